@@ -42,6 +42,7 @@
 /* ------------------------------ */
 #include "win32ex.h"						/* Needed for strcpy_m */
 #include "camera.h"
+#include "image_proc.h"
 #define INCLUDE_DCX_DETAIL_INFO
 #include "dcx.h"							/* DCX camera specific routines */
 
@@ -200,8 +201,8 @@ int DCx_GetCameraInfo(DCX_CAMERA *dcx, CAMERA_INFO *info) {
 	strcpy_m(info->version,			sizeof(info->version),		 dcx->CameraInfo.Version);
 	strcpy_m(info->date,				sizeof(info->date),			 dcx->CameraInfo.Date);
 
-	info->x_pixel_um = dcx->SensorInfo.wPixelSize / 100.0;		/* Strange units */
-	info->y_pixel_um = dcx->SensorInfo.wPixelSize / 100.0;
+	info->x_pixel_um = max(1,dcx->bin) * dcx->SensorInfo.wPixelSize / 100.0;		/* Strange units */
+	info->y_pixel_um = max(1,dcx->bin) * dcx->SensorInfo.wPixelSize / 100.0;
 	info->bColor     = dcx->SensorInfo.nColorMode != IS_COLORMODE_MONOCHROME;
 	info->height     = dcx->height;
 	info->width      = dcx->width;
@@ -1528,6 +1529,102 @@ int DCx_ResetRingCounters(DCX_CAMERA *dcx) {
 	return 0;
 }
 
+/* ===========================================================================
+-- Set sensor binning (same factor in x and y)
+--
+-- Usage: int DCx_SetBinning(DCX_CAMERA *dcx, int bin);
+--
+-- Inputs: dcx - structure associated with a camera
+--         bin - binning factor (1, 2 or 4)
+--
+-- Output: Stops the video, sets the binning, reallocates the ring at the
+--         binned size (same number of buffers) and restores the trigger mode
+--
+-- Return: 0 on success
+--           1 => no camera initialized
+--           2 => factor not supported by the sensor
+--           3 => SDK failed to set the binning
+--
+-- Note: Ring memory belongs to the SDK, so there is no software binning
+--       path for these cameras
+=========================================================================== */
+int DCx_SetBinning(DCX_CAMERA *dcx, int bin) {
+	static char *rname = "DCx_SetBinning";
+
+	int rc, mode, supported, nBuf;
+	TRIGGER_MODE trig_hold;
+
+	/* Must be valid structure */
+	if (dcx == NULL || dcx->hCam <= 0) return 1;
+
+	switch (bin) {
+		case 1:  mode = IS_BINNING_DISABLE; break;
+		case 2:  mode = IS_BINNING_2X_VERTICAL | IS_BINNING_2X_HORIZONTAL; break;
+		case 4:  mode = IS_BINNING_4X_VERTICAL | IS_BINNING_4X_HORIZONTAL; break;
+		default: return 2;
+	}
+	supported = is_SetBinning(dcx->hCam, IS_GET_SUPPORTED_BINNING);
+	if ((supported & mode) != mode) return 2;
+	if (bin == max(1,dcx->bin)) return 0;
+
+	/* Stop video and release the ring (sized for the old geometry) */
+	trig_hold = dcx->trigger.mode;
+	DCx_SetTriggerMode(dcx, TRIG_SOFTWARE, 0);
+	nBuf = dcx->nBuffers;
+	DCx_ReleaseRingBuffers(dcx);
+
+	rc = 0;
+	if (is_SetBinning(dcx->hCam, mode) != IS_SUCCESS) {
+		fprintf(stderr, "[%s] is_SetBinning(%d) failed\n", rname, bin); fflush(stderr);
+		rc = 3;
+	} else {
+		dcx->bin = bin;
+	}
+
+	/* Binned geometry from the selected format */
+	if (dcx->ImageFormatInfo != NULL) {
+		dcx->width  = dcx->ImageFormatInfo->nWidth  / max(1,dcx->bin);
+		dcx->height = dcx->ImageFormatInfo->nHeight / max(1,dcx->bin);
+	}
+	DCx_SetRingBufferSize(dcx, nBuf);
+
+	DCx_SetTriggerMode(dcx, trig_hold, 0);
+	return rc;
+}
+
+/* ===========================================================================
+-- Report the current binning
+--
+-- Usage: int DCx_GetBinning(DCX_CAMERA *dcx, BINNING_INFO *info);
+--
+-- Inputs: dcx  - structure associated with a camera
+--         info - pointer to structure to receive the state
+--
+-- Output: *info - factors, binned image size and pixel size
+--
+-- Return: 0 on success, 1 if no camera initialized
+=========================================================================== */
+int DCx_GetBinning(DCX_CAMERA *dcx, BINNING_INFO *info) {
+	static char *rname = "DCx_GetBinning";
+
+	int supported;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (dcx == NULL || dcx->hCam <= 0) return 1;
+	if (info == NULL) return 0;
+
+	supported = is_SetBinning(dcx->hCam, IS_GET_SUPPORTED_BINNING);
+	info->bin = info->hardware = max(1,dcx->bin);
+	info->software = 1;
+	info->max_hardware = ((supported & (IS_BINNING_4X_VERTICAL | IS_BINNING_4X_HORIZONTAL)) == (IS_BINNING_4X_VERTICAL | IS_BINNING_4X_HORIZONTAL)) ? 4 :
+								((supported & (IS_BINNING_2X_VERTICAL | IS_BINNING_2X_HORIZONTAL)) == (IS_BINNING_2X_VERTICAL | IS_BINNING_2X_HORIZONTAL)) ? 2 : 1 ;
+	info->width  = dcx->width;
+	info->height = dcx->height;
+	info->x_pixel_um = info->y_pixel_um = info->bin * dcx->SensorInfo.wPixelSize / 100.0;
+
+	return 0;
+}
+
 /* ===========================================================================
 -- Release ring buffers / memory associated with a camera.
 --
@@ -1879,6 +1976,8 @@ int DCx_GetImageInfo(DCX_CAMERA *dcx, int frame, IMAGE_INFO *info) {
 	info->frame  = frame;
 	info->width  = dcx->width;
 	info->height = dcx->height;
+	info->bin    = max(1,dcx->bin);
+	info->x_pixel_um = info->y_pixel_um = info->bin * dcx->SensorInfo.wPixelSize / 100.0;
 
 	is_GetImageMemPitch(hCam, &pitch);
 	info->memory_pitch = pitch;
@@ -1886,6 +1985,7 @@ int DCx_GetImageInfo(DCX_CAMERA *dcx, int frame, IMAGE_INFO *info) {
 	is_GetImageInfo(hCam, dcx->Image_PID[frame], &ImageInfo, sizeof(ImageInfo));
 	info->camera_time = ImageInfo.u64TimestampDevice*100E-9;
 	info->timestamp = TimeFromUC480Time(&ImageInfo.TimestampSystem);
+	info->imageID = (int) ImageInfo.u64FrameNumber;					/* Sequence from camera, unique since open */
 
 	is_Exposure(hCam, IS_EXPOSURE_CMD_GET_EXPOSURE, &rval, sizeof(rval));
 	info->exposure = rval;
@@ -1952,6 +2052,48 @@ int DCx_GetImageData(DCX_CAMERA *dcx, int frame, void **image_data, size_t *leng
 }
 
 
+/* ===========================================================================
+-- Describe the pixel layout of a specific image for the generic kernels
+--
+-- Usage: int DCx_GetImageBuffer(DCX_CAMERA *dcx, int frame, IMAGE_BUFFER *buffer);
+--
+-- Inputs: dcx    - an opened DCx camera
+--         frame  - index of frame to image (-1 = current)
+--                    invalid frame return error (rc = 2)
+--         buffer - pointer to structure to receive the description
+--
+-- Output: *buffer - format (PIXEL_BGR24 or PIXEL_MONO8), size, pitch and
+--                   pointer to the ring buffer memory (shared)
+--
+-- Return: 0 if successful, 
+--           1 => no camera initialized
+--           2 => frame invalid
+=========================================================================== */
+int DCx_GetImageBuffer(DCX_CAMERA *dcx, int frame, IMAGE_BUFFER *buffer) {
+	static char *rname = "DCx_GetImageBuffer";
+
+	int pitch;
+
+	if (buffer != NULL) memset(buffer, 0, sizeof(*buffer));
+
+	/* Make sure the structure is valid and there is still an opened camera */
+	if (dcx == NULL || dcx->hCam <= 0) return 1;
+
+	if (frame == -1) frame = dcx->iLast;								/* Last image */
+	if (frame < 0 || frame > dcx->nValid) return 2;
+	if (buffer == NULL) return 0;
+
+	is_GetImageMemPitch(dcx->hCam, &pitch);
+	buffer->format    = dcx->IsSensorColor ? PIXEL_BGR24 : PIXEL_MONO8 ;	/* Matches is_SetColorMode() */
+	buffer->width     = dcx->width;
+	buffer->height    = dcx->height;
+	buffer->pitch     = pitch;
+	buffer->bit_depth = 8;
+	buffer->data      = (void *) dcx->Image_Mem[frame];
+
+	return 0;
+}
+
 /* ===========================================================================
 -- Determine formats that camera supports for writing
 --
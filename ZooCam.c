@@ -63,9 +63,13 @@
 
 /* Load camera routines */
 #include "camera.h"							/* Call either DCX or TL versions */
+#include "image_proc.h"						/* Generic pixel kernels (HDR merge) */
+#include "perf.h"								/* Stage latency instrumentation */
 #include "dcx.h"								/* DCX API camera routines & info */
 #define INCLUDE_TL_DETAIL_INFO
 #include "tl.h"								/* TL  API camera routines & info */
+#define INCLUDE_SIM_DETAIL_INFO
+#include "sim.h"								/* Synthetic camera (load testing) */
 
 /* Load the full WND detail */
 #define	INCLUDE_WND_DETAIL_INFO			/* Get all of the typedefs and internal details */
@@ -92,6 +96,13 @@
 #define	DFLT_FPS_MAX				(25)					/* Default range for FPS scale */
 #define	MAX_FRAME_DISPLAY_HZ		(8)					/* Limit CPU consumed rendering images */
 
+/* DCx enumeration run alongside the TL discovery (see Fill_Camera_List_Control) */
+typedef struct _DCX_ENUM {
+	int count;
+	UC480_CAMERA_INFO *details;
+	HANDLE done;
+} DCX_ENUM;
+
 /* ------------------------------- */
 /* My external function prototypes */
 /* ------------------------------- */
@@ -106,8 +117,55 @@ int InitializeHistogramCurves(HWND hdlg, WND_INFO *wnd);
 void FreeCurve(GRAPH_CURVE *cv);
 
 static void AutoExposureThread(void *arglist);
+static int pretrigger_burst(WND_INFO *wnd, HWND hdlg, HANDLE start, HANDLE end);
+static BOOL copy_segment_frame(WND_INFO *wnd, int imageID, SEGMENT_FRAME *dst);
+static void free_segment(BURST_SEGMENT *segment);
+static int  ring_new_frames(WND_INFO *wnd, int last_id, int nmax, int *frames, int *ids, int *skipped);
+static int  stream_burst_start(WND_INFO *wnd);
+static void stream_burst_capture(WND_INFO *wnd, HANDLE end);
+static void stream_burst_finish(WND_INFO *wnd);
+static void stream_writer_thread(void *arglist);
+static void autosave_reset(WND_INFO *wnd);
+static void autosave_enqueue(WND_INFO *wnd);
+static void autosave_writer_thread(void *arglist);
+static void autosave_stop(WND_INFO *wnd);
+static BOOL autosave_gate_check(WND_INFO *wnd, int frame, IMAGE_INFO *info, AUTOSAVE_GATE *parms, double *metric, char **reason, int *npreview);
+static int  hdr_capture(WND_INFO *wnd, double ms, BOOL bTrigger, int *last_id, IMAGE_BUFFER *copy, int *size, IMAGE_INFO *info);
+static void hdr_bracket_thread(void *arglist);
+static void paint_rgb24(HWND hwnd, unsigned char *bits, int width, int height);
+static void accum_thread(void *arglist);
+static BOOL accum_add_frame(WND_INFO *wnd, int frame, int imageID);
+static BOOL accum_alloc(WND_INFO *wnd, IMAGE_BUFFER *layout);
+static void accum_free(WND_INFO *wnd);
+static float *accum_result(WND_INFO *wnd, int frame);
+static void calib_init(WND_INFO *wnd);
+static void calib_free(WND_INFO *wnd);
+static void calib_dark_at(WND_INFO *wnd, double ms, unsigned short *out);
+static BOOL calib_prepare(WND_INFO *wnd, double ms);
+static int  calib_check_camera(WND_INFO *wnd);
+static int calib_filter(void *context, const unsigned short *src, unsigned short *dst, int width, int height, int imageID);
+static void calib_self_check(WND_INFO *wnd);
+static BOOL calib_read_header(char *fname, CALIB_FILE_HEADER *header);
+static int calib_accum_mean(WND_INFO *wnd, float **mean, int *width, int *height, int *format, int *bit_depth, double *ms, double *dB);
+static int calib_install(WND_INFO *wnd);
+static void roi_init(WND_INFO *wnd);
+static struct _ROI_STREAM *roi_find(WND_INFO *wnd, char *name);
+static void roi_free(struct _ROI_STREAM *roi);
+static BOOL roi_layout(struct _ROI_STREAM *roi, IMAGE_BUFFER *src);
+static void roi_stream_capture(WND_INFO *wnd);
+static void multi_init(WND_INFO *wnd);
+static struct _MULTI_CAPTURE *multi_find(WND_INFO *wnd, void *tl);
+static int multi_camera_id(void *tl);
+static BOOL multi_is_main(WND_INFO *wnd, void *tl);
+static double multi_fps(struct _MULTI_CAPTURE *cap);
+static void multi_capture_thread(void *arglist);
+static void multi_align(struct _MULTI_CAPTURE *rcap, struct _MULTI_CAPTURE *cap, MULTI_ALIGN_INFO *info);
+static void dcx_enum_thread(void *arglist);
 
 static void show_sharpness_dialog_thread(void *arglist);
+static void show_perf_dialog_thread(void *arglist);
+static void perf_fill_table(HWND hdlg);
+BOOL CALLBACK PerfStatsDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam);
 BOOL CALLBACK DCX_CameraInfoDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam);
 BOOL CALLBACK TL_CameraInfoDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam);
 BOOL CALLBACK NUMATODlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -119,6 +177,7 @@ BOOL CALLBACK CameraIDConfigDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM l
 static int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *camera);
 static int DCx_CameraOpen(HWND hdlg, WND_INFO *wnd, DCX_CAMERA *dcx, UC480_CAMERA_INFO *info);
 static int TL_CameraOpen(HWND hdlg, WND_INFO *wnd, TL_CAMERA *tl);
+static int SIM_CameraOpen(HWND hdlg, WND_INFO *wnd, SIM_CAMERA *sim);
 
 static int Camera_Close(HWND hdlg, WND_INFO *wnd);
 static int DCx_CameraClose(HWND hdlg, WND_INFO *wnd, DCX_CAMERA *dcx, UC480_CAMERA_INFO *info);
@@ -127,6 +186,7 @@ static int TL_CameraClose(HWND hdlg, WND_INFO *wnd, TL_CAMERA *tl);
 static int Camera_ShowImage(WND_INFO *wnd, int frame, int *pSharp);
 static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp);
 static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp);
+static int SIM_ShowImage(WND_INFO *wnd, int index, int *pSharp);
 
 static void Camera_Info_Thread(void *arglist);
 
@@ -167,6 +227,14 @@ static sig_atomic_t TL_Process_Image_Thread_Abort  = FALSE;	/* Abort when no lon
 static HANDLE TL_Process_Image_Thread_Trigger = NULL;
 static void TL_ImageThread(void *arglist);
 
+static sig_atomic_t SIM_Process_Image_Thread_Active = FALSE;
+static sig_atomic_t SIM_Process_Image_Thread_Abort  = FALSE;
+
+static HANDLE SIM_Process_Image_Thread_Trigger = NULL;
+static void SIM_ImageThread(void *arglist);
+
+static BOOL sim_camera_enabled = FALSE;							/* -sim on the command line lists the synthetic camera */
+
 static HINSTANCE hInstance=NULL;
 static HWND float_image_hwnd;										/* Handle to free-floating image window */
 
@@ -635,6 +703,10 @@ static void AutoExposureThread(void *arglist) {
 -- Notes: 1) Expecting that the camera is in TRIG_BURST mode
 --        2) Opens semaphores to LasGo for stripe start/end signals
 --        3) Waits for start semaphore, or flag to abort
+--        4) If pre-trigger frames are configured, pretrigger_burst() runs
+--           instead so the start of the stripe is not lost
+--        5) If streaming is enabled, frames are written while running and
+--           the burst is only COMPLETE once all are on disk
 =========================================================================== */
 static void trigger_burst_mode(void *arglist) {
 
@@ -643,6 +715,7 @@ static void trigger_burst_mode(void *arglist) {
 	HANDLE start, end;
 	char szTmp[256];
 	int rc;
+	BOOL bStream = FALSE;
 
 	static sig_atomic_t active=FALSE;
 
@@ -664,6 +737,24 @@ static void trigger_burst_mode(void *arglist) {
 		goto BurstThreadFail;
 	}
 
+	/* Pre-trigger mode ... camera is already recording when the stripe starts */
+	if (wnd->pretrigger.npre > 0 || wnd->pretrigger.npost > 0) {
+		rc = pretrigger_burst(wnd, hdlg, start, end);
+		if (rc == 1) goto BurstThreadAbort;
+		if (rc != 0) goto BurstThreadFail;
+		wnd->BurstModeStatus = BURST_STATUS_COMPLETE;
+		goto BurstThreadExit;
+	}
+
+	/* Writer thread ready before anything can arrive */
+	if (wnd->stream.enabled) {
+		if (stream_burst_start(wnd) != 0) {
+			MessageBox(NULL, "Unable to start the streaming burst writer", "Image Burst Capture Failed", MB_ICONERROR | MB_OK);
+			goto BurstThreadFail;
+		}
+		bStream = TRUE;
+	}
+
 	/* Wait for the start semaphore from a stripe */
 	/* Use 500 ms wait to be able to watch for aborts */
 	Camera_Arm(wnd, TRIG_ARM);											/* Arm the camera ... */
@@ -686,9 +777,20 @@ static void trigger_burst_mode(void *arglist) {
 	if (hdlg != NULL) SetDlgItemCheck(hdlg, IDC_LIVE, TRUE);	/* Show triggered state in the button */
 
 	/* Wait for the end signal ... but never more than 10 seconds */
-	rc = WaitForSingleObject(end, 10000);
+	if (bStream) {
+		stream_burst_capture(wnd, end);						/* Queues frames to the writer while waiting */
+	} else {
+		rc = WaitForSingleObject(end, 10000);
+	}
 	Camera_Arm(wnd, TRIG_DISARM);
 	if (hdlg != NULL) SetDlgItemCheck(hdlg, IDC_LIVE, FALSE);
+
+	/* Only complete once the writer has everything on disk */
+	if (bStream) {
+		if (hdlg != NULL) SetDlgItemText(hdlg, IDC_ARM, "Burst: writing");
+		stream_burst_finish(wnd);
+		bStream = FALSE;
+	}
 	wnd->BurstModeStatus = BURST_STATUS_COMPLETE;
 	goto BurstThreadExit;
 
@@ -701,6 +803,7 @@ BurstThreadAbort:
 	goto BurstThreadExit;
 
 BurstThreadExit:
+	if (bStream) stream_burst_finish(wnd);				/* Keep whatever arrived before an abort */
 	if (hdlg != NULL)  SetDlgItemText(hdlg, IDC_ARM, "Burst: standby");
 	if (start != NULL) CloseHandle(start);
 	if (end   != NULL) CloseHandle(end);
@@ -713,6 +816,845 @@ BurstThreadExit:
 	return;
 }
 
+/* ===========================================================================
+-- Pre-trigger variant of the burst thread (called from trigger_burst_mode)
+--
+-- Usage: static int pretrigger_burst(WND_INFO *wnd, HWND hdlg, HANDLE start, HANDLE end);
+--
+-- Inputs: wnd   - pointer to the WND_INFO structure
+--         hdlg  - dialog for status text (or NULL)
+--         start - LasGoStripeStart event
+--         end   - LasGoStripeEnd event
+--
+-- Output: Starts capture immediately so the ring is always recording.  When
+--         start (or BURST_MARK) fires, the newest frame in the ring becomes
+--         the trigger frame.  The npre frames before it are copied out at
+--         once and the following npost frames are copied as they arrive.
+--         Frames are found by walking the ring, since imageIDs are shared
+--         by every camera and one camera's are not consecutive.
+--         The finished segment replaces wnd->pretrigger.segment and status
+--         becomes BURST_STATUS_COMPLETE while the camera keeps running until
+--         the end event (at most 10 s).
+--
+-- Return: 0 ==> segment captured
+--         1 ==> aborted
+--         2 ==> failed (ring too small, no memory, ...)
+=========================================================================== */
+#define	PRETRIGGER_POLL_MS	(2)						/* Check for new post-trigger frames */
+#define	PRETRIGGER_MAX_MS		(10000)					/* Give up on post-trigger frames */
+
+static int pretrigger_burst(WND_INFO *wnd, HWND hdlg, HANDLE start, HANDLE end) {
+	static char *rname = "pretrigger_burst";
+
+	HANDLE events[2];
+	BURST_SEGMENT *segment, *old;
+	IMAGE_INFO info;
+	RING_INFO rings;
+	int i, n, k, rc, npre, npost, nring, frame, last_id, prev_id, skipped;
+	int *frames, *ids;
+	double trigger_time;
+	HIRES_TIMER *timer;
+
+	npre  = wnd->pretrigger.npre;
+	npost = wnd->pretrigger.npost;
+	if (wnd->pretrigger.mark == NULL) wnd->pretrigger.mark = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (wnd->pretrigger.mutex == NULL) wnd->pretrigger.mutex = CreateMutex(NULL, FALSE, NULL);
+	if (wnd->pretrigger.mark == NULL || wnd->pretrigger.mutex == NULL) return 2;
+
+	/* Ring must hold the pre-trigger frames plus some slack while copying */
+	if (Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers < npre+2) {
+		fprintf(stderr, "[%s] Ring (%d buffers) too small for %d pre-trigger frames\n", rname, rings.nBuffers, npre); fflush(stderr);
+		return 2;
+	}
+
+	if ( (segment = calloc(1, sizeof(*segment))) == NULL) return 2;
+	segment->nframes = npre + 1 + npost;
+	segment->trigger_index = npre;
+	if ( (segment->frames = calloc(segment->nframes, sizeof(*segment->frames))) == NULL) { free(segment); return 2; }
+	nring  = rings.nBuffers;
+	frames = calloc(nring, sizeof(*frames));
+	ids    = calloc(nring, sizeof(*ids));
+	if (frames == NULL || ids == NULL) {
+		if (frames != NULL) free(frames);
+		if (ids    != NULL) free(ids);
+		free_segment(segment);
+		return 2;
+	}
+
+	/* Start recording now ... the ring keeps the history */
+	ResetEvent(wnd->pretrigger.mark);
+	Camera_Arm(wnd, TRIG_ARM);
+	Camera_Trigger(wnd);
+	if (hdlg != NULL) SetDlgItemText(hdlg, IDC_ARM, "Burst: pre-trigger");
+	if (hdlg != NULL) SetDlgItemCheck(hdlg, IDC_LIVE, TRUE);
+	wnd->BurstModeStatus = BURST_STATUS_ARMED;
+
+	/* Wait for the stripe start or a marker from the server (500 ms only to watch for aborts) */
+	events[0] = start; events[1] = wnd->pretrigger.mark;
+	while (TRUE) {
+		if (! wnd->BurstModeActive) { rc = 1; goto PretriggerExit; }
+		rc = WaitForMultipleObjects(2, events, FALSE, 500);
+		if (rc == WAIT_OBJECT_0 || rc == WAIT_OBJECT_0+1) break;
+		if (rc == WAIT_TIMEOUT) continue;
+		fprintf(stderr, "[%s] Wait for stripe start returned error (rc=%d)\n", rname, rc); fflush(stderr);
+		rc = 2; goto PretriggerExit;
+	}
+
+	/* The newest frame right now is the trigger frame */
+	wnd->BurstModeStatus = BURST_STATUS_RUNNING;
+	if (hdlg != NULL) SetDlgItemText(hdlg, IDC_ARM, "Burst: running");
+	if (Camera_GetImageInfo(wnd, -1, &info) != 0 || info.imageID < 0) { rc = 2; goto PretriggerExit; }
+	segment->trigger_imageID = info.imageID;
+	trigger_time = info.camera_time;
+
+	/* Trigger frame and the pre-trigger frames are in the ring now ... grab before overwritten */
+	prev_id = segment->trigger_imageID+1;
+	if (Camera_GetRingInfo(wnd, &rings) == 0) {
+		for (n=0,i=0; i<rings.nBuffers && n<=npre; i++) {
+			frame = (rings.iLast - i + rings.nBuffers) % rings.nBuffers;
+			if (Camera_GetImageInfo(wnd, frame, &info) != 0 || info.imageID < 0) break;
+			if (n == 0 && info.imageID > segment->trigger_imageID) continue;		/* Arrived since the trigger */
+			if (info.imageID >= prev_id) break;												/* Ring wrapped while walking */
+			prev_id = info.imageID;
+			if (copy_segment_frame(wnd, info.imageID, &segment->frames[npre-n])) segment->nvalid++;
+			n++;
+		}
+	}
+
+	/* Post-trigger frames as they arrive (oldest first; frames passed over stay empty) */
+	timer = HiResTimerCreate();
+	last_id = segment->trigger_imageID;
+	n = 0;
+	while (n < npost) {
+		if (! wnd->BurstModeActive) { HiResTimerDestroy(timer); rc = 1; goto PretriggerExit; }
+		if (HiResTimerDelta(timer) > 0.001*PRETRIGGER_MAX_MS) break;
+		if ( (k = ring_new_frames(wnd, last_id, nring, frames, ids, &skipped)) == 0) { Sleep(PRETRIGGER_POLL_MS); continue; }
+		n += min(skipped, npost-n);
+		for (i=k-1; i>=0 && n<npost; i--,n++) {
+			if (copy_segment_frame(wnd, ids[i], &segment->frames[npre+1+n])) segment->nvalid++;
+		}
+		last_id = ids[0];
+	}
+	HiResTimerDestroy(timer);
+
+	/* Latency relative to the trigger frame (camera clock) */
+	for (i=0; i<segment->nframes; i++) {
+		if (segment->frames[i].data != NULL) segment->frames[i].latency_ms = 1000.0*(segment->frames[i].info.camera_time - trigger_time);
+	}
+
+	/* Freeze ... replaces the previous segment */
+	WaitForSingleObject(wnd->pretrigger.mutex, INFINITE);
+	old = wnd->pretrigger.segment;
+	wnd->pretrigger.segment = segment;
+	ReleaseMutex(wnd->pretrigger.mutex);
+	free_segment(old);
+	segment = NULL;
+	wnd->BurstModeStatus = BURST_STATUS_COMPLETE;
+	fprintf(stderr, "[%s] Segment frozen: trigger imageID %d, %d of %d frames\n", rname, wnd->pretrigger.segment->trigger_imageID, wnd->pretrigger.segment->nvalid, wnd->pretrigger.segment->nframes); fflush(stderr);
+
+	/* Keep recording until the end of the stripe, like the normal burst */
+	for (i=0; i<PRETRIGGER_MAX_MS/500 && wnd->BurstModeActive; i++) {
+		if (WaitForSingleObject(end, 500) == WAIT_OBJECT_0) break;
+	}
+	rc = 0;
+
+PretriggerExit:
+	Camera_Arm(wnd, TRIG_DISARM);
+	if (hdlg != NULL) SetDlgItemCheck(hdlg, IDC_LIVE, FALSE);
+	free_segment(segment);
+	free(frames); free(ids);
+	return rc;
+}
+
+/* ===========================================================================
+-- Copy one frame (by imageID) out of the ring into a segment entry
+--
+-- Usage: static BOOL copy_segment_frame(WND_INFO *wnd, int imageID, SEGMENT_FRAME *dst);
+--
+-- Return: TRUE if copied, FALSE if the image is no longer (or not yet) in the ring
+=========================================================================== */
+static BOOL copy_segment_frame(WND_INFO *wnd, int imageID, SEGMENT_FRAME *dst) {
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	void *memory;
+	int i, frame, length;
+
+	if (imageID < 0 || Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers <= 0) return FALSE;
+
+	/* Most recent first ... that is where we usually are */
+	for (i=0; i<rings.nBuffers; i++) {
+		frame = (rings.iLast - i + rings.nBuffers) % rings.nBuffers;
+		if (Camera_GetImageInfo(wnd, frame, &info) == 0 && info.imageID == imageID) break;
+	}
+	if (i >= rings.nBuffers) return FALSE;
+	if (Camera_GetImageData(wnd, frame, &memory, &length) != 0 || memory == NULL || length <= 0) return FALSE;
+	if ( (dst->data = malloc(length)) == NULL) return FALSE;
+	memcpy(dst->data, memory, length);
+
+	/* Make sure the slot wasn't reused while copying */
+	if (Camera_GetImageInfo(wnd, frame, &dst->info) != 0 || dst->info.imageID != imageID) {
+		free(dst->data); dst->data = NULL;
+		return FALSE;
+	}
+	dst->length = length;
+	return TRUE;
+}
+
+static void free_segment(BURST_SEGMENT *segment) {
+	int i;
+
+	if (segment == NULL) return;
+	if (segment->frames != NULL) {
+		for (i=0; i<segment->nframes; i++) if (segment->frames[i].data != NULL) free(segment->frames[i].data);
+		free(segment->frames);
+	}
+	free(segment);
+	return;
+}
+
+/* ===========================================================================
+-- Collect the ring frames newer than the last one handled
+--
+-- Usage: static int ring_new_frames(WND_INFO *wnd, int last_id, int nmax, int *frames, int *ids, int *skipped);
+--
+-- Inputs: wnd     - pointer to the WND_INFO structure
+--         last_id - imageID of the newest frame already handled
+--         nmax    - size of the frames[] and ids[] arrays
+--         frames  - receives ring indices, newest first
+--         ids     - receives the matching imageIDs
+--         skipped - receives the number of new frames beyond nmax (may be NULL)
+--
+-- Output: Walks back from the newest frame until an imageID at or before
+--         last_id.  Only the newest nmax are returned; the older ones are
+--         counted in *skipped and the caller must count them as lost, since
+--         moving last_id to ids[0] passes over them for good.
+--
+-- Return: number of frames in frames[] / ids[]
+=========================================================================== */
+#define	RING_WALK_MAX			(64)						/* Frames taken per signal by the fixed-size walkers */
+
+static int ring_new_frames(WND_INFO *wnd, int last_id, int nmax, int *frames, int *ids, int *skipped) {
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	int i, n, extra, frame;
+
+	n = extra = 0;
+	if (Camera_GetRingInfo(wnd, &rings) == 0) {
+		for (i=0; i<rings.nBuffers; i++) {
+			frame = (rings.iLast - i + rings.nBuffers) % rings.nBuffers;
+			if (Camera_GetImageInfo(wnd, frame, &info) != 0 || info.imageID <= last_id) break;
+			if (n < nmax) {
+				ids[n] = info.imageID; frames[n] = frame; n++;
+			} else {
+				extra++;
+			}
+		}
+	}
+	if (skipped != NULL) *skipped = extra;
+	if (extra > 0) Perf_Count(PERF_FRAMES_OVERWRITTEN, extra);
+	return n;
+}
+
+/* ===========================================================================
+-- Streaming burst writer (frames saved while the burst is running)
+--
+-- Usage: static int  stream_burst_start(WND_INFO *wnd);
+--        static void stream_burst_capture(WND_INFO *wnd, HANDLE end);
+--        static void stream_burst_finish(WND_INFO *wnd);
+--
+-- Inputs: wnd - pointer to the WND_INFO structure
+--         end - LasGoStripeEnd event
+--
+-- Output: start   - allocates the queue (one entry per ring buffer) and
+--                   starts stream_writer_thread() on wnd->stream.pattern
+--         capture - after Camera_Trigger(), queues each new frame until
+--                   the end event, an abort, or 10 s
+--         finish  - tells the writer no more frames are coming and waits
+--                   until it has written and closed everything
+--
+--         The pattern and format are copied at the start, so Burst_Set_Stream()
+--         during a burst only affects the next one.
+--
+-- Return: start - 0 if running, !0 on failure
+--
+-- Notes: The ring itself holds the pixels until the writer saves them with
+--        Camera_SaveImage(), so the writer has (ring size - 1) frames of
+--        slack.  A frame overwritten before (or while) being saved is counted
+--        as lost and left out of the .csv.
+=========================================================================== */
+#define	STREAM_POLL_MS		(2)						/* Check for new frames while running */
+#define	STREAM_MAX_MS		(10000)					/* Same limit as the normal burst */
+
+static int stream_burst_start(WND_INFO *wnd) {
+	static char *rname = "stream_burst_start";
+
+	RING_INFO rings;
+
+	if (Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers <= 0) return 1;
+	if (! wnd->stream.lock_init) {
+		InitializeCriticalSection(&wnd->stream.lock);
+		wnd->stream.lock_init = TRUE;
+	}
+	if (wnd->stream.wake == NULL) wnd->stream.wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (wnd->stream.done == NULL) wnd->stream.done = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if (wnd->stream.wake == NULL || wnd->stream.done == NULL) return 2;
+
+	EnterCriticalSection(&wnd->stream.lock);
+	if (wnd->stream.queue != NULL) free(wnd->stream.queue);
+	wnd->stream.nqueue = rings.nBuffers;
+	wnd->stream.queue  = calloc(wnd->stream.nqueue, sizeof(*wnd->stream.queue));
+	wnd->stream.head   = wnd->stream.tail = 0;
+	wnd->stream.frames = wnd->stream.written = wnd->stream.lost = 0;
+	wnd->stream.capture_done = FALSE;
+	strcpy_s(wnd->stream.active_pattern, sizeof(wnd->stream.active_pattern), wnd->stream.pattern);
+	wnd->stream.active_format = wnd->stream.format;
+	LeaveCriticalSection(&wnd->stream.lock);
+	if (wnd->stream.queue == NULL) return 3;
+
+	ResetEvent(wnd->stream.done);
+	if (_beginthread(stream_writer_thread, 0, wnd) == -1L) {
+		fprintf(stderr, "[%s] Unable to start the writer thread\n", rname); fflush(stderr);
+		SetEvent(wnd->stream.done);
+		return 4;
+	}
+	return 0;
+}
+
+static void stream_burst_capture(WND_INFO *wnd, HANDLE end) {
+
+	IMAGE_INFO info;
+	RING_INFO rings;
+	int i, n, last_id, skipped, *ids, *frames;
+	HIRES_TIMER *timer;
+	BOOL bEnd;
+
+	/* Anything at or before this imageID was in the ring before the trigger */
+	last_id = (Camera_GetImageInfo(wnd, -1, &info) == 0) ? info.imageID : -1;
+	if (Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers <= 0) return;
+	ids    = calloc(rings.nBuffers, sizeof(*ids));
+	frames = calloc(rings.nBuffers, sizeof(*frames));
+	if (ids == NULL || frames == NULL) goto StreamCaptureExit;
+
+	timer = HiResTimerCreate();
+	bEnd = FALSE;
+	while (! bEnd) {
+		bEnd = (WaitForSingleObject(end, STREAM_POLL_MS) == WAIT_OBJECT_0) ||
+				 ! wnd->BurstModeActive || HiResTimerDelta(timer) > 0.001*STREAM_MAX_MS;
+
+		/* Walk back from the newest frame to the last one already queued */
+		if ( (n = ring_new_frames(wnd, last_id, rings.nBuffers, frames, ids, &skipped)) == 0) continue;
+
+		/* Queue oldest first */
+		EnterCriticalSection(&wnd->stream.lock);
+		wnd->stream.lost   += skipped;							/* Ring was reallocated larger */
+		wnd->stream.frames += skipped;
+		for (i=n-1; i>=0; i--) {
+			if (Camera_GetImageInfo(wnd, frames[i], &info) != 0 || info.imageID != ids[i]) {
+				wnd->stream.lost++;
+				Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+			} else if (wnd->stream.head - wnd->stream.tail >= wnd->stream.nqueue) {
+				wnd->stream.lost++;								/* Writer too far behind */
+				Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+			} else {
+				wnd->stream.queue[wnd->stream.head % wnd->stream.nqueue].index = wnd->stream.frames;
+				wnd->stream.queue[wnd->stream.head % wnd->stream.nqueue].info  = info;
+				wnd->stream.head++;
+			}
+			wnd->stream.frames++;
+		}
+		LeaveCriticalSection(&wnd->stream.lock);
+		last_id = ids[0];
+		SetEvent(wnd->stream.wake);
+	}
+	HiResTimerDestroy(timer);
+
+StreamCaptureExit:
+	if (ids    != NULL) free(ids);
+	if (frames != NULL) free(frames);
+	return;
+}
+
+static void stream_burst_finish(WND_INFO *wnd) {
+
+	if (wnd->stream.done == NULL) return;
+	wnd->stream.capture_done = TRUE;
+	SetEvent(wnd->stream.wake);
+	WaitForSingleObject(wnd->stream.done, INFINITE);
+	return;
+}
+
+/* ===========================================================================
+-- Thread writing queued burst frames and the .csv (see stream_burst_start)
+--
+-- Usage: _beginthread(stream_writer_thread, 0, wnd);
+--
+-- Inputs: arglist - pointer to the WND_INFO structure
+--
+-- Output: <pattern>.csv and <pattern>_ddd.ext exactly as TL_SaveBurstImages.
+--         The .csv is committed to disk before wnd->stream.done is set.
+=========================================================================== */
+static void stream_writer_thread(void *arglist) {
+	static char *rname = "stream_writer_thread";
+
+	WND_INFO *wnd;
+	struct _STREAM_ENTRY entry;
+	IMAGE_INFO info;
+	char pathname[PATH_MAX], *extension;
+	struct tm tm;
+	double tstart;
+	FILE *funit;
+	BOOL have, done;
+
+	wnd = (WND_INFO *) arglist;
+	Perf_TraceThreadName(rname);
+
+	/* Open a .csv log file with information on each image */
+	sprintf_s(pathname, sizeof(pathname), "%s.csv", wnd->stream.active_pattern);
+	if (fopen_s(&funit, pathname, "w") != 0) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, pathname); fflush(stderr);
+		funit = NULL;
+	}
+	if (funit != NULL) fprintf(funit, "/* Index,filename,t_relative,t_time,t_clock\n");
+	extension = (wnd->stream.active_format == FILE_RAW) ? "raw" : "bmp";
+
+	tstart = -999;												/* Flag to copy first available value */
+	while (TRUE) {
+		EnterCriticalSection(&wnd->stream.lock);
+		if ( (have = (wnd->stream.tail != wnd->stream.head)) ) {
+			entry = wnd->stream.queue[wnd->stream.tail % wnd->stream.nqueue];
+			wnd->stream.tail++;
+		}
+		done = wnd->stream.capture_done;
+		LeaveCriticalSection(&wnd->stream.lock);
+
+		if (! have) {
+			if (done) break;
+			WaitForSingleObject(wnd->stream.wake, 100);
+			continue;
+		}
+
+		/* Save straight from the ring, then make sure the slot was not reused meanwhile */
+		sprintf_s(pathname, sizeof(pathname), "%s_%3.3d.%s", wnd->stream.active_pattern, entry.index, extension);
+		Perf_TraceBegin("Stream write", entry.info.imageID);
+		if (Camera_GetImageInfo(wnd, entry.info.frame, &info) != 0 || info.imageID != entry.info.imageID ||
+			 Camera_SaveImage(wnd, entry.info.frame, pathname, wnd->stream.active_format) != 0 ||
+			 Camera_GetImageInfo(wnd, entry.info.frame, &info) != 0 || info.imageID != entry.info.imageID) {
+			Perf_TraceEnd("Stream write", entry.info.imageID);
+			remove(pathname);
+			InterlockedIncrement(&wnd->stream.lost);
+			continue;
+		}
+		Perf_TraceEnd("Stream write", entry.info.imageID);
+
+		/* Put an entry in the logfile */
+		if (tstart == -999) tstart = entry.info.camera_time;
+		_localtime64_s(&tm, &entry.info.timestamp);
+		if (funit != NULL) {
+			fprintf(funit, "%d,%s,%.4f,%lld,%4.4d.%2.2d.%2.2d %2.2d:%2.2d:%2.2d.%3.3d\n", 
+					  entry.index, pathname, entry.info.camera_time-tstart, entry.info.timestamp,
+					  tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, 0);
+		}
+		InterlockedIncrement(&wnd->stream.written);
+	}
+
+	/* Durable before reporting complete */
+	if (funit != NULL) {
+		fflush(funit);
+		_commit(_fileno(funit));
+		fclose(funit);
+	}
+	SetEvent(wnd->stream.done);
+	return;
+}
+
+/* ===========================================================================
+-- Autosave queue (frames saved by imageID on writer threads)
+--
+-- Usage: static void autosave_reset(WND_INFO *wnd);
+--        static void autosave_enqueue(WND_INFO *wnd);
+--        static void autosave_stop(WND_INFO *wnd);
+--
+-- Inputs: wnd - pointer to the WND_INFO structure
+--
+-- Output: reset   - (re)sizes the queue to the ring and starts after the
+--                   newest frame, so only frames arriving later are saved
+--         enqueue - called by the image thread on every new image signal.
+--                   Walks back from the newest frame to the last one
+--                   considered and queues each (oldest first) with the next
+--                   filename index.  Frames arriving in free run are passed
+--                   over, as before.  With the change gate enabled, frames
+--                   too similar to the last one saved are skipped (see
+--                   Autosave_Gate) and each decision is logged.
+--         stop    - tells the writers to exit and waits until all have,
+--                   so wnd may be freed.  No writer starts afterwards.
+--
+-- Notes: The image event is auto-reset, so one signal may cover several
+--        frames; walking the ring by imageID saves each exactly once.  The
+--        queue holds at most one ring's worth of frames (anything older is
+--        overwritten anyway); a full queue drops the frame and counts it
+--        rather than block the caller.  The writers save straight from the
+--        ring and check the imageID was not reused while saving.
+=========================================================================== */
+#define	AUTOSAVE_WRITERS		(2)						/* I/O threads servicing the queue */
+
+static void autosave_reset(WND_INFO *wnd) {
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	int nqueue;
+
+	if (! wnd->autosave.lock_init) {
+		InitializeCriticalSection(&wnd->autosave.lock);
+		wnd->autosave.lock_init = TRUE;
+	}
+	if (wnd->autosave.wake == NULL) wnd->autosave.wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (wnd->autosave.idle == NULL) wnd->autosave.idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+	nqueue = (Camera_GetRingInfo(wnd, &rings) == 0 && rings.nBuffers > 0) ? rings.nBuffers : 1 ;
+
+	EnterCriticalSection(&wnd->autosave.lock);
+	if (nqueue != wnd->autosave.nqueue || wnd->autosave.queue == NULL) {
+		if (wnd->autosave.head != wnd->autosave.tail) wnd->autosave.dropped += wnd->autosave.head - wnd->autosave.tail;
+		if (wnd->autosave.queue != NULL) free(wnd->autosave.queue);
+		wnd->autosave.queue  = calloc(nqueue, sizeof(*wnd->autosave.queue));
+		wnd->autosave.nqueue = (wnd->autosave.queue != NULL) ? nqueue : 0 ;
+		wnd->autosave.head   = wnd->autosave.tail = 0;
+	}
+	wnd->autosave.last_id = (Camera_GetImageInfo(wnd, -1, &info) == 0) ? info.imageID : -1 ;
+	*wnd->autosave.last_fname = '\0';
+	wnd->autosave.last_failed = FALSE;
+	if (wnd->autosave.gate.log != NULL) { fclose(wnd->autosave.gate.log); wnd->autosave.gate.log = NULL; }		/* Directory may have changed */
+	wnd->autosave.gate.nref = 0;											/* Next frame is always saved */
+	wnd->autosave.gate.last_metric = -1;
+	LeaveCriticalSection(&wnd->autosave.lock);
+	return;
+}
+
+static void autosave_enqueue(WND_INFO *wnd) {
+	static char *rname = "autosave_enqueue";
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	TRIGGER_MODE mode;
+	AUTOSAVE_GATE gate;
+	unsigned char *swap;
+	char fname[PATH_MAX];
+	int i, n, newest, depth, last_id, skipped, npreview;
+	int frames[RING_WALK_MAX], ids[RING_WALK_MAX];	/* More than this per signal are counted lost */
+	int index[RING_WALK_MAX];								/* Filename index given (-1 ==> not queued) */
+	double metric[RING_WALK_MAX], camera_time[RING_WALK_MAX];
+	char *reason[RING_WALK_MAX];
+	BOOL save[RING_WALK_MAX], bGate;
+
+	if (! wnd->autosave.lock_init) autosave_reset(wnd);
+	if (Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers <= 0) return;
+	if (rings.nBuffers != wnd->autosave.nqueue) autosave_reset(wnd);		/* Ring was reallocated */
+
+	/* Walk back from the newest frame to the last one already considered */
+	EnterCriticalSection(&wnd->autosave.lock);
+	last_id = wnd->autosave.last_id;
+	LeaveCriticalSection(&wnd->autosave.lock);
+	if ( (n = ring_new_frames(wnd, last_id, RING_WALK_MAX, frames, ids, &skipped)) == 0) return;
+	newest = ids[0];
+
+	/* But only if not LiveVideo */
+	mode = Camera_GetTriggerMode(wnd, NULL);
+	if (mode != TRIG_SOFTWARE && mode != TRIG_EXTERNAL && mode != TRIG_SS) {
+		EnterCriticalSection(&wnd->autosave.lock);
+		if (newest > wnd->autosave.last_id) wnd->autosave.last_id = newest;
+		LeaveCriticalSection(&wnd->autosave.lock);
+		return;
+	}
+
+	/* Gate settings as of this signal */
+	EnterCriticalSection(&wnd->autosave.lock);
+	gate = wnd->autosave.gate.parms;
+	wnd->autosave.lost += skipped;							/* Any past RING_WALK_MAX were older still */
+	LeaveCriticalSection(&wnd->autosave.lock);
+	bGate = gate.enable;
+
+	/* Oldest first: gate outside the lock (only this thread uses the previews), then queue */
+	for (i=n-1; i>=0; i--) {
+		save[i] = TRUE; metric[i] = -1; reason[i] = "save"; camera_time[i] = 0; index[i] = -1; npreview = 0;
+		if (Camera_GetImageInfo(wnd, frames[i], &info) == 0 && info.imageID == ids[i]) {
+			camera_time[i] = info.camera_time;
+			if (bGate) save[i] = autosave_gate_check(wnd, frames[i], &info, &gate, &metric[i], &reason[i], &npreview);
+		}
+
+		EnterCriticalSection(&wnd->autosave.lock);
+		if (metric[i] >= 0) wnd->autosave.gate.last_metric = metric[i];
+		if (! save[i]) {
+			wnd->autosave.gate.skipped++;
+		} else if (Camera_GetImageInfo(wnd, frames[i], &info) != 0 || info.imageID != ids[i]) {
+			wnd->autosave.lost++;
+			Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+			reason[i] = "lost";
+		} else if (wnd->autosave.head - wnd->autosave.tail >= wnd->autosave.nqueue) {
+			wnd->autosave.dropped++;							/* Writers too far behind */
+			reason[i] = "dropped";
+		} else {
+			index[i] = wnd->autosave.next_index++;
+			wnd->autosave.queue[wnd->autosave.head % wnd->autosave.nqueue].index = index[i];
+			wnd->autosave.queue[wnd->autosave.head % wnd->autosave.nqueue].info  = info;
+			wnd->autosave.head++;
+			wnd->autosave.queued++;
+			if (bGate && npreview > 0) {					/* Queued ... its preview is now the reference */
+				swap = wnd->autosave.gate.ref; wnd->autosave.gate.ref = wnd->autosave.gate.work; wnd->autosave.gate.work = swap;
+				wnd->autosave.gate.nref = npreview;
+				wnd->autosave.gate.t_saved = info.camera_time;
+			}
+		}
+		LeaveCriticalSection(&wnd->autosave.lock);
+	}
+
+	EnterCriticalSection(&wnd->autosave.lock);
+	depth = wnd->autosave.head - wnd->autosave.tail;
+	if (depth > wnd->autosave.max_depth) wnd->autosave.max_depth = depth;
+
+	/* Log the decisions (buffered; flushed when the gate or autosave is reset) */
+	if (bGate) {
+		if (wnd->autosave.gate.log == NULL) {
+			sprintf_s(fname, sizeof(fname), "%s/%s_gate.csv", wnd->autosave.directory, wnd->autosave.template);
+			if (fopen_s(&wnd->autosave.gate.log, fname, "a") == 0 && wnd->autosave.gate.log != NULL) {
+				fseek(wnd->autosave.gate.log, 0, SEEK_END);
+				if (ftell(wnd->autosave.gate.log) == 0) fprintf(wnd->autosave.gate.log, "imageID,camera_time,metric,decision,index\n");
+			} else {
+				fprintf(stderr, "[%s] Unable to open gate log \"%s\"\n", rname, fname); fflush(stderr);
+				wnd->autosave.gate.log = NULL;
+			}
+		}
+		if (wnd->autosave.gate.log != NULL) {
+			for (i=n-1; i>=0; i--) fprintf(wnd->autosave.gate.log, "%d,%.6f,%.3f,%s,%d\n", ids[i], camera_time[i], metric[i], reason[i], index[i]);
+		}
+	}
+	if (newest > wnd->autosave.last_id) wnd->autosave.last_id = newest;	/* Unless reset meanwhile */
+	LeaveCriticalSection(&wnd->autosave.lock);
+
+	/* Writers exit when idle and disabled, so (re)start as needed */
+	while (! wnd->autosave.stop && wnd->autosave.writers < AUTOSAVE_WRITERS) {
+		ResetEvent(wnd->autosave.idle);
+		InterlockedIncrement(&wnd->autosave.writers);
+		if (_beginthread(autosave_writer_thread, 0, wnd) == -1L) {
+			if (InterlockedDecrement(&wnd->autosave.writers) == 0) SetEvent(wnd->autosave.idle);
+			fprintf(stderr, "[%s] Unable to start an autosave writer thread\n", rname); fflush(stderr);
+			break;
+		}
+	}
+	SetEvent(wnd->autosave.wake);
+	return;
+}
+
+static void autosave_stop(WND_INFO *wnd) {
+
+	if (! wnd->autosave.lock_init) return;						/* Never started */
+
+	wnd->autosave.stop = TRUE;
+	SetEvent(wnd->autosave.wake);
+	while (wnd->autosave.writers > 0) {
+		WaitForSingleObject(wnd->autosave.idle, 1000);		/* Recheck in case of a start/exit race */
+		SetEvent(wnd->autosave.wake);
+	}
+	return;
+}
+
+/* ===========================================================================
+-- Decide whether the change gate lets a frame through to autosave
+--
+-- Usage: static BOOL autosave_gate_check(WND_INFO *wnd, int frame, IMAGE_INFO *info, AUTOSAVE_GATE *parms,
+--                                        double *metric, char **reason, int *npreview);
+--
+-- Inputs: wnd      - pointer to the WND_INFO structure
+--         frame    - ring index of the frame
+--         info     - its image information (imageID, camera_time)
+--         parms    - gate settings (copied under autosave.lock by the caller)
+--         metric   - receives the mean |difference| from the last saved preview (-1 if none)
+--         reason   - receives "first", "change", "interval" or "skip"
+--         npreview - receives the samples of the preview left in gate.work (0 if none)
+--
+-- Return: TRUE if the frame should be saved
+--
+-- Notes: Called only from autosave_enqueue(), which owns the preview buffers.
+--        The reference is not touched here; the caller swaps gate.work in
+--        (under the lock) only once the frame is actually queued.
+=========================================================================== */
+static BOOL autosave_gate_check(WND_INFO *wnd, int frame, IMAGE_INFO *info, AUTOSAVE_GATE *parms, double *metric, char **reason, int *npreview) {
+
+	IMAGE_BUFFER src, preview;
+	IMAGE_REGION region;
+	IMAGE_INFO check;
+	int n;
+
+	*metric = -1; *reason = "first"; *npreview = 0;
+
+	/* Binned 8-bit preview of the frame (Bayer is binned in 2x2 cells) */
+	if (Camera_GetImageBuffer(wnd, frame, &src) != 0 || src.data == NULL) return TRUE;
+	memset(&region, 0, sizeof(region));
+	region.bin = max(1, src.width / ((src.format == PIXEL_BAYER16) ? 2*AUTOSAVE_GATE_WIDTH : AUTOSAVE_GATE_WIDTH));
+	if (IP_RegionGeometry(&src, &region, PIXEL_MONO8, &preview) != 0) return TRUE;
+	n = preview.width * preview.height;
+	if (n > wnd->autosave.gate.nalloc) {
+		if (wnd->autosave.gate.ref  != NULL) free(wnd->autosave.gate.ref);
+		if (wnd->autosave.gate.work != NULL) free(wnd->autosave.gate.work);
+		wnd->autosave.gate.ref  = malloc(n);
+		wnd->autosave.gate.work = malloc(n);
+		wnd->autosave.gate.nalloc = (wnd->autosave.gate.ref != NULL && wnd->autosave.gate.work != NULL) ? n : 0 ;
+		wnd->autosave.gate.nref = 0;
+		if (wnd->autosave.gate.nalloc == 0) return TRUE;
+	}
+	preview.data = wnd->autosave.gate.work;
+	if (IP_ExtractRegion(&src, &region, &preview) != 0) return TRUE;
+	if (Camera_GetImageInfo(wnd, frame, &check) != 0 || check.imageID != info->imageID) return TRUE;	/* Overwritten ... let the queue count it */
+	*npreview = n;
+
+	if (wnd->autosave.gate.nref == n) {
+		*metric = IP_MeanAbsDiff8(wnd->autosave.gate.work, wnd->autosave.gate.ref, n);
+		if (*metric >= parms->threshold) {
+			*reason = "change";
+		} else if (parms->max_interval > 0 && fabs(info->camera_time - wnd->autosave.gate.t_saved) >= parms->max_interval) {
+			*reason = "interval";
+		} else {
+			*reason = "skip";
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* ===========================================================================
+-- Thread writing queued autosave frames (see autosave_enqueue)
+--
+-- Usage: _beginthread(autosave_writer_thread, 0, wnd);
+--
+-- Inputs: arglist - pointer to the WND_INFO structure
+--
+-- Output: <directory>/<template>_ddd.raw for each queued frame
+=========================================================================== */
+static void autosave_writer_thread(void *arglist) {
+	static char *rname = "autosave_writer_thread";
+
+	WND_INFO *wnd;
+	struct _AUTOSAVE_ENTRY entry;
+	IMAGE_INFO info;
+	HANDLE idle;
+	char pathname[PATH_MAX], fname[PATH_MAX];
+	int rc;
+	BOOL have;
+
+	wnd = (WND_INFO *) arglist;
+	Perf_TraceThreadName(rname);
+
+	while (! wnd->autosave.stop && ! abort_all_threads) {
+		EnterCriticalSection(&wnd->autosave.lock);
+		if ( (have = (wnd->autosave.tail != wnd->autosave.head)) ) {
+			entry = wnd->autosave.queue[wnd->autosave.tail % wnd->autosave.nqueue];
+			wnd->autosave.tail++;
+		}
+		LeaveCriticalSection(&wnd->autosave.lock);
+
+		if (! have) {
+			if (! wnd->autosave.enable) break;					/* Idle and disabled */
+			WaitForSingleObject(wnd->autosave.wake, 1000);
+			continue;
+		}
+
+		/* Save straight from the ring, then make sure the slot was not reused meanwhile */
+		sprintf_s(fname, sizeof(fname), "%s_%3.3d.raw", wnd->autosave.template, entry.index);
+		sprintf_s(pathname, sizeof(pathname), "%s/%s", wnd->autosave.directory, fname);
+		if (Camera_GetImageInfo(wnd, entry.info.frame, &info) != 0 || info.imageID != entry.info.imageID) {
+			rc = -1;													/* Overwritten before we got to it */
+		} else {
+			Perf_TraceBegin("Autosave write", entry.info.imageID);
+			rc = Camera_SaveImage(wnd, entry.info.frame, pathname, FILE_RAW);
+			Perf_TraceEnd("Autosave write", entry.info.imageID);
+			if (rc == 0 && (Camera_GetImageInfo(wnd, entry.info.frame, &info) != 0 || info.imageID != entry.info.imageID) ) {
+				remove(pathname);
+				rc = -1;												/* Overwritten while saving */
+			}
+		}
+
+		EnterCriticalSection(&wnd->autosave.lock);
+		if (rc == 0) {
+			wnd->autosave.written++;
+			strcpy_s(wnd->autosave.last_fname, sizeof(wnd->autosave.last_fname), fname);
+		} else if (rc < 0) {
+			wnd->autosave.lost++;
+			Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+		} else {
+			wnd->autosave.failed++;
+		}
+		if (rc >= 0) wnd->autosave.last_failed = (rc != 0);
+		LeaveCriticalSection(&wnd->autosave.lock);
+		if (rc > 0) { fprintf(stderr, "[%s] Failed to save \"%s\" (rc=%d)\n", rname, pathname, rc); fflush(stderr); }
+	}
+
+	/* wnd may be freed as soon as writers reaches 0 (autosave_stop) */
+	idle = wnd->autosave.idle;
+	if (InterlockedDecrement(&wnd->autosave.writers) == 0) SetEvent(idle);
+	return;
+}
+
+/* ===========================================================================
+-- Autosave queue statistics (see ZooCam.h)
+=========================================================================== */
+int Autosave_Stats(AUTOSAVE_INFO *info, BOOL reset) {
+
+	WND_INFO *wnd;
+	AUTOSAVE_INFO my_info;
+
+	if (info == NULL) info = &my_info;
+	memset(info, 0, sizeof(*info));
+	if ( (wnd = main_wnd) == NULL) return 1;
+
+	info->enabled = wnd->autosave.enable;
+	info->writers = wnd->autosave.writers;
+	if (! wnd->autosave.lock_init) return 0;
+
+	EnterCriticalSection(&wnd->autosave.lock);
+	info->capacity  = wnd->autosave.nqueue;
+	info->depth     = wnd->autosave.head - wnd->autosave.tail;
+	info->max_depth = wnd->autosave.max_depth;
+	info->queued    = wnd->autosave.queued;
+	info->written   = wnd->autosave.written;
+	info->dropped   = wnd->autosave.dropped;
+	info->lost      = wnd->autosave.lost;
+	info->failed    = wnd->autosave.failed;
+	info->skipped   = wnd->autosave.gate.skipped;
+	info->last_metric = wnd->autosave.gate.last_metric;
+	if (reset) {
+		wnd->autosave.max_depth = info->depth;
+		wnd->autosave.queued = wnd->autosave.written = wnd->autosave.dropped = wnd->autosave.lost = wnd->autosave.failed = 0;
+		wnd->autosave.gate.skipped = 0;
+	}
+	LeaveCriticalSection(&wnd->autosave.lock);
+	return 0;
+}
+
+/* ===========================================================================
+-- Autosave change gate settings (see ZooCam.h)
+=========================================================================== */
+int Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current) {
+
+	WND_INFO *wnd;
+
+	if (current != NULL) memset(current, 0, sizeof(*current));
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (set != NULL && (set->threshold < 0 || set->max_interval < 0)) return 2;
+	if (! wnd->autosave.lock_init) autosave_reset(wnd);
+
+	EnterCriticalSection(&wnd->autosave.lock);
+	if (set != NULL) {
+		wnd->autosave.gate.parms = *set;
+		wnd->autosave.gate.parms.enable = set->enable ? TRUE : FALSE ;
+		wnd->autosave.gate.nref = 0;										/* Next frame starts a new reference */
+		if (wnd->autosave.gate.log != NULL) fflush(wnd->autosave.gate.log);
+	}
+	if (current != NULL) *current = wnd->autosave.gate.parms;
+	LeaveCriticalSection(&wnd->autosave.lock);
+	return 0;
+}
+
 /* ===========================================================================
 -- The 'main' function of Win32 GUI programs ... now for a new imaging thread 
 =========================================================================== */
@@ -809,6 +1751,10 @@ void Final_Closeout(void) {
 	if ( (wnd = main_wnd) != NULL) {
 		printf("Performing final shutdown of cameras\n"); fflush(stdout);
 
+		/* Autosave writers and property reconcile hold wnd ... wait for them before the cameras go */
+		autosave_stop(wnd);
+		Camera_StopProperties(wnd);
+
 		dcx = wnd->dcx;
 		/* Release resources */
 		if (dcx != NULL && dcx->FrameEvent != NULL) {
@@ -900,29 +1846,43 @@ int CalcStatistics(WND_INFO *wnd, int index, unsigned char *rgb, int *pSharp) {
 	memset(green->y, 0, green->npt*sizeof(*green->y));
 	memset(blue->y,  0, blue->npt *sizeof(*blue->y));
 
-	/* At this point, split based on the camera ... DCx versus TL */
-	/* The TL will use the raw structure rather than bmp conversion for statistics */
-	if (wnd->Camera.driver == TL) {
+	/* At this point, split based on the camera ... DCx versus TL (and SIM) */
+	/* The TL and SIM will use the raw structure rather than bmp conversion for statistics */
+	if (wnd->Camera.driver == TL || wnd->Camera.driver == SIM) {
 		int b,g,r,w;									/* Values of R,G,B and W (grey) intensities */
-		TL_CAMERA *tl;
-		SHORT *data;
+		int scale;										/* Raw counts per histogram bin */
+		unsigned short *data;
 
-		/* Get camera information */
-		tl = (TL_CAMERA *) wnd->Camera.details;
+		if (wnd->Camera.driver == TL) {
+			TL_CAMERA *tl;
 
-		/* Look up the image size info */
-		height = tl->height; width = tl->width;
-		is_color = tl->IsSensorColor;
-		pitch = is_color ? 3*width : width;
+			/* Get camera information */
+			tl = (TL_CAMERA *) wnd->Camera.details;
 
-		/* validate the image index and get pointer to raw data */
-		if (index < 0) index = tl->iLast;
-		data = tl->images[index].raw;			/* Image data */
+			/* Look up the image size info */
+			height = tl->height; width = tl->width;
+			is_color = tl->IsSensorColor;
 
-		if (! is_color) {
+			/* validate the image index and get pointer to raw data */
+			if (index < 0) index = tl->iLast;
+			data = tl->images[index].raw;			/* Image data */
+			scale = 16;
+		} else {
+			SIM_CAMERA *sim;
+
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			height = sim->height; width = sim->width;
+			is_color = sim->IsSensorColor;
+			if (index < 0) index = sim->iLast;
+			data = sim->images[index].raw;
+			scale = 1 << (sim->bit_depth-8);
+		}
+		pitch = is_color ? 3*width : width;
+
+		if (! is_color) {
 			w_max = 0;
 			for (i=0; i<height*width; i++) {
-				w = max(0, min(data[i]/16+8, 255)); red->y[w]++;
+				w = max(0, min(data[i]/scale+8, 255)); red->y[w]++;
 				if (w > w_max) w_max = w;
 			}
 		} else {
@@ -930,13 +1890,13 @@ int CalcStatistics(WND_INFO *wnd, int index, unsigned char *rgb, int *pSharp) {
 			for (i=0; i<height; i++) {
 				for (j=0; j<width; j+=2) {
 					g = (i%2 == 0) ? data[i*width+j] : data[i*width+j+1];
-					g = max(0, min(g/16+8, 255)); green->y[g] += 2;
+					g = max(0, min(g/scale+8, 255)); green->y[g] += 2;
 					if (i%2 == 0) {							/* Line with red */
 						r = data[i*width+j+1];
-						r = max(0, min(r/16+8, 255)); red->y[r] += 4;
+						r = max(0, min(r/scale+8, 255)); red->y[r] += 4;
 					} else {
 						b = data[i*width+j];
-						b = max(0, min(b/16+8, 255)); blue->y[b] += 4;
+						b = max(0, min(b/scale+8, 255)); blue->y[b] += 4;
 					}
 					w = (r+g+b)/3;
 					if (w > w_max) w_max = w;
@@ -1247,6 +2207,7 @@ BOOL Camera_Available(CAMERA *camera) {
 			rc = ! ((UC480_CAMERA_INFO *) camera->details)->dwInUse;
 			break;
 		case TL:
+		case SIM:
 			rc = TRUE;
 			break;
 		default:
@@ -1262,12 +2223,14 @@ BOOL Camera_Available(CAMERA *camera) {
 -- Usage: int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *camera);
 --			 int DCx_CameraOpen(HWND hdlg, WND_INFO *wnd, DCX_CAMERA *dcx, UC480_CAMERA_INFO *info);
 --        int TL_CameraOpen (HWND hdlg, WND_INFO *wnd, TL_CAMERA *tl);
+--        int SIM_CameraOpen(HWND hdlg, WND_INFO *wnd, SIM_CAMERA *sim);
 --
 -- Inputs: hdlg   - pointer to current window
 --         wnd    - pointer to high level camera information
 --         camera - pointer to structure identifying desired camera
 --         dcx    - pointer to DCX_CAMERA structure for camera (open and fill)
 --         tl     - pointer to TL_CAMERA structure for camera (open and fill)
+--         sim    - pointer to the synthetic camera (open and start generator)
 --         
 -- Output: Initializes the requested camera and updates dialog box
 --
@@ -1280,12 +2243,15 @@ static int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *request) {
 
 	int rc, formats;
 	TL_CAMERA  *tl;
+	SIM_CAMERA *sim;
 	DCX_CAMERA *dcx;
 	int i;
 	double fps;
 
 	if (request == NULL) return 1;
 
+	/* No property queries while the driver and details change */
+	Camera_HoldProperties(wnd, TRUE);
 	switch (request->driver) {
 		case DCX:
 			dcx  = wnd->dcx;
@@ -1307,10 +2273,22 @@ static int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *request) {
 			wnd->fps_max = tl->fps_max;
 			wnd->has_fps_control = tl->bFrameRateControl;
 			break;
+		case SIM:
+			sim = (SIM_CAMERA *) request->details;
+			rc = SIM_CameraOpen(hdlg, wnd, sim);
+			wnd->bColor  = sim->IsSensorColor;
+			wnd->height  = sim->height;
+			wnd->width   = sim->width;
+			wnd->fps_min = 1;
+			wnd->fps_max = SIM_FPS_MAX;
+			wnd->has_fps_control = TRUE;
+			break;
 		default:
 			fprintf(stderr, "[%s] Driver from camera structure invalid (%d)\n", rname, request->driver); fflush(stderr);
 			rc = 2;
 	}
+	if (rc != 0) wnd->Camera.driver = UNKNOWN;
+	Camera_HoldProperties(wnd, FALSE);
 
 	/* If successful, copy to the main structure and update window */
 	if (rc == 0) {
@@ -1328,6 +2306,9 @@ static int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *request) {
 		wnd->vert_r->visible = wnd->vert_g->visible = wnd->vert_b->visible = wnd->bColor;
 		wnd->horz_r->visible = wnd->horz_g->visible = wnd->horz_b->visible = wnd->bColor;
 
+		/* Load the property cache for this camera before showing the values */
+		Camera_RefreshProperties(wnd, PROP_ALL);
+
 		SendMessage(hdlg, WMP_SHOW_GAMMA, 0, 0);
 		SendMessage(hdlg, WMP_SHOW_COLOR_CORRECT, 0, 0);
 		SendMessage(hdlg, WMP_SHOW_GAINS, 0, 0);
@@ -1349,8 +2330,6 @@ static int Camera_Open(HWND hdlg, WND_INFO *wnd, CAMERA *request) {
 							(formats & FL_BMP) ? IDR_IMAGE_BMP :
 							(formats & FL_JPG) ? IDR_IMAGE_JPG :
 							(formats & FL_BMP) ? IDR_IMAGE_PNG : IDR_IMAGE_RAW);
-	} else {
-		wnd->Camera.driver = UNKNOWN;
 	}
 
 	return rc;
@@ -1367,12 +2346,15 @@ static int Camera_Close(HWND hdlg, WND_INFO *wnd) {
 	static char *rname = "Camera_Close";
 
 	TL_CAMERA *tl;
+	SIM_CAMERA *sim;
 	DCX_CAMERA *dcx;
 	int i, rc;
 
 	if (wnd == NULL) return 1;											/* Invalid call */
 	if (wnd->Camera.driver == UNKNOWN) return 0;				/* Already closed */
 
+	/* No property queries on a camera being closed */
+	Camera_HoldProperties(wnd, TRUE);
 	rc = 0;
 	switch (wnd->Camera.driver) {
 		case DCX:
@@ -1395,6 +2377,16 @@ static int Camera_Close(HWND hdlg, WND_INFO *wnd) {
 			EnableDlgItem(hdlg, IDB_ROI, FALSE);		ShowDlgItem(hdlg, IDB_ROI, FALSE);
 			EnableDlgItem(hdlg, IDT_ROI_INFO, FALSE);	ShowDlgItem(hdlg, IDT_ROI_INFO, FALSE);
 			break;
+		case SIM:
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			for (i=0; i<5 && SIM_Process_Image_Thread_Active; i++) {
+				SIM_Process_Image_Thread_Abort = TRUE;
+				SetEvent(SIM_Process_Image_Thread_Trigger);	/* Re-trigger */
+				Sleep(100);
+			}
+			if (i >= 5) { fprintf(stderr, "[%s] Failed to see SIM processing thread terminate\n", rname); fflush(stderr); }
+			rc = SIM_CloseCamera(sim);
+			break;
 		default:
 			fprintf(stderr, "[%s] Driver from camera structure invalid (%d)\n", rname, wnd->Camera.driver); fflush(stderr);
 			rc = 2;
@@ -1402,7 +2394,9 @@ static int Camera_Close(HWND hdlg, WND_INFO *wnd) {
 
 	/* No camera now active */
 	wnd->Camera.driver = UNKNOWN;
+	Camera_HoldProperties(wnd, FALSE);
 	wnd->LiveVideo = FALSE;
+	Camera_RefreshProperties(wnd, PROP_ALL);					/* Subscribers see the camera go away */
 	SendMessage(hdlg, WMP_UPDATE_TRIGGER_BUTTONS, 0, 0);
 
 	return rc;
@@ -1422,6 +2416,11 @@ static int Camera_Close(HWND hdlg, WND_INFO *wnd) {
 --         *pFirst  - pointer to CAMERA structure of first available camera
 --
 -- Return: Number of cameras (entries in the combo box)
+--
+-- Notes: DCx enumeration runs on its own thread while the TL cameras are
+--        discovered (itself parallel and cached), so the list is ready in
+--        the time of the slower of the two.
+--        The synthetic camera is listed last, and only when started with -sim
 =========================================================================== */
 int Fill_Camera_List_Control(HWND hdlg, WND_INFO *wnd, int *pnvalid, CAMERA **pFirst) {
 	static char *rname = "Fill_Camera_List_Control";
@@ -1432,14 +2431,27 @@ int Fill_Camera_List_Control(HWND hdlg, WND_INFO *wnd, int *pnvalid, CAMERA **pF
 	CAMERA camera, *first;
 	UC480_CAMERA_INFO *dcx_info, *dcx_details;
 	TL_CAMERA *tl_camera, **tl_list;
+	SIM_CAMERA *sim_camera;
+	DCX_ENUM dcx_enum;
 //	TL_CAMERA_INFO *tl_info, tl_details;
 
 	CameraList_Reset();
 
-	/* Get the DCX cameras and add to the list */
+	/* Start the DCX enumeration in the background */
 	fprintf(stderr, "[%s] Enumerating DCX list\n", rname); fflush(stderr);
-	DCx_EnumCameraList(&count, &dcx_details);
-	for (i=0; i<count; i++) {
+	memset(&dcx_enum, 0, sizeof(dcx_enum));
+	dcx_enum.done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (_beginthread(dcx_enum_thread, 0, (void *) &dcx_enum) == -1L) dcx_enum_thread(&dcx_enum);
+
+	/* Get the TL cameras (added to the list after the DCX ones) */
+	fprintf(stderr, "[%s] Enumerating TL list\n", rname); fflush(stderr);
+	TL_EnumCameraList(&count, &tl_list);
+
+	/* Get the DCX cameras and add to the list */
+	WaitForSingleObject(dcx_enum.done, INFINITE);
+	CloseHandle(dcx_enum.done);
+	dcx_details = dcx_enum.details;
+	for (i=0; i<dcx_enum.count; i++) {
 		dcx_info = dcx_details + i;
 		camera.driver = DCX;
 		sprintf_s(camera.ini_name, sizeof(camera.ini_name),  "DCX_%s", dcx_details[i].SerNo);
@@ -1451,9 +2463,7 @@ int Fill_Camera_List_Control(HWND hdlg, WND_INFO *wnd, int *pnvalid, CAMERA **pF
 		printf("DCX_Camera %d:  CameraID: %d  DeviceID: %d  SensorID: %d  InUse: %d S/N: %s  Model: %s  Status: %d\n", i, dcx_details[i].dwCameraID, dcx_details[i].dwDeviceID, dcx_details[i].dwSensorID, dcx_details[i].dwInUse, dcx_details[i].SerNo, dcx_details[i].Model, dcx_details[i].dwStatus); fflush(stdout);
 	}
 
-	/* Get the TL cameras and add to the list */
-	fprintf(stderr, "[%s] Enumerating TL list\n", rname); fflush(stderr);
-	TL_EnumCameraList(&count, &tl_list);
+	/* Add the TL cameras to the list */
 	for (i=0; i<count; i++) {
 		tl_camera = tl_list[i];
 		camera.driver = TL;
@@ -1466,6 +2476,18 @@ int Fill_Camera_List_Control(HWND hdlg, WND_INFO *wnd, int *pnvalid, CAMERA **pF
 		printf("TL_Camera %d:  CameraID: %s  S/N: %s  Model: %s\n", i, tl_camera->ID, tl_camera->serial, tl_camera->model); fflush(stdout);
 	}
 
+	/* And the synthetic camera if requested */
+	if (sim_camera_enabled && (sim_camera = SIM_FindCamera()) != NULL) {
+		camera.driver = SIM;
+		sprintf_s(camera.ini_name, sizeof(camera.ini_name),  "SIM_%s", sim_camera->serial);
+		sprintf_s(camera.id, sizeof(camera.id), "[SIM]:%s (%s)", sim_camera->model, sim_camera->serial);
+		strcpy_s(camera.alias, sizeof(camera.alias), camera.id);
+		sprintf_s(camera.description, sizeof(camera.description), "Synthetic camera (no hardware)");
+		camera.details = (void *) sim_camera;
+		CameraList_Add(&camera, NULL);
+		printf("SIM_Camera:  S/N: %s  Model: %s\n", sim_camera->serial, sim_camera->model); fflush(stdout);
+	}
+
 	/* Fill in any additional details from the inifile (alias, descriptions) */
 	for (i=0; i<camera_count; i++) {
 		ReadPrivateProfileStr(camera_list[i].ini_name, "Alias",       camera_list[i].alias,       sizeof(camera_list[i].alias),       ConfigIniFile);				/* No change if not there */
@@ -1504,6 +2526,17 @@ int Fill_Camera_List_Control(HWND hdlg, WND_INFO *wnd, int *pnvalid, CAMERA **pF
 #define	TIMER_FRAMEINFO_UPDATE				(3)
 #define	TIMER_INITIALIZE_CAMERAS			(4)
 
+/* Thread for Fill_Camera_List_Control ... DCx enumeration in parallel with TL discovery */
+static void dcx_enum_thread(void *arglist) {
+	DCX_ENUM *dcx_enum;
+
+	dcx_enum = (DCX_ENUM *) arglist;
+	DCx_EnumCameraList(&dcx_enum->count, &dcx_enum->details);
+	if (dcx_enum->count < 0) dcx_enum->count = 0;
+	SetEvent(dcx_enum->done);
+	return;
+}
+
 /* Thread called during WM_INITDIALOG to open first camera and fill in the list */
 /* It may take several seconds, so remove from message loop path */
 static void initialize_cameras_thread(void *arglist) {
@@ -1785,6 +2818,18 @@ BOOL CALLBACK CameraDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam) {
 						if (rings.iShow    != ringhold.iShow)    SetDlgItemInt(hdlg, IDV_CURRENT_FRAME, rings.iShow,    FALSE);
 						ringhold = rings;
 					}
+					/* Autosave writers only post the name ... update here so they never touch the window */
+					if (wnd->autosave.lock_init) {
+						static char fname_shown[PATH_MAX] = "";
+						char fname[PATH_MAX];
+						EnterCriticalSection(&wnd->autosave.lock);
+						strcpy_s(fname, sizeof(fname), wnd->autosave.last_failed ? "-- failed --" : wnd->autosave.last_fname);
+						LeaveCriticalSection(&wnd->autosave.lock);
+						if (strcmp(fname, fname_shown) != 0) {
+							SetDlgItemText(hdlg, IDT_AUTOSAVE_FNAME, fname);
+							strcpy_s(fname_shown, sizeof(fname_shown), fname);
+						}
+					}
 					break;
 
 				default:
@@ -1943,7 +2988,7 @@ BOOL CALLBACK CameraDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam) {
 					SetDlgItemInt(hdlg, IDV_RED_GAIN,    (int) (values[1]+0.5), FALSE);
 					SetDlgItemInt(hdlg, IDV_GREEN_GAIN,  (int) (values[2]+0.5), FALSE);
 					SetDlgItemInt(hdlg, IDV_BLUE_GAIN,   (int) (values[3]+0.5), FALSE);
-				} else if (wnd->Camera.driver == TL) {
+				} else if (wnd->Camera.driver == TL || wnd->Camera.driver == SIM) {
 					SetDlgItemDouble(hdlg, IDV_MASTER_GAIN, "%.1f", values[0]);
 					SetDlgItemDouble(hdlg, IDV_RED_GAIN,    "%.1f", values[1]);
 					SetDlgItemDouble(hdlg, IDV_GREEN_GAIN,  "%.1f", values[2]);
@@ -2151,6 +3196,10 @@ BOOL CALLBACK CameraDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam) {
 				case IDB_AUTO_EXPOSURE:
 					if (BN_CLICKED == wNotifyCode) _beginthread(AutoExposureThread, 0, wnd);
 					rcode = TRUE; break;
+
+				case IDB_PERF_STATS:
+					if (BN_CLICKED == wNotifyCode) _beginthread(show_perf_dialog_thread, 0, NULL);
+					rcode = TRUE; break;
 					
 				case IDB_RESET_CURSOR:
 					if (BN_CLICKED == wNotifyCode) {
@@ -2524,6 +3573,7 @@ BOOL CALLBACK CameraDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam) {
 							wnd->autosave.enable = FALSE;
 						} else {
 							rc = DialogBoxParam(hInstance, "IDD_AUTOSAVE", HWND_DESKTOP, (DLGPROC) AutoSaveInfoDlgProc, (LPARAM) wnd);
+							if (rc == IDOK) autosave_reset(wnd);				/* Only frames from now on */
 							if ( ! (wnd->autosave.enable = (rc == IDOK)) ) SetDlgItemCheck(hdlg, wID, FALSE);
 						}
 						EnableDlgItem(hdlg, IDT_AUTOSAVE_FNAME, wnd->autosave.enable);
@@ -2752,6 +3802,12 @@ BOOL CALLBACK CameraIDConfigDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM l
 						SetDlgItemText(hdlg, IDT_MODEL_0+i,  tl->model);
 						SetDlgItemText(hdlg, IDT_SERIAL_0+i, tl->serial);
 						break;
+					case SIM:
+						SetDlgItemText(hdlg, IDT_CLASS_0+i,  "SIM");
+						SetDlgItemText(hdlg, IDT_ID_0+i,     "-");
+						SetDlgItemText(hdlg, IDT_MODEL_0+i,  ((SIM_CAMERA *) camera_list[i].details)->model);
+						SetDlgItemText(hdlg, IDT_SERIAL_0+i, ((SIM_CAMERA *) camera_list[i].details)->serial);
+						break;
 					default:
 						SetDlgItemText(hdlg, IDT_CLASS_0+i,  "???");
 						SetDlgItemText(hdlg, IDT_MODEL_0+i,  "???");
@@ -3550,6 +4606,148 @@ int Update_Focus_Dialog(int sharpness) {
 }
 #endif
 
+/* ===========================================================================
+-- Dialog box showing the frame pipeline instrumentation (Perf_GetStats)
+--
+-- Usage: BOOL CALLBACK PerfStatsDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam);
+--
+-- Standard windows dialog.  Table is refreshed twice a second.
+=========================================================================== */
+static void show_perf_dialog_thread(void *arglist) {
+	static BOOL running = FALSE;
+	if (! running) {
+		running = TRUE;
+		DialogBox(hInstance, "IDD_PERF_STATS", HWND_DESKTOP, (DLGPROC) PerfStatsDlgProc);
+		running = FALSE;
+	}
+	return;
+}
+
+#define	TIMER_PERF_STATS_REDRAW	1
+
+static void perf_fill_table(HWND hdlg) {
+	PERF_STATS stats;
+	PERF_STAGE_STATS *s;
+	PERF_TRACE_INFO trace;
+	char szBuf[2048];
+	size_t n;
+	int i;
+
+	Perf_GetStats(&stats, FALSE);
+
+	n = sprintf_s(szBuf, sizeof(szBuf), "Stage\tCount\tMean\tp50\tp99\tMax  [us]\r\n");
+	for (i=0; i<PERF_NUM_STAGES; i++) {
+		s = stats.stage+i;
+		n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "%s\t%u\t%.1f\t%.0f\t%.0f\t%.1f\r\n", 
+							Perf_StageName(i), s->count, s->mean_us, s->p50_us, s->p99_us, s->max_us);
+	}
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "\r\nOver %.1f s:\r\n", stats.seconds);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "Frames received\t%u\t(%.1f fps)\r\n", stats.frames_received, 
+						(stats.seconds > 0) ? stats.frames_received/stats.seconds : 0.0);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "Dropped by fps limit\t%u\r\n", stats.frames_limited);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "Ring mutex timeouts\t%u\r\n", stats.mutex_timeouts);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "Overwritten before read\t%u\r\n", stats.frames_overwritten);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "Server bytes sent\t%.0f\t(%.2f MB/s)\r\n", stats.bytes_sent, 
+						(stats.seconds > 0) ? stats.bytes_sent/stats.seconds/1.0E6 : 0.0);
+
+	Perf_TraceInfo(&trace);
+	n += sprintf_s(szBuf+n, sizeof(szBuf)-n, "\r\nTrace %s\t%u events\t%d threads\t%u lost\r\n", 
+						trace.enabled ? "recording" : "stopped", trace.events, trace.threads, trace.overwritten);
+	SetDlgItemText(hdlg, IDT_PERF_TABLE, szBuf);
+	return;
+}
+
+BOOL CALLBACK PerfStatsDlgProc(HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+	static char *rname = "PerfStatsDlgProc";
+
+	int rc, wID, wNotifyCode, rcode;
+	static int tabs[] = { 92, 132, 172, 206, 240 };
+	char pathname[PATH_MAX];
+	OPENFILENAME ofn;
+
+/* The message loop */
+	rcode = FALSE;
+	switch (msg) {
+
+		case WM_INITDIALOG:
+			if (main_wnd != NULL) DlgCenterWindowEx(hdlg, main_wnd->hdlg);
+			SendDlgItemMessage(hdlg, IDT_PERF_TABLE, EM_SETTABSTOPS, (WPARAM) (sizeof(tabs)/sizeof(*tabs)), (LPARAM) tabs);
+			SetDlgItemCheck(hdlg, IDC_PERF_ENABLE, Perf_Enable(-1));
+			SetDlgItemCheck(hdlg, IDC_PERF_TRACE,  Perf_TraceEnable(-1));
+			perf_fill_table(hdlg);
+			SetTimer(hdlg, TIMER_PERF_STATS_REDRAW, 500, NULL);
+			rcode = TRUE; break;
+
+		case WM_CLOSE:
+			KillTimer(hdlg, TIMER_PERF_STATS_REDRAW);
+			EndDialog(hdlg,0);
+			rcode = TRUE; break;
+
+		case WM_TIMER:
+			if (wParam == TIMER_PERF_STATS_REDRAW) perf_fill_table(hdlg);
+			rcode = TRUE; break;
+
+		case WM_COMMAND:
+			wID = LOWORD(wParam);									/* Control sending message	*/
+			wNotifyCode = HIWORD(wParam);							/* Type of notification		*/
+
+			switch (wID) {
+				case IDOK:												/* Default response for pressing <ENTER> */
+				case IDCANCEL:
+					SendMessage(hdlg, WM_CLOSE, 0, 0);
+					rcode = TRUE; break;
+
+				case IDC_PERF_ENABLE:
+					Perf_Enable(GetDlgItemCheck(hdlg, wID));
+					rcode = TRUE; break;
+
+				case IDB_PERF_RESET:
+					if (BN_CLICKED == wNotifyCode) {
+						Perf_GetStats(NULL, TRUE);
+						perf_fill_table(hdlg);
+					}
+					rcode = TRUE; break;
+
+				case IDC_PERF_TRACE:
+					Perf_TraceEnable(GetDlgItemCheck(hdlg, wID));
+					perf_fill_table(hdlg);
+					rcode = TRUE; break;
+
+				case IDB_PERF_TRACE_SAVE:
+					if (BN_CLICKED == wNotifyCode) {
+						strcpy_m(pathname, sizeof(pathname), "zoocam_trace.json");
+						memset(&ofn, 0, sizeof(ofn));							/* Not static, must be set to zeros */
+						ofn.lStructSize       = sizeof(OPENFILENAME);
+						ofn.hwndOwner         = hdlg;
+						ofn.lpstrTitle        = "Save Chrome trace";
+						ofn.lpstrFilter       = "Chrome trace (*.json)\0*.json\0All files (*.*)\0*.*\0\0";
+						ofn.nFilterIndex      = 1;
+						ofn.lpstrFile         = pathname;				/* Full path */
+						ofn.nMaxFile          = sizeof(pathname);
+						ofn.lpstrDefExt       = "json";
+						ofn.Flags = OFN_LONGNAMES | OFN_NOCHANGEDIR | OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT;
+
+						/* If abandoned, just return now with no complaints */
+						if (GetSaveFileName(&ofn) && (rc = Perf_TraceDump(pathname, NULL)) != 0) {
+							fprintf(stderr, "[%s] Perf_TraceDump failed (rc=%d)\n", rname, rc); fflush(stderr);
+							Beep(300,200);
+						}
+					}
+					rcode = TRUE; break;
+
+				/* Known unused items */
+				case IDT_PERF_TABLE:
+					rcode = TRUE; break;
+					
+				default:
+					printf("Unused wID in %s: %d\n", rname, wID); fflush(stdout);
+					break;
+			}
+			return rcode;
+	}
+	return 0;
+}
+
 
 /* ===========================================================================
 -- Main callback routine for DCx camera info
@@ -3799,6 +4997,7 @@ int WINAPI WinMain(HINSTANCE hThisInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
 						  "  -?\t\tthis help information\n"
 						  "  -debug\t\tcreate c:/lsa/ZooCam.log debug file\n"
 						  "  -ini <config.ini>\talternate .ini file\n"
+						  "  -sim\t\tlist the synthetic camera (no hardware)\n"
 						  "\n"
 						  "Notes:\n"
 						  " 1) For one argument with no -option, -ini is assumed\n"
@@ -3810,6 +5009,8 @@ int WINAPI WinMain(HINSTANCE hThisInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
 			debug = TRUE;
 		} else if (_stricmp(token, "-ini") == 0 || _stricmp(token, "/ini") == 0) {
 			ParseCmdLine(ConfigIniFile, sizeof(ConfigIniFile), tokenlist, &tokenlist);
+		} else if (_stricmp(token, "-sim") == 0 || _stricmp(token, "/sim") == 0) {
+			sim_camera_enabled = TRUE;
 		} else if (*ConfigIniFile == '\0') {
 			strcpy_s(ConfigIniFile, sizeof(ConfigIniFile), token);
 		} else {
@@ -3833,6 +5034,12 @@ int WINAPI WinMain(HINSTANCE hThisInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
 	}
 	fprintf(stderr, "inifile configured as %s\n", ConfigIniFile); fflush(stderr);
 
+	/* Camera metadata cache lives beside the .ini file */
+	strcpy_s(szBuf, sizeof(szBuf), ConfigIniFile);
+	for (isize=(int) strlen(szBuf); isize>0 && strchr("/\\:", szBuf[isize-1]) == NULL; isize--);
+	strcpy_s(szBuf+isize, sizeof(szBuf)-isize, "TL_cameras.cache");
+	TL_SetCacheFile(szBuf);
+
 	/* Open the system debug file */
 	if (debug) {
 		if ( (fopen_s(&fdebug, "c:/lsa/ZooCam.log", "a")) != 0) {
@@ -4253,6 +5460,7 @@ static void Camera_Info_Thread(void *arglist) {
 --           (1) BURST_ARM    ==> arm the burst mode
 --           (2) BURST_ABORT  ==> abort burst if enabled
 --           (3) BURST_WAIT   ==> wait for burst to complete (timeout active)
+--           (4) BURST_MARK   ==> trigger an armed pre-trigger burst now
 --         msTimeout - timeout for some operations (<=1000 ms)
 --         response - pointer to for return code (beyond success)
 --
@@ -4274,6 +5482,7 @@ static void Camera_Info_Thread(void *arglist) {
 --		BURST_ARM:		0 if successful (or if already armed)
 --		BURST_ABORT:	0 if successful (or wasn't armed)
 --		BURST_WAIT:		0 if complete, 1 on timeout
+--		BURST_MARK:		0 if marked, 1 if not armed in pre-trigger mode
 =========================================================================== */
 int Burst_Actions(BURST_ACTION request, int msTimeout, int *response) {
 	static char *rname = "Burst_Actions";
@@ -4328,7 +5537,7 @@ int Burst_Actions(BURST_ACTION request, int msTimeout, int *response) {
 				if (msTimeout > 1000) msTimeout = 1000;				/* Also don't allow requests for more than 1 second */
 				*response = 1;													/* Indicate timeout before done */
 				while (msTimeout > 0) {
-					if (! wnd->BurstModeActive) { *response = 0; break; }
+					if (! wnd->BurstModeActive || wnd->BurstModeStatus == BURST_STATUS_COMPLETE) { *response = 0; break; }
 					Sleep(min(100, msTimeout));							/* Wait in 100 ms blocks */
 					msTimeout -= 100;											/* May go negative but who cares */
 				}
@@ -4336,6 +5545,15 @@ int Burst_Actions(BURST_ACTION request, int msTimeout, int *response) {
 				*response = 0;
 			}
 			break;
+
+		case BURST_MARK:
+			if (wnd->BurstModeActive && wnd->pretrigger.mark != NULL && (wnd->pretrigger.npre > 0 || wnd->pretrigger.npost > 0)) {
+				SetEvent(wnd->pretrigger.mark);
+				*response = 0;
+			} else {
+				*response = 1;
+			}
+			break;
 			
 		default:
 			return 2;
@@ -4346,129 +5564,2977 @@ int Burst_Actions(BURST_ACTION request, int msTimeout, int *response) {
 
 
 /* ===========================================================================
--- Query the preferred image storage format from radio button
+-- Pre-trigger burst configuration and access to the frozen segment
 --
--- Usage: FILE_FORMAT GetDfltImageFormat(HWND hdlg);
+-- Usage: int Burst_Set_Pretrigger(int npre, int npost, int *cur_npre, int *cur_npost);
+--        BURST_SEGMENT *Burst_Lock_Segment(void);
+--        void Burst_Unlock_Segment(void);
+--        int Burst_Save_Segment(char *pattern);
 --
--- Inputs: hdlg - pointer to the dialog box with controls
+-- Inputs: npre, npost - frames to keep before / collect after the trigger
+--                       (<0 ==> no change, both 0 ==> normal burst mode)
+--         cur_npre, cur_npost - if !NULL, receive the values now in effect
+--         pattern - root of name for files
+--							  <pattern>.csv - logfile 
+--                     <pattern>_ddd.raw - raw data of each frame
 --
--- Output: none
+-- Output: Set changes the mode used by the next BURST_ARM
 --
--- Return: Image format to use as default.  FILE_BMP returned as default.
+-- Return: Set:  0 if successful, 1 if no window, 2 if ring too small for npre
+--         Lock: last segment or NULL (always call Burst_Unlock_Segment())
+--         Save: 0 if successful, 1 no segment, 2 unable to open the logfile
+--
+-- Notes: The csv follows TL_SaveBurstImages() with the imageID and the
+--        latency from the trigger frame (ms, camera clock) appended.
 =========================================================================== */
-static FILE_FORMAT GetDfltImageFormat(HWND hdlg) {
-	int rc;
+int Burst_Set_Pretrigger(int npre, int npost, int *cur_npre, int *cur_npost) {
+	static char *rname = "Burst_Set_Pretrigger";
 
-	switch (GetRadioButton(hdlg, IDR_IMAGE_BMP, IDR_IMAGE_PNG)) {
-		case IDR_IMAGE_RAW:
-			rc = FILE_RAW; break;
-		case IDR_IMAGE_JPG:
-			rc = FILE_JPG; break;
-		case IDR_IMAGE_PNG:
-			rc = FILE_PNG; break;
-		case IDR_IMAGE_BMP:
-		default:
-			rc = FILE_BMP; break;
+	RING_INFO rings;
+	int rc = 0;
+
+	if (main_wnd == NULL) return 1;
+	if (main_wnd->pretrigger.mutex == NULL) main_wnd->pretrigger.mutex = CreateMutex(NULL, FALSE, NULL);
+	if (main_wnd->pretrigger.mark  == NULL) main_wnd->pretrigger.mark  = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (npre >= 0) {
+		if (Camera_GetRingInfo(main_wnd, &rings) == 0 && rings.nBuffers < npre+2) {
+			rc = 2;
+		} else {
+			main_wnd->pretrigger.npre = npre;
+		}
 	}
+	if (npost >= 0) main_wnd->pretrigger.npost = npost;
+
+	if (cur_npre  != NULL) *cur_npre  = main_wnd->pretrigger.npre;
+	if (cur_npost != NULL) *cur_npost = main_wnd->pretrigger.npost;
 	return rc;
 }
 
+BURST_SEGMENT *Burst_Lock_Segment(void) {
+	if (main_wnd == NULL || main_wnd->pretrigger.mutex == NULL) return NULL;
+	WaitForSingleObject(main_wnd->pretrigger.mutex, INFINITE);
+	return main_wnd->pretrigger.segment;
+}
+
+void Burst_Unlock_Segment(void) {
+	if (main_wnd == NULL || main_wnd->pretrigger.mutex == NULL) return;
+	ReleaseMutex(main_wnd->pretrigger.mutex);
+	return;
+}
+
+int Burst_Save_Segment(char *pattern) {
+	static char *rname = "Burst_Save_Segment";
+
+	BURST_SEGMENT *segment;
+	SEGMENT_FRAME *frame;
+	char pathname[PATH_MAX];
+	struct tm tm;
+	double tstart;
+	FILE *funit, *fraw;
+	int i;
+
+	if ( (segment = Burst_Lock_Segment()) == NULL) { Burst_Unlock_Segment(); return 1; }
+
+	/* Open a .csv log file with information on each image */
+	sprintf_s(pathname, sizeof(pathname), "%s.csv", pattern);
+	if (fopen_s(&funit, pathname, "w") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, pathname); fflush(stderr);
+		Burst_Unlock_Segment();
+		return 2;
+	}
+	fprintf(funit, "/* Index,filename,t_relative,t_time,t_clock,imageID,latency_ms\n");
+
+	tstart = -999;
+	for (i=0; i<segment->nframes; i++) {
+		frame = segment->frames+i;
+		if (frame->data == NULL) continue;
+		if (tstart == -999) tstart = frame->info.camera_time;
+
+		sprintf_s(pathname, sizeof(pathname), "%s_%3.3d.raw", pattern, i);
+		_localtime64_s(&tm, &frame->info.timestamp);
+		fprintf(funit, "%d,%s,%.4f,%lld,%4.4d.%2.2d.%2.2d %2.2d:%2.2d:%2.2d.%3.3d,%d,%.3f\n",
+				  i, pathname, frame->info.camera_time-tstart, frame->info.timestamp,
+				  tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, 0,
+				  frame->info.imageID, frame->latency_ms);
+
+		if (fopen_s(&fraw, pathname, "wb") != 0 || fraw == NULL) {
+			fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, pathname); fflush(stderr);
+			continue;
+		}
+		fwrite(frame->data, 1, frame->length, fraw);
+		fclose(fraw);
+	}
+	fclose(funit);
+
+	Burst_Unlock_Segment();
+	return 0;
+}
+
 
 /* ===========================================================================
--- Draw crosshair (full or small cross) on a bitmap window
+-- Streaming burst configuration and counts
 --
--- Usage: int GenerateCrosshair(WND_INFO *wnd, HWND hwnd);
+-- Usage: int Burst_Set_Stream(int enable, char *pattern, FILE_FORMAT format);
+--        int Burst_Stream_Counts(int *enabled, int *frames, int *written, int *lost, int *pending);
 --
--- Inputs: wnd - general information about camera application
---               uses only wnd->cursor_posn
---         hwnd - handle to window to draw in
+-- Inputs: enable  - 1 ==> stream the next bursts, 0 ==> normal burst, <0 ==> no change
+--         pattern - root of name for files (ignored if NULL)
+--         format  - FILE_BMP or FILE_RAW (FILE_DFLT ==> no change)
+--         enabled, frames, written, lost, pending - if !NULL, receive values
 --
--- Output: adds crosshair to image
+-- Output: Set changes the mode used by the next BURST_ARM
 --
--- Return: 0 if successful, 1 if hwnd is not a window
+-- Return: 0 if successful, 1 if no window
 =========================================================================== */
-int GenerateCrosshair(WND_INFO *wnd, HWND hwnd) {
-	RECT rect;
-	int ix,iy, width, height;
-	HDC hdc;
-
-	/* Create brushes for the cross-hair */
-	static HBRUSH background, foreground;
-	static HPEN hpen;
-	static BOOL first = TRUE;
+int Burst_Set_Stream(int enable, char *pattern, FILE_FORMAT format) {
+	static char *rname = "Burst_Set_Stream";
 
-	/* Create brushes and keep them persistent throughout run */
-	if (first) {
-		background = CreateSolidBrush(RGB(0,0,0));
-		foreground = CreateSolidBrush(RGB(255,255,255));
-		hpen = CreatePen(PS_SOLID, 1, RGB(255,255,255));
-		first = FALSE;
-	}
+	if (main_wnd == NULL) return 1;
 
-	/* If the specified hwnd is not a valid window, we can safely exit */
-	if (! IsWindow(hwnd)) return 1;
+	/* Lock only keeps the copy in stream_burst_start() from seeing half a name */
+	if (main_wnd->stream.lock_init) EnterCriticalSection(&main_wnd->stream.lock);
+	if (pattern != NULL && *pattern != '\0') strcpy_s(main_wnd->stream.pattern, sizeof(main_wnd->stream.pattern), pattern);
+	if (format == FILE_BMP || format == FILE_RAW) main_wnd->stream.format = format;
+	if (main_wnd->stream.format != FILE_RAW) main_wnd->stream.format = FILE_BMP;
+	if (enable >= 0) main_wnd->stream.enabled = (enable != 0) && *main_wnd->stream.pattern != '\0';
+	if (main_wnd->stream.lock_init) LeaveCriticalSection(&main_wnd->stream.lock);
+	return 0;
+}
 
-	/* Process the request */
-	GetClientRect(hwnd, &rect);
-	width = rect.right; height = rect.bottom;
-	ix = (int) (wnd->cursor_posn.x*width  + 0.5);
-	iy = (int) (wnd->cursor_posn.y*height + 0.5);
+int Burst_Stream_Counts(int *enabled, int *frames, int *written, int *lost, int *pending) {
 
-	/* Get DC */
-	hdc = GetDC(hwnd);
+	if (main_wnd == NULL) return 1;
+	if (enabled != NULL) *enabled = main_wnd->stream.enabled;
+	if (frames  != NULL) *frames  = main_wnd->stream.frames;
+	if (written != NULL) *written = main_wnd->stream.written;
+	if (lost    != NULL) *lost    = main_wnd->stream.lost;
+	if (pending != NULL) *pending = main_wnd->stream.head - main_wnd->stream.tail;
+	return 0;
+}
 
-	if (! wnd->cursor_posn.fullwidth) {
-		int isize;
-		isize = min(20,width/10);
-		SetRect(&rect, max(ix-isize,0),max(iy-1,0), min(ix+isize,width),min(iy+2,height));
-		FillRect(hdc, &rect, background);
-		SetRect(&rect, max(0,ix-1),max(0,iy-isize), min(ix+2,width),min(iy+isize,height));
-		FillRect(hdc, &rect, background);
+/* ===========================================================================
+-- HDR exposure bracketing (see ZooCam.h for the interface description)
+--
+-- Usage: int HDR_Bracket(int nexp, double *exposure, BOOL continuous, HDR_OUTPUT output, int black_level);
+--
+-- Inputs: nexp        - exposures in the bracket (0 ==> just stop bracketing)
+--         exposure    - requested exposure of each (ms)
+--         continuous  - TRUE to keep cycling, FALSE for a single merged frame
+--         output      - HDR_FLOAT32 or HDR_UINT16
+--         black_level - offset subtracted from every sample
+--
+-- Output: Stops any bracket in progress and starts hdr_bracket_thread()
+--
+-- Return: 0 if successful
+--           1 ==> no camera
+--           2 ==> invalid parameters
+--           3 ==> previous bracket would not stop
+--           4 ==> unable to start the thread
+=========================================================================== */
+#define	HDR_POLL_MS			(2)						/* Check for the bracket frames */
+#define	HDR_STOP_WAIT_MS	(5000)					/* Limit for the thread to exit */
 
-		SelectObject(hdc, hpen);
-		MoveToEx(hdc, max(ix-isize,0), iy, NULL); LineTo(hdc, min(ix+isize,width), iy);
-		MoveToEx(hdc, ix, max(iy-isize,0), NULL); LineTo(hdc, ix, min(iy+isize,height));
-	} else {
-		SetRect(&rect, 0,max(iy-1,0), width,min(iy+2,height));
-		FillRect(hdc, &rect, background);
-		SetRect(&rect, max(0,ix-1),0, min(ix+2,width),height);
-		FillRect(hdc, &rect, background);
+int HDR_Bracket(int nexp, double *exposure, BOOL continuous, HDR_OUTPUT output, int black_level) {
+	static char *rname = "HDR_Bracket";
 
-		SelectObject(hdc, hpen);
-		MoveToEx(hdc, 0, iy, NULL); LineTo(hdc, width, iy);
-		MoveToEx(hdc, ix, 0, NULL); LineTo(hdc, ix, height);
-	}		
+	WND_INFO *wnd;
+	int i;
 
-	/* Release DC */
-	ReleaseDC(hwnd, hdc);
+	if ( (wnd = main_wnd) == NULL || wnd->Camera.driver == UNKNOWN) return 1;
+	if (wnd->hdr.mutex == NULL) wnd->hdr.mutex = CreateMutex(NULL, FALSE, NULL);
 
-	/* Return successful */
+	/* Stop anything running (the thread restores the exposure as it exits) */
+	if (wnd->hdr.active) {
+		wnd->hdr.stop = TRUE;
+		for (i=0; wnd->hdr.active && i<HDR_STOP_WAIT_MS/10; i++) Sleep(10);
+		if (wnd->hdr.active) return 3;
+	}
+	if (nexp == 0) return 0;
+
+	/* Validate and copy the request */
+	if (nexp < 0 || nexp > HDR_MAX_EXPOSURES || exposure == NULL) return 2;
+	for (i=0; i<nexp; i++) if (exposure[i] <= 0) return 2;
+	if (output != HDR_UINT16) output = HDR_FLOAT32;
+
+	wnd->hdr.nexp        = nexp;
+	wnd->hdr.continuous  = continuous;
+	wnd->hdr.output      = output;
+	wnd->hdr.black_level = max(0, black_level);
+	for (i=0; i<nexp; i++) wnd->hdr.exposure[i] = exposure[i];
+
+	WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+	memset(&wnd->hdr.status, 0, sizeof(wnd->hdr.status));
+	wnd->hdr.status.continuous = continuous;
+	wnd->hdr.status.output     = output;
+	wnd->hdr.status.nexp       = nexp;
+	for (i=0; i<nexp; i++) wnd->hdr.status.exposure[i] = exposure[i];
+	ReleaseMutex(wnd->hdr.mutex);
+
+	wnd->hdr.stop = FALSE;
+	wnd->hdr.active = TRUE;
+	if (_beginthread(hdr_bracket_thread, 0, wnd) == -1L) {
+		fprintf(stderr, "[%s] Unable to start the bracket thread\n", rname); fflush(stderr);
+		wnd->hdr.active = FALSE;
+		return 4;
+	}
 	return 0;
 }
 
-
-
 /* ===========================================================================
-================ SUPPORT ROUTINES ... usage is obvious =======================
-=========================================================================== */
-
-/* ===========================================================================
--- Display a specified image (PID) on windows with statistics
+-- Capture one frame at a given exposure for the bracket
 --
--- Usage: void Camera_ShowImage(WND_INFO *wnd, int index);
+-- Usage: static int hdr_capture(WND_INFO *wnd, double ms, BOOL bTrigger, int *last_id, IMAGE_BUFFER *copy, int *size, IMAGE_INFO *info);
 --
--- Inputs: wnd   - structure with all the info
---         index - index of frame to display
---         pSharp - pointer to variable to get sharpness estimate (if ! NULL)
+-- Inputs: wnd      - pointer to the WND_INFO structure
+--         ms       - exposure to set (ms)
+--         bTrigger - TRUE if the camera needs a software trigger for each frame
+--         last_id  - imageID of the newest frame seen (updated)
+--         copy     - private buffer (data reallocated as needed)
+--         size     - bytes allocated in copy->data (updated)
+--         info     - receives the IMAGE_INFO of the captured frame
 --
--- Output: *pSharp - estimate of the sharpness (in some units)
+-- Output: First frame at or after the imageID bound from Camera_ApplySettings,
+--         copied out of the ring so the merge isn't racing the camera
 --
--- Return: 0 - all info displayed
---         1 - only images were shown ... main HDLG not a window
---         2 - PauseImageRendering TRUE ... thread currently in a critical section 
+-- Return: 0 if successful, 1 on timeout or stop request, 2 on memory
+--
+-- Notes: The TL exposure tag is the setting when the frame arrived, so a
+--        frame exposed before the change can carry the new value.  Only
+--        the settings bound says which frames really have it.  If the
+--        bound is unknown, the frame in flight at the change is skipped.
 =========================================================================== */
-static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp);
-static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp);
+static int hdr_capture(WND_INFO *wnd, double ms, BOOL bTrigger, int *last_id, IMAGE_BUFFER *copy, int *size, IMAGE_INFO *info) {
+
+	CAMERA_SETTINGS settings;
+	IMAGE_BUFFER ring;
+	HIRES_TIMER *timer;
+	void *data;
+	double actual, t_max;
+	int frame, length, bound, skip, rc;
+
+	memset(&settings, 0, sizeof(settings));
+	settings.modify   = SETTING_EXPOSURE;
+	settings.exposure = ms;
+	Camera_ApplySettings(wnd, &settings, 0);
+	actual = (settings.exposure > 0) ? settings.exposure : ms ;
+	bound  = settings.imageID;
+	skip   = (bound < 0) ? 1 : 0 ;								/* Frame in flight never arrived ... drop it when it does */
+	if (Camera_GetImageInfo(wnd, -1, info) == 0 && info->imageID >= 0) *last_id = info->imageID;
+	if (bTrigger) Camera_Trigger(wnd);
+
+	rc = 1;
+	timer = HiResTimerCreate();
+	t_max = (2000.0 + 4*actual) / 1000.0;
+	while (! wnd->hdr.stop && HiResTimerDelta(timer) < t_max) {
+		if (Camera_GetImageInfo(wnd, -1, info) != 0 || info->imageID < 0 || info->imageID == *last_id) { Sleep(HDR_POLL_MS); continue; }
+		*last_id = info->imageID;
+		if (info->imageID < bound || skip-- > 0) {						/* Exposed before the change */
+			if (bTrigger) Camera_Trigger(wnd);
+			continue;
+		}
+
+		frame = info->frame;
+		if (Camera_GetImageBuffer(wnd, frame, &ring) != 0 || ring.data == NULL) continue;
+		if (Camera_GetImageData(wnd, frame, &data, &length) != 0 || length <= 0) continue;
+		if (length > *size) {
+			if (copy->data != NULL) free(copy->data);
+			if ( (copy->data = malloc(length)) == NULL) { *size = 0; rc = 2; break; }
+			*size = length;
+		}
+		memcpy(copy->data, ring.data, length);
+
+		/* Make sure the slot wasn't reused while copying */
+		if (Camera_GetImageInfo(wnd, frame, info) != 0 || info->imageID != *last_id) continue;
+		data = copy->data;
+		*copy = ring;
+		copy->data = data;
+		rc = 0;
+		break;
+	}
+	HiResTimerDestroy(timer);
+	return rc;
+}
+
+/* ===========================================================================
+-- Thread cycling the exposures and merging each complete bracket
+=========================================================================== */
+static void hdr_bracket_thread(void *arglist) {
+	static char *rname = "hdr_bracket_thread";
+
+	WND_INFO *wnd;
+	IMAGE_BUFFER frames[HDR_MAX_EXPOSURES], dst;
+	IMAGE_INFO info[HDR_MAX_EXPOSURES];
+	IP_HDR_PARMS parms;
+	HIRES_TIMER *timer;
+	double ms_original, actual[HDR_MAX_EXPOSURES], ms_merge;
+	int size[HDR_MAX_EXPOSURES];
+	int i, k, next, need, last_id, rc;
+	BOOL bTrigger;
+
+	wnd = (WND_INFO *) arglist;
+	memset(frames, 0, sizeof(frames));
+	memset(size, 0, sizeof(size));
+	timer = HiResTimerCreate();
+
+	ms_original = Camera_GetExposure(wnd);
+	bTrigger = Camera_GetTriggerMode(wnd, NULL) != TRIG_FREERUN;
+	last_id = -1;
+	if (Camera_GetImageInfo(wnd, -1, info) == 0) last_id = info[0].imageID;
+
+	do {
+		/* Collect the bracket */
+		for (k=0; k<wnd->hdr.nexp; k++) {
+			if (hdr_capture(wnd, wnd->hdr.exposure[k], bTrigger, &last_id, frames+k, size+k, info+k) != 0) break;
+			actual[k] = info[k].exposure;
+		}
+		if (k < wnd->hdr.nexp) {
+			if (! wnd->hdr.stop) { fprintf(stderr, "[%s] Timeout waiting for exposure %.3f ms\n", rname, wnd->hdr.exposure[k]); fflush(stderr); }
+			break;
+		}
+
+		/* Merge into the buffer not being served */
+		dst = frames[0];
+		if (dst.format == PIXEL_MONO8 || wnd->hdr.output == HDR_FLOAT32) dst.format = PIXEL_FLOAT32;
+		dst.pitch = dst.width * IP_BytesPerPixel(dst.format);
+		need = dst.pitch * dst.height;
+		next = 1 - wnd->hdr.current;
+		if (need > wnd->hdr.size[next]) {
+			if (wnd->hdr.buffer[next] != NULL) free(wnd->hdr.buffer[next]);
+			if ( (wnd->hdr.buffer[next] = malloc(need)) == NULL) { wnd->hdr.size[next] = 0; break; }
+			wnd->hdr.size[next] = need;
+		}
+		dst.data = wnd->hdr.buffer[next];
+
+		memset(&parms, 0, sizeof(parms));
+		parms.black_level = wnd->hdr.black_level;
+		HiResTimerReset(timer, 0.0);
+		if ( (rc = IP_MergeHDR(frames, actual, wnd->hdr.nexp, &parms, &dst)) != 0) {
+			fprintf(stderr, "[%s] IP_MergeHDR failed (rc=%d) ... unsupported pixel format?\n", rname, rc); fflush(stderr);
+			break;
+		}
+		ms_merge = 1000.0*HiResTimerDelta(timer);
+
+		/* Publish */
+		WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+		wnd->hdr.info              = info[wnd->hdr.nexp-1];
+		wnd->hdr.info.frame        = (uint32_t) FRAME_HDR;
+		wnd->hdr.info.imageID      = -1;
+		wnd->hdr.info.memory_pitch = dst.pitch;
+		wnd->hdr.info.exposure     = (dst.format == PIXEL_FLOAT32) ? 1.0 : parms.scale ;
+		wnd->hdr.current = next;
+		wnd->hdr.length  = need;
+		wnd->hdr.status.output = (dst.format == PIXEL_FLOAT32) ? HDR_FLOAT32 : HDR_UINT16 ;
+		for (i=0; i<wnd->hdr.nexp; i++) {
+			wnd->hdr.status.actual[i]  = actual[i];
+			wnd->hdr.status.imageID[i] = info[i].imageID;
+		}
+		wnd->hdr.status.scale    = parms.scale;
+		wnd->hdr.status.ms_merge = ms_merge;
+		wnd->hdr.status.count++;
+		ReleaseMutex(wnd->hdr.mutex);
+
+	} while (wnd->hdr.continuous && ! wnd->hdr.stop);
+
+	if (ms_original > 0) Camera_SetExposure(wnd, ms_original);
+	for (k=0; k<HDR_MAX_EXPOSURES; k++) if (frames[k].data != NULL) free(frames[k].data);
+	HiResTimerDestroy(timer);
+	wnd->hdr.active = FALSE;
+	return;
+}
+
+/* ===========================================================================
+-- Status and access to the merged HDR frame
+--
+-- Usage: int HDR_Bracket_Status(HDR_BRACKET_INFO *info);
+--        int HDR_GetImageInfo(WND_INFO *wnd, IMAGE_INFO *info);
+--        int HDR_GetImageData(WND_INFO *wnd, void **image_data, int *length);
+--
+-- Output: *info, *image_data, *length (image_data is a malloc'd copy taken
+--         while the HDR mutex is held; the caller must free() it)
+--
+-- Return: 0 if successful, 1 if no window, 2 if no merged frame yet,
+--         4 if no memory for the copy
+=========================================================================== */
+int HDR_Bracket_Status(HDR_BRACKET_INFO *info) {
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (main_wnd == NULL) return 1;
+	if (info == NULL || main_wnd->hdr.mutex == NULL) return 0;
+
+	WaitForSingleObject(main_wnd->hdr.mutex, INFINITE);
+	*info = main_wnd->hdr.status;
+	info->active = main_wnd->hdr.active;
+	ReleaseMutex(main_wnd->hdr.mutex);
+	return 0;
+}
+
+int HDR_GetImageInfo(WND_INFO *wnd, IMAGE_INFO *info) {
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (wnd == NULL) return 1;
+	if (wnd->hdr.mutex == NULL || wnd->hdr.status.count <= 0) return 2;
+
+	WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+	if (info != NULL) *info = wnd->hdr.info;
+	ReleaseMutex(wnd->hdr.mutex);
+	return 0;
+}
+
+int HDR_GetImageData(WND_INFO *wnd, void **image_data, int *length) {
+
+	void *copy;
+
+	if (image_data != NULL) *image_data = NULL;
+	if (length     != NULL) *length = 0;
+	if (wnd == NULL) return 1;
+	if (image_data == NULL || wnd->hdr.mutex == NULL || wnd->hdr.status.count <= 0) return 2;
+
+	/* Copy under the mutex ... the double buffer is reused two merges later */
+	WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+	if ( (copy = malloc(wnd->hdr.length)) != NULL) {
+		memcpy(copy, wnd->hdr.buffer[wnd->hdr.current], wnd->hdr.length);
+		*image_data = copy;
+		if (length != NULL) *length = wnd->hdr.length;
+	}
+	ReleaseMutex(wnd->hdr.mutex);
+	return (copy != NULL) ? 0 : 4 ;
+}
+
+/* ===========================================================================
+-- Save the merged HDR frame
+--
+-- Usage: int HDR_SaveImage(WND_INFO *wnd, char *path);
+--
+-- Inputs: wnd  - pointer to the WND_INFO structure
+--         path - file to write
+--
+-- Output: HDR_FLOAT32 ==> Portable Float Map (little endian, bottom row first)
+--         HDR_UINT16  ==> 16-bit binary PGM (big endian, maxval 65535)
+--
+-- Return: 0 if successful, 1 no window, 2 no merged frame, 6 file failed
+=========================================================================== */
+int HDR_SaveImage(WND_INFO *wnd, char *path) {
+	static char *rname = "HDR_SaveImage";
+
+	FILE *funit;
+	unsigned char *data, *row, *swap;
+	int irow, icol, width, height;
+	BOOL bFloat;
+
+	if (wnd == NULL) return 1;
+	if (path == NULL || *path == '\0' || wnd->hdr.mutex == NULL || wnd->hdr.status.count <= 0) return 2;
+
+	if (fopen_s(&funit, path, "wb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		return 6;
+	}
+
+	WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+	data   = wnd->hdr.buffer[wnd->hdr.current];
+	width  = wnd->hdr.info.width;
+	height = wnd->hdr.info.height;
+	bFloat = wnd->hdr.status.output == HDR_FLOAT32;
+	if (bFloat) {
+		fprintf(funit, "Pf\n%d %d\n-1.0\n", width, height);
+		for (irow=height-1; irow>=0; irow--) fwrite(data + (size_t) irow*wnd->hdr.info.memory_pitch, sizeof(float), width, funit);
+	} else if ( (swap = malloc(2*width)) != NULL) {
+		fprintf(funit, "P5\n%d %d\n65535\n", width, height);
+		for (irow=0; irow<height; irow++) {
+			row = data + (size_t) irow*wnd->hdr.info.memory_pitch;
+			for (icol=0; icol<width; icol++) { swap[2*icol] = row[2*icol+1]; swap[2*icol+1] = row[2*icol]; }
+			fwrite(swap, 2, width, funit);
+		}
+		free(swap);
+	}
+	ReleaseMutex(wnd->hdr.mutex);
+
+	fclose(funit);
+	return 0;
+}
+
+/* ===========================================================================
+-- Render the merged HDR frame with a log tone map
+--
+-- Usage: int HDR_RenderFrame(WND_INFO *wnd, HWND hwnd);
+--
+-- Inputs: wnd  - pointer to the WND_INFO structure
+--         hwnd - window to render into (stretched to the client area)
+--
+-- Output: gray = 255 log(1+1000 v/vmax) / log(1001) through a lookup table
+--
+-- Return: 0 if successful, 1 no window, 2 no merged frame, 4 no memory
+=========================================================================== */
+#define	HDR_LUT_SIZE	(4096)
+
+int HDR_RenderFrame(WND_INFO *wnd, HWND hwnd) {
+
+	unsigned char lut[HDR_LUT_SIZE], *bits, *out, g;
+	unsigned short *p16;
+	float *pf, vmax, v;
+	int i, irow, icol, width, height, stride;
+
+	if (wnd == NULL || ! IsWindow(hwnd)) return 1;
+	if (wnd->hdr.mutex == NULL || wnd->hdr.status.count <= 0) return 2;
+
+	for (i=0; i<HDR_LUT_SIZE; i++) lut[i] = (unsigned char) (255.0*log(1.0+1000.0*i/(HDR_LUT_SIZE-1))/log(1001.0) + 0.5);
+
+	WaitForSingleObject(wnd->hdr.mutex, INFINITE);
+	width  = wnd->hdr.info.width;
+	height = wnd->hdr.info.height;
+	stride = (3*width+3) & ~3;								/* DIB rows are DWORD aligned */
+	if ( (bits = malloc((size_t) stride*height)) == NULL) { ReleaseMutex(wnd->hdr.mutex); return 4; }
+
+	/* Peak for the normalization */
+	vmax = 0;
+	for (irow=0; irow<height; irow++) {
+		out = (unsigned char *) wnd->hdr.buffer[wnd->hdr.current] + (size_t) irow*wnd->hdr.info.memory_pitch;
+		if (wnd->hdr.status.output == HDR_FLOAT32) {
+			for (pf=(float *) out,icol=0; icol<width; icol++) if (pf[icol] > vmax) vmax = pf[icol];
+		} else {
+			for (p16=(unsigned short *) out,icol=0; icol<width; icol++) if (p16[icol] > vmax) vmax = p16[icol];
+		}
+	}
+	if (vmax <= 0) vmax = 1;
+
+	/* Bottom-up gray RGB24 */
+	for (irow=0; irow<height; irow++) {
+		pf  = (float *) ((unsigned char *) wnd->hdr.buffer[wnd->hdr.current] + (size_t) irow*wnd->hdr.info.memory_pitch);
+		p16 = (unsigned short *) pf;
+		out = bits + (size_t) (height-1-irow)*stride;
+		for (icol=0; icol<width; icol++) {
+			v = (wnd->hdr.status.output == HDR_FLOAT32) ? pf[icol] : p16[icol] ;
+			i = (int) ((HDR_LUT_SIZE-1)*v/vmax);
+			g = lut[max(0, min(HDR_LUT_SIZE-1, i))];
+			*(out++) = g; *(out++) = g; *(out++) = g;
+		}
+	}
+	ReleaseMutex(wnd->hdr.mutex);
+
+	paint_rgb24(hwnd, bits, width, height);
+	free(bits);
+	return 0;
+}
+
+/* ===========================================================================
+-- Stretch a bottom-up RGB24 DIB (DWORD aligned rows) to a window's client area
+=========================================================================== */
+static void paint_rgb24(HWND hwnd, unsigned char *bits, int width, int height) {
+
+	BITMAPINFOHEADER bmih;
+	RECT Client;
+	HDC hdc;
+
+	memset(&bmih, 0, sizeof(bmih));
+	bmih.biSize        = sizeof(bmih);
+	bmih.biWidth       = width;
+	bmih.biHeight      = height;
+	bmih.biPlanes      = 1;
+	bmih.biBitCount    = 24;
+	bmih.biCompression = BI_RGB;
+	bmih.biSizeImage   = ((3*width+3) & ~3) * height;
+
+	hdc = GetDC(hwnd);
+	SetStretchBltMode(hdc, COLORONCOLOR);
+	GetClientRect(hwnd, &Client);
+	StretchDIBits(hdc, 0,0, Client.right, Client.bottom, 0,0, width, height, bits, (BITMAPINFO *) &bmih, DIB_RGB_COLORS, SRCCOPY);
+	ReleaseDC(hwnd, hdc);
+	return;
+}
+
+/* ===========================================================================
+-- Frame accumulator (see ZooCam.h for the interface description)
+--
+-- Usage: int Accum_Start(ACCUM_MODE mode, int nframes);
+--
+-- Inputs: mode    - ACCUM_COUNT, ACCUM_SLIDING or ACCUM_STOP
+--         nframes - frames to sum / window size
+--
+-- Output: Stops any run in progress; COUNT and SLIDING clear the sums and
+--         start accum_thread() with the next new frame
+--
+-- Return: 0 if successful
+--           1 ==> no camera
+--           2 ==> invalid parameters
+--           3 ==> previous run would not stop
+--           4 ==> unable to start the thread
+=========================================================================== */
+#define	ACCUM_POLL_MS			(2)						/* Check the ring for new frames */
+#define	ACCUM_STOP_WAIT_MS	(5000)					/* Limit for the thread to exit */
+#define	ACCUM_MAX_COUNT		(65536)					/* 32-bit sums of 16-bit samples */
+
+int Accum_Start(ACCUM_MODE mode, int nframes) {
+	static char *rname = "Accum_Start";
+
+	WND_INFO *wnd;
+	int i;
+
+	if ( (wnd = main_wnd) == NULL || wnd->Camera.driver == UNKNOWN) return 1;
+	if (wnd->accum.mutex == NULL) wnd->accum.mutex = CreateMutex(NULL, FALSE, NULL);
+
+	if (wnd->accum.active) {
+		wnd->accum.stop = TRUE;
+		for (i=0; wnd->accum.active && i<ACCUM_STOP_WAIT_MS/10; i++) Sleep(10);
+		if (wnd->accum.active) return 3;
+	}
+	if (mode == ACCUM_STOP) return 0;
+
+	if (mode != ACCUM_COUNT && mode != ACCUM_SLIDING) return 2;
+	if (nframes < 1 || nframes > ((mode == ACCUM_SLIDING) ? ACCUM_MAX_WINDOW : ACCUM_MAX_COUNT)) return 2;
+
+	/* Fresh sums ... buffers are (re)allocated by the first frame */
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	wnd->accum.mode     = mode;
+	wnd->accum.nframes  = nframes;
+	wnd->accum.width    = 0;
+	wnd->accum.count    = wnd->accum.total = wnd->accum.lost = 0;
+	wnd->accum.complete = FALSE;
+	wnd->accum.dirty    = FALSE;
+	ReleaseMutex(wnd->accum.mutex);
+
+	wnd->accum.stop = FALSE;
+	wnd->accum.active = TRUE;
+	if (_beginthread(accum_thread, 0, wnd) == -1L) {
+		fprintf(stderr, "[%s] Unable to start the accumulator thread\n", rname); fflush(stderr);
+		wnd->accum.active = FALSE;
+		return 4;
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Thread adding each new frame in the ring to the sums
+=========================================================================== */
+static void accum_thread(void *arglist) {
+
+	WND_INFO *wnd;
+	IMAGE_INFO info;
+	int i, n, last_id, skipped;
+	int frames[RING_WALK_MAX], ids[RING_WALK_MAX];	/* More than this per pass are counted lost */
+
+	wnd = (WND_INFO *) arglist;
+	last_id = (Camera_GetImageInfo(wnd, -1, &info) == 0) ? info.imageID : -1 ;
+
+	while (! wnd->accum.stop && ! wnd->accum.complete && main_wnd == wnd && ! abort_all_threads) {
+
+		/* Walk back from the newest frame to the last one already added */
+		if ( (n = ring_new_frames(wnd, last_id, RING_WALK_MAX, frames, ids, &skipped)) == 0) { Sleep(ACCUM_POLL_MS); continue; }
+		wnd->accum.lost += skipped;
+
+		/* Add oldest first */
+		for (i=n-1; i>=0 && ! wnd->accum.complete; i--) {
+			if (! accum_add_frame(wnd, frames[i], ids[i])) { wnd->accum.lost++; Perf_Count(PERF_FRAMES_OVERWRITTEN, 1); }
+		}
+		last_id = ids[0];
+	}
+
+	wnd->accum.active = FALSE;
+	return;
+}
+
+/* ===========================================================================
+-- Add one ring frame (by imageID) to the sums
+--
+-- Usage: static BOOL accum_add_frame(WND_INFO *wnd, int frame, int imageID);
+--
+-- Return: TRUE if added, FALSE if the frame was overwritten or not usable
+--
+-- Notes: The frame is first packed into the scratch slot and the imageID
+--        checked again, so the sums never see a half-overwritten frame.  In
+--        a sliding window the scratch slot then replaces the oldest one.
+=========================================================================== */
+static BOOL accum_add_frame(WND_INFO *wnd, int frame, int imageID) {
+	static char *rname = "accum_add_frame";
+
+	IMAGE_BUFFER ring, packed, oldest;
+	IMAGE_INFO info;
+	HIRES_TIMER *timer;
+	unsigned char *scratch;
+	int row, bytes;
+
+	if (Camera_GetImageBuffer(wnd, frame, &ring) != 0 || ring.data == NULL || IP_AccumSamples(&ring) <= 0) return FALSE;
+
+	/* Geometry changed (or first frame) ==> restart the sums */
+	if (ring.width != wnd->accum.width || ring.height != wnd->accum.height || ring.format != wnd->accum.format) {
+		if (! accum_alloc(wnd, &ring)) return FALSE;
+	}
+
+	timer = HiResTimerCreate();
+	bytes = wnd->accum.frame_bytes / ring.height;
+	scratch = wnd->accum.slots[wnd->accum.nslots-1];
+	for (row=0; row<ring.height; row++) memcpy(scratch + (size_t) row*bytes, (unsigned char *) ring.data + (size_t) row*ring.pitch, bytes);
+	if (Camera_GetImageInfo(wnd, frame, &info) != 0 || info.imageID != imageID) { HiResTimerDestroy(timer); return FALSE; }
+
+	packed = ring;
+	packed.pitch = bytes;
+	packed.data  = scratch;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	if (wnd->accum.mode == ACCUM_SLIDING) {
+		if (wnd->accum.count >= wnd->accum.nframes) {
+			oldest = packed;
+			oldest.data = wnd->accum.slots[wnd->accum.head];
+			IP_Accumulate(&oldest, wnd->accum.sum, wnd->accum.sumsq, TRUE);
+			wnd->accum.count--;
+		}
+		IP_Accumulate(&packed, wnd->accum.sum, wnd->accum.sumsq, FALSE);
+		wnd->accum.slots[wnd->accum.nslots-1] = wnd->accum.slots[wnd->accum.head];
+		wnd->accum.slots[wnd->accum.head] = scratch;
+		wnd->accum.head = (wnd->accum.head+1) % wnd->accum.nframes;
+	} else {
+		IP_Accumulate(&packed, wnd->accum.sum, wnd->accum.sumsq, FALSE);
+	}
+	wnd->accum.count++;
+	wnd->accum.total++;
+	wnd->accum.complete = (wnd->accum.mode == ACCUM_COUNT && wnd->accum.count >= wnd->accum.nframes);
+	wnd->accum.dirty  = TRUE;
+	wnd->accum.info   = info;
+	wnd->accum.ms_add = 1000.0*HiResTimerDelta(timer);
+	ReleaseMutex(wnd->accum.mutex);
+
+	HiResTimerDestroy(timer);
+	return TRUE;
+}
+
+/* ===========================================================================
+-- (Re)allocate the sums, window and results for a frame layout
+--
+-- Usage: static BOOL accum_alloc(WND_INFO *wnd, IMAGE_BUFFER *layout);
+--
+-- Return: TRUE if successful, FALSE if out of memory (accumulator emptied)
+=========================================================================== */
+static BOOL accum_alloc(WND_INFO *wnd, IMAGE_BUFFER *layout) {
+	static char *rname = "accum_alloc";
+
+	int i, nslots, nsamples;
+	BOOL ok;
+
+	nsamples = IP_AccumSamples(layout);
+	nslots = ((wnd->accum.mode == ACCUM_SLIDING) ? wnd->accum.nframes : 0) + 1;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	accum_free(wnd);
+	wnd->accum.format      = layout->format;
+	wnd->accum.width       = layout->width;
+	wnd->accum.height      = layout->height;
+	wnd->accum.bit_depth   = layout->bit_depth;
+	wnd->accum.nsamples    = nsamples;
+	wnd->accum.frame_bytes = layout->width * IP_BytesPerPixel(layout->format) * layout->height;
+	wnd->accum.count = wnd->accum.head = 0;
+	wnd->accum.dirty = FALSE;
+
+	ok = (wnd->accum.sum   = calloc(nsamples, sizeof(*wnd->accum.sum)))   != NULL &&
+		  (wnd->accum.sumsq = calloc(nsamples, sizeof(*wnd->accum.sumsq))) != NULL &&
+		  (wnd->accum.slots = calloc(nslots,   sizeof(*wnd->accum.slots))) != NULL;
+	if (ok) {
+		wnd->accum.nslots = nslots;
+		for (i=0; ok && i<nslots; i++) ok = (wnd->accum.slots[i] = malloc(wnd->accum.frame_bytes)) != NULL;
+		for (i=0; ok && i<2; i++) {
+			ok = (wnd->accum.mean[i] = malloc(nsamples*sizeof(float))) != NULL &&
+				  (wnd->accum.var[i]  = malloc(nsamples*sizeof(float))) != NULL;
+		}
+	}
+	if (! ok) {
+		fprintf(stderr, "[%s] Unable to allocate the accumulator (%d samples, %d frames)\n", rname, nsamples, nslots); fflush(stderr);
+		accum_free(wnd);
+		wnd->accum.width = 0;
+	}
+	ReleaseMutex(wnd->accum.mutex);
+	return ok;
+}
+
+static void accum_free(WND_INFO *wnd) {
+	int i;
+
+	if (wnd->accum.sum   != NULL) { free(wnd->accum.sum);   wnd->accum.sum   = NULL; }
+	if (wnd->accum.sumsq != NULL) { free(wnd->accum.sumsq); wnd->accum.sumsq = NULL; }
+	if (wnd->accum.slots != NULL) {
+		for (i=0; i<wnd->accum.nslots; i++) if (wnd->accum.slots[i] != NULL) free(wnd->accum.slots[i]);
+		free(wnd->accum.slots);
+		wnd->accum.slots = NULL;
+	}
+	wnd->accum.nslots = 0;
+	for (i=0; i<2; i++) {
+		if (wnd->accum.mean[i] != NULL) { free(wnd->accum.mean[i]); wnd->accum.mean[i] = NULL; }
+		if (wnd->accum.var[i]  != NULL) { free(wnd->accum.var[i]);  wnd->accum.var[i]  = NULL; }
+	}
+	wnd->accum.count = 0;
+	return;
+}
+
+/* ===========================================================================
+-- Bring the mean / variance images up to date (call with the mutex held)
+--
+-- Usage: static float *accum_result(WND_INFO *wnd, int frame);
+--
+-- Return: pointer to the served FRAME_MEAN or FRAME_VARIANCE image, or NULL
+--         if nothing has been accumulated
+--
+-- Notes: Results are made in the idle pair and then swapped in.  The
+--        pointer is only good while the mutex is held; the pair is reused
+--        on the update after next, so anything handed out is a copy.
+=========================================================================== */
+static float *accum_result(WND_INFO *wnd, int frame) {
+	int next;
+
+	if (wnd->accum.count <= 0 || wnd->accum.sum == NULL) return NULL;
+	if (wnd->accum.dirty) {
+		next = 1 - wnd->accum.current;
+		IP_AccumResult(wnd->accum.sum, wnd->accum.sumsq, wnd->accum.nsamples, wnd->accum.count, wnd->accum.mean[next], wnd->accum.var[next]);
+		wnd->accum.current = next;
+		wnd->accum.dirty = FALSE;
+	}
+	return (frame == FRAME_VARIANCE) ? wnd->accum.var[wnd->accum.current] : wnd->accum.mean[wnd->accum.current] ;
+}
+
+/* ===========================================================================
+-- Status and access to the accumulator images
+--
+-- Usage: int Accum_Status(ACCUM_INFO *info);
+--        int Accum_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info);
+--        int Accum_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
+--
+-- Output: *info, *image_data, *length.  The IMAGE_INFO is that of the last
+--         frame added with frame = FRAME_MEAN / FRAME_VARIANCE, imageID = -1
+--         and memory_pitch = bytes of one row of float values.  *image_data
+--         is a malloc'd copy taken under the mutex (caller must free()).
+--
+-- Return: 0 if successful, 1 if no window, 2 if no frames accumulated,
+--         4 if no memory for the copy
+=========================================================================== */
+int Accum_Status(ACCUM_INFO *info) {
+
+	WND_INFO *wnd;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (info == NULL || wnd->accum.mutex == NULL) return 0;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	info->mode     = wnd->accum.mode;
+	info->nframes  = wnd->accum.nframes;
+	info->active   = wnd->accum.active;
+	info->complete = wnd->accum.complete;
+	info->count    = wnd->accum.count;
+	info->total    = wnd->accum.total;
+	info->lost     = wnd->accum.lost;
+	info->width    = wnd->accum.width;
+	info->height   = wnd->accum.height;
+	info->nsamples = (wnd->accum.width > 0) ? wnd->accum.nsamples : 0 ;
+	info->ms_add   = wnd->accum.ms_add;
+	ReleaseMutex(wnd->accum.mutex);
+	return 0;
+}
+
+int Accum_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info) {
+
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (wnd == NULL) return 1;
+	if (wnd->accum.mutex == NULL) return 2;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	rc = (wnd->accum.count > 0 && wnd->accum.sum != NULL) ? 0 : 2 ;
+	if (rc == 0 && info != NULL) {
+		*info = wnd->accum.info;
+		info->frame        = (uint32_t) frame;
+		info->imageID      = -1;
+		info->memory_pitch = (wnd->accum.nsamples / wnd->accum.height) * sizeof(float);
+	}
+	ReleaseMutex(wnd->accum.mutex);
+	return rc;
+}
+
+int Accum_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length) {
+
+	float *data;
+	int rc, nbytes;
+
+	if (image_data != NULL) *image_data = NULL;
+	if (length     != NULL) *length = 0;
+	if (wnd == NULL) return 1;
+	if (image_data == NULL || wnd->accum.mutex == NULL) return 2;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	if ( (data = accum_result(wnd, frame)) == NULL) {
+		rc = 2;
+	} else if ( (*image_data = malloc(nbytes = wnd->accum.nsamples * sizeof(float))) == NULL) {
+		rc = 4;
+	} else {
+		memcpy(*image_data, data, nbytes);
+		if (length != NULL) *length = nbytes;
+		rc = 0;
+	}
+	ReleaseMutex(wnd->accum.mutex);
+	return rc;
+}
+
+/* ===========================================================================
+-- Save an accumulator image as raw float32 (little endian, top row first)
+--
+-- Usage: int Accum_SaveImage(WND_INFO *wnd, int frame, char *path);
+--
+-- Return: 0 if successful, 1 no window, 2 nothing accumulated, 6 file failed
+=========================================================================== */
+int Accum_SaveImage(WND_INFO *wnd, int frame, char *path) {
+	static char *rname = "Accum_SaveImage";
+
+	FILE *funit;
+	float *data;
+	int rc;
+
+	if (wnd == NULL) return 1;
+	if (path == NULL || *path == '\0' || wnd->accum.mutex == NULL) return 2;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	if ( (data = accum_result(wnd, frame)) == NULL) {
+		rc = 2;
+	} else if (fopen_s(&funit, path, "wb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		rc = 6;
+	} else {
+		rc = (fwrite(data, sizeof(float), wnd->accum.nsamples, funit) == (size_t) wnd->accum.nsamples) ? 0 : 6 ;
+		fclose(funit);
+	}
+	ReleaseMutex(wnd->accum.mutex);
+	return rc;
+}
+
+/* ===========================================================================
+-- Render an accumulator image (linear between its minimum and maximum)
+--
+-- Usage: int Accum_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd);
+--
+-- Return: 0 if successful, 1 no window, 2 nothing accumulated, 4 no memory
+--
+-- Notes: 3-sample (RGB24/BGR24) layouts render in color, all others gray
+=========================================================================== */
+int Accum_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd) {
+
+	unsigned char *bits, *out;
+	float *data, *row, vmin, vmax, scale;
+	int i, irow, icol, width, height, spp, stride;
+	BOOL bRGB;
+
+	if (wnd == NULL || ! IsWindow(hwnd)) return 1;
+	if (wnd->accum.mutex == NULL) return 2;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	if ( (data = accum_result(wnd, frame)) == NULL) { ReleaseMutex(wnd->accum.mutex); return 2; }
+	width  = wnd->accum.width;
+	height = wnd->accum.height;
+	spp    = wnd->accum.nsamples / (width*height);
+	bRGB   = wnd->accum.format == PIXEL_RGB24;
+	stride = (3*width+3) & ~3;								/* DIB rows are DWORD aligned */
+	if ( (bits = malloc((size_t) stride*height)) == NULL) { ReleaseMutex(wnd->accum.mutex); return 4; }
+
+	vmin = vmax = data[0];
+	for (i=1; i<wnd->accum.nsamples; i++) {
+		if (data[i] < vmin) vmin = data[i];
+		if (data[i] > vmax) vmax = data[i];
+	}
+	scale = (vmax > vmin) ? 255.0f/(vmax-vmin) : 0 ;
+
+	/* Bottom-up BGR24 */
+	for (irow=0; irow<height; irow++) {
+		row = data + (size_t) irow*width*spp;
+		out = bits + (size_t) (height-1-irow)*stride;
+		for (icol=0; icol<width; icol++) {
+			if (spp == 3) {
+				out[0] = (unsigned char) ((row[3*icol+(bRGB ? 2 : 0)]-vmin)*scale);
+				out[1] = (unsigned char) ((row[3*icol+1]-vmin)*scale);
+				out[2] = (unsigned char) ((row[3*icol+(bRGB ? 0 : 2)]-vmin)*scale);
+			} else {
+				out[0] = out[1] = out[2] = (unsigned char) ((row[icol]-vmin)*scale);
+			}
+			out += 3;
+		}
+	}
+	ReleaseMutex(wnd->accum.mutex);
+
+	paint_rgb24(hwnd, bits, width, height);
+	free(bits);
+	return 0;
+}
+
+/* ===========================================================================
+-- Dark / bias / flat calibration
+--
+-- The set lives in wnd->calib and is applied by calib_filter(), installed as
+-- the TL frame filter, so correction is fused with the copy of each frame
+-- into the ring.  All members are protected by wnd->calib.lock, which the
+-- filter holds while it runs (it is already inside the TL image mutex).
+=========================================================================== */
+static void calib_init(WND_INFO *wnd) {
+	if (! wnd->calib.lock_init) {
+		InitializeCriticalSection(&wnd->calib.lock);
+		wnd->calib.lock_init = TRUE;
+	}
+	return;
+}
+
+/* Release the set (lock held) */
+static void calib_free(WND_INFO *wnd) {
+	if (wnd->calib.bias     != NULL) { free(wnd->calib.bias);     wnd->calib.bias     = NULL; }
+	if (wnd->calib.dark     != NULL) { free(wnd->calib.dark);     wnd->calib.dark     = NULL; }
+	if (wnd->calib.flat     != NULL) { free(wnd->calib.flat);     wnd->calib.flat     = NULL; }
+	if (wnd->calib.dark_eff[0] != NULL) { free(wnd->calib.dark_eff[0]); wnd->calib.dark_eff[0] = NULL; }
+	if (wnd->calib.dark_eff[1] != NULL) { free(wnd->calib.dark_eff[1]); wnd->calib.dark_eff[1] = NULL; }
+	if (wnd->calib.gain_eff    != NULL) { free(wnd->calib.gain_eff);    wnd->calib.gain_eff    = NULL; }
+	wnd->calib.ms_eff[0] = wnd->calib.ms_eff[1] = -1;
+	wnd->calib.width = wnd->calib.height = 0;
+	wnd->calib.ms_dark = wnd->calib.dB_gain = 0;
+	return;
+}
+
+/* Dark expected at exposure ms: bias + (dark-bias)*ms/ms_dark (lock held) */
+static void calib_dark_at(WND_INFO *wnd, double ms, unsigned short *out) {
+	int i, n;
+	float scale, v;
+
+	n = wnd->calib.width * wnd->calib.height;
+	if (wnd->calib.dark != NULL && wnd->calib.bias != NULL && wnd->calib.ms_dark > 0) {
+		scale = (float) (ms / wnd->calib.ms_dark);
+		for (i=0; i<n; i++) {
+			v = wnd->calib.bias[i] + ((float) wnd->calib.dark[i] - (float) wnd->calib.bias[i])*scale + 0.5f;
+			out[i] = (v <= 0) ? 0 : (v >= 65535.0f) ? 65535 : (unsigned short) v ;
+		}
+	} else if (wnd->calib.dark != NULL) {
+		memcpy(out, wnd->calib.dark, n*sizeof(*out));
+	} else if (wnd->calib.bias != NULL) {
+		memcpy(out, wnd->calib.bias, n*sizeof(*out));
+	} else {
+		memset(out, 0, n*sizeof(*out));
+	}
+	return;
+}
+
+/* Is exposure ms close enough to use a dark built at ms_eff */
+#define	CALIB_MS_MATCH(ms, ms_eff)	((ms_eff) >= 0 && fabs((ms)-(ms_eff)) <= 0.005*(ms_eff))
+
+/* (Re)build the buffers used by the kernel after the set changes, dark at exposure ms (lock held) */
+static BOOL calib_prepare(WND_INFO *wnd, double ms) {
+	int i, n;
+
+	n = wnd->calib.width * wnd->calib.height;
+	if (n <= 0) return FALSE;
+	for (i=0; i<2; i++) {
+		if (wnd->calib.dark_eff[i] == NULL) wnd->calib.dark_eff[i] = malloc(n*sizeof(*wnd->calib.dark_eff[i]));
+		wnd->calib.ms_eff[i] = -1;
+		wnd->calib.from_id[i] = 0;
+	}
+	if (wnd->calib.gain_eff == NULL) wnd->calib.gain_eff = malloc(n*sizeof(*wnd->calib.gain_eff));
+	if (wnd->calib.dark_eff[0] == NULL || wnd->calib.dark_eff[1] == NULL || wnd->calib.gain_eff == NULL) return FALSE;
+
+	if (wnd->calib.flat != NULL) {
+		memcpy(wnd->calib.gain_eff, wnd->calib.flat, n*sizeof(*wnd->calib.gain_eff));
+	} else {
+		for (i=0; i<n; i++) wnd->calib.gain_eff[i] = 1.0f;
+	}
+	wnd->calib.ieff = 0;
+	calib_dark_at(wnd, ms, wnd->calib.dark_eff[0]);
+	wnd->calib.ms_eff[0] = ms;
+	return TRUE;
+}
+
+/* ===========================================================================
+-- Build the scaled dark for a new exposure ahead of its frames
+--
+-- Usage: void Calib_SetExposure(WND_INFO *wnd, double ms, int imageID);
+--
+-- Inputs: wnd     - pointer to the WND_INFO structure
+--         ms      - exposure set (or about to be set) on the camera
+--         imageID - first frame exposed at ms (<0 ==> from the next frame,
+--                   CALIB_ID_PENDING ==> not known yet, call again once it is)
+--
+-- Output: The dark for ms is built into the idle dark_eff and made current.
+--         The previous one is used for frames before imageID.  Calling
+--         again with the same ms only moves imageID.
+=========================================================================== */
+void Calib_SetExposure(WND_INFO *wnd, double ms, int imageID) {
+	int next;
+
+	if (wnd == NULL || ! wnd->calib.lock_init) return;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->calib.enabled && wnd->calib.dark_eff[0] != NULL && wnd->calib.dark_eff[1] != NULL) {
+		if (! CALIB_MS_MATCH(ms, wnd->calib.ms_eff[wnd->calib.ieff])) {
+			next = 1 - wnd->calib.ieff;
+			calib_dark_at(wnd, ms, wnd->calib.dark_eff[next]);
+			wnd->calib.ms_eff[next] = ms;
+			wnd->calib.ieff = next;
+		}
+		wnd->calib.from_id[wnd->calib.ieff] = max(0, imageID);
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+	return;
+}
+
+/* ===========================================================================
+-- Check the calibration set belongs to the open camera at its current gain
+--
+-- Usage: static int calib_check_camera(WND_INFO *wnd);
+--
+-- Return: 0 if it matches, -2 if not a TL camera, -3 if the image size
+--         differs, -4 if the serial number or (with a dark) the gain differs
+=========================================================================== */
+static int calib_check_camera(WND_INFO *wnd) {
+	static char *rname = "calib_check_camera";
+
+	CAMERA_INFO camera;
+	TL_CAMERA *tl;
+	double gains[4];
+	int rc;
+
+	if (wnd->Camera.driver != TL) return -2;
+	tl = (TL_CAMERA *) wnd->Camera.details;
+	Camera_GetCameraInfo(wnd, &camera);
+	Camera_GetGains(wnd, gains, NULL);
+
+	rc = 0;
+	EnterCriticalSection(&wnd->calib.lock);
+	if (tl->width != wnd->calib.width || tl->height != wnd->calib.height) {
+		rc = -3;
+	} else if (strcmp(camera.serial, wnd->calib.serial) != 0) {
+		fprintf(stderr, "[%s] Calibration set is for camera %s, not %s\n", rname, wnd->calib.serial, camera.serial); fflush(stderr);
+		rc = -4;
+	} else if (wnd->calib.dark != NULL && fabs(wnd->calib.dB_gain-gains[M_CHAN]) > 0.1) {
+		fprintf(stderr, "[%s] Calibration dark is at %.1f dB, camera is at %.1f dB\n", rname, wnd->calib.dB_gain, gains[M_CHAN]); fflush(stderr);
+		rc = -4;
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+	return rc;
+}
+
+/* ===========================================================================
+-- TL frame filter: correct one frame as it is copied into the ring
+--
+-- Usage: static int calib_filter(void *context, const unsigned short *src, unsigned short *dst,
+--                                int width, int height, int imageID);
+--
+-- Return: 0 if dst written, 1 to have the caller do a plain copy
+--
+-- Notes: The dark is chosen by imageID, since the exposure the TL driver
+--        reports is the setting at arrival, not the one the frame had.
+=========================================================================== */
+static int calib_filter(void *context, const unsigned short *src, unsigned short *dst, int width, int height, int imageID) {
+	static char *rname = "calib_filter";
+
+	WND_INFO *wnd;
+	HIRES_TIMER *timer;
+	unsigned short *dark;
+	int i, n, maxval;
+	BOOL bCalib, bDefect;
+
+	wnd = (WND_INFO *) context;
+	if (wnd == NULL || ! wnd->calib.lock_init) return 1;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	bCalib  = wnd->calib.enabled && width == wnd->calib.width && height == wnd->calib.height &&
+				 wnd->calib.ms_eff[wnd->calib.ieff] >= 0 && wnd->calib.gain_eff != NULL;
+	bDefect = wnd->defect.enabled && width == wnd->defect.width && height == wnd->defect.height &&
+				 wnd->defect.index != NULL;
+
+	/* Sets are per frame size ... after a binning or ROI change frames pass uncorrected, so say so once */
+	if (wnd->calib.enabled && ! bCalib && ! wnd->calib.size_logged) {
+		fprintf(stderr, "[%s] %d x %d frames do not match the %d x %d calibration set ... not corrected\n", rname, width, height, wnd->calib.width, wnd->calib.height); fflush(stderr);
+		wnd->calib.size_logged = TRUE;
+	}
+	if (wnd->defect.enabled && ! bDefect && ! wnd->defect.size_logged) {
+		fprintf(stderr, "[%s] %d x %d frames do not match the %d x %d defect map ... not corrected\n", rname, width, height, wnd->defect.width, wnd->defect.height); fflush(stderr);
+		wnd->defect.size_logged = TRUE;
+	}
+	if (! bCalib && ! bDefect) {
+		LeaveCriticalSection(&wnd->calib.lock);
+		return 1;
+	}
+	n = width*height;
+
+	if (! bCalib) {
+		memcpy(dst, src, n*sizeof(*dst));
+	} else {
+		maxval = (1 << wnd->calib.bit_depth) - 1;
+
+		/* Darks are built by Calib_SetExposure() ... previous one for frames exposed before the change */
+		i = wnd->calib.ieff;
+		if (imageID < wnd->calib.from_id[i] && wnd->calib.ms_eff[1-i] >= 0) i = 1-i;
+		dark = wnd->calib.dark_eff[i];
+
+		IP_Calibrate16(src, dst, dark, wnd->calib.gain_eff, n, maxval, FALSE);
+		wnd->calib.frames++;
+	}
+
+	/* Defects after the calibration so the interpolation uses corrected neighbors */
+	if (bDefect) {
+		timer = HiResTimerCreate();
+		IP_CorrectDefects(dst, width, height, wnd->defect.format, wnd->defect.cfa_phase, wnd->defect.index, wnd->defect.ndefects);
+		wnd->defect.ms_correct = 1000.0*HiResTimerDelta(timer);
+		HiResTimerDestroy(timer);
+		wnd->defect.frames++;
+	}
+
+	LeaveCriticalSection(&wnd->calib.lock);
+	return 0;
+}
+
+/* ===========================================================================
+-- Compare the SIMD correction with the scalar reference on one frame
+--
+-- Usage: static void calib_self_check(WND_INFO *wnd);
+--
+-- Inputs: wnd - pointer to the WND_INFO structure (set prepared)
+--
+-- Output: Copies the newest ring frame and the current dark / gains, runs
+--         both paths of IP_Calibrate16 on the copies, and records
+--         check_samples and check_maxdiff.  Left at 0 if no frame of the
+--         set's size is available.
+--
+-- Notes: The lock is held only for the copies, so the frame filter is
+--        never kept waiting behind the scalar pass.
+=========================================================================== */
+static void calib_self_check(WND_INFO *wnd) {
+	static char *rname = "calib_self_check";
+
+	IMAGE_INFO info, again;
+	unsigned short *raw, *dark, *simd, *scalar;
+	float *gain;
+	void *data;
+	int i, n, length, maxval, diff, maxdiff;
+
+	if (Camera_GetImageInfo(wnd, -1, &info) != 0 || info.imageID < 0) return;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	n = wnd->calib.width * wnd->calib.height;
+	maxval = (1 << wnd->calib.bit_depth) - 1;
+	LeaveCriticalSection(&wnd->calib.lock);
+	if (n <= 0 || info.width*info.height != n) return;
+
+	if ( (raw = malloc(4*n*sizeof(*raw) + n*sizeof(*gain))) == NULL) return;
+	dark = raw+n; simd = dark+n; scalar = simd+n; gain = (float *) (scalar+n);
+
+	/* Private copy of the frame (skip if it was reused meanwhile) */
+	if (Camera_GetImageData(wnd, info.frame, &data, &length) != 0 || data == NULL || length < (int) (n*sizeof(*raw))) { free(raw); return; }
+	memcpy(raw, data, n*sizeof(*raw));
+	if (Camera_GetImageInfo(wnd, info.frame, &again) != 0 || again.imageID != info.imageID) { free(raw); return; }
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->calib.dark_eff[wnd->calib.ieff] == NULL || wnd->calib.gain_eff == NULL || wnd->calib.width*wnd->calib.height != n) {
+		LeaveCriticalSection(&wnd->calib.lock);
+		free(raw); return;
+	}
+	memcpy(dark, wnd->calib.dark_eff[wnd->calib.ieff], n*sizeof(*dark));
+	memcpy(gain, wnd->calib.gain_eff, n*sizeof(*gain));
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	IP_Calibrate16(raw, simd,   dark, gain, n, maxval, FALSE);
+	IP_Calibrate16(raw, scalar, dark, gain, n, maxval, TRUE);
+	maxdiff = 0;
+	for (i=0; i<n; i++) {
+		diff = abs((int) simd[i] - (int) scalar[i]);
+		if (diff > maxdiff) maxdiff = diff;
+	}
+	free(raw);
+
+	EnterCriticalSection(&wnd->calib.lock);
+	wnd->calib.check_samples = n;
+	wnd->calib.check_maxdiff = maxdiff;
+	LeaveCriticalSection(&wnd->calib.lock);
+	if (maxdiff > 1) { fprintf(stderr, "[%s] SIMD and scalar corrections differ by up to %d\n", rname, maxdiff); fflush(stderr); }
+	return;
+}
+
+/* ===========================================================================
+-- Install (or remove) calib_filter() as needed by the calibration and defect map
+--
+-- Usage: static int calib_install(WND_INFO *wnd);
+--
+-- Return: 0 if successful, !0 from TL_SetFrameFilter()
+=========================================================================== */
+static int calib_install(WND_INFO *wnd) {
+	TL_CAMERA *tl;
+
+	if (wnd->Camera.driver != TL) return 1;
+	tl = (TL_CAMERA *) wnd->Camera.details;
+	if (wnd->calib.enabled || wnd->defect.enabled) return TL_SetFrameFilter(tl, calib_filter, wnd);
+	return TL_SetFrameFilter(tl, NULL, NULL);
+}
+
+/* ===========================================================================
+-- Copy the accumulator mean for a calibration or defect build
+--
+-- Usage: static int calib_accum_mean(WND_INFO *wnd, float **mean, int *width, int *height,
+--                                    int *format, int *bit_depth, double *ms, double *dB);
+--
+-- Output: *mean - malloc'd width*height copy (caller frees), and its layout
+--                 and the exposure / gain of the accumulated frames
+--
+-- Return: 0 if successful, 2 if nothing accumulated, 4 if not MONO16/BAYER16 or no memory
+=========================================================================== */
+static int calib_accum_mean(WND_INFO *wnd, float **mean, int *width, int *height, int *format, int *bit_depth, double *ms, double *dB) {
+	float *data;
+	int n;
+
+	*mean = NULL;
+	if (wnd->accum.mutex == NULL) return 2;
+
+	WaitForSingleObject(wnd->accum.mutex, INFINITE);
+	if ( (data = accum_result(wnd, FRAME_MEAN)) == NULL) { ReleaseMutex(wnd->accum.mutex); return 2; }
+	*width = wnd->accum.width; *height = wnd->accum.height; n = wnd->accum.nsamples;
+	*format = wnd->accum.format; *bit_depth = wnd->accum.bit_depth;
+	*ms = wnd->accum.info.exposure; *dB = wnd->accum.info.master_gain;
+	if ( (*format != PIXEL_MONO16 && *format != PIXEL_BAYER16) || n != *width * *height) { ReleaseMutex(wnd->accum.mutex); return 4; }
+	if ( (*mean = malloc(n*sizeof(**mean))) == NULL) { ReleaseMutex(wnd->accum.mutex); return 4; }
+	memcpy(*mean, data, n*sizeof(**mean));
+	ReleaseMutex(wnd->accum.mutex);
+	return 0;
+}
+
+/* ===========================================================================
+-- Take a calibration component from the accumulator mean
+--
+-- Usage: int Calib_Capture(CALIB_KIND kind);
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int Calib_Capture(CALIB_KIND kind) {
+	static char *rname = "Calib_Capture";
+
+	WND_INFO *wnd;
+	CAMERA_INFO camera;
+	float *mean;
+	unsigned short *out, *dark;
+	double ms, dB, ms_now;
+	int i, n, rc, width, height, format, bit_depth;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (kind != CALIB_BIAS && kind != CALIB_DARK && kind != CALIB_FLAT) return 2;
+	calib_init(wnd);
+	if (wnd->calib.enabled) return 3;						/* Accumulated frames would already be corrected */
+
+	/* Copy the mean out so the accumulator is not held */
+	if ( (rc = calib_accum_mean(wnd, &mean, &width, &height, &format, &bit_depth, &ms, &dB)) != 0) return rc;
+	n = width*height;
+
+	Camera_GetCameraInfo(wnd, &camera);
+	ms_now = Camera_GetExposure(wnd);
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (width != wnd->calib.width || height != wnd->calib.height || format != wnd->calib.format ||
+		 strcmp(camera.serial, wnd->calib.serial) != 0) {
+		if (wnd->calib.width != 0) { fprintf(stderr, "[%s] Image size or camera changed ... starting a new calibration set\n", rname); fflush(stderr); }
+		calib_free(wnd);
+		strcpy_s(wnd->calib.serial, sizeof(wnd->calib.serial), camera.serial);
+		wnd->calib.width = width; wnd->calib.height = height;
+		wnd->calib.format = format; wnd->calib.bit_depth = bit_depth;
+	}
+
+	rc = 0;
+	switch (kind) {
+		case CALIB_BIAS:
+		case CALIB_DARK:
+			if (kind == CALIB_BIAS) {
+				if (wnd->calib.bias == NULL) wnd->calib.bias = malloc(n*sizeof(*wnd->calib.bias));
+				out = wnd->calib.bias;
+			} else {
+				if (wnd->calib.dark == NULL) wnd->calib.dark = malloc(n*sizeof(*wnd->calib.dark));
+				out = wnd->calib.dark;
+				wnd->calib.ms_dark = ms;
+				wnd->calib.dB_gain = dB;
+			}
+			if (out == NULL) { rc = 4; break; }
+			for (i=0; i<n; i++) out[i] = (mean[i] >= 65535.0f) ? 65535 : (unsigned short) (mean[i] + 0.5f) ;
+			break;
+
+		case CALIB_FLAT:
+			if (wnd->calib.flat == NULL) wnd->calib.flat = malloc(n*sizeof(*wnd->calib.flat));
+			if (wnd->calib.flat == NULL || (dark = malloc(n*sizeof(*dark))) == NULL) { rc = 4; break; }
+			calib_dark_at(wnd, ms, dark);
+			if (IP_FlatGain(mean, dark, width, height, format, wnd->calib.flat) != 0) {
+				free(wnd->calib.flat); wnd->calib.flat = NULL;
+				rc = 5;
+			}
+			free(dark);
+			break;
+	}
+	if (rc == 0 && ! calib_prepare(wnd, ms_now)) rc = 4;
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	free(mean);
+	return rc;
+}
+
+/* ===========================================================================
+-- Turn correction of incoming frames on or off
+--
+-- Usage: int Calib_Enable(int enable);
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int Calib_Enable(int enable) {
+	static char *rname = "Calib_Enable";
+
+	WND_INFO *wnd;
+	double ms;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return -1;
+	calib_init(wnd);
+	if (enable < 0) return wnd->calib.enabled;
+	if (wnd->Camera.driver != TL) return enable ? -2 : 0 ;
+
+	if (! enable) {
+		EnterCriticalSection(&wnd->calib.lock);
+		wnd->calib.enabled = FALSE;
+		LeaveCriticalSection(&wnd->calib.lock);
+		calib_install(wnd);
+		return 0;
+	}
+
+	/* Set must be for this camera, size and gain; dark prepared at the current exposure */
+	if ( (rc = calib_check_camera(wnd)) != 0) return rc;
+	ms = Camera_GetExposure(wnd);
+
+	rc = 1;
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->calib.bias == NULL && wnd->calib.dark == NULL && wnd->calib.flat == NULL) {
+		rc = -3;
+	} else if (! calib_prepare(wnd, ms)) {
+		rc = -3;
+	} else {
+		wnd->calib.check_samples = wnd->calib.check_maxdiff = 0;
+		wnd->calib.frames = 0;
+		wnd->calib.size_logged = FALSE;
+		wnd->calib.enabled = TRUE;
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	/* SIMD versus scalar on a ring frame, here rather than in the frame callback */
+	if (rc == 1) calib_self_check(wnd);
+
+	if (rc == 1 && calib_install(wnd) != 0) {
+		fprintf(stderr, "[%s] Unable to install the calibration filter\n", rname); fflush(stderr);
+		wnd->calib.enabled = FALSE;
+		rc = 0;
+	}
+	return rc;
+}
+
+int Calib_Status(CALIB_INFO *info) {
+
+	WND_INFO *wnd;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (info == NULL || ! wnd->calib.lock_init) return 0;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	info->enabled   = wnd->calib.enabled && wnd->Camera.driver == TL &&
+						   ((TL_CAMERA *) wnd->Camera.details)->frame_filter == calib_filter;
+	info->have_bias = wnd->calib.bias != NULL;
+	info->have_dark = wnd->calib.dark != NULL;
+	info->have_flat = wnd->calib.flat != NULL;
+	info->width     = wnd->calib.width;
+	info->height    = wnd->calib.height;
+	strcpy_s(info->serial, sizeof(info->serial), wnd->calib.serial);
+	info->ms_dark   = wnd->calib.ms_dark;
+	info->dB_gain   = wnd->calib.dB_gain;
+	info->frames    = wnd->calib.frames;
+	info->check_samples = wnd->calib.check_samples;
+	info->check_maxdiff = wnd->calib.check_maxdiff;
+	LeaveCriticalSection(&wnd->calib.lock);
+	return 0;
+}
+
+/* ===========================================================================
+-- Write / read the calibration set (CALIB_FILE_HEADER then the arrays)
+--
+-- Usage: int Calib_Save(char *path);
+--        int Calib_Load(char *path);
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int Calib_Save(char *path) {
+	static char *rname = "Calib_Save";
+
+	WND_INFO *wnd;
+	CALIB_FILE_HEADER header;
+	char fname[PATH_MAX];
+	FILE *funit;
+	size_t n;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	calib_init(wnd);
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->calib.width <= 0 || (wnd->calib.bias == NULL && wnd->calib.dark == NULL && wnd->calib.flat == NULL)) {
+		LeaveCriticalSection(&wnd->calib.lock);
+		return 2;
+	}
+
+	if (path != NULL && *path != '\0') {
+		strcpy_s(fname, sizeof(fname), path);
+	} else {
+		sprintf_s(fname, sizeof(fname), "%s_%.3fms_%.1fdB.zcal", *wnd->calib.serial ? wnd->calib.serial : "camera", wnd->calib.ms_dark, wnd->calib.dB_gain);
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic       = CALIB_FILE_MAGIC;
+	header.header_size = sizeof(header);
+	header.version     = 1;
+	strcpy_s(header.serial, sizeof(header.serial), wnd->calib.serial);
+	header.width  = wnd->calib.width;  header.height    = wnd->calib.height;
+	header.format = wnd->calib.format; header.bit_depth = wnd->calib.bit_depth;
+	header.ms_dark = wnd->calib.ms_dark; header.dB_gain = wnd->calib.dB_gain;
+	header.have_bias = wnd->calib.bias != NULL;
+	header.have_dark = wnd->calib.dark != NULL;
+	header.have_flat = wnd->calib.flat != NULL;
+	n = (size_t) header.width*header.height;
+
+	if (fopen_s(&funit, fname, "wb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, fname); fflush(stderr);
+		rc = 6;
+	} else {
+		rc = (fwrite(&header, sizeof(header), 1, funit) == 1) ? 0 : 6 ;
+		if (rc == 0 && header.have_bias && fwrite(wnd->calib.bias, sizeof(*wnd->calib.bias), n, funit) != n) rc = 6;
+		if (rc == 0 && header.have_dark && fwrite(wnd->calib.dark, sizeof(*wnd->calib.dark), n, funit) != n) rc = 6;
+		if (rc == 0 && header.have_flat && fwrite(wnd->calib.flat, sizeof(*wnd->calib.flat), n, funit) != n) rc = 6;
+		fclose(funit);
+		if (rc != 0) { fprintf(stderr, "[%s] Failed writing \"%s\"\n", rname, fname); fflush(stderr); }
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+	return rc;
+}
+
+/* Read and validate just the header */
+static BOOL calib_read_header(char *fname, CALIB_FILE_HEADER *header) {
+	FILE *funit;
+	BOOL ok;
+
+	if (fopen_s(&funit, fname, "rb") != 0 || funit == NULL) return FALSE;
+	ok = fread(header, sizeof(*header), 1, funit) == 1 && header->magic == CALIB_FILE_MAGIC &&
+		  header->header_size == sizeof(*header) && header->version == 1 && header->width > 0 && header->height > 0 &&
+		  memchr(header->serial, '\0', sizeof(header->serial)) != NULL;			/* Used as a string */
+	fclose(funit);
+	return ok;
+}
+
+int Calib_Load(char *path) {
+	static char *rname = "Calib_Load";
+
+	WND_INFO *wnd;
+	CAMERA_INFO camera;
+	CALIB_FILE_HEADER header;
+	struct _finddata_t find;
+	intptr_t hfind;
+	char fname[PATH_MAX], best[PATH_MAX];
+	unsigned short *bias, *dark;
+	float *flat;
+	double ms, gains[4], err, best_err;
+	DWORD attrib;
+	FILE *funit;
+	size_t n;
+	BOOL ok;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	calib_init(wnd);
+	if (path == NULL || *path == '\0') path = ".";
+
+	/* A directory ==> pick the best set for this camera and its current settings */
+	attrib = GetFileAttributes(path);
+	if (attrib != INVALID_FILE_ATTRIBUTES && (attrib & FILE_ATTRIBUTE_DIRECTORY)) {
+		Camera_GetCameraInfo(wnd, &camera);
+		ms = Camera_GetExposure(wnd);
+		Camera_GetGains(wnd, gains, NULL);
+		*best = '\0'; best_err = 0;
+		sprintf_s(fname, sizeof(fname), "%s/*.zcal", path);
+		if ( (hfind = _findfirst(fname, &find)) != -1) {
+			do {
+				sprintf_s(fname, sizeof(fname), "%s/%s", path, find.name);
+				if (! calib_read_header(fname, &header)) continue;
+				if (strcmp(header.serial, camera.serial) != 0 || fabs(header.dB_gain-gains[M_CHAN]) > 0.1) continue;
+				err = (header.ms_dark > 0 && ms > 0) ? fabs(log(header.ms_dark/ms)) : 1E10 ;
+				if (*best == '\0' || err < best_err) { strcpy_s(best, sizeof(best), fname); best_err = err; }
+			} while (_findnext(hfind, &find) == 0);
+			_findclose(hfind);
+		}
+		if (*best == '\0') {
+			fprintf(stderr, "[%s] No calibration set in \"%s\" for camera %s at %.1f dB\n", rname, path, camera.serial, gains[M_CHAN]); fflush(stderr);
+			return 6;
+		}
+		path = best;
+	}
+
+	if (! calib_read_header(path, &header)) {
+		fprintf(stderr, "[%s] \"%s\" is not a calibration file\n", rname, path); fflush(stderr);
+		return 6;
+	}
+	n = (size_t) header.width*header.height;
+	bias = header.have_bias ? malloc(n*sizeof(*bias)) : NULL;
+	dark = header.have_dark ? malloc(n*sizeof(*dark)) : NULL;
+	flat = header.have_flat ? malloc(n*sizeof(*flat)) : NULL;
+
+	ok = (! header.have_bias || bias != NULL) && (! header.have_dark || dark != NULL) && (! header.have_flat || flat != NULL) &&
+		  fopen_s(&funit, path, "rb") == 0 && funit != NULL;
+	if (ok) {
+		ok = fseek(funit, header.header_size, SEEK_SET) == 0 &&
+			  (bias == NULL || fread(bias, sizeof(*bias), n, funit) == n) &&
+			  (dark == NULL || fread(dark, sizeof(*dark), n, funit) == n) &&
+			  (flat == NULL || fread(flat, sizeof(*flat), n, funit) == n);
+		fclose(funit);
+	}
+	if (! ok) {
+		fprintf(stderr, "[%s] Failed reading \"%s\"\n", rname, path); fflush(stderr);
+		if (bias != NULL) free(bias);
+		if (dark != NULL) free(dark);
+		if (flat != NULL) free(flat);
+		return 6;
+	}
+
+	EnterCriticalSection(&wnd->calib.lock);
+	calib_free(wnd);
+	strcpy_s(wnd->calib.serial, sizeof(wnd->calib.serial), header.serial);
+	wnd->calib.width  = header.width;  wnd->calib.height    = header.height;
+	wnd->calib.format = header.format; wnd->calib.bit_depth = header.bit_depth;
+	wnd->calib.ms_dark = header.ms_dark; wnd->calib.dB_gain = header.dB_gain;
+	wnd->calib.bias = bias; wnd->calib.dark = dark; wnd->calib.flat = flat;
+	if (! calib_prepare(wnd, Camera_GetExposure(wnd))) wnd->calib.enabled = FALSE;			/* Filter passes frames through */
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	/* Loaded while enabled ... stop if the new set is not for this camera */
+	if (wnd->calib.enabled && calib_check_camera(wnd) != 0) {
+		EnterCriticalSection(&wnd->calib.lock);
+		wnd->calib.enabled = FALSE;
+		LeaveCriticalSection(&wnd->calib.lock);
+		calib_install(wnd);
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Hot / dead pixel map (shares calib.lock and calib_filter with the calibration)
+--
+-- Usage: int Defect_Build(CALIB_KIND kind, double threshold);
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int Defect_Build(CALIB_KIND kind, double threshold) {
+	static char *rname = "Defect_Build";
+
+	WND_INFO *wnd;
+	CAMERA_INFO camera;
+	CFA_PHASE phase;
+	float *mean;
+	int *found, *merged;
+	double ms, dB;
+	int i, j, k, n, rc, width, height, format, bit_depth, added;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (kind != CALIB_BIAS && kind != CALIB_DARK && kind != CALIB_FLAT) return 2;
+	calib_init(wnd);
+	if (wnd->defect.enabled) return 3;						/* Accumulated frames would already be corrected */
+
+	if ( (rc = calib_accum_mean(wnd, &mean, &width, &height, &format, &bit_depth, &ms, &dB)) != 0) return rc;
+	if ( (found = malloc(DEFECT_MAX_COUNT*sizeof(*found))) == NULL) { free(mean); return 4; }
+
+	if (kind == CALIB_FLAT) {
+		n = IP_FindDefects(mean, width, height, format, 0.0, (threshold > 0) ? threshold : DEFECT_DFLT_FRACTION, found, DEFECT_MAX_COUNT);
+	} else {
+		n = IP_FindDefects(mean, width, height, format, (threshold > 0) ? threshold : DEFECT_DFLT_NSIGMA, 0.0, found, DEFECT_MAX_COUNT);
+	}
+	free(mean);
+	if (n < 0 || n > DEFECT_MAX_COUNT) {
+		fprintf(stderr, "[%s] %d defects found ... threshold too low?\n", rname, n); fflush(stderr);
+		free(found);
+		return (n < 0) ? 4 : 5 ;
+	}
+
+	Camera_GetCameraInfo(wnd, &camera);
+	phase = (wnd->Camera.driver == TL) ? (CFA_PHASE) ((TL_CAMERA *) wnd->Camera.details)->color_filter : CFA_GREEN_LEFT_OF_RED ;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (width != wnd->defect.width || height != wnd->defect.height || format != wnd->defect.format ||
+		 strcmp(camera.serial, wnd->defect.serial) != 0) {
+		if (wnd->defect.index != NULL) { free(wnd->defect.index); wnd->defect.index = NULL; }
+		wnd->defect.ndefects = wnd->defect.nhot = wnd->defect.ndead = 0;
+		strcpy_s(wnd->defect.serial, sizeof(wnd->defect.serial), camera.serial);
+		wnd->defect.width = width; wnd->defect.height = height; wnd->defect.format = format;
+		wnd->defect.cfa_phase = phase;
+	}
+
+	/* Merge the two sorted lists */
+	rc = 0;
+	if ( (merged = malloc((wnd->defect.ndefects+n)*sizeof(*merged)+1)) == NULL) {
+		rc = 4;
+	} else {
+		for (i=j=k=0; i<wnd->defect.ndefects || j<n; ) {
+			if (j >= n || (i < wnd->defect.ndefects && wnd->defect.index[i] < found[j])) {
+				merged[k++] = wnd->defect.index[i++];
+			} else {
+				if (i < wnd->defect.ndefects && wnd->defect.index[i] == found[j]) i++;
+				merged[k++] = found[j++];
+			}
+		}
+		added = k - wnd->defect.ndefects;
+		if (k > DEFECT_MAX_COUNT) {
+			free(merged);
+			rc = 5;
+		} else {
+			if (wnd->defect.index != NULL) free(wnd->defect.index);
+			wnd->defect.index = merged;
+			wnd->defect.ndefects = k;
+			if (kind == CALIB_FLAT) wnd->defect.ndead += added; else wnd->defect.nhot += added;
+		}
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	free(found);
+	return rc;
+}
+
+int Defect_Clear(void) {
+	WND_INFO *wnd;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	calib_init(wnd);
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->defect.index != NULL) { free(wnd->defect.index); wnd->defect.index = NULL; }
+	wnd->defect.ndefects = wnd->defect.nhot = wnd->defect.ndead = 0;
+	LeaveCriticalSection(&wnd->calib.lock);
+	return 0;
+}
+
+int Defect_Enable(int enable) {
+	static char *rname = "Defect_Enable";
+
+	WND_INFO *wnd;
+	CAMERA_INFO camera;
+	TL_CAMERA *tl;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return -1;
+	calib_init(wnd);
+	if (enable < 0) return wnd->defect.enabled;
+	if (wnd->Camera.driver != TL) return enable ? -2 : 0 ;
+	tl = (TL_CAMERA *) wnd->Camera.details;
+	Camera_GetCameraInfo(wnd, &camera);
+
+	rc = enable ? 1 : 0 ;
+	EnterCriticalSection(&wnd->calib.lock);
+	if (enable && (tl->width != wnd->defect.width || tl->height != wnd->defect.height || wnd->defect.index == NULL)) {
+		rc = -3;
+	} else if (enable && strcmp(camera.serial, wnd->defect.serial) != 0) {
+		fprintf(stderr, "[%s] Defect map is for camera %s, not %s\n", rname, wnd->defect.serial, camera.serial); fflush(stderr);
+		rc = -4;
+	} else {
+		if (enable) { wnd->defect.frames = 0; wnd->defect.size_logged = FALSE; }
+		wnd->defect.enabled = enable ? TRUE : FALSE ;
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	if (rc >= 0 && calib_install(wnd) != 0) {
+		fprintf(stderr, "[%s] Unable to install the defect filter\n", rname); fflush(stderr);
+		wnd->defect.enabled = FALSE;
+		rc = 0;
+	}
+	return rc;
+}
+
+int Defect_Status(DEFECT_INFO *info) {
+
+	WND_INFO *wnd;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (info == NULL || ! wnd->calib.lock_init) return 0;
+
+	EnterCriticalSection(&wnd->calib.lock);
+	info->enabled    = wnd->defect.enabled && wnd->Camera.driver == TL &&
+						    ((TL_CAMERA *) wnd->Camera.details)->frame_filter == calib_filter;
+	info->ndefects   = wnd->defect.ndefects;
+	info->nhot       = wnd->defect.nhot;
+	info->ndead      = wnd->defect.ndead;
+	info->width      = wnd->defect.width;
+	info->height     = wnd->defect.height;
+	strcpy_s(info->serial, sizeof(info->serial), wnd->defect.serial);
+	info->frames     = wnd->defect.frames;
+	info->ms_correct = wnd->defect.ms_correct;
+	LeaveCriticalSection(&wnd->calib.lock);
+	return 0;
+}
+
+/* ===========================================================================
+-- Write / read the defect map (DEFECT_FILE_HEADER then the indices)
+--
+-- Usage: int Defect_Save(char *path);
+--        int Defect_Load(char *path);
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int Defect_Save(char *path) {
+	static char *rname = "Defect_Save";
+
+	WND_INFO *wnd;
+	DEFECT_FILE_HEADER header;
+	char fname[PATH_MAX];
+	FILE *funit;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	calib_init(wnd);
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->defect.index == NULL) { LeaveCriticalSection(&wnd->calib.lock); return 2; }
+
+	if (path != NULL && *path != '\0') {
+		strcpy_s(fname, sizeof(fname), path);
+	} else {
+		sprintf_s(fname, sizeof(fname), "%s.zdef", *wnd->defect.serial ? wnd->defect.serial : "camera");
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic       = DEFECT_FILE_MAGIC;
+	header.header_size = sizeof(header);
+	header.version     = 2;
+	strcpy_s(header.serial, sizeof(header.serial), wnd->defect.serial);
+	header.width    = wnd->defect.width;
+	header.height   = wnd->defect.height;
+	header.format   = wnd->defect.format;
+	header.ndefects = wnd->defect.ndefects;
+	header.nhot     = wnd->defect.nhot;
+	header.ndead    = wnd->defect.ndead;
+	header.cfa_phase = wnd->defect.cfa_phase;
+
+	if (fopen_s(&funit, fname, "wb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, fname); fflush(stderr);
+		rc = 6;
+	} else {
+		rc = (fwrite(&header, sizeof(header), 1, funit) == 1 &&
+				fwrite(wnd->defect.index, sizeof(*wnd->defect.index), header.ndefects, funit) == (size_t) header.ndefects) ? 0 : 6 ;
+		fclose(funit);
+		if (rc != 0) { fprintf(stderr, "[%s] Failed writing \"%s\"\n", rname, fname); fflush(stderr); }
+	}
+	LeaveCriticalSection(&wnd->calib.lock);
+	return rc;
+}
+
+int Defect_Load(char *path) {
+	static char *rname = "Defect_Load";
+
+	WND_INFO *wnd;
+	CAMERA_INFO camera;
+	DEFECT_FILE_HEADER header;
+	char fname[PATH_MAX];
+	DWORD attrib;
+	FILE *funit;
+	int i, *index;
+	BOOL ok;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	calib_init(wnd);
+	if (path == NULL || *path == '\0') path = ".";
+
+	/* A directory ==> the map for this camera */
+	attrib = GetFileAttributes(path);
+	if (attrib != INVALID_FILE_ATTRIBUTES && (attrib & FILE_ATTRIBUTE_DIRECTORY)) {
+		Camera_GetCameraInfo(wnd, &camera);
+		sprintf_s(fname, sizeof(fname), "%s/%s.zdef", path, camera.serial);
+		path = fname;
+	}
+
+	if (fopen_s(&funit, path, "rb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		return 6;
+	}
+	index = NULL;
+	memset(&header, 0, sizeof(header));
+	ok = fread(&header, 1, sizeof(header), funit) >= offsetof(DEFECT_FILE_HEADER, cfa_phase) && header.magic == DEFECT_FILE_MAGIC;
+	if (ok && header.version == 1 && header.header_size == offsetof(DEFECT_FILE_HEADER, cfa_phase)) {
+		header.cfa_phase = CFA_GREEN_LEFT_OF_RED;								/* Layout assumed before the phase was stored */
+	} else if (! (header.version == 2 && header.header_size == sizeof(header))) {
+		ok = FALSE;
+	}
+	ok = ok && memchr(header.serial, '\0', sizeof(header.serial)) != NULL &&		/* Used as a string */
+		  header.width > 0 && header.height > 0 && header.ndefects > 0 && header.ndefects <= DEFECT_MAX_COUNT &&
+		  header.cfa_phase >= CFA_RED && header.cfa_phase <= CFA_GREEN_LEFT_OF_BLUE &&
+		  fseek(funit, header.header_size, SEEK_SET) == 0 &&
+		  (index = malloc(header.ndefects*sizeof(*index))) != NULL &&
+		  fread(index, sizeof(*index), header.ndefects, funit) == (size_t) header.ndefects;
+	fclose(funit);
+	for (i=1; ok && i<header.ndefects; i++) if (index[i] <= index[i-1]) ok = FALSE;		/* Must be sorted for the bsearch */
+	if (! ok) {
+		fprintf(stderr, "[%s] \"%s\" is not a valid defect map\n", rname, path); fflush(stderr);
+		if (index != NULL) free(index);
+		return 6;
+	}
+
+	EnterCriticalSection(&wnd->calib.lock);
+	if (wnd->defect.index != NULL) free(wnd->defect.index);
+	strcpy_s(wnd->defect.serial, sizeof(wnd->defect.serial), header.serial);
+	wnd->defect.width  = header.width;
+	wnd->defect.height = header.height;
+	wnd->defect.format = header.format;
+	wnd->defect.cfa_phase = (CFA_PHASE) header.cfa_phase;
+	wnd->defect.index    = index;
+	wnd->defect.ndefects = header.ndefects;
+	wnd->defect.nhot     = header.nhot;
+	wnd->defect.ndead    = header.ndead;
+	LeaveCriticalSection(&wnd->calib.lock);
+
+	/* Loaded while enabled ... recheck against the open camera */
+	if (wnd->defect.enabled && Defect_Enable(1) != 1) Defect_Enable(0);
+	return 0;
+}
+
+/* ===========================================================================
+-- Multi-ROI extraction streams (see ZooCam.h for the interface description)
+--
+-- Usage: int ROI_Stream_Add(ROI_STREAM_DEF *def);
+--        int ROI_Stream_Remove(char *name);
+--
+-- Inputs: def  - stream definition (name must be non-blank)
+--         name - stream to remove (NULL or "" ==> all)
+--
+-- Output: Add registers (or redefines) the stream; the window is clipped and
+--         its slots allocated by the first frame that arrives.  Remove frees
+--         the slots and compacts the table.
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+#define	ROI_WAIT_SLICE_MS		(20)					/* Recheck interval while waiting */
+
+int ROI_Stream_Add(ROI_STREAM_DEF *def) {
+	static char *rname = "ROI_Stream_Add";
+
+	WND_INFO *wnd;
+	struct _ROI_STREAM *roi;
+	IMAGE_INFO info;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (def == NULL || *def->name == '\0' || def->nslots < 0 || def->nslots > ROI_MAX_SLOTS) return 2;
+	if (def->format != PIXEL_UNKNOWN && def->format != PIXEL_MONO8  && def->format != PIXEL_RGB24 &&
+		 def->format != PIXEL_BGR24   && def->format != PIXEL_MONO16 && def->format != PIXEL_BAYER16) return 2;
+	def->name[sizeof(def->name)-1] = '\0';
+
+	roi_init(wnd);
+	EnterCriticalSection(&wnd->roi.lock);
+	if ( (roi = roi_find(wnd, def->name)) != NULL) {
+		roi_free(roi);									/* Redefine ... old frames discarded */
+	} else if (wnd->roi.nstreams >= ROI_MAX_STREAMS) {
+		roi = NULL;
+	} else {
+		roi = wnd->roi.stream + wnd->roi.nstreams++;
+		if (roi->event == NULL) roi->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	}
+
+	if (roi == NULL) {
+		rc = 3;
+	} else {
+		roi->def = *def;
+		if (roi->def.bin < 1)    roi->def.bin = 1;
+		if (roi->def.every < 1)  roi->def.every = 1;
+		if (roi->def.nslots < 1) roi->def.nslots = ROI_DFLT_SLOTS;
+		memset(&roi->status, 0, sizeof(roi->status));
+		roi->status.def      = roi->def;
+		roi->status.last_seq = -1;
+		roi->next_seq = 0;
+		roi->phase    = 0;
+		rc = 0;
+	}
+
+	/* First stream starts with the next frame to arrive */
+	if (rc == 0 && wnd->roi.nstreams == 1) wnd->roi.last_id = (Camera_GetImageInfo(wnd, -1, &info) == 0) ? info.imageID : -1 ;
+	LeaveCriticalSection(&wnd->roi.lock);
+
+	if (rc == 3) { fprintf(stderr, "[%s] All %d ROI streams in use\n", rname, ROI_MAX_STREAMS); fflush(stderr); }
+	return rc;
+}
+
+int ROI_Stream_Remove(char *name) {
+
+	WND_INFO *wnd;
+	struct _ROI_STREAM *roi, save;
+	int rc;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (! wnd->roi.lock_init) return (name == NULL || *name == '\0') ? 0 : 2 ;
+
+	EnterCriticalSection(&wnd->roi.lock);
+	if (name == NULL || *name == '\0') {
+		while (wnd->roi.nstreams > 0) roi_free(wnd->roi.stream + --wnd->roi.nstreams);
+		rc = 0;
+	} else if ( (roi = roi_find(wnd, name)) == NULL) {
+		rc = 2;
+	} else {
+		roi_free(roi);
+		save = *roi;										/* Keep its event with the free entry */
+		*roi = wnd->roi.stream[--wnd->roi.nstreams];
+		wnd->roi.stream[wnd->roi.nstreams] = save;
+		rc = 0;
+	}
+	LeaveCriticalSection(&wnd->roi.lock);
+	return rc;
+}
+
+/* ===========================================================================
+-- Helpers for the stream table (call with wnd->roi.lock held, except init)
+--
+-- Usage: static void roi_init(WND_INFO *wnd);
+--        static struct _ROI_STREAM *roi_find(WND_INFO *wnd, char *name);
+--        static void roi_free(struct _ROI_STREAM *roi);
+--        static BOOL roi_layout(struct _ROI_STREAM *roi, IMAGE_BUFFER *src);
+--
+-- Output: roi_layout clips the window to the ring image and (re)allocates
+--         the slots for that geometry.  A stream whose window lies outside
+--         the image stays defined but collects nothing.
+--
+-- Return: roi_find: the stream or NULL; roi_layout: TRUE if usable
+=========================================================================== */
+static void roi_init(WND_INFO *wnd) {
+	if (! wnd->roi.lock_init) {
+		InitializeCriticalSection(&wnd->roi.lock);
+		wnd->roi.lock_init = TRUE;
+	}
+	return;
+}
+
+static struct _ROI_STREAM *roi_find(WND_INFO *wnd, char *name) {
+	int i;
+
+	if (name == NULL) return NULL;
+	for (i=0; i<wnd->roi.nstreams; i++) {
+		if (strncmp(wnd->roi.stream[i].def.name, name, sizeof(wnd->roi.stream[i].def.name)) == 0) return wnd->roi.stream+i;
+	}
+	return NULL;
+}
+
+static void roi_free(struct _ROI_STREAM *roi) {
+	if (roi->slots  != NULL) { free(roi->slots);  roi->slots  = NULL; }
+	if (roi->frames != NULL) { free(roi->frames); roi->frames = NULL; }
+	roi->nslots = 0;
+	roi->src_width = roi->src_height = roi->src_format = 0;
+	roi->status.first_seq = 0;
+	roi->status.last_seq  = -1;
+	return;
+}
+
+static BOOL roi_layout(struct _ROI_STREAM *roi, IMAGE_BUFFER *src) {
+	static char *rname = "roi_layout";
+
+	IMAGE_REGION region;
+	IMAGE_BUFFER layout;
+	int rc;
+
+	if (roi->src_width == src->width && roi->src_height == src->height && roi->src_format == src->format) return roi->slots != NULL;
+
+	roi_free(roi);
+	roi->src_width  = src->width;
+	roi->src_height = src->height;
+	roi->src_format = src->format;
+
+	region.ulx = roi->def.ulx;  region.width  = roi->def.width;
+	region.uly = roi->def.uly;  region.height = roi->def.height;
+	region.bin = roi->def.bin;  region.bDecimate = roi->def.bDecimate;
+	if ( (rc = IP_RegionGeometry(src, &region, (roi->def.format != PIXEL_UNKNOWN) ? roi->def.format : src->format, &layout)) != 0) {
+		fprintf(stderr, "[%s] ROI stream \"%s\" does not fit the %dx%d image (rc=%d)\n", rname, roi->def.name, src->width, src->height, rc); fflush(stderr);
+		return FALSE;
+	}
+
+	roi->status.def.ulx    = region.ulx;   roi->status.def.uly    = region.uly;
+	roi->status.def.width  = region.width; roi->status.def.height = region.height;
+	roi->status.width       = layout.width;
+	roi->status.height      = layout.height;
+	roi->status.format      = layout.format;
+	roi->status.bit_depth   = layout.bit_depth;
+	roi->status.frame_bytes = layout.pitch * layout.height;
+
+	if ( (roi->slots  = malloc((size_t) roi->def.nslots * roi->status.frame_bytes)) == NULL ||
+		  (roi->frames = calloc(roi->def.nslots, sizeof(*roi->frames))) == NULL) {
+		fprintf(stderr, "[%s] Unable to allocate %d frames for ROI stream \"%s\"\n", rname, roi->def.nslots, roi->def.name); fflush(stderr);
+		roi_free(roi);
+		roi->src_width = src->width;				/* Don't retry every frame */
+		roi->src_height = src->height;
+		roi->src_format = src->format;
+		return FALSE;
+	}
+	roi->nslots = roi->def.nslots;
+	return TRUE;
+}
+
+/* ===========================================================================
+-- Copy the registered windows out of each new ring frame
+--
+-- Usage: static void roi_stream_capture(WND_INFO *wnd);
+--
+-- Inputs: wnd - pointer to the WND_INFO structure
+--
+-- Output: Called by the image threads on every new image signal.  Walks
+--         back from the newest frame to the last one considered and copies
+--         each stream's window (oldest first) into its next slot.  The
+--         imageID is checked again after the copies, so a frame overwritten
+--         while being copied is counted lost rather than kept.
+=========================================================================== */
+static void roi_stream_capture(WND_INFO *wnd) {
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	IMAGE_BUFFER src, dst;
+	IMAGE_REGION region;
+	HIRES_TIMER *timer;
+	struct _ROI_STREAM *roi;
+	ROI_FRAME_INFO *frame;
+	BOOL copied[ROI_MAX_STREAMS];
+	int i, j, n, slot, skipped, every;
+	int frames[RING_WALK_MAX], ids[RING_WALK_MAX];	/* More than this per signal are counted lost */
+
+	if (Camera_GetRingInfo(wnd, &rings) != 0 || rings.nBuffers <= 0) return;
+
+	EnterCriticalSection(&wnd->roi.lock);
+
+	/* Walk back from the newest frame to the last one considered; older ones skipped are lost to streams due them */
+	if ( (n = ring_new_frames(wnd, wnd->roi.last_id, RING_WALK_MAX, frames, ids, &skipped)) > 0) wnd->roi.last_id = ids[0];
+	for (j=0; j<wnd->roi.nstreams && skipped>0; j++) {
+		roi = wnd->roi.stream+j;
+		every = roi->def.every;
+		roi->status.lost += (roi->phase + skipped + every-1)/every - (roi->phase + every-1)/every;
+		roi->phase += skipped;
+	}
+
+	timer = HiResTimerCreate();
+	for (i=n-1; i>=0; i--) {
+		if (Camera_GetImageBuffer(wnd, frames[i], &src) != 0 || src.data == NULL) continue;
+
+		/* Copy each stream due a frame into its next slot */
+		for (j=0; j<wnd->roi.nstreams; j++) {
+			roi = wnd->roi.stream+j;
+			copied[j] = FALSE;
+			if (roi->phase++ % roi->def.every != 0) continue;
+			if (! roi_layout(roi, &src)) continue;
+
+			HiResTimerReset(timer, 0.0);
+			region.ulx = roi->status.def.ulx;  region.width  = roi->status.def.width;
+			region.uly = roi->status.def.uly;  region.height = roi->status.def.height;
+			region.bin = roi->def.bin;         region.bDecimate = roi->def.bDecimate;
+			dst.format    = roi->status.format;
+			dst.width     = roi->status.width;
+			dst.height    = roi->status.height;
+			dst.pitch     = roi->status.frame_bytes / roi->status.height;
+			dst.bit_depth = roi->status.bit_depth;
+			dst.data      = roi->slots + (size_t) (roi->next_seq % roi->nslots) * roi->status.frame_bytes;
+			copied[j] = (IP_ExtractRegion(&src, &region, &dst) == 0);
+			roi->status.ms_copy = 1000.0*HiResTimerDelta(timer);
+		}
+
+		/* Commit only if the source survived the copies */
+		if (Camera_GetImageInfo(wnd, frames[i], &info) != 0 || info.imageID != ids[i]) {
+			for (j=0; j<wnd->roi.nstreams; j++) if (copied[j]) wnd->roi.stream[j].status.lost++;
+			Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+			continue;
+		}
+		for (j=0; j<wnd->roi.nstreams; j++) {
+			if (! copied[j]) continue;
+			roi = wnd->roi.stream+j;
+			slot = roi->next_seq % roi->nslots;
+			frame = roi->frames+slot;
+			frame->seq         = roi->next_seq;
+			frame->imageID     = info.imageID;
+			frame->timestamp   = info.timestamp;
+			frame->camera_time = info.camera_time;
+			frame->exposure    = info.exposure;
+			frame->width       = roi->status.width;
+			frame->height      = roi->status.height;
+			frame->pitch       = roi->status.frame_bytes / roi->status.height;
+			frame->format      = roi->status.format;
+			frame->bit_depth   = roi->status.bit_depth;
+			frame->length      = roi->status.frame_bytes;
+			roi->status.last_seq  = roi->next_seq++;
+			roi->status.first_seq = max(0, roi->next_seq - roi->nslots);
+			roi->status.captured++;
+			SetEvent(roi->event);
+		}
+	}
+	HiResTimerDestroy(timer);
+	LeaveCriticalSection(&wnd->roi.lock);
+	return;
+}
+
+/* ===========================================================================
+-- Status of the streams
+--
+-- Usage: int ROI_Stream_List(ROI_STREAM_INFO *info, int maxn);
+--
+-- Return: number of streams defined (info filled for up to maxn of them)
+=========================================================================== */
+int ROI_Stream_List(ROI_STREAM_INFO *info, int maxn) {
+
+	WND_INFO *wnd;
+	int i, n;
+
+	if ( (wnd = main_wnd) == NULL || ! wnd->roi.lock_init) return 0;
+
+	EnterCriticalSection(&wnd->roi.lock);
+	n = wnd->roi.nstreams;
+	for (i=0; info != NULL && i<n && i<maxn; i++) info[i] = wnd->roi.stream[i].status;
+	LeaveCriticalSection(&wnd->roi.lock);
+	return n;
+}
+
+/* ===========================================================================
+-- Copy one frame out of a stream (waiting for it if not yet captured)
+--
+-- Usage: int ROI_Stream_GetFrame(char *name, int seq, int msTimeout, ROI_FRAME_INFO **frame, size_t *length);
+--
+-- Inputs: name      - stream
+--         seq       - frame wanted (<0 ==> newest)
+--         msTimeout - longest to wait for seq (or for any frame if seq < 0)
+--         frame     - receives malloc'd ROI_FRAME_INFO + pixels
+--         length    - if !NULL, receives the bytes in *frame
+--
+-- Return: see ZooCam.h
+--
+-- Notes: The stream event is auto-reset and may be shared by several
+--        waiters, so the wait is done in short slices with the sequence
+--        rechecked each time.
+=========================================================================== */
+int ROI_Stream_GetFrame(char *name, int seq, int msTimeout, ROI_FRAME_INFO **frame, size_t *length) {
+
+	WND_INFO *wnd;
+	struct _ROI_STREAM *roi;
+	HIRES_TIMER *timer;
+	HANDLE event;
+	int rc, slot, want;
+	double remain;
+
+	if (frame  != NULL) *frame  = NULL;
+	if (length != NULL) *length = 0;
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (frame == NULL || ! wnd->roi.lock_init) return 2;
+
+	event = NULL;
+	timer = HiResTimerCreate();
+	for (;;) {
+		EnterCriticalSection(&wnd->roi.lock);
+		if ( (roi = roi_find(wnd, name)) == NULL) {
+			rc = 2;
+		} else if (roi->status.last_seq < 0 || (seq >= 0 && seq > roi->status.last_seq)) {
+			rc = 3;
+			event = roi->event;
+		} else {
+			want = (seq < 0) ? roi->status.last_seq : max(seq, roi->status.first_seq) ;
+			slot = want % roi->nslots;
+			if ( (*frame = malloc(sizeof(**frame) + roi->frames[slot].length)) == NULL) {
+				rc = 4;
+			} else {
+				**frame = roi->frames[slot];
+				memcpy(*frame+1, roi->slots + (size_t) slot*roi->status.frame_bytes, roi->frames[slot].length);
+				if (length != NULL) *length = sizeof(**frame) + roi->frames[slot].length;
+				rc = 0;
+			}
+		}
+		LeaveCriticalSection(&wnd->roi.lock);
+
+		if (rc != 3 || (remain = msTimeout - 1000.0*HiResTimerDelta(timer)) <= 0) break;
+		WaitForSingleObject(event, (DWORD) min(remain, ROI_WAIT_SLICE_MS) + 1);
+	}
+	HiResTimerDestroy(timer);
+	return rc;
+}
+
+/* ===========================================================================
+-- Save one frame of a stream
+--
+-- Usage: int ROI_Stream_Save(char *name, int seq, char *path);
+--
+-- Inputs: name - stream
+--         seq  - frame (<0 ==> newest held)
+--         path - file to write
+--
+-- Output: 8-bit and 16-bit mono / Bayer ==> binary PGM (16-bit big endian,
+--         maxval from the bit depth); RGB24 / BGR24 ==> binary PPM.  The
+--         source imageID and camera time are written as a PNM comment.
+--
+-- Return: see ZooCam.h
+=========================================================================== */
+int ROI_Stream_Save(char *name, int seq, char *path) {
+	static char *rname = "ROI_Stream_Save";
+
+	ROI_FRAME_INFO *frame;
+	FILE *funit;
+	unsigned char *data, *row, *swap;
+	int rc, irow, icol, nbytes;
+
+	if (path == NULL || *path == '\0') return 2;
+	if ( (rc = ROI_Stream_GetFrame(name, seq, 0, &frame, NULL)) != 0) return rc;
+
+	if (fopen_s(&funit, path, "wb") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		free(frame);
+		return 6;
+	}
+
+	data   = (unsigned char *) (frame+1);
+	nbytes = frame->width * IP_BytesPerPixel(frame->format);
+	if ( (swap = malloc(nbytes)) == NULL) {
+		rc = 4;
+	} else {
+		fprintf(funit, "%s\n# %s seq %d imageID %d camera_time %.6f\n%d %d\n%d\n",
+				  (frame->format == PIXEL_RGB24 || frame->format == PIXEL_BGR24) ? "P6" : "P5",
+				  name, frame->seq, frame->imageID, frame->camera_time, frame->width, frame->height,
+				  (IP_BytesPerPixel(frame->format) == 2) ? (1 << frame->bit_depth) - 1 : 255);
+		for (irow=0; irow<frame->height; irow++) {
+			row = data + (size_t) irow*frame->pitch;
+			switch (frame->format) {
+				case PIXEL_MONO16:
+				case PIXEL_BAYER16:
+					for (icol=0; icol<nbytes; icol+=2) { swap[icol] = row[icol+1]; swap[icol+1] = row[icol]; }
+					break;
+				case PIXEL_BGR24:
+					for (icol=0; icol<nbytes; icol+=3) { swap[icol] = row[icol+2]; swap[icol+1] = row[icol+1]; swap[icol+2] = row[icol]; }
+					break;
+				default:
+					memcpy(swap, row, nbytes);
+					break;
+			}
+			fwrite(swap, 1, nbytes, funit);
+		}
+		free(swap);
+		rc = ferror(funit) ? 6 : 0 ;
+	}
+	fclose(funit);
+	free(frame);
+	return rc;
+}
+
+/* ===========================================================================
+-- Concurrent capture on several TL cameras (see ZooCam.h for the interface)
+--
+-- Usage: int Multi_Camera_Start(int id, int nBuf);
+--        int Multi_Camera_Stop(int id);
+--
+-- Inputs: id   - index in the TL camera list (Stop: -1 ==> all)
+--         nBuf - ring size if the camera has to be opened
+--
+-- Output: Start opens the camera if needed (freerun) and runs a capture
+--         thread that records arrivals.  Stop ends the thread and closes
+--         the camera again if it was opened here and is not the GUI camera.
+--
+-- Return: see ZooCam.h
+--
+-- Notes: Table slots are never moved ... a thread owns its slot until it
+--        clears active, and the slot is reused only after that.
+=========================================================================== */
+#define	MULTI_DFLT_RING		(10)					/* Ring for cameras opened here */
+#define	MULTI_STOP_WAIT_MS	(3000)				/* Longest to wait for the threads */
+
+int Multi_Camera_Start(int id, int nBuf) {
+	static char *rname = "Multi_Camera_Start";
+
+	WND_INFO *wnd;
+	TL_CAMERA *tl;
+	struct _MULTI_CAPTURE *cap;
+	int i, rc;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if ( (tl = TL_FindCameraByIndex(id)) == NULL) return 2;
+	if (nBuf <= 0) nBuf = MULTI_DFLT_RING;
+
+	/* Reserve a slot (or find the camera already there) */
+	multi_init(wnd);
+	EnterCriticalSection(&wnd->multi.lock);
+	if ( (cap = multi_find(wnd, tl)) != NULL) {
+		if (cap->active) { LeaveCriticalSection(&wnd->multi.lock); return 0; }
+	} else {
+		for (i=0; i<MULTI_MAX_CAMERAS; i++) {
+			if (wnd->multi.cam[i].tl == NULL && ! wnd->multi.cam[i].active) { cap = wnd->multi.cam+i; break; }
+		}
+		if (cap != NULL) {
+			cap->tl = tl;
+			cap->bOpened = FALSE;
+			wnd->multi.ncams++;
+		}
+	}
+	if (cap != NULL) {
+		cap->stop    = FALSE;
+		cap->last_id = -1;
+		cap->nhist = cap->head = 0;
+		cap->handled = cap->lost = 0;
+		cap->stats_imageID = -1;
+		cap->active  = TRUE;								/* Holds the slot while opening */
+	}
+	LeaveCriticalSection(&wnd->multi.lock);
+	if (cap == NULL) { fprintf(stderr, "[%s] All %d capture slots in use\n", rname, MULTI_MAX_CAMERAS); fflush(stderr); return 3; }
+
+	/* Open outside the lock ... takes a while */
+	rc = 0;
+	if (tl->handle == NULL) {
+		if (TL_OpenCamera(tl, nBuf) != 0) {
+			fprintf(stderr, "[%s] Unable to open camera %d (%s)\n", rname, id, tl->serial); fflush(stderr);
+			rc = 5;
+		} else {
+			cap->bOpened = TRUE;
+			tl->trigger.mode = -1;						/* Set to invalid so will definitely change */
+			TL_SetTriggerMode(tl, TRIG_FREERUN, NULL);
+		}
+	}
+	if (rc == 0 && _beginthread(multi_capture_thread, 0, (void *) cap) == -1L) rc = 5;
+
+	if (rc != 0) {
+		EnterCriticalSection(&wnd->multi.lock);
+		if (cap->bOpened && ! multi_is_main(wnd, tl)) TL_CloseCamera(tl);
+		cap->tl = NULL;
+		cap->active = FALSE;
+		wnd->multi.ncams--;
+		LeaveCriticalSection(&wnd->multi.lock);
+	}
+	return rc;
+}
+
+int Multi_Camera_Stop(int id) {
+
+	WND_INFO *wnd;
+	TL_CAMERA *tl;
+	struct _MULTI_CAPTURE *cap;
+	BOOL stopping[MULTI_MAX_CAMERAS], busy;
+	int i, n, ms;
+
+	if ( (wnd = main_wnd) == NULL) return 1;
+	if (! wnd->multi.lock_init) return (id < 0) ? 0 : 2 ;
+
+	/* Flag the threads */
+	EnterCriticalSection(&wnd->multi.lock);
+	for (n=0,i=0; i<MULTI_MAX_CAMERAS; i++) {
+		cap = wnd->multi.cam+i;
+		stopping[i] = cap->tl != NULL && (id < 0 || multi_camera_id(cap->tl) == id);
+		if (stopping[i]) { cap->stop = TRUE; n++; }
+	}
+	LeaveCriticalSection(&wnd->multi.lock);
+	if (n == 0) return (id < 0) ? 0 : 2 ;
+
+	/* Threads notice within one wait (1 s) */
+	for (ms=0; ms<MULTI_STOP_WAIT_MS; ms+=20) {
+		for (busy=FALSE,i=0; i<MULTI_MAX_CAMERAS; i++) if (stopping[i] && wnd->multi.cam[i].active) busy = TRUE;
+		if (! busy) break;
+		Sleep(20);
+	}
+
+	/* Release the slots (a thread that did not finish keeps its slot) */
+	EnterCriticalSection(&wnd->multi.lock);
+	for (i=0; i<MULTI_MAX_CAMERAS; i++) {
+		cap = wnd->multi.cam+i;
+		if (! stopping[i] || cap->active) continue;
+		tl = (TL_CAMERA *) cap->tl;
+		if (cap->bOpened && ! multi_is_main(wnd, tl)) TL_CloseCamera(tl);
+		cap->tl = NULL;
+		wnd->multi.ncams--;
+	}
+	LeaveCriticalSection(&wnd->multi.lock);
+	return 0;
+}
+
+/* ===========================================================================
+-- Helpers for the capture table (call with wnd->multi.lock held, except init)
+--
+-- Usage: static void multi_init(WND_INFO *wnd);
+--        static struct _MULTI_CAPTURE *multi_find(WND_INFO *wnd, void *tl);
+--        static int multi_camera_id(void *tl);
+--        static BOOL multi_is_main(WND_INFO *wnd, void *tl);
+--        static double multi_fps(struct _MULTI_CAPTURE *cap);
+--
+-- Return: multi_find: slot or NULL; multi_camera_id: index in the TL list
+--         or -1; multi_fps: arrivals per second over the history (0 if <2)
+=========================================================================== */
+static void multi_init(WND_INFO *wnd) {
+	if (! wnd->multi.lock_init) {
+		InitializeCriticalSection(&wnd->multi.lock);
+		wnd->multi.lock_init = TRUE;
+	}
+	return;
+}
+
+static struct _MULTI_CAPTURE *multi_find(WND_INFO *wnd, void *tl) {
+	int i;
+
+	if (tl == NULL) return NULL;
+	for (i=0; i<MULTI_MAX_CAMERAS; i++) if (wnd->multi.cam[i].tl == tl) return wnd->multi.cam+i;
+	return NULL;
+}
+
+static int multi_camera_id(void *tl) {
+	int i;
+
+	for (i=0; i<TL_MAX_CAMERAS; i++) if (tl != NULL && TL_FindCameraByIndex(i) == tl) return i;
+	return -1;
+}
+
+static BOOL multi_is_main(WND_INFO *wnd, void *tl) {
+	return wnd->Camera.driver == TL && wnd->Camera.details == tl;
+}
+
+static double multi_fps(struct _MULTI_CAPTURE *cap) {
+	int first, last;
+
+	if (cap == NULL || cap->nhist < 2) return 0.0;
+	last  = (cap->head - 1 + MULTI_HISTORY) % MULTI_HISTORY;
+	first = (cap->head - cap->nhist + MULTI_HISTORY) % MULTI_HISTORY;
+	return (cap->host[last] > cap->host[first]) ? (cap->nhist-1) / (cap->host[last]-cap->host[first]) : 0.0 ;
+}
+
+/* ===========================================================================
+-- Processing thread for one camera ... records every new ring frame
+--
+-- Usage: _beginthread(multi_capture_thread, 0, cap);
+--
+-- Inputs: cap - slot in wnd->multi (active already set by the caller)
+--
+-- Output: Appends (imageID, host time, camera time) of each new frame, in
+--         imageID order, to the slot history and counts it as handled.
+--         Frames beyond RING_WALK_MAX in one signal are counted as lost.
+--         The newest frame is copied out and its statistics refreshed at
+--         most MULTI_STATS_HZ times a second.  Pixels otherwise stay in
+--         the camera ring (Multi_Camera_GetImage copies them on request).
+--
+-- Notes: Exits when stopped, the camera is closed, or on shutdown
+=========================================================================== */
+static void multi_capture_thread(void *arglist) {
+	static char *rname = "multi_capture_thread";
+
+	struct _MULTI_CAPTURE *cap;
+	TL_CAMERA *tl;
+	TL_IMAGE *image;
+	WND_INFO *wnd;
+	HANDLE signal;
+	HIRES_TIMER *timer;
+	IMAGE_BUFFER src;
+	IP_STATS ip;
+	unsigned short *work;
+	int i, k, n, ibuf, extra, nwork, stats_id;
+	int ids[RING_WALK_MAX];								/* More than this per signal are counted lost */
+	double host[RING_WALK_MAX], camera[RING_WALK_MAX];
+	LONGLONG t_start;
+
+	cap = (struct _MULTI_CAPTURE *) arglist;
+	tl  = (TL_CAMERA *) cap->tl;
+	fprintf(stderr, "[%s] Capturing camera %s\n", rname, tl->serial); fflush(stderr);
+	Perf_TraceThreadName(rname);
+
+	signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+	TL_AddImageSignal(tl, signal);
+	timer = HiResTimerCreate();
+	work = NULL; nwork = 0;
+
+	while ( (wnd = main_wnd) != NULL && ! cap->stop && ! abort_all_threads && TL_IsValidCamera(tl) && tl->handle != NULL) {
+		if (WaitForSingleObject(signal, 1000) != WAIT_OBJECT_0) continue;
+		if (cap->stop) break;
+
+		/* Walk back from the newest frame to the last one recorded (copy the newest if statistics are due) */
+		n = extra = 0;
+		stats_id = -1;
+		if (WAIT_OBJECT_0 == WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) {
+			for (i=0; i<tl->nValid; i++) {
+				ibuf = (tl->iLast - i + tl->nBuffers) % tl->nBuffers;
+				image = tl->images+ibuf;
+				if (! image->valid || image->imageID <= cap->last_id) break;
+				if (n >= RING_WALK_MAX) { extra++; continue; }
+				ids[n] = image->imageID; host[n] = image->host_time; camera[n] = image->camera_time; n++;
+			}
+			if (n > 0 && HiResTimerDelta(timer) >= 1.0/MULTI_STATS_HZ && TL_GetImageBuffer(tl, tl->iLast, &src) == 0) {
+				if (work == NULL || nwork < tl->nbytes_raw) {
+					if (work != NULL) free(work);
+					work  = malloc(tl->nbytes_raw);
+					nwork = (work != NULL) ? tl->nbytes_raw : 0 ;
+				}
+				if (work != NULL) {
+					memcpy(work, src.data, tl->nbytes_raw);
+					src.data = work;
+					stats_id = ids[0];
+				}
+			}
+			ReleaseMutex(tl->image_mutex);
+		}
+		if (n == 0) continue;
+		if (extra > 0) Perf_Count(PERF_FRAMES_OVERWRITTEN, extra);
+
+		/* Statistics outside the ring lock */
+		if (stats_id >= 0) {
+			HiResTimerReset(timer, 0.0);
+			t_start = Perf_Start();
+			if (IP_ComputeStats(&src, 0, 0, &ip, NULL, NULL, NULL) != 0) stats_id = -1;
+			Perf_Stop(PERF_STATISTICS, t_start);
+		}
+
+		/* Oldest first into the history */
+		EnterCriticalSection(&wnd->multi.lock);
+		for (i=n-1; i>=0; i--) {
+			k = cap->head;
+			cap->ids[k] = ids[i]; cap->host[k] = host[i]; cap->camera[k] = camera[i];
+			cap->head = (k+1) % MULTI_HISTORY;
+			if (cap->nhist < MULTI_HISTORY) cap->nhist++;
+		}
+		cap->last_id = ids[0];
+		cap->handled += n;
+		cap->lost    += extra;
+		if (stats_id >= 0) {
+			cap->stats_imageID = stats_id;
+			for (cap->mean=0,cap->vmax=0,cap->saturated=0,i=0; i<ip.nchannels; i++) {
+				cap->mean += ip.mean[i] / ip.nchannels;
+				cap->vmax  = max(cap->vmax, ip.vmax[i]);
+				cap->saturated += ip.saturated[i];
+			}
+			cap->brenner = ip.brenner;
+		}
+		LeaveCriticalSection(&wnd->multi.lock);
+	}
+
+	TL_RemoveImageSignal(tl, signal);
+	CloseHandle(signal);
+	HiResTimerDestroy(timer);
+	if (work != NULL) free(work);
+	cap->active = FALSE;
+
+	fprintf(stderr, "[%s] Exited (%s)\n", rname, tl->serial); fflush(stderr);
+	return;
+}
+
+/* ===========================================================================
+-- Status of every TL camera known
+--
+-- Usage: int Multi_Camera_List(MULTI_CAMERA_INFO *info, int maxn);
+--
+-- Return: number of TL cameras (info filled for up to maxn of them)
+=========================================================================== */
+int Multi_Camera_List(MULTI_CAMERA_INFO *info, int maxn) {
+
+	WND_INFO *wnd;
+	TL_CAMERA *tl;
+	struct _MULTI_CAPTURE *cap;
+	MULTI_CAMERA_INFO *p;
+	int i, n;
+
+	if ( (wnd = main_wnd) == NULL) return 0;
+	multi_init(wnd);
+
+	EnterCriticalSection(&wnd->multi.lock);
+	for (n=0,i=0; i<TL_MAX_CAMERAS; i++) {
+		if ( (tl = TL_FindCameraByIndex(i)) == NULL) continue;
+		if (info != NULL && n < maxn) {
+			p = info+n;
+			memset(p, 0, sizeof(*p));
+			cap = multi_find(wnd, tl);
+			p->id = i;
+			strcpy_m(p->model,  sizeof(p->model),  tl->model);
+			strcpy_m(p->serial, sizeof(p->serial), tl->serial);
+			p->bMain      = multi_is_main(wnd, tl);
+			p->bOpen      = tl->handle != NULL;
+			p->bCapturing = cap != NULL && cap->active;
+			p->width      = tl->width;
+			p->height     = tl->height;
+			p->bit_depth  = tl->bit_depth;
+			p->bColor     = tl->IsSensorColor;
+			p->last_imageID = -1;
+			if (p->bOpen) {
+				p->nBuffers = tl->nBuffers;
+				p->nValid   = tl->nValid;
+				if (tl->nValid > 0) p->last_imageID = tl->images[tl->iLast].imageID;
+				p->received = tl->frames_received;
+				p->stored   = tl->frames_stored;
+				p->skipped  = tl->frames_skipped;
+				p->missed   = tl->frames_missed;
+				p->host_time = tl->host_time;
+			}
+			p->fps = multi_fps(cap);
+			p->stats_imageID = -1;
+			if (cap != NULL) {
+				p->handled       = cap->handled;
+				p->lost          = cap->lost;
+				p->stats_imageID = cap->stats_imageID;
+				p->mean          = cap->mean;
+				p->vmax          = cap->vmax;
+				p->saturated     = cap->saturated;
+				p->brenner       = cap->brenner;
+			}
+		}
+		n++;
+	}
+	LeaveCriticalSection(&wnd->multi.lock);
+	return n;
+}
+
+/* ===========================================================================
+-- Copy one frame out of a camera ring
+--
+-- Usage: int Multi_Camera_GetImage(int id, int frame, MULTI_FRAME_INFO **pframe, size_t *length);
+--
+-- Inputs: id     - camera
+--         frame  - ring index (-1 ==> newest)
+--         pframe - receives malloc'd MULTI_FRAME_INFO + raw pixels
+--         length - if !NULL, receives the bytes in *pframe
+--
+-- Return: 0 if successful, 1 no window, 2 no such camera / frame (or not
+--         open), 4 no memory, 6 ring busy
+=========================================================================== */
+int Multi_Camera_GetImage(int id, int frame, MULTI_FRAME_INFO **pframe, size_t *length) {
+
+	TL_CAMERA *tl;
+	TL_IMAGE *image;
+	IMAGE_INFO info;
+	int rc;
+
+	if (pframe != NULL) *pframe = NULL;
+	if (length != NULL) *length = 0;
+	if (main_wnd == NULL) return 1;
+	if (pframe == NULL || (tl = TL_FindCameraByIndex(id)) == NULL || tl->handle == NULL || tl->nValid <= 0) return 2;
+
+	if (WAIT_OBJECT_0 != WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) return 6;
+	if (frame < 0) frame = tl->iLast;
+	if (frame >= tl->nValid || TL_GetImageInfo(tl, frame, &info) != 0) {
+		rc = 2;
+	} else if ( (*pframe = malloc(sizeof(**pframe) + tl->nbytes_raw)) == NULL) {
+		rc = 4;
+	} else {
+		image = tl->images+frame;
+		(*pframe)->id        = id;
+		(*pframe)->info      = info;
+		(*pframe)->host_time = image->host_time;
+		(*pframe)->length    = tl->nbytes_raw;
+		memcpy(*pframe+1, image->raw, tl->nbytes_raw);
+		if (length != NULL) *length = sizeof(**pframe) + tl->nbytes_raw;
+		rc = 0;
+	}
+	ReleaseMutex(tl->image_mutex);
+	return rc;
+}
+
+/* ===========================================================================
+-- Cross-camera timestamp alignment
+--
+-- Usage: int Multi_Camera_Align(int ref, MULTI_ALIGN_INFO *info, int maxn);
+--
+-- Inputs: ref  - reference camera (-1 ==> main camera if capturing, else
+--                the first capturing camera)
+--         info - receives up to maxn entries, one per capturing camera
+--                (the reference is included with zero offsets)
+--
+-- Output: For each reference arrival inside the span of the other camera's
+--         history, the nearest arrival of that camera is paired and the
+--         difference accumulated.  The camera clock is fitted against the
+--         host clock by least squares (clock_ppm = (slope-1)*1E6).
+--
+-- Return: number of capturing cameras with history (0 if no reference)
+=========================================================================== */
+int Multi_Camera_Align(int ref, MULTI_ALIGN_INFO *info, int maxn) {
+
+	WND_INFO *wnd;
+	struct _MULTI_CAPTURE *rcap, *cap;
+	int i, n;
+
+	if ( (wnd = main_wnd) == NULL || ! wnd->multi.lock_init) return 0;
+
+	EnterCriticalSection(&wnd->multi.lock);
+
+	/* Choose the reference */
+	rcap = NULL;
+	if (ref >= 0) {
+		rcap = multi_find(wnd, TL_FindCameraByIndex(ref));
+	} else if (wnd->Camera.driver == TL) {
+		rcap = multi_find(wnd, wnd->Camera.details);
+	}
+	for (i=0; rcap == NULL && ref < 0 && i<MULTI_MAX_CAMERAS; i++) {
+		if (wnd->multi.cam[i].tl != NULL && wnd->multi.cam[i].nhist > 0) rcap = wnd->multi.cam+i;
+	}
+
+	n = 0;
+	if (rcap != NULL && rcap->nhist > 0) {
+		for (i=0; i<MULTI_MAX_CAMERAS; i++) {
+			cap = wnd->multi.cam+i;
+			if (cap->tl == NULL || cap->nhist <= 0) continue;
+			if (info != NULL && n < maxn) multi_align(rcap, cap, info+n);
+			n++;
+		}
+	}
+	LeaveCriticalSection(&wnd->multi.lock);
+	return n;
+}
+
+static void multi_align(struct _MULTI_CAPTURE *rcap, struct _MULTI_CAPTURE *cap, MULTI_ALIGN_INFO *info) {
+
+	int i, j, k, kr, np, n, nr;
+	double t, dt, sum, sumsq, dmax;
+	double mh, mc, shh, shc;
+
+	memset(info, 0, sizeof(*info));
+	info->id  = multi_camera_id(cap->tl);
+	info->ref = multi_camera_id(rcap->tl);
+	info->fps = multi_fps(cap);
+
+	/* Oldest entries of each history (arrivals increase with the index) */
+	n  = cap->nhist;  k  = (cap->head  - n  + MULTI_HISTORY) % MULTI_HISTORY;
+	nr = rcap->nhist; kr = (rcap->head - nr + MULTI_HISTORY) % MULTI_HISTORY;
+
+	/* Pair every reference arrival inside this camera's span with its nearest arrival */
+	np = 0; sum = sumsq = dmax = 0.0;
+	for (j=0,i=0; i<nr; i++) {
+		t = rcap->host[(kr+i) % MULTI_HISTORY];
+		if (t < cap->host[k] || t > cap->host[(k+n-1) % MULTI_HISTORY]) continue;
+		while (j+1 < n && fabs(cap->host[(k+j+1) % MULTI_HISTORY]-t) <= fabs(cap->host[(k+j) % MULTI_HISTORY]-t)) j++;
+		dt = cap->host[(k+j) % MULTI_HISTORY] - t;
+		sum += dt; sumsq += dt*dt;
+		if (fabs(dt) > dmax) dmax = fabs(dt);
+		np++;
+	}
+	info->nframes = np;
+	if (np > 0) {
+		info->offset_ms = 1000.0*sum/np;
+		info->rms_ms    = 1000.0*sqrt(sumsq/np);
+		info->max_ms    = 1000.0*dmax;
+	}
+
+	/* Camera clock against host clock (centered sums keep the precision) */
+	mh = mc = 0.0;
+	for (i=0; i<n; i++) { mh += cap->host[(k+i) % MULTI_HISTORY]; mc += cap->camera[(k+i) % MULTI_HISTORY]; }
+	if (n > 1) {
+		mh /= n; mc /= n;
+		shh = shc = 0.0;
+		for (i=0; i<n; i++) {
+			t = cap->host[(k+i) % MULTI_HISTORY] - mh;
+			shh += t*t;
+			shc += t*(cap->camera[(k+i) % MULTI_HISTORY] - mc);
+		}
+		if (shh > 0 && mc != 0.0) {
+			info->clock_ppm    = (shc/shh - 1.0) * 1.0E6;
+			info->clock_offset = mc - (shc/shh)*mh;
+		}
+	}
+	return;
+}
+
+/* ===========================================================================
+-- Query the preferred image storage format from radio button
+--
+-- Usage: FILE_FORMAT GetDfltImageFormat(HWND hdlg);
+--
+-- Inputs: hdlg - pointer to the dialog box with controls
+--
+-- Output: none
+--
+-- Return: Image format to use as default.  FILE_BMP returned as default.
+=========================================================================== */
+static FILE_FORMAT GetDfltImageFormat(HWND hdlg) {
+	int rc;
+
+	switch (GetRadioButton(hdlg, IDR_IMAGE_BMP, IDR_IMAGE_PNG)) {
+		case IDR_IMAGE_RAW:
+			rc = FILE_RAW; break;
+		case IDR_IMAGE_JPG:
+			rc = FILE_JPG; break;
+		case IDR_IMAGE_PNG:
+			rc = FILE_PNG; break;
+		case IDR_IMAGE_BMP:
+		default:
+			rc = FILE_BMP; break;
+	}
+	return rc;
+}
+
+
+/* ===========================================================================
+-- Draw crosshair (full or small cross) on a bitmap window
+--
+-- Usage: int GenerateCrosshair(WND_INFO *wnd, HWND hwnd);
+--
+-- Inputs: wnd - general information about camera application
+--               uses only wnd->cursor_posn
+--         hwnd - handle to window to draw in
+--
+-- Output: adds crosshair to image
+--
+-- Return: 0 if successful, 1 if hwnd is not a window
+=========================================================================== */
+int GenerateCrosshair(WND_INFO *wnd, HWND hwnd) {
+	RECT rect;
+	int ix,iy, width, height;
+	HDC hdc;
+
+	/* Create brushes for the cross-hair */
+	static HBRUSH background, foreground;
+	static HPEN hpen;
+	static BOOL first = TRUE;
+
+	/* Create brushes and keep them persistent throughout run */
+	if (first) {
+		background = CreateSolidBrush(RGB(0,0,0));
+		foreground = CreateSolidBrush(RGB(255,255,255));
+		hpen = CreatePen(PS_SOLID, 1, RGB(255,255,255));
+		first = FALSE;
+	}
+
+	/* If the specified hwnd is not a valid window, we can safely exit */
+	if (! IsWindow(hwnd)) return 1;
+
+	/* Process the request */
+	GetClientRect(hwnd, &rect);
+	width = rect.right; height = rect.bottom;
+	ix = (int) (wnd->cursor_posn.x*width  + 0.5);
+	iy = (int) (wnd->cursor_posn.y*height + 0.5);
+
+	/* Get DC */
+	hdc = GetDC(hwnd);
+
+	if (! wnd->cursor_posn.fullwidth) {
+		int isize;
+		isize = min(20,width/10);
+		SetRect(&rect, max(ix-isize,0),max(iy-1,0), min(ix+isize,width),min(iy+2,height));
+		FillRect(hdc, &rect, background);
+		SetRect(&rect, max(0,ix-1),max(0,iy-isize), min(ix+2,width),min(iy+isize,height));
+		FillRect(hdc, &rect, background);
+
+		SelectObject(hdc, hpen);
+		MoveToEx(hdc, max(ix-isize,0), iy, NULL); LineTo(hdc, min(ix+isize,width), iy);
+		MoveToEx(hdc, ix, max(iy-isize,0), NULL); LineTo(hdc, ix, min(iy+isize,height));
+	} else {
+		SetRect(&rect, 0,max(iy-1,0), width,min(iy+2,height));
+		FillRect(hdc, &rect, background);
+		SetRect(&rect, max(0,ix-1),0, min(ix+2,width),height);
+		FillRect(hdc, &rect, background);
+
+		SelectObject(hdc, hpen);
+		MoveToEx(hdc, 0, iy, NULL); LineTo(hdc, width, iy);
+		MoveToEx(hdc, ix, 0, NULL); LineTo(hdc, ix, height);
+	}		
+
+	/* Release DC */
+	ReleaseDC(hwnd, hdc);
+
+	/* Return successful */
+	return 0;
+}
+
+
+
+/* ===========================================================================
+================ SUPPORT ROUTINES ... usage is obvious =======================
+=========================================================================== */
+
+/* ===========================================================================
+-- Display a specified image (PID) on windows with statistics
+--
+-- Usage: void Camera_ShowImage(WND_INFO *wnd, int index);
+--
+-- Inputs: wnd   - structure with all the info
+--         index - index of frame to display
+--         pSharp - pointer to variable to get sharpness estimate (if ! NULL)
+--
+-- Output: *pSharp - estimate of the sharpness (in some units)
+--
+-- Return: 0 - all info displayed
+--         1 - only images were shown ... main HDLG not a window
+--         2 - PauseImageRendering TRUE ... thread currently in a critical section 
+=========================================================================== */
+static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp);
+static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp);
+static int SIM_ShowImage(WND_INFO *wnd, int index, int *pSharp);
 
 static int Camera_ShowImage(WND_INFO *wnd, int frame, int *pSharp) {
 	static char *rname = "Camera_ShowImage";
@@ -4484,6 +8550,9 @@ static int Camera_ShowImage(WND_INFO *wnd, int frame, int *pSharp) {
 		case TL:
 			rc = TL_ShowImage(wnd, frame, pSharp);			/* Includes crosshair */
 			break;
+		case SIM:
+			rc = SIM_ShowImage(wnd, frame, pSharp);		/* Includes crosshair */
+			break;
 		default:
 			rc = -1;
 			break;
@@ -4498,6 +8567,7 @@ static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 	TL_CAMERA *tl;
 	char szBuf[256];
 	TL_IMAGE *image;
+	LONGLONG t_start;
 
 	/* Default return values */
 	if (pSharp != NULL) *pSharp = 0;
@@ -4516,13 +8586,21 @@ static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 
 	/* Render the bitmap and report statistics */
 	if (IsWindow(float_image_hwnd)) {
+		t_start = Perf_Start();
 		TL_RenderFrame(tl, index, float_image_hwnd);
+		Perf_Stop(PERF_RENDER, t_start);
 		GenerateCrosshair(wnd, float_image_hwnd);
 	}
 	if (IsWindow(wnd->thumbnail)) {
+		t_start = Perf_Start();
 		TL_RenderFrame(tl, index, wnd->thumbnail);
+		Perf_Stop(PERF_RENDER, t_start);
 		GenerateCrosshair(wnd, wnd->thumbnail);
-		if (! CalcStatistics_Active) CalcStatistics(wnd, index, tl->rgb24, pSharp);
+		if (! CalcStatistics_Active) {
+			t_start = Perf_Start();
+			CalcStatistics(wnd, index, tl->rgb24, pSharp);
+			Perf_Stop(PERF_STATISTICS, t_start);
+		}
 
 		image = &tl->images[index];							/* Currently shown image (after render) */
 		sprintf_s(szBuf, sizeof(szBuf), "[%6d] %2.2d:%2.2d:%2.2d.%3.3d", image->imageID,
@@ -4540,6 +8618,58 @@ static int TL_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 }
 
 
+static int SIM_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
+	static char *rname = "SIM_ShowImage";
+
+	SIM_CAMERA *sim;
+	char szBuf[256];
+	SIM_IMAGE *image;
+	LONGLONG t_start;
+
+	/* Default return values */
+	if (pSharp != NULL) *pSharp = 0;
+
+	/* Validate the parameters */
+	if (wnd == NULL || wnd->Camera.driver != SIM) return 1;
+	if (wnd->PauseImageRendering) return 2;
+
+	sim = (SIM_CAMERA *) wnd->Camera.details;
+	if (index < 0) index = sim->iLast;
+
+	/* Render the bitmap and report statistics */
+	if (IsWindow(float_image_hwnd)) {
+		t_start = Perf_Start();
+		SIM_RenderFrame(sim, index, float_image_hwnd);
+		Perf_Stop(PERF_RENDER, t_start);
+		GenerateCrosshair(wnd, float_image_hwnd);
+	}
+	if (IsWindow(wnd->thumbnail)) {
+		t_start = Perf_Start();
+		SIM_RenderFrame(sim, index, wnd->thumbnail);
+		Perf_Stop(PERF_RENDER, t_start);
+		GenerateCrosshair(wnd, wnd->thumbnail);
+		if (! CalcStatistics_Active) {
+			t_start = Perf_Start();
+			CalcStatistics(wnd, index, sim->rgb24, pSharp);
+			Perf_Stop(PERF_STATISTICS, t_start);
+		}
+
+		image = &sim->images[index];
+		sprintf_s(szBuf, sizeof(szBuf), "[%6d] %2.2d:%2.2d:%2.2d.%3.3d", image->imageID,
+					 image->system_time.wHour, image->system_time.wMinute, image->system_time.wSecond, image->system_time.wMilliseconds);
+		SetDlgItemText(wnd->hdlg, IDT_IMAGE_INFO, szBuf);
+		sprintf_s(szBuf, sizeof(szBuf), "(%.3d,%.3d,%.3d)", wnd->cursor_pixel.r, wnd->cursor_pixel.g, wnd->cursor_pixel.b);
+		SetDlgItemText(wnd->hdlg, IDT_PIXEL_INFO, szBuf);
+	}
+	sim->iShow = index;
+
+	/* Identify the particular ring entry on the main dialog window */
+	SetDlgItemInt(wnd->hdlg, IDV_CURRENT_FRAME, sim->iShow, FALSE);
+
+	return 0;
+}
+
+
 static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 	static char *rname = "DCx_ShowImage";
 
@@ -4548,6 +8678,7 @@ static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 	char szBuf[256];
 	DCX_CAMERA *dcx;
 	UC480IMAGEINFO ImageInfo;
+	LONGLONG t_start;
 
 	/* First ... see if we need to avoid any access to the buffers */
 	if (wnd->PauseImageRendering) return 2;
@@ -4579,13 +8710,21 @@ static int DCx_ShowImage(WND_INFO *wnd, int index, int *pSharp) {
 	/* Render the bitmap and report statistics */
 	/* For DCX cameras, onlyi works if in IS_CM_BGR8_PACKED mode ... also could use is_GetImageHistogram */
 	if (IsWindow(float_image_hwnd)) {
+		t_start = Perf_Start();
 		is_RenderBitmap(dcx->hCam, PID, float_image_hwnd, IS_RENDER_FIT_TO_WINDOW);
+		Perf_Stop(PERF_RENDER, t_start);
 		GenerateCrosshair(wnd, float_image_hwnd);
 	}
 	if (IsWindow(wnd->thumbnail))   {
+		t_start = Perf_Start();
 		is_RenderBitmap(dcx->hCam, PID, wnd->thumbnail, IS_RENDER_FIT_TO_WINDOW);
+		Perf_Stop(PERF_RENDER, t_start);
 		GenerateCrosshair(wnd, wnd->thumbnail);
-		if (! CalcStatistics_Active) CalcStatistics(wnd, 0, pMem, pSharp);
+		if (! CalcStatistics_Active) {
+			t_start = Perf_Start();
+			CalcStatistics(wnd, 0, pMem, pSharp);
+			Perf_Stop(PERF_STATISTICS, t_start);
+		}
 
 		is_GetImageInfo(dcx->hCam, PID, &ImageInfo, sizeof(ImageInfo));
 		sprintf_s(szBuf, sizeof(szBuf), "[%6lld] %2.2d:%2.2d:%2.2d.%3.3d", ImageInfo.u64FrameNumber,
@@ -4622,9 +8761,11 @@ static void DCx_ImageThread(void *arglist) {
 	DCX_CAMERA *dcx;
 	int PID;
 	HIRES_TIMER *timer;
+	LONGLONG t_start;
 
 	/* Just wait for events that mean I should render the images */
 	printf("DCx_ImageThread thread started\n"); fflush(stdout);
+	Perf_TraceThreadName(rname);
 
 	/* Create a timer so can limit how often */
 	timer = HiResTimerCreate();						/* Create the timer and then reset	*/
@@ -4641,16 +8782,25 @@ static void DCx_ImageThread(void *arglist) {
 		dcx = wnd->Camera.details;						/* Pointer to valid DCX_CAMERA structure	*/
 		if (dcx->hCam <= 0) continue;					/* Holy shit ... how would this be			*/
 		wnd->Image_Count++;								/* Increment number of images (we think)	*/
+		Perf_Count(PERF_FRAMES_RECEIVED, 1);
+		Perf_TraceBegin("DCx frame event", wnd->Image_Count);
+		t_start = Perf_Start();
 
 		/* Determine the PID and index of last stored image */
 		rc = is_GetImageMem(dcx->hCam, &pMem);
-		if ( (PID = FindImagePIDFrompMem(wnd->dcx, pMem, &CurrentImageIndex)) == -1) continue;
+		if ( (PID = FindImagePIDFrompMem(wnd->dcx, pMem, &CurrentImageIndex)) == -1) { Perf_TraceEnd("DCx frame event", wnd->Image_Count); continue; }
 
 #ifdef USE_RINGS
 		/* Update the main dialog window with the number of images in the ring */
 		dcx->iLast = CurrentImageIndex;					/* Shown image will be same as last one valid */
 		if (CurrentImageIndex >= dcx->nValid) dcx->nValid = CurrentImageIndex+1;
 #endif
+		Perf_Stop(PERF_CALLBACK, t_start);
+		Perf_TraceEnd("DCx frame event", wnd->Image_Count);
+
+		Perf_TraceBegin("Process", wnd->Image_Count);
+		t_start = Perf_Start();
+		if (wnd->roi.nstreams > 0) roi_stream_capture(wnd);		/* Copy the registered windows */
 
 #ifdef USE_NUMATO
 		if (wnd->numato.enabled && wnd->numato.mode == DIO_TOGGLE) {
@@ -4658,6 +8808,8 @@ static void DCx_ImageThread(void *arglist) {
 			if (++wnd->numato.phase >= wnd->numato.on+wnd->numato.off) wnd->numato.phase = 0;
 		}
 #endif
+		Perf_Stop(PERF_PROCESS, t_start);
+		Perf_TraceEnd("Process", wnd->Image_Count);
 
 		/* Skip processing if (i) so requested or (ii) too many per second */
 		if (wnd->PauseImageRendering) continue;
@@ -4667,7 +8819,9 @@ static void DCx_ImageThread(void *arglist) {
 		HiResTimerReset(timer, 0.00);
 
 		/* Show image with crosshairs */
+		Perf_TraceBegin("Render", wnd->Image_Count);
 		Camera_ShowImage(wnd, CurrentImageIndex, &delta_max);						/* Call to ShowImage adds cross-hairs for me */
+		Perf_TraceEnd("Render", wnd->Image_Count);
 		if (! IsWindow(wnd->hdlg)) continue;
 
 #ifdef USE_FOCUS
@@ -4923,7 +9077,8 @@ static void TL_ImageThread(void *arglist) {
 	int delta_max;
 	HIRES_TIMER *timer;
 	WND_INFO *wnd;
-	int rc;
+	int rc, imageID;
+	LONGLONG t_start;
 
 	/* Get the camera to monitor */
 	TL_Process_Image_Thread_Active = TRUE;
@@ -4931,6 +9086,7 @@ static void TL_ImageThread(void *arglist) {
 
 	tl = (TL_CAMERA *) arglist;
 	fprintf(stderr, "[%s] Thread started monitoring camera: %p\n", rname, tl); fflush(stderr);
+	Perf_TraceThreadName(rname);
 
 	/* Create a timer so can limit how often */
 	timer = HiResTimerCreate();						/* Create the timer and then reset	*/
@@ -4949,19 +9105,15 @@ static void TL_ImageThread(void *arglist) {
 
 		if ( (wnd = main_wnd) == NULL) continue;	/* Recover most current wnd */
 		wnd->Image_Count++;								/* Increment number of images (we think) */
+		imageID = tl->image_count-1;					/* Newest frame (trace tag only) */
 
-		/* Has user enable autosave? */
-		if (wnd->autosave.enable) {
-			rc = Camera_GetTriggerMode(wnd, NULL);	/* But only if not LiveVideo */
-			if (rc == TRIG_SOFTWARE || rc == TRIG_EXTERNAL || rc == TRIG_SS) {
-				char fname[PATH_MAX];
-				sprintf_s(fname, sizeof(fname), "%s_%3.3d.raw", wnd->autosave.template, wnd->autosave.next_index);
-				SetDlgItemText(wnd->hdlg, IDT_AUTOSAVE_FNAME, fname);
-				sprintf_s(fname, sizeof(fname), "%s/%s_%3.3d.raw", wnd->autosave.directory, wnd->autosave.template, wnd->autosave.next_index);
-				if (TL_SaveImage(tl, fname, -1, FILE_RAW) != 0) SetDlgItemText(wnd->hdlg, IDT_AUTOSAVE_FNAME, "-- failed --");
-				wnd->autosave.next_index++;
-			}
-		}
+		/* Has user enable autosave? (queued by imageID, written by autosave_writer_thread) */
+		Perf_TraceBegin("Process", imageID);
+		t_start = Perf_Start();
+		if (wnd->autosave.enable) autosave_enqueue(wnd);
+		if (wnd->roi.nstreams > 0) roi_stream_capture(wnd);		/* Copy the registered windows */
+		Perf_Stop(PERF_PROCESS, t_start);
+		Perf_TraceEnd("Process", imageID);
 
 		/* Skip processing if (i) so requested or (ii) too many per second */
 		if (wnd->PauseImageRendering) continue;
@@ -4972,7 +9124,9 @@ static void TL_ImageThread(void *arglist) {
 		HiResTimerReset(timer, 0.00);
 
 		/* Show image with crosshairs */
+		Perf_TraceBegin("Render", imageID);
 		Camera_ShowImage(wnd, -1, &delta_max);				/* Call to ShowImage adds cross-hairs for me */
+		Perf_TraceEnd("Render", imageID);
 		
 		if (IsWindow(wnd->hdlg)) {
 			#ifdef USE_FOCUS
@@ -4992,6 +9146,150 @@ static void TL_ImageThread(void *arglist) {
 	return;
 }
 
+/* ---------------------------------------------------------------------------
+-- Open the synthetic camera (no ROI, binning or hardware-specific controls)
+--
+-- Key will be setting Camera.driver to SIM and Camera.details to the 
+-- SIM_CAMERA * structure
+--------------------------------------------------------------------------- */
+static int SIM_CameraOpen(HWND hdlg, WND_INFO *wnd, SIM_CAMERA *sim) {
+	static char *rname = "SIM_CameraOpen";
+
+	int i;
+
+	static struct {
+		int wID;
+		BOOL enable;
+	} SIM_Control_List[] = {
+		{IDS_GAMMA, FALSE}, {IDV_GAMMA, FALSE}, {IDB_GAMMA_NEUTRAL, FALSE},
+		{IDR_COLOR_DISABLE, FALSE}, {IDR_COLOR_ENABLE, FALSE}, {IDR_COLOR_BG40, FALSE}, {IDR_COLOR_HQ, FALSE}, {IDR_COLOR_AUTO_IR, FALSE},
+		{IDV_COLOR_CORRECT_FACTOR, FALSE},
+		{IDB_LOAD_PARAMETERS, FALSE}, {IDB_SAVE_PARAMETERS, FALSE},
+		{IDV_MASTER_GAIN, TRUE}, {IDS_MASTER_GAIN, TRUE},
+		{IDV_FRAMERATE, TRUE}, {IDS_FRAMERATE, TRUE},
+		{IDB_SAVE, TRUE}, {IDB_SAVE_BURST, TRUE}
+	};
+
+	/* Neither the camera modes nor the ROI apply */
+	ShowDlgItem(hdlg, IDC_CAMERA_MODES, FALSE);
+	ShowDlgItem(hdlg, IDB_ROI, FALSE);			EnableDlgItem(hdlg, IDB_ROI, FALSE);
+	ShowDlgItem(hdlg, IDT_ROI_INFO, FALSE);	EnableDlgItem(hdlg, IDT_ROI_INFO, FALSE);
+
+	if (SIM_OpenCamera(sim, 10) != 0) {
+		wnd->Camera.driver = UNKNOWN;
+		return 1;
+	} else {
+		wnd->Camera.driver  = SIM;
+		wnd->Camera.details = sim;
+	}
+	fprintf(stderr, "[%s] Synthetic camera open %dx%d (%s, %d bit)\n", rname, sim->width, sim->height, sim->IsSensorColor ? "Bayer" : "mono", sim->bit_depth); fflush(stderr);
+
+	SIM_SetExposure(sim, 10.0);								/* Start at 10 ms exposure */
+	SIM_SetTriggerMode(sim, TRIG_FREERUN, NULL);			/* Put into continuous trigger */
+
+	_beginthread(SIM_ImageThread, 0, (void *) sim);
+
+	/* Enable and disable optional controls (CameraOnControls automatically enabled) */
+	EnableDlgItem(hdlg, IDV_RED_GAIN,    sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDV_GREEN_GAIN,  sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDV_BLUE_GAIN,   sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDS_RED_GAIN,    sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDS_GREEN_GAIN,  sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDS_BLUE_GAIN,   sim->IsSensorColor);
+	EnableDlgItem(hdlg, IDB_RESET_GAINS_RGB, TRUE);
+	EnableDlgItem(hdlg, IDB_RESET_GAINS_NEUTRAL, TRUE);
+	for (i=0; i<sizeof(SIM_Control_List)/sizeof(SIM_Control_List[0]); i++)
+		EnableDlgItem(hdlg, SIM_Control_List[i].wID, SIM_Control_List[i].enable);
+
+	/* Mark trigger controls that are visible */
+	memset(&sim->trigger.capabilities, 0, sizeof(sim->trigger.capabilities));
+	sim->trigger.capabilities.bFreerun    = TRUE;
+	sim->trigger.capabilities.bExternal   = TRUE;
+	sim->trigger.capabilities.bSingleShot = TRUE;
+	sim->trigger.capabilities.bSoftware   = TRUE;
+	sim->trigger.capabilities.bBurst      = TRUE;
+	sim->trigger.capabilities.bArmDisarm  = TRUE;
+	sim->trigger.capabilities.bMultipleFramesPerTrigger = TRUE;
+	SendMessage(hdlg, WMP_UPDATE_TRIGGER_BUTTONS, 0, 0);
+
+	/* Camera now active in freerun triggering - tell window */
+	wnd->LiveVideo = TRUE;
+	SetDlgItemCheck(hdlg, IDC_LIVE, wnd->LiveVideo);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Process frames from the synthetic camera (same duties as TL_ImageThread)
+-- 
+-- Usage: SIM_ImageThread(void *arglist);
+--
+-- Inputs: arglist - void * cast of the SIM_CAMERA * structure
+--
+-- Output: displays frames and generates statistics
+--
+-- Return: none
+=========================================================================== */
+static void SIM_ImageThread(void *arglist) {
+	static char *rname = "SIM_ImageThread";
+
+	SIM_CAMERA *sim;
+	int delta_max;
+	HIRES_TIMER *timer;
+	WND_INFO *wnd;
+	int rc, imageID;
+	LONGLONG t_start;
+
+	SIM_Process_Image_Thread_Active = TRUE;
+	SIM_Process_Image_Thread_Abort  = FALSE;
+
+	sim = (SIM_CAMERA *) arglist;
+	fprintf(stderr, "[%s] Thread started monitoring camera: %p\n", rname, sim); fflush(stderr);
+	Perf_TraceThreadName(rname);
+
+	timer = HiResTimerCreate();
+	HiResTimerReset(timer, 0.00);
+
+	SIM_Process_Image_Thread_Trigger = CreateEvent(NULL, FALSE, FALSE, NULL);
+	SIM_AddImageSignal(sim, SIM_Process_Image_Thread_Trigger);
+
+	while (main_wnd != NULL && ! SIM_Process_Image_Thread_Abort && SIM_IsValidCamera(sim) && ! abort_all_threads) {
+
+		rc = WaitForSingleObject(SIM_Process_Image_Thread_Trigger, 1000);
+		if (SIM_Process_Image_Thread_Abort) break;
+		if (rc != WAIT_OBJECT_0) continue;
+
+		if ( (wnd = main_wnd) == NULL) continue;
+		wnd->Image_Count++;
+		imageID = sim->image_count-1;
+
+		Perf_TraceBegin("Process", imageID);
+		t_start = Perf_Start();
+		if (wnd->autosave.enable) autosave_enqueue(wnd);
+		if (wnd->roi.nstreams > 0) roi_stream_capture(wnd);
+		Perf_Stop(PERF_PROCESS, t_start);
+		Perf_TraceEnd("Process", imageID);
+
+		/* Skip processing if (i) so requested or (ii) too many per second */
+		if (wnd->PauseImageRendering) continue;
+		if (HiResTimerDelta(timer) < 1.0/MAX_FRAME_DISPLAY_HZ) continue;
+		HiResTimerReset(timer, 0.00);
+
+		Perf_TraceBegin("Render", imageID);
+		Camera_ShowImage(wnd, -1, &delta_max);
+		Perf_TraceEnd("Render", imageID);
+	}
+	SIM_Process_Image_Thread_Active = FALSE;
+
+	SIM_RemoveImageSignal(sim, SIM_Process_Image_Thread_Trigger);
+	CloseHandle(SIM_Process_Image_Thread_Trigger);
+	SIM_Process_Image_Thread_Trigger = NULL;
+	HiResTimerDestroy(timer);
+
+	fprintf(stderr, "[%s] Exited\n", rname); fflush(stderr);
+	return;
+}
+
 /*===========================================================================
  -- Routine that is a "do nothing" ... just gets signal that a sequence
  -- has completed.  Needed for rings to work with TL cameras
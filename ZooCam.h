@@ -91,6 +91,7 @@ int DCx_Set_Exposure(WND_INFO *wnd, double exposure, BOOL maximize_framerate, HW
 --           (1) BURST_ARM    ==> arm the burst mode
 --           (2) BURST_ABORT  ==> abort burst if enabled
 --           (3) BURST_WAIT   ==> wait for burst to complete (timeout active)
+--           (4) BURST_MARK   ==> trigger a pre-trigger burst now (instead of LasGoStripeStart)
 --         msTimeout - timeout for some operations (wait)
 --         response - pointer to for return code (beyond success)
 --
@@ -102,10 +103,618 @@ int DCx_Set_Exposure(WND_INFO *wnd, double exposure, BOOL maximize_framerate, HW
 -- *response codes
 --     ACTION = 0 (STATUS)
 =========================================================================== */
-typedef enum _BURST_ACTION {BURST_STATUS=0, BURST_ARM=1, BURST_ABORT=2, BURST_WAIT=3} BURST_ACTION;
+typedef enum _BURST_ACTION {BURST_STATUS=0, BURST_ARM=1, BURST_ABORT=2, BURST_WAIT=3, BURST_MARK=4} BURST_ACTION;
 
 int Burst_Actions(BURST_ACTION request, int msTimeout, int *response);
 
+/* ===========================================================================
+-- Pre-trigger burst capture and the frozen segment of frames around a trigger
+--
+-- Usage: int Burst_Set_Pretrigger(int npre, int npost, int *cur_npre, int *cur_npost);
+--        BURST_SEGMENT *Burst_Lock_Segment(void);
+--        void Burst_Unlock_Segment(void);
+--        int Burst_Save_Segment(char *pattern);
+--
+-- Inputs: npre, npost - frames to keep before / collect after the trigger
+--                       (<0 ==> no change, both 0 ==> normal burst mode)
+--         cur_npre, cur_npost - if !NULL, receive the values now in effect
+--         pattern - root of name for files (<pattern>.csv, <pattern>_ddd.raw)
+--
+-- Output: When armed in pre-trigger mode the ring records continuously.  On
+--         LasGoStripeStart (or BURST_MARK) the newest frame becomes the
+--         trigger frame; the npre frames before it and the next npost
+--         frames are copied out of the ring into a segment, which then
+--         stays frozen while capture continues.
+--
+-- Return: Set:    0 if successful, 1 if no window, 2 if ring too small
+--         Lock:   pointer to the last segment (NULL if none) ... must call
+--                 Burst_Unlock_Segment() whenever Lock was called
+--         Save:   0 if successful, 1 no segment, 2 unable to open files
+=========================================================================== */
+typedef struct _SEGMENT_FRAME {
+	IMAGE_INFO info;							/* Info on the frame when copied */
+	double latency_ms;						/* Camera time relative to the trigger frame */
+	int length;									/* Bytes of raw data */
+	void *data;									/* Copy of the raw data (NULL if lost) */
+} SEGMENT_FRAME;
+
+typedef struct _BURST_SEGMENT {
+	int trigger_imageID;						/* imageID of the newest frame when the trigger arrived */
+	int trigger_index;						/* Index of that frame in frames[] */
+	int nframes;								/* npre + 1 + npost */
+	int nvalid;									/* Frames actually captured */
+	SEGMENT_FRAME *frames;
+} BURST_SEGMENT;
+
+int Burst_Set_Pretrigger(int npre, int npost, int *cur_npre, int *cur_npost);
+BURST_SEGMENT *Burst_Lock_Segment(void);
+void Burst_Unlock_Segment(void);
+int Burst_Save_Segment(char *pattern);
+
+/* ===========================================================================
+-- Streaming burst ... frames written to disk while the burst is running
+--
+-- Usage: int Burst_Set_Stream(int enable, char *pattern, FILE_FORMAT format);
+--        int Burst_Stream_Counts(int *enabled, int *frames, int *written, int *lost, int *pending);
+--
+-- Inputs: enable  - 1 ==> stream the next bursts, 0 ==> normal burst, <0 ==> no change
+--         pattern - root of name for files (ignored if NULL)
+--							  <pattern>.csv - logfile (same layout as TL_SaveBurstImages)
+--                     <pattern>_ddd.bmp - individual images (or .raw)
+--         format  - FILE_BMP or FILE_RAW (FILE_DFLT ==> no change)
+--         enabled, frames, written, lost, pending - if !NULL, counts for the
+--                   current (or last) streamed burst
+--
+-- Output: While streaming, each new frame is queued to a writer thread as
+--         soon as it arrives, so a burst is no longer limited to the ring
+--         size.  BURST_STATUS_COMPLETE is only reported once every queued
+--         frame and the .csv are written and closed.
+--
+-- Return: 0 if successful, 1 if no window
+--
+-- Notes: The pattern is captured when the burst is armed.  Set a new
+--        pattern before each arm or the previous files are overwritten.
+=========================================================================== */
+int Burst_Set_Stream(int enable, char *pattern, FILE_FORMAT format);
+int Burst_Stream_Counts(int *enabled, int *frames, int *written, int *lost, int *pending);
+
+/* ===========================================================================
+-- HDR exposure bracketing ... cycle the exposure and merge the frames
+--
+-- Usage: int HDR_Bracket(int nexp, double *exposure, BOOL continuous, HDR_OUTPUT output, int black_level);
+--        int HDR_Bracket_Status(HDR_BRACKET_INFO *info);
+--        int HDR_GetImageInfo(WND_INFO *wnd, IMAGE_INFO *info);
+--        int HDR_GetImageData(WND_INFO *wnd, void **image_data, int *length);
+--        int HDR_SaveImage(WND_INFO *wnd, char *path);
+--        int HDR_RenderFrame(WND_INFO *wnd, HWND hwnd);
+--
+-- Inputs: nexp        - exposures in the bracket (0 ==> stop bracketing)
+--         exposure    - requested exposure of each (ms)
+--         continuous  - TRUE to keep cycling, FALSE for one merged frame
+--         output      - HDR_FLOAT32 (radiance, counts/ms) or HDR_UINT16 (scaled)
+--         black_level - offset subtracted from every sample before merging
+--         info        - receives bracket status / merged frame information
+--         path        - file for the merged frame (.pfm float, .pgm 16-bit)
+--         hwnd        - window for a log tone-mapped rendering
+--
+-- Output: A thread sets each exposure in turn and takes the first new frame
+--         that reports that exposure in its IMAGE_INFO.  Each set of nexp
+--         frames is merged with IP_MergeHDR() into the HDR frame, which is
+--         available as frame FRAME_HDR to Camera_GetImageInfo(),
+--         Camera_CopyImageData(), Camera_SaveImage() and Camera_RenderFrame()
+--         (and so to the server).  The original exposure is restored when
+--         bracketing stops.
+--
+-- Return: HDR_Bracket: 0 if successful, 1 no camera, 2 invalid parameters,
+--                      3 previous bracket would not stop, 4 no thread
+--         others: 0 if successful, 2 if no merged frame yet, 6 file failed
+--
+-- Notes: IMAGE_INFO of the HDR frame has frame = FRAME_HDR, imageID = -1
+--        (never confused with ring images by client caches) and exposure =
+--        the equivalent exposure of the merged values in ms (1.0 for float,
+--        the 16-bit scale for HDR_UINT16).
+--        HDR_GetImageData() returns a malloc'd copy (caller frees).
+--        There is no GUI view of FRAME_HDR; the merged frame is for server
+--        clients, HDR_SaveImage() and callers of Camera_RenderFrame() that
+--        supply their own window.
+=========================================================================== */
+#define	HDR_MAX_EXPOSURES	(8)
+typedef enum _HDR_OUTPUT { HDR_FLOAT32=0, HDR_UINT16=1 } HDR_OUTPUT;
+
+#pragma pack(4)
+typedef struct _HDR_BRACKET_INFO {
+	int active;									/* Bracket thread running */
+	int continuous;							/* Keep cycling (else one merged frame) */
+	HDR_OUTPUT output;						/* Format of the merged frame */
+	int nexp;									/* Exposures in the bracket */
+	double exposure[HDR_MAX_EXPOSURES];	/* Requested exposures (ms) */
+	double actual[HDR_MAX_EXPOSURES];	/* Exposure tagged on the frames of the last merge */
+	int imageID[HDR_MAX_EXPOSURES];		/* Source frames of the last merge */
+	int count;									/* Merged frames since bracketing started */
+	double scale;								/* HDR_UINT16: value per count/ms */
+	double ms_merge;							/* Time for the last merge (ms) */
+} HDR_BRACKET_INFO;
+#pragma pack()
+
+int HDR_Bracket(int nexp, double *exposure, BOOL continuous, HDR_OUTPUT output, int black_level);
+int HDR_Bracket_Status(HDR_BRACKET_INFO *info);
+int HDR_GetImageInfo(WND_INFO *wnd, IMAGE_INFO *info);
+int HDR_GetImageData(WND_INFO *wnd, void **image_data, int *length);
+int HDR_SaveImage(WND_INFO *wnd, char *path);
+int HDR_RenderFrame(WND_INFO *wnd, HWND hwnd);
+
+/* ===========================================================================
+-- Autosave queue statistics
+--
+-- Usage: int Autosave_Stats(AUTOSAVE_INFO *info, BOOL reset);
+--
+-- Inputs: info  - receives the current counts (if !NULL)
+--         reset - TRUE to zero the counts and max_depth after reading
+--
+-- Output: Autosave (external / software / single-shot triggering) queues
+--         the imageID of every new frame; writer threads save each one
+--         from the ring.  The display thread never waits on the disk.
+--
+-- Return: 0 if successful, 1 if no window
+--
+-- Notes: dropped ==> queue full when the frame arrived (writers behind)
+--        lost    ==> frame overwritten in the ring before it was saved
+=========================================================================== */
+#pragma pack(4)
+typedef struct _AUTOSAVE_INFO {
+	int enabled;								/* Autosave active */
+	int capacity;								/* Queue entries (ring size) */
+	int depth;									/* Frames waiting now */
+	int max_depth;								/* Largest backlog seen */
+	int writers;								/* Writer threads running */
+	int queued;									/* Frames accepted into the queue */
+	int written;								/* Files written */
+	int dropped;								/* Frames refused because the queue was full */
+	int lost;									/* Frames overwritten before being written */
+	int failed;									/* Write errors */
+	int skipped;								/* Frames not saved by the change gate */
+	double last_metric;						/* Last change metric (<0 ==> none yet) */
+} AUTOSAVE_INFO;
+#pragma pack()
+
+int Autosave_Stats(AUTOSAVE_INFO *info, BOOL reset);
+
+/* ===========================================================================
+-- Change-detection gate on autosave
+--
+-- Usage: int Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current);
+--
+-- Inputs: set     - new gate settings (NULL ==> just query)
+--         current - receives the settings in effect (if !NULL)
+--
+-- Output: When enabled, each frame that would be autosaved is first binned
+--         to a MONO8 preview about AUTOSAVE_GATE_WIDTH pixels wide and
+--         compared with the preview of the last frame saved.  The metric is
+--         the mean absolute difference in 8-bit counts (SSE2 psadbw).  The
+--         frame is saved only if metric >= threshold, or if max_interval
+--         seconds of camera time have passed since the last save.  Every
+--         decision is appended to <directory>/<template>_gate.csv as
+--         imageID,camera_time,metric,decision,index so the sequence can be
+--         reconstructed.
+--
+-- Return: 0 if successful, 1 if no window, 2 if invalid parameters
+=========================================================================== */
+#define	AUTOSAVE_GATE_WIDTH		(128)				/* Approximate preview width (pixels) */
+
+#pragma pack(4)
+typedef struct _AUTOSAVE_GATE {
+	int enable;									/* Gate active */
+	double threshold;							/* Mean |difference| (8-bit counts) to save */
+	double max_interval;						/* Save at least this often (s, 0 ==> never forced) */
+} AUTOSAVE_GATE;
+#pragma pack()
+
+int Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current);
+
+/* ===========================================================================
+-- Frame accumulator ... running mean and variance of the incoming frames
+--
+-- Usage: int Accum_Start(ACCUM_MODE mode, int nframes);
+--        int Accum_Status(ACCUM_INFO *info);
+--        int Accum_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info);
+--        int Accum_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
+--        int Accum_SaveImage(WND_INFO *wnd, int frame, char *path);
+--        int Accum_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd);
+--
+-- Inputs: mode    - ACCUM_COUNT   ==> sum the next nframes frames and stop
+--                   ACCUM_SLIDING ==> keep the last nframes frames (until stopped)
+--                   ACCUM_STOP    ==> stop adding (results remain available)
+--         nframes - frames to sum (COUNT <= 65536, SLIDING <= ACCUM_MAX_WINDOW)
+--         frame   - FRAME_MEAN or FRAME_VARIANCE
+--         info    - receives accumulator status / image information
+--         path    - file for the image (raw little-endian float32, row order)
+--         hwnd    - window for a linear min/max rendering
+--
+-- Output: A thread adds every new frame in the ring (by imageID, so none are
+--         missed or repeated) into 32-bit sum and 64-bit sum-of-squares
+--         buffers with the SSE2 kernel IP_Accumulate().  The mean and
+--         variance images are PIXEL_FLOAT32 with one value per sample (Bayer
+--         and color layouts retained) and are available as frames FRAME_MEAN
+--         and FRAME_VARIANCE to Camera_GetImageInfo(), Camera_CopyImageData(),
+--         Camera_SaveImage() and Camera_RenderFrame() (and so to the server).
+--
+-- Return: Accum_Start: 0 if successful, 1 no camera, 2 invalid parameters,
+--                      3 previous run would not stop, 4 no thread
+--         others: 0 if successful, 2 if no frames accumulated, 4 no memory,
+--                 6 file failed
+--
+-- Notes: A change of image size or format restarts the sums.
+--        Accum_GetImageData() returns a malloc'd copy (caller frees).
+--        There is no GUI view of FRAME_MEAN / FRAME_VARIANCE; the images are
+--        for server clients, Accum_SaveImage(), the calibration capture and
+--        callers of Camera_RenderFrame() that supply their own window.
+=========================================================================== */
+#define	ACCUM_MAX_WINDOW	(64)					/* Frames kept for the sliding window */
+typedef enum _ACCUM_MODE { ACCUM_STOP=0, ACCUM_COUNT=1, ACCUM_SLIDING=2 } ACCUM_MODE;
+
+#pragma pack(4)
+typedef struct _ACCUM_INFO {
+	ACCUM_MODE mode;							/* Mode of the current / last run */
+	int nframes;								/* Requested frames (or window size) */
+	int active;									/* Accumulator thread running */
+	int complete;								/* ACCUM_COUNT run has all nframes */
+	int count;									/* Frames now in the sums */
+	int total;									/* Frames added since the start */
+	int lost;									/* Frames overwritten before they could be added */
+	int width, height;						/* Image size of the sums */
+	int nsamples;								/* Values in the mean / variance images */
+	double ms_add;								/* Time to add the last frame (ms) */
+} ACCUM_INFO;
+#pragma pack()
+
+int Accum_Start(ACCUM_MODE mode, int nframes);
+int Accum_Status(ACCUM_INFO *info);
+int Accum_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info);
+int Accum_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
+int Accum_SaveImage(WND_INFO *wnd, int frame, char *path);
+int Accum_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd);
+
+/* ===========================================================================
+-- Dark / bias / flat calibration applied as frames enter the ring
+--
+-- Usage: int Calib_Capture(CALIB_KIND kind);
+--        int Calib_Enable(int enable);
+--        int Calib_Save(char *path);
+--        int Calib_Load(char *path);
+--        int Calib_Status(CALIB_INFO *info);
+--        void Calib_SetExposure(WND_INFO *wnd, double ms, int imageID);
+--
+-- Inputs: kind   - CALIB_BIAS, CALIB_DARK or CALIB_FLAT ... taken from the
+--                  accumulator mean (run ACCUM_COUNT under the right
+--                  conditions first: shortest exposure and capped for the
+--                  bias, capped at the working exposure for the dark,
+--                  uniform illumination for the flat)
+--         enable - 1 ==> correct frames, 0 ==> raw frames, <0 ==> no change
+--         path   - calibration file; NULL or "" ==> <serial>_<ms>ms_<dB>dB.zcal
+--                  For Calib_Load a directory picks the set in it with this
+--                  camera's serial, the current gain, and the nearest exposure
+--         info   - receives the state of the calibration set
+--         ms     - new exposure of the camera (ms)
+--         imageID - first frame exposed at ms (see Calib_SetExposure in ZooCam.c)
+--
+-- Output: When enabled, each frame is corrected as it is copied into the
+--         ring, dst = (raw - dark) * flat_gain, so statistics, display,
+--         saves and the server all see corrected data.  dark is the bias
+--         plus the dark current scaled to the frame's exposure.  On enabling,
+--         a copy of the newest frame is corrected by both the SIMD and the
+--         scalar reference and compared (check_samples, check_maxdiff in
+--         CALIB_INFO).  Calib_SetExposure() is called by Camera_SetExposure()
+--         and Camera_ApplySettings() to build the scaled dark ahead of the
+--         frames, so the driver's frame callback never does more than the
+--         correction.  The previous dark is kept for frames before the
+--         imageID bound of Camera_ApplySettings (Camera_SetExposure has no
+--         bound and switches at the next frame).
+--
+-- Return: Calib_Enable: 1 if enabled, 0 if not, <0 on error
+--                        -1 ==> no camera, -2 ==> driver not supported,
+--                        -3 ==> set does not match the current image size
+--                        -4 ==> set is for another camera or gain
+--         others: 0 if successful
+--                   1 ==> no camera
+--                   2 ==> nothing accumulated / nothing to save
+--                   3 ==> calibration enabled while accumulating (disable first)
+--                   4 ==> unsupported pixel format or no memory
+--                   5 ==> flat field has no signal
+--                   6 ==> file failed, not a calibration file, or no match
+=========================================================================== */
+typedef enum _CALIB_KIND { CALIB_BIAS=0, CALIB_DARK=1, CALIB_FLAT=2 } CALIB_KIND;
+
+#pragma pack(4)
+typedef struct _CALIB_INFO {
+	int enabled;								/* Correction being applied to new frames */
+	int have_bias, have_dark, have_flat;	/* Components in the set */
+	int width, height;						/* Image size of the set */
+	char serial[32];							/* Camera serial number of the set */
+	double ms_dark;							/* Exposure of the dark (key) */
+	double dB_gain;							/* Gain of the dark (key) */
+	int frames;									/* Frames corrected since enabled */
+	int check_samples;						/* Samples compared with the scalar reference */
+	int check_maxdiff;						/* Largest difference found (0 ==> identical) */
+} CALIB_INFO;
+#pragma pack()
+
+/* Header of a .zcal file ... followed by width*height bias (uint16), dark (uint16), flat gain (float) for those present */
+#define	CALIB_FILE_MAGIC		(0x5A43414C)			/* "ZCAL" */
+#pragma pack(4)
+typedef struct _CALIB_FILE_HEADER {
+	int magic;									/* CALIB_FILE_MAGIC */
+	int header_size;							/* sizeof(CALIB_FILE_HEADER) */
+	int version;								/* 1 */
+	char serial[32];
+	int width, height, format, bit_depth;	/* Layout (PIXEL_FORMAT) */
+	double ms_dark, dB_gain;
+	int have_bias, have_dark, have_flat;
+} CALIB_FILE_HEADER;
+#pragma pack()
+
+int Calib_Capture(CALIB_KIND kind);
+int Calib_Enable(int enable);
+int Calib_Save(char *path);
+int Calib_Load(char *path);
+int Calib_Status(CALIB_INFO *info);
+#define	CALIB_ID_PENDING	(0x7FFFFFFF)			/* Calib_SetExposure: first frame not known yet */
+void Calib_SetExposure(WND_INFO *wnd, double ms, int imageID);
+
+/* ===========================================================================
+-- Hot / dead pixel map ... built from dark and flat means, corrected in-line
+--
+-- Usage: int Defect_Build(CALIB_KIND kind, double threshold);
+--        int Defect_Clear(void);
+--        int Defect_Enable(int enable);
+--        int Defect_Save(char *path);
+--        int Defect_Load(char *path);
+--        int Defect_Status(DEFECT_INFO *info);
+--
+-- Inputs: kind      - CALIB_DARK (or CALIB_BIAS) ==> add hot pixels, those
+--                     more than threshold robust sigma above the median
+--                     (<=0 ==> DEFECT_DFLT_NSIGMA)
+--                     CALIB_FLAT ==> add dead / weak pixels, those below
+--                     threshold of the median (<=0 ==> DEFECT_DFLT_FRACTION)
+--                     Both take the accumulator mean (run ACCUM_COUNT first)
+--         enable    - 1 ==> correct frames, 0 ==> don't, <0 ==> no change
+--         path      - map file; NULL or "" ==> <serial>.zdef.  For
+--                     Defect_Load a directory picks <serial>.zdef in it
+--         info      - receives the state of the map
+--
+-- Output: The map is a sorted list of sample indices.  When enabled, each
+--         listed sample is replaced by the mean of its good same-color
+--         neighbors as the frame is copied into the ring (after the dark /
+--         flat correction if that is also enabled), so CalcStatistics and
+--         centroid tracking never see the defects.  The cost is proportional
+--         to the number of defects.
+--
+-- Return: Defect_Enable: 1 if enabled, 0 if not, <0 on error
+--                         -1 ==> no camera, -2 ==> driver not supported,
+--                         -3 ==> map does not match the current image size
+--                         -4 ==> map is for another camera
+--         others: 0 if successful
+--                   1 ==> no camera
+--                   2 ==> nothing accumulated / no map
+--                   3 ==> correction enabled while accumulating (disable first)
+--                   4 ==> unsupported pixel format or no memory
+--                   5 ==> more than DEFECT_MAX_COUNT defects (threshold too low)
+--                   6 ==> file failed or not a defect map
+=========================================================================== */
+#define	DEFECT_MAX_COUNT			(65536)		/* Sanity limit on the map */
+#define	DEFECT_DFLT_NSIGMA		(8.0)			/* Hot: robust sigma above the dark median */
+#define	DEFECT_DFLT_FRACTION		(0.5)			/* Dead: fraction of the flat median */
+
+#pragma pack(4)
+typedef struct _DEFECT_INFO {
+	int enabled;								/* Correction being applied to new frames */
+	int ndefects;								/* Samples in the map */
+	int nhot, ndead;							/* Added by the dark / flat builds */
+	int width, height;						/* Image size of the map */
+	char serial[32];							/* Camera serial number of the map */
+	int frames;									/* Frames corrected since enabled */
+	double ms_correct;						/* Time for the last frame's correction (ms) */
+} DEFECT_INFO;
+#pragma pack()
+
+/* Header of a .zdef file ... followed by ndefects sample indices (int32, increasing) */
+/* Version 1 files end before cfa_phase and are read as CFA_GREEN_LEFT_OF_RED */
+#define	DEFECT_FILE_MAGIC		(0x5A444546)			/* "ZDEF" */
+#pragma pack(4)
+typedef struct _DEFECT_FILE_HEADER {
+	int magic;									/* DEFECT_FILE_MAGIC */
+	int header_size;							/* sizeof(DEFECT_FILE_HEADER) */
+	int version;								/* 2 */
+	char serial[32];
+	int width, height, format;				/* Layout (PIXEL_FORMAT) */
+	int ndefects, nhot, ndead;
+	int cfa_phase;								/* CFA_PHASE of the sensor (Bayer neighbors) */
+} DEFECT_FILE_HEADER;
+#pragma pack()
+
+int Defect_Build(CALIB_KIND kind, double threshold);
+int Defect_Clear(void);
+int Defect_Enable(int enable);
+int Defect_Save(char *path);
+int Defect_Load(char *path);
+int Defect_Status(DEFECT_INFO *info);
+
+/* ===========================================================================
+-- Multi-ROI extraction streams ... small windows copied from every frame
+--
+-- Usage: int ROI_Stream_Add(ROI_STREAM_DEF *def);
+--        int ROI_Stream_Remove(char *name);
+--        int ROI_Stream_List(ROI_STREAM_INFO *info, int maxn);
+--        int ROI_Stream_GetFrame(char *name, int seq, int msTimeout, ROI_FRAME_INFO **frame, size_t *length);
+--        int ROI_Stream_Save(char *name, int seq, char *path);
+--
+-- Inputs: def       - name, window (sensor pixels of the ring image), bin
+--                     and bDecimate as for IMAGE_REGION, every (keep one
+--                     frame in every), format (PIXEL_FORMAT of the copies,
+--                     0 ==> same as the ring) and nslots (frames kept)
+--         name      - stream to act on (Remove: NULL or "" ==> all)
+--         info      - receives up to maxn stream descriptions
+--         seq       - sequence number in the stream (<0 ==> newest)
+--         msTimeout - longest to wait for seq (or any frame) to arrive
+--         frame     - receives a malloc'd ROI_FRAME_INFO followed by the
+--                     pixels (caller frees); *length is the total bytes
+--         path      - file for the frame (PGM, or PPM for RGB24)
+--
+-- Output: The image thread copies each registered window out of every new
+--         ring frame (by imageID, as autosave) with IP_ExtractRegion() into
+--         a compact ring of nslots frames per stream, each with its own
+--         sequence number and the timestamps of the source frame.  Streams
+--         are independent: a consumer waits on and fetches its own frames.
+--
+-- Return: ROI_Stream_Add: 0 if successful, 1 no window, 2 invalid parameters,
+--                         3 table full, 4 no memory
+--         ROI_Stream_Remove: 0 if successful, 2 no such stream
+--         ROI_Stream_List: number of streams (may exceed maxn)
+--         ROI_Stream_GetFrame / Save: 0 if successful, 1 no window, 2 no
+--                         such stream, 3 timeout (no frame), 4 no memory,
+--                         6 file failed
+--
+-- Notes: (1) Adding an existing name redefines that stream (its frames
+--            are discarded).  Windows are clipped to the current image and
+--            re-clipped if the camera ROI changes.
+--        (2) If seq has already been overwritten, GetFrame returns the
+--            oldest frame still held, so a consumer asking for last+1 sees
+--            any gap in the returned seq.
+=========================================================================== */
+#define	ROI_MAX_STREAMS		(8)					/* Registered windows */
+#define	ROI_DFLT_SLOTS			(16)					/* Frames held per stream */
+#define	ROI_MAX_SLOTS			(1024)
+
+#pragma pack(4)
+typedef struct _ROI_STREAM_DEF {
+	char name[32];								/* Unique name of the stream */
+	int ulx, uly;								/* Upper left corner (pixels of the ring image) */
+	int width, height;						/* Size in pixels (<=0 ==> to edge) */
+	int bin;										/* Bin / stride factor (1 = full resolution) */
+	int bDecimate;								/* TRUE ==> take every bin'th pixel, FALSE ==> average */
+	int every;									/* Keep one frame in every (<=1 ==> all) */
+	int format;									/* PIXEL_FORMAT of the copies (0 ==> as ring) */
+	int nslots;									/* Frames held (0 ==> ROI_DFLT_SLOTS) */
+} ROI_STREAM_DEF;
+
+typedef struct _ROI_STREAM_INFO {
+	ROI_STREAM_DEF def;						/* Definition as clipped to the current image */
+	int width, height;						/* Size of each copy (pixels) */
+	int format, bit_depth;					/* PIXEL_FORMAT of the copies */
+	int frame_bytes;							/* Bytes in each copy (packed rows) */
+	int first_seq, last_seq;				/* Frames now held (last_seq < 0 ==> none) */
+	int captured;								/* Frames copied since added */
+	int lost;									/* Frames overwritten in the ring before copying */
+	double ms_copy;							/* Time for the last copy (ms) */
+} ROI_STREAM_INFO;
+
+typedef struct _ROI_FRAME_INFO {
+	int seq;										/* Sequence number within the stream */
+	int imageID;								/* imageID of the source frame */
+	__time64_t timestamp;					/* Standard UNIX time of capture */
+	double camera_time;						/* Camera clock time of capture (s) */
+	double exposure;							/* Exposure (ms) */
+	int width, height;						/* Size of the copy (pixels) */
+	int pitch;									/* Bytes between rows (packed) */
+	int format, bit_depth;					/* PIXEL_FORMAT and significant bits */
+	uint32_t length;							/* Bytes of pixel data following */
+} ROI_FRAME_INFO;
+#pragma pack()
+
+int ROI_Stream_Add(ROI_STREAM_DEF *def);
+int ROI_Stream_Remove(char *name);
+int ROI_Stream_List(ROI_STREAM_INFO *info, int maxn);
+int ROI_Stream_GetFrame(char *name, int seq, int msTimeout, ROI_FRAME_INFO **frame, size_t *length);
+int ROI_Stream_Save(char *name, int seq, char *path);
+
+/* ===========================================================================
+-- Concurrent capture on several TL cameras
+--
+-- Usage: int Multi_Camera_List(MULTI_CAMERA_INFO *info, int maxn);
+--        int Multi_Camera_Start(int id, int nBuf);
+--        int Multi_Camera_Stop(int id);
+--        int Multi_Camera_GetImage(int id, int frame, MULTI_FRAME_INFO **pframe, size_t *length);
+--        int Multi_Camera_Align(int ref, MULTI_ALIGN_INFO *info, int maxn);
+--
+-- Inputs: id     - camera (index in the TL camera list, as reported by
+--                  Multi_Camera_List); Stop: -1 ==> all
+--         nBuf   - ring size when the camera has to be opened (0 ==> 10)
+--         frame  - ring index (-1 ==> newest)
+--         ref    - camera the others are aligned to (-1 ==> main camera,
+--                  or the first capturing if the main one is not)
+--         info   - receives up to maxn descriptions / alignments
+--         pframe - receives a malloc'd MULTI_FRAME_INFO followed by the
+--                  raw 16-bit pixels (caller frees); *length total bytes
+--
+-- Output: Each started camera is opened (if not already the GUI camera)
+--         in freerun with its own ring and counts from the TL frame
+--         callback.  imageIDs come from the sequence shared by all cameras
+--         (TL_NextImageID), so they never collide.  A processing thread per
+--         camera keeps the arrival history (imageID, host clock, camera
+--         clock) of the last MULTI_HISTORY frames, counts the frames it
+--         handled and passed over, and refreshes the image statistics of
+--         the newest frame up to MULTI_STATS_HZ.  Multi_Camera_Align pairs every frame
+--         of the reference with the nearest arrival of each other camera
+--         and reports the mean / rms / max difference, and fits each
+--         camera clock against the common host clock (rate in ppm).
+--
+-- Return: Multi_Camera_List / Align: number of entries (may exceed maxn)
+--         Others: 0 if successful, 1 no window, 2 no such camera (or
+--                 frame, or not open), 3 table full, 4 no memory, 5 failed
+--                 to open / start, 6 ring busy
+--
+-- Notes: Only TL cameras ... the DCx driver holds a single camera in the
+--        main window structure.  Triggering and exposure of the extra
+--        cameras stay at their open defaults (freerun).
+=========================================================================== */
+#define	MULTI_MAX_CAMERAS		(8)					/* Cameras capturing at once */
+#define	MULTI_HISTORY			(256)					/* Arrivals kept per camera for alignment */
+#define	MULTI_STATS_HZ			(8)					/* Statistics refreshes per camera per second */
+
+#pragma pack(4)
+typedef struct _MULTI_CAMERA_INFO {
+	int id;										/* Camera for the Multi_* calls */
+	char model[32], serial[32];
+	int bMain;									/* Driven by the GUI */
+	int bOpen;									/* Handle open (capturing into its ring) */
+	int bCapturing;							/* Capture thread running */
+	int width, height, bit_depth, bColor;
+	int nBuffers, nValid;
+	int last_imageID;							/* Newest frame in the ring (-1 ==> none) */
+	uint32_t received, stored, skipped, missed;	/* Counts from the frame callback */
+	uint32_t handled, lost;					/* Frames the processing thread took, and passed over */
+	double fps;									/* Arrival rate over the history */
+	double host_time;							/* Host clock of the newest frame (s) */
+	int stats_imageID;						/* Frame the statistics are from (-1 ==> none yet) */
+	double mean;								/* Mean level over the channels */
+	int vmax;									/* Largest value */
+	uint32_t saturated;						/* Pixels at saturation */
+	double brenner;							/* Focus metric (as IMAGE_STATS) */
+} MULTI_CAMERA_INFO;
+
+typedef struct _MULTI_FRAME_INFO {
+	int id;										/* Camera */
+	IMAGE_INFO info;							/* As Camera_GetImageInfo */
+	double host_time;							/* Arrival on the common host clock (s) */
+	uint32_t length;							/* Bytes of pixel data following */
+} MULTI_FRAME_INFO;
+
+typedef struct _MULTI_ALIGN_INFO {
+	int id, ref;								/* Camera and the reference it is compared to */
+	int nframes;								/* Reference frames paired */
+	double fps;									/* Arrival rate over the history */
+	double offset_ms;							/* Mean arrival minus the paired reference arrival */
+	double rms_ms, max_ms;					/* RMS and largest |difference| */
+	double clock_ppm;							/* Camera clock rate relative to the host clock */
+	double clock_offset;						/* Camera time minus host time (s, from the fit) */
+} MULTI_ALIGN_INFO;
+#pragma pack()
+
+int Multi_Camera_List(MULTI_CAMERA_INFO *info, int maxn);
+int Multi_Camera_Start(int id, int nBuf);
+int Multi_Camera_Stop(int id);
+int Multi_Camera_GetImage(int id, int frame, MULTI_FRAME_INFO **pframe, size_t *length);
+int Multi_Camera_Align(int ref, MULTI_ALIGN_INFO *info, int maxn);
+
 /* ===========================================================================
 -- Interface to the BURST functions
 --
@@ -149,7 +758,7 @@ int DCx_Enable_Live_Video(int state);
 
 /* Upper level camera information encoded in the combobox dropdown and ActiveCamera pointer */
 typedef struct _CAMERA {
-	enum {UNKNOWN=0, DCX=1, TL=2} driver;	/* empty initialization points to none */
+	enum {UNKNOWN=0, DCX=1, TL=2, SIM=3} driver;	/* empty initialization points to none */
 	char id[64];								/* Unique camera id based on camera information (default alias) */
 	char ini_name[32];						/* Initialization file name (CAM_S/N) */
 	char alias[64];							/* Alias name for use in the combobox */
@@ -173,9 +782,145 @@ typedef struct _WND_INFO {
 			BURST_STATUS_ABORT=4,			/* Capture was aborted */
 			BURST_STATUS_FAIL=5				/* Capture failed for other reason (no semaphores, etc.) */
 	} BurstModeStatus;						/* Internal status */
+	struct {										/* Pre-trigger burst (see Burst_Set_Pretrigger) */
+		int npre, npost;						/* Frames before / after trigger (both 0 ==> normal burst) */
+		HANDLE mark;							/* Auto-reset event for BURST_MARK */
+		HANDLE mutex;							/* Protects segment */
+		BURST_SEGMENT *segment;				/* Last frozen segment */
+	} pretrigger;
+	struct {										/* Streaming burst writer (see Burst_Set_Stream) */
+		BOOL enabled;							/* Write frames as they arrive */
+		char pattern[PATH_MAX];				/* Root name for the next burst */
+		FILE_FORMAT format;					/* FILE_BMP or FILE_RAW */
+		char active_pattern[PATH_MAX];	/* Copies taken at the start of the running burst */
+		FILE_FORMAT active_format;			/* (the writer never reads pattern / format) */
+		CRITICAL_SECTION lock;				/* Protects queue, head, tail */
+		BOOL lock_init;
+		HANDLE wake;							/* Writer has work (or capture finished) */
+		HANDLE done;							/* Writer has closed all files */
+		struct _STREAM_ENTRY {
+			int index;							/* Sequence in the burst (file _ddd) */
+			IMAGE_INFO info;					/* Info when queued (frame and imageID) */
+		} *queue;								/* Frames waiting for the writer */
+		int nqueue, head, tail;				/* Queue size, next to add, next to write */
+		volatile BOOL capture_done;		/* No more frames will be queued */
+		volatile long frames, written, lost;	/* Counts for the current / last burst */
+	} stream;
+	struct {										/* HDR exposure bracketing (see HDR_Bracket) */
+		volatile BOOL active;				/* Bracket thread running */
+		volatile BOOL stop;					/* Request the thread to finish */
+		BOOL continuous;
+		HDR_OUTPUT output;
+		int black_level;
+		int nexp;
+		double exposure[HDR_MAX_EXPOSURES];
+		HANDLE mutex;							/* Protects everything below */
+		void *buffer[2];						/* Merged frames ... current one is served */
+		int size[2];							/* Bytes allocated in each buffer */
+		int current, length;					/* Buffer being served and its bytes */
+		IMAGE_INFO info;						/* Info for the merged frame */
+		HDR_BRACKET_INFO status;			/* Last merge details */
+	} hdr;
+	struct {										/* Frame accumulator (see Accum_Start) */
+		volatile BOOL active;				/* Accumulator thread running */
+		volatile BOOL stop;					/* Request the thread to finish */
+		ACCUM_MODE mode;
+		int nframes;
+		HANDLE mutex;							/* Protects everything below */
+		int format, width, height, bit_depth;	/* Layout of the summed frames (PIXEL_FORMAT) */
+		int nsamples, frame_bytes;			/* Values per frame and bytes of a packed copy */
+		uint32_t *sum;							/* Running sums */
+		uint64_t *sumsq;						/* Running sums of squares */
+		unsigned char **slots;				/* nframes+1 packed copies (window + scratch) */
+		int nslots, head;						/* Allocated slots, oldest in the window */
+		float *mean[2], *var[2];			/* Results ... current pair is served */
+		int current;
+		BOOL dirty;								/* Sums changed since the results were made */
+		int count, total, lost;
+		BOOL complete;
+		double ms_add;
+		IMAGE_INFO info;						/* Last frame added */
+	} accum;
+	struct {										/* Dark / bias / flat calibration (see Calib_Enable) */
+		CRITICAL_SECTION lock;				/* Protects everything below (held by the frame filter) */
+		BOOL lock_init;
+		BOOL enabled;
+		char serial[32];						/* Key of the set ... camera, */
+		double ms_dark, dB_gain;			/* exposure and gain of the dark */
+		int width, height, format, bit_depth;
+		unsigned short *bias, *dark;		/* NULL if not captured */
+		float *flat;							/* Normalized gains (NULL if not captured) */
+		unsigned short *dark_eff[2];		/* Darks used by the kernel, built at ms_eff */
+		float *gain_eff;						/* Gains used by the kernel */
+		double ms_eff[2];						/* Exposure of each dark_eff (<0 ==> not built) */
+		int ieff;								/* dark_eff for the current exposure */
+		int from_id[2];						/* First imageID each dark_eff applies to */
+		int check_samples, check_maxdiff;
+		volatile long frames;
+		BOOL size_logged;						/* Frames of another size reported (binning / ROI) */
+	} calib;
+	struct {										/* Hot / dead pixel map (see Defect_Enable) ... uses calib.lock */
+		BOOL enabled;
+		char serial[32];
+		int width, height, format;
+		CFA_PHASE cfa_phase;					/* Color of the top-left sample (Bayer) */
+		int *index;								/* Sorted sample indices */
+		int ndefects, nhot, ndead;
+		volatile long frames;
+		double ms_correct;
+		BOOL size_logged;						/* Frames of another size reported (binning / ROI) */
+	} defect;
+	struct {										/* Multi-ROI extraction streams (see ROI_Stream_Add) */
+		CRITICAL_SECTION lock;				/* Protects everything below (held while copying) */
+		BOOL lock_init;
+		int last_id;							/* Newest imageID already considered */
+		int nstreams;
+		struct _ROI_STREAM {
+			ROI_STREAM_DEF def;				/* As requested */
+			ROI_STREAM_INFO status;			/* Clipped definition, layout and counts */
+			int src_width, src_height, src_format;	/* Ring layout the window was clipped for */
+			int nslots;
+			unsigned char *slots;			/* nslots packed copies */
+			ROI_FRAME_INFO *frames;			/* Information for each slot */
+			int next_seq;						/* Sequence for the next copy */
+			int phase;							/* Frames since the last one kept */
+			HANDLE event;						/* Auto-reset, set on each new copy */
+		} stream[ROI_MAX_STREAMS];
+	} roi;
+	struct {										/* Concurrent capture on several TL cameras (see Multi_Camera_Start) */
+		CRITICAL_SECTION lock;				/* Protects everything below (never held while waiting) */
+		BOOL lock_init;
+		int ncams;
+		struct _MULTI_CAPTURE {
+			void *tl;							/* TL_CAMERA * */
+			BOOL bOpened;						/* Opened here (closed again on stop) */
+			volatile BOOL active;			/* Capture thread running */
+			volatile BOOL stop;				/* Request the thread to finish */
+			int last_id;						/* Newest imageID recorded */
+			int nhist, head;					/* Arrivals held and next slot */
+			int ids[MULTI_HISTORY];
+			double host[MULTI_HISTORY], camera[MULTI_HISTORY];
+			uint32_t handled, lost;			/* Frames taken from the ring, and passed over */
+			int stats_imageID;				/* Statistics of the newest frame processed (as MULTI_CAMERA_INFO) */
+			double mean, brenner;
+			int vmax;
+			uint32_t saturated;
+		} cam[MULTI_MAX_CAMERAS];
+	} multi;
 
 	/* Camera initialized */
 	CAMERA Camera;								/* Pointer to primary info on the camera (DCX or TL) */
+	struct {										/* Cached camera properties (see Camera_GetProperties) */
+		CRITICAL_SECTION lock;				/* Protects values and signals (never held across SDK calls) */
+		CRITICAL_SECTION refresh;			/* Serializes the SDK queries that publish new values */
+		BOOL lock_init;
+		BOOL valid;								/* values belong to ... */
+		int driver;								/* ... this camera */
+		void *details;
+		CAMERA_PROPS values;
+		HANDLE signals[PROP_MAX_SIGNALS];	/* Set on each new version */
+		HANDLE stop, done;					/* Reconcile thread: exit request / has exited */
+	} props;
 
 	/* Common camera information */
 	int Image_Count;							/* Number of images processed - use to identify new data */
@@ -199,6 +944,31 @@ typedef struct _WND_INFO {
 		char template[PATH_MAX];			/* What is template for save */
 		char directory[PATH_MAX];			/* Directory for saving files */
 		int next_index;						/* Next index to use */
+		CRITICAL_SECTION lock;				/* Protects the queue (never held during I/O) */
+		BOOL lock_init;
+		HANDLE wake;							/* Signals the writer threads */
+		HANDLE idle;							/* Set (manual) by the last writer to exit */
+		BOOL stop;								/* Writers exit and none start (closeout) */
+		struct _AUTOSAVE_ENTRY {
+			int index;							/* Index used in the filename */
+			IMAGE_INFO info;					/* Frame and imageID in the ring */
+		} *queue;
+		int nqueue, head, tail;				/* Bounded FIFO (one entry per ring buffer) */
+		int last_id;							/* Newest imageID already considered */
+		volatile long writers;				/* Writer threads running */
+		volatile long queued, written, dropped, lost, failed;
+		int max_depth;							/* Largest backlog seen */
+		char last_fname[PATH_MAX];			/* Last file written (for the dialog) */
+		BOOL last_failed;
+		struct {									/* Change-detection gate (see Autosave_Gate) */
+			AUTOSAVE_GATE parms;
+			unsigned char *ref, *work;		/* Preview of the last saved frame / candidate */
+			int nref, nalloc;					/* Samples in ref, allocated for each */
+			double t_saved;					/* camera_time of the last saved frame */
+			double last_metric;
+			volatile long skipped;
+			FILE *log;							/* Per-frame decisions (<template>_gate.csv) */
+		} gate;
 	} autosave;
 
 	/* Should we generate error reports */
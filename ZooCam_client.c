@@ -30,6 +30,7 @@
 
 /* Not loading windows.h, so need to define HWND and BOOL to avoid problems */
 #include "camera.h"					/* Generic camera information */
+#include "perf.h"						/* Stage latency statistics */
 
 #include "server_support.h"		/* Server support */
 #include "ZooCam.h"					/* Access to the ZooCam info */
@@ -45,6 +46,14 @@
 	#define	FALSE	(0)
 #endif
 
+/* Entry in the client frame cache */
+typedef struct _CACHE_ENTRY {
+	struct _CACHE_ENTRY *prev, *next;		/* Most recently used at head */
+	int imageID;
+	size_t length;
+	void *data;
+} CACHE_ENTRY;
+
 /* ------------------------------- */
 /* My external function prototypes */
 /* ------------------------------- */
@@ -53,6 +62,14 @@
 /* My internal function prototypes */
 /* ------------------------------- */
 static void cleanup(void);
+static int Attach_Shared_Ring(void);
+static int Fetch_Image_Data(int frame, void **image_data, size_t *length, int *imageID);
+static BOOL Cache_Lookup(int imageID, void **image_data, size_t *length);
+static void Cache_Insert(int imageID, void *data, size_t length);
+static void Cache_Trim(BOOL all);
+static void Cache_Init(void);
+static int roi_stream_exchange(ROI_STREAM_ACTION action, ROI_STREAM_DEF *def, char *name, int seq, char *path, int *nstreams, ROI_STREAM_INFO **streams);
+static int multi_camera_exchange(MULTI_CAMERA_ACTION action, int id, int nBuf, int *ncams, MULTI_CAMERA_INFO **cams);
 
 /* ------------------------------- */
 /* My usage of other external fncs */
@@ -65,6 +82,18 @@ static void cleanup(void);
 /* ------------------------------- */
 /* Locally defined global vars     */
 /* ------------------------------- */
+/* Frame cache ... most recently used at head */
+static struct {
+	FRAME_CACHE_POLICY policy;
+	size_t max_bytes;
+	int max_frames;
+	INIT_ONCE lock_once;								/* Guards InitializeCriticalSection(&lock) */
+	CRITICAL_SECTION lock;
+	CACHE_ENTRY *head, *tail;
+	size_t bytes;
+	int frames;
+	uint32_t hits, misses, evictions;
+} frame_cache = { CACHE_VALIDATE, ZOOCAM_CACHE_DFLT_BYTES, ZOOCAM_CACHE_DFLT_FRAMES, INIT_ONCE_STATIC_INIT };
 
 #ifdef LOCAL_CLIENT_TEST
 	
@@ -112,7 +141,7 @@ int main(int argc, char *argv[]) {
 	/* Test querying camera information */
 	if ( (rc = ZooCam_Get_Camera_Info(&info)) == 0) {
 		printf("Camera information\n");
-		printf("  Type: %s\n", info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : "unknown");
+		printf("  Type: %s\n", info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : info.type == CAMERA_SIM ? "SIM" : "unknown");
 		printf("  Name: %s\n", info.name);
 		printf("  Manufacturer: %s\n", info.manufacturer);
 		printf("  Model: %s\n", info.model);
@@ -185,7 +214,7 @@ int main(int argc, char *argv[]) {
 	for (i=0; i<18; i++) { ZooCam_Trigger(); Sleep(200); }		/* Collect an unusual number */
 	rc = ZooCam_Get_Image_Info(-1, &image_info);
 	printf("Last image info (rc=%d): %s frame=%d times: %lld / %.3f  w/h: %d/%d pitch: %d exposure: %f\n", rc, 
-			 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : "unknown",
+			 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : info.type == CAMERA_SIM ? "SIM" : "unknown",
 			 image_info.frame,
 			 image_info.timestamp, image_info.camera_time, 
 			 image_info.width, image_info.height, image_info.memory_pitch, image_info.exposure);	fflush(stdout);
@@ -193,7 +222,7 @@ int main(int argc, char *argv[]) {
 //		rc = ZooCam_Get_Image_Info(i, &image_info);
 //		printf("Image info %d: (rc=%d): %s frame=%d times: %lld / %.3f  w/h: %d/%d pitch: %d exposure: %f\n", 
 //				 i, rc,
-//				 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : "unknown",
+//				 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : info.type == CAMERA_SIM ? "SIM" : "unknown",
 //				 image_info.frame,
 //				 image_info.timestamp, image_info.camera_time, 
 //				 image_info.width, image_info.height, image_info.memory_pitch, image_info.exposure);	
@@ -208,7 +237,7 @@ int main(int argc, char *argv[]) {
 	rc = ZooCam_Get_Image_Info(-1, &image_info);
 	printf("image_info size: %d\n", sizeof(image_info));
 	printf("Last image info (rc=%d): %s frame=%d times: %lld / %.3f  w/h: %d/%d pitch: %d exposure: %f\n", rc, 
-			 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : "unknown",
+			 info.type == CAMERA_DCX ? "DCx" : info.type == CAMERA_TL ? "TL" : info.type == CAMERA_SIM ? "SIM" : "unknown",
 			 image_info.frame,
 			 image_info.timestamp, image_info.camera_time, 
 			 image_info.width, image_info.height, image_info.memory_pitch, image_info.exposure);	fflush(stdout);
@@ -229,6 +258,70 @@ int main(int argc, char *argv[]) {
 	fflush(stdout);
 #endif
 	
+	/* Test region (crop / bin) transfer */
+#if 0
+	{
+		REGION_REQUEST region;
+		REGION_INFO region_info;
+
+		memset(&region, 0, sizeof(region));
+		region.frame = -1; region.ulx = 100; region.uly = 100; region.width = 256; region.height = 256;
+		region.bin = 2; region.format = REGION_MONO8;
+		rc = ZooCam_Get_Image_Region(&region, &region_info, &image_data, &length);
+		printf("Region data (rc=%d): %dx%d at (%d,%d) bin=%d pitch=%d length=%d\n", rc, region_info.width, region_info.height, 
+				 region_info.ulx, region_info.uly, region_info.bin, region_info.pitch, length); fflush(stdout);
+		if (image_data != NULL) free(image_data);
+	}
+#endif
+	
+	/* Test remote statistics */
+#if 0
+	{
+		STATS_REQUEST stats_request;
+		IMAGE_STATS *image_stats;
+
+		memset(&stats_request, 0, sizeof(stats_request));
+		stats_request.frame = -1; stats_request.imageID = -1;
+		stats_request.flags = STATS_HISTOGRAM;
+		rc = ZooCam_Get_Stats(&stats_request, &image_stats);
+		if (rc == 0 && image_stats != NULL) {
+			printf("Stats (imageID=%d): %d bytes  centroid (%.2f,%.2f)  sigma (%.2f,%.2f)  sat %u/%u/%u  brenner %.1f\n", 
+					 image_stats->imageID, image_stats->total_bytes, image_stats->centroid_x, image_stats->centroid_y, 
+					 sqrt(image_stats->var_x), sqrt(image_stats->var_y), 
+					 image_stats->saturated[0], image_stats->saturated[1], image_stats->saturated[2], image_stats->brenner); fflush(stdout);
+			free(image_stats);
+		}
+	}
+#endif
+	
+	/* Test pipelined requests ... exposure, trigger and fetch overlapped on the wire */
+#if 0
+	{
+		CS_PENDING *pending[3];
+		EXPOSURE_PARMS set_parms;
+		REGION_REQUEST region;
+		void *reply_data;
+		int reply_rc;
+
+		memset(&set_parms, 0, sizeof(set_parms));
+		set_parms.exposure = 10.0;
+		memset(&region, 0, sizeof(region));
+		region.frame = -1; region.bin = 4; region.format = REGION_MONO8;
+
+		for (i=0; i<5; i++) {
+			ZooCam_Async_Request(ZOOCAM_SET_EXPOSURE_PARMS, MODIFY_EXPOSURE, &set_parms, sizeof(set_parms), NULL, NULL, &pending[0]);
+			ZooCam_Async_Request(ZOOCAM_TRIGGER, 0, NULL, 0, NULL, NULL, &pending[1]);
+			ZooCam_Async_Request(ZOOCAM_GET_IMAGE_REGION, 0, &region, sizeof(region), NULL, NULL, &pending[2]);
+			for (j=0; j<3; j++) {
+				rc = ZooCam_Async_Wait(pending[j], INFINITE, &reply_rc, &reply_data, &length);
+				printf("  pass %d request %d: rc=%d reply.rc=%d length=%d\n", i, j, rc, reply_rc, length); fflush(stdout);
+				if (reply_data != NULL) free(reply_data);
+			}
+			set_parms.exposure *= 2;
+		}
+	}
+#endif
+	
 	/* Test saving data to files */
 #if 0
 	printf("Save file (rc=%d)\n", ZooCam_Save_Frame(-1, "burst/test.png", FILE_DFLT)); fflush(stdout);
@@ -307,7 +400,7 @@ int main(int argc, char *argv[]) {
 -- Inputs: IP_address - IP address in normal form.  Use "127.0.0.1" for loopback test
 --                      if NULL, uses DFLT_SERVER_IP_ADDRESS
 --
--- Output: Creates MUTEX semaphores, opens socket, sets atexit() to ensure closure
+-- Output: Creates MUTEX semaphores, opens pipelined socket, sets atexit() to ensure closure
 --
 -- Return:  0 - successful
 --          1 - unable to create semaphores for controlling access to hardware
@@ -315,9 +408,12 @@ int main(int argc, char *argv[]) {
 --          3 - unable to query the server version
 --          4 - server / client version mismatch
 --
--- Notes: Must be called before any attempt to communicate across the socket
+-- Notes: (1) Must be called before any attempt to communicate across the socket
+--        (2) If the server is on this machine, also maps the shared frame
+--            ring so image data does not have to cross the socket
 =========================================================================== */
 static CLIENT_DATA_BLOCK *ZooCam_Remote = NULL;		/* Connection to the server */
+static SHM_RING *ZooCam_Shm = NULL;						/* Shared frame ring (same-host server only) */
 
 int Init_ZooCam_Client(char *IP_address) {
 	static char *rname = "Init_ZooCam_Client";
@@ -332,8 +428,13 @@ int Init_ZooCam_Client(char *IP_address) {
 
 	/* Shutdown sockets if already open (reinitialization allowed) */
 	if (ZooCam_Remote != NULL) { CloseServerConnection(ZooCam_Remote); ZooCam_Remote = NULL; }
+	if (ZooCam_Shm != NULL) { CloseSharedRing(ZooCam_Shm); ZooCam_Shm = NULL; }
 
-	if ( (ZooCam_Remote = ConnectToServer("ZooCam", IP_address, ZOOCAM_ACCESS_PORT, &rc)) == NULL) {
+	/* imageID's are only meaningful for one server session */
+	ZooCam_Cache_Config(CACHE_NOCHANGE, 0, 0);
+	ZooCam_Cache_Flush();
+
+	if ( (ZooCam_Remote = ConnectToServerPipelined("ZooCam", IP_address, ZOOCAM_ACCESS_PORT, &rc)) == NULL) {
 		fprintf(stderr, "ERROR[%s]: Failed to connect to the server\n", rname); fflush(stderr);
 		return -1;
 	}
@@ -347,11 +448,52 @@ int Init_ZooCam_Client(char *IP_address) {
 		return 4;
 	}
 
+	/* Same machine ... frames can come through shared memory (failure is not an error) */
+	if (IsServerLocal(ZooCam_Remote)) Attach_Shared_Ring();
+
 	/* Report success, and if not close everything that has been started */
-	fprintf(stderr, "INFO: Connected to ZooCam server on %s\n", IP_address); fflush(stderr);
+	fprintf(stderr, "INFO: Connected to ZooCam server on %s%s\n", IP_address, ZooCam_Shm != NULL ? " (shared memory frames)" : ""); fflush(stderr);
 	return 0;
 }
 
+/* ===========================================================================
+-- Ask a same-host server for its shared frame ring and map it
+--
+-- Usage: static int Attach_Shared_Ring(void);
+--
+-- Inputs: none
+--
+-- Output: Sets ZooCam_Shm if successful
+--
+-- Return: 0 if attached, otherwise rc from server or 5 if unable to map
+=========================================================================== */
+static int Attach_Shared_Ring(void) {
+	static char *rname = "Attach_Shared_Ring";
+
+	CS_MSG request, reply;
+	SHM_ATTACH_INFO *attach = NULL;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_SHM_ATTACH;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &attach);
+	if (rc != 0 || reply.msg != ZOOCAM_SHM_ATTACH) {
+		if (attach != NULL) free(attach);
+		return 5;
+	}
+
+	rc = reply.rc;
+	if (rc == 0 && attach != NULL && reply.data_len >= sizeof(*attach)) {
+		attach->name[sizeof(attach->name)-1] = '\0';
+		if ( (ZooCam_Shm = OpenSharedRing(attach->name)) == NULL) {
+			fprintf(stderr, "WARNING[%s]: Unable to map shared ring %s ... using socket for frames\n", rname, attach->name); fflush(stderr);
+			rc = 5;
+		}
+	}
+	if (attach != NULL) free(attach);
+	return rc;
+}
+
 /* ===========================================================================
 -- Routine to shutdown cleanly an open interface to ZooCam server
 --
@@ -373,9 +515,61 @@ int Shutdown_ZooCam_Client(void) {
 	/* Shutdown sockets and mark closed */
 	CloseServerConnection(ZooCam_Remote); 
 	ZooCam_Remote = NULL;
+	if (ZooCam_Shm != NULL) { CloseSharedRing(ZooCam_Shm); ZooCam_Shm = NULL; }
+	ZooCam_Cache_Flush();
+	return 0;
+}
+
+/* ===========================================================================
+--	Pipelined (asynchronous) requests to the server
+--
+--	Usage:  int ZooCam_Async_Request(int msg, int option, void *data, size_t length, 
+--                                  CS_CALLBACK callback, void *context, CS_PENDING **handle);
+--         int ZooCam_Async_Wait(CS_PENDING *handle, int msTimeout, int *rc, void **reply_data, size_t *length);
+--         int ZooCam_Async_Cancel(CS_PENDING *handle);
+--
+--	Notes: See ZooCam_client.h for details
+=========================================================================== */
+int ZooCam_Async_Request(int msg, int option, void *data, size_t length, CS_CALLBACK callback, void *context, CS_PENDING **handle) {
+	CS_MSG request;
+
+	memset(&request, 0, sizeof(request));
+	request.msg      = msg;
+	request.option   = option;
+	request.data_len = (data != NULL) ? (uint32_t) length : 0;
+	return SubmitServerRequest(ZooCam_Remote, request, data, callback, context, handle);
+}
+
+int ZooCam_Async_Wait(CS_PENDING *handle, int msTimeout, int *rc, void **reply_data, size_t *length) {
+	CS_MSG reply;
+	void *my_data;
+	int status;
+
+	if (rc != NULL) *rc = -1;
+	if (reply_data != NULL) *reply_data = NULL;
+	if (length != NULL) *length = 0;
+
+	if ( (status = WaitServerReply(handle, msTimeout, &reply, &my_data)) != 0) return status;
+
+	if (reply.msg == -1) {											/* Server could not get its semaphore */
+		if (my_data != NULL) free(my_data);
+		return 4;
+	}
+
+	if (rc != NULL) *rc = reply.rc;
+	if (reply_data != NULL) {
+		*reply_data = my_data;
+		if (length != NULL) *length = reply.data_len;
+	} else if (my_data != NULL) {
+		free(my_data);
+	}
 	return 0;
 }
 
+int ZooCam_Async_Cancel(CS_PENDING *handle) {
+	return AbandonServerRequest(handle);
+}
+
 /* ===========================================================================
 -- Quick routine to check for errors and print messages for TCP transaction
 --
@@ -531,15 +725,74 @@ int ZooCam_Get_Image_Info(int frame, IMAGE_INFO *info) {
 -- Return: 0 if successful, otherwise error code from call
 --           1 ==> no camera connected
 --           2 ==> frame invalid
+--
+-- Notes: (1) Uses the shared frame ring if attached (server on this machine)
+--        (2) Unless caching is off, a ZOOCAM_GET_IMAGE_INFO query identifies
+--            the image in the slot and a cached copy is returned if present
 =========================================================================== */
 int ZooCam_Get_Image_Data(int frame, void **image_data, size_t *length) {
+	IMAGE_INFO info;
+	size_t nbytes;
+	int rc, imageID, before;
+
+	/* Fill in default response (no data) */
+	if (image_data != NULL) *image_data = NULL;
+	if (length != NULL) *length = 0;
+
+	/* No caching ... just go get it */
+	if (frame_cache.policy == CACHE_OFF || image_data == NULL) return Fetch_Image_Data(frame, image_data, length, &imageID);
+
+	/* Cheap query tells us which image is in the slot now */
+	if ( (rc = ZooCam_Get_Image_Info(frame, &info)) != 0) return rc;
+	if (info.imageID >= 0 && Cache_Lookup(info.imageID, image_data, length)) return 0;
+
+	/* Miss ... fetch the resolved frame and make sure it is still the same image before keeping it */
+	before = info.imageID;
+	if ( (rc = Fetch_Image_Data(info.frame, image_data, &nbytes, &imageID)) != 0) return rc;
+	if (length != NULL) *length = nbytes;
+	if (imageID < 0 && ZooCam_Get_Image_Info(info.frame, &info) == 0) imageID = info.imageID;	/* Socket path doesn't say ... slot after the transfer */
+	if (before >= 0 && imageID == before) Cache_Insert(before, *image_data, nbytes);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Get a copy of the raw data for a frame (shared ring if attached, else socket)
+--
+-- Usage: static int Fetch_Image_Data(int frame, void **image_data, size_t *length, int *imageID);
+--
+-- Inputs: frame      - image frame (-1 ==> current)
+--         image_data - pointer to get malloc'd raw data (may be NULL)
+--         length     - pointer to get number of bytes in *data buffer (may be NULL)
+--         imageID    - pointer to get imageID of the data returned (-1 if not known)
+--
+-- Return: 0 if successful, otherwise error code from server
+=========================================================================== */
+static int Fetch_Image_Data(int frame, void **image_data, size_t *length, int *imageID) {
 	CS_MSG request, reply;
-	IMAGE_INFO *my_info = NULL;
+	SHM_FRAME shm;
+	void *shared;
 	int rc;
 
-	/* Fill in default response (no data) */
 	if (image_data != NULL) *image_data = NULL;
 	if (length != NULL) *length = 0;
+	*imageID = -1;
+
+	/* Same machine ... one copy straight out of the shared ring */
+	if (ZooCam_Shm != NULL && image_data != NULL) {
+		rc = ZooCam_Get_Image_Shared(frame, &shm, &shared);
+		if (rc == 0 && (*image_data = malloc(shm.length)) != NULL) {
+			memcpy(*image_data, shared, shm.length);
+			if (ZooCam_Shared_Valid(&shm)) {
+				if (length != NULL) *length = shm.length;
+				*imageID = shm.info.imageID;
+				return 0;
+			}
+			free(*image_data); *image_data = NULL;				/* Overwritten while copying ... use socket */
+		} else if (rc != 3 && rc != 5) {
+			return rc;
+		}
+	}
 
 	/* Fill in the request */
 	memset(&request, 0, sizeof(request));
@@ -556,6 +809,323 @@ int ZooCam_Get_Image_Data(int frame, void **image_data, size_t *length) {
 	return reply.rc;					/* 0 or failure error code */
 }
 
+/* ===========================================================================
+--	Client side cache of image data keyed by the server's imageID
+--
+--	Usage:  int ZooCam_Cache_Config(FRAME_CACHE_POLICY policy, size_t max_bytes, int max_frames);
+--         int ZooCam_Cache_Stats(FRAME_CACHE_STATS *stats, BOOL reset);
+--         int ZooCam_Cache_Flush(void);
+--
+--	Inputs: policy     - CACHE_OFF or CACHE_VALIDATE (or CACHE_NOCHANGE)
+--         max_bytes  - limit on memory held (0 ==> no change)
+--         max_frames - limit on frames held (0 ==> no change)
+--         stats      - structure to receive current statistics
+--         reset      - if TRUE, zero the hit / miss / eviction counters
+--
+--	Output: Least recently used frames are evicted to stay within limits
+--
+-- Return: 0 if successful
+=========================================================================== */
+static BOOL CALLBACK Cache_Init_Once(PINIT_ONCE once, PVOID parm, PVOID *context) {
+	InitializeCriticalSection(&frame_cache.lock);
+	return TRUE;
+}
+
+/* Create the lock exactly once, whichever thread gets here first */
+static void Cache_Init(void) {
+	InitOnceExecuteOnce(&frame_cache.lock_once, Cache_Init_Once, NULL, NULL);
+}
+
+static void Cache_Unlink(CACHE_ENTRY *entry) {
+	if (entry->prev != NULL) entry->prev->next = entry->next; else frame_cache.head = entry->next;
+	if (entry->next != NULL) entry->next->prev = entry->prev; else frame_cache.tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void Cache_Push(CACHE_ENTRY *entry) {
+	entry->prev = NULL;
+	entry->next = frame_cache.head;
+	if (frame_cache.head != NULL) frame_cache.head->prev = entry; else frame_cache.tail = entry;
+	frame_cache.head = entry;
+}
+
+/* Evict from the tail until within limits, or everything if all (called holding lock) */
+static void Cache_Trim(BOOL all) {
+	CACHE_ENTRY *entry;
+
+	while ( (entry = frame_cache.tail) != NULL && (all || frame_cache.bytes > frame_cache.max_bytes || frame_cache.frames > frame_cache.max_frames) ) {
+		Cache_Unlink(entry);
+		frame_cache.bytes -= entry->length;
+		frame_cache.frames--;
+		if (! all) frame_cache.evictions++;
+		free(entry->data); free(entry);
+	}
+}
+
+/* Return a malloc'd copy of a cached image, moving it to the front */
+static BOOL Cache_Lookup(int imageID, void **image_data, size_t *length) {
+	CACHE_ENTRY *entry;
+	void *copy = NULL;
+
+	Cache_Init();
+	EnterCriticalSection(&frame_cache.lock);
+	for (entry=frame_cache.head; entry!=NULL; entry=entry->next) if (entry->imageID == imageID) break;
+	if (entry != NULL && (copy = malloc(entry->length)) != NULL) {
+		memcpy(copy, entry->data, entry->length);
+		if (length != NULL) *length = entry->length;
+		Cache_Unlink(entry);
+		Cache_Push(entry);
+		frame_cache.hits++;
+	} else {
+		frame_cache.misses++;
+	}
+	LeaveCriticalSection(&frame_cache.lock);
+
+	*image_data = copy;
+	return copy != NULL;
+}
+
+/* Keep a copy of newly fetched data (unless another thread already has) */
+static void Cache_Insert(int imageID, void *data, size_t length) {
+	CACHE_ENTRY *entry, *have;
+
+	if (data == NULL || length == 0 || length > frame_cache.max_bytes) return;
+	if ( (entry = calloc(1, sizeof(*entry))) == NULL) return;
+	if ( (entry->data = malloc(length)) == NULL) { free(entry); return; }
+	memcpy(entry->data, data, length);
+	entry->imageID = imageID;
+	entry->length  = length;
+
+	Cache_Init();
+	EnterCriticalSection(&frame_cache.lock);
+	for (have=frame_cache.head; have!=NULL; have=have->next) if (have->imageID == imageID) break;
+	if (have != NULL) {										/* Concurrent miss on the same image */
+		Cache_Unlink(have);
+		Cache_Push(have);
+		LeaveCriticalSection(&frame_cache.lock);
+		free(entry->data); free(entry);
+		return;
+	}
+	Cache_Push(entry);
+	frame_cache.bytes += length;
+	frame_cache.frames++;
+	Cache_Trim(FALSE);
+	LeaveCriticalSection(&frame_cache.lock);
+	return;
+}
+
+int ZooCam_Cache_Config(FRAME_CACHE_POLICY policy, size_t max_bytes, int max_frames) {
+
+	Cache_Init();
+	EnterCriticalSection(&frame_cache.lock);
+	if (policy != CACHE_NOCHANGE) frame_cache.policy = policy;
+	if (max_bytes  > 0) frame_cache.max_bytes  = max_bytes;
+	if (max_frames > 0) frame_cache.max_frames = max_frames;
+	Cache_Trim(frame_cache.policy == CACHE_OFF);				/* Off releases everything */
+	LeaveCriticalSection(&frame_cache.lock);
+	return 0;
+}
+
+int ZooCam_Cache_Stats(FRAME_CACHE_STATS *stats, BOOL reset) {
+
+	Cache_Init();
+	EnterCriticalSection(&frame_cache.lock);
+	if (stats != NULL) {
+		stats->policy     = frame_cache.policy;
+		stats->max_bytes  = frame_cache.max_bytes;
+		stats->max_frames = frame_cache.max_frames;
+		stats->bytes      = frame_cache.bytes;
+		stats->frames     = frame_cache.frames;
+		stats->hits       = frame_cache.hits;
+		stats->misses     = frame_cache.misses;
+		stats->evictions  = frame_cache.evictions;
+	}
+	if (reset) frame_cache.hits = frame_cache.misses = frame_cache.evictions = 0;
+	LeaveCriticalSection(&frame_cache.lock);
+	return 0;
+}
+
+int ZooCam_Cache_Flush(void) {
+
+	Cache_Init();
+	EnterCriticalSection(&frame_cache.lock);
+	Cache_Trim(TRUE);
+	LeaveCriticalSection(&frame_cache.lock);
+	return 0;
+}
+
+/* ===========================================================================
+--	Routines to access image data in place (server on the same machine)
+--
+--	Usage:  int  ZooCam_Get_Image_Shared(int frame, SHM_FRAME *shm, void **image_data);
+--         BOOL ZooCam_Shared_Valid(SHM_FRAME *shm);
+--         BOOL ZooCam_Shared_Active(void);
+--
+--	Inputs: frame      - image frame (-1 ==> current)
+--         shm        - structure to receive image info, slot and sequence
+--         image_data - pointer to receive address of the data in the ring
+--		
+--	Output: *shm        - info on the image and where it was published
+--         *image_data - raw data in the shared ring (read-only, do NOT free)
+--
+-- Return: Get:    0 if successful, otherwise error code from call
+--                   1 ==> no camera connected
+--                   2 ==> frame invalid
+--                   3 ==> frame larger than the shared slots
+--                   5 ==> no shared memory ring (server remote or refused)
+--         Valid:  TRUE if the data at *image_data has not been overwritten
+--         Active: TRUE if the shared memory ring is attached
+=========================================================================== */
+int ZooCam_Get_Image_Shared(int frame, SHM_FRAME *shm, void **image_data) {
+	CS_MSG request, reply;
+	SHM_FRAME *my_shm = NULL;
+	void *data;
+	size_t length;
+	int rc;
+
+	/* Fill in default response (no data) */
+	if (shm != NULL) { memset(shm, 0, sizeof(*shm)); shm->slot = -1; }
+	if (image_data != NULL) *image_data = NULL;
+	if (ZooCam_Shm == NULL) return 5;
+
+	/* Fill in the request */
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_GET_IMAGE_SHM;
+	request.option = frame;
+
+	/* Get the response ... only a few bytes cross the socket */
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_shm);
+	if (Error_Check(rc, &reply, ZOOCAM_GET_IMAGE_SHM) != 0) return rc;
+	if (my_shm == NULL) return (reply.rc != 0) ? reply.rc : 5;
+
+	rc = reply.rc;
+	if (rc == 0) {
+		if ( (data = SharedRingAccess(ZooCam_Shm, my_shm->slot, my_shm->sequence, &length)) == NULL) {
+			rc = 2;														/* Already overwritten */
+		} else {
+			if (shm != NULL) *shm = *my_shm;
+			if (image_data != NULL) *image_data = data;
+		}
+	}
+	free(my_shm);
+	return rc;
+}
+
+BOOL ZooCam_Shared_Valid(SHM_FRAME *shm) {
+	return shm != NULL && ZooCam_Shm != NULL && SharedRingValid(ZooCam_Shm, shm->slot, shm->sequence);
+}
+
+BOOL ZooCam_Shared_Active(void) {
+	return ZooCam_Shm != NULL;
+}
+
+
+/* ===========================================================================
+--	Routine to return a cropped, binned and/or converted copy of an image
+--
+--	Usage:  int ZooCam_Get_Image_Region(REGION_REQUEST *request, REGION_INFO *info, void **image_data, size_t *length);
+--
+--	Inputs: request    - frame, window, binning and output format desired
+--         info       - pointer to structure to receive details of returned data
+--         image_data - pointer to get malloc'd pixel data (caller must free())
+--         length     - pointer to get number of bytes in *image_data buffer
+--		
+--	Output: *info       - actual window, size and format of the data
+--         *image_data - pixels, info->pitch bytes per row, info->height rows
+--         *length     - number of bytes in the buffer
+--
+-- Return: 0 if successful, otherwise error code from call
+--           1 ==> no camera connected
+--           2 ==> frame invalid
+--           3 ==> window lies outside the image or smaller than one bin
+--           4 ==> server unable to allocate memory
+=========================================================================== */
+int ZooCam_Get_Image_Region(REGION_REQUEST *region, REGION_INFO *info, void **image_data, size_t *length) {
+	CS_MSG request, reply;
+	unsigned char *my_data = NULL;
+	size_t nbytes;
+	int rc;
+
+	/* Fill in default response (no data) */
+	if (info       != NULL) memset(info, 0, sizeof(*info));
+	if (image_data != NULL) *image_data = NULL;
+	if (length     != NULL) *length = 0;
+	if (region == NULL) return -1;
+
+	/* Fill in the request */
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_GET_IMAGE_REGION;
+	request.option   = region->frame;
+	request.data_len = sizeof(*region);
+
+	/* Get the response */
+	rc = StandardServerExchange(ZooCam_Remote, request, region, &reply, (void **) &my_data);
+	if (Error_Check(rc, &reply, ZOOCAM_GET_IMAGE_REGION) != 0) return rc;
+
+	/* Split the header from the pixel data (if valid) */
+	if (my_data != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(REGION_INFO)) {
+			nbytes = reply.data_len - sizeof(REGION_INFO);
+			if (info != NULL) memcpy(info, my_data, sizeof(*info));
+			if (image_data != NULL && nbytes > 0 && (*image_data = malloc(nbytes)) != NULL) {
+				memcpy(*image_data, my_data+sizeof(REGION_INFO), nbytes);
+				if (length != NULL) *length = nbytes;
+			}
+		}
+		free(my_data);
+	}
+
+	return reply.rc;					/* 0 or failure error code */
+}
+
+
+/* ===========================================================================
+--	Routine to return statistics on an image computed by the server
+--
+--	Usage:  int ZooCam_Get_Stats(STATS_REQUEST *request, IMAGE_STATS **stats);
+--
+--	Inputs: request - image (frame or imageID), optional arrays, bins, threshold
+--         stats   - pointer to get malloc'd IMAGE_STATS block (caller must free())
+--		
+--	Output: *stats - scalar results followed by any requested arrays
+--
+-- Return: 0 if successful, otherwise error code from call
+--           1 ==> no camera connected
+--           2 ==> frame invalid or imageID no longer in the ring
+--           3 ==> statistics not supported for this image format
+--           4 ==> server unable to allocate memory
+=========================================================================== */
+int ZooCam_Get_Stats(STATS_REQUEST *parms, IMAGE_STATS **stats) {
+	CS_MSG request, reply;
+	IMAGE_STATS *my_stats = NULL;
+	int rc;
+
+	/* Fill in default response (no data) */
+	if (stats != NULL) *stats = NULL;
+	if (parms == NULL) return -1;
+
+	/* Fill in the request */
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_GET_STATS;
+	request.option   = parms->frame;
+	request.data_len = sizeof(*parms);
+
+	/* Get the response */
+	rc = StandardServerExchange(ZooCam_Remote, request, parms, &reply, (void **) &my_stats);
+	if (Error_Check(rc, &reply, ZOOCAM_GET_STATS) != 0) return rc;
+
+	/* Hand the block to the caller (if valid) */
+	if (my_stats != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(IMAGE_STATS) && stats != NULL) {
+			*stats = my_stats;
+		} else {
+			free(my_stats);
+		}
+	}
+
+	return reply.rc;					/* 0 or failure error code */
+}
+
 
 /* ===========================================================================
 --	Save a frame to specified filename in specified format
@@ -1192,6 +1762,835 @@ int ZooCam_LED_Set_State(int state) {
 	return reply.rc;
 }
 
+/* ===========================================================================
+--	Routine to set or query the server transaction log verbosity
+--
+--	Usage:  int ZooCam_Set_Log_Level(int level);
+--
+--	Inputs: level - 0 ==> errors only
+--                 1 ==> one line per request (default)
+--                 2 ==> verbose (per-command detail lines)
+--                 <0 ==> just query
+-- 
+--	Output: Changes the logging on the server immediately
+--
+-- Return: Returns -1 on client/server error
+--         Otherwise the previous level
+=========================================================================== */
+int ZooCam_Set_Log_Level(int level) {
+	CS_MSG request, reply;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	request.msg    = ZOOCAM_SET_LOG_LEVEL;
+	request.option = level;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, NULL);
+	if (Error_Check(rc, &reply, ZOOCAM_SET_LOG_LEVEL) != 0) return -1;
+
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routines for pre-trigger burst capture
+--
+--	Usage:  int ZooCam_Burst_Pretrigger(int npre, int npost, PRETRIGGER_PARMS *actual);
+--	        int ZooCam_Burst_Mark(void);
+--	        int ZooCam_Get_Segment_Info(SEGMENT_INFO *segment, SEGMENT_FRAME_INFO **frames);
+--	        int ZooCam_Get_Segment_Frame(int index, SEGMENT_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_Save_Segment(char *pattern);
+--
+--	Inputs: npre, npost - frames to keep before / after the trigger
+--                       (<0 ==> no change, both 0 ==> normal burst)
+--         actual      - if !NULL, receives the values now in effect
+--         segment     - receives the segment summary
+--         frames      - if !NULL, receives malloc'd array of nframes entries
+--         index       - frame in the segment (0 ... nframes-1)
+--         info        - if !NULL, receives the frame details
+--         image_data  - receives malloc'd copy of the frame data
+--         pattern     - root of name for files (<pattern>.csv, <pattern>_ddd.raw)
+-- 
+--	Output: With npre or npost > 0, DCxZooCam_Burst_Arm() starts recording
+--         at once.  The stripe start (or ZooCam_Burst_Mark()) freezes npre
+--         frames from before the event, the trigger frame, and npost after.
+--         DCxZooCam_Burst_Wait() returns once the segment is frozen.
+--
+-- Return: All return -1 on client/server error
+--         ZooCam_Burst_Pretrigger: 0 if successful, 2 if ring is too small for npre
+--         ZooCam_Burst_Mark:       0 if marked, 1 if not armed in pre-trigger mode
+--         ZooCam_Get_Segment_*:    0 if successful, 1 no segment, 2 bad index, 3 frame missing
+--         ZooCam_Save_Segment:     value from Burst_Save_Segment()
+=========================================================================== */
+int ZooCam_Burst_Pretrigger(int npre, int npost, PRETRIGGER_PARMS *actual) {
+	CS_MSG request, reply;
+	PRETRIGGER_PARMS parms, *my_actual = NULL;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_BURST_PRETRIGGER;
+	request.data_len = sizeof(parms);
+	parms.npre  = npre;
+	parms.npost = npost;
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, (void **) &my_actual);
+	if (Error_Check(rc, &reply, ZOOCAM_BURST_PRETRIGGER) != 0) return -1;
+
+	if (my_actual != NULL) {
+		if (actual != NULL && reply.data_len >= sizeof(*actual)) *actual = *my_actual;
+		free(my_actual);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Burst_Mark(void) {
+	CS_MSG request, reply;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_BURST_MARK;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, NULL);
+	if (Error_Check(rc, &reply, ZOOCAM_BURST_MARK) != 0) return -1;
+
+	return reply.rc;
+}
+
+int ZooCam_Get_Segment_Info(SEGMENT_INFO *segment, SEGMENT_FRAME_INFO **frames) {
+	CS_MSG request, reply;
+	SEGMENT_INFO *my_info = NULL;
+	size_t nbytes;
+	int rc;
+
+	if (frames != NULL) *frames = NULL;
+	if (segment == NULL) return -1;
+	memset(segment, 0, sizeof(*segment));
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_SEGMENT_INFO;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_SEGMENT_INFO) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(*my_info)) {
+			*segment = *my_info;
+			nbytes = segment->nframes*sizeof(**frames);
+			if (frames != NULL && reply.data_len >= sizeof(*my_info)+nbytes && (*frames = malloc(nbytes)) != NULL) {
+				memcpy(*frames, my_info+1, nbytes);
+			}
+		}
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Get_Segment_Frame(int index, SEGMENT_FRAME_INFO *info, void **image_data) {
+	CS_MSG request, reply;
+	SEGMENT_FRAME_INFO *my_frame = NULL;
+	int rc;
+
+	if (image_data != NULL) *image_data = NULL;
+
+	memset(&request, 0, sizeof(request));
+	request.msg    = ZOOCAM_SEGMENT_DATA;
+	request.option = index;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_frame);
+	if (Error_Check(rc, &reply, ZOOCAM_SEGMENT_DATA) != 0) return -1;
+
+	/* Split the reply into the info block and a separate copy of the pixels */
+	if (my_frame != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(*my_frame) && reply.data_len - sizeof(*my_frame) >= my_frame->length) {
+			if (info != NULL) *info = *my_frame;
+			if (image_data != NULL && (*image_data = malloc(my_frame->length)) != NULL) {
+				memcpy(*image_data, my_frame+1, my_frame->length);
+			}
+		}
+		free(my_frame);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Save_Segment(char *pattern) {
+	CS_MSG request, reply;
+	FILE_SAVE_PARMS parms;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_SEGMENT_SAVE;
+	request.data_len = sizeof(parms);
+	parms.format = FILE_RAW;
+	strcpy_s(parms.path, sizeof(parms.path), pattern);
+
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, NULL);
+	if (Error_Check(rc, &reply, ZOOCAM_SEGMENT_SAVE) != 0) return -1;
+
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to write burst frames to disk while the burst is running
+--
+--	Usage:  int ZooCam_Burst_Stream(int enable, char *pattern, FILE_FORMAT format, BURST_STREAM_INFO *info);
+--
+--	Inputs: enable  - 1 ==> stream the next bursts, 0 ==> normal burst, <0 ==> just query
+--         pattern - root of name for files (NULL ==> no change)
+--							  <pattern>.csv - logfile (same layout as ZooCam_Save_All)
+--                     <pattern>_ddd.bmp - individual images (or .raw)
+--         format  - FILE_BMP or FILE_RAW (FILE_DFLT ==> no change)
+--         info    - if !NULL, receives the mode and counts of the current / last burst
+-- 
+--	Output: While streaming, DCxZooCam_Burst_Status() only reports
+--         BURST_STATUS_COMPLETE once every frame and the .csv are written
+--         and closed, so the next stripe can be armed immediately (with a
+--         new pattern ... the pattern is captured at arm).
+--
+-- Return: Returns -1 on client/server error, otherwise 0
+=========================================================================== */
+int ZooCam_Burst_Stream(int enable, char *pattern, FILE_FORMAT format, BURST_STREAM_INFO *info) {
+	CS_MSG request, reply;
+	FILE_SAVE_PARMS parms;
+	BURST_STREAM_INFO *my_info = NULL;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg    = ZOOCAM_BURST_STREAM;
+	request.option = enable;
+	if (pattern != NULL) {
+		request.data_len = sizeof(parms);
+		parms.format = format;
+		strcpy_s(parms.path, sizeof(parms.path), pattern);
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (pattern != NULL) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_BURST_STREAM) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to start, stop or query HDR exposure bracketing
+--
+--	Usage:  int ZooCam_HDR_Bracket(HDR_BRACKET_PARMS *parms, HDR_BRACKET_INFO *info);
+--
+--	Inputs: parms - bracket to run (nexp > 0), stop (nexp = 0) or NULL to query
+--         info  - if !NULL, receives the bracket status and last merge details
+-- 
+--	Output: Merged frames are available as frame FRAME_HDR
+--
+-- Return: Returns -1 on client/server error, otherwise HDR_Bracket() code
+=========================================================================== */
+int ZooCam_HDR_Bracket(HDR_BRACKET_PARMS *parms, HDR_BRACKET_INFO *info) {
+	CS_MSG request, reply;
+	HDR_BRACKET_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_HDR_BRACKET;
+	if (parms != NULL && parms->nexp >= 0) request.data_len = sizeof(*parms);
+	rc = StandardServerExchange(ZooCam_Remote, request, (request.data_len != 0) ? parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_HDR_BRACKET) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to query the autosave queue (back-pressure) statistics
+--
+--	Usage:  int ZooCam_Autosave_Stats(BOOL reset, AUTOSAVE_INFO *info);
+--
+--	Inputs: reset - TRUE to zero the counts after reading them
+--         info  - receives the queue statistics
+-- 
+--	Output: *info
+--
+-- Return: Returns -1 on client/server error, otherwise 0
+=========================================================================== */
+int ZooCam_Autosave_Stats(BOOL reset, AUTOSAVE_INFO *info) {
+	CS_MSG request, reply;
+	AUTOSAVE_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	request.msg    = ZOOCAM_AUTOSAVE_STATS;
+	request.option = reset ? 1 : 0 ;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_AUTOSAVE_STATS) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to set or query the autosave change-detection gate
+--
+--	Usage:  int ZooCam_Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current);
+--
+--	Inputs: set     - new settings (NULL ==> just query)
+--         current - if !NULL, receives the settings in effect
+-- 
+--	Output: *current
+--
+-- Return: Returns -1 on client/server error, otherwise Autosave_Gate() code
+=========================================================================== */
+int ZooCam_Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current) {
+	CS_MSG request, reply;
+	AUTOSAVE_GATE *my_gate = NULL;
+	int rc;
+
+	if (current != NULL) memset(current, 0, sizeof(*current));
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_AUTOSAVE_GATE;
+	if (set != NULL) request.data_len = sizeof(*set);
+	rc = StandardServerExchange(ZooCam_Remote, request, set, &reply, (void **) &my_gate);
+	if (Error_Check(rc, &reply, ZOOCAM_AUTOSAVE_GATE) != 0) return -1;
+
+	if (my_gate != NULL) {
+		if (current != NULL && reply.data_len >= sizeof(*current)) *current = *my_gate;
+		free(my_gate);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to run the frame accumulator (averaging / variance)
+--
+--	Usage:  int ZooCam_Accumulate(int mode, int nframes, ACCUM_INFO *info);
+--
+--	Inputs: mode    - ACCUM_COUNT, ACCUM_SLIDING, ACCUM_STOP or <0 to query
+--         nframes - frames to sum / window size
+--         info    - if !NULL, receives the accumulator status
+-- 
+--	Output: Results are frames FRAME_MEAN and FRAME_VARIANCE
+--
+-- Return: Returns -1 on client/server error, otherwise Accum_Start() code
+=========================================================================== */
+int ZooCam_Accumulate(int mode, int nframes, ACCUM_INFO *info) {
+	CS_MSG request, reply;
+	ACCUM_PARMS parms;
+	ACCUM_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_ACCUMULATE;
+	if (mode >= 0) {
+		request.data_len = sizeof(parms);
+		parms.mode    = mode;
+		parms.nframes = nframes;
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (mode >= 0) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_ACCUMULATE) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routines for dark / bias / flat calibration
+--
+--	Usage:  int ZooCam_Calibrate(CALIB_ACTION action, int value, char *path, CALIB_INFO *info);
+--	        int ZooCam_Calib_Build(CALIB_KIND kind, int nframes, int msTimeout, CALIB_INFO *info);
+--
+--	Inputs: see ZooCam_client.h
+-- 
+--	Output: *info
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Calibrate(CALIB_ACTION action, int value, char *path, CALIB_INFO *info) {
+	CS_MSG request, reply;
+	CALIB_PARMS parms;
+	CALIB_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_CALIBRATE;
+	if (action != CALIB_QUERY) {
+		request.data_len = sizeof(parms);
+		parms.action = action;
+		parms.value  = value;
+		if (path != NULL) strcpy_s(parms.path, sizeof(parms.path), path);
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (action != CALIB_QUERY) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_CALIBRATE) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Calib_Build(CALIB_KIND kind, int nframes, int msTimeout, CALIB_INFO *info) {
+	ACCUM_INFO accum;
+	int rc, ms;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if ( (rc = ZooCam_Accumulate(ACCUM_COUNT, nframes, &accum)) != 0) return rc;
+
+	for (ms=0; ! accum.complete; ms+=50) {
+		if (ms > msTimeout) return -2;
+		Sleep(50);
+		if (ZooCam_Accumulate(-1, 0, &accum) < 0) return -1;
+	}
+	return ZooCam_Calibrate(CALIB_CAPTURE, kind, NULL, info);
+}
+
+/* ===========================================================================
+--	Routine for the hot / dead pixel map
+--
+--	Usage:  int ZooCam_Defects(DEFECT_ACTION action, int value, double threshold, char *path, DEFECT_INFO *info);
+--
+--	Inputs: see ZooCam_client.h
+-- 
+--	Output: *info
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Defects(DEFECT_ACTION action, int value, double threshold, char *path, DEFECT_INFO *info) {
+	CS_MSG request, reply;
+	DEFECT_PARMS parms;
+	DEFECT_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_DEFECTS;
+	if (action != DEFECT_QUERY) {
+		request.data_len = sizeof(parms);
+		parms.action    = action;
+		parms.value     = value;
+		parms.threshold = threshold;
+		if (path != NULL) strcpy_s(parms.path, sizeof(parms.path), path);
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (action != DEFECT_QUERY) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_DEFECTS) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routines for multi-ROI extraction streams
+--
+--	Usage:  int ZooCam_ROI_Add(ROI_STREAM_DEF *def);
+--	        int ZooCam_ROI_Remove(char *name);
+--	        int ZooCam_ROI_List(int *nstreams, ROI_STREAM_INFO **streams);
+--	        int ZooCam_ROI_Get_Frame(char *name, int seq, int msTimeout, ROI_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_ROI_Save(char *name, int seq, char *path);
+--
+--	Inputs: see ZooCam_client.h
+-- 
+--	Output: *nstreams, *streams, *info, *image_data
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+static int roi_stream_exchange(ROI_STREAM_ACTION action, ROI_STREAM_DEF *def, char *name, int seq, char *path, int *nstreams, ROI_STREAM_INFO **streams) {
+	CS_MSG request, reply;
+	ROI_STREAM_PARMS parms;
+	ROI_STREAM_INFO *my_info = NULL;
+	int rc;
+
+	if (nstreams != NULL) *nstreams = 0;
+	if (streams  != NULL) *streams  = NULL;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_ROI_STREAM;
+	if (action != ROI_LIST) {
+		request.data_len = sizeof(parms);
+		parms.action = action;
+		parms.seq    = seq;
+		if (def  != NULL) parms.def = *def;
+		if (name != NULL) strcpy_s(parms.def.name, sizeof(parms.def.name), name);
+		if (path != NULL) strcpy_s(parms.path, sizeof(parms.path), path);
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (action != ROI_LIST) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_ROI_STREAM) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (nstreams != NULL) *nstreams = reply.data_len / sizeof(*my_info);
+		if (streams != NULL && reply.data_len >= sizeof(*my_info)) {
+			*streams = my_info;							/* Caller frees */
+			my_info = NULL;
+		}
+		if (my_info != NULL) free(my_info);
+	}
+	return reply.rc;
+}
+
+int ZooCam_ROI_Add(ROI_STREAM_DEF *def) {
+	if (def == NULL) return -1;
+	return roi_stream_exchange(ROI_ADD, def, NULL, 0, NULL, NULL, NULL);
+}
+
+int ZooCam_ROI_Remove(char *name) {
+	return roi_stream_exchange(ROI_REMOVE, NULL, (name != NULL) ? name : "", 0, NULL, NULL, NULL);
+}
+
+int ZooCam_ROI_List(int *nstreams, ROI_STREAM_INFO **streams) {
+	return roi_stream_exchange(ROI_LIST, NULL, NULL, 0, NULL, nstreams, streams);
+}
+
+int ZooCam_ROI_Save(char *name, int seq, char *path) {
+	if (name == NULL || path == NULL) return -1;
+	return roi_stream_exchange(ROI_SAVE, NULL, name, seq, path, NULL, NULL);
+}
+
+int ZooCam_ROI_Get_Frame(char *name, int seq, int msTimeout, ROI_FRAME_INFO *info, void **image_data) {
+	CS_MSG request, reply;
+	ROI_FRAME_PARMS parms;
+	ROI_FRAME_INFO *my_frame = NULL;
+	int rc;
+
+	if (info       != NULL) memset(info, 0, sizeof(*info));
+	if (image_data != NULL) *image_data = NULL;
+	if (name == NULL) return -1;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_ROI_FRAME;
+	request.data_len = sizeof(parms);
+	strcpy_s(parms.name, sizeof(parms.name), name);
+	parms.seq       = seq;
+	parms.msTimeout = msTimeout;
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, (void **) &my_frame);
+	if (Error_Check(rc, &reply, ZOOCAM_ROI_FRAME) != 0) return -1;
+
+	/* Split the reply into the info block and a separate copy of the pixels */
+	if (my_frame != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(*my_frame) && reply.data_len - sizeof(*my_frame) >= my_frame->length) {
+			if (info != NULL) *info = *my_frame;
+			if (image_data != NULL && (*image_data = malloc(my_frame->length)) != NULL) {
+				memcpy(*image_data, my_frame+1, my_frame->length);
+			}
+		}
+		free(my_frame);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to set or query the image binning
+--
+--	Usage:  int ZooCam_Set_Binning(int bin, BOOL bSoftware, BINNING_INFO *info);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise Camera_SetBinning() code
+=========================================================================== */
+int ZooCam_Set_Binning(int bin, BOOL bSoftware, BINNING_INFO *info) {
+	CS_MSG request, reply;
+	BINNING_PARMS parms;
+	BINNING_INFO *my_info = NULL;
+	int rc;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_SET_BINNING;
+	request.data_len = sizeof(parms);
+	parms.bin       = bin;
+	parms.bSoftware = bSoftware;
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_SET_BINNING) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routines for concurrent capture on several TL cameras
+--
+--	Usage:  int ZooCam_Multi_List(int *ncams, MULTI_CAMERA_INFO **cams);
+--	        int ZooCam_Multi_Start(int id, int nBuf);
+--	        int ZooCam_Multi_Stop(int id);
+--	        int ZooCam_Multi_Get_Image(int id, int frame, MULTI_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_Multi_Align(int ref, int *n, MULTI_ALIGN_INFO **align);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+static int multi_camera_exchange(MULTI_CAMERA_ACTION action, int id, int nBuf, int *ncams, MULTI_CAMERA_INFO **cams) {
+	CS_MSG request, reply;
+	MULTI_CAMERA_PARMS parms;
+	MULTI_CAMERA_INFO *my_info = NULL;
+	int rc;
+
+	if (ncams != NULL) *ncams = 0;
+	if (cams  != NULL) *cams  = NULL;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_MULTI_CAMERA;
+	if (action != MULTI_LIST) {
+		request.data_len = sizeof(parms);
+		parms.action = action;
+		parms.id     = id;
+		parms.nBuf   = nBuf;
+	}
+	rc = StandardServerExchange(ZooCam_Remote, request, (action != MULTI_LIST) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_MULTI_CAMERA) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (ncams != NULL) *ncams = reply.data_len / sizeof(*my_info);
+		if (cams != NULL && reply.data_len >= sizeof(*my_info)) {
+			*cams = my_info;								/* Caller frees */
+			my_info = NULL;
+		}
+		if (my_info != NULL) free(my_info);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Multi_List(int *ncams, MULTI_CAMERA_INFO **cams) {
+	return multi_camera_exchange(MULTI_LIST, 0, 0, ncams, cams);
+}
+
+int ZooCam_Multi_Start(int id, int nBuf) {
+	return multi_camera_exchange(MULTI_START, id, nBuf, NULL, NULL);
+}
+
+int ZooCam_Multi_Stop(int id) {
+	return multi_camera_exchange(MULTI_STOP, id, 0, NULL, NULL);
+}
+
+int ZooCam_Multi_Get_Image(int id, int frame, MULTI_FRAME_INFO *info, void **image_data) {
+	CS_MSG request, reply;
+	MULTI_IMAGE_PARMS parms;
+	MULTI_FRAME_INFO *my_frame = NULL;
+	int rc;
+
+	if (info       != NULL) memset(info, 0, sizeof(*info));
+	if (image_data != NULL) *image_data = NULL;
+
+	memset(&request, 0, sizeof(request));
+	memset(&parms, 0, sizeof(parms));
+	request.msg = ZOOCAM_MULTI_IMAGE;
+	request.data_len = sizeof(parms);
+	parms.id    = id;
+	parms.frame = frame;
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, (void **) &my_frame);
+	if (Error_Check(rc, &reply, ZOOCAM_MULTI_IMAGE) != 0) return -1;
+
+	/* Split the reply into the info block and a separate copy of the pixels */
+	if (my_frame != NULL) {
+		if (reply.rc == 0 && reply.data_len >= sizeof(*my_frame) && reply.data_len - sizeof(*my_frame) >= my_frame->length) {
+			if (info != NULL) *info = *my_frame;
+			if (image_data != NULL && (*image_data = malloc(my_frame->length)) != NULL) {
+				memcpy(*image_data, my_frame+1, my_frame->length);
+			}
+		}
+		free(my_frame);
+	}
+	return reply.rc;
+}
+
+int ZooCam_Multi_Align(int ref, int *n, MULTI_ALIGN_INFO **align) {
+	CS_MSG request, reply;
+	MULTI_ALIGN_INFO *my_align = NULL;
+	int rc;
+
+	if (n     != NULL) *n     = 0;
+	if (align != NULL) *align = NULL;
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_MULTI_ALIGN;
+	request.option = ref;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_align);
+	if (Error_Check(rc, &reply, ZOOCAM_MULTI_ALIGN) != 0) return -1;
+
+	if (my_align != NULL) {
+		if (n != NULL) *n = reply.data_len / sizeof(*my_align);
+		if (align != NULL && reply.data_len >= sizeof(*my_align)) {
+			*align = my_align;								/* Caller frees */
+			my_align = NULL;
+		}
+		if (my_align != NULL) free(my_align);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to query the cached camera properties, optionally waiting for a change
+--
+--	Usage:  int ZooCam_Get_Properties(int version, CAMERA_PROPS *props);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Get_Properties(int version, CAMERA_PROPS *props) {
+	CS_MSG request, reply;
+	CAMERA_PROPS *my_props = NULL;
+	int rc;
+
+	if (props != NULL) memset(props, 0, sizeof(*props));
+
+	memset(&request, 0, sizeof(request));
+	request.msg = ZOOCAM_GET_PROPERTIES;
+	request.option = version;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_props);
+	if (Error_Check(rc, &reply, ZOOCAM_GET_PROPERTIES) != 0) return -1;
+
+	if (my_props != NULL) {
+		if (props != NULL && reply.data_len >= sizeof(*my_props)) *props = *my_props;
+		free(my_props);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to change several capture settings at once between two frames
+--
+--	Usage:  int ZooCam_Apply_Settings(CAMERA_SETTINGS *settings, int msWait);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Apply_Settings(CAMERA_SETTINGS *settings, int msWait) {
+	CS_MSG request, reply;
+	CAMERA_SETTINGS parms, *my_settings = NULL;
+	int rc;
+
+	memset(&parms, 0, sizeof(parms));
+	if (settings != NULL) parms = *settings;
+
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_APPLY_SETTINGS;
+	request.option   = msWait;
+	request.data_len = sizeof(parms);
+	rc = StandardServerExchange(ZooCam_Remote, request, &parms, &reply, (void **) &my_settings);
+	if (Error_Check(rc, &reply, ZOOCAM_APPLY_SETTINGS) != 0) return -1;
+
+	if (my_settings != NULL) {
+		if (settings != NULL && reply.data_len >= sizeof(*my_settings)) *settings = *my_settings;
+		free(my_settings);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to query the frame pipeline instrumentation
+--
+--	Usage:  int ZooCam_Get_Perf_Stats(PERF_STATS *stats, BOOL reset);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Get_Perf_Stats(PERF_STATS *stats, BOOL reset) {
+	CS_MSG request, reply;
+	PERF_STATS *my_stats = NULL;
+	int rc;
+
+	memset(&request, 0, sizeof(request));
+	request.msg    = ZOOCAM_GET_PERF_STATS;
+	request.option = reset ? 1 : 0 ;
+	rc = StandardServerExchange(ZooCam_Remote, request, NULL, &reply, (void **) &my_stats);
+	if (Error_Check(rc, &reply, ZOOCAM_GET_PERF_STATS) != 0) return -1;
+
+	if (my_stats != NULL) {
+		if (stats != NULL && reply.data_len >= sizeof(*my_stats)) *stats = *my_stats;
+		free(my_stats);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to control the frame pipeline event trace
+--
+--	Usage:  int ZooCam_Trace(int action, char *path, PERF_TRACE_INFO *info);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Trace(int action, char *path, PERF_TRACE_INFO *info) {
+	CS_MSG request, reply;
+	FILE_SAVE_PARMS parms;
+	PERF_TRACE_INFO *my_info = NULL;
+	int rc;
+
+	memset(&parms, 0, sizeof(parms));
+	if (path != NULL) strcpy_s(parms.path, sizeof(parms.path), path);
+
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_TRACE;
+	request.option   = action;
+	request.data_len = (action == ZOOCAM_TRACE_DUMP) ? sizeof(parms) : 0 ;
+	rc = StandardServerExchange(ZooCam_Remote, request, (action == ZOOCAM_TRACE_DUMP) ? &parms : NULL, &reply, (void **) &my_info);
+	if (Error_Check(rc, &reply, ZOOCAM_TRACE) != 0) return -1;
+
+	if (my_info != NULL) {
+		if (info != NULL && reply.data_len >= sizeof(*my_info)) *info = *my_info;
+		free(my_info);
+	}
+	return reply.rc;
+}
+
+/* ===========================================================================
+--	Routine to set or query the synthetic camera
+--
+--	Usage:  int ZooCam_Sim_Config(SIM_CONFIG *config, BOOL set);
+--
+--	Inputs: see ZooCam_client.h
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+=========================================================================== */
+int ZooCam_Sim_Config(SIM_CONFIG *config, BOOL set) {
+	CS_MSG request, reply;
+	SIM_CONFIG *my_config = NULL;
+	int rc;
+
+	if (config == NULL) set = FALSE;
+
+	memset(&request, 0, sizeof(request));
+	request.msg      = ZOOCAM_SIM_CONFIG;
+	request.option   = set ? 1 : 0 ;
+	request.data_len = set ? sizeof(*config) : 0 ;
+	rc = StandardServerExchange(ZooCam_Remote, request, set ? config : NULL, &reply, (void **) &my_config);
+	if (Error_Check(rc, &reply, ZOOCAM_SIM_CONFIG) != 0) return -1;
+
+	if (my_config != NULL) {
+		if (config != NULL && reply.data_len >= sizeof(*my_config)) *config = *my_config;
+		free(my_config);
+	}
+	return reply.rc;
+}
+
 /* ===========================================================================
 --	Routines to set and query the live video state
 --
@@ -1229,6 +2628,7 @@ static void cleanup(void) {
 	static char *rname = "cleanup";
 
 	if (ZooCam_Remote != NULL) { CloseServerConnection(ZooCam_Remote); ZooCam_Remote = NULL; }
+	if (ZooCam_Shm != NULL) { CloseSharedRing(ZooCam_Shm); ZooCam_Shm = NULL; }
 	ShutdownSockets();
 	fprintf(stderr, "Performed socket shutdown activities\n"); fflush(stderr);
 
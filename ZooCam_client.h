@@ -7,7 +7,7 @@
 -- would BREAK EXISTING COMPILATIONS.  Version is checked by the client
 -- open routine, so as long as this changes, don't expect problems.
 =========================================================================== */
-#define	ZOOCAM_CLIENT_SERVER_VERSION	(2001)	/* v.2 with generic camera support */
+#define	ZOOCAM_CLIENT_SERVER_VERSION	(2002)	/* v.2 with generic camera support, imageID in IMAGE_INFO */
 
 /* =============================
 -- Port that the server runs
@@ -49,6 +49,48 @@
 
 #define ZOOCAM_LED_SET_STATE		 (22)		/* Set LED current supply either on or off (or query) */
 
+#define ZOOCAM_GET_IMAGE_REGION	 (23)		/* Return cropped / binned / converted data for a frame */
+#define ZOOCAM_GET_STATS			 (24)		/* Return histograms, moments, profiles, focus for a frame */
+#define ZOOCAM_SET_LOG_LEVEL		 (25)		/* Set server transaction log verbosity (<0 ==> query) */
+
+#define ZOOCAM_SHM_ATTACH			 (26)		/* Same-host clients: name and size of shared frame ring */
+#define ZOOCAM_GET_IMAGE_SHM		 (27)		/* Publish a frame into the shared ring, return where */
+
+/* Pre-trigger burst capture (see Burst_Set_Pretrigger()) */
+#define ZOOCAM_BURST_PRETRIGGER	 (28)		/* Set / query frames kept before and after the trigger */
+#define ZOOCAM_BURST_MARK			 (29)		/* Trigger an armed pre-trigger burst now (software marker) */
+#define ZOOCAM_SEGMENT_INFO		 (30)		/* Return SEGMENT_INFO and frame details of the last segment */
+#define ZOOCAM_SEGMENT_DATA		 (31)		/* Return image data for one frame of the segment (request.option) */
+#define ZOOCAM_SEGMENT_SAVE		 (32)		/* Save the segment to disk (FILE_SAVE_PARMS path is the pattern) */
+
+#define ZOOCAM_BURST_STREAM		 (33)		/* Write burst frames while running (option = enable, <0 ==> query) */
+
+#define ZOOCAM_HDR_BRACKET		 (34)		/* Start/stop/query exposure bracketing (optional HDR_BRACKET_PARMS) */
+#define ZOOCAM_AUTOSAVE_STATS	 (35)		/* Autosave queue counts (AUTOSAVE_INFO), option = 1 ==> reset after */
+#define ZOOCAM_ACCUMULATE		 (36)		/* Start/stop/query the frame accumulator (optional ACCUM_PARMS) */
+#define ZOOCAM_CALIBRATE			 (37)		/* Dark/bias/flat calibration actions (optional CALIB_PARMS) */
+#define ZOOCAM_DEFECTS			 (38)		/* Hot/dead pixel map actions (optional DEFECT_PARMS) */
+#define ZOOCAM_AUTOSAVE_GATE		 (39)		/* Set/query the autosave change gate (optional AUTOSAVE_GATE) */
+#define ZOOCAM_ROI_STREAM		 (40)		/* Add/remove/save multi-ROI streams (optional ROI_STREAM_PARMS) */
+#define ZOOCAM_ROI_FRAME			 (41)		/* Return one frame of an ROI stream (ROI_FRAME_PARMS) */
+#define ZOOCAM_SET_BINNING		 (42)		/* Set/query binning (optional BINNING_PARMS), returns BINNING_INFO */
+#define ZOOCAM_MULTI_CAMERA		 (43)		/* List/start/stop concurrent TL captures (optional MULTI_CAMERA_PARMS) */
+#define ZOOCAM_MULTI_IMAGE		 (44)		/* Return one frame from a camera's ring (MULTI_IMAGE_PARMS) */
+#define ZOOCAM_MULTI_ALIGN		 (45)		/* Cross-camera timestamp alignment (option = reference camera, -1 ==> main) */
+#define ZOOCAM_GET_PROPERTIES	 (46)		/* Cached CAMERA_PROPS (option = version held, waits for a newer one) */
+#define ZOOCAM_APPLY_SETTINGS	 (47)		/* Apply CAMERA_SETTINGS as one batch between frames (option = ms wait) */
+#define ZOOCAM_GET_PERF_STATS	 (48)		/* Stage latency histograms and counters, PERF_STATS (option = 1 ==> reset after) */
+#define ZOOCAM_TRACE				 (49)		/* Pipeline event trace (option = ZOOCAM_TRACE_*), returns PERF_TRACE_INFO */
+#define ZOOCAM_SIM_CONFIG		 (50)		/* Set/query the synthetic camera (option = 1 ==> set from SIM_CONFIG) */
+
+#define	ZOOCAM_PROPERTY_WAIT		(1000)	/* ms ZOOCAM_GET_PROPERTIES waits for a new version */
+#define	ZOOCAM_ROI_FRAME_WAIT	(1000)	/* Longest ms ZOOCAM_ROI_FRAME waits (msTimeout capped) */
+
+/* Actions for ZOOCAM_TRACE (any other value just queries) */
+#define	ZOOCAM_TRACE_STOP			(0)
+#define	ZOOCAM_TRACE_START		(1)		/* Clears events from any earlier trace */
+#define	ZOOCAM_TRACE_DUMP			(2)		/* Write Chrome trace JSON on the server (FILE_SAVE_PARMS path) */
+
 /* Structure for saving single frame or all frames */
 #pragma pack(4)
 typedef struct _FILE_SAVE_PARMS {
@@ -58,6 +100,232 @@ typedef struct _FILE_SAVE_PARMS {
 } FILE_SAVE_PARMS;
 #pragma pack()
 
+/* Structures for requesting a cropped / binned subset of an image */
+/* Reply data is a REGION_INFO structure immediately followed by the pixels */
+typedef enum _REGION_FORMAT { REGION_RAW16=0, REGION_MONO8=1, REGION_RGB24=2 } REGION_FORMAT;
+
+#pragma pack(4)
+typedef struct _REGION_REQUEST {
+	int frame;										/* Frame number or -1 for current */
+	int ulx, uly;									/* Upper left corner of window (sensor pixels) */
+	int width, height;							/* Window size (<= 0 ==> extend to edge of image) */
+	int bin;											/* Binning / stride factor (1 = full resolution) */
+	BOOL bDecimate;								/* TRUE ==> every bin'th pixel, FALSE ==> average bin x bin */
+	REGION_FORMAT format;						/* Output format (raw16, 8-bit mono, RGB24) */
+} REGION_REQUEST;
+
+typedef struct _REGION_INFO {
+	int frame;										/* Frame actually returned */
+	int ulx, uly;									/* Window after clipping (even for Bayer sensors) */
+	int src_width, src_height;					/* Window size in sensor pixels */
+	int width, height;							/* Size of the returned image in pixels */
+	int bin;											/* Binning / stride factor used */
+	BOOL bDecimate;								/* TRUE if decimated rather than averaged */
+	REGION_FORMAT format;						/* Format of the returned pixels */
+	BOOL bBayer;									/* REGION_RAW16 data is a G R / B G Bayer mosaic */
+	int bytes_per_pixel;							/* 1 (mono8), 2 (raw16) or 3 (RGB24) */
+	int bit_depth;									/* Significant bits in each sample */
+	int pitch;										/* Bytes per row in the returned data (no padding) */
+	__time64_t timestamp;						/* Standard UNIX time of image capture */
+	double camera_time;							/* Time of capture from camera clock (seconds) */
+} REGION_INFO;
+#pragma pack()
+
+/* Structures for remote statistics on an image (computed on the server) */
+/* Reply data is an IMAGE_STATS structure followed by the optional arrays */
+#define	STATS_HISTOGRAM		(0x01)			/* Include per-channel histograms (uint32_t) */
+#define	STATS_PROFILES			(0x02)			/* Include column and row sums (float) */
+#define	STATS_MAX_HIST_BINS	(4096)			/* Maximum histogram bins per channel */
+
+#pragma pack(4)
+typedef struct _STATS_REQUEST {
+	int frame;										/* Frame number or -1 for current (used if imageID < 0) */
+	int imageID;									/* Specific image, or -1 to use frame */
+	int flags;										/* OR'd STATS_HISTOGRAM, STATS_PROFILES */
+	int hist_bins;									/* Bins per channel (0 ==> full depth up to STATS_MAX_HIST_BINS) */
+	int threshold;									/* Only intensity above this counts for centroid / moments */
+} STATS_REQUEST;
+
+typedef struct _IMAGE_STATS {
+	int frame;										/* Frame in the ring */
+	int imageID;									/* Unique ID of the image */
+	__time64_t timestamp;						/* Standard UNIX time of image capture */
+	double camera_time;							/* Time of capture from camera clock (seconds) */
+	int width, height;							/* Image size in pixels */
+	int bit_depth;									/* Significant bits in each sample */
+	int nchannels;									/* 1 for monochrome, 3 for color (R,G,B order) */
+	int max_value;									/* Saturation value (2^bit_depth - 1) */
+	uint32_t npixels[3];							/* Number of pixels in each channel */
+	uint32_t saturated[3];						/* Number of pixels at max_value in each channel */
+	int vmin[3], vmax[3];						/* Minimum and maximum of each channel */
+	double mean[3];								/* Mean of each channel */
+	int threshold;									/* Threshold used for centroid / moments */
+	double total;									/* Sum of (intensity - threshold) above threshold */
+	double centroid_x, centroid_y;			/* Intensity weighted centroid (pixels) */
+	double var_x, var_y, cov_xy;				/* Second central moments (pixels^2) */
+	double brenner;								/* Focus: mean squared like-color gradient */
+	int max_gradient;								/* Focus: largest like-color difference */
+	int flags;										/* Which optional arrays follow */
+	int hist_bins, hist_shift;					/* Bin i counts values [i<<shift, (i+1)<<shift) */
+	uint32_t hist_offset;						/* Byte offset of nchannels*hist_bins uint32_t (0 if none) */
+	uint32_t col_offset;							/* Byte offset of width float column sums (0 if none) */
+	uint32_t row_offset;							/* Byte offset of height float row sums (0 if none) */
+	uint32_t total_bytes;						/* Size of the structure plus all arrays */
+} IMAGE_STATS;
+#pragma pack()
+
+/* Structures for the same-host shared memory frame ring */
+#define	ZOOCAM_SHM_SLOTS	(4)						/* Frames held in the shared ring */
+
+#pragma pack(4)
+typedef struct _SHM_ATTACH_INFO {
+	char name[64];									/* Name of the mapping (OpenSharedRing) */
+	int nslots;										/* Slots in the ring */
+	uint32_t slot_bytes;							/* Largest frame that can be published */
+} SHM_ATTACH_INFO;
+
+typedef struct _SHM_FRAME {
+	IMAGE_INFO info;								/* Information on the frame published */
+	int32_t slot;									/* Slot in the shared ring */
+	int32_t sequence;								/* Sequence number of the slot when published */
+	uint32_t length;								/* Bytes of image data in the slot */
+} SHM_FRAME;
+#pragma pack()
+
+/* Structures for the pre-trigger burst segment */
+/* SEGMENT_INFO reply is the SEGMENT_INFO followed by nframes SEGMENT_FRAME_INFO */
+#pragma pack(4)
+typedef struct _PRETRIGGER_PARMS {
+	int npre;										/* Frames kept before the trigger (<0 ==> no change) */
+	int npost;										/* Frames collected after the trigger (<0 ==> no change) */
+} PRETRIGGER_PARMS;
+
+typedef struct _SEGMENT_INFO {
+	int trigger_imageID;							/* imageID of the frame current at the trigger */
+	int trigger_index;							/* Index of that frame in the segment (= npre) */
+	int nframes;									/* Frames in the segment (npre + 1 + npost) */
+	int nvalid;										/* Frames actually captured */
+} SEGMENT_INFO;
+
+typedef struct _SEGMENT_FRAME_INFO {
+	IMAGE_INFO info;								/* Information on the frame (imageID < 0 if missing) */
+	double latency_ms;							/* Camera time relative to the trigger frame (ms) */
+	uint32_t length;								/* Bytes of image data (0 if missing) */
+} SEGMENT_FRAME_INFO;
+#pragma pack()
+
+/* Streaming burst ... request data is an optional FILE_SAVE_PARMS (path is the pattern) */
+#pragma pack(4)
+typedef struct _BURST_STREAM_INFO {
+	int enabled;									/* Next bursts are streamed to disk */
+	int frames;										/* Frames seen in the current / last burst */
+	int written;									/* Frames written (and listed in the .csv) */
+	int lost;										/* Frames overwritten before they could be written */
+	int pending;									/* Frames still waiting for the writer */
+} BURST_STREAM_INFO;
+#pragma pack()
+
+/* HDR bracketing ... reply data is HDR_BRACKET_INFO (ZooCam.h) */
+/* The merged frame is frame FRAME_HDR for GET_IMAGE_INFO, GET_IMAGE_DATA and SAVE_FRAME */
+#pragma pack(4)
+typedef struct _HDR_BRACKET_PARMS {
+	int nexp;										/* >0 ==> start bracket, 0 ==> stop, <0 ==> query only */
+	int continuous;								/* Keep cycling (else one merged frame) */
+	HDR_OUTPUT output;							/* HDR_FLOAT32 or HDR_UINT16 */
+	int black_level;								/* Offset subtracted before merging */
+	double exposure[HDR_MAX_EXPOSURES];		/* Exposure of each frame (ms) */
+} HDR_BRACKET_PARMS;
+#pragma pack()
+
+/* Frame accumulator ... reply data is ACCUM_INFO (ZooCam.h) */
+/* Results are frames FRAME_MEAN and FRAME_VARIANCE (PIXEL_FLOAT32) for GET_IMAGE_INFO, GET_IMAGE_DATA and SAVE_FRAME */
+#pragma pack(4)
+typedef struct _ACCUM_PARMS {
+	ACCUM_MODE mode;								/* ACCUM_COUNT, ACCUM_SLIDING or ACCUM_STOP */
+	int nframes;									/* Frames to sum / window size */
+} ACCUM_PARMS;
+#pragma pack()
+
+/* Calibration ... reply data is CALIB_INFO (ZooCam.h) */
+typedef enum _CALIB_ACTION { CALIB_QUERY=0, CALIB_CAPTURE=1, CALIB_ENABLE=2, CALIB_SAVE=3, CALIB_LOAD=4 } CALIB_ACTION;
+#pragma pack(4)
+typedef struct _CALIB_PARMS {
+	CALIB_ACTION action;
+	int value;										/* CAPTURE: CALIB_KIND, ENABLE: 0/1 */
+	char path[260];								/* SAVE / LOAD: file (or directory for LOAD) */
+} CALIB_PARMS;
+#pragma pack()
+
+/* Defect map ... reply data is DEFECT_INFO (ZooCam.h) */
+typedef enum _DEFECT_ACTION { DEFECT_QUERY=0, DEFECT_BUILD=1, DEFECT_ENABLE=2, DEFECT_SAVE=3, DEFECT_LOAD=4, DEFECT_CLEAR=5 } DEFECT_ACTION;
+#pragma pack(4)
+typedef struct _DEFECT_PARMS {
+	DEFECT_ACTION action;
+	int value;										/* BUILD: CALIB_KIND, ENABLE: 0/1 */
+	double threshold;								/* BUILD: nsigma (dark) or fraction (flat), 0 ==> default */
+	char path[260];								/* SAVE / LOAD: file (or directory for LOAD) */
+} DEFECT_PARMS;
+#pragma pack()
+
+/* Multi-ROI streams ... ROI_STREAM reply data is one ROI_STREAM_INFO per stream (ZooCam.h) */
+/* ROI_FRAME reply data is ROI_FRAME_INFO followed by the pixels */
+typedef enum _ROI_STREAM_ACTION { ROI_LIST=0, ROI_ADD=1, ROI_REMOVE=2, ROI_SAVE=3 } ROI_STREAM_ACTION;
+#pragma pack(4)
+typedef struct _ROI_STREAM_PARMS {
+	ROI_STREAM_ACTION action;
+	ROI_STREAM_DEF def;							/* ADD: definition, REMOVE / SAVE: def.name ("" ==> all for REMOVE) */
+	int seq;											/* SAVE: frame (<0 ==> newest) */
+	char path[260];								/* SAVE: file (PGM / PPM) */
+} ROI_STREAM_PARMS;
+
+typedef struct _ROI_FRAME_PARMS {
+	char name[32];									/* Stream */
+	int seq;											/* Frame wanted (<0 ==> newest) */
+	int msTimeout;									/* Longest to wait for it to be captured */
+} ROI_FRAME_PARMS;
+#pragma pack()
+
+/* Binning ... reply data is BINNING_INFO (camera.h) */
+#pragma pack(4)
+typedef struct _BINNING_PARMS {
+	int bin;											/* Factor (1 ==> none, <=0 ==> query) */
+	BOOL bSoftware;								/* TL: bin in software even if the sensor can */
+} BINNING_PARMS;
+#pragma pack()
+
+/* Concurrent capture ... MULTI_CAMERA reply data is one MULTI_CAMERA_INFO per TL camera (ZooCam.h) */
+/* MULTI_IMAGE reply data is MULTI_FRAME_INFO followed by the pixels, MULTI_ALIGN one MULTI_ALIGN_INFO per camera */
+typedef enum _MULTI_CAMERA_ACTION { MULTI_LIST=0, MULTI_START=1, MULTI_STOP=2 } MULTI_CAMERA_ACTION;
+#pragma pack(4)
+typedef struct _MULTI_CAMERA_PARMS {
+	MULTI_CAMERA_ACTION action;
+	int id;											/* Camera (STOP: -1 ==> all) */
+	int nBuf;										/* START: ring size if opened (0 ==> default) */
+} MULTI_CAMERA_PARMS;
+
+typedef struct _MULTI_IMAGE_PARMS {
+	int id;											/* Camera */
+	int frame;										/* Ring index (-1 ==> newest) */
+} MULTI_IMAGE_PARMS;
+#pragma pack()
+
+/* Client side frame cache (ZooCam_Get_Image_Data) */
+#define	ZOOCAM_CACHE_DFLT_BYTES		(256*1024*1024)	/* Memory limit for cached frames */
+#define	ZOOCAM_CACHE_DFLT_FRAMES	(16)					/* Frame limit for cached frames */
+
+typedef enum _FRAME_CACHE_POLICY { CACHE_NOCHANGE=-1, CACHE_OFF=0, CACHE_VALIDATE=1 } FRAME_CACHE_POLICY;
+
+typedef struct _FRAME_CACHE_STATS {
+	FRAME_CACHE_POLICY policy;					/* Current policy */
+	size_t max_bytes;								/* Memory limit */
+	int max_frames;								/* Frame limit */
+	size_t bytes;									/* Memory currently held */
+	int frames;										/* Frames currently held */
+	uint32_t hits;									/* Requests answered from the cache */
+	uint32_t misses;								/* Requests that went to the server */
+	uint32_t evictions;							/* Frames dropped to stay within limits */
+} FRAME_CACHE_STATS;
+
 /* Structures for query/modify exposure and gain settings */
 #pragma pack(4)
 /* Or'd bit-flags in option to control setting parameters */
@@ -86,7 +354,7 @@ typedef struct _EXPOSURE_PARMS {
 -- Inputs: IP_address - IP address in normal form.  Use "127.0.0.1" for loopback test
 --                      if NULL, uses DFLT_SERVER_IP_ADDRESS
 --
--- Output: Creates MUTEX semaphores, opens socket, sets atexit() to ensure closure
+-- Output: Creates MUTEX semaphores, opens pipelined socket, sets atexit() to ensure closure
 --
 -- Return:  0 - successful
 --          1 - unable to create semaphores for controlling access to hardware
@@ -94,7 +362,9 @@ typedef struct _EXPOSURE_PARMS {
 --          3 - unable to query the server version
 --          4 - server / client version mismatch
 --
--- Notes: Must be called before any attempt to communicate across the socket
+-- Notes: (1) Must be called before any attempt to communicate across the socket
+--        (2) If the server is on this machine, also maps the shared frame
+--            ring so image data does not have to cross the socket
 =========================================================================== */
 int Init_ZooCam_Client(char *IP_address);
 
@@ -112,6 +382,50 @@ int Init_ZooCam_Client(char *IP_address);
 =========================================================================== */
 int Shutdown_ZooCam_Client(void);
 
+/* ===========================================================================
+--	Pipelined (asynchronous) requests to the server
+--
+--	Usage:  int ZooCam_Async_Request(int msg, int option, void *data, size_t length, 
+--                                  CS_CALLBACK callback, void *context, CS_PENDING **handle);
+--         int ZooCam_Async_Wait(CS_PENDING *handle, int msTimeout, int *rc, void **reply_data, size_t *length);
+--         int ZooCam_Async_Cancel(CS_PENDING *handle);
+--
+--	Inputs: msg      - any ZOOCAM_xxx command
+--         option   - request.option value for the command
+--         data     - data sent with the command (structure as for the blocking call)
+--         length   - bytes in data
+--         callback - if !NULL, called on the reader thread with the reply (no handle returned)
+--                    callback(status, &reply, data, context) ... callback must free(data)
+--         context  - passed to the callback
+--         handle   - receives the pending request for ZooCam_Async_Wait()
+--         msTimeout - maximum wait in ms (0 to poll, INFINITE allowed)
+--         rc       - receives reply.rc for the command (if !NULL)
+--         reply_data - receives malloc'd data returned by the command (if !NULL)
+--         length   - receives bytes in reply_data (if !NULL)
+-- 
+--	Output: Request is sent immediately; any number may be in flight
+--
+-- Return: ZooCam_Async_Request: 0 if sent, else code from SubmitServerRequest()
+--         ZooCam_Async_Wait:    0 ==> reply received (handle released)
+--                               1 ==> timeout (handle still valid)
+--                               2 ==> connection lost (handle released)
+--                               3 ==> invalid handle
+--                               4 ==> server could not process (mutex timeout)
+--         ZooCam_Async_Cancel:  0 ==> handle released, reply will be discarded
+--
+-- Notes: (1) Requests are tagged with msgid and replies matched as they arrive,
+--            so an acquisition loop can send SET_EXPOSURE, TRIGGER and a
+--            GET_IMAGE_REGION back to back and collect the results later.
+--        (2) Commands that change state run on the server in the order sent.
+--            Queries (GET_xxx, RING_GET_xxx, BURST_STATUS, BURST_WAIT) sent
+--            between them may run in parallel and be answered out of order.
+--        (3) The blocking ZooCam_xxx() calls use the same connection and may
+--            be freely mixed with pipelined requests.
+=========================================================================== */
+int ZooCam_Async_Request(int msg, int option, void *data, size_t length, CS_CALLBACK callback, void *context, CS_PENDING **handle);
+int ZooCam_Async_Wait(CS_PENDING *handle, int msTimeout, int *rc, void **reply_data, size_t *length);
+int ZooCam_Async_Cancel(CS_PENDING *handle);
+
 /* ===========================================================================
 --	Routine to return current version of this code
 --
@@ -178,9 +492,127 @@ int ZooCam_Get_Image_Info(int frame, IMAGE_INFO *info);
 -- Return: 0 if successful, otherwise error code from call
 --           1 ==> no camera connected
 --           2 ==> frame invalid
+--
+-- Notes: (1) Uses the shared frame ring if attached (server on this machine)
+--        (2) Unless caching is off, a ZOOCAM_GET_IMAGE_INFO query identifies
+--            the image in the slot and a cached copy is returned if present
 =========================================================================== */
 int ZooCam_Get_Image_Data(int frame, void **image_data, size_t *length);
 
+/* ===========================================================================
+--	Routines to access image data in place (server on the same machine)
+--
+--	Usage:  int  ZooCam_Get_Image_Shared(int frame, SHM_FRAME *shm, void **image_data);
+--         BOOL ZooCam_Shared_Valid(SHM_FRAME *shm);
+--         BOOL ZooCam_Shared_Active(void);
+--
+--	Inputs: frame      - image frame (-1 ==> current)
+--         shm        - structure to receive image info, slot and sequence
+--         image_data - pointer to receive address of the data in the ring
+--		
+--	Output: *shm        - info on the image and where it was published
+--         *image_data - raw data in the shared ring (read-only, do NOT free)
+--
+-- Return: Get:    0 if successful, otherwise error code from call
+--                   1 ==> no camera connected
+--                   2 ==> frame invalid
+--                   3 ==> frame larger than the shared slots
+--                   5 ==> no shared memory ring (server remote or refused)
+--         Valid:  TRUE if the data at *image_data has not been overwritten
+--         Active: TRUE if the shared memory ring is attached
+--
+-- Notes: (1) The shared ring is negotiated by Init_ZooCam_Client() when the
+--            server is on the same machine.  ZooCam_Get_Image_Data() then
+--            uses it automatically (one copy, no TCP transfer of pixels).
+--        (2) The data remains valid until ZOOCAM_SHM_SLOTS-1 other frames
+--            have been published.  Check ZooCam_Shared_Valid() after using
+--            the data and discard results if it has become FALSE.
+=========================================================================== */
+int  ZooCam_Get_Image_Shared(int frame, SHM_FRAME *shm, void **image_data);
+BOOL ZooCam_Shared_Valid(SHM_FRAME *shm);
+BOOL ZooCam_Shared_Active(void);
+
+/* ===========================================================================
+--	Client side cache of image data keyed by the server's imageID
+--
+--	Usage:  int ZooCam_Cache_Config(FRAME_CACHE_POLICY policy, size_t max_bytes, int max_frames);
+--         int ZooCam_Cache_Stats(FRAME_CACHE_STATS *stats, BOOL reset);
+--         int ZooCam_Cache_Flush(void);
+--
+--	Inputs: policy     - CACHE_OFF      ==> every call goes to the server
+--                      CACHE_VALIDATE ==> query image info, reuse data if same imageID (default)
+--                      CACHE_NOCHANGE ==> leave policy alone
+--         max_bytes  - limit on memory held (0 ==> no change)
+--         max_frames - limit on frames held (0 ==> no change)
+--         stats      - structure to receive current statistics
+--         reset      - if TRUE, zero the hit / miss / eviction counters
+--
+--	Output: Least recently used frames are evicted to stay within limits.
+--         Turning the cache off releases all memory.
+--
+-- Return: 0 if successful
+--
+-- Notes: ZooCam_Get_Image_Data() still returns a malloc'd copy the caller
+--        must free(); only the transfer from the server is avoided.
+=========================================================================== */
+int ZooCam_Cache_Config(FRAME_CACHE_POLICY policy, size_t max_bytes, int max_frames);
+int ZooCam_Cache_Stats(FRAME_CACHE_STATS *stats, BOOL reset);
+int ZooCam_Cache_Flush(void);
+
+/* ===========================================================================
+--	Routine to return a cropped, binned and/or converted copy of an image
+--
+--	Usage:  int ZooCam_Get_Image_Region(REGION_REQUEST *request, REGION_INFO *info, void **image_data, size_t *length);
+--
+--	Inputs: request    - frame, window, binning and output format desired
+--         info       - pointer to structure to receive details of returned data
+--         image_data - pointer to get malloc'd pixel data (caller must free())
+--         length     - pointer to get number of bytes in *image_data buffer
+--		
+--	Output: *info       - actual window, size and format of the data
+--         *image_data - pixels, info->pitch bytes per row, info->height rows
+--         *length     - number of bytes in the buffer
+--
+-- Return: 0 if successful, otherwise error code from call
+--           1 ==> no camera connected
+--           2 ==> frame invalid
+--           3 ==> window lies outside the image or smaller than one bin
+--           4 ==> server unable to allocate memory
+--           5 ==> frame overwritten while being extracted (ask again)
+--
+-- Notes: (1) The server does the extraction, so transfer size scales with
+--            the window and binning rather than the sensor size.
+--        (2) For Bayer (color TL) sensors the window is aligned to 2x2 cells.
+--            REGION_RAW16 returns a binned mosaic, while REGION_MONO8 and
+--            REGION_RGB24 return one pixel per (binned) 2x2 cell.
+=========================================================================== */
+int ZooCam_Get_Image_Region(REGION_REQUEST *request, REGION_INFO *info, void **image_data, size_t *length);
+
+/* ===========================================================================
+--	Routine to return statistics on an image computed by the server
+--
+--	Usage:  int ZooCam_Get_Stats(STATS_REQUEST *request, IMAGE_STATS **stats);
+--
+--	Inputs: request - image (frame or imageID), optional arrays, bins, threshold
+--         stats   - pointer to get malloc'd IMAGE_STATS block (caller must free())
+--		
+--	Output: *stats - scalar results followed by any requested arrays.  Use the
+--                  hist_offset, col_offset and row_offset byte offsets from
+--                  the start of the block to locate the arrays.
+--
+-- Return: 0 if successful, otherwise error code from call
+--           1 ==> no camera connected
+--           2 ==> frame invalid or imageID no longer in the ring
+--           3 ==> statistics not supported for this image format
+--           4 ==> server unable to allocate memory
+--           5 ==> frame overwritten while the statistics were computed (ask again)
+--
+-- Notes: The reply is a few kilobytes (histograms at up to 4096 bins per
+--        channel) rather than the full frame.  Results are cached on the
+--        server by imageID, so repeated queries for one image are cheap.
+=========================================================================== */
+int ZooCam_Get_Stats(STATS_REQUEST *request, IMAGE_STATS **stats);
+
 /* ===========================================================================
 --	Save a frame to specified filename in specified format
 --
@@ -467,4 +899,389 @@ int DCxZooCam_Burst_Wait(int msTimeout);
 =========================================================================== */
 int ZooCam_LED_Set_State(int state);
 
+/* ===========================================================================
+--	Routines for pre-trigger burst capture
+--
+--	Usage:  int ZooCam_Burst_Pretrigger(int npre, int npost, PRETRIGGER_PARMS *actual);
+--	        int ZooCam_Burst_Mark(void);
+--	        int ZooCam_Get_Segment_Info(SEGMENT_INFO *segment, SEGMENT_FRAME_INFO **frames);
+--	        int ZooCam_Get_Segment_Frame(int index, SEGMENT_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_Save_Segment(char *pattern);
+--
+--	Inputs: npre, npost - frames to keep before / after the trigger
+--                       (<0 ==> no change, both 0 ==> normal burst)
+--         actual      - if !NULL, receives the values now in effect
+--         segment     - receives the segment summary
+--         frames      - if !NULL, receives malloc'd array of nframes entries
+--         index       - frame in the segment (0 ... nframes-1)
+--         info        - if !NULL, receives the frame details
+--         image_data  - receives malloc'd copy of the frame data
+--         pattern     - root of name for files (<pattern>.csv, <pattern>_ddd.raw)
+-- 
+--	Output: With npre or npost > 0, DCxZooCam_Burst_Arm() starts recording
+--         at once.  The stripe start (or ZooCam_Burst_Mark()) freezes npre
+--         frames from before the event, the trigger frame, and npost after.
+--         DCxZooCam_Burst_Wait() returns once the segment is frozen.
+--
+-- Return: All return -1 on client/server error
+--         ZooCam_Burst_Pretrigger: 0 if successful, 2 if ring is too small for npre
+--         ZooCam_Burst_Mark:       0 if marked, 1 if not armed in pre-trigger mode
+--         ZooCam_Get_Segment_*:    0 if successful, 1 no segment, 2 bad index, 3 frame missing
+--         ZooCam_Save_Segment:     value from Burst_Save_Segment()
+=========================================================================== */
+int ZooCam_Burst_Pretrigger(int npre, int npost, PRETRIGGER_PARMS *actual);
+int ZooCam_Burst_Mark(void);
+int ZooCam_Get_Segment_Info(SEGMENT_INFO *segment, SEGMENT_FRAME_INFO **frames);
+int ZooCam_Get_Segment_Frame(int index, SEGMENT_FRAME_INFO *info, void **image_data);
+int ZooCam_Save_Segment(char *pattern);
+
+/* ===========================================================================
+--	Routine to write burst frames to disk while the burst is running
+--
+--	Usage:  int ZooCam_Burst_Stream(int enable, char *pattern, FILE_FORMAT format, BURST_STREAM_INFO *info);
+--
+--	Inputs: enable  - 1 ==> stream the next bursts, 0 ==> normal burst, <0 ==> just query
+--         pattern - root of name for files (NULL ==> no change)
+--							  <pattern>.csv - logfile (same layout as ZooCam_Save_All)
+--                     <pattern>_ddd.bmp - individual images (or .raw)
+--         format  - FILE_BMP or FILE_RAW (FILE_DFLT ==> no change)
+--         info    - if !NULL, receives the mode and counts of the current / last burst
+-- 
+--	Output: While streaming, DCxZooCam_Burst_Status() only reports
+--         BURST_STATUS_COMPLETE once every frame and the .csv are written
+--         and closed, so the next stripe can be armed immediately (with a
+--         new pattern ... the pattern is captured at arm).
+--
+-- Return: Returns -1 on client/server error, otherwise 0
+=========================================================================== */
+int ZooCam_Burst_Stream(int enable, char *pattern, FILE_FORMAT format, BURST_STREAM_INFO *info);
+
+/* ===========================================================================
+--	Routine to start, stop or query HDR exposure bracketing
+--
+--	Usage:  int ZooCam_HDR_Bracket(HDR_BRACKET_PARMS *parms, HDR_BRACKET_INFO *info);
+--
+--	Inputs: parms - bracket to run (nexp > 0), stop (nexp = 0) or NULL to query
+--         info  - if !NULL, receives the bracket status and last merge details
+-- 
+--	Output: The server cycles the exposures, merges each set, and serves the
+--         result as frame FRAME_HDR.  Use ZooCam_Get_Image_Info() and
+--         ZooCam_Get_Image_Data() with FRAME_HDR (PIXEL_FLOAT32 counts/ms or
+--         16-bit scaled by info->scale), or ZooCam_Save_Frame() to a .pfm/.pgm.
+--
+-- Return: Returns -1 on client/server error, otherwise HDR_Bracket() code
+=========================================================================== */
+int ZooCam_HDR_Bracket(HDR_BRACKET_PARMS *parms, HDR_BRACKET_INFO *info);
+
+/* ===========================================================================
+--	Routine to query the autosave queue (back-pressure) statistics
+--
+--	Usage:  int ZooCam_Autosave_Stats(BOOL reset, AUTOSAVE_INFO *info);
+--
+--	Inputs: reset - TRUE to zero the counts after reading them
+--         info  - receives queue capacity, depth, and frames queued,
+--                 written, dropped (queue full) and lost (overwritten)
+-- 
+--	Output: *info
+--
+-- Return: Returns -1 on client/server error, otherwise 0
+=========================================================================== */
+int ZooCam_Autosave_Stats(BOOL reset, AUTOSAVE_INFO *info);
+
+/* ===========================================================================
+--	Routine to set or query the autosave change-detection gate
+--
+--	Usage:  int ZooCam_Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current);
+--
+--	Inputs: set     - new settings (NULL ==> just query)
+--                   enable       - only save frames that changed
+--                   threshold    - mean |difference| of 8-bit previews to save
+--                   max_interval - save at least every max_interval s (0 ==> never forced)
+--         current - if !NULL, receives the settings in effect
+-- 
+--	Output: Skipped frames are counted in AUTOSAVE_INFO.skipped, and every
+--         decision is logged to <template>_gate.csv in the autosave directory
+--
+-- Return: Returns -1 on client/server error, otherwise Autosave_Gate() code
+=========================================================================== */
+int ZooCam_Autosave_Gate(AUTOSAVE_GATE *set, AUTOSAVE_GATE *current);
+
+/* ===========================================================================
+--	Routine to run the frame accumulator (averaging / variance)
+--
+--	Usage:  int ZooCam_Accumulate(int mode, int nframes, ACCUM_INFO *info);
+--
+--	Inputs: mode    - ACCUM_COUNT   ==> sum the next nframes and stop
+--                   ACCUM_SLIDING ==> sliding window of nframes (<= ACCUM_MAX_WINDOW)
+--                   ACCUM_STOP    ==> stop adding frames
+--                   <0            ==> just query
+--         nframes - frames to sum / window size
+--         info    - if !NULL, receives the accumulator status
+-- 
+--	Output: Mean and variance images (float per sample) are then available
+--         with ZooCam_Get_Image_Info() / ZooCam_Get_Image_Data() using
+--         frames FRAME_MEAN and FRAME_VARIANCE, and ZooCam_Save_Frame()
+--         writes them as raw float32.
+--
+-- Return: Returns -1 on client/server error, otherwise Accum_Start() code
+=========================================================================== */
+int ZooCam_Accumulate(int mode, int nframes, ACCUM_INFO *info);
+
+/* ===========================================================================
+--	Routines for dark / bias / flat calibration of incoming frames
+--
+--	Usage:  int ZooCam_Calibrate(CALIB_ACTION action, int value, char *path, CALIB_INFO *info);
+--	        int ZooCam_Calib_Build(CALIB_KIND kind, int nframes, int msTimeout, CALIB_INFO *info);
+--
+--	Inputs: action    - CALIB_QUERY   ==> just report
+--                     CALIB_CAPTURE ==> take component value (CALIB_KIND)
+--                                       from the accumulator mean
+--                     CALIB_ENABLE  ==> value 1/0 turns correction on/off
+--                     CALIB_SAVE    ==> write the set to path ("" ==> default name)
+--                     CALIB_LOAD    ==> read path (directory ==> best match)
+--         kind      - component to build (CALIB_BIAS, CALIB_DARK, CALIB_FLAT)
+--         nframes   - frames to average for it
+--         msTimeout - longest to wait for the frames
+--         info      - if !NULL, receives the calibration status
+-- 
+--	Output: ZooCam_Calib_Build() runs the accumulator for nframes and then
+--         captures the mean as the component.  Set the exposure and light
+--         for the component before calling.
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+--         (Calib_* codes in ZooCam.h); ZooCam_Calib_Build() returns -2 on
+--         timeout
+=========================================================================== */
+int ZooCam_Calibrate(CALIB_ACTION action, int value, char *path, CALIB_INFO *info);
+int ZooCam_Calib_Build(CALIB_KIND kind, int nframes, int msTimeout, CALIB_INFO *info);
+
+/* ===========================================================================
+--	Routine for the hot / dead pixel map
+--
+--	Usage:  int ZooCam_Defects(DEFECT_ACTION action, int value, double threshold, char *path, DEFECT_INFO *info);
+--
+--	Inputs: action    - DEFECT_QUERY  ==> just report
+--                     DEFECT_BUILD  ==> add defects from the accumulator mean,
+--                                       value CALIB_DARK (hot) or CALIB_FLAT (dead)
+--                     DEFECT_ENABLE ==> value 1/0 turns correction on/off
+--                     DEFECT_SAVE   ==> write the map to path ("" ==> <serial>.zdef)
+--                     DEFECT_LOAD   ==> read path (directory ==> <serial>.zdef in it)
+--                     DEFECT_CLEAR  ==> empty the map
+--         threshold - DEFECT_BUILD sensitivity (0 ==> default, see Defect_Build)
+--         info      - if !NULL, receives the map status
+-- 
+--	Output: Run ZooCam_Accumulate(ACCUM_COUNT, ...) with the sensor capped
+--         (long exposure) or under a flat field before DEFECT_BUILD.
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+--         (Defect_* codes in ZooCam.h)
+=========================================================================== */
+int ZooCam_Defects(DEFECT_ACTION action, int value, double threshold, char *path, DEFECT_INFO *info);
+
+/* ===========================================================================
+--	Routines for multi-ROI extraction streams
+--
+--	Usage:  int ZooCam_ROI_Add(ROI_STREAM_DEF *def);
+--	        int ZooCam_ROI_Remove(char *name);
+--	        int ZooCam_ROI_List(int *nstreams, ROI_STREAM_INFO **streams);
+--	        int ZooCam_ROI_Get_Frame(char *name, int seq, int msTimeout, ROI_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_ROI_Save(char *name, int seq, char *path);
+--
+--	Inputs: def        - name, window, bin/bDecimate, every, format and nslots
+--                      (see ROI_Stream_Add in ZooCam.h)
+--         name       - stream (Remove: "" or NULL ==> all)
+--         nstreams   - receives the number of streams
+--         streams    - if !NULL, receives a malloc'd array of nstreams
+--                      descriptions (caller frees)
+--         seq        - frame wanted (<0 ==> newest); a consumer asks for
+--                      info.seq+1 each time and sees any gap in info.seq
+--         msTimeout  - longest the server waits for seq to be captured
+--                      (capped at ZOOCAM_ROI_FRAME_WAIT; poll for longer)
+--         info       - receives the frame information (timestamps, size)
+--         image_data - receives a malloc'd copy of the pixels (caller frees)
+--         path       - file on the server (PGM, or PPM for color)
+-- 
+--	Output: The server copies each window out of every new frame into a
+--         small ring per stream, so only the windows are transferred.
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+--         (ROI_Stream_* codes in ZooCam.h)
+=========================================================================== */
+int ZooCam_ROI_Add(ROI_STREAM_DEF *def);
+int ZooCam_ROI_Remove(char *name);
+int ZooCam_ROI_List(int *nstreams, ROI_STREAM_INFO **streams);
+int ZooCam_ROI_Get_Frame(char *name, int seq, int msTimeout, ROI_FRAME_INFO *info, void **image_data);
+int ZooCam_ROI_Save(char *name, int seq, char *path);
+
+/* ===========================================================================
+--	Routine to set or query the image binning
+--
+--	Usage:  int ZooCam_Set_Binning(int bin, BOOL bSoftware, BINNING_INFO *info);
+--
+--	Inputs: bin       - binning factor (1 ==> none, 2, 4, ...; <=0 ==> query)
+--         bSoftware - TL cameras: bin in software even if the sensor can
+--         info      - if !NULL, receives the binning in effect
+-- 
+--	Output: Sensor binning is used where available; TL color cameras and
+--         unsupported factors are binned (CFA-aware) as frames enter the
+--         ring.  Image size and pixel size in CAMERA_INFO / IMAGE_INFO
+--         follow the binned geometry.
+--
+-- Return: Returns -1 on client/server error, otherwise Camera_SetBinning() code
+=========================================================================== */
+int ZooCam_Set_Binning(int bin, BOOL bSoftware, BINNING_INFO *info);
+
+/* ===========================================================================
+--	Routines for concurrent capture on several TL cameras
+--
+--	Usage:  int ZooCam_Multi_List(int *ncams, MULTI_CAMERA_INFO **cams);
+--	        int ZooCam_Multi_Start(int id, int nBuf);
+--	        int ZooCam_Multi_Stop(int id);
+--	        int ZooCam_Multi_Get_Image(int id, int frame, MULTI_FRAME_INFO *info, void **image_data);
+--	        int ZooCam_Multi_Align(int ref, int *n, MULTI_ALIGN_INFO **align);
+--
+--	Inputs: id         - camera (MULTI_CAMERA_INFO id; Stop: -1 ==> all)
+--         nBuf       - ring size for a camera that has to be opened (0 ==> 10)
+--         ncams, n   - receive the number of entries
+--         cams       - if !NULL, receives a malloc'd array of *ncams
+--                      descriptions (caller frees)
+--         frame      - ring index (-1 ==> newest)
+--         info       - receives the frame information (IMAGE_INFO of that
+--                      camera plus the host arrival time)
+--         image_data - receives a malloc'd copy of the raw pixels (caller frees)
+--         ref        - reference camera for the alignment (-1 ==> main)
+--         align      - if !NULL, receives a malloc'd array of *n alignments
+-- 
+--	Output: Each started camera captures into its own ring with its own
+--         imageIDs and counts.  Arrivals are stamped on one host clock, so
+--         ZooCam_Multi_Align can report how closely frames of the cameras
+--         coincide and the drift of each camera clock.
+--
+-- Return: Returns -1 on client/server error, otherwise the server code
+--         (Multi_Camera_* codes in ZooCam.h)
+=========================================================================== */
+int ZooCam_Multi_List(int *ncams, MULTI_CAMERA_INFO **cams);
+int ZooCam_Multi_Start(int id, int nBuf);
+int ZooCam_Multi_Stop(int id);
+int ZooCam_Multi_Get_Image(int id, int frame, MULTI_FRAME_INFO *info, void **image_data);
+int ZooCam_Multi_Align(int ref, int *n, MULTI_ALIGN_INFO **align);
+
+/* ===========================================================================
+--	Routine to query the cached camera properties, optionally waiting for a change
+--
+--	Usage:  int ZooCam_Get_Properties(int version, CAMERA_PROPS *props);
+--
+--	Inputs: version - version the caller already has (<0 ==> return immediately)
+--         props   - receives exposure, framerate, gamma and gains with their
+--                   version number
+-- 
+--	Output: Served from the server's property cache (no camera access).  If
+--         version matches the current one, waits up to ZOOCAM_PROPERTY_WAIT
+--         ms for a change, so a client can follow settings by calling this
+--         in a loop with the version from the last reply.
+--
+-- Return: Returns -1 on client/server error, otherwise
+--           0 ==> *props is a version other than the one given
+--           2 ==> no camera active
+--           3 ==> no change within the wait (*props is the current version)
+=========================================================================== */
+int ZooCam_Get_Properties(int version, CAMERA_PROPS *props);
+
+/* ===========================================================================
+--	Routine to change several capture settings at once between two frames
+--
+--	Usage:  int ZooCam_Apply_Settings(CAMERA_SETTINGS *settings, int msWait);
+--
+--	Inputs: settings - staged values; settings->modify is the OR of the
+--                    SETTING_* flags (same bits as MODIFY_*) to change
+--         msWait   - ms to wait for a frame boundary (<=0 ==> SETTING_FRAME_WAIT)
+-- 
+--	Output: All changes are made in one batch right after a frame arrives.
+--         *settings returns every value as it now stands and, in imageID,
+--         a bound from which every frame is captured with all of the
+--         changes (-1 if none were requested, or not known within msWait).
+--         Frames before it may carry a mix of old and new values, and the
+--         first frame with every change can come before it.
+--
+-- Return: Returns -1 on client/server error, otherwise
+--           0 ==> successful
+--           2 ==> no camera active
+--           3 ==> no frame arrived within msWait (changes applied anyway)
+=========================================================================== */
+int ZooCam_Apply_Settings(CAMERA_SETTINGS *settings, int msWait);
+
+/* ===========================================================================
+--	Routine to query the frame pipeline instrumentation
+--
+--	Usage:  int ZooCam_Get_Perf_Stats(PERF_STATS *stats, BOOL reset);
+--
+--	Inputs: stats - pointer to receive the summary (may be NULL)
+--         reset - if TRUE, histograms and counters are cleared after the copy
+-- 
+--	Output: *stats - for each stage (PERF_CALLBACK ... PERF_SEND) the count,
+--                  mean, p50, p99 and max duration in us plus the log2
+--                  histogram, and the frame / byte counters, all since the
+--                  last reset
+--
+-- Return: Returns -1 on client/server error, otherwise 0
+=========================================================================== */
+int ZooCam_Get_Perf_Stats(PERF_STATS *stats, BOOL reset);
+
+/* ===========================================================================
+--	Routine to control the frame pipeline event trace
+--
+--	Usage:  int ZooCam_Trace(int action, char *path, PERF_TRACE_INFO *info);
+--
+--	Inputs: action - ZOOCAM_TRACE_STOP, ZOOCAM_TRACE_START, ZOOCAM_TRACE_DUMP
+--                  or anything else to just query
+--         path   - for ZOOCAM_TRACE_DUMP, file to write on the server machine
+--         info   - optional, receives the trace state after the action
+-- 
+--	Output: ZOOCAM_TRACE_DUMP writes Chrome trace JSON (chrome://tracing or
+--         ui.perfetto.dev) with one timeline per thread: SDK callback,
+--         image_mutex wait/held, image thread processing and render,
+--         autosave/stream writes and server requests, tagged with imageID
+--
+-- Return: Returns -1 on client/server error, otherwise
+--           0 ==> successful
+--           1 ==> no path given for the dump
+--           2 ==> unable to open the file
+=========================================================================== */
+int ZooCam_Trace(int action, char *path, PERF_TRACE_INFO *info);
+
+/* ===========================================================================
+--	Routine to set or query the synthetic camera (server started with -sim)
+--
+--	Usage:  int ZooCam_Sim_Config(SIM_CONFIG *config, BOOL set);
+--
+--	Inputs: config - values to set, and receives the values in effect
+--         set    - TRUE to change the configuration, FALSE to just query
+-- 
+--	Output: *config - bounded values now in effect.  Size, color and bit
+--                   depth apply the next time the camera is opened; the
+--                   frame rate and scene change with the next frame
+--
+-- Return: Returns -1 on client/server error, otherwise
+--           0 ==> successful
+--           1 ==> synthetic camera unavailable
+=========================================================================== */
+int ZooCam_Sim_Config(SIM_CONFIG *config, BOOL set);
+
+/* ===========================================================================
+--	Routine to set or query the server transaction log verbosity
+--
+--	Usage:  int ZooCam_Set_Log_Level(int level);
+--
+--	Inputs: level - 0 ==> errors only
+--                 1 ==> one line per request (default)
+--                 2 ==> verbose (per-command detail lines)
+--                 <0 ==> just query
+-- 
+--	Output: Changes the logging on the server immediately
+--
+-- Return: Returns -1 on client/server error
+--         Otherwise the previous level
+=========================================================================== */
+int ZooCam_Set_Log_Level(int level);
+
 #endif		/* _ZOOCAM_CLIENT_INCLUDED */
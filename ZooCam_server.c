@@ -21,8 +21,11 @@
 /* ------------------------------ */
 #include "server_support.h"				/* Server support routine */
 #include "camera.h"							/* Camera information */
+#include "image_proc.h"						/* Region extraction kernels */
+#include "perf.h"								/* Stage latency instrumentation */
 #include "dcx.h"
 #include "tl.h"
+#include "sim.h"
 #include "ZooCam.h"							/* Access to the ZooCam info */
 #include "Ki224.h"							/* Access to the current control */
 #include "ZooCam_server.h"					/* Prototypes for main	  */
@@ -45,13 +48,25 @@
 /* ------------------------------- */
 /* My internal function prototypes */
 /* ------------------------------- */
-static int server_msg_handler(SERVER_DATA_BLOCK *block);
+static void server_msg_handler(SERVER_CONN *conn, CS_MSG *request, int request_class, void *data, CS_MSG *reply, void **reply_data, BOOL *free_reply);
+static int server_msg_class(CS_MSG *request);
+#define	ZOOCAM_CLASS_LOCKED	(SERVER_CLASS_USER)		/* server_msg_class: handler takes ZooCam_Server_Mutex */
+static BOOL server_msg_locked(int msg);
+static void server_msg_monitor(CS_MSG *request, CS_MSG *reply, SERVER_TIMING *timing);
+static void server_log_thread(void *arg);
 
 static int Remote_Get_Camera_Info(CAMERA_INFO *info);
 static int Remote_Set_Exposure_Parms(int options, EXPOSURE_PARMS *request, EXPOSURE_PARMS *actual);
 static int Remote_Ring_Actions(RING_ACTION request, int option, RING_INFO *response);
 static int Remote_Get_Image_Info(int frame, IMAGE_INFO *info);
 static int Remote_Get_Image_Data(int frame, void **data, size_t *length);
+static int Remote_Get_Image_Region(REGION_REQUEST *request, void **data, size_t *length);
+static int Remote_Shm_Attach(SHM_ATTACH_INFO *attach);
+static int Remote_Get_Image_Shm(int frame, SHM_FRAME *shm);
+static int Remote_Find_Frame(int imageID);
+static int Remote_Get_Stats(STATS_REQUEST *request, void **data, size_t *length);
+static int Remote_Get_Segment_Info(void **data, size_t *length);
+static int Remote_Get_Segment_Data(int index, void **data, size_t *length);
 
 /* ------------------------------- */
 /* My usage of other external fncs */
@@ -69,7 +84,7 @@ static int Remote_Get_Image_Data(int frame, void **data, size_t *length);
 -- Encode the current time as a string for a printf statement
 =========================================================================== */
 char *EncodeLogTime(void) {
-	static char obuf[64];
+	static __declspec(thread) char obuf[64];				/* Handlers run on several workers */
 	SYSTEMTIME systime;
 
 	GetLocalTime(&systime);
@@ -92,6 +107,32 @@ char *EncodeLogTime(void) {
 =========================================================================== */
 static BOOL ZooCam_Msg_Server_Up = FALSE;				/* Server has been started */
 static HANDLE ZooCam_Server_Mutex = NULL;				/* access to the client/server communication */
+static SHM_RING *ZooCam_Frame_Ring = NULL;				/* Shared frames for same-host clients (created on demand) */
+static SHM_ATTACH_INFO ZooCam_Frame_Ring_Info;
+
+/* Transaction log ... handlers add records to a ring, a background thread writes them */
+#define	LOG_RING_SIZE	(4096)							/* Records (power of 2) */
+#define	LOG_DRAIN_MS	(250)								/* Maximum delay before records are written */
+
+typedef struct _LOG_RECORD {
+	FILETIME time;											/* When the reply went out */
+	int msg, msgid, option, rc;
+	uint32_t bytes_in, bytes_out;
+	float queue_ms, service_ms, send_ms;
+	BOOL sent;
+} LOG_RECORD;
+
+typedef struct _LOG_SLOT {
+	volatile long ready;									/* Set once record is filled, cleared when drained */
+	LOG_RECORD record;
+} LOG_SLOT;
+
+static LOG_SLOT log_ring[LOG_RING_SIZE];
+static volatile long log_head = 0;						/* Next slot to claim (producers) */
+static volatile long log_tail = 0;						/* Next slot to write (drain thread only) */
+static volatile long log_dropped = 0;					/* Records lost because the ring was full */
+static HANDLE log_event = NULL;							/* Wakes the drain thread early */
+static int log_level = ZOOCAM_LOG_REQUESTS;
 
 int Init_ZooCam_Server(void) {
 	static char *rname = "Init_ZooCam_Server";
@@ -111,8 +152,11 @@ int Init_ZooCam_Server(void) {
 /* Enable debug information */
 	DebugSockets(2);									/* All warnings and errors */
 
+/* Background thread that writes the transaction log */
+	if (log_event == NULL && (log_event = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL) _beginthread(server_log_thread, 0, NULL);
+
 /* Bring up the message based server */
-	if ( ! (ZooCam_Msg_Server_Up = (RunServerThread("ZooCam", ZOOCAM_ACCESS_PORT, server_msg_handler, NULL) == 0)) ) {
+	if ( ! (ZooCam_Msg_Server_Up = (RunEventServerThread("ZooCam", ZOOCAM_ACCESS_PORT, ZOOCAM_SERVER_WORKERS, server_msg_handler, server_msg_class, server_msg_monitor, NULL) == 0)) ) {
 		if (fdebug != NULL) {
 			fprintf(fdebug, "%s ERROR[%s]: Unable to start the ZooCam message based remote server\n", EncodeLogTime(), rname); fflush(fdebug);
 		}
@@ -141,29 +185,40 @@ int Shutdown_ZooCam_Server(void) {
 		fprintf(fdebug, "%s ZooCam Server: Request to shutdown the server\n", EncodeLogTime()); fflush(fdebug);
 	}
 
+	/* Clients that still have the ring mapped keep it alive until they close */
+	if (ZooCam_Frame_Ring != NULL) { CloseSharedRing(ZooCam_Frame_Ring); ZooCam_Frame_Ring = NULL; }
+
 	return 0;
 }
 
 /* ===========================================================================
--- Actual server routine to process messages received on the open socket.
+-- Actual server routine to process one request received from a client.
 --
--- Usage: int server_msg_handler(SERVER_DATA_BLOCK *block)
+-- Usage: void server_msg_handler(SERVER_CONN *conn, CS_MSG *request, int request_class, void *data, 
+--                                CS_MSG *reply, void **reply_data, BOOL *free_reply);
 --
--- Inputs: socket - an open socket for exchanging messages with the client
+-- Inputs: conn    - connection the request arrived on
+--         request - the request header
+--         request_class - from server_msg_class (ZOOCAM_CLASS_LOCKED ==> take the mutex)
+--         data    - data received with the request (released by the server core)
+--         reply   - preset reply (msgid echoed, rc=0)
 --
--- Output: whatever needs to be done
+-- Output: *reply, *reply_data, *free_reply - the response to send
 --
--- Return: 0 ==> close this socket but continue listening for new clients
---         1 ==> Timeout waiting for semaphore
---         2 ==> socket appears to have been abandoned
+-- Return: none
+--
+-- Notes: Called on one of the event server worker threads.  Requests from
+--        different clients (and SERVER_CONCURRENT requests from one client)
+--        may be in here at the same time.
 =========================================================================== */
-static int server_msg_handler(SERVER_DATA_BLOCK *block) {
+static void server_msg_handler(SERVER_CONN *conn, CS_MSG *request_in, int request_class, void *received_data, CS_MSG *reply_out, void **reply_data_out, BOOL *free_reply) {
 	static char *rname = "server_msg_handler";
 
 	CS_MSG request, reply;
-	void *received_data, *reply_data;
-	BOOL ServerActive;
+	void *reply_data;
+	BOOL bLocked, bTimeout;
 	size_t length;
+	int n;
 	FILE *logfile;
 
 	/* These refer to the last captured image */
@@ -171,214 +226,678 @@ static int server_msg_handler(SERVER_DATA_BLOCK *block) {
 	void *image_data;
 	BOOL free_reply_data;
 
-	/* And more information buffers that get transferred - some need to be kept */
+	/* And more information buffers that get transferred (copied by the server core on return) */
 	CAMERA_INFO camera_info;
 	EXPOSURE_PARMS exposure;
 	TRIGGER_INFO trigger_info;
 	RING_INFO ring_info;
-
-/* Get standard request from client and process */
-	ServerActive = TRUE;
-	while (ServerActive && GetStandardServerRequest(block, &request, &received_data) == 0) {	/* Exit if client disappears */
-
-		/* Where should logging information go? */
-		logfile = (fdebug != NULL) ? fdebug : stderr;
-
-		/* Debug standard message received */
-		fprintf(logfile, "%s %s: Received standard request: msg=%d option=%d data_len=%d data=%p\n", EncodeLogTime(), rname, request.msg, request.option, request.data_len, received_data); fflush(logfile);
-
-		/* Create a default reply message - by default don't release reply_data */
-		memcpy(&reply, &request, sizeof(reply));
-		reply.rc = reply.data_len = 0;			/* All okay and no extra data */
-		reply_data = NULL;							/* No extra data on return */
-		free_reply_data = FALSE;
-
-		/* Be very careful ... only allow one socket message to be in process at any time */
-		/* The code should already protect, but not sure how interleaved messages may impact operations */
-		if (WaitForSingleObject(ZooCam_Server_Mutex, ZOOCAM_SERVER_WAIT) != WAIT_OBJECT_0) {
-			fprintf(logfile, "%s ERROR[%s]: Timeout waiting for the ZooCam_Server_Mutex semaphore\n", EncodeLogTime(), rname); fflush(logfile);
-			reply.msg = -1; reply.rc = -1;
-
-		} else switch (request.msg) {
-			case SERVER_END:
-				fprintf(logfile, "%s %s: SERVER_END\n", EncodeLogTime(), rname); fflush(logfile);
-				ServerActive = FALSE;
-				break;
-
-			case ZOOCAM_QUERY_VERSION:
-				fprintf(logfile, "%s %s: ZOOCAM_QUERY_VERSION()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = ZOOCAM_CLIENT_SERVER_VERSION;
-				break;
-
-			case ZOOCAM_GET_CAMERA_INFO:
-				fprintf(logfile, "%s %s: ZOOCAM_GET_CAMERA_INFO()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Remote_Get_Camera_Info(&camera_info);			/* Get the information */
-				reply.data_len = sizeof(camera_info);
-				reply_data = (void *) &camera_info;
-				break;
-
-			case ZOOCAM_GET_EXPOSURE_PARMS:
-				fprintf(logfile, "%s %s: ZOOCAM_GET_EXPOSURE_PARMS()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Remote_Set_Exposure_Parms(0, NULL, &exposure);
-				reply.data_len = sizeof(exposure);
-				reply_data = (void *) &exposure;
-				break;
-
-			case ZOOCAM_SET_EXPOSURE_PARMS:
-				fprintf(logfile, "%s %s: ZOOCAM_SET_EXPOSURE_PARMS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				if (request.data_len < sizeof(EXPOSURE_PARMS)) {
-					fprintf(logfile, "%s %s: data_len < sizeof(EXPOSURE_PARMS).  Ignoring set.\n", EncodeLogTime(), rname); fflush(logfile);
-					received_data = NULL;
-				}
-				reply.rc = Remote_Set_Exposure_Parms(request.option, received_data, &exposure);
-				reply.data_len = sizeof(exposure);
-				reply_data = (void *) &exposure;
-				break;
-
-			case ZOOCAM_GET_IMAGE_INFO:
-				fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_INFO(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				reply.rc = Remote_Get_Image_Info(request.option, &image_info);
-				reply.data_len = sizeof(image_info);
-				reply_data = (void *) &image_info;
-				break;
-
-			case ZOOCAM_GET_IMAGE_DATA:
-				fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_DATA(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				reply.rc = Remote_Get_Image_Data(request.option, &image_data, &length);
-				reply.data_len = length;
-				reply_data = (void *) image_data;
-				free_reply_data = TRUE;
-				break;
-
-			case ZOOCAM_SAVE_FRAME:
-				fprintf(logfile, "%s: ZOOCAM_SAVE_FRAME()\n", rname); fflush(logfile);
+	SHM_ATTACH_INFO shm_attach;
+	SHM_FRAME shm_frame;
+	PRETRIGGER_PARMS pretrigger;
+	BURST_STREAM_INFO stream;
+	HDR_BRACKET_INFO hdr;
+	AUTOSAVE_INFO autosave;
+	AUTOSAVE_GATE gate;
+	ACCUM_INFO accum;
+	CALIB_INFO calib;
+	DEFECT_INFO defect;
+	BINNING_INFO binning;
+	CAMERA_PROPS props;
+	CAMERA_SETTINGS settings;
+	PERF_STATS perf;
+	PERF_TRACE_INFO trace;
+	SIM_CONFIG sim_config;
+
+	/* Where should logging information go? */
+	logfile = (fdebug != NULL) ? fdebug : stderr;
+
+	/* Reply is preset by the server core (msgid echoed, rc=0, no data) */
+	memcpy(&request, request_in, sizeof(request));
+	memcpy(&reply, reply_out, sizeof(reply));
+	reply_data = NULL;							/* No extra data on return */
+	free_reply_data = FALSE;
+
+	/* Be very careful ... only allow one socket message to be in process at any time */
+	/* The code should already protect, but not sure how interleaved messages may impact operations */
+	/* Exceptions (server_msg_locked) are the few that touch no camera state (BURST_WAIT may wait up to 1 s) */
+	/* BURST_MARK only signals an event and must not queue behind a long transfer */
+	/* ROI_FRAME waits on its stream's own lock and event, like BURST_WAIT (capped at ZOOCAM_ROI_FRAME_WAIT) */
+	/* GET_EXPOSURE_PARMS and GET_PROPERTIES are served from the property cache (own lock; EXPOSURE_PARMS locks to refill it) */
+	/* GET_PERF_STATS and TRACE only touch the lock-free instrumentation */
+	/* Decided once in server_msg_class, since the GET_EXPOSURE_PARMS answer can change meanwhile */
+	bLocked = (request_class & ZOOCAM_CLASS_LOCKED) != 0;
+
+	/* Time spent queued behind other requests shows separately on the trace */
+	Perf_TraceBegin("Server request", -1);
+	bTimeout = FALSE;
+	if (bLocked) {
+		Perf_TraceBegin("Server mutex wait", -1);
+		bTimeout = (WaitForSingleObject(ZooCam_Server_Mutex, ZOOCAM_SERVER_WAIT) != WAIT_OBJECT_0);
+		Perf_TraceEnd("Server mutex wait", -1);
+	}
+	if (bLocked && bTimeout) {
+		fprintf(logfile, "%s ERROR[%s]: Timeout waiting for the ZooCam_Server_Mutex semaphore\n", EncodeLogTime(), rname); fflush(logfile);
+		reply.msg = -1; reply.rc = -1;
+		bLocked = FALSE;
+
+	} else switch (request.msg) {
+		case SERVER_END:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: SERVER_END\n", EncodeLogTime(), rname); fflush(logfile); }
+			EndServerConn(conn);					/* Close once this reply is sent */
+			break;
+
+		case ZOOCAM_QUERY_VERSION:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_QUERY_VERSION()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = ZOOCAM_CLIENT_SERVER_VERSION;
+			break;
+
+		case ZOOCAM_GET_CAMERA_INFO:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_CAMERA_INFO()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Get_Camera_Info(&camera_info);			/* Get the information */
+			reply.data_len = sizeof(camera_info);
+			reply_data = (void *) &camera_info;
+			break;
+
+		case ZOOCAM_GET_EXPOSURE_PARMS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_EXPOSURE_PARMS()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Set_Exposure_Parms(0, NULL, &exposure);
+			reply.data_len = sizeof(exposure);
+			reply_data = (void *) &exposure;
+			break;
+
+		case ZOOCAM_SET_EXPOSURE_PARMS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SET_EXPOSURE_PARMS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if (request.data_len < sizeof(EXPOSURE_PARMS)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(EXPOSURE_PARMS).  Ignoring set.\n", EncodeLogTime(), rname); fflush(logfile);
+				received_data = NULL;
+			}
+			reply.rc = Remote_Set_Exposure_Parms(request.option, received_data, &exposure);
+			reply.data_len = sizeof(exposure);
+			reply_data = (void *) &exposure;
+			break;
+
+		/* option: version the client already has ... waits up to ZOOCAM_PROPERTY_WAIT ms for another */
+		case ZOOCAM_GET_PROPERTIES:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_PROPERTIES(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Camera_WaitProperties(NULL, request.option, (request.option < 0) ? 0 : ZOOCAM_PROPERTY_WAIT, &props);
+			reply.data_len = sizeof(props);
+			reply_data = (void *) &props;
+			break;
+
+		/* option: ms to wait for a frame boundary (<=0 ==> SETTING_FRAME_WAIT) */
+		case ZOOCAM_APPLY_SETTINGS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_APPLY_SETTINGS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			memset(&settings, 0, sizeof(settings));
+			if (request.data_len >= sizeof(CAMERA_SETTINGS) && received_data != NULL) {
+				settings = *((CAMERA_SETTINGS *) received_data);
+			} else {
+				fprintf(logfile, "%s %s: data_len < sizeof(CAMERA_SETTINGS).  Only querying.\n", EncodeLogTime(), rname); fflush(logfile);
+			}
+			reply.rc = Camera_ApplySettings(NULL, &settings, request.option);
+			reply.data_len = sizeof(settings);
+			reply_data = (void *) &settings;
+			break;
+
+		/* option: 1 ==> reset the histograms and counters after the copy */
+		case ZOOCAM_GET_PERF_STATS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_PERF_STATS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Perf_GetStats(&perf, request.option == 1);
+			reply.data_len = sizeof(perf);
+			reply_data = (void *) &perf;
+			break;
+
+		/* option: ZOOCAM_TRACE_STOP, _START, _DUMP (path in FILE_SAVE_PARMS), otherwise query */
+		case ZOOCAM_TRACE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_TRACE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = 0;
+			if (request.option == ZOOCAM_TRACE_STOP) {
+				Perf_TraceEnable(FALSE);
+			} else if (request.option == ZOOCAM_TRACE_START) {
+				Perf_TraceEnable(TRUE);
+			} else if (request.option == ZOOCAM_TRACE_DUMP) {
 				if (request.data_len < sizeof(FILE_SAVE_PARMS)) {
-					fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping save.\n", EncodeLogTime(), rname); fflush(logfile);
+					fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping dump.\n", EncodeLogTime(), rname); fflush(logfile);
 					reply.rc = 1;
 				} else {
 					FILE_SAVE_PARMS *parms;
 					parms = (FILE_SAVE_PARMS *) received_data;
-					reply.rc = Camera_SaveImage(NULL, parms->frame, parms->path, parms->format);
+					parms->path[sizeof(parms->path)-1] = '\0';
+					reply.rc = Perf_TraceDump(parms->path, NULL);
 				}
-				break;
-
-			case ZOOCAM_SAVE_ALL:
-				fprintf(logfile, "%s: ZOOCAM_SAVE_ALL()\n", rname); fflush(logfile);
-				if (request.data_len < sizeof(FILE_SAVE_PARMS)) {
-					fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping save.\n", EncodeLogTime(), rname); fflush(logfile);
-					reply.rc = 1;
+			}
+			Perf_TraceInfo(&trace);
+			reply.data_len = sizeof(trace);
+			reply_data = (void *) &trace;
+			break;
+
+		/* option: 1 ==> set from the SIM_CONFIG sent, otherwise query */
+		case ZOOCAM_SIM_CONFIG:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SIM_CONFIG(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			memset(&sim_config, 0, sizeof(sim_config));
+			if (request.option == 1) {
+				if (request.data_len >= sizeof(SIM_CONFIG) && received_data != NULL) {
+					SIM_SetConfig(SIM_FindCamera(), (SIM_CONFIG *) received_data);
 				} else {
-					FILE_SAVE_PARMS *parms;
-					parms = (FILE_SAVE_PARMS *) received_data;
-					reply.rc = Camera_SaveAll(NULL, parms->path, parms->format);
+					fprintf(logfile, "%s %s: data_len < sizeof(SIM_CONFIG).  Only querying.\n", EncodeLogTime(), rname); fflush(logfile);
 				}
-				break;
-
-			case ZOOCAM_ARM:
-				fprintf(logfile, "%s %s: ZOOCAM_TRIGGER(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				reply.rc = Camera_Arm(NULL, request.option);
-				break;
-
-			case ZOOCAM_GET_TRIGGER_MODE:
-				fprintf(logfile, "%s %s: ZOOCAM_GET_TRIGGER_MODE()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Camera_GetTriggerMode(NULL, &trigger_info);
-				reply.data_len = sizeof(trigger_info);
-				reply_data = (void *) &trigger_info;
-				break;
-
-			case ZOOCAM_SET_TRIGGER_MODE:
-				fprintf(logfile, "%s %s: ZOOCAM_SET_TRIGGER_MODE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				if (request.data_len < sizeof(TRIGGER_INFO)) {
-					fprintf(logfile, "%s %s: data_len < sizeof(TRIGGER_INFO). Setting to zeros.\n", EncodeLogTime(), rname); fflush(logfile);
-					memset(&trigger_info, 0, sizeof(trigger_info));
-				} else {
-					memcpy(&trigger_info, received_data, sizeof(trigger_info));
+			}
+			reply.rc = (SIM_GetConfig(SIM_FindCamera(), &sim_config) == 0) ? 0 : 1 ;
+			reply.data_len = sizeof(sim_config);
+			reply_data = (void *) &sim_config;
+			break;
+
+		case ZOOCAM_GET_IMAGE_INFO:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_INFO(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Remote_Get_Image_Info(request.option, &image_info);
+			reply.data_len = sizeof(image_info);
+			reply_data = (void *) &image_info;
+			break;
+
+		case ZOOCAM_GET_IMAGE_DATA:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_DATA(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Remote_Get_Image_Data(request.option, &image_data, &length);
+			reply.data_len = length;
+			reply_data = (void *) image_data;
+			free_reply_data = TRUE;
+			break;
+
+		case ZOOCAM_SHM_ATTACH:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SHM_ATTACH()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Shm_Attach(&shm_attach);
+			reply.data_len = sizeof(shm_attach);
+			reply_data = (void *) &shm_attach;
+			break;
+
+		case ZOOCAM_GET_IMAGE_SHM:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_SHM(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Remote_Get_Image_Shm(request.option, &shm_frame);
+			reply.data_len = sizeof(shm_frame);
+			reply_data = (void *) &shm_frame;
+			break;
+
+		case ZOOCAM_GET_IMAGE_REGION:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_IMAGE_REGION(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if (request.data_len < sizeof(REGION_REQUEST)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(REGION_REQUEST). Ignoring request.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 3;
+			} else {
+				reply.rc = Remote_Get_Image_Region((REGION_REQUEST *) received_data, &image_data, &length);
+				reply.data_len = length;
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_GET_STATS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_STATS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if (request.data_len < sizeof(STATS_REQUEST)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(STATS_REQUEST). Ignoring request.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 3;
+			} else {
+				reply.rc = Remote_Get_Stats((STATS_REQUEST *) received_data, &image_data, &length);
+				reply.data_len = length;
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_SAVE_FRAME:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SAVE_FRAME()\n", EncodeLogTime(), rname); fflush(logfile); }
+			if (request.data_len < sizeof(FILE_SAVE_PARMS)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping save.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 1;
+			} else {
+				FILE_SAVE_PARMS *parms;
+				parms = (FILE_SAVE_PARMS *) received_data;
+				reply.rc = Camera_SaveImage(NULL, parms->frame, parms->path, parms->format);
+			}
+			break;
+
+		case ZOOCAM_SAVE_ALL:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SAVE_ALL()\n", EncodeLogTime(), rname); fflush(logfile); }
+			if (request.data_len < sizeof(FILE_SAVE_PARMS)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping save.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 1;
+			} else {
+				FILE_SAVE_PARMS *parms;
+				parms = (FILE_SAVE_PARMS *) received_data;
+				reply.rc = Camera_SaveAll(NULL, parms->path, parms->format);
+			}
+			break;
+
+		case ZOOCAM_ARM:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_TRIGGER(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Camera_Arm(NULL, request.option);
+			break;
+
+		case ZOOCAM_GET_TRIGGER_MODE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_GET_TRIGGER_MODE()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Camera_GetTriggerMode(NULL, &trigger_info);
+			reply.data_len = sizeof(trigger_info);
+			reply_data = (void *) &trigger_info;
+			break;
+
+		case ZOOCAM_SET_TRIGGER_MODE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SET_TRIGGER_MODE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if (request.data_len < sizeof(TRIGGER_INFO)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(TRIGGER_INFO). Setting to zeros.\n", EncodeLogTime(), rname); fflush(logfile);
+				memset(&trigger_info, 0, sizeof(trigger_info));
+			} else {
+				memcpy(&trigger_info, received_data, sizeof(trigger_info));
+			}
+			reply.rc = Camera_SetTriggerMode(NULL, request.option, &trigger_info);
+			reply.data_len = sizeof(trigger_info);
+			reply_data = (void *) &trigger_info;
+			break;
+
+		case ZOOCAM_TRIGGER:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_TRIGGER()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Camera_Trigger(NULL);
+			break;
+
+		case ZOOCAM_RING_GET_INFO:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_RING_GET_INFO()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Ring_Actions(RING_GET_INFO, 0, &ring_info);
+			reply.data_len   = sizeof(ring_info);
+			reply_data = (void *) &ring_info;
+			break;
+			
+		case ZOOCAM_RING_GET_SIZE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_RING_GET_SIZE()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Ring_Actions(RING_GET_SIZE, 0, NULL);
+			break;
+
+		case ZOOCAM_RING_SET_SIZE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_RING_SET_SIZE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Remote_Ring_Actions(RING_SET_SIZE, request.option, NULL);
+			break;
+
+		case ZOOCAM_RING_RESET_COUNT:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_RING_RESET_COUNT\n", EncodeLogTime(), rname); fflush(logfile); }
+			Camera_ResetRingCounters(NULL);
+			break;
+			
+		case ZOOCAM_RING_GET_FRAME_CNT:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_RING_GET_FRAME_CNT()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Ring_Actions(RING_GET_ACTIVE_CNT, 0, NULL);
+			break;
+
+		case ZOOCAM_BURST_ARM:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_ARM()\n", EncodeLogTime(), rname); fflush(logfile); }
+			Burst_Actions(BURST_ARM, 0, &reply.rc);			/* Arm the burst */
+			break;
+
+		case ZOOCAM_BURST_ABORT:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_ABORT()\n", EncodeLogTime(), rname); fflush(logfile); }
+			Burst_Actions(BURST_ABORT, 0, &reply.rc);		/* Abort existing request */
+			break;
+
+		case ZOOCAM_BURST_STATUS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_STATUS()\n", EncodeLogTime(), rname); fflush(logfile); }
+			Burst_Actions(BURST_STATUS, 0, &reply.rc);		/* Query the status */
+			break;
+			
+		case ZOOCAM_BURST_WAIT:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_WAIT(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			Burst_Actions(BURST_WAIT, request.option, &reply.rc);	/* Wait for stripe to occur */
+			break;
+
+		case ZOOCAM_BURST_PRETRIGGER:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_PRETRIGGER()\n", EncodeLogTime(), rname); fflush(logfile); }
+			if (request.data_len < sizeof(PRETRIGGER_PARMS)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(PRETRIGGER_PARMS). Ignoring request.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 3;
+			} else {
+				PRETRIGGER_PARMS *parms;
+				parms = (PRETRIGGER_PARMS *) received_data;
+				reply.rc = Burst_Set_Pretrigger(parms->npre, parms->npost, &pretrigger.npre, &pretrigger.npost);
+				reply.data_len = sizeof(pretrigger);
+				reply_data = (void *) &pretrigger;
+			}
+			break;
+
+		/* option: 1 => stream, 0 => normal burst, <0 => query; optional FILE_SAVE_PARMS for pattern/format */
+		case ZOOCAM_BURST_STREAM:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_STREAM(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if (request.data_len >= sizeof(FILE_SAVE_PARMS)) {
+				FILE_SAVE_PARMS *parms;
+				parms = (FILE_SAVE_PARMS *) received_data;
+				Burst_Set_Stream(request.option, parms->path, parms->format);
+			} else {
+				Burst_Set_Stream(request.option, NULL, FILE_DFLT);
+			}
+			reply.rc = Burst_Stream_Counts(&stream.enabled, &stream.frames, &stream.written, &stream.lost, &stream.pending);
+			reply.data_len = sizeof(stream);
+			reply_data = (void *) &stream;
+			break;
+
+		/* Optional HDR_BRACKET_PARMS starts/stops the bracket; always returns HDR_BRACKET_INFO */
+		case ZOOCAM_HDR_BRACKET:
+			if (request.data_len >= sizeof(HDR_BRACKET_PARMS)) {
+				HDR_BRACKET_PARMS *parms;
+				parms = (HDR_BRACKET_PARMS *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_HDR_BRACKET(%d)\n", EncodeLogTime(), rname, parms->nexp); fflush(logfile); }
+				reply.rc = HDR_Bracket(parms->nexp, parms->exposure, parms->continuous, parms->output, parms->black_level);
+			}
+			HDR_Bracket_Status(&hdr);
+			reply.data_len = sizeof(hdr);
+			reply_data = (void *) &hdr;
+			break;
+
+		case ZOOCAM_AUTOSAVE_STATS:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_AUTOSAVE_STATS(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Autosave_Stats(&autosave, request.option == 1);
+			reply.data_len = sizeof(autosave);
+			reply_data = (void *) &autosave;
+			break;
+
+		/* Optional AUTOSAVE_GATE sets the gate; always returns the settings */
+		case ZOOCAM_AUTOSAVE_GATE:
+			if (request.data_len >= sizeof(AUTOSAVE_GATE)) {
+				AUTOSAVE_GATE *parms;
+				parms = (AUTOSAVE_GATE *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_AUTOSAVE_GATE(%d,%g,%g)\n", EncodeLogTime(), rname, parms->enable, parms->threshold, parms->max_interval); fflush(logfile); }
+				reply.rc = Autosave_Gate(parms, &gate);
+			} else {
+				reply.rc = Autosave_Gate(NULL, &gate);
+			}
+			reply.data_len = sizeof(gate);
+			reply_data = (void *) &gate;
+			break;
+
+		/* Optional ACCUM_PARMS starts/stops the accumulator; always returns ACCUM_INFO */
+		case ZOOCAM_ACCUMULATE:
+			if (request.data_len >= sizeof(ACCUM_PARMS)) {
+				ACCUM_PARMS *parms;
+				parms = (ACCUM_PARMS *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_ACCUMULATE(%d,%d)\n", EncodeLogTime(), rname, parms->mode, parms->nframes); fflush(logfile); }
+				reply.rc = Accum_Start(parms->mode, parms->nframes);
+			}
+			Accum_Status(&accum);
+			reply.data_len = sizeof(accum);
+			reply_data = (void *) &accum;
+			break;
+
+		/* Optional CALIB_PARMS performs one action; always returns CALIB_INFO */
+		case ZOOCAM_CALIBRATE:
+			if (request.data_len >= sizeof(CALIB_PARMS)) {
+				CALIB_PARMS *parms;
+				parms = (CALIB_PARMS *) received_data;
+				parms->path[sizeof(parms->path)-1] = '\0';
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_CALIBRATE(%d,%d,\"%s\")\n", EncodeLogTime(), rname, parms->action, parms->value, parms->path); fflush(logfile); }
+				switch (parms->action) {
+					case CALIB_CAPTURE:
+						reply.rc = Calib_Capture(parms->value); break;
+					case CALIB_ENABLE:
+						reply.rc = Calib_Enable(parms->value); break;
+					case CALIB_SAVE:
+						reply.rc = Calib_Save(parms->path); break;
+					case CALIB_LOAD:
+						reply.rc = Calib_Load(parms->path); break;
+					default:
+						break;
 				}
-				reply.rc = Camera_SetTriggerMode(NULL, request.option, &trigger_info);
-				reply.data_len = sizeof(trigger_info);
-				reply_data = (void *) &trigger_info;
-				break;
-
-			case ZOOCAM_TRIGGER:
-				fprintf(logfile, "%s %s: ZOOCAM_TRIGGER()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Camera_Trigger(NULL);
-				break;
-
-			case ZOOCAM_RING_GET_INFO:
-				fprintf(logfile, "%s %s: ZOOCAM_RING_GET_INFO()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Remote_Ring_Actions(RING_GET_INFO, 0, &ring_info);
-				reply.data_len   = sizeof(ring_info);
-				reply_data = (void *) &ring_info;
-				break;
-				
-			case ZOOCAM_RING_GET_SIZE:
-				fprintf(logfile, "%s %s: ZOOCAM_RING_GET_SIZE()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Remote_Ring_Actions(RING_GET_SIZE, 0, NULL);
-				break;
-
-			case ZOOCAM_RING_SET_SIZE:
-				fprintf(logfile, "%s %s: ZOOCAM_RING_SET_SIZE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				reply.rc = Remote_Ring_Actions(RING_SET_SIZE, request.option, NULL);
-				break;
-
-			case ZOOCAM_RING_RESET_COUNT:
-				fprintf(logfile, "%s %s: ZOOCAM_RING_RESET_COUNT\n", EncodeLogTime(), rname); fflush(logfile);
-				Camera_ResetRingCounters(NULL);
-				break;
-				
-			case ZOOCAM_RING_GET_FRAME_CNT:
-				fprintf(logfile, "%s %s: ZOOCAM_RING_GET_FRAME_CNT()\n", EncodeLogTime(), rname); fflush(logfile);
-				reply.rc = Remote_Ring_Actions(RING_GET_ACTIVE_CNT, 0, NULL);
-				break;
-
-			case ZOOCAM_BURST_ARM:
-				fprintf(logfile, "%s %s: ZOOCAM_BURST_ARM()\n", EncodeLogTime(), rname); fflush(logfile);
-				Burst_Actions(BURST_ARM, 0, &reply.rc);			/* Arm the burst */
-				break;
-
-			case ZOOCAM_BURST_ABORT:
-				fprintf(logfile, "%s %s: ZOOCAM_BURST_ABORT()\n", EncodeLogTime(), rname); fflush(logfile);
-				Burst_Actions(BURST_ABORT, 0, &reply.rc);		/* Abort existing request */
-				break;
-
-			case ZOOCAM_BURST_STATUS:
-				fprintf(logfile, "%s %s: ZOOCAM_BURST_STATUS()\n", EncodeLogTime(), rname); fflush(logfile);
-				Burst_Actions(BURST_STATUS, 0, &reply.rc);		/* Query the status */
-				break;
-				
-			case ZOOCAM_BURST_WAIT:
-				fprintf(logfile, "%s %s: ZOOCAM_BURST_WAIT(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				Burst_Actions(BURST_WAIT, request.option, &reply.rc);	/* Wait for stripe to occur */
-				break;
-				
-			/* 0 => off, 1 => on, otherwise no change; returns current on/off BOOL state */
-			case ZOOCAM_LED_SET_STATE:
-				fprintf(logfile, "%s %s: ZOOCAM_LED_SET_STATE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile);
-				reply.rc = Keith224_Output(request.option);
-				break;
-
-			default:
-				fprintf(logfile, "%s ERROR: ZooCam server message received (%d) that was not recognized.\n"
-						  "       Will be ignored with rc=-1 return code.\n", EncodeLogTime(), request.msg);
-			 fflush(logfile);
-				reply.rc = -1;
-				break;
-		}
-		ReleaseMutex(ZooCam_Server_Mutex);
-		if (received_data != NULL) { free(received_data); received_data = NULL; }
+			}
+			Calib_Status(&calib);
+			reply.data_len = sizeof(calib);
+			reply_data = (void *) &calib;
+			break;
+
+		/* Optional DEFECT_PARMS performs one action; always returns DEFECT_INFO */
+		case ZOOCAM_DEFECTS:
+			if (request.data_len >= sizeof(DEFECT_PARMS)) {
+				DEFECT_PARMS *parms;
+				parms = (DEFECT_PARMS *) received_data;
+				parms->path[sizeof(parms->path)-1] = '\0';
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_DEFECTS(%d,%d,%g,\"%s\")\n", EncodeLogTime(), rname, parms->action, parms->value, parms->threshold, parms->path); fflush(logfile); }
+				switch (parms->action) {
+					case DEFECT_BUILD:
+						reply.rc = Defect_Build(parms->value, parms->threshold); break;
+					case DEFECT_ENABLE:
+						reply.rc = Defect_Enable(parms->value); break;
+					case DEFECT_SAVE:
+						reply.rc = Defect_Save(parms->path); break;
+					case DEFECT_LOAD:
+						reply.rc = Defect_Load(parms->path); break;
+					case DEFECT_CLEAR:
+						reply.rc = Defect_Clear(); break;
+					default:
+						break;
+				}
+			}
+			Defect_Status(&defect);
+			reply.data_len = sizeof(defect);
+			reply_data = (void *) &defect;
+			break;
+
+		case ZOOCAM_ROI_STREAM:
+			if (request.data_len >= sizeof(ROI_STREAM_PARMS)) {
+				ROI_STREAM_PARMS *parms;
+				parms = (ROI_STREAM_PARMS *) received_data;
+				parms->def.name[sizeof(parms->def.name)-1] = '\0';
+				parms->path[sizeof(parms->path)-1] = '\0';
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_ROI_STREAM(%d,\"%s\",%d,%d,%d,%d,%d,%d)\n", EncodeLogTime(), rname, parms->action, parms->def.name, parms->def.ulx, parms->def.uly, parms->def.width, parms->def.height, parms->def.bin, parms->seq); fflush(logfile); }
+				switch (parms->action) {
+					case ROI_ADD:
+						reply.rc = ROI_Stream_Add(&parms->def); break;
+					case ROI_REMOVE:
+						reply.rc = ROI_Stream_Remove(parms->def.name); break;
+					case ROI_SAVE:
+						reply.rc = ROI_Stream_Save(parms->def.name, parms->seq, parms->path); break;
+					default:
+						break;
+				}
+			}
+			if ( (image_data = calloc(ROI_MAX_STREAMS, sizeof(ROI_STREAM_INFO))) != NULL) {
+				reply.data_len = min(ROI_Stream_List(image_data, ROI_MAX_STREAMS), ROI_MAX_STREAMS) * sizeof(ROI_STREAM_INFO);
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_ROI_FRAME:
+			if (request.data_len < sizeof(ROI_FRAME_PARMS)) {
+				reply.rc = 2;
+			} else {
+				ROI_FRAME_PARMS *parms;
+				parms = (ROI_FRAME_PARMS *) received_data;
+				parms->name[sizeof(parms->name)-1] = '\0';
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_ROI_FRAME(\"%s\",%d,%d)\n", EncodeLogTime(), rname, parms->name, parms->seq, parms->msTimeout); fflush(logfile); }
+				reply.rc = ROI_Stream_GetFrame(parms->name, parms->seq, min(parms->msTimeout, ZOOCAM_ROI_FRAME_WAIT), (ROI_FRAME_INFO **) &image_data, &length);
+				reply.data_len = length;
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_SET_BINNING:
+			if (request.data_len >= sizeof(BINNING_PARMS)) {
+				BINNING_PARMS *parms;
+				parms = (BINNING_PARMS *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SET_BINNING(%d,%d)\n", EncodeLogTime(), rname, parms->bin, parms->bSoftware); fflush(logfile); }
+				reply.rc = Camera_SetBinning(NULL, parms->bin, parms->bSoftware, &binning);
+			} else {
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SET_BINNING()\n", EncodeLogTime(), rname); fflush(logfile); }
+				reply.rc = Camera_SetBinning(NULL, 0, FALSE, &binning);
+			}
+			reply.data_len = sizeof(binning);
+			reply_data = (void *) &binning;
+			break;
+
+		case ZOOCAM_MULTI_CAMERA:
+			if (request.data_len >= sizeof(MULTI_CAMERA_PARMS)) {
+				MULTI_CAMERA_PARMS *parms;
+				parms = (MULTI_CAMERA_PARMS *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_MULTI_CAMERA(%d,%d,%d)\n", EncodeLogTime(), rname, parms->action, parms->id, parms->nBuf); fflush(logfile); }
+				switch (parms->action) {
+					case MULTI_START:
+						reply.rc = Multi_Camera_Start(parms->id, parms->nBuf); break;
+					case MULTI_STOP:
+						reply.rc = Multi_Camera_Stop(parms->id); break;
+					default:
+						break;
+				}
+			}
+			if ( (n = Multi_Camera_List(NULL, 0)) > 0 && (image_data = calloc(n, sizeof(MULTI_CAMERA_INFO))) != NULL) {
+				reply.data_len = min(Multi_Camera_List(image_data, n), n) * sizeof(MULTI_CAMERA_INFO);
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_MULTI_IMAGE:
+			if (request.data_len < sizeof(MULTI_IMAGE_PARMS)) {
+				reply.rc = 2;
+			} else {
+				MULTI_IMAGE_PARMS *parms;
+				parms = (MULTI_IMAGE_PARMS *) received_data;
+				if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_MULTI_IMAGE(%d,%d)\n", EncodeLogTime(), rname, parms->id, parms->frame); fflush(logfile); }
+				reply.rc = Multi_Camera_GetImage(parms->id, parms->frame, (MULTI_FRAME_INFO **) &image_data, &length);
+				reply.data_len = length;
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
 
-		/* Send the standard response and any associated data */
-		fprintf(logfile, "%s %s: Standard block return  rc=%d data_len=%d data=%p\n", EncodeLogTime(), rname, reply.rc, reply.data_len, reply_data); fflush(logfile);
-		if (SendStandardServerResponse(block, reply, reply_data) != 0) {
-			fprintf(logfile, "%s ERROR: ZooCam server failed to send response we requested.\n", EncodeLogTime());
+		case ZOOCAM_MULTI_ALIGN:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_MULTI_ALIGN(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			if ( (image_data = calloc(MULTI_MAX_CAMERAS, sizeof(MULTI_ALIGN_INFO))) != NULL) {
+				reply.data_len = min(Multi_Camera_Align(request.option, image_data, MULTI_MAX_CAMERAS), MULTI_MAX_CAMERAS) * sizeof(MULTI_ALIGN_INFO);
+				reply_data = (void *) image_data;
+				free_reply_data = TRUE;
+			}
+			break;
+
+		case ZOOCAM_BURST_MARK:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_BURST_MARK()\n", EncodeLogTime(), rname); fflush(logfile); }
+			Burst_Actions(BURST_MARK, 0, &reply.rc);			/* Freeze the pre-trigger segment */
+			break;
+
+		case ZOOCAM_SEGMENT_INFO:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SEGMENT_INFO()\n", EncodeLogTime(), rname); fflush(logfile); }
+			reply.rc = Remote_Get_Segment_Info(&image_data, &length);
+			reply.data_len = length;
+			reply_data = (void *) image_data;
+			free_reply_data = TRUE;
+			break;
+
+		case ZOOCAM_SEGMENT_DATA:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SEGMENT_DATA(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Remote_Get_Segment_Data(request.option, &image_data, &length);
+			reply.data_len = length;
+			reply_data = (void *) image_data;
+			free_reply_data = TRUE;
+			break;
+
+		case ZOOCAM_SEGMENT_SAVE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_SEGMENT_SAVE()\n", EncodeLogTime(), rname); fflush(logfile); }
+			if (request.data_len < sizeof(FILE_SAVE_PARMS)) {
+				fprintf(logfile, "%s %s: data_len < sizeof(FILE_SAVE_PARMS). Skipping save.\n", EncodeLogTime(), rname); fflush(logfile);
+				reply.rc = 1;
+			} else {
+				FILE_SAVE_PARMS *parms;
+				parms = (FILE_SAVE_PARMS *) received_data;
+				reply.rc = Burst_Save_Segment(parms->path);
+			}
+			break;
+			
+		/* 0 => off, 1 => on, otherwise no change; returns current on/off BOOL state */
+		case ZOOCAM_LED_SET_STATE:
+			if (log_level >= ZOOCAM_LOG_VERBOSE) { fprintf(logfile, "%s %s: ZOOCAM_LED_SET_STATE(%d)\n", EncodeLogTime(), rname, request.option); fflush(logfile); }
+			reply.rc = Keith224_Output(request.option);
+			break;
+
+		/* <0 => query only; returns previous level */
+		case ZOOCAM_SET_LOG_LEVEL:
+			reply.rc = ZooCam_Server_Log_Level(request.option);
+			fprintf(logfile, "%s %s: ZOOCAM_SET_LOG_LEVEL(%d) [was %d]\n", EncodeLogTime(), rname, request.option, reply.rc); fflush(logfile);
+			break;
+
+		default:
+			fprintf(logfile, "%s ERROR: ZooCam server message received (%d) that was not recognized.\n"
+					  "       Will be ignored with rc=-1 return code.\n", EncodeLogTime(), request.msg);
 		 fflush(logfile);
-		}
-		if (free_reply_data && reply_data != NULL) free(reply_data);
-		fprintf(logfile, "%s %s: Transaction complete\n", EncodeLogTime(), rname); fflush(logfile);
+			reply.rc = -1;
+			break;
 	}
+	if (bLocked) ReleaseMutex(ZooCam_Server_Mutex);
+	Perf_TraceEnd("Server request", -1);
+
+	/* Summary of the transaction goes to the log ring from server_msg_monitor() once sent */
+	memcpy(reply_out, &reply, sizeof(reply));
+	*reply_data_out = reply_data;
+	*free_reply     = free_reply_data;
+	return;
+}
 
-	EndServerHandler(block);								/* Cleanly exit the server structure always */
-	return 0;
+/* ===========================================================================
+-- Classify requests for the event server
+--
+-- Usage: int server_msg_class(CS_MSG *request);
+--
+-- Inputs: request - request just received
+--
+-- Output: none
+--
+-- Return: SERVER_CONCURRENT for queries that may overlap other requests
+--         from the same client, SERVER_ORDERED for everything that changes
+--         state (these run in the order sent, after earlier requests finish)
+--         Either is or'd with SERVER_BLOCKING if the handler can wait on
+--         ZooCam_Server_Mutex or an event, so it runs off the worker pool,
+--         and with ZOOCAM_CLASS_LOCKED if the handler takes the mutex
+=========================================================================== */
+static int server_msg_class(CS_MSG *request) {
+	int blocking;
+
+	blocking = server_msg_locked(request->msg) ? (SERVER_BLOCKING | ZOOCAM_CLASS_LOCKED) : 0 ;
+	if (request->msg == ZOOCAM_BURST_WAIT || request->msg == ZOOCAM_ROI_FRAME || request->msg == ZOOCAM_GET_PROPERTIES) blocking |= SERVER_BLOCKING;
+
+	switch (request->msg) {
+		case ZOOCAM_QUERY_VERSION:
+		case ZOOCAM_GET_CAMERA_INFO:
+		case ZOOCAM_GET_EXPOSURE_PARMS:
+		case ZOOCAM_GET_TRIGGER_MODE:
+		case ZOOCAM_GET_IMAGE_INFO:
+		case ZOOCAM_GET_IMAGE_DATA:
+		case ZOOCAM_GET_IMAGE_SHM:
+		case ZOOCAM_GET_IMAGE_REGION:
+		case ZOOCAM_GET_STATS:
+		case ZOOCAM_RING_GET_INFO:
+		case ZOOCAM_RING_GET_SIZE:
+		case ZOOCAM_RING_GET_FRAME_CNT:
+		case ZOOCAM_BURST_STATUS:
+		case ZOOCAM_BURST_WAIT:
+		case ZOOCAM_BURST_MARK:
+		case ZOOCAM_SEGMENT_INFO:
+		case ZOOCAM_SEGMENT_DATA:
+		case ZOOCAM_ROI_FRAME:
+		case ZOOCAM_GET_PROPERTIES:
+		case ZOOCAM_GET_PERF_STATS:
+		case ZOOCAM_SET_LOG_LEVEL:
+			return SERVER_CONCURRENT | blocking;
+		default:
+			return SERVER_ORDERED | blocking;
+	}
+}
+
+/* ===========================================================================
+-- Does the handler for this request take ZooCam_Server_Mutex?
+--
+-- Usage: BOOL server_msg_locked(int msg);
+--
+-- Return: FALSE for the few requests that touch no camera state
+--
+-- Notes: GET_EXPOSURE_PARMS needs the mutex only when the property cache
+--        does not hold the active camera yet, since the read then queries
+--        the camera.  GET_PROPERTIES may wait for a new version, so it
+--        never holds the mutex; its refill is ordered with camera open and
+--        close by the property refresh lock alone.
+=========================================================================== */
+static BOOL server_msg_locked(int msg) {
+	if (msg == ZOOCAM_GET_EXPOSURE_PARMS) return ! Camera_PropertiesCurrent(NULL);
+	return ! (msg == ZOOCAM_QUERY_VERSION || msg == ZOOCAM_BURST_STATUS || msg == ZOOCAM_BURST_WAIT || 
+				 msg == ZOOCAM_BURST_MARK    || msg == ZOOCAM_SET_LOG_LEVEL  || msg == ZOOCAM_ROI_FRAME  ||
+				 msg == ZOOCAM_GET_PROPERTIES || msg == ZOOCAM_GET_PERF_STATS || msg == ZOOCAM_TRACE);
 }
 
 
@@ -431,12 +950,15 @@ static int Remote_Get_Camera_Info(CAMERA_INFO *info) {
 --       and camera has capbility
 --    3) If MODIFY_EXPOSURE is given without MODIFY_FPS, maximum FPS inferred
 --    4) MODIFY_BLUE_GAIN on a monochrome camera is a NOP
+--    5) All changes go to the camera as one batch between two frames
+--       (see Camera_ApplySettings)
 =========================================================================== */
 static int Remote_Set_Exposure_Parms(int options, EXPOSURE_PARMS *request, EXPOSURE_PARMS *actual) {
 	static char *rname = "Remote_Set_Exposure_Parms";
 
 	EXPOSURE_PARMS mine;
-	double rvals[4];
+	CAMERA_SETTINGS settings;
+	CAMERA_PROPS props;
 
 	/* Set response code to -1 to indicate major error */
 	if (actual == NULL) actual = &mine;							/* So don't have to check */
@@ -445,33 +967,31 @@ static int Remote_Set_Exposure_Parms(int options, EXPOSURE_PARMS *request, EXPOS
 	/* If we don't have data, we can't have any options for setting */
 	if (request == NULL) options = 0;
 
-	/* Should we change gamma? */
-	if (options & MODIFY_GAMMA) Camera_SetGamma(NULL, request->gamma);
-
-	/* Modify any of the gains */
-	if (options & (MODIFY_MASTER_GAIN | MODIFY_RED_GAIN | MODIFY_GREEN_GAIN | MODIFY_BLUE_GAIN)) {
-		if (options & MODIFY_MASTER_GAIN) Camera_SetGains(NULL, M_CHAN, IS_VALUE, request->master_gain);
-		if (options & MODIFY_RED_GAIN)    Camera_SetGains(NULL, R_CHAN, IS_VALUE, request->red_gain);
-		if (options & MODIFY_GREEN_GAIN)  Camera_SetGains(NULL, G_CHAN, IS_VALUE, request->green_gain);
-		if (options & MODIFY_BLUE_GAIN)   Camera_SetGains(NULL, B_CHAN, IS_VALUE, request->blue_gain);
+	/* Stage everything requested and apply it in one batch (MODIFY_* and SETTING_* bits agree) */
+	if (options != 0) {
+		memset(&settings, 0, sizeof(settings));
+		settings.modify   = options & (MODIFY_EXPOSURE | MODIFY_FPS | MODIFY_GAMMA | MODIFY_MASTER_GAIN | MODIFY_RED_GAIN | MODIFY_GREEN_GAIN | MODIFY_BLUE_GAIN);
+		settings.exposure = request->exposure;
+		settings.fps      = request->fps;
+		settings.gamma    = request->gamma;
+		settings.gains[0] = request->master_gain;
+		settings.gains[1] = request->red_gain;
+		settings.gains[2] = request->green_gain;
+		settings.gains[3] = request->blue_gain;
+		Camera_ApplySettings(NULL, &settings, SETTING_FRAME_WAIT);
 	}
 
-	/* First set FPS if requested with expectation that EXPOSURE may need to change */
-	if (options & (MODIFY_EXPOSURE || MODIFY_FPS)) {
-		if (options & MODIFY_FPS)      Camera_SetFPSControl(NULL, request->fps);
-		if (options & MODIFY_EXPOSURE) Camera_SetExposure(NULL, request->exposure);
+	/* Retrieve the current values now (one consistent copy from the property cache) */
+	if (Camera_GetProperties(NULL, &props) != 1) {
+		actual->exposure    = props.exposure;
+		actual->fps         = props.fps;
+		actual->gamma       = props.gamma;
+		actual->master_gain = props.gains[0];
+		actual->red_gain    = props.gains[1];
+		actual->green_gain  = props.gains[2];
+		actual->blue_gain   = props.gains[3];
 	}
 
-	/* Retrieve the current values now */
-	actual->exposure = Camera_GetExposure(NULL);
-	actual->fps      = Camera_GetFPSControl(NULL);
-	actual->gamma    = Camera_GetGamma(NULL);
-	Camera_GetGains(NULL, rvals, NULL);
-	actual->master_gain = rvals[0];
-	actual->red_gain    = rvals[1];
-	actual->green_gain  = rvals[2];
-	actual->blue_gain   = rvals[3];
-
 	return 0;
 }
 
@@ -554,15 +1074,578 @@ static int Remote_Get_Image_Info(int frame, IMAGE_INFO *info) {
 static int Remote_Get_Image_Data(int frame, void **image_data, size_t *length) {
 	static char *rname = "Remote_GetCamera_Info";
 
+	int rc, nbytes;
+
+	/* Equivalent to main routine ... the copy is handed back to the client */
+	rc = Camera_CopyImageData(NULL, frame, image_data, &nbytes);
+	*length = (rc == 0) ? nbytes : 0 ;
+	return rc;
+}
+
+/* ===========================================================================
+-- Client/server routine to return a cropped / binned / converted image
+--
+-- Usage: int Remote_Get_Image_Region(REGION_REQUEST *request, void **data, size_t *length);
+--
+-- Inputs: request - frame, window, binning and output format desired
+--         data    - pointer to receive malloc'd buffer (REGION_INFO + pixels)
+--         length  - pointer to receive number of bytes in *data
+--
+-- Output: *data   - REGION_INFO header immediately followed by the pixels
+--                   calling routine responsible to release memory when done
+--         *length - number of bytes in *data
+--
+-- Return: 0 ==> successful
+--           1 ==> no camera initialized
+--           2 ==> frame request invalid
+--           3 ==> window outside the image or smaller than one bin
+--           4 ==> unable to allocate memory
+--           5 ==> frame overwritten while it was being extracted
+=========================================================================== */
+static int Remote_Get_Image_Region(REGION_REQUEST *request, void **data, size_t *length) {
+	static char *rname = "Remote_Get_Image_Region";
+
+	IMAGE_INFO image_info, check;
+	IMAGE_BUFFER src, dst;
+	IMAGE_REGION region;
+	PIXEL_FORMAT format;
+	REGION_INFO *info;
+	size_t nbytes;
+	int rc;
+
+	*data = NULL; *length = 0;
+
+	/* Resolve the frame once so info and data refer to the same image */
+	if ( (rc = Camera_GetImageInfo(NULL, request->frame, &image_info)) != 0) return rc;
+	if (image_info.imageID < 0) return 5;
+	if ( (rc = Camera_GetImageBuffer(NULL, image_info.frame, &src)) != 0) return rc;
+
+	/* Validate the region and figure out how big the answer will be */
+	region.ulx = request->ulx;			region.uly = request->uly;
+	region.width = request->width;	region.height = request->height;
+	region.bin = request->bin;			region.bDecimate = request->bDecimate;
+	format = (request->format == REGION_MONO8) ? PIXEL_MONO8 : (request->format == REGION_RGB24) ? PIXEL_RGB24 : PIXEL_MONO16 ;
+	if (IP_RegionGeometry(&src, &region, format, &dst) != 0) return 3;
+
+	nbytes = (size_t) dst.pitch * dst.height;
+	if ( (info = calloc(1, sizeof(*info)+nbytes)) == NULL) return 4;
+	dst.data = (void *) (info+1);
+	if (IP_ExtractRegion(&src, &region, &dst) != 0) { free(info); return 4; }
+	if (Camera_GetImageInfo(NULL, image_info.frame, &check) != 0 || check.imageID != image_info.imageID) { free(info); return 5; }
+
+	info->frame       = image_info.frame;
+	info->ulx         = region.ulx;			info->uly        = region.uly;
+	info->src_width   = region.width;		info->src_height = region.height;
+	info->width       = dst.width;			info->height     = dst.height;
+	info->bin         = region.bin;
+	info->bDecimate   = region.bDecimate;
+	info->format      = request->format;
+	info->bBayer      = (dst.format == PIXEL_BAYER16);
+	info->bytes_per_pixel = IP_BytesPerPixel(dst.format);
+	info->bit_depth   = dst.bit_depth;
+	info->pitch       = dst.pitch;
+	info->timestamp   = image_info.timestamp;
+	info->camera_time = image_info.camera_time;
+
+	*data   = (void *) info;
+	*length = sizeof(*info)+nbytes;
+	return 0;
+}
+
+/* ===========================================================================
+-- Client/server routine to hand a same-host client the shared frame ring
+--
+-- Usage: int Remote_Shm_Attach(SHM_ATTACH_INFO *attach);
+--
+-- Inputs: attach - structure to receive name and size of the ring
+--
+-- Output: Creates the ring on the first request.  Slots are sized for a
+--         full sensor frame in the current pixel format.
+--
+-- Return: 0 ==> successful
+--           1 ==> no camera initialized
+--           5 ==> unable to create the shared memory
+--
+-- Notes: Called holding ZooCam_Server_Mutex (ordered request)
+=========================================================================== */
+static int Remote_Shm_Attach(SHM_ATTACH_INFO *attach) {
+	static char *rname = "Remote_Shm_Attach";
+
+	CAMERA_INFO camera;
+	IMAGE_BUFFER buffer;
+	size_t slot_bytes;
+	int bpp;
+
+	memset(attach, 0, sizeof(*attach));
+
+	if (ZooCam_Frame_Ring == NULL) {
+		if (Camera_GetCameraInfo(NULL, &camera) != 0) return 1;
+
+		/* Full sensor in the current format, or current frame if that is bigger */
+		bpp = 3;
+		slot_bytes = 0;
+		if (Camera_GetImageBuffer(NULL, -1, &buffer) == 0) {
+			if (IP_BytesPerPixel(buffer.format) > 0) bpp = IP_BytesPerPixel(buffer.format);
+			slot_bytes = (size_t) buffer.pitch * buffer.height;
+		}
+		slot_bytes = max(slot_bytes, (size_t) camera.width * camera.height * bpp);
+		slot_bytes = (slot_bytes + 4095) & ~((size_t) 4095);
+
+		sprintf_s(ZooCam_Frame_Ring_Info.name, sizeof(ZooCam_Frame_Ring_Info.name), "ZooCam_Frames_%lu", (unsigned long) GetCurrentProcessId());
+		if ( (ZooCam_Frame_Ring = CreateSharedRing(ZooCam_Frame_Ring_Info.name, ZOOCAM_SHM_SLOTS, slot_bytes)) == NULL) {
+			fprintf(stderr, "%s ERROR[%s]: Unable to create shared frame ring (%d x %u bytes)\n", EncodeLogTime(), rname, ZOOCAM_SHM_SLOTS, (unsigned) slot_bytes); fflush(stderr);
+			return 5;
+		}
+		ZooCam_Frame_Ring_Info.nslots     = ZOOCAM_SHM_SLOTS;
+		ZooCam_Frame_Ring_Info.slot_bytes = (uint32_t) slot_bytes;
+	}
+
+	*attach = ZooCam_Frame_Ring_Info;
+	return 0;
+}
+
+/* ===========================================================================
+-- Client/server routine to publish a frame into the shared ring
+--
+-- Usage: int Remote_Get_Image_Shm(int frame, SHM_FRAME *shm);
+--
+-- Inputs: frame - which frame of data (-1 for current)
+--         shm   - structure to receive image info and ring location
+--
+-- Output: Copies the frame into the next ring slot (unless the same camera
+--         imageID is already in the ring) and reports the slot and sequence
+--
+-- Notes: Computed frames (FRAME_HDR, FRAME_MEAN, FRAME_VARIANCE) are always
+--        copied, since their contents change without a new imageID
+--
+-- Return: 0 ==> successful
+--           1 ==> no camera initialized
+--           2 ==> frame request invalid
+--           3 ==> frame larger than a ring slot (use ZOOCAM_GET_IMAGE_DATA)
+--           5 ==> no shared ring (client must ZOOCAM_SHM_ATTACH first)
+=========================================================================== */
+static int Remote_Get_Image_Shm(int frame, SHM_FRAME *shm) {
+	static char *rname = "Remote_Get_Image_Shm";
+
 	void *image_memory;
+	int rc, length, slot;
+	int32_t sequence;
+	BOOL bCopy;
+
+	memset(shm, 0, sizeof(*shm));
+	shm->slot = -1;
+	if (ZooCam_Frame_Ring == NULL) return 5;
+
+	/* Resolve the frame once so info and data refer to the same image */
+	if ( (rc = Camera_GetImageInfo(NULL, frame, &shm->info)) != 0) return rc;
+	frame = (int) shm->info.frame;
+	bCopy = frame == FRAME_HDR || frame == FRAME_MEAN || frame == FRAME_VARIANCE;		/* Not shared, only as a copy */
+	if (bCopy) {
+		rc = Camera_CopyImageData(NULL, shm->info.frame, &image_memory, &length);
+	} else {
+		rc = Camera_GetImageData(NULL, shm->info.frame, &image_memory, &length);
+	}
+	if (rc != 0) return rc;
+	if (image_memory == NULL || length <= 0) return 2;
+
+	/* Only ring frames are fixed for a given imageID; computed frames (HDR,
+	 * mean, variance) are rebuilt in place and must never be deduplicated */
+	rc = SharedRingPublish(ZooCam_Frame_Ring, bCopy ? -1 : shm->info.imageID, image_memory, length, &slot, &sequence);
+	if (bCopy) free(image_memory);
+	switch (rc) {
+		case 0:  break;
+		case 2:  return 3;
+		default: return 5;
+	}
+	shm->slot     = slot;
+	shm->sequence = sequence;
+	shm->length   = length;
+	return 0;
+}
+
+/* ===========================================================================
+-- Locate the ring frame currently holding a specific image
+--
+-- Usage: int Remote_Find_Frame(int imageID);
+--
+-- Inputs: imageID - unique ID of the image (from IMAGE_INFO)
+--
+-- Output: none
+--
+-- Return: frame index in the ring, or -1 if no longer present
+=========================================================================== */
+static int Remote_Find_Frame(int imageID) {
+	static char *rname = "Remote_Find_Frame";
+
+	RING_INFO rings;
+	IMAGE_INFO info;
+	int i, frame;
+
+	if (Camera_GetRingInfo(NULL, &rings) != 0 || rings.nBuffers <= 0) return -1;
+
+	/* Start at the most recent and work backwards ... usual request is recent */
+	for (i=0; i<rings.nBuffers; i++) {
+		frame = (rings.iLast - i + rings.nBuffers) % rings.nBuffers;
+		if (Camera_GetImageInfo(NULL, frame, &info) == 0 && info.imageID == imageID) return frame;
+	}
+	return -1;
+}
+
+/* ===========================================================================
+-- Client/server routine to compute statistics on an image
+--
+-- Usage: int Remote_Get_Stats(STATS_REQUEST *request, void **data, size_t *length);
+--
+-- Inputs: request - which image and which optional arrays
+--         data    - pointer to receive malloc'd buffer (IMAGE_STATS + arrays)
+--         length  - pointer to receive number of bytes in *data
+--
+-- Output: *data   - IMAGE_STATS header followed by the requested arrays
+--                   calling routine responsible to release memory when done
+--         *length - number of bytes in *data
+--
+-- Return: 0 ==> successful
+--           1 ==> no camera initialized
+--           2 ==> frame request invalid (or imageID not in ring)
+--           3 ==> unsupported image format
+--           4 ==> unable to allocate memory
+--           5 ==> frame overwritten while the statistics were computed
+--
+-- Notes: The last result is kept and returned again (copied) when the
+--        same image is requested with the same parameters.  Statistics
+--        are computed in place on the ring and kept only if the imageID
+--        is unchanged afterwards.  All calls come
+--        from server_msg_handler holding ZooCam_Server_Mutex.
+=========================================================================== */
+static struct {
+	int imageID, flags, hist_bins, threshold;
+	IMAGE_STATS *stats;
+} stats_cache = { -1, 0, 0, 0, NULL };
+
+static int Remote_Get_Stats(STATS_REQUEST *request, void **data, size_t *length) {
+	static char *rname = "Remote_Get_Stats";
+
+	IMAGE_INFO image_info, check;
+	IMAGE_BUFFER src;
+	IP_STATS ip;
+	IMAGE_STATS *stats;
+	int rc, frame, nbins, full_bins, shift;
+	size_t nbytes;
+	LONGLONG t_stats;
+
+	*data = NULL; *length = 0;
+
+	/* Resolve the image to a frame */
+	frame = request->frame;
+	if (request->imageID >= 0 && (frame = Remote_Find_Frame(request->imageID)) < 0) return 2;
+	if ( (rc = Camera_GetImageInfo(NULL, frame, &image_info)) != 0) return rc;
+	if (image_info.imageID < 0) return 5;
+
+	/* Serve from the cache if nothing has changed */
+	if (stats_cache.stats != NULL && image_info.imageID >= 0 && stats_cache.imageID == image_info.imageID && 
+		 stats_cache.flags == request->flags && stats_cache.hist_bins == request->hist_bins && stats_cache.threshold == request->threshold) {
+		if ( (*data = malloc(stats_cache.stats->total_bytes)) == NULL) return 4;
+		memcpy(*data, stats_cache.stats, stats_cache.stats->total_bytes);
+		((IMAGE_STATS *) *data)->frame = image_info.frame;				/* Image may have been found in a new slot */
+		*length = stats_cache.stats->total_bytes;
+		return 0;
+	}
+
+	if ( (rc = Camera_GetImageBuffer(NULL, image_info.frame, &src)) != 0) return rc;
+	if (IP_StatsChannels(&src) == 0 || (full_bins = IP_StatsHistBins(&src, 0)) == 0) return 3;
+
+	/* Pick the shift so the histogram has at most the requested number of bins */
+	nbins = (request->hist_bins <= 0 || request->hist_bins > STATS_MAX_HIST_BINS) ? STATS_MAX_HIST_BINS : request->hist_bins ;
+	for (shift=0; IP_StatsHistBins(&src, shift) > nbins; shift++) ;
+	nbins = IP_StatsHistBins(&src, shift);
+
+	/* Lay out the reply block */
+	nbytes = sizeof(IMAGE_STATS);
+	if (request->flags & STATS_HISTOGRAM) nbytes += IP_StatsChannels(&src)*nbins*sizeof(uint32_t);
+	if (request->flags & STATS_PROFILES)  nbytes += (src.width+src.height)*sizeof(float);
+	if ( (stats = calloc(1, nbytes)) == NULL) return 4;
+
+	stats->flags = request->flags & (STATS_HISTOGRAM | STATS_PROFILES);
+	nbytes = sizeof(IMAGE_STATS);
+	if (stats->flags & STATS_HISTOGRAM) { stats->hist_offset = (uint32_t) nbytes; nbytes += IP_StatsChannels(&src)*nbins*sizeof(uint32_t); }
+	if (stats->flags & STATS_PROFILES)  { stats->col_offset  = (uint32_t) nbytes; nbytes += src.width*sizeof(float); 
+													  stats->row_offset  = (uint32_t) nbytes; nbytes += src.height*sizeof(float); }
+	stats->total_bytes = (uint32_t) nbytes;
+
+	/* One pass over the raw data does all the work */
+	t_stats = Perf_Start();
+	rc = IP_ComputeStats(&src, shift, request->threshold, &ip, 
+								stats->hist_offset ? (uint32_t *) ((char *) stats + stats->hist_offset) : NULL,
+								stats->col_offset  ? (float *)    ((char *) stats + stats->col_offset)  : NULL,
+								stats->row_offset  ? (float *)    ((char *) stats + stats->row_offset)  : NULL);
+	Perf_Stop(PERF_STATISTICS, t_stats);
+	if (rc != 0) { free(stats); return (rc == 2) ? 4 : 3; }
+
+	/* Neither cache nor return numbers from a slot that was rewritten under us */
+	if (Camera_GetImageInfo(NULL, image_info.frame, &check) != 0 || check.imageID != image_info.imageID) {
+		free(stats);
+		Perf_Count(PERF_FRAMES_OVERWRITTEN, 1);
+		return 5;
+	}
+
+	stats->frame       = image_info.frame;
+	stats->imageID     = image_info.imageID;
+	stats->timestamp   = image_info.timestamp;
+	stats->camera_time = image_info.camera_time;
+	stats->width       = src.width;
+	stats->height      = src.height;
+	stats->bit_depth   = src.bit_depth;
+	stats->nchannels   = ip.nchannels;
+	stats->max_value   = ip.max_value;
+	memcpy(stats->npixels,   ip.npixels,   sizeof(stats->npixels));
+	memcpy(stats->saturated, ip.saturated, sizeof(stats->saturated));
+	memcpy(stats->vmin,      ip.vmin,      sizeof(stats->vmin));
+	memcpy(stats->vmax,      ip.vmax,      sizeof(stats->vmax));
+	memcpy(stats->mean,      ip.mean,      sizeof(stats->mean));
+	stats->threshold   = request->threshold;
+	stats->total       = ip.total;
+	stats->centroid_x  = ip.centroid_x;	stats->centroid_y = ip.centroid_y;
+	stats->var_x       = ip.var_x;			stats->var_y      = ip.var_y;			stats->cov_xy = ip.cov_xy;
+	stats->brenner     = ip.brenner;
+	stats->max_gradient = ip.max_gradient;
+	stats->hist_bins   = ip.hist_bins;
+	stats->hist_shift  = ip.hist_shift;
+
+	/* Replace the cached copy and return a duplicate */
+	if (stats_cache.stats != NULL) free(stats_cache.stats);
+	stats_cache.stats     = stats;
+	stats_cache.imageID   = stats->imageID;
+	stats_cache.flags     = request->flags;
+	stats_cache.hist_bins = request->hist_bins;
+	stats_cache.threshold = request->threshold;
+
+	if ( (*data = malloc(stats->total_bytes)) == NULL) return 4;
+	memcpy(*data, stats, stats->total_bytes);
+	*length = stats->total_bytes;
+	return 0;
+}
+
+/* ===========================================================================
+-- Client/server routine to return details of the last pre-trigger segment
+--
+-- Usage: int Remote_Get_Segment_Info(void **data, size_t *length);
+--
+-- Inputs: data   - pointer to receive malloc'd reply block
+--         length - pointer to receive size of the block
+--
+-- Output: *data - SEGMENT_INFO followed by nframes SEGMENT_FRAME_INFO
+--
+-- Return: 0 ==> successful
+--         1 ==> no segment captured yet
+--         4 ==> memory allocation failure
+=========================================================================== */
+static int Remote_Get_Segment_Info(void **data, size_t *length) {
+	static char *rname = "Remote_Get_Segment_Info";
+
+	BURST_SEGMENT *segment;
+	SEGMENT_INFO *info;
+	SEGMENT_FRAME_INFO *frames;
+	int i;
+
+	*data = NULL; *length = 0;
+	if ( (segment = Burst_Lock_Segment()) == NULL) { Burst_Unlock_Segment(); return 1; }
+
+	*length = sizeof(*info) + segment->nframes*sizeof(*frames);
+	if ( (info = calloc(1, *length)) == NULL) { Burst_Unlock_Segment(); *length = 0; return 4; }
+	info->trigger_imageID = segment->trigger_imageID;
+	info->trigger_index   = segment->trigger_index;
+	info->nframes         = segment->nframes;
+	info->nvalid          = segment->nvalid;
+
+	frames = (SEGMENT_FRAME_INFO *) (info+1);
+	for (i=0; i<segment->nframes; i++) {
+		if (segment->frames[i].data == NULL) {
+			frames[i].info.imageID = -1;
+			continue;
+		}
+		frames[i].info       = segment->frames[i].info;
+		frames[i].latency_ms = segment->frames[i].latency_ms;
+		frames[i].length     = segment->frames[i].length;
+	}
+	Burst_Unlock_Segment();
+
+	*data = info;
+	return 0;
+}
+
+/* ===========================================================================
+-- Client/server routine to return one frame of the pre-trigger segment
+--
+-- Usage: int Remote_Get_Segment_Data(int index, void **data, size_t *length);
+--
+-- Inputs: index  - frame in the segment (0 ... nframes-1)
+--         data   - pointer to receive malloc'd reply block
+--         length - pointer to receive size of the block
+--
+-- Output: *data - SEGMENT_FRAME_INFO followed by the image data
+--
+-- Return: 0 ==> successful
+--         1 ==> no segment captured yet
+--         2 ==> index out of range
+--         3 ==> frame was not captured
+--         4 ==> memory allocation failure
+=========================================================================== */
+static int Remote_Get_Segment_Data(int index, void **data, size_t *length) {
+	static char *rname = "Remote_Get_Segment_Data";
+
+	BURST_SEGMENT *segment;
+	SEGMENT_FRAME *frame;
+	SEGMENT_FRAME_INFO *info;
 	int rc;
 
-	/* Equivalent to main routine ... just call with pointer to WND_INFO * */
-	*image_data = NULL;
-	rc = Camera_GetImageData(NULL, frame, &image_memory, length);
-	if (*length >= 0 && image_memory != NULL) {
-		*image_data = malloc(*length);
-		memcpy(*image_data, image_memory, *length);
+	*data = NULL; *length = 0;
+	if ( (segment = Burst_Lock_Segment()) == NULL) {
+		rc = 1;
+	} else if (index < 0 || index >= segment->nframes) {
+		rc = 2;
+	} else if ( (frame = segment->frames+index)->data == NULL) {
+		rc = 3;
+	} else if ( (info = malloc(sizeof(*info) + frame->length)) == NULL) {
+		rc = 4;
+	} else {
+		info->info       = frame->info;
+		info->latency_ms = frame->latency_ms;
+		info->length     = frame->length;
+		memcpy(info+1, frame->data, frame->length);
+		*data   = info;
+		*length = sizeof(*info) + frame->length;
+		rc = 0;
 	}
+	Burst_Unlock_Segment();
+
+	return rc;
+}
+
+/* ===========================================================================
+-- Select how much the server writes to the log
+--
+-- Usage: int ZooCam_Server_Log_Level(int level);
+--
+-- Inputs: level - ZOOCAM_LOG_ERRORS   (0) ==> only errors
+--                 ZOOCAM_LOG_REQUESTS (1) ==> one line per request (default)
+--                 ZOOCAM_LOG_VERBOSE  (2) ==> also the per-command detail lines
+--                 <0 ==> just query
+--
+-- Output: changes the level immediately
+--
+-- Return: previous level
+--
+-- Notes: Request lines are written in batches by a background thread, so
+--        they cost a few hundred ns on the request path.  Verbose lines are
+--        written synchronously and should only be enabled for debugging.
+=========================================================================== */
+int ZooCam_Server_Log_Level(int level) {
+	int rc;
+
+	rc = log_level;
+	if (level >= 0) log_level = min(level, ZOOCAM_LOG_VERBOSE);
 	return rc;
 }
+
+/* ===========================================================================
+-- Monitor routine called by the event server once a reply has been written
+--
+-- Usage: void server_msg_monitor(CS_MSG *request, CS_MSG *reply, SERVER_TIMING *timing);
+--
+-- Inputs: request - request as received
+--         reply   - reply as sent
+--         timing  - queue, service and send times
+--
+-- Output: Adds one record to the log ring (never blocks).  If the drain thread
+--         has fallen a full ring behind, the record is dropped and counted.
+--         Send time and reply size always go to the PERF_SEND statistics.
+--
+-- Return: none
+=========================================================================== */
+static void server_msg_monitor(CS_MSG *request, CS_MSG *reply, SERVER_TIMING *timing) {
+
+	LOG_SLOT *slot;
+	long head;
+
+	/* Instrumentation sees every reply, whatever the log level */
+	if (timing->sent) {
+		Perf_AddSample(PERF_SEND, timing->send_ms);
+		Perf_Count(PERF_BYTES_SENT, (long) (sizeof(CS_MSG) + reply->data_len));
+	}
+
+	if (log_level < ZOOCAM_LOG_REQUESTS) return;
+
+	/* Claim a slot ... lock-free, multiple workers may be here at once */
+	do {
+		head = log_head;
+		if (head - log_tail >= LOG_RING_SIZE) { InterlockedIncrement(&log_dropped); return; }
+	} while (InterlockedCompareExchange(&log_head, head+1, head) != head);
+
+	slot = log_ring + (head & (LOG_RING_SIZE-1));
+	GetSystemTimeAsFileTime(&slot->record.time);
+	slot->record.msg        = request->msg;
+	slot->record.msgid      = request->msgid;
+	slot->record.option     = request->option;
+	slot->record.rc         = reply->rc;
+	slot->record.bytes_in   = request->data_len;
+	slot->record.bytes_out  = reply->data_len;
+	slot->record.queue_ms   = (float) timing->queue_ms;
+	slot->record.service_ms = (float) timing->service_ms;
+	slot->record.send_ms    = (float) timing->send_ms;
+	slot->record.sent       = timing->sent;
+	InterlockedExchange(&slot->ready, 1);					/* Publish (full barrier) */
+
+	/* Wake the drain thread early only when the ring is getting full */
+	if (head - log_tail == LOG_RING_SIZE/2 && log_event != NULL) SetEvent(log_event);
+	return;
+}
+
+/* ===========================================================================
+-- Background thread that writes the transaction log in batches
+--
+-- Usage: _beginthread(server_log_thread, 0, NULL);
+--
+-- Inputs: none
+--
+-- Output: Every LOG_DRAIN_MS (or sooner if the ring is half full) formats all
+--         published records and writes them with a single fflush()
+--
+-- Return: none (runs forever)
+=========================================================================== */
+static void server_log_thread(void *arg) {
+	static char *rname = "server_log";
+
+	LOG_SLOT *slot;
+	LOG_RECORD rec;
+	FILETIME local;
+	SYSTEMTIME st;
+	FILE *logfile;
+	long dropped;
+	int n;
+
+	while (TRUE) {
+		WaitForSingleObject(log_event, LOG_DRAIN_MS);
+		logfile = (fdebug != NULL) ? fdebug : stderr;
+
+		for (n=0; log_tail != log_head; n++) {
+			slot = log_ring + (log_tail & (LOG_RING_SIZE-1));
+			if (! slot->ready) break;							/* Claimed but not yet filled */
+			rec = slot->record;
+			InterlockedExchange(&slot->ready, 0);
+			InterlockedIncrement(&log_tail);
+
+			FileTimeToLocalFileTime(&rec.time, &local);
+			FileTimeToSystemTime(&local, &st);
+			fprintf(logfile, "%.4d.%.2d%.2d:%.2d:%.2d.%.2d.%.3d %s: msg=%d msgid=%d option=%d rc=%d in=%u out=%u queue=%.3f service=%.3f send=%.3f ms%s\n",
+					  st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds, rname,
+					  rec.msg, rec.msgid, rec.option, rec.rc, rec.bytes_in, rec.bytes_out, 
+					  rec.queue_ms, rec.service_ms, rec.send_ms, rec.sent ? "" : " (not sent)");
+		}
+		if ( (dropped = InterlockedExchange(&log_dropped, 0)) != 0) {
+			fprintf(logfile, "%s %s: %d log records dropped (ring full)\n", EncodeLogTime(), rname, (int) dropped);
+			n++;
+		}
+		if (n > 0) fflush(logfile);
+	}
+	return;
+}
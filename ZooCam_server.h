@@ -1,7 +1,14 @@
 int Init_ZooCam_Server(void);
 int Shutdown_ZooCam_Server(void);
+int ZooCam_Server_Log_Level(int level);
 
 #define	ZOOCAM_SERVER_WAIT	(30000)		/* 30 second time-out */
+#define	ZOOCAM_SERVER_WORKERS	(8)			/* Worker threads servicing client requests (waits run on their own threads) */
+
+/* Transaction log verbosity (ZooCam_Server_Log_Level) */
+#define	ZOOCAM_LOG_ERRORS		(0)			/* Only failures */
+#define	ZOOCAM_LOG_REQUESTS	(1)			/* One line per request, written in batches (default) */
+#define	ZOOCAM_LOG_VERBOSE	(2)			/* Also the per-command detail lines (synchronous) */
 
 /* Typedef's */
 typedef enum _RING_ACTION {RING_GET_INFO=0, RING_GET_SIZE=1, RING_SET_SIZE=2, RING_GET_ACTIVE_CNT=3} RING_ACTION;
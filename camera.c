@@ -46,9 +46,12 @@
 
 /* Load camera specific API for me */
 #include "camera.h"
+#include "image_proc.h"						/* Generic pixel kernels and IMAGE_BUFFER */
+#include "perf.h"								/* Stage latency instrumentation */
 #include "dcx.h"								/* DCX API camera routines & info */
 #define	INCLUDE_MINIMAL_TL
 #include "tl.h"								/* TL  API camera routines & info */
+#include "sim.h"								/* Synthetic camera (load testing) */
 
 #define	INCLUDE_WND_DETAIL_INFO			/* Get all of the typedefs and internal details */
 #include "ZooCam.h"							/* Access to the ZooCam info */
@@ -72,6 +75,16 @@
 /* My internal function prototypes */
 /* ------------------------------- */
 static int GetPreferredImageFormat(HWND hdlg);
+static void props_init(WND_INFO *wnd);
+static BOOL props_current(WND_INFO *wnd);
+static void props_reconcile_thread(void *arglist);
+static double query_exposure(WND_INFO *wnd);
+static int    query_exposure_parms(WND_INFO *wnd, double *ms_min, double *ms_max, double *ms_incr);
+static double query_fps_control(WND_INFO *wnd);
+static double query_gamma(WND_INFO *wnd);
+static int    query_gains(WND_INFO *wnd, double values[4], double slider[4]);
+static int    settings_last_id(WND_INFO *wnd);
+static BOOL   settings_wait_frame(WND_INFO *wnd, int last_id, int msWait);
 
 /* ------------------------------- */
 /* My usage of other external fncs */
@@ -116,6 +129,9 @@ int Camera_GetCameraInfo(WND_INFO *wnd, CAMERA_INFO *info) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetCameraInfo(tl, info);
 			break;
+		case SIM:
+			rc = SIM_GetCameraInfo((SIM_CAMERA *) wnd->Camera.details, info);
+			break;
 		default:
 			if (info != NULL) info->type = CAMERA_UNKNOWN;
 			rc = 1;
@@ -141,33 +157,19 @@ int Camera_GetCameraInfo(WND_INFO *wnd, CAMERA_INFO *info) {
 -- Return: 0 if successful, errors from each camera otherwise
 --
 -- Notes: Not all cameras have a minimum increment; returns 0.001 ms if unknown
+--        Values come from the property cache (see Camera_GetProperties)
 =========================================================================== */
 int Camera_GetExposureParms(WND_INFO *wnd, double *ms_min, double *ms_max, double *ms_incr) {
 	static char *rname = "Camera_GetExposureParms";
 
-	TL_CAMERA  *camera;
-	DCX_CAMERA *dcx;
+	CAMERA_PROPS props;
 	int rc;
-	BOOL bServerRequest;
 
-	/* Make sure we have valid structures */
-	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
-	if (wnd == NULL) return 1;
-
-	switch (wnd->Camera.driver) {
-		case DCX:
-			dcx = (DCX_CAMERA *) wnd->dcx;						/* (DCX_CAMERA *) wnd->Camera.details; */
-			rc = DCx_GetExposureParms(dcx, ms_min, ms_max, ms_incr);
-			break;
-		case TL:
-			camera = (TL_CAMERA *) wnd->Camera.details;
-			rc = TL_GetExposureParms(camera, ms_min, ms_max);
-			*ms_incr = 0.001;											/* Return default value */
-			break;
-		default:
-			rc = 2;
-			break;
-	}
+	/* Served from the property cache */
+	if ( (rc = Camera_GetProperties(wnd, &props)) == 1) return 1;
+	if (ms_min  != NULL) *ms_min  = props.ms_min;
+	if (ms_max  != NULL) *ms_max  = props.ms_max;
+	if (ms_incr != NULL) *ms_incr = props.ms_incr;
 
 	return rc;
 }
@@ -181,35 +183,16 @@ int Camera_GetExposureParms(WND_INFO *wnd, double *ms_min, double *ms_max, doubl
 --
 -- Output: none
 --
--- Return: Current exposure time in milliseconds
+-- Return: Current exposure time in milliseconds (from the property cache)
 =========================================================================== */
 double Camera_GetExposure(WND_INFO *wnd) {
 	static char *rname = "Camera_GetExposure";
 
-	double rval;
-	TL_CAMERA  *camera;
-	DCX_CAMERA *dcx;
-	BOOL bServerRequest;
+	CAMERA_PROPS props;
 
-	/* Make sure we have valid structures */
-	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
-	if (wnd == NULL) return 0;
-
-	switch (wnd->Camera.driver) {
-		case DCX:
-			dcx = (DCX_CAMERA *) wnd->dcx;						/* (DCX_CAMERA *) wnd->Camera.details; */
-			rval = DCx_GetExposure(dcx, FALSE);					/* Just query (not necessary to request) */
-			break;
-		case TL:
-			camera = (TL_CAMERA *) wnd->Camera.details;
-			rval = TL_GetExposure(camera, FALSE);				/* Just query (not necessary to request) */
-			break;
-		default:
-			rval = 1.0;
-			break;
-	}
-
-	return rval;
+	/* Served from the property cache */
+	if (Camera_GetProperties(wnd, &props) == 1) return 0;
+	return props.exposure;
 }
 
 /* ===========================================================================
@@ -247,11 +230,20 @@ double Camera_SetExposure(WND_INFO *wnd, double ms_expose) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			ms_expose = TL_SetExposure(camera, ms_expose);
 			break;
+		case SIM:
+			ms_expose = SIM_SetExposure((SIM_CAMERA *) wnd->Camera.details, ms_expose);
+			break;
 
 		default:
 			break;
 	}
 
+	/* Scaled calibration dark ready before the new frames arrive */
+	Calib_SetExposure(wnd, ms_expose, -1);
+
+	/* Exposure may also move the framerate */
+	Camera_RefreshProperties(wnd, PROP_EXPOSURE | PROP_FPS);
+
 	/* Server can't modify dialog box, so help here */
 	/* Update exposure, but also deal with fact that framerate may change */
 	if (wnd->hdlg != NULL && IsWindow(wnd->hdlg)) {
@@ -289,6 +281,7 @@ int Camera_SetGains(WND_INFO *wnd, GAIN_CHANNEL channel, ENTRY_TYPE entry, doubl
 
 	int rc, ival;
 	TL_CAMERA *camera;
+	SIM_CAMERA *sim;
 	DCX_CAMERA *dcx;
 	BOOL bServerRequest;
 
@@ -322,9 +315,24 @@ int Camera_SetGains(WND_INFO *wnd, GAIN_CHANNEL channel, ENTRY_TYPE entry, doubl
 				if (channel == B_CHAN) TL_SetRGBGains(camera, TL_IGNORE_GAIN, TL_IGNORE_GAIN, value);
 			}
 			break;
+		case SIM:
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			if (channel == M_CHAN) {												/* Same scales as TL */
+				double db_min, db_max;
+				SIM_GetMasterGainInfo(sim, NULL, NULL, &db_min, &db_max);
+				if (IS_SLIDER == entry) value = db_min + value*(db_max-db_min);
+				SIM_SetMasterGain(sim, value);
+			} else {
+				if (entry == IS_SLIDER) value = 0.5*exp(value*log(20));
+				if (channel == R_CHAN) SIM_SetRGBGains(sim, value, SIM_IGNORE_GAIN, SIM_IGNORE_GAIN);
+				if (channel == G_CHAN) SIM_SetRGBGains(sim, SIM_IGNORE_GAIN, value, SIM_IGNORE_GAIN);
+				if (channel == B_CHAN) SIM_SetRGBGains(sim, SIM_IGNORE_GAIN, SIM_IGNORE_GAIN, value);
+			}
+			break;
 		default:
 			break;
 	}
+	Camera_RefreshProperties(wnd, PROP_GAINS);
 
 	/* Server can't modify dialog box, so help here */
 	if (bServerRequest) SendMessage(wnd->hdlg, WMP_SHOW_GAINS, 0, 0);
@@ -389,9 +397,27 @@ int Camera_ResetGains(WND_INFO *wnd, GAIN_RESET_MODE rgb) {
 			TL_SetRGBGains(camera, red, green, blue);
 		}
 		break;
+		case SIM:
+		{
+			double master, red, green, blue;
+			SIM_CAMERA *sim;
+
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			if (RGB_GAIN == rgb) {
+				SIM_GetMasterGainInfo(sim, NULL, &master, NULL, NULL);
+				SIM_GetDfltRGBGains(sim, &red, &green, &blue);
+			} else {
+				master = 0;
+				red = green = blue = 1.0;
+			}
+			SIM_SetMasterGain(sim, master);
+			SIM_SetRGBGains(sim, red, green, blue);
+		}
+		break;
 		default:
 			break;
 	}
+	Camera_RefreshProperties(wnd, PROP_GAINS);
 
 	return rc;
 }
@@ -407,7 +433,7 @@ int Camera_ResetGains(WND_INFO *wnd, GAIN_RESET_MODE rgb) {
 --         slider[4] - array to receive fractions [0.0,1.0] for setting sliders
 --                     Order is master, red, green, blue in each array
 --
--- Output: Queries gains and returns numbers to display
+-- Output: Returns numbers to display (from the property cache)
 --
 -- Return: 0 if successful; otherwise error code
 --           1 ==> camera is not active
@@ -415,52 +441,19 @@ int Camera_ResetGains(WND_INFO *wnd, GAIN_RESET_MODE rgb) {
 int Camera_GetGains(WND_INFO *wnd, double values[4], double slider[4]) {
 	static char *rname = "Camera_GetGains";
 
-	int i, rc;
-	TL_CAMERA *camera;
-	DCX_CAMERA *dcx;
-	BOOL bServerRequest;
-	double rval[4], db_min, db_max;
-	int ival[4];
+	CAMERA_PROPS props;
+	int i;
 
 	/* Initial return values */
 	if (values != NULL) for (i=0; i<4; i++) values[i] = 0.0;
 	if (slider != NULL) for (i=0; i<4; i++) slider[i] = 0.0;
 
-	/* Make sure we have valid structures */
-	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
-	if (wnd == NULL) return 1;
-
-	rc = 0;
-	switch (wnd->Camera.driver) {
-		case DCX:
-			dcx = (DCX_CAMERA *) wnd->dcx;
-			DCx_GetRGBGains(dcx, &ival[0], &ival[1], &ival[2], &ival[3]);
-			if (values != NULL) for (i=0; i<4; i++) values[i] = ival[i];
-			if (slider != NULL) {
-				for (i=0; i<4; i++) slider[i] = ival[i] / 100.0 ;
-				for (i=0; i<4; i++) slider[i] = max(0.0, min(1.0, slider[i]));
-			}
-			break;
-
-		case TL:
-			camera = (TL_CAMERA *) wnd->Camera.details;
-			TL_GetMasterGain(camera, &rval[0]);
-			TL_GetMasterGainInfo(camera, NULL, NULL, &db_min, &db_max);
-			TL_GetRGBGains(camera, &rval[1], &rval[2], &rval[3]);
-
-			if (values != NULL) for (i=0; i<4; i++) values[i] = rval[i];
-			if (slider != NULL) {
-				slider[0] = (rval[0]-db_min)/(db_max-db_min+1E-10);
-				for (i=1; i<4; i++) slider[i] = log(2*max(0.5,rval[i]))/log(20.0);
-				for (i=0; i<4; i++) slider[i] = max(0.0, min(1.0, slider[i]));
-			}
-			break;
-
-		default:
-			break;
-	}
+	/* Served from the property cache */
+	if (Camera_GetProperties(wnd, &props) == 1) return 1;
+	if (values != NULL) for (i=0; i<4; i++) values[i] = props.gains[i];
+	if (slider != NULL) for (i=0; i<4; i++) slider[i] = props.slider[i];
 
-	return rc;
+	return 0;
 }
 
 /* ===========================================================================
@@ -495,6 +488,9 @@ double Camera_GetFPSActual(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			fps = TL_GetFPSActual(camera);
 			break;
+		case SIM:
+			fps = SIM_GetFPSActual((SIM_CAMERA *) wnd->Camera.details);
+			break;
 		default:
 			fps = 0.0;
 			break;
@@ -536,12 +532,18 @@ double Camera_SetFPSControl(WND_INFO *wnd, double fps) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			fps = TL_SetFPSControl(tl, fps);
 			break;
+		case SIM:
+			fps = SIM_SetFPSControl((SIM_CAMERA *) wnd->Camera.details, fps);
+			break;
 
 		default:
 			fps = 0.0;
 			break;
 	}
 
+	/* Framerate may also limit the exposure */
+	Camera_RefreshProperties(wnd, PROP_FPS | PROP_EXPOSURE);
+
 	/* Server can't modify dialog box, so help here */
 	if (bServerRequest) SendMessage(wnd->hdlg, WMP_SHOW_FRAMERATE, 0, 0);
 
@@ -558,33 +560,17 @@ double Camera_SetFPSControl(WND_INFO *wnd, double fps) {
 -- Output: none
 --
 -- Return: - current framerate setting in fps if supported or <= 0 on error
+--
+-- Notes: Value comes from the property cache (see Camera_GetProperties)
 =========================================================================== */
 double Camera_GetFPSControl(WND_INFO *wnd) {
 	static char *rname = "Camera_GetFPSControl";
 
-	TL_CAMERA *camera;
-	DCX_CAMERA *dcx;
-	BOOL bServerRequest;
-	double fps;
-
-	/* Make sure we have valid structures and an active camera */
-	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
-	if (wnd == NULL) return 0.0;
-
-	switch (wnd->Camera.driver) {
-		case DCX:
-			dcx = (DCX_CAMERA *) wnd->dcx;
-			fps = DCx_GetFPSControl(dcx);
-			break;
-		case TL:
-			camera = (TL_CAMERA *) wnd->Camera.details;
-			fps = TL_GetFPSControl(camera);
-			break;
-		default:
-			fps = 0.0;
-	}
+	CAMERA_PROPS props;
 
-	return fps;
+	/* Served from the property cache */
+	if (Camera_GetProperties(wnd, &props) == 1) return 0.0;
+	return props.fps;
 }	
 
 /* ===========================================================================
@@ -620,6 +606,9 @@ double Camera_GetFPSLimit(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			fps = TL_GetFPSLimit(camera);
 			break;
+		case SIM:
+			fps = SIM_GetFPSLimit((SIM_CAMERA *) wnd->Camera.details);
+			break;
 		default:
 			fps = 0.0;
 	}
@@ -663,6 +652,9 @@ double Camera_SetFPSLimit(WND_INFO *wnd, double fps) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			fps = TL_SetFPSLimit(camera, fps);
 			break;
+		case SIM:
+			fps = SIM_SetFPSLimit((SIM_CAMERA *) wnd->Camera.details, fps);
+			break;
 		default:
 			fps = 0.0;
 	}
@@ -697,6 +689,7 @@ double Camera_SetGamma(WND_INFO *wnd, double gamma) {
 	dcx = wnd->dcx;
 
 	rval = DCx_SetGamma(dcx, gamma);
+	Camera_RefreshProperties(wnd, PROP_GAMMA);
 
 	/* Server can't modify dialog box, so help here */
 	if (bServerRequest) SendMessage(wnd->hdlg, WMP_SHOW_GAMMA, 0, 0);
@@ -713,24 +706,649 @@ double Camera_SetGamma(WND_INFO *wnd, double gamma) {
 --
 -- Output: none
 --
--- Return: gamma value from camera, or 0 on error
+-- Return: gamma value (from the property cache), or 0 on error
 =========================================================================== */
 double Camera_GetGamma(WND_INFO *wnd) {
 	static char *rname = "Camera_GetGamma";
 
+	CAMERA_PROPS props;
+
+	/* Served from the property cache */
+	if (Camera_GetProperties(wnd, &props) == 1) return 0.0;
+	return props.gamma;
+}
+
+/* ===========================================================================
+-- Cached camera property store (exposure, framerate, gamma and gains)
+--
+-- Usage: int Camera_GetProperties(WND_INFO *wnd, CAMERA_PROPS *props);
+--        int Camera_RefreshProperties(WND_INFO *wnd, int which);
+--        int Camera_WaitProperties(WND_INFO *wnd, int version, int msWait, CAMERA_PROPS *props);
+--        int Camera_AddPropertySignal(WND_INFO *wnd, HANDLE signal);
+--        int Camera_RemovePropertySignal(WND_INFO *wnd, HANDLE signal);
+--        BOOL Camera_PropertiesCurrent(WND_INFO *wnd);
+--        void Camera_HoldProperties(WND_INFO *wnd, BOOL hold);
+--        void Camera_StopProperties(WND_INFO *wnd);
+--
+-- Inputs: wnd     - pointer to valid window information (NULL ==> main_wnd)
+--         props   - pointer to receive a consistent copy of the values
+--         which   - PROP_* groups to query from the camera (PROP_ALL for all)
+--         version - version already known to the caller
+--         msWait  - maximum ms to wait for a version other than version
+--         signal  - event set each time a new version is published
+--         hold    - TRUE to keep camera queries out, FALSE to release
+--
+-- Output: *props - cached values with their version number
+--
+-- Return: Camera_GetProperties, Camera_WaitProperties
+--             0 ==> successful (Wait: a different version is in *props)
+--             1 ==> no window information
+--             2 ==> no camera active (*props has the driver defaults)
+--             3 ==> (Wait only) timeout, *props is the current version
+--         Camera_RefreshProperties
+--             PROP_* groups that changed (0 if none), -1 if no window
+--         Add/Remove signals
+--             0 ==> successful, 1 ==> no window, 2 ==> list full / not found
+--         Camera_PropertiesCurrent
+--             TRUE if the cache holds values for the active camera (a Get
+--             will not query the camera)
+--
+-- Notes: The Camera_Get* routines for these values are served from memory.
+--        Every Camera_Set* routine re-queries the groups it may affect, and
+--        a background thread compares everything with the camera every
+--        PROP_RECONCILE_MS, posting the WMP_SHOW_* messages for groups that
+--        changed outside of these routines.  The version only changes when
+--        a value actually differs.  A change of camera invalidates the
+--        cache and the next query reads everything.  Camera_Open and
+--        Camera_Close hold the properties (Camera_HoldProperties) while
+--        the driver and details change, so no query runs on a camera
+--        being opened or closed.  Camera_StopProperties ends the
+--        background thread and waits for it; call it at shutdown before
+--        the camera or wnd goes away.  It is not restarted.
+=========================================================================== */
+int Camera_GetProperties(WND_INFO *wnd, CAMERA_PROPS *props) {
+	static char *rname = "Camera_GetProperties";
+
+	BOOL bServerRequest, bValid;
+
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return 1;
+	props_init(wnd);
+
+	EnterCriticalSection(&wnd->props.lock);
+	bValid = props_current(wnd);
+	if (bValid) *props = wnd->props.values;
+	LeaveCriticalSection(&wnd->props.lock);
+
+	/* First use (or new camera) ... fill everything from the camera */
+	if (! bValid) {
+		Camera_RefreshProperties(wnd, PROP_ALL);
+		EnterCriticalSection(&wnd->props.lock);
+		*props = wnd->props.values;
+		LeaveCriticalSection(&wnd->props.lock);
+	}
+
+	return (wnd->Camera.driver == UNKNOWN) ? 2 : 0 ;
+}
+
+int Camera_RefreshProperties(WND_INFO *wnd, int which) {
+	static char *rname = "Camera_RefreshProperties";
+
+	CAMERA_PROPS now;
+	int i, driver, changed;
+	void *details;
+	BOOL bServerRequest;
+
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return -1;
+	props_init(wnd);
+
+	/* One refresh at a time so an older query can never publish over a newer one */
+	EnterCriticalSection(&wnd->props.refresh);
+	driver  = wnd->Camera.driver;
+	details = wnd->Camera.details;
+
+	/* Camera closed while waiting, and the cache already says so ... nothing to query */
+	EnterCriticalSection(&wnd->props.lock);
+	if (driver == UNKNOWN && props_current(wnd)) {
+		LeaveCriticalSection(&wnd->props.lock);
+		LeaveCriticalSection(&wnd->props.refresh);
+		return 0;
+	}
+	LeaveCriticalSection(&wnd->props.lock);
+
+	/* Start from the cached values ... all groups if they belong to another camera */
+	EnterCriticalSection(&wnd->props.lock);
+	if (! props_current(wnd)) which = PROP_ALL;
+	now = wnd->props.values;
+	LeaveCriticalSection(&wnd->props.lock);
+
+	if (which & PROP_EXPOSURE) {
+		now.exposure = query_exposure(wnd);
+		now.ms_min = now.ms_max = now.ms_incr = 0.0;
+		query_exposure_parms(wnd, &now.ms_min, &now.ms_max, &now.ms_incr);
+	}
+	if (which & PROP_FPS)   now.fps   = query_fps_control(wnd);
+	if (which & PROP_GAMMA) now.gamma = query_gamma(wnd);
+	if (which & PROP_GAINS) query_gains(wnd, now.gains, now.slider);
+
+	/* Publish a new version only if something differs */
+	EnterCriticalSection(&wnd->props.lock);
+	if (! props_current(wnd)) {
+		changed = PROP_ALL;
+	} else {
+		changed = 0;
+		if (now.exposure != wnd->props.values.exposure || now.ms_min != wnd->props.values.ms_min ||
+			 now.ms_max   != wnd->props.values.ms_max   || now.ms_incr != wnd->props.values.ms_incr) changed |= PROP_EXPOSURE;
+		if (now.fps   != wnd->props.values.fps)   changed |= PROP_FPS;
+		if (now.gamma != wnd->props.values.gamma) changed |= PROP_GAMMA;
+		if (memcmp(now.gains, wnd->props.values.gains, sizeof(now.gains)) != 0 || memcmp(now.slider, wnd->props.values.slider, sizeof(now.slider)) != 0) changed |= PROP_GAINS;
+	}
+	if (changed != 0) {
+		now.version = wnd->props.values.version + 1;
+		now.changed = changed;
+		wnd->props.values  = now;
+		wnd->props.driver  = driver;
+		wnd->props.details = details;
+		wnd->props.valid   = TRUE;
+		for (i=0; i<PROP_MAX_SIGNALS; i++) if (wnd->props.signals[i] != NULL) SetEvent(wnd->props.signals[i]);
+	}
+	LeaveCriticalSection(&wnd->props.lock);
+
+	LeaveCriticalSection(&wnd->props.refresh);
+	return changed;
+}
+
+int Camera_WaitProperties(WND_INFO *wnd, int version, int msWait, CAMERA_PROPS *props) {
+	static char *rname = "Camera_WaitProperties";
+
+	HANDLE signal;
+	int rc;
+	BOOL bServerRequest;
+
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return 1;
+
+	/* Subscribe before looking so a change between the two is not missed */
+	signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (Camera_AddPropertySignal(wnd, signal) != 0) { CloseHandle(signal); signal = NULL; }
+
+	rc = Camera_GetProperties(wnd, props);
+	if (rc != 1 && props->version == version && msWait > 0 && signal != NULL) {
+		if (WaitForSingleObject(signal, msWait) == WAIT_OBJECT_0) {
+			rc = Camera_GetProperties(wnd, props);
+		} else {
+			rc = 3;
+		}
+	} else if (rc != 1 && props->version == version) {
+		rc = 3;
+	}
+
+	if (signal != NULL) {
+		Camera_RemovePropertySignal(wnd, signal);
+		CloseHandle(signal);
+	}
+	return rc;
+}
+
+int Camera_AddPropertySignal(WND_INFO *wnd, HANDLE signal) {
+	static char *rname = "Camera_AddPropertySignal";
+
+	int i;
+	BOOL bServerRequest;
+
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return 1;
+	props_init(wnd);
+
+	EnterCriticalSection(&wnd->props.lock);
+	for (i=0; i<PROP_MAX_SIGNALS; i++) {
+		if (wnd->props.signals[i] == NULL) { wnd->props.signals[i] = signal; break; }
+	}
+	LeaveCriticalSection(&wnd->props.lock);
+
+	return (i < PROP_MAX_SIGNALS) ? 0 : 2 ;
+}
+
+int Camera_RemovePropertySignal(WND_INFO *wnd, HANDLE signal) {
+	static char *rname = "Camera_RemovePropertySignal";
+
+	int i;
+	BOOL bServerRequest;
+
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return 1;
+	props_init(wnd);
+
+	EnterCriticalSection(&wnd->props.lock);
+	for (i=0; i<PROP_MAX_SIGNALS; i++) {
+		if (wnd->props.signals[i] == signal) { wnd->props.signals[i] = NULL; break; }
+	}
+	LeaveCriticalSection(&wnd->props.lock);
+
+	return (i < PROP_MAX_SIGNALS) ? 0 : 2 ;
+}
+
+BOOL Camera_PropertiesCurrent(WND_INFO *wnd) {
+	BOOL bValid;
+
+	if (wnd == NULL) wnd = main_wnd;
+	if (wnd == NULL) return FALSE;
+	props_init(wnd);
+
+	EnterCriticalSection(&wnd->props.lock);
+	bValid = props_current(wnd);
+	LeaveCriticalSection(&wnd->props.lock);
+	return bValid;
+}
+
+void Camera_HoldProperties(WND_INFO *wnd, BOOL hold) {
+
+	if (wnd == NULL) wnd = main_wnd;
+	if (wnd == NULL) return;
+	props_init(wnd);
+
+	if (hold) {
+		EnterCriticalSection(&wnd->props.refresh);
+	} else {
+		LeaveCriticalSection(&wnd->props.refresh);
+	}
+	return;
+}
+
+void Camera_StopProperties(WND_INFO *wnd) {
+
+	if (wnd == NULL) wnd = main_wnd;
+	if (wnd == NULL || ! wnd->props.lock_init) return;		/* Thread never started */
+
+	SetEvent(wnd->props.stop);
+	if (wnd->props.done != NULL) WaitForSingleObject(wnd->props.done, INFINITE);
+	return;
+}
+
+/* ===========================================================================
+-- Apply a staged set of changes in one batch between two frames
+--
+-- Usage: int Camera_ApplySettings(WND_INFO *wnd, CAMERA_SETTINGS *settings, int msWait);
+--
+-- Inputs: wnd      - pointer to valid window information (NULL ==> main_wnd)
+--         settings - values to change (settings->modify selects which)
+--         msWait   - maximum ms to wait for a frame boundary (<=0 ==> SETTING_FRAME_WAIT)
+--
+-- Output: *settings - values after the change (from the property cache) and
+--                     an imageID from which every frame has all of them
+--
+-- Return: 0 ==> successful
+--         1 ==> no window information or settings
+--         2 ==> no camera active
+--         3 ==> no frame arrived within msWait (changes applied anyway)
+--
+-- Notes: In freerun the batch starts as soon as a frame arrives, so the
+--        SDK calls fall in the gap before the next one, and the frame
+--        already exposing when they finish is not counted.  The imageID
+--        is a conservative bound: no frame before it is promised the new
+--        values, and the first such frame may come before it.  For TL
+--        and SIM in freerun it is known only once the frame in flight has
+--        arrived (up to msWait more; -1 if it does not).  Gains go to
+--        the camera in one call per driver rather than one per channel.
+--        The property cache is refreshed once for the whole batch and
+--        the dialog is told about the groups that changed.
+=========================================================================== */
+#define	SETTINGS_POLL_MS		(1)						/* DCx has no spare frame event */
+#define	SETTINGS_IN_FLIGHT	(1)						/* Frames possibly exposing when the batch ends */
+
+int Camera_ApplySettings(WND_INFO *wnd, CAMERA_SETTINGS *settings, int msWait) {
+	static char *rname = "Camera_ApplySettings";
+
+	CAMERA_PROPS props;
+	TL_CAMERA *tl;
+	SIM_CAMERA *sim;
 	DCX_CAMERA *dcx;
+	TRIGGER_MODE mode;
+	int modify, which, changed, last_id, driver, rc;
 	BOOL bServerRequest;
 
-	/* Make sure we have valid structures */
 	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
-	if (wnd == NULL) return 0.0;
+	if (wnd == NULL || settings == NULL) return 1;
+	props_init(wnd);
 
-	if (wnd->Camera.driver != DCX) return 0.0;
+	settings->imageID = -1;
+	if (wnd->Camera.driver == UNKNOWN) return 2;
+	if (msWait <= 0) msWait = SETTING_FRAME_WAIT;
+	modify = settings->modify;
+
+	/* Stage the calibration dark now so frames up to the bound keep the old one */
+	if (modify & SETTING_EXPOSURE) Calib_SetExposure(wnd, settings->exposure, CALIB_ID_PENDING);
+
+	/* Line up with the end of a frame (triggered cameras are idle between triggers) */
+	rc = 0;
+	mode = Camera_GetTriggerMode(wnd, NULL);
+	last_id = settings_last_id(wnd);
+	if (mode == TRIG_FREERUN && modify != 0) {
+		if (! settings_wait_frame(wnd, last_id, msWait)) rc = 3;
+	}
+
+	/* Keep the reconcile thread's queries out of the gap */
+	EnterCriticalSection(&wnd->props.refresh);
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;
+			if (modify & SETTING_GAMMA) DCx_SetGamma(dcx, settings->gamma);
+			if (modify & SETTING_GAINS) {
+				DCx_SetRGBGains(dcx, (modify & SETTING_MASTER_GAIN) ? max(0,min(100,(int) (settings->gains[0]+0.5))) : DCX_IGNORE_GAIN,
+											(modify & SETTING_RED_GAIN)    ? max(0,min(100,(int) (settings->gains[1]+0.5))) : DCX_IGNORE_GAIN,
+											(modify & SETTING_GREEN_GAIN)  ? max(0,min(100,(int) (settings->gains[2]+0.5))) : DCX_IGNORE_GAIN,
+											(modify & SETTING_BLUE_GAIN)   ? max(0,min(100,(int) (settings->gains[3]+0.5))) : DCX_IGNORE_GAIN);
+			}
+			if (modify & SETTING_FPS)      DCx_SetFPSControl(dcx, settings->fps);
+			if (modify & SETTING_EXPOSURE) DCx_SetExposure(dcx, settings->exposure);
+			break;
+
+		case TL:
+			tl = (TL_CAMERA *) wnd->Camera.details;
+			if (modify & SETTING_MASTER_GAIN) TL_SetMasterGain(tl, settings->gains[0]);
+			if (modify & (SETTING_RED_GAIN | SETTING_GREEN_GAIN | SETTING_BLUE_GAIN)) {
+				TL_SetRGBGains(tl, (modify & SETTING_RED_GAIN)   ? settings->gains[1] : TL_IGNORE_GAIN,
+										 (modify & SETTING_GREEN_GAIN) ? settings->gains[2] : TL_IGNORE_GAIN,
+										 (modify & SETTING_BLUE_GAIN)  ? settings->gains[3] : TL_IGNORE_GAIN);
+			}
+			if (modify & SETTING_FPS)      TL_SetFPSControl(tl, settings->fps);
+			if (modify & SETTING_EXPOSURE) TL_SetExposure(tl, settings->exposure);
+			break;
+		case SIM:
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			if (modify & SETTING_MASTER_GAIN) SIM_SetMasterGain(sim, settings->gains[0]);
+			if (modify & (SETTING_RED_GAIN | SETTING_GREEN_GAIN | SETTING_BLUE_GAIN)) {
+				SIM_SetRGBGains(sim, (modify & SETTING_RED_GAIN)   ? settings->gains[1] : SIM_IGNORE_GAIN,
+										   (modify & SETTING_GREEN_GAIN) ? settings->gains[2] : SIM_IGNORE_GAIN,
+										   (modify & SETTING_BLUE_GAIN)  ? settings->gains[3] : SIM_IGNORE_GAIN);
+			}
+			if (modify & SETTING_FPS)      SIM_SetFPSControl(sim, settings->fps);
+			if (modify & SETTING_EXPOSURE) SIM_SetExposure(sim, settings->exposure);
+			break;
+
+		default:
+			break;
+	}
+
+	last_id = settings_last_id(wnd);
+	driver  = wnd->Camera.driver;
+	LeaveCriticalSection(&wnd->props.refresh);
+
+	/* Anything after the frame(s) in flight now was started with every change.  DCx numbers its
+	 * own frames one after another; TL and SIM share imageIDs with the other cameras, so wait for
+	 * the frame in flight and start after it (unknown if it does not come) */
+	if (modify != 0) {
+		if (mode == TRIG_SOFTWARE) {
+			settings->imageID = last_id + 1;
+		} else if (driver == DCX) {
+			settings->imageID = last_id + 1 + SETTINGS_IN_FLIGHT;
+		} else if (settings_wait_frame(wnd, last_id, msWait)) {
+			settings->imageID = settings_last_id(wnd) + 1;
+		}
+	}
+	if (modify & SETTING_EXPOSURE) Calib_SetExposure(wnd, Camera_GetExposure(wnd), settings->imageID);
+
+	/* One refresh for the batch, and let the dialog catch up */
+	which = 0;
+	if (modify & (SETTING_EXPOSURE | SETTING_FPS)) which |= PROP_EXPOSURE | PROP_FPS;
+	if (modify & SETTING_GAMMA) which |= PROP_GAMMA;
+	if (modify & SETTING_GAINS) which |= PROP_GAINS;
+	changed = (which != 0) ? Camera_RefreshProperties(wnd, which) : 0 ;
+	if (changed > 0 && wnd->hdlg != NULL && IsWindow(wnd->hdlg)) {
+		if (changed & PROP_EXPOSURE) PostMessage(wnd->hdlg, WMP_SHOW_EXPOSURE,  0, 0);
+		if (changed & PROP_FPS)      PostMessage(wnd->hdlg, WMP_SHOW_FRAMERATE, 0, 0);
+		if (changed & PROP_GAMMA)    PostMessage(wnd->hdlg, WMP_SHOW_GAMMA,     0, 0);
+		if (changed & PROP_GAINS)    PostMessage(wnd->hdlg, WMP_SHOW_GAINS,     0, 0);
+	}
+
+	/* Report every value as it now stands */
+	if (Camera_GetProperties(wnd, &props) == 0) {
+		settings->exposure = props.exposure;
+		settings->fps      = props.fps;
+		settings->gamma    = props.gamma;
+		memcpy(settings->gains, props.gains, sizeof(settings->gains));
+	}
+
+	return rc;
+}
+
+/* Newest imageID the camera has delivered (-1 if none) */
+static int settings_last_id(WND_INFO *wnd) {
+	IMAGE_INFO info;
 
-	dcx = (DCX_CAMERA *) wnd->dcx;
-	return DCx_GetGamma(dcx);
+	if (wnd->Camera.driver == TL) return TL_GetImageCount((TL_CAMERA *) wnd->Camera.details) - 1;	/* Counts frames skipped by the ring too */
+	if (wnd->Camera.driver == SIM) return SIM_GetImageCount((SIM_CAMERA *) wnd->Camera.details) - 1;
+	if (Camera_GetImageInfo(wnd, -1, &info) != 0) return -1;
+	return info.imageID;
 }
 
+/* Wait for a frame newer than last_id ... FALSE if none within msWait */
+static BOOL settings_wait_frame(WND_INFO *wnd, int last_id, int msWait) {
+	TL_CAMERA *tl;
+	SIM_CAMERA *sim;
+	HANDLE signal;
+	DWORD t_end;
+	BOOL bFrame;
+
+	if (wnd->Camera.driver == TL) {
+		tl = (TL_CAMERA *) wnd->Camera.details;
+		if ( (signal = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL) return FALSE;
+		TL_AddImageSignal(tl, signal);
+		bFrame = settings_last_id(wnd) != last_id || WaitForSingleObject(signal, msWait) == WAIT_OBJECT_0;
+		TL_RemoveImageSignal(tl, signal);
+		CloseHandle(signal);
+		return bFrame;
+	} else if (wnd->Camera.driver == SIM) {
+		sim = (SIM_CAMERA *) wnd->Camera.details;
+		if ( (signal = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL) return FALSE;
+		SIM_AddImageSignal(sim, signal);
+		bFrame = settings_last_id(wnd) != last_id || WaitForSingleObject(signal, msWait) == WAIT_OBJECT_0;
+		SIM_RemoveImageSignal(sim, signal);
+		CloseHandle(signal);
+		return bFrame;
+	}
+
+	t_end = GetTickCount() + msWait;
+	while (settings_last_id(wnd) == last_id) {
+		if ((int) (t_end - GetTickCount()) <= 0) return FALSE;
+		Sleep(SETTINGS_POLL_MS);
+	}
+	return TRUE;
+}
+
+/* Create the locks and start reconciliation on first use */
+static void props_init(WND_INFO *wnd) {
+	static volatile long once = 0;
+
+	if (wnd->props.lock_init) return;
+	if (InterlockedCompareExchange(&once, 1, 0) == 0) {
+		InitializeCriticalSection(&wnd->props.lock);
+		InitializeCriticalSection(&wnd->props.refresh);
+		wnd->props.stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		wnd->props.done = CreateEvent(NULL, TRUE, FALSE, NULL);
+		wnd->props.lock_init = TRUE;
+		if (wnd->props.stop == NULL || _beginthread(props_reconcile_thread, 0, (void *) wnd) == -1L) {
+			if (wnd->props.done != NULL) SetEvent(wnd->props.done);	/* Nothing to join */
+		}
+	} else {
+		while (! wnd->props.lock_init) Sleep(1);
+	}
+	return;
+}
+
+/* Do the cached values belong to the active camera? (props.lock held) */
+static BOOL props_current(WND_INFO *wnd) {
+	return wnd->props.valid && wnd->props.driver == (int) wnd->Camera.driver && wnd->props.details == wnd->Camera.details;
+}
+
+/* Background comparison with the camera ... catches changes made outside Camera_Set* */
+static void props_reconcile_thread(void *arglist) {
+	WND_INFO *wnd;
+	HANDLE done;
+	int changed;
+
+	wnd = (WND_INFO *) arglist;
+	while (WaitForSingleObject(wnd->props.stop, PROP_RECONCILE_MS) == WAIT_TIMEOUT) {
+		if (wnd->Camera.driver == UNKNOWN) continue;
+		if ( (changed = Camera_RefreshProperties(wnd, PROP_ALL)) <= 0) continue;
+		if (wnd->hdlg == NULL || ! IsWindow(wnd->hdlg)) continue;
+		if (changed & PROP_EXPOSURE) PostMessage(wnd->hdlg, WMP_SHOW_EXPOSURE,  0, 0);
+		if (changed & PROP_FPS)      PostMessage(wnd->hdlg, WMP_SHOW_FRAMERATE, 0, 0);
+		if (changed & PROP_GAMMA)    PostMessage(wnd->hdlg, WMP_SHOW_GAMMA,     0, 0);
+		if (changed & PROP_GAINS)    PostMessage(wnd->hdlg, WMP_SHOW_GAINS,     0, 0);
+	}
+
+	done = wnd->props.done;								/* wnd may be freed once this is set */
+	SetEvent(done);
+	return;
+}
+
+/* ===========================================================================
+-- Direct camera queries behind the property cache (wnd must be valid)
+--
+-- Usage: static double query_exposure(WND_INFO *wnd);
+--        static int    query_exposure_parms(WND_INFO *wnd, double *ms_min, double *ms_max, double *ms_incr);
+--        static double query_fps_control(WND_INFO *wnd);
+--        static double query_gamma(WND_INFO *wnd);
+--        static int    query_gains(WND_INFO *wnd, double values[4], double slider[4]);
+--
+-- Return: as the corresponding Camera_Get* routines
+=========================================================================== */
+static double query_exposure(WND_INFO *wnd) {
+
+	double rval;
+	TL_CAMERA  *camera;
+	DCX_CAMERA *dcx;
+
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;						/* (DCX_CAMERA *) wnd->Camera.details; */
+			rval = DCx_GetExposure(dcx, FALSE);					/* Just query (not necessary to request) */
+			break;
+		case TL:
+			camera = (TL_CAMERA *) wnd->Camera.details;
+			rval = TL_GetExposure(camera, FALSE);				/* Just query (not necessary to request) */
+			break;
+		case SIM:
+			rval = SIM_GetExposure((SIM_CAMERA *) wnd->Camera.details);
+			break;
+		default:
+			rval = 1.0;
+			break;
+	}
+
+	return rval;
+}
+
+static int query_exposure_parms(WND_INFO *wnd, double *ms_min, double *ms_max, double *ms_incr) {
+
+	TL_CAMERA  *camera;
+	DCX_CAMERA *dcx;
+	int rc;
+
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;						/* (DCX_CAMERA *) wnd->Camera.details; */
+			rc = DCx_GetExposureParms(dcx, ms_min, ms_max, ms_incr);
+			break;
+		case TL:
+			camera = (TL_CAMERA *) wnd->Camera.details;
+			rc = TL_GetExposureParms(camera, ms_min, ms_max);
+			*ms_incr = 0.001;											/* Return default value */
+			break;
+		case SIM:
+			rc = SIM_GetExposureParms((SIM_CAMERA *) wnd->Camera.details, ms_min, ms_max);
+			*ms_incr = 0.001;
+			break;
+		default:
+			rc = 2;
+			break;
+	}
+
+	return rc;
+}
+
+static double query_fps_control(WND_INFO *wnd) {
+
+	TL_CAMERA *camera;
+	DCX_CAMERA *dcx;
+	double fps;
+
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;
+			fps = DCx_GetFPSControl(dcx);
+			break;
+		case TL:
+			camera = (TL_CAMERA *) wnd->Camera.details;
+			fps = TL_GetFPSControl(camera);
+			break;
+		case SIM:
+			fps = SIM_GetFPSControl((SIM_CAMERA *) wnd->Camera.details);
+			break;
+		default:
+			fps = 0.0;
+	}
+
+	return fps;
+}
+
+static double query_gamma(WND_INFO *wnd) {
+
+	if (wnd->Camera.driver != DCX) return 0.0;
+	return DCx_GetGamma((DCX_CAMERA *) wnd->dcx);
+}
+
+static int query_gains(WND_INFO *wnd, double values[4], double slider[4]) {
+
+	int i;
+	TL_CAMERA *camera;
+	SIM_CAMERA *sim;
+	DCX_CAMERA *dcx;
+	double rval[4], db_min, db_max;
+	int ival[4];
+
+	for (i=0; i<4; i++) values[i] = slider[i] = 0.0;
+
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;
+			DCx_GetRGBGains(dcx, &ival[0], &ival[1], &ival[2], &ival[3]);
+			for (i=0; i<4; i++) values[i] = ival[i];
+			for (i=0; i<4; i++) slider[i] = ival[i] / 100.0 ;
+			for (i=0; i<4; i++) slider[i] = max(0.0, min(1.0, slider[i]));
+			break;
+
+		case TL:
+			camera = (TL_CAMERA *) wnd->Camera.details;
+			TL_GetMasterGain(camera, &rval[0]);
+			TL_GetMasterGainInfo(camera, NULL, NULL, &db_min, &db_max);
+			TL_GetRGBGains(camera, &rval[1], &rval[2], &rval[3]);
+
+			for (i=0; i<4; i++) values[i] = rval[i];
+			slider[0] = (rval[0]-db_min)/(db_max-db_min+1E-10);
+			for (i=1; i<4; i++) slider[i] = log(2*max(0.5,rval[i]))/log(20.0);
+			for (i=0; i<4; i++) slider[i] = max(0.0, min(1.0, slider[i]));
+			break;
+		case SIM:
+			sim = (SIM_CAMERA *) wnd->Camera.details;
+			SIM_GetMasterGain(sim, &rval[0]);
+			SIM_GetMasterGainInfo(sim, NULL, NULL, &db_min, &db_max);
+			SIM_GetRGBGains(sim, &rval[1], &rval[2], &rval[3]);
+
+			for (i=0; i<4; i++) values[i] = rval[i];
+			slider[0] = (rval[0]-db_min)/(db_max-db_min+1E-10);
+			for (i=1; i<4; i++) slider[i] = log(2*max(0.5,rval[i]))/log(20.0);
+			for (i=0; i<4; i++) slider[i] = max(0.0, min(1.0, slider[i]));
+			break;
+
+		default:
+			break;
+	}
+
+	return 0;
+}
 
 /* ===========================================================================
 -- Alternate routine to render a specific image frame in the buffer to a window
@@ -741,6 +1359,8 @@ double Camera_GetGamma(WND_INFO *wnd) {
 -- Inputs: wnd   - pointer to valid window information
 --         frame - index of frame to image (-1 ==> for most recent)
 --                 will be limited to allowed range
+--                 FRAME_HDR ==> tone mapped merged HDR frame
+--                 FRAME_MEAN, FRAME_VARIANCE ==> accumulator images
 --         hwnd  - window where image is to be rendered
 =========================================================================== */
 int Camera_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd) {
@@ -750,6 +1370,7 @@ int Camera_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd) {
 	TL_CAMERA *camera;
 	DCX_CAMERA *dcx;
 	BOOL bServerRequest;
+	LONGLONG t_render;
 
 	/* Make sure we have valid structures */
 	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
@@ -757,6 +1378,18 @@ int Camera_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd) {
 
 	if (! IsWindow(hwnd)) return 1;
 
+	/* Merged HDR frame is tone mapped, accumulator images scaled min to max */
+	if (frame == FRAME_HDR || frame == FRAME_MEAN || frame == FRAME_VARIANCE) {
+		if (frame == FRAME_HDR) {
+			HDR_RenderFrame(wnd, hwnd);
+		} else {
+			Accum_RenderFrame(wnd, frame, hwnd);
+		}
+		GenerateCrosshair(wnd, hwnd);
+		return 0;
+	}
+
+	t_render = Perf_Start();
 	switch (wnd->Camera.driver) {
 		case DCX:
 			dcx = (DCX_CAMERA *) wnd->dcx;
@@ -766,9 +1399,13 @@ int Camera_RenderFrame(WND_INFO *wnd, int frame, HWND hwnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_RenderFrame(camera, frame, hwnd);
 			break;
+		case SIM:
+			rc = SIM_RenderFrame((SIM_CAMERA *) wnd->Camera.details, frame, hwnd);
+			break;
 		default:
 			break;
 	}
+	Perf_Stop(PERF_RENDER, t_render);
 
 	GenerateCrosshair(wnd, hwnd);
 	return 0;
@@ -812,6 +1449,9 @@ int Camera_Trigger(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_Trigger(camera);
 			break;
+		case SIM:
+			rc = SIM_Trigger((SIM_CAMERA *) wnd->Camera.details);
+			break;
 		default:
 			rc = 0;
 			break;
@@ -858,6 +1498,9 @@ TRIG_ARM_ACTION Camera_Arm(WND_INFO *wnd, TRIG_ARM_ACTION action) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_Arm(camera, action);
 			break;
+		case SIM:
+			rc = SIM_Arm((SIM_CAMERA *) wnd->Camera.details, action);
+			break;
 		default:
 			rc = 0;
 			break;
@@ -918,6 +1561,9 @@ TRIGGER_MODE Camera_SetTriggerMode(WND_INFO *wnd, TRIGGER_MODE mode, TRIGGER_INF
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_SetTriggerMode(camera, mode, info);
 			break;
+		case SIM:
+			rc = SIM_SetTriggerMode((SIM_CAMERA *) wnd->Camera.details, mode, info);
+			break;
 
 		default:
 			rc = -3;
@@ -953,6 +1599,9 @@ TRIGGER_MODE Camera_GetTriggerMode(WND_INFO *wnd, TRIGGER_INFO *info) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetTriggerMode(camera, info);
 			break;
+		case SIM:
+			rc = SIM_GetTriggerMode((SIM_CAMERA *) wnd->Camera.details, info);
+			break;
 
 		default:
 			rc = -3;
@@ -1000,6 +1649,9 @@ int Camera_GetFramesPerTrigger(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetFramesPerTrigger(camera);
 			break;
+		case SIM:
+			rc = SIM_GetFramesPerTrigger((SIM_CAMERA *) wnd->Camera.details);
+			break;
 
 		default:
 			rc = -3;
@@ -1031,6 +1683,9 @@ int Camera_SetFramesPerTrigger(WND_INFO *wnd, int frames) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_SetFramesPerTrigger(camera, frames);
 			break;
+		case SIM:
+			rc = SIM_SetFramesPerTrigger((SIM_CAMERA *) wnd->Camera.details, frames);
+			break;
 
 		default:
 			rc = -3;
@@ -1073,6 +1728,7 @@ COLOR_CORRECT Camera_SetColorCorrection(WND_INFO *wnd, COLOR_CORRECT mode, doubl
 			break;
 
 		case TL:
+		case SIM:
 		default:
 			rc = -3;
 			break;
@@ -1099,6 +1755,7 @@ COLOR_CORRECT Camera_GetColorCorrection(WND_INFO *wnd, double *rval) {
 			break;
 
 		case TL:
+		case SIM:
 		default:
 			rc = -3;
 			break;
@@ -1150,6 +1807,9 @@ int Camera_GetRingInfo(WND_INFO *wnd, RING_INFO *info) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			TL_GetRingInfo(tl, &info->nBuffers, &info->nValid, &info->iLast, &info->iShow);
 			break;
+		case SIM:
+			SIM_GetRingInfo((SIM_CAMERA *) wnd->Camera.details, &info->nBuffers, &info->nValid, &info->iLast, &info->iShow);
+			break;
 		default:
 			break;
 	}
@@ -1194,6 +1854,9 @@ int Camera_SetRingBufferSize(WND_INFO *wnd, int nBuf) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_SetRingBufferSize(tl, nBuf);
 			break;
+		case SIM:
+			rc = SIM_SetRingBufferSize((SIM_CAMERA *) wnd->Camera.details, nBuf);
+			break;
 		default:
 			rc = 0;
 			break;
@@ -1205,6 +1868,61 @@ int Camera_SetRingBufferSize(WND_INFO *wnd, int nBuf) {
 	return rc;
 }
 
+/* ===========================================================================
+-- Set (or query) binning of the images
+--
+-- Usage: int Camera_SetBinning(WND_INFO *wnd, int bin, BOOL bSoftware, BINNING_INFO *info);
+--
+-- Inputs: wnd       - handle to the main information structure
+--         bin       - binning factor (1 ==> none, <= 0 ==> query only)
+--         bSoftware - TL only: bin in software even if the sensor can
+--         info      - if not NULL, receives the resulting state
+--
+-- Output: Sensor binning where available, otherwise (TL) CFA-aware software
+--         binning as frames enter the ring.  Image size in wnd is updated.
+--
+-- Return: 0 if successful, otherwise error from TL/DCx_SetBinning
+=========================================================================== */
+int Camera_SetBinning(WND_INFO *wnd, int bin, BOOL bSoftware, BINNING_INFO *info) {
+	static char *rname = "Camera_SetBinning";
+
+	int rc;
+	DCX_CAMERA *dcx;
+	TL_CAMERA *tl;
+	BINNING_INFO state;
+
+	/* Make sure we have valid structures */
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (wnd == NULL) wnd = main_wnd;
+	if (wnd == NULL) return 1;
+
+	rc = 0;
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->dcx;
+			if (bin > 0) rc = DCx_SetBinning(dcx, bin);
+			DCx_GetBinning(dcx, &state);
+			break;
+		case TL:
+			tl = (TL_CAMERA *) wnd->Camera.details;
+			if (bin > 0) rc = TL_SetBinning(tl, bin, bSoftware);
+			TL_GetBinning(tl, &state);
+			break;
+		case SIM:
+			if (bin > 1) rc = 2;											/* Synthetic frames are never binned */
+			SIM_GetBinning((SIM_CAMERA *) wnd->Camera.details, &state);
+			break;
+		default:
+			return 1;
+	}
+
+	/* Image size for rendering follows the binned geometry */
+	if (state.width != 0 && state.height != 0) { wnd->width = state.width; wnd->height = state.height; }
+	if (info != NULL) *info = state;
+
+	return rc;
+}
+
 /* ===========================================================================
 -- Reset the ring buffer counters so the next image will be in location 0
 -- Primarily a Client/Server call for burst mode operation.  While other
@@ -1240,6 +1958,9 @@ int Camera_ResetRingCounters(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_ResetRingCounters(camera);
 			break;
+		case SIM:
+			rc = SIM_ResetRingCounters((SIM_CAMERA *) wnd->Camera.details);
+			break;
 
 		default:
 			rc = 0;
@@ -1283,6 +2004,9 @@ int Camera_GetSaveFormatFlag(WND_INFO *wnd) {
 			camera = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetSaveFormatFlag(camera);
 			break;
+		case SIM:
+			rc = SIM_GetSaveFormatFlag((SIM_CAMERA *) wnd->Camera.details);
+			break;
 
 		default:
 			rc = 0;
@@ -1300,6 +2024,8 @@ int Camera_GetSaveFormatFlag(WND_INFO *wnd) {
 -- Inputs: wnd   - pointer to valid window information
 --         frame - index of frame to image (-1 = current)
 --                    invalid frame return error (rc = 2)
+--                    FRAME_HDR ==> most recent merged HDR frame
+--                    FRAME_MEAN, FRAME_VARIANCE ==> accumulator images
 --         info  - pointer to structure to receive image information
 --
 -- Output: *info (if not NULL)
@@ -1322,6 +2048,10 @@ int Camera_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info) {
 	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
 	if (wnd == NULL) return 1;										/* Nothing initialized */
 
+	/* Merged HDR frame and accumulator images live outside the ring */
+	if (frame == FRAME_HDR) return HDR_GetImageInfo(wnd, info);
+	if (frame == FRAME_MEAN || frame == FRAME_VARIANCE) return Accum_GetImageInfo(wnd, frame, info);
+
 	switch (wnd->Camera.driver) {
 		case DCX:
 			dcx = (DCX_CAMERA *) wnd->Camera.details;
@@ -1331,6 +2061,9 @@ int Camera_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetImageInfo(tl, frame, info);
 			break;
+		case SIM:
+			rc = SIM_GetImageInfo((SIM_CAMERA *) wnd->Camera.details, frame, info);
+			break;
 		default:
 			if (info != NULL) info->type = CAMERA_UNKNOWN;
 			rc = 1;
@@ -1348,6 +2081,8 @@ int Camera_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info) {
 -- Inputs: wnd        - pointer to valid window information
 --         frame      - index of frame to image (-1 = current)
 --                        invalid frame return error (rc = 2)
+--                        FRAME_HDR, FRAME_MEAN, FRAME_VARIANCE ==> invalid,
+--                          use Camera_CopyImageData()
 --         image_data - pointer to get a pointer to actual memory location (shared)
 --         length     - pointer to get count to # of bytes in the image data
 --
@@ -1374,6 +2109,9 @@ int Camera_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length
 	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
 	if (wnd == NULL) return 1;										/* Nothing initialized */
 
+	/* Merged HDR frame and accumulator images live outside the ring ... only as a copy */
+	if (frame == FRAME_HDR || frame == FRAME_MEAN || frame == FRAME_VARIANCE) return 2;
+
 	switch (wnd->Camera.driver) {
 		case DCX:
 			dcx = (DCX_CAMERA *) wnd->Camera.details;
@@ -1383,6 +2121,113 @@ int Camera_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_GetImageData(tl, frame, image_data, length);
 			break;
+		case SIM:
+		{
+			size_t nbytes;
+			rc = SIM_GetImageData((SIM_CAMERA *) wnd->Camera.details, frame, image_data, &nbytes);
+			if (length != NULL) *length = (int) nbytes;
+		}
+			break;
+		default:
+			rc = 1;
+			break;
+	}
+
+	return rc;
+}
+
+/* ===========================================================================
+-- Get a private copy of the raw data for a specific image
+--
+-- Usage: int Camera_CopyImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
+--
+-- Inputs: wnd        - pointer to valid window information
+--         frame      - index of frame to image (-1 = current)
+--                        FRAME_HDR ==> most recent merged HDR frame
+--                        FRAME_MEAN, FRAME_VARIANCE ==> accumulator images
+--         image_data - pointer to get a malloc'd copy of the data
+--         length     - pointer to get count to # of bytes in the image data
+--
+-- Output: *image_data - copy of the data, calling routine must free()
+--         *length     - number of bytes in the copy
+--
+-- Return: 0 if successful, 
+--           1 => no camera initialized
+--           2 => frame invalid
+--           4 => no memory for the copy
+--
+-- Notes: FRAME_HDR, FRAME_MEAN and FRAME_VARIANCE are only available this
+--        way.  They are double buffered by the bracket / accumulator threads,
+--        so they are copied under their mutex rather than handed out as a
+--        shared pointer.
+=========================================================================== */
+int Camera_CopyImageData(WND_INFO *wnd, int frame, void **image_data, int *length) {
+	static char *rname = "Camera_CopyImageData";
+
+	void *memory;
+	int rc, nbytes;
+
+	/* Default return values */
+	if (image_data != NULL) *image_data = NULL;
+	if (length     != NULL) *length = 0;
+
+	if (wnd == NULL) wnd = main_wnd;
+	if (wnd == NULL) return 1;										/* Nothing initialized */
+	if (image_data == NULL) return 2;
+
+	if (frame == FRAME_HDR) return HDR_GetImageData(wnd, image_data, length);
+	if (frame == FRAME_MEAN || frame == FRAME_VARIANCE) return Accum_GetImageData(wnd, frame, image_data, length);
+
+	if ( (rc = Camera_GetImageData(wnd, frame, &memory, &nbytes)) != 0) return rc;
+	if (memory == NULL || nbytes <= 0) return 2;
+	if ( (*image_data = malloc(nbytes)) == NULL) return 4;
+	memcpy(*image_data, memory, nbytes);
+	if (length != NULL) *length = nbytes;
+	return 0;
+}
+
+/* ===========================================================================
+-- Describe the pixel layout of a specific image for the generic kernels
+--
+-- Usage: int Camera_GetImageBuffer(WND_INFO *wnd, int frame, IMAGE_BUFFER *buffer);
+--
+-- Inputs: wnd    - pointer to valid window information
+--         frame  - index of frame to image (-1 = current)
+--                    invalid frame return error (rc = 2)
+--         buffer - pointer to structure to receive the description
+--
+-- Output: *buffer - format, geometry and pointer to the (shared) ring memory
+--
+-- Return: 0 if successful, 
+--           1 => no camera initialized
+--           2 => frame invalid
+=========================================================================== */
+int Camera_GetImageBuffer(WND_INFO *wnd, int frame, IMAGE_BUFFER *buffer) {
+	static char *rname = "Camera_GetImageBuffer";
+
+	TL_CAMERA  *tl;
+	DCX_CAMERA *dcx;
+	int rc;
+	BOOL bServerRequest;
+
+	if (buffer != NULL) memset(buffer, 0, sizeof(*buffer));
+
+	/* Make sure we have valid structures */
+	if (bServerRequest = (wnd == NULL)) wnd = main_wnd;
+	if (wnd == NULL) return 1;										/* Nothing initialized */
+
+	switch (wnd->Camera.driver) {
+		case DCX:
+			dcx = (DCX_CAMERA *) wnd->Camera.details;
+			rc = DCx_GetImageBuffer(dcx, frame, buffer);
+			break;
+		case TL:
+			tl = (TL_CAMERA *) wnd->Camera.details;
+			rc = TL_GetImageBuffer(tl, frame, buffer);
+			break;
+		case SIM:
+			rc = SIM_GetImageBuffer((SIM_CAMERA *) wnd->Camera.details, frame, buffer);
+			break;
 		default:
 			rc = 1;
 			break;
@@ -1536,7 +2381,8 @@ static int GetFilename(WND_INFO *wnd, char *path, size_t length, FILE_FORMAT dfl
 -- Usage: int Camera_SaveImage(WND_INFO *wnd, int frame, char *path, FILE_FORMAT format);
 --
 -- Inputs: wnd    - handle to the main information structure
---         frame  - frame to save (-1 => last)
+--         frame  - frame to save (-1 => last, FRAME_HDR => merged HDR frame,
+--                  FRAME_MEAN / FRAME_VARIANCE => accumulator as raw float32)
 --         path   - filename (NULL to query)
 --         format - format (if path given) or preferred format if querying
 --
@@ -1553,6 +2399,7 @@ int Camera_SaveImage(WND_INFO *wnd, int frame, char *pathname, FILE_FORMAT forma
 	TL_CAMERA *camera;
 	DCX_CAMERA *dcx;
 	BOOL bServerRequest;
+	LONGLONG t_save;
 
 	char path[PATH_MAX];								/* Local storage for pathname if NULL */
 
@@ -1574,10 +2421,15 @@ int Camera_SaveImage(WND_INFO *wnd, int frame, char *pathname, FILE_FORMAT forma
 		pathname = path;
 	}
 
+	/* Merged HDR frame has its own writer (PFM for float, PGM for 16-bit) */
+	if (frame == FRAME_HDR) return HDR_SaveImage(wnd, pathname);
+	if (frame == FRAME_MEAN || frame == FRAME_VARIANCE) return Accum_SaveImage(wnd, frame, pathname);		/* Raw float32 */
+
 	/* Guess format for the drivers ... though they will ultimately choose a default */
 	if (format == FILE_DFLT) format = GuessFileFormat(pathname);
 
 	/* Send to appropriate driver routine */
+	t_save = Perf_Start();
 	switch (wnd->Camera.driver) {
 		case DCX:
 			dcx = wnd->dcx;
@@ -1589,10 +2441,15 @@ int Camera_SaveImage(WND_INFO *wnd, int frame, char *pathname, FILE_FORMAT forma
 			rc = TL_SaveImage(camera, pathname, frame, format);
 			break;
 
+		case SIM:
+			rc = SIM_SaveImage((SIM_CAMERA *) wnd->Camera.details, pathname, frame, format);
+			break;
+
 		default:
 			rc = 2;
 			break;
 	}
+	if (rc == 0) Perf_Stop(PERF_SAVE, t_save);
 
 #if 0
 ExitSave:
@@ -1716,6 +2573,9 @@ int Camera_SaveAll(WND_INFO *wnd, char *pattern, FILE_FORMAT format) {
 			tl = (TL_CAMERA *) wnd->Camera.details;
 			rc = TL_SaveBurstImages(tl, pattern, format);
 			break;
+		case SIM:
+			rc = SIM_SaveBurstImages((SIM_CAMERA *) wnd->Camera.details, pattern, format);
+			break;
 
 		default:
 			rc = 2;
@@ -5,11 +5,11 @@
 int nskip_rate_ms;
 
 /* Note: The structures here are also used by the client/server */
-typedef enum _CAMERA_TYPE {CAMERA_UNKNOWN=0, CAMERA_DCX=1, CAMERA_TL=2} CAMERA_TYPE;
+typedef enum _CAMERA_TYPE {CAMERA_UNKNOWN=0, CAMERA_DCX=1, CAMERA_TL=2, CAMERA_SIM=3} CAMERA_TYPE;
 
 #pragma pack(4)
 typedef struct _IMAGE_INFO {			/* NOTE: interpretation of values depends on camera type */ 
-	CAMERA_TYPE type;						/* 0=unknown, 1=DCX, 2=TL					*/
+	CAMERA_TYPE type;						/* 0=unknown, 1=DCX, 2=TL, 3=SIM			*/
 	uint32_t frame;						/* Which frame within the ring buffer	*/
 	__time64_t timestamp;				/* Standard UNIX time of image capture (64 bit) */
 	double camera_time;					/* Time of capture from camera clock - units are seconds but epoch undefined */
@@ -22,25 +22,105 @@ typedef struct _IMAGE_INFO {			/* NOTE: interpretation of values depends on came
 	uint32_t color_correct_mode;		/* Camera dependent							*/
 												/* For DCX, 0,1,2,4,8 corresponding to disable, enable, BG40, HQ, IR Auto */
 	double color_correct_strength;	/* Camera dependent							*/
+	int imageID;							/* Unique ID of image (increases frame to frame), -1 if unknown */
+	int bin;									/* Binning factor of the image (1 ==> none) */
+	double x_pixel_um, y_pixel_um;	/* Effective pixel size in um (binned) */
 } IMAGE_INFO;
 #pragma pack()
 
 /* Structure used by ZooCam_client to query camera characteristics */
 #pragma pack(4)
 typedef struct _CAMERA_INFO {
-	CAMERA_TYPE type;						/* 0=unknown, 1=DCX, 2=TL		*/
+	CAMERA_TYPE type;						/* 0=unknown, 1=DCX, 2=TL, 3=SIM */
 	char name[32];							/* "name" of specific camera	*/
 	char model[32];						/* Manufacturer's camera model */
 	char manufacturer[32];				/* Sensor manufacturer */
 	char serial[32];						/* Sensor serial number */
 	char version[32];						/* Sensor version */
 	char date[32];							/* Sensor firmware date */
-	uint32_t width, height;				/* Maximum image size */
+	uint32_t width, height;				/* Maximum image size (binned) */
 	BOOL bColor;							/* Is camera color? */
-	double x_pixel_um, y_pixel_um;	/* Pixel size in um */
+	double x_pixel_um, y_pixel_um;	/* Pixel size in um (binned) */
 } CAMERA_INFO;
 #pragma pack()
 
+/* Binning state (see Camera_SetBinning) */
+#define	MAX_BINNING			(8)
+#pragma pack(4)
+typedef struct _BINNING_INFO {
+	int bin;									/* Binning factor of the images (1 ==> none) */
+	int hardware;							/* Part done by the sensor */
+	int software;							/* Part done as frames enter the ring (CFA-aware for color) */
+	int max_hardware;						/* Largest sensor binning available (1 ==> none) */
+	uint32_t width, height;				/* Binned image size */
+	double x_pixel_um, y_pixel_um;	/* Binned pixel size in um */
+} BINNING_INFO;
+#pragma pack()
+
+/* Cached camera properties (see Camera_GetProperties) */
+#define	PROP_EXPOSURE		(0x01)			/* exposure, ms_min, ms_max, ms_incr */
+#define	PROP_FPS				(0x02)			/* fps (frame rate control setting) */
+#define	PROP_GAMMA			(0x04)
+#define	PROP_GAINS			(0x08)			/* gains[], slider[] */
+#define	PROP_ALL				(0x0F)
+#define	PROP_MAX_SIGNALS	(10)
+#define	PROP_RECONCILE_MS	(1000)			/* Background comparison with the camera */
+#pragma pack(4)
+typedef struct _CAMERA_PROPS {
+	int version;							/* Incremented each time any value changes */
+	int changed;							/* PROP_* groups that changed in this version */
+	double exposure;						/* Exposure time in ms */
+	double ms_min, ms_max, ms_incr;	/* Exposure range and step */
+	double fps;								/* Frame rate setting (<= 0 ==> no control) */
+	double gamma;
+	double gains[4], slider[4];		/* master, red, green, blue (see Camera_GetGains) */
+} CAMERA_PROPS;
+#pragma pack()
+
+/* Staged changes applied together between two frames (Camera_ApplySettings) */
+/* Bits match the MODIFY_* flags of ZooCam_client.h */
+#define	SETTING_EXPOSURE		(0x01)
+#define	SETTING_FPS				(0x02)
+#define	SETTING_GAMMA			(0x04)
+#define	SETTING_MASTER_GAIN	(0x08)
+#define	SETTING_RED_GAIN		(0x10)
+#define	SETTING_GREEN_GAIN	(0x20)
+#define	SETTING_BLUE_GAIN		(0x40)
+#define	SETTING_GAINS			(0x78)
+#define	SETTING_FRAME_WAIT	(1000)			/* Default ms to wait for a frame boundary */
+#pragma pack(4)
+typedef struct _CAMERA_SETTINGS {
+	int modify;								/* SETTING_* values to change (all values are returned) */
+	int imageID;							/* Output: frames from this imageID on have every change (bound, -1 if unknown) */
+	double exposure;						/* Exposure time in ms */
+	double fps;								/* Frame rate (per second) */
+	double gamma;
+	double gains[4];						/* master, red, green, blue (IS_VALUE units of Camera_SetGains) */
+} CAMERA_SETTINGS;
+#pragma pack()
+
+/* Synthetic camera (see SIM_SetConfig) ... frames are generated, not captured */
+/* Same seed and settings ==> same sequence of frames */
+#define	SIM_MAX_SPOTS		(16)
+#pragma pack(4)
+typedef struct _SIM_CONFIG {
+	int width, height;					/* Image size (takes effect at the next open) */
+	BOOL bColor;							/* Bayer (G R / B G) or monochrome (next open) */
+	int bit_depth;							/* Significant bits in each pixel [8,16] (next open) */
+	double fps;								/* Frame rate (up to SIM_FPS_MAX, limited by the exposure) */
+	int nspots;								/* Number of Gaussian spots [0,SIM_MAX_SPOTS] */
+	double sigma;							/* Spot sigma at best focus (pixels) */
+	double peak;							/* Spot peak at best focus, 10 ms and 0 dB (counts) */
+	double speed;							/* Spot motion (pixels per second of frame time) */
+	double background;					/* Dark level (counts) */
+	double noise;							/* RMS read noise at 0 dB (counts) */
+	double focus;							/* Virtual focus position (mm) */
+	double best_focus;					/* Focus position giving the sharpest spots (mm) */
+	double blur_per_mm;					/* Growth of spot sigma with defocus (pixels/mm) */
+	int seed;								/* Spot layout and noise sequence */
+} SIM_CONFIG;
+#pragma pack()
+
 /* Values for the enumeration must match order of radio buttons */
 #define	NUM_TRIGGER_MODES		(5)
 typedef enum _TRIGGER_MODE     { TRIG_FREERUN=0, TRIG_SOFTWARE=1, TRIG_EXTERNAL=2, TRIG_SS=3, TRIG_BURST=4 } TRIGGER_MODE;
@@ -87,6 +167,11 @@ typedef enum _COLOR_CORRECT { COLOR_DISABLE=0, COLOR_ENABLE=1, COLOR_BG40=2, COL
 /* Enum for file type in saves */
 typedef enum _FILE_FORMAT { FILE_DFLT = 0, FILE_BMP=1, FILE_RAW=2, FILE_JPG=3, FILE_PNG=4 } FILE_FORMAT;
 
+/* Pseudo frame indices for images computed from the ring (see HDR_Bracket, Accum_Start) */
+#define	FRAME_HDR			(-2)				/* Last merged HDR image */
+#define	FRAME_MEAN			(-3)				/* Accumulator mean */
+#define	FRAME_VARIANCE		(-4)				/* Accumulator variance */
+
 /* Structure use for communicating ring size information in client/server */
 #pragma pack(4)
 typedef struct _RING_INFO {
@@ -106,9 +191,20 @@ typedef struct _RING_INFO {
 #ifndef ZOOM_CLIENT							/* Don't load if the client code */
 
 typedef struct _WND_INFO WND_INFO;
+typedef struct _IMAGE_BUFFER IMAGE_BUFFER;				/* Defined in image_proc.h */
 
 int Camera_GetCameraInfo(WND_INFO *wnd, CAMERA_INFO *info);
 
+int Camera_GetProperties(WND_INFO *wnd, CAMERA_PROPS *props);
+int Camera_RefreshProperties(WND_INFO *wnd, int which);
+int Camera_WaitProperties(WND_INFO *wnd, int version, int msWait, CAMERA_PROPS *props);
+BOOL Camera_PropertiesCurrent(WND_INFO *wnd);
+void Camera_HoldProperties(WND_INFO *wnd, BOOL hold);
+void Camera_StopProperties(WND_INFO *wnd);
+int Camera_AddPropertySignal(WND_INFO *wnd, HANDLE signal);
+int Camera_RemovePropertySignal(WND_INFO *wnd, HANDLE signal);
+int Camera_ApplySettings(WND_INFO *wnd, CAMERA_SETTINGS *settings, int msWait);
+
 int    Camera_GetExposureParms(WND_INFO *wnd, double *ms_low, double *ms_high, double *ms_incr);
 double Camera_SetExposure(WND_INFO *wnd, double ms_expose);
 double Camera_GetExposure(WND_INFO *wnd);
@@ -141,10 +237,13 @@ TRIGGER_MODE Camera_GetTriggerMode(WND_INFO *wnd, TRIGGER_INFO *info);
 
 int Camera_GetRingInfo(WND_INFO *wnd, RING_INFO *info);
 int Camera_SetRingBufferSize(WND_INFO *wnd, int nBuf);
+int Camera_SetBinning(WND_INFO *wnd, int bin, BOOL bSoftware, BINNING_INFO *info);
 int Camera_ResetRingCounters(WND_INFO *wnd);
 
 int Camera_GetImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
+int Camera_CopyImageData(WND_INFO *wnd, int frame, void **image_data, int *length);
 int Camera_GetImageInfo(WND_INFO *wnd, int frame, IMAGE_INFO *info);
+int Camera_GetImageBuffer(WND_INFO *wnd, int frame, IMAGE_BUFFER *buffer);
 
 int Camera_GetPreferredImageFormat(WND_INFO *wnd);
 int Camera_GetSaveFormatFlag(WND_INFO *wnd);
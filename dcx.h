@@ -61,7 +61,8 @@ typedef struct _DCX_CAMERA {
 	int CameraID;
 	CAMINFO CameraInfo;						/* Details on the camera */
 	SENSORINFO SensorInfo;					/* Details on the sensor */
-	int width, height;						/* Size of the sensor in pixels */
+	int width, height;						/* Size of the sensor in pixels (binned) */
+	int bin;										/* Hardware binning factor (0/1 ==> none) */
 	BOOL IsSensorColor;						/* Is the camera a color camera */
 	int NumImageFormats;						/* Number of image formats available */
 	IMAGE_FORMAT_LIST *ImageFormatList;	/* List of formats for the active camera */
@@ -147,6 +148,8 @@ int DCx_GetRingInfo(DCX_CAMERA *dcx, int *nBuffers, int *nValid, int *iLast, int
 int DCx_SetRingBufferSize(DCX_CAMERA *dcx, int nBuf);
 int DCx_ReleaseRingBuffers(DCX_CAMERA *dcx);
 int DCx_ResetRingCounters(DCX_CAMERA *dcx);
+int DCx_SetBinning(DCX_CAMERA *dcx, int bin);
+int DCx_GetBinning(DCX_CAMERA *dcx, BINNING_INFO *info);
 
 int FindImageIndexFromPID(DCX_CAMERA *dcx, int PID);
 int FindImageIndexFrompMem(DCX_CAMERA *dcx, char *pMem);
@@ -156,6 +159,7 @@ int FindImagePIDFrompMem(DCX_CAMERA *dcx, unsigned char *pMem, int *index);
 /* Image saving */
 int DCx_GetImageInfo(DCX_CAMERA *dcx, int frame, IMAGE_INFO *info);
 int DCx_GetImageData(DCX_CAMERA *dcx, int frame, void **image_data, size_t *length);
+int DCx_GetImageBuffer(DCX_CAMERA *dcx, int frame, IMAGE_BUFFER *buffer);
 
 int DCx_GetSaveFormatFlag(DCX_CAMERA *dcx);
 int DCx_SaveBurstImages(DCX_CAMERA *dcx, char *pattern, FILE_FORMAT format);
@@ -0,0 +1,1425 @@
+/* image_proc.c -- pixel kernels shared by the camera drivers and the server */
+
+/* ------------------------------ */
+/* Feature test macros            */
+/* ------------------------------ */
+#define _POSIX_SOURCE					/* Always require POSIX standard */
+
+/* ------------------------------ */
+/* Standard include files         */
+/* ------------------------------ */
+#include <stddef.h>						/* for defining several useful types and macros */
+#include <stdlib.h>						/* for performing a variety of operations */
+#include <stdio.h>
+#include <string.h>						/* for manipulating several kinds of strings */
+#include <math.h>
+#include <stdint.h>						/* C99 extension to get known width integers */
+
+/* Extend from POSIX to get thread functions */
+#undef _POSIX_
+	#include <process.h>					/* for process control fuctions (e.g. threads, programs) */
+#define _POSIX_
+
+/* Standard Windows libraries */
+#define STRICT								/* define before including windows.h for stricter type checking */
+	#include <windows.h>					/* master include file for Windows applications */
+
+/* SSE2 is guaranteed on x64 and with /arch:SSE2 on Win32 */
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define	USE_SSE2
+	#include <emmintrin.h>
+#endif
+
+/* ------------------------------ */
+/* Local include files            */
+/* ------------------------------ */
+#include "image_proc.h"
+
+/* ------------------------------- */
+/* My local typedef's and defines  */
+/* ------------------------------- */
+#ifndef TRUE
+	#define	TRUE	(1)
+#endif
+#ifndef FALSE
+	#define	FALSE	(0)
+#endif
+
+#define	IP_HDR_MAX_THREADS	(16)				/* Bands for IP_MergeHDR */
+
+/* One band of rows for IP_MergeHDR (everything the row kernel needs) */
+typedef struct _HDR_BAND {
+	IMAGE_BUFFER *frames, *dst;
+	int nframes;
+	float inv_t[IP_HDR_MAX_FRAMES];			/* 1/exposure of each frame */
+	int k_short, k_long;						/* Shortest and longest exposures */
+	float black, sat, scale;
+	int row0, row1;							/* Rows [row0,row1) of this band */
+	volatile long *remaining;				/* Bands still running */
+	HANDLE done;								/* Set when remaining reaches 0 */
+	int rc;
+} HDR_BAND;
+
+/* ------------------------------- */
+/* My external function prototypes */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* My internal function prototypes */
+/* ------------------------------- */
+static void row_16_to_8(const unsigned short *src, unsigned char *dst, int n, int shift);
+static void row_bin2_16(const unsigned short *r0, const unsigned short *r1, unsigned short *dst, int nout);
+static int extract_generic(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst);
+static int extract_bayer(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst);
+static void hdr_band_thread(void *arg);
+static void hdr_row(HDR_BAND *band, const void **rows, int bytes, int n, float *dst);
+static void accum_row(const void *src, BOOL wide, uint32_t *sum, uint64_t *sumsq, int n, BOOL subtract);
+
+/* ------------------------------- */
+/* My usage of other external fncs */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* Locally defined global vars     */
+/* ------------------------------- */
+
+
+/* ===========================================================================
+-- Return number of bytes used by each pixel of a given format
+--
+-- Usage: int IP_BytesPerPixel(PIXEL_FORMAT format);
+--
+-- Inputs: format - one of the PIXEL_FORMAT enums
+--
+-- Output: none
+--
+-- Return: bytes per pixel, or 0 if format is unknown
+=========================================================================== */
+int IP_BytesPerPixel(PIXEL_FORMAT format) {
+
+	switch (format) {
+		case PIXEL_MONO8:		return 1;
+		case PIXEL_BGR24:
+		case PIXEL_RGB24:		return 3;
+		case PIXEL_MONO16:
+		case PIXEL_BAYER16:	return 2;
+		case PIXEL_FLOAT32:	return 4;
+		default:					return 0;
+	}
+}
+
+/* ===========================================================================
+-- Validate a region request against an image and determine output geometry
+--
+-- Usage: int IP_RegionGeometry(IMAGE_BUFFER *src, IMAGE_REGION *region, PIXEL_FORMAT format, IMAGE_BUFFER *dst);
+--
+-- Inputs: src    - description of the source image
+--         region - requested rectangle / binning (modified, see output)
+--         format - requested output format (PIXEL_MONO16, PIXEL_MONO8, PIXEL_RGB24 or PIXEL_BGR24)
+--         dst    - structure to receive the output geometry
+--
+-- Output: *region - clipped to the image.  For Bayer sources the corner
+--                   and size are forced even so the CFA phase is retained
+--         *dst    - format, width, height, pitch and bit_depth of the
+--                   extracted image.  dst->data is set to NULL and must be
+--                   assigned by the caller before IP_ExtractRegion()
+--
+-- Return: 0 if successful, otherwise
+--           1 ==> invalid source image or NULL pointers
+--           2 ==> region lies outside the image or is smaller than one bin
+--           3 ==> unsupported output format
+--
+-- Notes: (1) Bayer sources work in 2x2 cells.  PIXEL_MONO16 returns a
+--            Bayer mosaic (PIXEL_BAYER16) with each color binned separately.
+--            PIXEL_MONO8 and PIXEL_RGB24 return one pixel per binned cell.
+--        (2) 16-bit samples are scaled to 8 bits by dropping low bits
+=========================================================================== */
+int IP_RegionGeometry(IMAGE_BUFFER *src, IMAGE_REGION *region, PIXEL_FORMAT format, IMAGE_BUFFER *dst) {
+	static char *rname = "IP_RegionGeometry";
+
+	int cell, nx, ny;
+	BOOL bBayer;
+
+	if (dst != NULL) memset(dst, 0, sizeof(*dst));
+	if (src == NULL || region == NULL || dst == NULL || src->data == NULL) return 1;
+	if (src->width <= 0 || src->height <= 0 || IP_BytesPerPixel(src->format) == 0) return 1;
+
+	/* Clip the requested rectangle to the image */
+	if (region->bin < 1) region->bin = 1;
+	if (region->ulx < 0) region->ulx = 0;
+	if (region->uly < 0) region->uly = 0;
+	if (region->ulx >= src->width || region->uly >= src->height) return 2;
+	if (region->width  <= 0 || region->ulx+region->width  > src->width)  region->width  = src->width  - region->ulx;
+	if (region->height <= 0 || region->uly+region->height > src->height) region->height = src->height - region->uly;
+
+	/* Bayer data is handled in 2x2 cells so the CFA phase is preserved */
+	bBayer = (src->format == PIXEL_BAYER16);
+	if (bBayer) {
+		region->ulx &= ~1;  region->uly &= ~1;
+		region->width &= ~1; region->height &= ~1;
+	}
+	cell = bBayer ? 2 : 1;
+	nx = region->width  / (cell*region->bin);
+	ny = region->height / (cell*region->bin);
+	if (nx <= 0 || ny <= 0) return 2;
+
+	switch (format) {
+		case PIXEL_MONO16:
+		case PIXEL_BAYER16:
+			dst->format    = bBayer ? PIXEL_BAYER16 : PIXEL_MONO16;
+			dst->width     = nx*cell;
+			dst->height    = ny*cell;
+			dst->bit_depth = src->bit_depth;
+			dst->cfa_phase = src->cfa_phase;						/* Even offsets keep the phase */
+			break;
+		case PIXEL_MONO8:
+		case PIXEL_RGB24:
+		case PIXEL_BGR24:
+			dst->format    = format;
+			dst->width     = nx;
+			dst->height    = ny;
+			dst->bit_depth = 8;
+			break;
+		default:
+			return 3;
+	}
+	dst->pitch = dst->width * IP_BytesPerPixel(dst->format);
+	dst->data  = NULL;
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Extract a cropped, binned and format converted copy of an image
+--
+-- Usage: int IP_ExtractRegion(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst);
+--
+-- Inputs: src    - description of the source image
+--         region - region as validated by IP_RegionGeometry()
+--         dst    - geometry from IP_RegionGeometry() with dst->data pointing
+--                  to at least dst->pitch*dst->height bytes
+--
+-- Output: dst->data filled with the extracted pixels
+--
+-- Return: 0 if successful, otherwise
+--           1 ==> invalid parameters
+--           2 ==> unable to allocate working memory
+--
+-- Notes: Common cases (straight crop, 16->8 bit, 2x2 mono binning) use
+--        SSE2 kernels when available.  Everything else uses the generic
+--        accumulate loops.  Averages are rounded to nearest.
+=========================================================================== */
+int IP_ExtractRegion(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst) {
+	static char *rname = "IP_ExtractRegion";
+
+	int row, bpp, shift;
+	unsigned char *sptr, *dptr;
+
+	if (src == NULL || region == NULL || dst == NULL || src->data == NULL || dst->data == NULL) return 1;
+
+	/* Bayer mosaics are always binned as 2x2 cells */
+	if (src->format == PIXEL_BAYER16) return extract_bayer(src, region, dst);
+
+	/* Full resolution crop with no change of format is just row copies */
+	if (region->bin == 1 && src->format == dst->format) {
+		bpp = IP_BytesPerPixel(src->format);
+		for (row=0; row<dst->height; row++) {
+			sptr = (unsigned char *) src->data + (size_t) (region->uly+row)*src->pitch + (size_t) region->ulx*bpp;
+			dptr = (unsigned char *) dst->data + (size_t) row*dst->pitch;
+			memcpy(dptr, sptr, (size_t) dst->width*bpp);
+		}
+		return 0;
+	}
+
+	/* 16-bit mono to 8-bit mono at full resolution */
+	if (region->bin == 1 && src->format == PIXEL_MONO16 && dst->format == PIXEL_MONO8) {
+		shift = (src->bit_depth > 8) ? src->bit_depth-8 : 0 ;
+		for (row=0; row<dst->height; row++) {
+			sptr = (unsigned char *) src->data + (size_t) (region->uly+row)*src->pitch;
+			dptr = (unsigned char *) dst->data + (size_t) row*dst->pitch;
+			row_16_to_8((unsigned short *) sptr + region->ulx, dptr, dst->width, shift);
+		}
+		return 0;
+	}
+
+	/* 2x2 averaged binning of 16-bit mono data */
+	if (region->bin == 2 && ! region->bDecimate && src->format == PIXEL_MONO16 && dst->format == PIXEL_MONO16) {
+		for (row=0; row<dst->height; row++) {
+			sptr = (unsigned char *) src->data + (size_t) (region->uly+2*row)*src->pitch;
+			dptr = (unsigned char *) dst->data + (size_t) row*dst->pitch;
+			row_bin2_16((unsigned short *) sptr + region->ulx, (unsigned short *) (sptr+src->pitch) + region->ulx, (unsigned short *) dptr, dst->width);
+		}
+		return 0;
+	}
+
+	return extract_generic(src, region, dst);
+}
+
+
+/* ===========================================================================
+-- Kernel: shift a row of 16-bit samples down to 8 bits with saturation
+=========================================================================== */
+static void row_16_to_8(const unsigned short *src, unsigned char *dst, int n, int shift) {
+	int i=0;
+	unsigned int ival;
+
+#ifdef USE_SSE2
+	__m128i a, b, cnt;
+
+	cnt = _mm_cvtsi32_si128(shift);
+	for (; i+16<=n; i+=16) {
+		a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (src+i)),   cnt);
+		b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (src+i+8)), cnt);
+		_mm_storeu_si128((__m128i *) (dst+i), _mm_packus_epi16(a, b));
+	}
+#endif
+
+	for (; i<n; i++) {
+		ival = src[i] >> shift;
+		dst[i] = (ival > 255) ? 255 : (unsigned char) ival;
+	}
+	return;
+}
+
+/* ===========================================================================
+-- Kernel: average 2x2 blocks from two rows of 16-bit samples
+-- Widens to 32 bits so full 16-bit data cannot overflow
+=========================================================================== */
+static void row_bin2_16(const unsigned short *r0, const unsigned short *r1, unsigned short *dst, int nout) {
+	int i=0;
+
+#ifdef USE_SSE2
+	__m128i a, b, zero, two, bias32, bias16, s0, s1, sum;
+
+	zero   = _mm_setzero_si128();
+	two    = _mm_set1_epi32(2);
+	bias32 = _mm_set1_epi32(32768);
+	bias16 = _mm_set1_epi16((short) 0x8000);
+	for (; i+4<=nout; i+=4) {
+		a  = _mm_loadu_si128((const __m128i *) (r0+2*i));
+		b  = _mm_loadu_si128((const __m128i *) (r1+2*i));
+		s0 = _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero));	/* Columns 0-3 */
+		s1 = _mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero));	/* Columns 4-7 */
+		s0 = _mm_add_epi32(s0, _mm_srli_epi64(s0, 32));											/* Pairs in lanes 0 and 2 */
+		s1 = _mm_add_epi32(s1, _mm_srli_epi64(s1, 32));
+		s0 = _mm_shuffle_epi32(s0, _MM_SHUFFLE(3,3,2,0));
+		s1 = _mm_shuffle_epi32(s1, _MM_SHUFFLE(3,3,2,0));
+		sum = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(s0, s1), two), 2);
+		/* No unsigned 32->16 pack in SSE2, so bias into signed range and back */
+		sum = _mm_packs_epi32(_mm_sub_epi32(sum, bias32), zero);
+		_mm_storel_epi64((__m128i *) (dst+i), _mm_add_epi16(sum, bias16));
+	}
+#endif
+
+	for (; i<nout; i++) dst[i] = (unsigned short) ((r0[2*i] + r0[2*i+1] + r1[2*i] + r1[2*i+1] + 2) >> 2);
+	return;
+}
+
+/* ===========================================================================
+-- Generic extraction for mono and packed color sources
+-- Accumulates each output row in 32-bit sums and then converts
+=========================================================================== */
+static int extract_generic(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst) {
+	static char *rname = "extract_generic";
+
+	int i, j, ox, oy, sx, nb, n, nch, shift;
+	uint32_t *sums, r, g, b, v;
+	unsigned char *srow, *drow, *p;
+
+	nch   = (src->format == PIXEL_BGR24 || src->format == PIXEL_RGB24) ? 3 : 1 ;
+	nb    = region->bDecimate ? 1 : region->bin ;
+	n     = nb*nb;
+	shift = (src->bit_depth > 8) ? src->bit_depth-8 : 0 ;
+
+	if ( (sums = malloc(dst->width*nch*sizeof(*sums))) == NULL) return 2;
+
+	for (oy=0; oy<dst->height; oy++) {
+		memset(sums, 0, dst->width*nch*sizeof(*sums));
+		for (j=0; j<nb; j++) {
+			srow = (unsigned char *) src->data + (size_t) (region->uly + oy*region->bin + j)*src->pitch;
+			for (ox=0; ox<dst->width; ox++) {
+				for (i=0; i<nb; i++) {
+					sx = region->ulx + ox*region->bin + i;
+					switch (src->format) {
+						case PIXEL_MONO8:
+							sums[ox] += srow[sx]; break;
+						case PIXEL_MONO16:
+							sums[ox] += ((unsigned short *) srow)[sx]; break;
+						case PIXEL_BGR24:
+							p = srow+3*sx; sums[3*ox] += p[2]; sums[3*ox+1] += p[1]; sums[3*ox+2] += p[0]; break;
+						case PIXEL_RGB24:
+							p = srow+3*sx; sums[3*ox] += p[0]; sums[3*ox+1] += p[1]; sums[3*ox+2] += p[2]; break;
+						default:
+							break;
+					}
+				}
+			}
+		}
+
+		/* Convert the sums to the output format */
+		drow = (unsigned char *) dst->data + (size_t) oy*dst->pitch;
+		for (ox=0; ox<dst->width; ox++) {
+			if (nch == 1) {
+				r = g = b = v = (sums[ox] + n/2) / n;
+			} else {
+				r = (sums[3*ox]   + n/2) / n;
+				g = (sums[3*ox+1] + n/2) / n;
+				b = (sums[3*ox+2] + n/2) / n;
+				v = (r + 2*g + b + 2) / 4;
+			}
+			switch (dst->format) {
+				case PIXEL_MONO16:
+					((unsigned short *) drow)[ox] = (unsigned short) v; break;
+				case PIXEL_MONO8:
+					v >>= shift; drow[ox] = (unsigned char) min(v, 255); break;
+				case PIXEL_RGB24:
+					drow[3*ox] = (unsigned char) min(r >> shift, 255); drow[3*ox+1] = (unsigned char) min(g >> shift, 255); drow[3*ox+2] = (unsigned char) min(b >> shift, 255); break;
+				case PIXEL_BGR24:
+					drow[3*ox] = (unsigned char) min(b >> shift, 255); drow[3*ox+1] = (unsigned char) min(g >> shift, 255); drow[3*ox+2] = (unsigned char) min(r >> shift, 255); break;
+				default:
+					break;
+			}
+		}
+	}
+
+	free(sums);
+	return 0;
+}
+
+/* ===========================================================================
+-- Channel (0=R, 1=G, 2=B) at each position of a 2x2 Bayer cell
+--
+-- Usage: static void bayer_channels(CFA_PHASE phase, int chan[4]);
+--
+-- Output: chan[2*(y%2) + x%2] is the color at (x,y) for this phase
+=========================================================================== */
+static void bayer_channels(CFA_PHASE phase, int chan[4]) {
+	static const int map[4][4] = {
+		{ 0, 1, 1, 2 },									/* CFA_RED:                R G / G B */
+		{ 2, 1, 1, 0 },									/* CFA_BLUE:               B G / G R */
+		{ 1, 0, 2, 1 },									/* CFA_GREEN_LEFT_OF_RED:  G R / B G */
+		{ 1, 2, 0, 1 }										/* CFA_GREEN_LEFT_OF_BLUE: G B / R G */
+	};
+	int i;
+
+	if (phase < CFA_RED || phase > CFA_GREEN_LEFT_OF_BLUE) phase = CFA_GREEN_LEFT_OF_RED;
+	for (i=0; i<4; i++) chan[i] = map[phase][i];
+	return;
+}
+
+/* ===========================================================================
+-- Extraction for Bayer mosaic sources (phase from src->cfa_phase)
+-- Each 2x2 cell is accumulated as four separate colors
+=========================================================================== */
+static int extract_bayer(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst) {
+	static char *rname = "extract_bayer";
+
+	int i, j, ox, oy, sx, nb, n, nx, shift;
+	int chan[4], ir, ig1, ig2, ib;
+	uint32_t *sums, *s, r, g, b;
+	unsigned short *r0, *r1, *d0, *d1;
+	unsigned char *drow;
+
+	nb    = region->bDecimate ? 1 : region->bin ;
+	n     = nb*nb;
+	shift = (src->bit_depth > 8) ? src->bit_depth-8 : 0 ;
+	nx    = (dst->format == PIXEL_BAYER16) ? dst->width/2 : dst->width ;
+
+	/* Which of the four cell sums holds each color */
+	bayer_channels(src->cfa_phase, chan);
+	ir = ig1 = ig2 = ib = -1;
+	for (i=0; i<4; i++) {
+		if (chan[i] == 0) ir = i;
+		if (chan[i] == 2) ib = i;
+		if (chan[i] == 1) { if (ig1 < 0) ig1 = i; else ig2 = i; }
+	}
+
+	if ( (sums = malloc(4*nx*sizeof(*sums))) == NULL) return 2;
+
+	for (oy=0; oy<((dst->format == PIXEL_BAYER16) ? dst->height/2 : dst->height); oy++) {
+		memset(sums, 0, 4*nx*sizeof(*sums));
+		for (j=0; j<nb; j++) {
+			r0 = (unsigned short *) ((unsigned char *) src->data + (size_t) (region->uly + 2*(oy*region->bin+j))*src->pitch);
+			r1 = (unsigned short *) ((unsigned char *) r0 + src->pitch);
+			for (ox=0; ox<nx; ox++) {
+				s = sums + 4*ox;
+				for (i=0; i<nb; i++) {
+					sx = region->ulx + 2*(ox*region->bin+i);
+					s[0] += r0[sx]; s[1] += r0[sx+1];								/* Even row of the cell */
+					s[2] += r1[sx]; s[3] += r1[sx+1];								/* Odd row */
+				}
+			}
+		}
+
+		/* Convert the sums to the output format */
+		if (dst->format == PIXEL_BAYER16) {
+			d0 = (unsigned short *) ((unsigned char *) dst->data + (size_t) (2*oy)*dst->pitch);
+			d1 = (unsigned short *) ((unsigned char *) d0 + dst->pitch);
+			for (ox=0; ox<nx; ox++) {
+				s = sums + 4*ox;
+				d0[2*ox] = (unsigned short) ((s[0]+n/2)/n); d0[2*ox+1] = (unsigned short) ((s[1]+n/2)/n);
+				d1[2*ox] = (unsigned short) ((s[2]+n/2)/n); d1[2*ox+1] = (unsigned short) ((s[3]+n/2)/n);
+			}
+		} else {
+			drow = (unsigned char *) dst->data + (size_t) oy*dst->pitch;
+			for (ox=0; ox<nx; ox++) {
+				s = sums + 4*ox;
+				r = ((s[ir]+n/2)/n) >> shift;
+				g = ((s[ig1]+s[ig2]+n)/(2*n)) >> shift;
+				b = ((s[ib]+n/2)/n) >> shift;
+				switch (dst->format) {
+					case PIXEL_MONO8:
+						drow[ox] = (unsigned char) min((r+2*g+b+2)/4, 255); break;
+					case PIXEL_RGB24:
+						drow[3*ox] = (unsigned char) min(r, 255); drow[3*ox+1] = (unsigned char) min(g, 255); drow[3*ox+2] = (unsigned char) min(b, 255); break;
+					case PIXEL_BGR24:
+						drow[3*ox] = (unsigned char) min(b, 255); drow[3*ox+1] = (unsigned char) min(g, 255); drow[3*ox+2] = (unsigned char) min(r, 255); break;
+					default:
+						break;
+				}
+			}
+		}
+	}
+
+	free(sums);
+	return 0;
+}
+
+
+/* ===========================================================================
+-- Number of color channels reported by IP_ComputeStats for an image
+--
+-- Usage: int IP_StatsChannels(IMAGE_BUFFER *src);
+--
+-- Inputs: src - description of the source image
+--
+-- Output: none
+--
+-- Return: 3 for Bayer or packed color, 1 for mono, 0 if invalid
+=========================================================================== */
+int IP_StatsChannels(IMAGE_BUFFER *src) {
+
+	if (src == NULL) return 0;
+	switch (src->format) {
+		case PIXEL_MONO8:
+		case PIXEL_MONO16:	return 1;
+		case PIXEL_BGR24:
+		case PIXEL_RGB24:
+		case PIXEL_BAYER16:	return 3;
+		default:					return 0;
+	}
+}
+
+/* ===========================================================================
+-- Number of histogram bins (per channel) for a given shift
+--
+-- Usage: int IP_StatsHistBins(IMAGE_BUFFER *src, int hist_shift);
+--
+-- Inputs: src        - description of the source image
+--         hist_shift - number of low bits dropped for the histogram index
+--
+-- Output: none
+--
+-- Return: number of bins needed to cover [0, 2^bit_depth-1], 0 if invalid
+=========================================================================== */
+int IP_StatsHistBins(IMAGE_BUFFER *src, int hist_shift) {
+
+	if (src == NULL || src->bit_depth <= 0 || src->bit_depth > 16 || hist_shift < 0) return 0;
+	return (((1 << src->bit_depth) - 1) >> hist_shift) + 1;
+}
+
+/* ===========================================================================
+-- Single pass statistics on an image at full bit depth
+--
+-- Usage: int IP_ComputeStats(IMAGE_BUFFER *src, int hist_shift, int threshold, IP_STATS *stats,
+--                            uint32_t *hist, float *col_sums, float *row_sums);
+--
+-- Inputs: src        - description of the source image
+--         hist_shift - low bits dropped for histogram index (0 = full depth)
+--         threshold  - only intensity above this value contributes to the
+--                      centroid and moments (weight = value - threshold)
+--         stats      - pointer to structure to receive the scalar results
+--         hist       - if !NULL, nchannels*IP_StatsHistBins() counts (R,G,B order)
+--         col_sums   - if !NULL, src->width sums of each column (all channels)
+--         row_sums   - if !NULL, src->height sums of each row (all channels)
+--
+-- Output: *stats and the optional arrays
+--
+-- Return: 0 if successful, otherwise
+--           1 ==> invalid parameters or unsupported format
+--           2 ==> unable to allocate working memory
+--
+-- Notes: (1) Bayer channels follow src->cfa_phase.  The focus metrics use
+--            differences two pixels apart so only like colors are compared.
+--            For packed color only the green channel is used for focus.
+--        (2) Moments of packed color images use the sum of the channels.
+=========================================================================== */
+int IP_ComputeStats(IMAGE_BUFFER *src, int hist_shift, int threshold, IP_STATS *stats, uint32_t *hist, float *col_sums, float *row_sums) {
+	static char *rname = "IP_ComputeStats";
+
+	int x, y, c, v, d, nch, nbins, maxv, w, bpp, ir, ib;
+	int chan[4];
+	uint64_t rw, rwx, rwxx, rsum, brenner, nbrenner, chsum[IP_MAX_CHANNELS];
+	uint64_t *cols;
+	double W, WX, WY, WXX, WYY, WXY;
+	unsigned char *row8;
+	unsigned short *row16;
+
+	if (src == NULL || stats == NULL || src->data == NULL) return 1;
+	memset(stats, 0, sizeof(*stats));
+	if ( (nch = IP_StatsChannels(src)) == 0) return 1;
+	if ( (nbins = IP_StatsHistBins(src, hist_shift)) == 0) return 1;
+	maxv = (1 << src->bit_depth) - 1;
+	bpp  = IP_BytesPerPixel(src->format);
+
+	if ( (cols = calloc(src->width, sizeof(*cols))) == NULL) return 2;
+	if (hist != NULL) memset(hist, 0, nch*nbins*sizeof(*hist));
+
+	for (c=0; c<nch; c++) { stats->vmin[c] = maxv; stats->vmax[c] = 0; chsum[c] = 0; }
+	bayer_channels(src->cfa_phase, chan);
+	ir = (src->format == PIXEL_BGR24) ? 2 : 0 ;					/* Byte offsets of red and blue */
+	ib = (src->format == PIXEL_BGR24) ? 0 : 2 ;
+
+	W = WX = WY = WXX = WYY = WXY = 0;
+	brenner = nbrenner = 0;
+
+/* Accumulate everything a row at a time in integers, then fold into doubles */
+#define	ACCUMULATE(chan, value) {																		\
+		if (hist != NULL) hist[(chan)*nbins + ((value) >> hist_shift)]++;					\
+		if ((value) >= maxv) stats->saturated[chan]++;												\
+		if ((value) < stats->vmin[chan]) stats->vmin[chan] = (value);							\
+		if ((value) > stats->vmax[chan]) stats->vmax[chan] = (value);							\
+		chsum[chan] += (value); stats->npixels[chan]++;												\
+	}
+#define	FOCUS(delta) {																						\
+		d = abs(delta); brenner += (uint64_t) d*d; nbrenner++;									\
+		if (d > stats->max_gradient) stats->max_gradient = d;										\
+	}
+#define	MOMENTS(value) {																					\
+		if ((value) > threshold) {																			\
+			w = (value) - threshold;																		\
+			rw += w; rwx += (uint64_t) w*x; rwxx += (uint64_t) w*x*x;							\
+		}																											\
+		rsum += (value); cols[x] += (value);															\
+	}
+
+	for (y=0; y<src->height; y++) {
+		row8  = (unsigned char *) src->data + (size_t) y*src->pitch;
+		row16 = (unsigned short *) row8;
+		rw = rwx = rwxx = rsum = 0;
+
+		switch (src->format) {
+			case PIXEL_MONO8:
+				for (x=0; x<src->width; x++) {
+					v = row8[x];
+					ACCUMULATE(0, v);
+					if (x+2 < src->width) FOCUS(row8[x+2]-v);
+					MOMENTS(v);
+				}
+				break;
+			case PIXEL_MONO16:
+				for (x=0; x<src->width; x++) {
+					v = min(row16[x], maxv);
+					ACCUMULATE(0, v);
+					if (x+2 < src->width) FOCUS(row16[x+2]-row16[x]);
+					MOMENTS(v);
+				}
+				break;
+			case PIXEL_BAYER16:
+				for (x=0; x<src->width; x++) {
+					v = min(row16[x], maxv);
+					c = chan[2*(y%2) + x%2];
+					ACCUMULATE(c, v);
+					if (x+2 < src->width) FOCUS(row16[x+2]-row16[x]);
+					MOMENTS(v);
+				}
+				break;
+			case PIXEL_BGR24:
+			case PIXEL_RGB24:
+				for (x=0; x<src->width; x++) {
+					v = row8[bpp*x+ir]; ACCUMULATE(0, v);
+					v = row8[bpp*x+1];  ACCUMULATE(1, v);
+					if (x+2 < src->width) FOCUS(row8[bpp*(x+2)+1]-v);
+					v = row8[bpp*x+ib]; ACCUMULATE(2, v);
+					v = row8[bpp*x] + row8[bpp*x+1] + row8[bpp*x+2];
+					MOMENTS(v);
+				}
+				break;
+			default:
+				break;
+		}
+
+		W   += (double) rw;
+		WX  += (double) rwx;
+		WXX += (double) rwxx;
+		WY  += (double) rw*y;
+		WYY += (double) rw*y*y;
+		WXY += (double) rwx*y;
+		if (row_sums != NULL) row_sums[y] = (float) rsum;
+	}
+#undef	ACCUMULATE
+#undef	FOCUS
+#undef	MOMENTS
+
+	/* Fold into final results */
+	stats->nchannels  = nch;
+	stats->max_value  = maxv;
+	stats->hist_bins  = nbins;
+	stats->hist_shift = hist_shift;
+	for (c=0; c<nch; c++) {
+		stats->mean[c] = (stats->npixels[c] > 0) ? (double) chsum[c] / stats->npixels[c] : 0 ;
+		if (stats->npixels[c] == 0) stats->vmin[c] = 0;
+	}
+	stats->total = W;
+	if (W > 0) {
+		stats->centroid_x = WX/W;
+		stats->centroid_y = WY/W;
+		stats->var_x  = WXX/W - stats->centroid_x*stats->centroid_x;
+		stats->var_y  = WYY/W - stats->centroid_y*stats->centroid_y;
+		stats->cov_xy = WXY/W - stats->centroid_x*stats->centroid_y;
+	}
+	stats->brenner = (nbrenner > 0) ? (double) brenner / nbrenner : 0 ;
+	if (col_sums != NULL) for (x=0; x<src->width; x++) col_sums[x] = (float) cols[x];
+
+	free(cols);
+	return 0;
+}
+
+
+/* ===========================================================================
+-- Merge exposure bracketed frames into one high dynamic range image
+--
+-- Usage: int IP_MergeHDR(IMAGE_BUFFER *frames, const double *exposure, int nframes, IP_HDR_PARMS *parms, IMAGE_BUFFER *dst);
+--
+-- Inputs: frames   - nframes images of the same scene (all PIXEL_MONO8, all
+--                    PIXEL_MONO16 or all PIXEL_BAYER16, same size)
+--         exposure - exposure of each frame (ms)
+--         nframes  - number of frames (1 ... IP_HDR_MAX_FRAMES)
+--         parms    - black level, saturation and threads (NULL ==> defaults)
+--         dst      - output of the same size, dst->data allocated by caller
+--                    PIXEL_FLOAT32 ==> radiance in counts/ms
+--                    same format as the frames (16-bit) ==> radiance scaled
+--                    so the brightest value the shortest exposure can
+--                    measure becomes 65535
+--
+-- Output: dst->data - per-sample weighted radiance estimate
+--                       sum_k w(z_k) (z_k-black)/t_k / sum_k w(z_k)
+--                     with the hat weight w(z) = min(z-black, saturation-z),
+--                     which is 0 at black and at saturation.  Samples with
+--                     no usable exposure take the shortest exposure if
+--                     saturated there, otherwise the longest.
+--         parms->scale - multiplier applied to counts/ms for 16-bit output
+--                        (1.0 for PIXEL_FLOAT32)
+--
+-- Return: 0 if successful, otherwise
+--           1 ==> invalid parameters or unsupported format
+--           2 ==> unable to allocate working memory
+--
+-- Notes: Bayer mosaics are merged sample by sample so the result keeps the
+--        CFA layout.  Rows are split into bands over parms->nthreads threads
+--        (0 ==> one per processor) and each row uses the SSE2 kernel when
+--        available.
+=========================================================================== */
+int IP_MergeHDR(IMAGE_BUFFER *frames, const double *exposure, int nframes, IP_HDR_PARMS *parms, IMAGE_BUFFER *dst) {
+	static char *rname = "IP_MergeHDR";
+
+	IP_HDR_PARMS dflt;
+	HDR_BAND *bands;
+	SYSTEM_INFO sysinfo;
+	volatile long remaining;
+	HANDLE done;
+	int i, k, nthreads, rows_per_band, rc;
+
+	if (frames == NULL || exposure == NULL || dst == NULL || dst->data == NULL) return 1;
+	if (nframes < 1 || nframes > IP_HDR_MAX_FRAMES) return 1;
+	if (frames[0].format != PIXEL_MONO8 && frames[0].format != PIXEL_MONO16 && frames[0].format != PIXEL_BAYER16) return 1;
+	for (k=0; k<nframes; k++) {
+		if (frames[k].data == NULL || frames[k].format != frames[0].format || exposure[k] <= 0) return 1;
+		if (frames[k].width != frames[0].width || frames[k].height != frames[0].height) return 1;
+	}
+	if (dst->width != frames[0].width || dst->height != frames[0].height) return 1;
+	if (dst->format != PIXEL_FLOAT32 && dst->format != frames[0].format) return 1;
+	if (dst->format == PIXEL_MONO8) return 1;								/* No room for HDR in 8 bits */
+
+	if (parms == NULL) {
+		memset(&dflt, 0, sizeof(dflt));
+		parms = &dflt;
+	}
+
+	/* One band per thread, never less than a few rows each */
+	nthreads = parms->nthreads;
+	if (nthreads <= 0) {
+		GetSystemInfo(&sysinfo);
+		nthreads = sysinfo.dwNumberOfProcessors;
+	}
+	nthreads = max(1, min(nthreads, min(IP_HDR_MAX_THREADS, dst->height/16)));
+	if ( (bands = calloc(nthreads, sizeof(*bands))) == NULL) return 2;
+
+	/* Common parameters (band 0 holds them, the rest copy) */
+	bands[0].frames  = frames;
+	bands[0].nframes = nframes;
+	bands[0].dst     = dst;
+	bands[0].black   = (float) max(0, parms->black_level);
+	k = (frames[0].bit_depth > 0) ? frames[0].bit_depth : 8*IP_BytesPerPixel(frames[0].format);
+	bands[0].sat     = (float) ((parms->saturation > 0) ? parms->saturation : (1 << k) - 1);
+	bands[0].k_short = bands[0].k_long = 0;
+	for (k=0; k<nframes; k++) {
+		bands[0].inv_t[k] = (float) (1.0/exposure[k]);
+		if (exposure[k] < exposure[bands[0].k_short]) bands[0].k_short = k;
+		if (exposure[k] > exposure[bands[0].k_long])  bands[0].k_long  = k;
+	}
+	if (dst->format == PIXEL_FLOAT32) {
+		parms->scale = 1.0;
+	} else {
+		parms->scale = 65535.0 / max(1.0, (bands[0].sat-bands[0].black)*bands[0].inv_t[bands[0].k_short]);
+	}
+	bands[0].scale = (float) parms->scale;
+
+	rows_per_band = (dst->height + nthreads-1) / nthreads;
+	remaining = nthreads;
+	done = (nthreads > 1) ? CreateEvent(NULL, TRUE, FALSE, NULL) : NULL;
+	for (i=0; i<nthreads; i++) {
+		if (i != 0) bands[i] = bands[0];
+		bands[i].row0 = i*rows_per_band;
+		bands[i].row1 = min(dst->height, (i+1)*rows_per_band);
+		bands[i].remaining = &remaining;
+		bands[i].done = done;
+	}
+
+	/* Workers take bands 1 ... n-1, this thread does band 0 (and any that fail to start) */
+	for (i=1; i<nthreads; i++) {
+		if (done == NULL || _beginthread(hdr_band_thread, 0, &bands[i]) == -1L) hdr_band_thread(&bands[i]);
+	}
+	hdr_band_thread(&bands[0]);
+	if (done != NULL) {
+		WaitForSingleObject(done, INFINITE);
+		CloseHandle(done);
+	}
+
+	for (rc=0,i=0; i<nthreads; i++) if (bands[i].rc != 0) rc = bands[i].rc;
+	free(bands);
+	return rc;
+}
+
+/* ===========================================================================
+-- Worker for IP_MergeHDR ... one band of rows, signals when the last finishes
+=========================================================================== */
+static void hdr_band_thread(void *arg) {
+
+	HDR_BAND *band;
+	const void *rows[IP_HDR_MAX_FRAMES];
+	unsigned short *out16;
+	float *tmp, *out;
+	int row, k, i, n, bytes;
+
+	band = (HDR_BAND *) arg;
+	n = band->dst->width;
+	bytes = IP_BytesPerPixel(band->frames[0].format);
+
+	tmp = (band->dst->format == PIXEL_FLOAT32) ? NULL : malloc(n*sizeof(*tmp));
+	if (band->dst->format != PIXEL_FLOAT32 && tmp == NULL) {
+		band->rc = 2;
+	} else {
+		for (row=band->row0; row<band->row1; row++) {
+			for (k=0; k<band->nframes; k++) rows[k] = (unsigned char *) band->frames[k].data + (size_t) row*band->frames[k].pitch;
+			out = (tmp != NULL) ? tmp : (float *) ((unsigned char *) band->dst->data + (size_t) row*band->dst->pitch);
+			hdr_row(band, rows, bytes, n, out);
+			if (tmp != NULL) {
+				out16 = (unsigned short *) ((unsigned char *) band->dst->data + (size_t) row*band->dst->pitch);
+				for (i=0; i<n; i++) {
+					float v = tmp[i]*band->scale + 0.5f;
+					out16[i] = (v >= 65535.0f) ? 65535 : (unsigned short) v ;
+				}
+			}
+		}
+		if (tmp != NULL) free(tmp);
+	}
+
+	if (band->done != NULL && InterlockedDecrement(band->remaining) == 0) SetEvent(band->done);
+	return;
+}
+
+/* ===========================================================================
+-- Kernel: weighted radiance for one row of samples from every exposure
+=========================================================================== */
+static void hdr_row(HDR_BAND *band, const void **rows, int bytes, int n, float *dst) {
+	int i=0, k;
+	float range, z, w, num, den, zs, zl;
+
+	range = band->sat - band->black;
+
+#ifdef USE_SSE2
+	{
+		__m128 vzero, vblack, vrange, vhalf, vtiny, vz, vw, vnum, vden, vzs, vzl, vfall, vmask;
+		__m128i izero, iz;
+
+		izero  = _mm_setzero_si128();
+		vzero  = _mm_setzero_ps();
+		vblack = _mm_set1_ps(band->black);
+		vrange = _mm_set1_ps(range);
+		vhalf  = _mm_set1_ps(0.5f*range);
+		vtiny  = _mm_set1_ps(1.0E-20f);
+		for (; i+4<=n; i+=4) {
+			vnum = vden = vzs = vzl = vzero;
+			for (k=0; k<band->nframes; k++) {
+				if (bytes == 2) {
+					iz = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) ((const unsigned short *) rows[k]+i)), izero);
+				} else {
+					iz = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *) ((const unsigned char *) rows[k]+i)), izero), izero);
+				}
+				vz = _mm_sub_ps(_mm_cvtepi32_ps(iz), vblack);
+				vw = _mm_max_ps(vzero, _mm_min_ps(vz, _mm_sub_ps(vrange, vz)));
+				vnum = _mm_add_ps(vnum, _mm_mul_ps(vw, _mm_mul_ps(vz, _mm_set1_ps(band->inv_t[k]))));
+				vden = _mm_add_ps(vden, vw);
+				if (k == band->k_short) vzs = vz;
+				if (k == band->k_long)  vzl = vz;
+			}
+			/* No usable exposure: saturated in the longest ==> shortest, else longest (dark) */
+			vmask = _mm_cmpgt_ps(vzl, vhalf);
+			vfall = _mm_or_ps(_mm_and_ps(vmask, _mm_mul_ps(vzs, _mm_set1_ps(band->inv_t[band->k_short]))),
+									_mm_andnot_ps(vmask, _mm_mul_ps(_mm_max_ps(vzl, vzero), _mm_set1_ps(band->inv_t[band->k_long]))));
+			vmask = _mm_cmpgt_ps(vden, vzero);
+			_mm_storeu_ps(dst+i, _mm_or_ps(_mm_and_ps(vmask, _mm_div_ps(vnum, _mm_max_ps(vden, vtiny))), _mm_andnot_ps(vmask, vfall)));
+		}
+	}
+#endif
+
+	for (; i<n; i++) {
+		num = den = zs = zl = 0;
+		for (k=0; k<band->nframes; k++) {
+			z = ((bytes == 2) ? ((const unsigned short *) rows[k])[i] : ((const unsigned char *) rows[k])[i]) - band->black;
+			w = min(z, range-z);
+			if (w > 0) { num += w*z*band->inv_t[k]; den += w; }
+			if (k == band->k_short) zs = z;
+			if (k == band->k_long)  zl = z;
+		}
+		if (den > 0) {
+			dst[i] = num/den;
+		} else if (zl > 0.5f*range) {
+			dst[i] = zs*band->inv_t[band->k_short];
+		} else {
+			dst[i] = max(zl, 0)*band->inv_t[band->k_long];
+		}
+	}
+	return;
+}
+
+
+/* ===========================================================================
+-- Add (or remove) one frame to running sum and sum-of-squares buffers
+--
+-- Usage: int IP_AccumSamples(IMAGE_BUFFER *src);
+--        int IP_Accumulate(IMAGE_BUFFER *src, uint32_t *sum, uint64_t *sumsq, BOOL subtract);
+--
+-- Inputs: src      - frame (any 8-bit format, PIXEL_MONO16 or PIXEL_BAYER16)
+--         sum      - IP_AccumSamples(src) running sums
+--         sumsq    - IP_AccumSamples(src) running sums of squares (NULL to skip)
+--         subtract - TRUE to remove a frame previously added (sliding windows)
+--
+-- Output: sum[i] += z_i, sumsq[i] += z_i^2 (or -= for subtract), where i runs
+--         over every sample of every row (color bytes included)
+--
+-- Return: IP_AccumSamples: samples in the buffers (0 if unsupported format)
+--         IP_Accumulate:   0 if successful, 1 if invalid parameters or unsupported format
+--
+-- Notes: A 32-bit sum holds 65536 frames of 16-bit data.  Squares of 16-bit
+--        samples need 32 bits each, so sumsq is 64-bit.  Rows use SSE2 when
+--        available.
+=========================================================================== */
+int IP_AccumSamples(IMAGE_BUFFER *src) {
+
+	switch (src->format) {
+		case PIXEL_MONO8:
+		case PIXEL_MONO16:
+		case PIXEL_BAYER16:	return src->width*src->height;
+		case PIXEL_BGR24:
+		case PIXEL_RGB24:		return 3*src->width*src->height;
+		default:					return 0;
+	}
+}
+
+int IP_Accumulate(IMAGE_BUFFER *src, uint32_t *sum, uint64_t *sumsq, BOOL subtract) {
+	static char *rname = "IP_Accumulate";
+
+	int row, n;
+
+	if (src == NULL || src->data == NULL || sum == NULL || IP_AccumSamples(src) <= 0) return 1;
+
+	n = IP_AccumSamples(src) / src->height;
+	for (row=0; row<src->height; row++) {
+		accum_row((unsigned char *) src->data + (size_t) row*src->pitch, IP_BytesPerPixel(src->format) == 2,
+					 sum + (size_t) row*n, (sumsq == NULL) ? NULL : sumsq + (size_t) row*n, n, subtract);
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Mean and variance images from running sums
+--
+-- Usage: int IP_AccumResult(const uint32_t *sum, const uint64_t *sumsq, int nsamples, int nframes, float *mean, float *variance);
+--
+-- Inputs: sum, sumsq - buffers from IP_Accumulate()
+--         nsamples   - samples in each buffer
+--         nframes    - frames currently in the sums
+--         mean       - receives sum/n (NULL to skip)
+--         variance   - receives the unbiased variance (NULL to skip, 0 if n < 2)
+--
+-- Return: 0 if successful, 1 if invalid parameters
+=========================================================================== */
+int IP_AccumResult(const uint32_t *sum, const uint64_t *sumsq, int nsamples, int nframes, float *mean, float *variance) {
+	static char *rname = "IP_AccumResult";
+
+	double s, inv_n, inv_n1;
+	int i;
+
+	if (sum == NULL || nsamples <= 0 || nframes <= 0) return 1;
+	if (variance != NULL && sumsq == NULL) return 1;
+
+	inv_n  = 1.0 / nframes;
+	inv_n1 = (nframes > 1) ? 1.0/(nframes-1) : 0 ;
+	for (i=0; i<nsamples; i++) {
+		s = sum[i];
+		if (mean != NULL) mean[i] = (float) (s*inv_n);
+		if (variance != NULL) variance[i] = (float) max(0.0, ((double) sumsq[i] - s*s*inv_n) * inv_n1);
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Kernel: add or subtract one row of 8 or 16-bit samples
+=========================================================================== */
+static void accum_row(const void *src, BOOL wide, uint32_t *sum, uint64_t *sumsq, int n, BOOL subtract) {
+
+	const unsigned short *s16;
+	const unsigned char *s8;
+	uint32_t z;
+	int i;
+
+	s16 = (const unsigned short *) src;
+	s8  = (const unsigned char *) src;
+	i = 0;
+
+#ifdef USE_SSE2
+	{
+		__m128i zero, v, lo, hi, sq_lo, sq_hi, p;
+		zero = _mm_setzero_si128();
+		for (; i+8<=n; i+=8) {
+			v = wide ? _mm_loadu_si128((const __m128i *) (s16+i)) : _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (s8+i)), zero);
+			lo = _mm_unpacklo_epi16(v, zero);
+			hi = _mm_unpackhi_epi16(v, zero);
+			if (subtract) {
+				_mm_storeu_si128((__m128i *) (sum+i),   _mm_sub_epi32(_mm_loadu_si128((__m128i *) (sum+i)),   lo));
+				_mm_storeu_si128((__m128i *) (sum+i+4), _mm_sub_epi32(_mm_loadu_si128((__m128i *) (sum+i+4)), hi));
+			} else {
+				_mm_storeu_si128((__m128i *) (sum+i),   _mm_add_epi32(_mm_loadu_si128((__m128i *) (sum+i)),   lo));
+				_mm_storeu_si128((__m128i *) (sum+i+4), _mm_add_epi32(_mm_loadu_si128((__m128i *) (sum+i+4)), hi));
+			}
+			if (sumsq == NULL) continue;
+
+			/* 16x16 ==> 32-bit squares from the low and high halves, then widen to 64 */
+			sq_lo = _mm_mullo_epi16(v, v);
+			sq_hi = _mm_mulhi_epu16(v, v);
+			lo = _mm_unpacklo_epi16(sq_lo, sq_hi);				/* Squares 0-3 */
+			hi = _mm_unpackhi_epi16(sq_lo, sq_hi);				/* Squares 4-7 */
+#define	ACC64(k, x)	p = _mm_loadu_si128((__m128i *) (sumsq+i+k)); \
+							_mm_storeu_si128((__m128i *) (sumsq+i+k), subtract ? _mm_sub_epi64(p, x) : _mm_add_epi64(p, x))
+			ACC64(0, _mm_unpacklo_epi32(lo, zero));
+			ACC64(2, _mm_unpackhi_epi32(lo, zero));
+			ACC64(4, _mm_unpacklo_epi32(hi, zero));
+			ACC64(6, _mm_unpackhi_epi32(hi, zero));
+#undef	ACC64
+		}
+	}
+#endif
+
+	for (; i<n; i++) {
+		z = wide ? s16[i] : s8[i];
+		if (subtract) {
+			sum[i] -= z;
+			if (sumsq != NULL) sumsq[i] -= (uint64_t) z*z;
+		} else {
+			sum[i] += z;
+			if (sumsq != NULL) sumsq[i] += (uint64_t) z*z;
+		}
+	}
+	return;
+}
+
+
+/* ===========================================================================
+-- Dark / flat correction of 16-bit samples: dst = (src - dark) * gain
+--
+-- Usage: int IP_Calibrate16(const unsigned short *src, unsigned short *dst, const unsigned short *dark, const float *gain, int n, int maxval, BOOL bScalar);
+--
+-- Inputs: src     - n raw samples (may be the same as dst)
+--         dst     - n corrected samples
+--         dark    - n dark values (bias + dark current at this exposure)
+--         gain    - n normalized flat field gains (1.0 ==> no correction)
+--         n       - number of samples
+--         maxval  - largest output value (2^bit_depth - 1)
+--         bScalar - TRUE to force the scalar reference path
+--
+-- Output: dst[i] = min(maxval, round(max(0, src[i]-dark[i]) * gain[i]))
+--
+-- Return: 0 if successful, 1 if invalid parameters
+--
+-- Notes: The SSE2 path does exactly the same single precision operations
+--        as the scalar path, so the two agree bit for bit.
+=========================================================================== */
+int IP_Calibrate16(const unsigned short *src, unsigned short *dst, const unsigned short *dark, const float *gain, int n, int maxval, BOOL bScalar) {
+	static char *rname = "IP_Calibrate16";
+
+	float v, vmax;
+	int i;
+
+	if (src == NULL || dst == NULL || dark == NULL || gain == NULL || n <= 0) return 1;
+	if (maxval <= 0 || maxval > 65535) maxval = 65535;
+	vmax = (float) maxval;
+	i = 0;
+
+#ifdef USE_SSE2
+	if (! bScalar) {
+		__m128i zero, d, lo, hi, bias32, bias16;
+		__m128 vh, vm, flo, fhi;
+		zero = _mm_setzero_si128();
+		vh = _mm_set1_ps(0.5f);
+		vm = _mm_set1_ps(vmax);
+		bias32 = _mm_set1_epi32(32768);
+		bias16 = _mm_set1_epi16((short) 0x8000);
+		for (; i+8<=n; i+=8) {
+			d  = _mm_subs_epu16(_mm_loadu_si128((const __m128i *) (src+i)), _mm_loadu_si128((const __m128i *) (dark+i)));
+			flo = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d, zero)), _mm_loadu_ps(gain+i)),   vh);
+			fhi = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(d, zero)), _mm_loadu_ps(gain+i+4)), vh);
+			lo = _mm_cvttps_epi32(_mm_min_ps(flo, vm));
+			hi = _mm_cvttps_epi32(_mm_min_ps(fhi, vm));
+			/* No unsigned 32->16 pack in SSE2, so bias into signed range and back */
+			d = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+			_mm_storeu_si128((__m128i *) (dst+i), _mm_add_epi16(d, bias16));
+		}
+	}
+#endif
+
+	for (; i<n; i++) {
+		v = (float) ((src[i] > dark[i]) ? src[i]-dark[i] : 0) * gain[i] + 0.5f;
+		if (v > vmax) v = vmax;
+		dst[i] = (unsigned short) v;
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Normalized flat field gains from a mean flat exposure
+--
+-- Usage: int IP_FlatGain(const float *flat, const unsigned short *dark, int width, int height, PIXEL_FORMAT format, float *gain);
+--
+-- Inputs: flat   - width*height mean flat field (from the accumulator)
+--         dark   - width*height dark at the flat's exposure (NULL ==> 0)
+--         width, height - image size
+--         format - PIXEL_MONO16 or PIXEL_BAYER16
+--         gain   - receives width*height gains
+--
+-- Output: gain = <flat-dark> / (flat-dark), with the average taken over each
+--         color of the Bayer mosaic separately so color balance is kept.
+--         Samples with no signal get gain 1, and gains are limited to 16.
+--
+-- Return: 0 if successful, 1 if invalid parameters, 2 if the flat has no signal
+=========================================================================== */
+int IP_FlatGain(const float *flat, const unsigned short *dark, int width, int height, PIXEL_FORMAT format, float *gain) {
+	static char *rname = "IP_FlatGain";
+
+	double sum[4], avg[4], v;
+	int cnt[4], ix, iy, k, phases;
+
+	if (flat == NULL || gain == NULL || width <= 0 || height <= 0) return 1;
+	if (format != PIXEL_MONO16 && format != PIXEL_BAYER16) return 1;
+	phases = (format == PIXEL_BAYER16) ? 4 : 1 ;
+
+	for (k=0; k<4; k++) { sum[k] = 0; cnt[k] = 0; }
+	for (iy=0; iy<height; iy++) {
+		for (ix=0; ix<width; ix++) {
+			k = (phases == 4) ? 2*(iy & 1) + (ix & 1) : 0 ;
+			v = flat[iy*width+ix] - ((dark != NULL) ? dark[iy*width+ix] : 0);
+			if (v > 0) { sum[k] += v; cnt[k]++; }
+		}
+	}
+	for (k=0; k<phases; k++) {
+		if (cnt[k] == 0) return 2;
+		avg[k] = sum[k] / cnt[k];
+	}
+
+	for (iy=0; iy<height; iy++) {
+		for (ix=0; ix<width; ix++) {
+			k = (phases == 4) ? 2*(iy & 1) + (ix & 1) : 0 ;
+			v = flat[iy*width+ix] - ((dark != NULL) ? dark[iy*width+ix] : 0);
+			gain[iy*width+ix] = (v > 0) ? (float) min(16.0, avg[k]/v) : 1.0f ;
+		}
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Find defective samples (hot in a dark, dead / weak in a flat)
+--
+-- Usage: int IP_FindDefects(const float *image, int width, int height, PIXEL_FORMAT format,
+--                           double nsigma, double low_fraction, int *index, int maxn);
+--
+-- Inputs: image        - width*height mean frame (from the accumulator)
+--         width, height - image size
+--         format       - PIXEL_MONO16 or PIXEL_BAYER16
+--         nsigma       - flag samples more than nsigma robust standard
+--                        deviations above the median (0 ==> no test)
+--         low_fraction - flag samples below low_fraction of the median
+--                        (0 ==> no test)
+--         index        - receives up to maxn sample indices (iy*width+ix),
+--                        in increasing order
+--         maxn         - size of index
+--
+-- Output: Median and MAD are estimated separately for each color of the
+--         Bayer mosaic from a subsample of at most IP_DEFECT_SAMPLES values.
+--
+-- Return: number of defects found (may exceed maxn), -1 if invalid parameters
+=========================================================================== */
+#define	IP_DEFECT_SAMPLES	(16384)
+
+static int compare_float(const void *a, const void *b) {
+	float x = *((float *) a), y = *((float *) b);
+	return (x < y) ? -1 : (x > y) ? 1 : 0 ;
+}
+
+int IP_FindDefects(const float *image, int width, int height, PIXEL_FORMAT format, double nsigma, double low_fraction, int *index, int maxn) {
+	static char *rname = "IP_FindDefects";
+
+	float *samples, med[4], hi[4], lo[4], sigma;
+	int ix, iy, i, k, n, step, phases, count;
+
+	if (image == NULL || width <= 0 || height <= 0) return -1;
+	if (format != PIXEL_MONO16 && format != PIXEL_BAYER16) return -1;
+	phases = (format == PIXEL_BAYER16) ? 4 : 1 ;
+	if ( (samples = malloc(IP_DEFECT_SAMPLES*sizeof(*samples))) == NULL) return -1;
+
+	/* Robust level and spread of each phase */
+	step = (int) sqrt((double) width*height/phases/IP_DEFECT_SAMPLES) + 1;
+	for (k=0; k<phases; k++) {
+		n = 0;
+		for (iy=(phases == 4) ? k/2 : 0; iy<height; iy+=step*((phases == 4) ? 2 : 1)) {
+			for (ix=(phases == 4) ? k%2 : 0; ix<width && n<IP_DEFECT_SAMPLES; ix+=step*((phases == 4) ? 2 : 1)) samples[n++] = image[iy*width+ix];
+		}
+		if (n == 0) { med[k] = 0; hi[k] = lo[k] = 0; continue; }
+		qsort(samples, n, sizeof(*samples), compare_float);
+		med[k] = samples[n/2];
+		for (i=0; i<n; i++) samples[i] = (float) fabs(samples[i]-med[k]);
+		qsort(samples, n, sizeof(*samples), compare_float);
+		sigma = (float) max(0.5, 1.4826*samples[n/2]);		/* Floor at quantization */
+		hi[k] = (nsigma > 0) ? (float) (med[k] + nsigma*sigma) : -1 ;
+		lo[k] = (float) (low_fraction*med[k]);
+	}
+	free(samples);
+
+	count = 0;
+	for (iy=0; iy<height; iy++) {
+		for (ix=0; ix<width; ix++) {
+			k = (phases == 4) ? 2*(iy & 1) + (ix & 1) : 0 ;
+			i = iy*width+ix;
+			if ( (hi[k] >= 0 && image[i] > hi[k]) || (low_fraction > 0 && image[i] < lo[k]) ) {
+				if (index != NULL && count < maxn) index[count] = i;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+/* ===========================================================================
+-- Replace defective samples by the mean of their good same-color neighbors
+--
+-- Usage: int IP_CorrectDefects(unsigned short *data, int width, int height, PIXEL_FORMAT format, CFA_PHASE phase, const int *index, int n);
+--
+-- Inputs: data          - width*height samples, corrected in place
+--         width, height - image size
+--         format        - PIXEL_MONO16 or PIXEL_BAYER16
+--         phase         - color of the top-left sample (PIXEL_BAYER16 only)
+--         index         - n defect indices in increasing order
+--         n             - number of defects
+--
+-- Output: Mono uses the 4 nearest neighbors.  Bayer greens use the 4
+--         diagonal greens, red and blue the 4 same-color samples two away.
+--         Neighbors that are themselves defects are skipped (binary search
+--         of index), so the work is proportional to n, not the image size.
+--
+-- Return: 0 if successful, 1 if invalid parameters
+=========================================================================== */
+static int compare_int(const void *a, const void *b) {
+	int x = *((int *) a), y = *((int *) b);
+	return (x < y) ? -1 : (x > y) ? 1 : 0 ;
+}
+
+int IP_CorrectDefects(unsigned short *data, int width, int height, PIXEL_FORMAT format, CFA_PHASE phase, const int *index, int n) {
+	static char *rname = "IP_CorrectDefects";
+
+	static const int mono[4][2]  = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+	static const int green[4][2] = { {-1,-1}, {1,-1}, {-1,1}, {1,1} };
+	static const int other[4][2] = { {-2,0}, {2,0}, {0,-2}, {0,2} };
+	const int (*offset)[2];
+	int i, j, ix, iy, jx, jy, k, sum, cnt, green_odd;
+
+	if (data == NULL || width <= 0 || height <= 0 || n < 0 || (n > 0 && index == NULL)) return 1;
+	if (format != PIXEL_MONO16 && format != PIXEL_BAYER16) return 1;
+
+	/* Greens are on the even diagonals when the top-left sample is green, else the odd */
+	green_odd = (phase == CFA_GREEN_LEFT_OF_RED || phase == CFA_GREEN_LEFT_OF_BLUE) ? 0 : 1 ;
+
+	for (i=0; i<n; i++) {
+		if (index[i] < 0 || index[i] >= width*height) continue;
+		iy = index[i] / width; ix = index[i] % width;
+		if (format == PIXEL_MONO16) {
+			offset = mono;
+		} else {
+			offset = (((ix+iy) & 1) == green_odd) ? green : other ;
+		}
+		sum = cnt = 0;
+		for (k=0; k<4; k++) {
+			jx = ix + offset[k][0]; jy = iy + offset[k][1];
+			if (jx < 0 || jx >= width || jy < 0 || jy >= height) continue;
+			j = jy*width+jx;
+			if (bsearch(&j, index, n, sizeof(*index), compare_int) != NULL) continue;
+			sum += data[j]; cnt++;
+		}
+		if (cnt > 0) data[index[i]] = (unsigned short) ((sum + cnt/2) / cnt);
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Mean absolute difference of two 8-bit images (change detection)
+--
+-- Usage: double IP_MeanAbsDiff8(const unsigned char *a, const unsigned char *b, int n);
+--
+-- Inputs: a, b - n samples each (e.g. binned MONO8 previews)
+--         n    - number of samples
+--
+-- Return: sum(|a-b|)/n, or 0 if n <= 0
+=========================================================================== */
+double IP_MeanAbsDiff8(const unsigned char *a, const unsigned char *b, int n) {
+	uint64_t sad;
+	int i;
+
+	if (a == NULL || b == NULL || n <= 0) return 0;
+
+	sad = 0; i = 0;
+#ifdef USE_SSE2
+	{
+		__m128i acc;
+		int k;
+		/* psadbw gives two partial sums per 16 bytes ... flush before the 32-bit extract could overflow */
+		while (n-i >= 16) {
+			acc = _mm_setzero_si128();
+			for (k=0; k<4096 && n-i >= 16; k++, i+=16) {
+				acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (a+i)), _mm_loadu_si128((const __m128i *) (b+i))));
+			}
+			sad += (uint64_t) _mm_cvtsi128_si32(acc) + (uint64_t) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+		}
+	}
+#endif
+	for (; i<n; i++) sad += (a[i] > b[i]) ? a[i]-b[i] : b[i]-a[i];
+	return (double) sad / n;
+}
+
+/* ===========================================================================
+-- Bin a 16-bit frame (mono or Bayer mosaic) by averaging bin x bin blocks
+--
+-- Usage: int IP_BinSize(int width, int height, int bin, BOOL bBayer, int *out_width, int *out_height);
+--        int IP_Bin16(const unsigned short *src, int width, int height, int bin, BOOL bBayer, unsigned short *dst, uint32_t *work);
+--
+-- Inputs: src    - width x height samples (no padding)
+--         bin    - binning factor (1, 2, 4, ...)
+--         bBayer - TRUE ==> src is a Bayer mosaic; each color is binned
+--                  separately so dst is again a mosaic with the same phase
+--         dst    - receives out_width x out_height samples (no padding)
+--         work   - width column totals of scratch (NULL ==> allocated each
+--                  call; per-frame callers should keep one)
+--
+-- Output: *out_width, *out_height - binned size (whole bins only; Bayer
+--                                   sizes stay even)
+--         dst - rounded averages, so the bit depth is unchanged
+--
+-- Return: 0 if successful, 1 invalid parameters, 2 image smaller than one bin,
+--         4 no memory
+--
+-- Notes: Mono 2x2 uses the SSE2 row_bin2_16() kernel directly.  Other cases
+--        sum the bin source rows of each output row with SSE2 into 32-bit
+--        column totals (the bulk of the work), then add the bin columns of
+--        each group from that one row.
+=========================================================================== */
+int IP_BinSize(int width, int height, int bin, BOOL bBayer, int *out_width, int *out_height) {
+	int cell;
+
+	if (out_width  != NULL) *out_width  = 0;
+	if (out_height != NULL) *out_height = 0;
+	if (width <= 0 || height <= 0 || bin < 1) return 1;
+	cell = bBayer ? 2 : 1;
+	if (width < cell*bin || height < cell*bin) return 2;
+	if (out_width  != NULL) *out_width  = (width  / (cell*bin)) * cell;
+	if (out_height != NULL) *out_height = (height / (cell*bin)) * cell;
+	return 0;
+}
+
+int IP_Bin16(const unsigned short *src, int width, int height, int bin, BOOL bBayer, unsigned short *dst, uint32_t *work) {
+	static char *rname = "IP_Bin16";
+
+	const unsigned short *sptr;
+	unsigned short *dptr;
+	uint32_t *sum, total;
+	int rc, cell, nx, ny, ncols, ox, oy, k, col, half, count;
+
+	if (src == NULL || dst == NULL) return 1;
+	if ( (rc = IP_BinSize(width, height, bin, bBayer, &nx, &ny)) != 0) return rc;
+	cell  = bBayer ? 2 : 1;
+	ncols = nx*bin;											/* Source columns used */
+
+	/* No binning is just a (possibly cropped) copy */
+	if (bin == 1) {
+		for (oy=0; oy<ny; oy++) memcpy(dst + (size_t) oy*nx, src + (size_t) oy*width, nx*sizeof(*dst));
+		return 0;
+	}
+
+	/* Mono 2x2 has its own kernel */
+	if (! bBayer && bin == 2) {
+		for (oy=0; oy<ny; oy++) row_bin2_16(src + (size_t) (2*oy)*width, src + (size_t) (2*oy+1)*width, dst + (size_t) oy*nx, nx);
+		return 0;
+	}
+
+	if ( (sum = work) == NULL && (sum = malloc(ncols*sizeof(*sum))) == NULL) return 4;
+	count = bin*bin;
+	half  = count/2;
+	for (oy=0; oy<ny; oy++) {
+
+		/* Column totals of the bin rows with this row's CFA phase */
+		memset(sum, 0, ncols*sizeof(*sum));
+		for (k=0; k<bin; k++) {
+			sptr = src + (size_t) (((oy/cell)*bin + k)*cell + oy%cell) * width;
+			col = 0;
+#ifdef USE_SSE2
+			{
+				__m128i a, zero;
+				zero = _mm_setzero_si128();
+				for (; col+8<=ncols; col+=8) {
+					a = _mm_loadu_si128((const __m128i *) (sptr+col));
+					_mm_storeu_si128((__m128i *) (sum+col),   _mm_add_epi32(_mm_loadu_si128((__m128i *) (sum+col)),   _mm_unpacklo_epi16(a, zero)));
+					_mm_storeu_si128((__m128i *) (sum+col+4), _mm_add_epi32(_mm_loadu_si128((__m128i *) (sum+col+4)), _mm_unpackhi_epi16(a, zero)));
+				}
+			}
+#endif
+			for (; col<ncols; col++) sum[col] += sptr[col];
+		}
+
+		/* Each output sample adds bin same-color columns */
+		dptr = dst + (size_t) oy*nx;
+		for (ox=0; ox<nx; ox++) {
+			col = (ox/cell)*bin*cell + ox%cell;
+			for (total=0,k=0; k<bin; k++, col+=cell) total += sum[col];
+			dptr[ox] = (unsigned short) ((total + half) / count);
+		}
+	}
+	if (sum != work) free(sum);
+	return 0;
+}
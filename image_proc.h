@@ -0,0 +1,91 @@
+#ifndef _IMAGE_PROC_INCLUDED
+
+#define	_IMAGE_PROC_INCLUDED
+
+/* Pixel layouts of the buffers handled by the image processing kernels */
+/* Bayer data carries its CFA phase in IMAGE_BUFFER (TL sensors are even rows G R, odd rows B G) */
+/* PIXEL_FLOAT32 is one float per sample (HDR radiance, mosaic retained) */
+typedef enum _PIXEL_FORMAT { PIXEL_UNKNOWN=0, PIXEL_MONO8=1, PIXEL_BGR24=2, PIXEL_RGB24=3, PIXEL_MONO16=4, PIXEL_BAYER16=5, PIXEL_FLOAT32=6 } PIXEL_FORMAT;
+
+/* Color filter phase of a Bayer mosaic ... top-left sample (values as TL_COLOR_FILTER_ARRAY_PHASE) */
+typedef enum _CFA_PHASE { CFA_RED=0, CFA_BLUE=1, CFA_GREEN_LEFT_OF_RED=2, CFA_GREEN_LEFT_OF_BLUE=3 } CFA_PHASE;
+
+/* Description of an image in memory (ring buffer or extracted copy) */
+typedef struct _IMAGE_BUFFER {
+	PIXEL_FORMAT format;						/* Layout of the pixels						*/
+	int width, height;						/* Image size in pixels						*/
+	int pitch;									/* Bytes between the start of each row	*/
+	int bit_depth;								/* Significant bits in each sample		*/
+	void *data;									/* Pointer to the first pixel				*/
+	CFA_PHASE cfa_phase;						/* PIXEL_BAYER16 only: color of the top-left sample */
+} IMAGE_BUFFER;
+
+/* Rectangle, binning and decimation for a region extraction */
+typedef struct _IMAGE_REGION {
+	int ulx, uly;								/* Upper left corner (source pixels)	*/
+	int width, height;						/* Size in source pixels (<=0 ==> to edge) */
+	int bin;										/* Bin / stride factor (1 = full resolution) */
+	BOOL bDecimate;							/* TRUE ==> take every bin'th pixel, FALSE ==> average */
+} IMAGE_REGION;
+
+/* Results of the fused statistics pass (channels are R,G,B or just 0 for mono) */
+#define	IP_MAX_CHANNELS	(3)
+typedef struct _IP_STATS {
+	int nchannels;								/* 1 for mono, 3 for color					*/
+	int max_value;								/* Saturation code (2^bit_depth - 1)	*/
+	int hist_bins, hist_shift;				/* Histogram bin i holds [i<<shift, (i+1)<<shift) */
+	uint32_t npixels[IP_MAX_CHANNELS];	/* Pixels of each channel					*/
+	uint32_t saturated[IP_MAX_CHANNELS];/* Pixels at max_value						*/
+	int vmin[IP_MAX_CHANNELS], vmax[IP_MAX_CHANNELS];
+	double mean[IP_MAX_CHANNELS];
+	double total;								/* Sum of intensity above threshold		*/
+	double centroid_x, centroid_y;		/* Intensity weighted centroid (pixels)	*/
+	double var_x, var_y, cov_xy;			/* Second central moments (pixels^2)	*/
+	double brenner;							/* Mean squared same-color gradient		*/
+	int max_gradient;							/* Largest same-color difference			*/
+} IP_STATS;
+
+/* Parameters for merging an exposure bracket */
+#define	IP_HDR_MAX_FRAMES	(16)
+typedef struct _IP_HDR_PARMS {
+	int black_level;							/* Offset subtracted from every sample		*/
+	int saturation;							/* Samples at or above are unusable (0 ==> 2^bit_depth-1) */
+	int nthreads;								/* Threads for the merge (0 ==> one per processor) */
+	double scale;								/* Output: 16-bit value per count/ms		*/
+} IP_HDR_PARMS;
+
+int IP_BytesPerPixel(PIXEL_FORMAT format);
+
+/* Region extraction (crop / bin / format conversion) */
+int IP_RegionGeometry(IMAGE_BUFFER *src, IMAGE_REGION *region, PIXEL_FORMAT format, IMAGE_BUFFER *dst);
+int IP_ExtractRegion(IMAGE_BUFFER *src, IMAGE_REGION *region, IMAGE_BUFFER *dst);
+
+/* Statistics (histograms, saturation, moments, profiles, focus) in one pass */
+int IP_StatsChannels(IMAGE_BUFFER *src);
+int IP_StatsHistBins(IMAGE_BUFFER *src, int hist_shift);
+int IP_ComputeStats(IMAGE_BUFFER *src, int hist_shift, int threshold, IP_STATS *stats, uint32_t *hist, float *col_sums, float *row_sums);
+
+/* High dynamic range merge of an exposure bracket (SSE2, multithreaded) */
+int IP_MergeHDR(IMAGE_BUFFER *frames, const double *exposure, int nframes, IP_HDR_PARMS *parms, IMAGE_BUFFER *dst);
+
+/* Running sum / sum-of-squares accumulation for frame averaging (SSE2) */
+int IP_AccumSamples(IMAGE_BUFFER *src);
+int IP_Accumulate(IMAGE_BUFFER *src, uint32_t *sum, uint64_t *sumsq, BOOL subtract);
+int IP_AccumResult(const uint32_t *sum, const uint64_t *sumsq, int nsamples, int nframes, float *mean, float *variance);
+
+/* Dark / bias / flat calibration (SSE2 correction, scalar reference with bScalar) */
+int IP_Calibrate16(const unsigned short *src, unsigned short *dst, const unsigned short *dark, const float *gain, int n, int maxval, BOOL bScalar);
+int IP_FlatGain(const float *flat, const unsigned short *dark, int width, int height, PIXEL_FORMAT format, float *gain);
+
+/* Hot / dead pixel detection and CFA-aware correction (cost proportional to the defect count) */
+int IP_FindDefects(const float *image, int width, int height, PIXEL_FORMAT format, double nsigma, double low_fraction, int *index, int maxn);
+int IP_CorrectDefects(unsigned short *data, int width, int height, PIXEL_FORMAT format, CFA_PHASE phase, const int *index, int n);
+
+/* Change detection between 8-bit previews (SSE2 sum of absolute differences) */
+double IP_MeanAbsDiff8(const unsigned char *a, const unsigned char *b, int n);
+
+/* Binning of 16-bit mono / Bayer frames (CFA-aware, SSE2) */
+int IP_BinSize(int width, int height, int bin, BOOL bBayer, int *out_width, int *out_height);
+int IP_Bin16(const unsigned short *src, int width, int height, int bin, BOOL bBayer, unsigned short *dst, uint32_t *work);
+
+#endif		/* _IMAGE_PROC_INCLUDED */
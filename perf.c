@@ -0,0 +1,525 @@
+/* perf.c -- per-stage latency histograms, event counters and event trace for the frame pipeline */
+
+/* ------------------------------ */
+/* Feature test macros            */
+/* ------------------------------ */
+#define _POSIX_SOURCE					/* Always require POSIX standard */
+
+/* ------------------------------ */
+/* Standard include files         */
+/* ------------------------------ */
+#include <stddef.h>						/* for defining several useful types and macros */
+#include <stdlib.h>						/* for performing a variety of operations */
+#include <stdio.h>
+#include <string.h>						/* for manipulating several kinds of strings */
+#include <math.h>
+#include <stdint.h>						/* C99 extension to get known width integers */
+
+/* Standard Windows libraries */
+#define STRICT								/* define before including windows.h for stricter type checking */
+	#include <windows.h>					/* master include file for Windows applications */
+
+/* ------------------------------ */
+/* Local include files            */
+/* ------------------------------ */
+#include "perf.h"
+
+/* ------------------------------- */
+/* My local typedef's and defines  */
+/* ------------------------------- */
+#ifndef TRUE
+	#define	TRUE	(1)
+#endif
+#ifndef FALSE
+	#define	FALSE	(0)
+#endif
+
+/* Accumulators for one stage ... only ever touched with Interlocked* calls */
+typedef struct _PERF_ACCUM {
+	volatile long count;
+	volatile long hist[PERF_HIST_BINS];
+	volatile LONGLONG ticks;				/* Sum of the durations */
+	volatile LONGLONG max_ticks;
+} PERF_ACCUM;
+
+/* One trace event and the ring of them kept for each thread (single writer) */
+typedef struct _PERF_TRACE_EVENT {
+	LONGLONG t;									/* QueryPerformanceCounter value */
+	const char *name;							/* Static string, also the pairing key */
+	int imageID;								/* <0 ==> not tied to a frame */
+	int phase;									/* 'B', 'E' or 'i' as in the Chrome format */
+} PERF_TRACE_EVENT;
+
+typedef struct _PERF_TRACE_RING {
+	DWORD tid;
+	volatile long in_use;					/* Owned by a live thread (0 ==> free for the next new one) */
+	char name[32];								/* From Perf_TraceThreadName() */
+	volatile long head;						/* Events ever written by the thread */
+	volatile long start;						/* head when the current trace started */
+	PERF_TRACE_EVENT event[PERF_TRACE_EVENTS];
+} PERF_TRACE_RING;
+
+#define	PERF_TRACE_GUARD	(64)			/* Newest slots a dump leaves alone in a full ring */
+
+/* ------------------------------- */
+/* My external function prototypes */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* My internal function prototypes */
+/* ------------------------------- */
+static void perf_record(PERF_STAGE stage, LONGLONG ticks);
+static double perf_percentile(uint32_t *hist, uint32_t count, double fraction);
+static PERF_TRACE_RING *perf_trace_ring(void);
+static void WINAPI perf_trace_release(void *data);
+static void perf_trace_event(const char *name, int imageID, int phase);
+
+/* ------------------------------- */
+/* My usage of other external fncs */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* Locally defined global vars     */
+/* ------------------------------- */
+static volatile long perf_enabled = TRUE;
+static LONGLONG perf_freq = 0;				/* Performance counter ticks per second */
+static LONGLONG perf_t_reset = 0;			/* Counter at the last reset */
+static PERF_ACCUM perf_stage[PERF_NUM_STAGES];
+static volatile LONGLONG perf_counter[PERF_NUM_COUNTERS];
+
+static char *perf_stage_names[PERF_NUM_STAGES] = {
+	"SDK callback", "Ring commit", "Processing", "Statistics", "Render", "Save", "Server send"
+};
+
+static volatile long perf_trace_enabled = FALSE;
+static volatile long perf_trace_state = 0;		/* 0 ==> no FLS index, 1 ==> allocating, 2 ==> ready */
+static DWORD perf_trace_fls = FLS_OUT_OF_INDEXES;
+static LONGLONG perf_trace_t0 = 0;				/* Counter when the trace was started */
+static volatile long perf_trace_nrings = 0;
+static PERF_TRACE_RING * volatile perf_trace_rings[PERF_TRACE_MAX_THREADS];
+
+
+/* ===========================================================================
+-- Turn the instrumentation on or off
+--
+-- Usage: int Perf_Enable(int enable);
+--
+-- Inputs: enable - 0 ==> off, 1 ==> on, <0 ==> just query
+--
+-- Output: While off, Perf_Start() returns 0 and nothing is recorded
+--
+-- Return: TRUE if instrumentation is now enabled
+=========================================================================== */
+int Perf_Enable(int enable) {
+	if (enable >= 0) InterlockedExchange(&perf_enabled, enable ? TRUE : FALSE);
+	return perf_enabled;
+}
+
+/* ===========================================================================
+-- Time one pass through a pipeline stage
+--
+-- Usage: LONGLONG Perf_Start(void);
+--        void Perf_Stop(PERF_STAGE stage, LONGLONG start);
+--        void Perf_AddSample(PERF_STAGE stage, double ms);
+--
+-- Inputs: stage - which histogram gets the sample
+--         start - value returned by Perf_Start() (0 ==> ignored)
+--         ms    - duration measured elsewhere (server send time)
+--
+-- Output: Adds one sample to the stage histogram, count, sum and maximum
+--
+-- Return: Perf_Start() - performance counter now, or 0 if disabled
+--
+-- Notes: Uses the same QueryPerformanceCounter clock as HIRES_TIMER (TSC
+--        based on current hardware).  Every update is an Interlocked call,
+--        so any thread may record without a lock and nothing ever blocks
+--        the frame callback.
+=========================================================================== */
+LONGLONG Perf_Start(void) {
+	LARGE_INTEGER now;
+
+	if (! perf_enabled) return 0;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void Perf_Stop(PERF_STAGE stage, LONGLONG start) {
+	LARGE_INTEGER now;
+
+	if (start == 0 || ! perf_enabled) return;
+	QueryPerformanceCounter(&now);
+	perf_record(stage, now.QuadPart - start);
+	return;
+}
+
+void Perf_AddSample(PERF_STAGE stage, double ms) {
+	LARGE_INTEGER freq;
+
+	if (! perf_enabled || ms < 0) return;
+	if (perf_freq == 0 && QueryPerformanceFrequency(&freq)) perf_freq = freq.QuadPart;
+	perf_record(stage, (LONGLONG) (ms*perf_freq/1000.0 + 0.5));
+	return;
+}
+
+/* ===========================================================================
+-- Bump one of the event counters
+--
+-- Usage: void Perf_Count(PERF_COUNTER counter, long n);
+--
+-- Inputs: counter - which count
+--         n       - amount to add (bytes for PERF_BYTES_SENT, else frames/events)
+=========================================================================== */
+void Perf_Count(PERF_COUNTER counter, long n) {
+	if (! perf_enabled || counter < 0 || counter >= PERF_NUM_COUNTERS) return;
+	InterlockedExchangeAdd64(&perf_counter[counter], n);
+	return;
+}
+
+/* ===========================================================================
+-- Return a summary of the stage histograms and counters
+--
+-- Usage: int Perf_GetStats(PERF_STATS *stats, BOOL reset);
+--
+-- Inputs: stats - receives the summary (may be NULL with reset)
+--         reset - if TRUE, clear everything after the copy
+--
+-- Output: *stats - counts, mean/p50/p99/max in us and the raw histograms
+--
+-- Return: 0 if successful
+--
+-- Notes: Samples recorded while the copy is made may appear in the
+--        histogram but not yet in the mean (or vice versa).  The summary
+--        is for monitoring, not accounting.
+=========================================================================== */
+int Perf_GetStats(PERF_STATS *stats, BOOL reset) {
+	static char *rname = "Perf_GetStats";
+
+	LARGE_INTEGER now, freq;
+	PERF_STAGE_STATS *s;
+	PERF_ACCUM *a;
+	int i, k;
+
+	QueryPerformanceCounter(&now);
+	if (perf_freq == 0 && QueryPerformanceFrequency(&freq)) perf_freq = freq.QuadPart;
+	if (perf_t_reset == 0) perf_t_reset = now.QuadPart;
+
+	if (stats != NULL) {
+		memset(stats, 0, sizeof(*stats));
+		stats->enabled            = perf_enabled;
+		stats->seconds            = (perf_freq > 0) ? (double) (now.QuadPart - perf_t_reset) / perf_freq : 0.0 ;
+		stats->frames_received    = (uint32_t) perf_counter[PERF_FRAMES_RECEIVED];
+		stats->frames_limited     = (uint32_t) perf_counter[PERF_FRAMES_LIMITED];
+		stats->mutex_timeouts     = (uint32_t) perf_counter[PERF_MUTEX_TIMEOUTS];
+		stats->frames_overwritten = (uint32_t) perf_counter[PERF_FRAMES_OVERWRITTEN];
+		stats->bytes_sent         = (double)   perf_counter[PERF_BYTES_SENT];
+
+		for (i=0; i<PERF_NUM_STAGES; i++) {
+			s = stats->stage+i;
+			a = perf_stage+i;
+			s->count = a->count;
+			for (k=0; k<PERF_HIST_BINS; k++) s->hist[k] = a->hist[k];
+			if (s->count == 0 || perf_freq <= 0) continue;
+			s->mean_us = 1.0E6 * a->ticks / perf_freq / s->count;
+			s->max_us  = 1.0E6 * a->max_ticks / perf_freq;
+			s->p50_us  = perf_percentile(s->hist, s->count, 0.50);
+			s->p99_us  = perf_percentile(s->hist, s->count, 0.99);
+		}
+	}
+
+	if (reset) {
+		memset(perf_stage, 0, sizeof(perf_stage));
+		memset((void *) perf_counter, 0, sizeof(perf_counter));
+		perf_t_reset = now.QuadPart;
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Short name of a stage for tables
+--
+-- Usage: char *Perf_StageName(PERF_STAGE stage);
+--
+-- Return: static string ("?" for an unknown stage)
+=========================================================================== */
+char *Perf_StageName(PERF_STAGE stage) {
+	if (stage < 0 || stage >= PERF_NUM_STAGES) return "?";
+	return perf_stage_names[stage];
+}
+
+/* ===========================================================================
+-- Start or stop the event trace
+--
+-- Usage: int Perf_TraceEnable(int enable);
+--
+-- Inputs: enable - 0 ==> stop, >0 ==> start (events from before are dropped),
+--                  <0 ==> just query
+--
+-- Output: While stopped every Perf_Trace*() call returns after one test
+--
+-- Return: TRUE if the trace is now recording
+--
+-- Notes: Stopping keeps the events so they can still be dumped.
+=========================================================================== */
+int Perf_TraceEnable(int enable) {
+	LARGE_INTEGER now, freq;
+	int i;
+
+	if (enable > 0) {
+		if (perf_freq == 0 && QueryPerformanceFrequency(&freq)) perf_freq = freq.QuadPart;
+		QueryPerformanceCounter(&now);
+		perf_trace_t0 = now.QuadPart;
+		for (i=0; i<perf_trace_nrings && i<PERF_TRACE_MAX_THREADS; i++) {
+			if (perf_trace_rings[i] != NULL) perf_trace_rings[i]->start = perf_trace_rings[i]->head;
+		}
+		InterlockedExchange(&perf_trace_enabled, TRUE);
+	} else if (enable == 0) {
+		InterlockedExchange(&perf_trace_enabled, FALSE);
+	}
+	return perf_trace_enabled;
+}
+
+/* ===========================================================================
+-- Record trace events for the calling thread
+--
+-- Usage: void Perf_TraceThreadName(const char *name);
+--        void Perf_TraceBegin(const char *name, int imageID);
+--        void Perf_TraceEnd(const char *name, int imageID);
+--        void Perf_TraceInstant(const char *name, int imageID);
+--
+-- Inputs: name    - event name; must be a static string (only the pointer is kept)
+--         imageID - frame the work belongs to, or -1
+--
+-- Output: Begin/End bracket a span on the thread's timeline, Instant marks
+--         a single moment.  ThreadName labels the timeline in the dump.
+--
+-- Notes: Each thread writes only its own ring (found through FLS), so
+--        recording takes no lock.  The ring is created on the first event;
+--        ThreadName creates it even when the trace is stopped so that
+--        long-lived threads can be named once when they start.  A ring is
+--        released when its thread exits and taken over by the next new
+--        thread (its old events are then dropped), so the table bounds the
+--        threads alive at once rather than every thread ever started.
+=========================================================================== */
+void Perf_TraceThreadName(const char *name) {
+	PERF_TRACE_RING *ring;
+
+	if (name == NULL || (ring = perf_trace_ring()) == NULL) return;
+	strncpy(ring->name, name, sizeof(ring->name)-1);				/* Ring is calloc'd, so always terminated */
+	return;
+}
+
+void Perf_TraceBegin(const char *name, int imageID) {
+	if (perf_trace_enabled) perf_trace_event(name, imageID, 'B');
+	return;
+}
+
+void Perf_TraceEnd(const char *name, int imageID) {
+	if (perf_trace_enabled) perf_trace_event(name, imageID, 'E');
+	return;
+}
+
+void Perf_TraceInstant(const char *name, int imageID) {
+	if (perf_trace_enabled) perf_trace_event(name, imageID, 'i');
+	return;
+}
+
+/* ===========================================================================
+-- Summary of the event trace
+--
+-- Usage: int Perf_TraceInfo(PERF_TRACE_INFO *info);
+--
+-- Output: *info - recording state, threads and events held / lost
+--
+-- Return: 0 if successful, 1 if info is NULL
+=========================================================================== */
+int Perf_TraceInfo(PERF_TRACE_INFO *info) {
+	PERF_TRACE_RING *ring;
+	long n;
+	int i;
+
+	if (info == NULL) return 1;
+	memset(info, 0, sizeof(*info));
+	info->enabled = perf_trace_enabled;
+	for (i=0; i<perf_trace_nrings && i<PERF_TRACE_MAX_THREADS; i++) {
+		if ( (ring = perf_trace_rings[i]) == NULL) continue;
+		info->threads++;
+		n = ring->head - ring->start;
+		if (n > PERF_TRACE_EVENTS) {
+			info->overwritten += n - PERF_TRACE_EVENTS;
+			n = PERF_TRACE_EVENTS;
+		}
+		info->events += n;
+	}
+	return 0;
+}
+
+/* ===========================================================================
+-- Write the event trace as Chrome trace JSON
+--
+-- Usage: int Perf_TraceDump(char *path, PERF_TRACE_INFO *info);
+--
+-- Inputs: path - file to create (conventionally .json)
+--         info - optional, receives Perf_TraceInfo() at the time of the dump
+--
+-- Output: {"traceEvents":[...]} with one timeline per thread, times in us
+--         from the start of the trace and imageID in the event args.  Load
+--         in chrome://tracing or ui.perfetto.dev.
+--
+-- Return: 0 if successful
+--           1 ==> no path given
+--           2 ==> unable to open the file
+--
+-- Notes: May be called while recording.  In a ring that has wrapped, the
+--        newest PERF_TRACE_GUARD slots are left out since the owner may be
+--        rewriting them.  Spans cut by the ring wrap show as unmatched.
+=========================================================================== */
+int Perf_TraceDump(char *path, PERF_TRACE_INFO *info) {
+	static char *rname = "Perf_TraceDump";
+
+	FILE *funit;
+	PERF_TRACE_RING *ring;
+	PERF_TRACE_EVENT ev;
+	DWORD pid;
+	long k, first, head;
+	BOOL comma;
+	int i;
+
+	if (path == NULL || *path == '\0') return 1;
+	if (fopen_s(&funit, path, "w") != 0 || funit == NULL) {
+		fprintf(stderr, "[%s] Unable to open \"%s\"\n", rname, path); fflush(stderr);
+		return 2;
+	}
+	Perf_TraceInfo(info);
+
+	pid = GetCurrentProcessId();
+	fprintf(funit, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	comma = FALSE;
+	for (i=0; i<perf_trace_nrings && i<PERF_TRACE_MAX_THREADS; i++) {
+		if ( (ring = perf_trace_rings[i]) == NULL) continue;
+
+		fprintf(funit, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}", 
+				  comma ? ",\n" : "", pid, ring->tid, *ring->name ? ring->name : "thread");
+		comma = TRUE;
+
+		head  = ring->head;
+		first = ring->start;
+		if (head - first > PERF_TRACE_EVENTS - PERF_TRACE_GUARD) first = head - (PERF_TRACE_EVENTS - PERF_TRACE_GUARD);
+		for (k=first; k<head; k++) {
+			ev = ring->event[k & (PERF_TRACE_EVENTS-1)];
+			if (ev.t < perf_trace_t0 || ev.name == NULL) continue;
+			fprintf(funit, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu", 
+					  ev.name, ev.phase, 1.0E6*(ev.t-perf_trace_t0)/perf_freq, pid, ring->tid);
+			if (ev.phase == 'i') fprintf(funit, ",\"s\":\"t\"");
+			if (ev.imageID >= 0) fprintf(funit, ",\"args\":{\"imageID\":%d}", ev.imageID);
+			fprintf(funit, "}");
+		}
+	}
+	fprintf(funit, "\n]}\n");
+	fclose(funit);
+	return 0;
+}
+
+/* Trace ring of the calling thread, created on first use (NULL if none available) */
+static PERF_TRACE_RING *perf_trace_ring(void) {
+	PERF_TRACE_RING *ring;
+	long i, n;
+
+	/* One FLS index for the process (its callback sees threads exit), allocated by whichever thread gets here first */
+	if (perf_trace_state != 2) {
+		if (InterlockedCompareExchange(&perf_trace_state, 1, 0) == 0) {
+			perf_trace_fls = FlsAlloc(perf_trace_release);
+			InterlockedExchange(&perf_trace_state, 2);
+		} else {
+			while (perf_trace_state != 2) Sleep(0);
+		}
+	}
+	if (perf_trace_fls == FLS_OUT_OF_INDEXES) return NULL;
+	if ( (ring = FlsGetValue(perf_trace_fls)) != NULL) return ring;
+
+	/* New thread ... take over the ring of one that has exited */
+	n = min(perf_trace_nrings, PERF_TRACE_MAX_THREADS);
+	for (i=0; i<n; i++) {
+		if ( (ring = perf_trace_rings[i]) == NULL || InterlockedCompareExchange(&ring->in_use, 1, 0) != 0) continue;
+		*ring->name = '\0';
+		ring->tid   = GetCurrentThreadId();
+		ring->start = ring->head;								/* Earlier thread's events are not this one's */
+		FlsSetValue(perf_trace_fls, ring);
+		return ring;
+	}
+
+	/* ... or claim a new slot in the table */
+	if (perf_trace_nrings >= PERF_TRACE_MAX_THREADS) return NULL;
+	if ( (i = InterlockedIncrement(&perf_trace_nrings)-1) >= PERF_TRACE_MAX_THREADS) return NULL;
+	if ( (ring = calloc(1, sizeof(*ring))) == NULL) return NULL;
+	ring->tid    = GetCurrentThreadId();
+	ring->in_use = 1;
+	FlsSetValue(perf_trace_fls, ring);
+	perf_trace_rings[i] = ring;
+	return ring;
+}
+
+/* FLS callback as a thread exits ... its ring is free for the next new thread (kept for dumps until then) */
+static void WINAPI perf_trace_release(void *data) {
+	PERF_TRACE_RING *ring;
+
+	if ( (ring = (PERF_TRACE_RING *) data) != NULL) InterlockedExchange(&ring->in_use, 0);
+	return;
+}
+
+/* Append one event to the calling thread's ring */
+static void perf_trace_event(const char *name, int imageID, int phase) {
+	PERF_TRACE_RING *ring;
+	PERF_TRACE_EVENT *ev;
+	LARGE_INTEGER now;
+
+	if ( (ring = perf_trace_ring()) == NULL) return;
+	QueryPerformanceCounter(&now);
+	ev = ring->event + (ring->head & (PERF_TRACE_EVENTS-1));
+	ev->t       = now.QuadPart;
+	ev->name    = name;
+	ev->imageID = imageID;
+	ev->phase   = phase;
+	InterlockedIncrement(&ring->head);						/* Publish (full barrier) */
+	return;
+}
+
+/* Add one duration (performance counter ticks) to a stage */
+static void perf_record(PERF_STAGE stage, LONGLONG ticks) {
+	PERF_ACCUM *a;
+	LARGE_INTEGER freq;
+	LONGLONG us, old;
+	int bin;
+
+	if (stage < 0 || stage >= PERF_NUM_STAGES || ticks < 0) return;
+	if (perf_freq == 0) {
+		if (! QueryPerformanceFrequency(&freq)) return;
+		perf_freq = freq.QuadPart;
+	}
+
+	/* Bin is the number of significant bits in the duration (us) */
+	us = ticks * 1000000 / perf_freq;
+	for (bin=0; us > 0 && bin < PERF_HIST_BINS-1; bin++) us >>= 1;
+
+	a = perf_stage+stage;
+	InterlockedIncrement(&a->count);
+	InterlockedIncrement(&a->hist[bin]);
+	InterlockedExchangeAdd64(&a->ticks, ticks);
+	while ( (old = a->max_ticks) < ticks) {
+		if (InterlockedCompareExchange64(&a->max_ticks, ticks, old) == old) break;
+	}
+	return;
+}
+
+/* Upper edge (us) of the bin where the cumulative count reaches fraction */
+static double perf_percentile(uint32_t *hist, uint32_t count, double fraction) {
+	double need, sum;
+	int k;
+
+	need = fraction * count;
+	sum = 0;
+	for (k=0; k<PERF_HIST_BINS-1; k++) {
+		sum += hist[k];
+		if (sum >= need) break;
+	}
+	return ldexp(1.0, k);
+}
@@ -0,0 +1,79 @@
+#ifndef _PERF_INCLUDED
+
+#define	_PERF_INCLUDED
+
+/* Stages of the frame pipeline timed with Perf_Start() / Perf_Stop() */
+#define	PERF_NUM_STAGES	(7)
+typedef enum _PERF_STAGE {
+	PERF_CALLBACK=0,							/* SDK frame callback / frame event, entry to exit */
+	PERF_RING_COMMIT=1,						/* Copy of a frame into the ring (mutex held) */
+	PERF_PROCESS=2,							/* Image thread work on a new frame before display */
+	PERF_STATISTICS=3,						/* Statistics of a frame (dialog and server) */
+	PERF_RENDER=4,								/* Drawing a frame into a window */
+	PERF_SAVE=5,								/* Writing one frame to disk */
+	PERF_SEND=6									/* Server handler return until the reply is written */
+} PERF_STAGE;
+
+/* Event counters bumped with Perf_Count() */
+#define	PERF_NUM_COUNTERS	(5)
+typedef enum _PERF_COUNTER {
+	PERF_FRAMES_RECEIVED=0,					/* Frames delivered by the camera SDK */
+	PERF_FRAMES_LIMITED=1,					/* Frames dropped by the fps_limit */
+	PERF_MUTEX_TIMEOUTS=2,					/* Ring mutex not obtained in time */
+	PERF_FRAMES_OVERWRITTEN=3,				/* Frames reused in the ring before a reader got them */
+	PERF_BYTES_SENT=4							/* Reply bytes written by the server (headers included) */
+} PERF_COUNTER;
+
+/* Histogram bin 0 counts durations under 1 us, bin k>0 those in [2^(k-1), 2^k) us */
+/* (the last bin is open ended, ~4 s and over) */
+#define	PERF_HIST_BINS		(24)
+
+#pragma pack(4)
+typedef struct _PERF_STAGE_STATS {
+	uint32_t count;							/* Samples since the reset */
+	double mean_us;							/* Mean duration */
+	double p50_us, p99_us;					/* Upper edge of the histogram bin holding the percentile */
+	double max_us;								/* Longest duration */
+	uint32_t hist[PERF_HIST_BINS];
+} PERF_STAGE_STATS;
+
+typedef struct _PERF_STATS {
+	int enabled;								/* Instrumentation active */
+	double seconds;							/* Since the last reset */
+	uint32_t frames_received;
+	uint32_t frames_limited;
+	uint32_t mutex_timeouts;
+	uint32_t frames_overwritten;
+	double bytes_sent;
+	PERF_STAGE_STATS stage[PERF_NUM_STAGES];
+} PERF_STATS;
+
+/* Optional event trace, dumped as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) */
+#define	PERF_TRACE_EVENTS			(8192)	/* Events kept per thread (power of 2, oldest overwritten) */
+#define	PERF_TRACE_MAX_THREADS	(64)		/* Threads that may record at once (exited ones free their ring) */
+
+typedef struct _PERF_TRACE_INFO {
+	int enabled;								/* Trace currently recording */
+	int threads;								/* Threads with a trace ring */
+	uint32_t events;							/* Events held since the trace was started */
+	uint32_t overwritten;					/* Events lost to ring wrap since the start */
+} PERF_TRACE_INFO;
+#pragma pack()
+
+int Perf_Enable(int enable);
+LONGLONG Perf_Start(void);
+void Perf_Stop(PERF_STAGE stage, LONGLONG start);
+void Perf_AddSample(PERF_STAGE stage, double ms);
+void Perf_Count(PERF_COUNTER counter, long n);
+int Perf_GetStats(PERF_STATS *stats, BOOL reset);
+char *Perf_StageName(PERF_STAGE stage);
+
+int  Perf_TraceEnable(int enable);
+void Perf_TraceThreadName(const char *name);
+void Perf_TraceBegin(const char *name, int imageID);
+void Perf_TraceEnd(const char *name, int imageID);
+void Perf_TraceInstant(const char *name, int imageID);
+int  Perf_TraceInfo(PERF_TRACE_INFO *info);
+int  Perf_TraceDump(char *path, PERF_TRACE_INFO *info);
+
+#endif		/* _PERF_INCLUDED */
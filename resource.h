@@ -284,6 +284,12 @@
 #define IDB_CLEAR_7                     2231
 #define IDB_CLEAR_9                     2232
 #define IDB_CLEAR_10                    2233
+#define IDB_PERF_STATS                  2234
+#define IDT_PERF_TABLE                  2235
+#define IDB_PERF_RESET                  2236
+#define IDC_PERF_ENABLE                 2237
+#define IDC_PERF_TRACE                  2238
+#define IDB_PERF_TRACE_SAVE             2239
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
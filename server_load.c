@@ -0,0 +1,231 @@
+/* Load test for the ZooCam server (standalone client) */
+
+/* ------------------------------ */
+/* Feature test macros            */
+/* ------------------------------ */
+#define _POSIX_SOURCE						/* Always require POSIX standard */
+
+/* ------------------------------ */
+/* Standard include files         */
+/* ------------------------------ */
+#include <stddef.h>				  /* for defining several useful types and macros */
+#include <stdio.h>				  /* for performing input and output */
+#include <stdlib.h>				  /* for performing a variety of operations */
+#include <string.h>
+#include <math.h>               /* basic math functions */
+#include <assert.h>
+#include <stdint.h>             /* C99 extension to get known width integers */
+#include <signal.h>
+
+/* ------------------------------ */
+/* Local include files            */
+/* ------------------------------ */
+#define	ZOOCAM_CLIENT
+
+#include "server_support.h"		/* Server support (includes windows.h) */
+#include "timer.h"					/* High resolution timer */
+#include "camera.h"					/* Generic camera information */
+#include "perf.h"						/* Stage latency statistics */
+#include "ZooCam.h"					/* Access to the ZooCam info */
+#include "ZooCam_client.h"			/* Commands, version and port */
+
+/* ------------------------------- */
+/* My local typedef's and defines  */
+/* ------------------------------- */
+#ifndef TRUE
+	#define	TRUE	(1)
+#endif
+#ifndef FALSE
+	#define	FALSE	(0)
+#endif
+
+#define	DFLT_CLIENTS	(32)					/* Simultaneous connections */
+#define	DFLT_SECONDS	(10)					/* Duration of the test */
+
+/* Kinds of traffic generated ... each client thread does one */
+typedef enum _LOAD_KIND { LOAD_STATUS=0, LOAD_IMAGE=1, LOAD_BURST_WAIT=2 } LOAD_KIND;
+#define	N_LOAD_KINDS	(3)
+static char *load_names[N_LOAD_KINDS] = { "status queries", "GET_IMAGE_DATA", "BURST_WAIT" };
+
+typedef struct _LOAD_CLIENT {
+	int id;
+	LOAD_KIND kind;
+	int errors;
+	int nsamples, nalloc;
+	double *latency;							/* ms for each completed request */
+	double bytes;								/* Total reply data received */
+} LOAD_CLIENT;
+
+/* ------------------------------- */
+/* My external function prototypes */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* My internal function prototypes */
+/* ------------------------------- */
+static void load_thread(void *arg);
+static int compare_double(const void *a, const void *b);
+
+/* ------------------------------- */
+/* My usage of other external fncs */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* My share of global externals    */
+/* ------------------------------- */
+
+/* ------------------------------- */
+/* Locally defined global vars     */
+/* ------------------------------- */
+static char *server_IP = LOOPBACK_SERVER_IP_ADDRESS;
+static HIRES_TIMER *timer = NULL;
+static double t_stop;							/* Time (from timer) when threads should stop */
+static volatile long threads_running = 0;
+
+/* ===========================================================================
+-- Load test: many concurrent clients against a running ZooCam server
+--
+-- Usage: load [IP_address] [nclients] [seconds]
+--
+-- Inputs: IP_address - server address (default loopback)
+--         nclients   - number of simultaneous connections (default 32)
+--         seconds    - duration of the test (default 10)
+--
+-- Output: Request count, rate and latency percentiles for each kind of
+--         traffic.  One client fetches full frames continuously, one sits
+--         in BURST_WAIT, and the rest poll status (version, image info,
+--         ring info).  Status latencies should stay low while the long
+--         transfers and waits are in progress.
+--
+-- Return: 0 on success, !0 if unable to connect
+=========================================================================== */
+int main(int argc, char *argv[]) {
+
+	LOAD_CLIENT *clients;
+	CLIENT_DATA_BLOCK *probe;
+	double *all, elapsed, bytes;
+	int i, k, n, nclients, seconds, errors;
+
+	nclients = DFLT_CLIENTS;
+	seconds  = DFLT_SECONDS;
+	if (argc > 1) server_IP = argv[1];
+	if (argc > 2) nclients = atoi(argv[2]);
+	if (argc > 3) seconds  = atoi(argv[3]);
+	if (nclients < 3) nclients = 3;
+	if (seconds  < 1) seconds  = 1;
+
+	DebugSockets(1);									/* Only errors */
+
+	/* Make sure there is a server before starting all the threads */
+	if ( (probe = ConnectToServerPipelined("ZooCam load", server_IP, ZOOCAM_ACCESS_PORT, NULL)) == NULL) {
+		fprintf(stderr, "ERROR: Unable to connect to the server at %s\n", server_IP); fflush(stderr);
+		return 1;
+	}
+	CloseServerConnection(probe);
+
+	printf("Load test: %d clients for %d seconds against %s\n", nclients, seconds, server_IP); fflush(stdout);
+
+	clients = calloc(nclients, sizeof(*clients));
+	timer = HiResTimerCreate();
+	t_stop = HiResTimerDelta(timer) + seconds;
+	for (i=0; i<nclients; i++) {
+		clients[i].id   = i;
+		clients[i].kind = (i == 0) ? LOAD_IMAGE : (i == 1) ? LOAD_BURST_WAIT : LOAD_STATUS ;
+		InterlockedIncrement(&threads_running);
+		if (_beginthread(load_thread, 0, &clients[i]) == -1L) {
+			fprintf(stderr, "ERROR: Unable to start client thread %d\n", i); fflush(stderr);
+			InterlockedDecrement(&threads_running);
+		}
+	}
+	while (threads_running > 0) Sleep(100);
+	elapsed = HiResTimerDelta(timer) - t_stop + seconds;
+
+	/* Report each kind of traffic */
+	printf("%-16s %8s %9s %9s %9s %9s %9s %9s %8s %6s\n", "traffic", "count", "req/s", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms", "MB/s", "errors");
+	for (k=0; k<N_LOAD_KINDS; k++) {
+		n = errors = 0; bytes = 0;
+		for (i=0; i<nclients; i++) if (clients[i].kind == k) { n += clients[i].nsamples; errors += clients[i].errors; bytes += clients[i].bytes; }
+		if (n == 0) continue;
+		all = malloc(n*sizeof(*all));
+		for (n=0,i=0; i<nclients; i++) {
+			if (clients[i].kind != k) continue;
+			memcpy(all+n, clients[i].latency, clients[i].nsamples*sizeof(*all));
+			n += clients[i].nsamples;
+		}
+		qsort(all, n, sizeof(*all), compare_double);
+		printf("%-16s %8d %9.1f %9.3f %9.3f %9.3f %9.3f %9.3f %8.1f %6d\n", load_names[k], n, n/elapsed,
+				 all[n/2], all[(int) (0.90*(n-1))], all[(int) (0.99*(n-1))], all[(int) (0.999*(n-1))], all[n-1], bytes/elapsed/1.0E6, errors);
+		free(all);
+	}
+	fflush(stdout);
+
+	for (i=0; i<nclients; i++) if (clients[i].latency != NULL) free(clients[i].latency);
+	free(clients);
+	HiResTimerDestroy(timer);
+	ShutdownSockets();
+	return 0;
+}
+
+/* ===========================================================================
+-- One simulated client ... own connection, blocking exchanges until t_stop
+=========================================================================== */
+static void load_thread(void *arg) {
+
+	LOAD_CLIENT *client;
+	CLIENT_DATA_BLOCK *remote;
+	CS_MSG request, reply;
+	void *data;
+	double t0, t1;
+	int i, rc;
+
+	static int status_msgs[] = { ZOOCAM_QUERY_VERSION, ZOOCAM_GET_IMAGE_INFO, ZOOCAM_RING_GET_INFO };
+
+	client = (LOAD_CLIENT *) arg;
+	if ( (remote = ConnectToServerPipelined("ZooCam load", server_IP, ZOOCAM_ACCESS_PORT, NULL)) == NULL) {
+		client->errors++;
+		InterlockedDecrement(&threads_running);
+		return;
+	}
+
+	for (i=0; (t0 = HiResTimerDelta(timer)) < t_stop; i++) {
+		memset(&request, 0, sizeof(request));
+		switch (client->kind) {
+			case LOAD_IMAGE:
+				request.msg = ZOOCAM_GET_IMAGE_DATA;
+				request.option = -1;
+				break;
+			case LOAD_BURST_WAIT:
+				request.msg = ZOOCAM_BURST_WAIT;
+				request.option = 1000;
+				break;
+			default:
+				request.msg = status_msgs[(i+client->id) % 3];
+				request.option = -1;
+				break;
+		}
+
+		rc = StandardServerExchange(remote, request, NULL, &reply, &data);
+		t1 = HiResTimerDelta(timer);
+		if (rc != 0 || reply.msg != request.msg) {
+			client->errors++;
+			if (rc != 0) break;						/* Connection lost */
+		} else {
+			if (client->nsamples >= client->nalloc) {
+				client->nalloc = 2*client->nalloc + 1024;
+				client->latency = realloc(client->latency, client->nalloc*sizeof(*client->latency));
+			}
+			client->latency[client->nsamples++] = 1000.0*(t1-t0);
+			client->bytes += reply.data_len;
+		}
+		if (data != NULL) free(data);
+	}
+
+	CloseServerConnection(remote);
+	InterlockedDecrement(&threads_running);
+	return;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *((double *) a), y = *((double *) b);
+	return (x < y) ? -1 : (x > y) ? 1 : 0 ;
+}
@@ -42,6 +42,10 @@
 /* My internal function prototypes */
 /* ------------------------------- */
 static uint32_t CRC32(void *buffer, int count);
+static CLIENT_DATA_BLOCK *OpenClientBlock(char *name, unsigned long ip_addr, int port, int *err);
+static void PipelineReader(void *arg);
+static void CompletePending(CLIENT_DATA_BLOCK *block, CS_PENDING *op, int status, CS_MSG *reply, void *data);
+static void ReleaseClientBlock(CLIENT_DATA_BLOCK *block);
 
 /* ------------------------------- */
 /* My usage of other external fncs */
@@ -175,7 +179,7 @@ int RunServer(char *pname, unsigned short port, void (*ClientHandler)(void *), v
 	}
 
 /* Listen on the socket. */
-	if ( listen( m_socket, 1 ) == SOCKET_ERROR ) {
+	if ( listen( m_socket, SOMAXCONN ) == SOCKET_ERROR ) {
 		fprintf(stderr, "TCP %s server: Error listening on socket.\n", name); fflush(stderr);
 		closesocket(m_socket);
 		return 5;
@@ -229,6 +233,620 @@ void EndServerHandler(SERVER_DATA_BLOCK *socket_info) {
 	return;
 }
 
+/* ===========================================================================
+-- Event driven server ... fixed worker pool on an I/O completion port
+--
+-- Usage: int RunEventServer      (char *name, unsigned short port, int nworkers,
+--                                 SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, 
+--                                 SERVER_MONITOR monitor, void (*reset)(void));
+--        int RunEventServerThread(char *name, unsigned short port, int nworkers,
+--                                 SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, 
+--                                 SERVER_MONITOR monitor, void (*reset)(void));
+--
+-- Inputs: name     - name of the server (for messages)
+--         port     - port to listen on
+--         nworkers - number of worker threads (<= 0 ==> SERVER_DFLT_WORKERS)
+--         handler  - routine called on a worker thread for each complete request
+--         classify - routine returning SERVER_ORDERED or SERVER_CONCURRENT for 
+--                    a request, or'd with SERVER_BLOCKING if the handler
+--                    may wait (NULL ==> everything SERVER_ORDERED).  Bits from
+--                    SERVER_CLASS_USER up are ignored here and handed to the
+--                    handler with the rest of the value
+--         monitor  - routine called once each reply is written (or dropped) with
+--                    the request, reply and queue/service/send times (may be NULL)
+--         reset    - routine called when a client connection closes (may be NULL)
+--
+-- Output: Accepts connections and services requests until the program exits
+--
+-- Return: RunEventServerThread:
+--           0 ==> thread started successfully
+--           1 ==> unable to allocate memory
+--           2 ==> _beginthread failed
+--         RunEventServer:
+--           3 ==> Unable to initiate sockets
+--           4 ==> Unable to bind the socket
+--           5 ==> Unable to listen on the socket
+--           6 ==> Unable to create the completion port or workers
+--
+-- Notes: (1) Each connection is a small state machine.  Reads are always
+--            outstanding (header, then data) and complete on whichever
+--            worker is free.  A full request is queued to the pool, the
+--            handler runs, and the reply joins the connection's write queue.
+--            Long transfers are written asynchronously, so no thread is tied
+--            up while a frame goes out and the next request is already read.
+--        (2) On one connection, SERVER_ORDERED requests run alone and in
+--            order (a barrier), while SERVER_CONCURRENT requests received
+--            between barriers may run in parallel on different workers.
+--            Replies go out as they complete, matched by msgid at the client.
+--        (3) The handler receives reply preset from the request (msgid echoed,
+--            rc=0).  If *reply_data is set without *free_reply, the data is
+--            copied before the handler returns, so it may point to locals.
+--        (4) Sockets are associated with the port directly and read/written
+--            with overlapped ReadFile/WriteFile, so only winsock 1.1 is needed.
+--        (5) SERVER_BLOCKING handlers run on a second port serviced by
+--            threads started as needed (up to SERVER_MAX_WAITERS, then kept),
+--            so requests that wait on a mutex or event never hold one of the
+--            nworkers threads.  With more than SERVER_MAX_WAITERS blocked at
+--            once, later blocking requests queue; the pool keeps running.
+=========================================================================== */
+#define	IO_RECV	(1)							/* Overlapped read on the connection */
+#define	IO_SEND	(2)							/* Overlapped write of a reply */
+#define	IO_WORK	(3)							/* Request queued to the worker pool */
+
+typedef struct _IO_OP {
+	OVERLAPPED ov;								/* Must be first (cast from LPOVERLAPPED) */
+	int kind;
+} IO_OP;
+
+/* One request from receipt until its reply has been written */
+typedef struct _SERVER_WORK {
+	IO_OP io;									/* IO_WORK while queued, then IO_SEND while writing */
+	struct _SERVER_WORK *next;
+	SERVER_CONN *conn;
+	BOOL ordered;								/* SERVER_ORDERED (barrier) request */
+	BOOL blocking;								/* SERVER_BLOCKING ... run on the wait port */
+	int request_class;						/* Value from classify (passed to the handler) */
+	CS_MSG request;
+	void *data;									/* malloc'd data received with the request */
+	CS_MSG reply;								/* Host order until queued, then network order */
+	void *reply_data;
+	BOOL free_reply;
+	int sent, total;							/* Progress writing header + reply_data */
+	CS_MSG reply_host;						/* Reply header before network encoding (for monitor) */
+	LONGLONG t_received, t_started, t_done;	/* Performance counter at each stage */
+} SERVER_WORK;
+
+typedef struct _EVENT_SERVER {
+	char name[32];
+	unsigned short port;
+	int nworkers;
+	HANDLE iocp;
+	HANDLE wait_port;							/* SERVER_BLOCKING requests (own threads) */
+	volatile long nwaiters;					/* Threads started on wait_port */
+	volatile long waiters_idle;			/* ... of those, waiting for a request */
+	volatile long waits_queued;			/* Posted to wait_port, not yet picked up */
+	SERVER_REQUEST_HANDLER handler;
+	SERVER_REQUEST_CLASS classify;
+	SERVER_MONITOR monitor;
+	void (*reset)(void);
+	volatile long nconnections;
+} EVENT_SERVER;
+
+#define	RX_HEADER	(0)						/* Reading the CS_MSG header */
+#define	RX_DATA		(1)						/* Reading the data that follows */
+
+struct _SERVER_CONN {
+	SOCKET socket;
+	EVENT_SERVER *server;
+	volatile long refcount;					/* Outstanding read + queued/running/writing requests */
+	CRITICAL_SECTION lock;					/* Protects everything below */
+	BOOL closing;								/* Socket closed ... drop remaining replies */
+	BOOL close_requested;					/* Close once the queued replies are written */
+
+	IO_OP recv;									/* Receive state machine */
+	int rx_state;
+	CS_MSG rx_msg;
+	char *rx_data;
+	int rx_have, rx_need;
+
+	SERVER_WORK *wait_head, *wait_tail;	/* Received, waiting for a barrier to clear */
+	int running;								/* Requests currently in a handler */
+	BOOL barrier;								/* An SERVER_ORDERED request is running */
+
+	SERVER_WORK *send_head, *send_tail;	/* Replies waiting for the writer */
+	BOOL sending;								/* A WriteFile is outstanding */
+};
+
+static void ReleaseConn(SERVER_CONN *conn) {
+	if (InterlockedDecrement(&conn->refcount) > 0) return;
+
+	if (conn->server->reset != NULL) (*conn->server->reset)();
+	InterlockedDecrement(&conn->server->nconnections);
+	DeleteCriticalSection(&conn->lock);
+	if (conn->rx_data != NULL) free(conn->rx_data);
+	free(conn);
+	return;
+}
+
+static void CloseConn(SERVER_CONN *conn) {
+	EnterCriticalSection(&conn->lock);
+	if (! conn->closing) {
+		conn->closing = TRUE;
+		shutdown(conn->socket, SD_BOTH);
+		closesocket(conn->socket);						/* Outstanding I/O completes with errors */
+	}
+	LeaveCriticalSection(&conn->lock);
+	return;
+}
+
+/* Mark a connection to be closed after its pending replies are written (SERVER_END) */
+void EndServerConn(SERVER_CONN *conn) {
+	EnterCriticalSection(&conn->lock);
+	conn->close_requested = TRUE;
+	LeaveCriticalSection(&conn->lock);
+	return;
+}
+
+/* Performance counter ticks (and their rate) for the request timing */
+static LONGLONG ServerTicks(void) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+static double ServerTickMs(void) {
+	static double ms = 0.0;
+	LARGE_INTEGER freq;
+	if (ms == 0.0 && QueryPerformanceFrequency(&freq) && freq.QuadPart != 0) ms = 1000.0 / freq.QuadPart;
+	return ms;
+}
+
+/* Free a request and everything it holds */
+static void FreeWork(SERVER_WORK *work) {
+	if (work->data != NULL) free(work->data);
+	if (work->free_reply && work->reply_data != NULL) free(work->reply_data);
+	free(work);
+	return;
+}
+
+/* Report the finished request to the monitor (if any) and release it */
+static void FinishWork(SERVER_CONN *conn, SERVER_WORK *work, BOOL sent) {
+	SERVER_TIMING timing;
+	double ms;
+
+	if (conn->server->monitor != NULL) {
+		ms = ServerTickMs();
+		timing.queue_ms   = ms * (work->t_started - work->t_received);
+		timing.service_ms = ms * (work->t_done    - work->t_started);
+		timing.send_ms    = ms * (ServerTicks()   - work->t_done);
+		timing.sent       = sent;
+		(*conn->server->monitor)(&work->request, &work->reply_host, &timing);
+	}
+	FreeWork(work);
+	return;
+}
+
+/* Issue the read for the next piece of the current message.  Returns 0 if started */
+static int StartRecv(SERVER_CONN *conn) {
+	char *ptr;
+	int len;
+
+	memset(&conn->recv.ov, 0, sizeof(conn->recv.ov));
+	conn->recv.kind = IO_RECV;
+	if (conn->rx_state == RX_HEADER) {
+		ptr = ((char *) &conn->rx_msg) + conn->rx_have;
+		len = sizeof(conn->rx_msg) - conn->rx_have;
+	} else {
+		ptr = conn->rx_data + conn->rx_have;
+		len = conn->rx_need - conn->rx_have;
+	}
+	if (! ReadFile((HANDLE) conn->socket, ptr, len, NULL, &conn->recv.ov) && GetLastError() != ERROR_IO_PENDING) return 1;
+	return 0;
+}
+
+/* Issue the write for the next piece of the reply at the head of the queue */
+static int StartSend(SERVER_CONN *conn, SERVER_WORK *work) {
+	char *ptr;
+	int len;
+
+	memset(&work->io.ov, 0, sizeof(work->io.ov));
+	work->io.kind = IO_SEND;
+	if (work->sent < sizeof(work->reply)) {
+		ptr = ((char *) &work->reply) + work->sent;
+		len = sizeof(work->reply) - work->sent;
+	} else {
+		ptr = ((char *) work->reply_data) + (work->sent - sizeof(work->reply));
+		len = work->total - work->sent;
+	}
+	if (! WriteFile((HANDLE) conn->socket, ptr, len, NULL, &work->io.ov) && GetLastError() != ERROR_IO_PENDING) return 1;
+	return 0;
+}
+
+static void RunWork(SERVER_CONN *conn, SERVER_WORK *work);
+
+/* Thread servicing SERVER_BLOCKING requests.  Never exits (kept for reuse) */
+static void WaitWorker(void *arg) {
+	EVENT_SERVER *server;
+	OVERLAPPED *ov;
+	DWORD icnt;
+	ULONG_PTR key;
+
+	server = (EVENT_SERVER *) arg;
+	while (TRUE) {
+		InterlockedIncrement(&server->waiters_idle);
+		GetQueuedCompletionStatus(server->wait_port, &icnt, &key, &ov, INFINITE);
+		InterlockedDecrement(&server->waiters_idle);
+		if (ov == NULL) continue;
+		InterlockedDecrement(&server->waits_queued);
+		RunWork((SERVER_CONN *) key, (SERVER_WORK *) ov);
+	}
+	return;
+}
+
+/* Hand a SERVER_BLOCKING request to the wait port, adding a thread if none is free */
+static void PostBlockingWork(EVENT_SERVER *server, SERVER_CONN *conn, SERVER_WORK *work) {
+	long queued;
+
+	queued = InterlockedIncrement(&server->waits_queued);
+	PostQueuedCompletionStatus(server->wait_port, 0, (ULONG_PTR) conn, &work->io.ov);
+	if (queued > server->waiters_idle && server->nwaiters < SERVER_MAX_WAITERS) {
+		InterlockedIncrement(&server->nwaiters);
+		if (_beginthread(WaitWorker, 0, server) == -1L) {
+			InterlockedDecrement(&server->nwaiters);
+			fprintf(stderr, "TCP %s server: Unable to start thread for blocking requests\n", server->name); fflush(stderr);
+		}
+	}
+	return;
+}
+
+/* Start any waiting requests that the barrier rules allow (called with lock held) */
+static void ScheduleWork(SERVER_CONN *conn) {
+	SERVER_WORK *work;
+
+	while ( (work = conn->wait_head) != NULL && ! conn->barrier) {
+		if (work->ordered && conn->running > 0) break;	/* Barrier waits for everything before it */
+		if ( (conn->wait_head = work->next) == NULL) conn->wait_tail = NULL;
+		work->next = NULL;
+		conn->running++;
+		if (work->ordered) conn->barrier = TRUE;
+		memset(&work->io.ov, 0, sizeof(work->io.ov));
+		work->io.kind = IO_WORK;
+		InterlockedIncrement(&conn->refcount);
+		if (work->blocking && conn->server->wait_port != NULL) {
+			PostBlockingWork(conn->server, conn, work);
+		} else {
+			PostQueuedCompletionStatus(conn->server->iocp, 0, (ULONG_PTR) conn, &work->io.ov);
+		}
+	}
+	return;
+}
+
+/* A complete request has arrived ... classify and queue it */
+static void DispatchRequest(SERVER_CONN *conn) {
+	SERVER_WORK *work;
+	int class;
+
+	if ( (work = calloc(1, sizeof(*work))) == NULL) {
+		fprintf(stderr, "ERROR[%s server]: Unable to allocate memory for a request\n", conn->server->name); fflush(stderr);
+		if (conn->rx_data != NULL) { free(conn->rx_data); conn->rx_data = NULL; }
+		return;
+	}
+	work->conn    = conn;
+	work->request = conn->rx_msg;
+	work->t_received = ServerTicks();
+	work->data    = conn->rx_data;
+	class = (conn->server->classify == NULL) ? SERVER_ORDERED : (*conn->server->classify)(&work->request) ;
+	work->ordered  = (class & SERVER_CONCURRENT) == 0;
+	work->blocking = (class & SERVER_BLOCKING) != 0;
+	work->request_class = class;
+	conn->rx_data = NULL;
+
+	EnterCriticalSection(&conn->lock);
+	if (conn->wait_tail == NULL) { conn->wait_head = work; } else { conn->wait_tail->next = work; }
+	conn->wait_tail = work;
+	ScheduleWork(conn);
+	LeaveCriticalSection(&conn->lock);
+	return;
+}
+
+/* A read completed with icnt bytes.  Returns 0 if the next read was issued */
+static int RecvComplete(SERVER_CONN *conn, int icnt) {
+	static char *rname = "RecvComplete";
+
+	if (icnt <= 0) return 1;								/* Client closed or error */
+	conn->rx_have += icnt;
+
+	if (conn->rx_state == RX_HEADER) {
+		if (conn->rx_have < sizeof(conn->rx_msg)) return StartRecv(conn);
+		conn->rx_msg.msg      = ntohl(conn->rx_msg.msg);
+		conn->rx_msg.msgid    = ntohl(conn->rx_msg.msgid);
+		conn->rx_msg.option   = ntohl(conn->rx_msg.option);
+		conn->rx_msg.rc       = ntohl(conn->rx_msg.rc);
+		conn->rx_msg.data_len = ntohl(conn->rx_msg.data_len);
+		conn->rx_msg.crc32    = ntohl(conn->rx_msg.crc32);
+		conn->rx_have = 0;
+		if (conn->rx_msg.data_len > 0) {
+			if ( (conn->rx_data = calloc(1, conn->rx_msg.data_len)) == NULL) return 2;
+			conn->rx_need  = conn->rx_msg.data_len;
+			conn->rx_state = RX_DATA;
+			return StartRecv(conn);
+		}
+	} else {
+		if (conn->rx_have < conn->rx_need) return StartRecv(conn);
+		if (conn->rx_msg.crc32 != 0 && DebugLevel >= 1) {
+			uint32_t crc;
+			if ( (crc = CRC32(conn->rx_data, conn->rx_need)) != conn->rx_msg.crc32) {
+				fprintf(stderr, "ERROR[%s]: CRC32 mistmatch (0x%8.8x versus 0x%8.8x)\n", rname, crc, conn->rx_msg.crc32); fflush(stderr);
+			}
+		}
+		conn->rx_have  = 0;
+		conn->rx_state = RX_HEADER;
+	}
+
+	DispatchRequest(conn);
+	return StartRecv(conn);
+}
+
+static void SendComplete(SERVER_CONN *conn, SERVER_WORK *work, BOOL ok, int icnt);
+
+/* Queue a finished reply for writing (takes over the reference held by the work) */
+static void QueueReply(SERVER_CONN *conn, SERVER_WORK *work) {
+	BOOL start;
+
+	/* Network encode the header now; the data follows it on the wire */
+	if (work->reply_data == NULL) work->reply.data_len = 0;
+	work->total = sizeof(work->reply) + work->reply.data_len;
+	work->reply.crc32    = (work->reply.data_len > 0) ? CRC32(work->reply_data, work->reply.data_len) : 0;
+	work->reply_host     = work->reply;
+	work->reply.msg      = htonl(work->reply.msg);
+	work->reply.msgid    = htonl(work->reply.msgid);
+	work->reply.option   = htonl(work->reply.option);
+	work->reply.rc       = htonl(work->reply.rc);
+	work->reply.data_len = htonl(work->reply.data_len);
+	work->reply.crc32    = htonl(work->reply.crc32);
+	work->next = NULL;
+
+	EnterCriticalSection(&conn->lock);
+	if (conn->closing) {
+		LeaveCriticalSection(&conn->lock);
+		FinishWork(conn, work, FALSE);
+		ReleaseConn(conn);
+		return;
+	}
+	if (conn->send_tail == NULL) { conn->send_head = work; } else { conn->send_tail->next = work; }
+	conn->send_tail = work;
+	if (start = ! conn->sending) conn->sending = TRUE;
+	LeaveCriticalSection(&conn->lock);
+
+	if (start && StartSend(conn, work) != 0) SendComplete(conn, work, FALSE, 0);	/* No completion will arrive */
+	return;
+}
+
+/* A write completed ... continue it, or move to the next queued reply */
+static void SendComplete(SERVER_CONN *conn, SERVER_WORK *work, BOOL ok, int icnt) {
+	SERVER_WORK *next;
+	BOOL close_now;
+
+	if (ok && icnt > 0) {
+		work->sent += icnt;
+		if (work->sent < work->total) {
+			if (StartSend(conn, work) == 0) return;				/* Keep the reference */
+			ok = FALSE;
+		}
+	} else {
+		ok = FALSE;
+	}
+	if (! ok) CloseConn(conn);
+
+	EnterCriticalSection(&conn->lock);
+	if ( (conn->send_head = work->next) == NULL) conn->send_tail = NULL;
+	next = conn->send_head;
+	if (next == NULL || conn->closing) conn->sending = FALSE;
+	close_now = conn->close_requested && next == NULL && conn->running == 0 && conn->wait_head == NULL;
+	LeaveCriticalSection(&conn->lock);
+
+	FinishWork(conn, work, ok);
+	if (close_now) CloseConn(conn);
+
+	/* With the socket closed, drain the queue without writing */
+	if (next != NULL && conn->closing) {
+		EnterCriticalSection(&conn->lock);
+		next = conn->send_head;
+		conn->send_head = conn->send_tail = NULL;
+		LeaveCriticalSection(&conn->lock);
+		while (next != NULL) {
+			SERVER_WORK *tmp = next->next;
+			FinishWork(conn, next, FALSE);
+			ReleaseConn(conn);
+			next = tmp;
+		}
+	} else if (next != NULL && StartSend(conn, next) != 0) {
+		SendComplete(conn, next, FALSE, 0);						/* No completion will arrive */
+	}
+	ReleaseConn(conn);
+	return;
+}
+
+/* Run the handler for one request on this worker */
+static void RunWork(SERVER_CONN *conn, SERVER_WORK *work) {
+	EVENT_SERVER *server;
+
+	server = conn->server;
+	memcpy(&work->reply, &work->request, sizeof(work->reply));
+	work->reply.rc = work->reply.data_len = 0;
+	work->reply_data = NULL;
+	work->free_reply = FALSE;
+
+	work->t_started = ServerTicks();
+	(*server->handler)(conn, &work->request, work->request_class, work->data, &work->reply, &work->reply_data, &work->free_reply);
+	work->t_done = ServerTicks();
+
+	if (work->data != NULL) { free(work->data); work->data = NULL; }
+
+	/* Reply data pointing at handler locals must be copied before it goes out of scope */
+	if (work->reply_data != NULL && ! work->free_reply && work->reply.data_len > 0) {
+		void *copy;
+		if ( (copy = malloc(work->reply.data_len)) != NULL) memcpy(copy, work->reply_data, work->reply.data_len);
+		work->reply_data = copy;
+		work->free_reply = TRUE;
+	}
+
+	/* Finished ... release barrier and start whatever was waiting */
+	EnterCriticalSection(&conn->lock);
+	conn->running--;
+	if (work->ordered) conn->barrier = FALSE;
+	ScheduleWork(conn);
+	LeaveCriticalSection(&conn->lock);
+
+	QueueReply(conn, work);
+	return;
+}
+
+/* Worker thread ... everything (reads, writes, requests) arrives on the completion port */
+static void EventWorker(void *arg) {
+	EVENT_SERVER *server;
+	SERVER_CONN *conn;
+	OVERLAPPED *ov;
+	IO_OP *op;
+	DWORD icnt;
+	ULONG_PTR key;
+	BOOL ok;
+
+	server = (EVENT_SERVER *) arg;
+	while (TRUE) {
+		ok = GetQueuedCompletionStatus(server->iocp, &icnt, &key, &ov, INFINITE);
+		if (ov == NULL) continue;							/* Port problem, not an I/O completion */
+		conn = (SERVER_CONN *) key;
+		op   = (IO_OP *) ov;
+
+		switch (op->kind) {
+			case IO_RECV:
+				if (! ok || conn->closing || RecvComplete(conn, icnt) != 0) {
+					CloseConn(conn);
+					ReleaseConn(conn);								/* Read chain ends */
+				}
+				break;
+			case IO_WORK:
+				RunWork(conn, (SERVER_WORK *) op);
+				break;
+			case IO_SEND:
+				SendComplete(conn, (SERVER_WORK *) op, ok, icnt);
+				break;
+		}
+	}
+	return;
+}
+
+static void RunEventServerStub(void *arg) {
+	EVENT_SERVER *server = (EVENT_SERVER *) arg;
+	RunEventServer(server->name, server->port, server->nworkers, server->handler, server->classify, server->monitor, server->reset);
+	free(server);
+	return;
+}
+
+int RunEventServerThread(char *name, unsigned short port, int nworkers, SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, SERVER_MONITOR monitor, void (*reset)(void)) {
+	EVENT_SERVER *stub;
+
+	if ( (stub = calloc(1, sizeof(*stub))) == NULL) return 1;
+	strcpy_s(stub->name, sizeof(stub->name), name);
+	stub->name[sizeof(stub->name)-1] = '\0';
+	stub->port     = port;
+	stub->nworkers = nworkers;
+	stub->handler  = handler;
+	stub->classify = classify;
+	stub->monitor  = monitor;
+	stub->reset    = reset;
+	return (_beginthread(RunEventServerStub, 0, (void *) stub) != -1L) ? 0 : 2 ;
+}
+
+int RunEventServer(char *name, unsigned short port, int nworkers, SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, SERVER_MONITOR monitor, void (*reset)(void)) {
+
+	SOCKET m_socket, c_socket;
+	SOCKADDR_IN service;
+	EVENT_SERVER *server;
+	SERVER_CONN *conn;
+	int i, nodelay;
+
+	if (InitSockets() != 0) return 3;
+
+	if ( (server = calloc(1, sizeof(*server))) == NULL) return 6;
+	strcpy_s(server->name, sizeof(server->name), name);
+	server->name[sizeof(server->name)-1] = '\0';
+	server->port     = port;
+	server->nworkers = (nworkers > 0) ? nworkers : SERVER_DFLT_WORKERS ;
+	server->handler  = handler;
+	server->classify = classify;
+	server->monitor  = monitor;
+	server->reset    = reset;
+
+	if ( (m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET ) {
+		fprintf(stderr, "TCP %s server: Error creating socket(): %ld\n", server->name, WSAGetLastError() ); fflush(stderr);
+		free(server);
+		return 3;
+	}
+	service.sin_family = AF_INET;
+	service.sin_addr.s_addr = htonl( INADDR_ANY );
+	service.sin_port = htons( port );
+	if ( bind( m_socket, (SOCKADDR*) &service, sizeof(service) ) == SOCKET_ERROR ) {
+		fprintf(stderr, "TCP %s server: bind() failed.\n", server->name); fflush(stderr);
+		closesocket(m_socket); free(server);
+		return 4;
+	}
+	if ( listen( m_socket, SOMAXCONN ) == SOCKET_ERROR ) {
+		fprintf(stderr, "TCP %s server: Error listening on socket.\n", server->name); fflush(stderr);
+		closesocket(m_socket); free(server);
+		return 5;
+	}
+
+	/* Completion port and the fixed pool of workers that service it */
+	if ( (server->iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, server->nworkers)) == NULL) {
+		fprintf(stderr, "TCP %s server: Unable to create I/O completion port\n", server->name); fflush(stderr);
+		closesocket(m_socket); free(server);
+		return 6;
+	}
+	if ( (server->wait_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0)) == NULL) {
+		fprintf(stderr, "TCP %s server: No port for blocking requests (they will use the workers)\n", server->name); fflush(stderr);
+	}
+	for (i=0; i<server->nworkers; i++) {
+		if (_beginthread(EventWorker, 0, server) == -1L) {
+			fprintf(stderr, "TCP %s server: Unable to start worker thread %d\n", server->name, i); fflush(stderr);
+			if (i == 0) { CloseHandle(server->iocp); if (server->wait_port != NULL) CloseHandle(server->wait_port); closesocket(m_socket); free(server); return 6; }
+			break;
+		}
+	}
+
+	if (DebugLevel >= 2) { fprintf(stderr, "TCP %s server: Waiting for clients on port %d (%d workers)\n", server->name, port, i); fflush(stderr); }
+	while (TRUE) {
+		if ( (c_socket = accept( m_socket, NULL, NULL )) == INVALID_SOCKET) {
+			Sleep(10);											/* Don't spin if accept() is failing */
+			continue;
+		}
+		nodelay = 1;											/* Small replies should go out immediately */
+		setsockopt(c_socket, IPPROTO_TCP, TCP_NODELAY, (char *) &nodelay, sizeof(nodelay));
+
+		if ( (conn = calloc(1, sizeof(*conn))) == NULL) {
+			closesocket(c_socket);
+			continue;
+		}
+		conn->socket   = c_socket;
+		conn->server   = server;
+		conn->refcount = 1;									/* Held by the read chain */
+		conn->rx_state = RX_HEADER;
+		InitializeCriticalSection(&conn->lock);
+		InterlockedIncrement(&server->nconnections);
+
+		if (CreateIoCompletionPort((HANDLE) c_socket, server->iocp, (ULONG_PTR) conn, 0) == NULL || StartRecv(conn) != 0) {
+			fprintf(stderr, "TCP %s server: Unable to start I/O on new connection\n", server->name); fflush(stderr);
+			CloseConn(conn);
+			ReleaseConn(conn);
+			continue;
+		}
+		if (DebugLevel >= 2) { fprintf(stderr, "TCP %s server: Connection on port %d established (%d active)\n", server->name, port, server->nconnections); fflush(stderr); }
+	}
+
+	closesocket(m_socket);
+	return 0;
+}
+
 /* ===========================================================================
 -- Routine to connect to a server
 --
@@ -255,9 +873,6 @@ CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *
 
 	int i, rc;
 	unsigned long ip_addr;
-	HANDLE mutex;
-	SOCKADDR_IN service;
-	SOCKET m_socket;
 	CLIENT_DATA_BLOCK *block;
 
 	/* Validate parameters */
@@ -282,6 +897,34 @@ CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *
 		if (list[i] != NULL && list[i]->ip_addr == ip_addr && list[i]->port == port && list[i]->active) return list[i];
 	}
 
+	/* Open the socket and create the block */
+	if ( (block = OpenClientBlock(name, ip_addr, port, err)) == NULL) return NULL;
+
+	/* Find a place to save this connection information */
+	for (i=0; i<nlist; i++) {
+		if (list[i] == NULL) break;
+	}
+	if (i >= nlist) {
+		list = realloc(list, (nlist+10)*sizeof(*list));
+		for (i=0; i<10; i++) list[nlist+i] = NULL;
+		i = nlist;													/* So put in the right place */
+		nlist += 10;												/* And mark our increase */
+	}
+	list[i] = block;
+
+	return block;
+}
+
+/* Socket, connect, mutex and block allocation common to both connection types */
+static CLIENT_DATA_BLOCK *OpenClientBlock(char *name, unsigned long ip_addr, int port, int *err) {
+	static char *rname = "ConnectToServer";
+
+	HANDLE mutex;
+	SOCKADDR_IN service;
+	SOCKET m_socket;
+	CLIENT_DATA_BLOCK *block;
+	int nodelay;
+
 	/* Create a socket to the server */
 	if ( (m_socket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP )) == INVALID_SOCKET) {
 		fprintf(stderr, "ERROR[%s]: Failed to create socket for \"%s\": %ld\n", rname, name, WSAGetLastError() ); fflush(stderr);
@@ -297,6 +940,8 @@ CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *
 		closesocket(m_socket);
 		*err = 4; return NULL;
 	}
+	nodelay = 1;										/* Requests are small ... send immediately */
+	setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (char *) &nodelay, sizeof(nodelay));
 
 	/* Create the mutex to limit control */
 	if ( (mutex = CreateMutex(NULL, FALSE, NULL)) == NULL) {
@@ -319,17 +964,74 @@ CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *
 	block->mutex   = mutex;
 	block->active  = TRUE;
 
-	/* Find a place to save this connection information */
-	for (i=0; i<nlist; i++) {
-		if (list[i] == NULL) break;
+	return block;
+}
+
+/* ===========================================================================
+-- Routine to open a pipelined connection to a server
+--
+-- Usage: CLIENT_DATA_BLOCK *ConnectToServerPipelined(char *name, char *IP_address, int port, int *err);
+--
+-- Inputs: name - descriptive name for the connection (DCx, Focus, ...)
+--         IP_address - IP address in normal form.  Use "127.0.0.1" for loopback test
+--                      if NULL, uses DFLT_SERVER_IP_ADDRESS
+--         err - pointer to variable to receive error code (may be NULL)
+--
+-- Output: Opens a new socket (never shared with ConnectToServer()) and
+--         starts a reader thread that matches replies to requests by msgid
+--
+-- Return:  ! NULL - pointer to a data block to be sent for communication with server
+--            NULL - some error (*err has the code, 1-6 as ConnectToServer)
+--                     7 ==> unable to create the pending list semaphores
+--                     8 ==> unable to start the reader thread
+--
+-- Notes: (1) Requests are sent with SubmitServerRequest() and any number may
+--            be in flight.  Replies may arrive in any order.
+--        (2) StandardServerExchange() also works on this block (submit + wait)
+--        (3) Close with CloseServerConnection() as usual
+=========================================================================== */
+CLIENT_DATA_BLOCK *ConnectToServerPipelined(char *name, char *IP_address, int port, int *err) {
+	static char *rname = "ConnectToServerPipelined";
+
+	int rc;
+	unsigned long ip_addr;
+	CLIENT_DATA_BLOCK *block;
+
+	/* Validate parameters */
+	if (IP_address == NULL) IP_address = DFLT_SERVER_IP_ADDRESS;
+	if (err == NULL) err = &rc;				/* So don't need to track */
+	*err = 0;										/* And assume success */
+
+	if (InitSockets() != 0) {
+		fprintf(stderr, "ERROR[%s]: Socket initialization failed\n", rname); fflush(stderr);
+		*err = 1; return NULL;
 	}
-	if (i >= nlist) {
-		list = realloc(list, (nlist+10)*sizeof(*list));
-		for (i=0; i<10; i++) list[nlist+i] = NULL;
-		i = nlist;													/* So put in the right place */
-		nlist += 10;												/* And mark our increase */
+	if ( (ip_addr = inet_addr(IP_address)) == -1) {
+		fprintf(stderr, "ERROR[%s]: Invalid IP address (%s)\n", rname, IP_address); fflush(stderr);
+		*err = 2; return NULL;
+	}
+
+	if ( (block = OpenClientBlock(name, ip_addr, port, err)) == NULL) return NULL;
+
+	block->pipelined  = TRUE;
+	block->next_msgid = 0;
+	block->pending    = NULL;
+	block->refcount   = 1;						/* Owner's reference, dropped by CloseServerConnection() */
+	if ( (block->list_mutex  = CreateMutex(NULL, FALSE, NULL)) == NULL ||
+		  (block->reader_done = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+		fprintf(stderr, "ERROR[%s]: Unable to create the pending list semaphores\n", rname); fflush(stderr);
+		if (block->list_mutex != NULL) CloseHandle(block->list_mutex);
+		closesocket(block->socket); CloseHandle(block->mutex); free(block);
+		*err = 7; return NULL;
+	}
+
+	block->reader_alive = TRUE;
+	if (_beginthread(PipelineReader, 0, block) == -1L) {
+		fprintf(stderr, "ERROR[%s]: Unable to start the reply reader thread\n", rname); fflush(stderr);
+		CloseHandle(block->list_mutex); CloseHandle(block->reader_done);
+		closesocket(block->socket); CloseHandle(block->mutex); free(block);
+		*err = 8; return NULL;
 	}
-	list[i] = block;
 
 	return block;
 }
@@ -346,6 +1048,9 @@ CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *
 --
 -- Return: 0 ==> successful
 --         1 ==> connection already closed
+--
+-- Notes: A pipelined block stays allocated until every CS_PENDING handle
+--        still held by the caller has been waited on or abandoned.
 ============================================================================ */
 int CloseServerConnection(CLIENT_DATA_BLOCK *block) {
 	static char *rname = "CloseServerConnection";
@@ -357,15 +1062,23 @@ int CloseServerConnection(CLIENT_DATA_BLOCK *block) {
 
 	/* Shutdown and close the socket */
 	shutdown(block->socket, SD_BOTH);
+	if (block->pipelined) {							/* Reader sees the shutdown and fails anything pending */
+		WaitForSingleObject(block->reader_done, INFINITE);
+	}
 	closesocket(block->socket);
 	block->active = FALSE;
-	free(block);
 
-	/* Finally, remove this entry from the list of known connections */
+	/* Remove this entry from the list of known connections */
 	for (i=0; i<nlist; i++) {
 		if (list[i] == block) list[i] = NULL;
 	}
 
+	/* Finally release the memory (pipelined ... once no request handle refers to it) */
+	if (block->pipelined) {
+		ReleaseClientBlock(block);
+	} else {
+		free(block);
+	}
 	return 0;
 }
 
@@ -387,6 +1100,7 @@ int CloseServerConnection(CLIENT_DATA_BLOCK *block) {
 -- Return: 0 if successful
 --         1 ==> client appears to have terminated
 --         2 ==> recv() returned SOCKET_ERROR - assume client is terminated
+--         3 ==> unable to allocate memory for the data (stream now unusable)
 --
 -- Notes: Sends/receives the standard message exchange block defined
 --         for this server implementation.
@@ -397,20 +1111,33 @@ int GetStandardServerResponse(CLIENT_DATA_BLOCK *block, CS_MSG *reply, void **pd
 int GetStandardServerRequest(SERVER_DATA_BLOCK *block, CS_MSG *request, void **pdata) {
 	return GetSocketMsg(block->socket, request, pdata);
 }
+
+/* recv() until all n bytes are in (TCP may deliver any message in pieces) */
+static int RecvAll(SOCKET socket, char *buffer, int n) {
+	int icnt;
+
+	while (n > 0) {
+		icnt = recv(socket, buffer, n, 0);
+		if (icnt == 0) return 1;
+		if (icnt == SOCKET_ERROR) return 2;
+		buffer += icnt;
+		n      -= icnt;
+	}
+	return 0;
+}
+
 int GetSocketMsg(SOCKET socket, CS_MSG *request, void **pdata) {
 	static char *rname = "GetSocketMsg";
-	int icnt;
+	int rc;
 	
 	/* Initialize all the results in case there is any failure */
 	memset(request, 0, sizeof(*request));
 	if (pdata != NULL) *pdata = NULL;
 
-	/* Get the data from the socket */
-	icnt = recv(socket, (char *) request, sizeof(*request), 0);
-	if (icnt == 0) return 1;
-	if (icnt == SOCKET_ERROR) {
-		if (DebugLevel >= 1) { fprintf(stderr, "ERROR: recv() returned SOCKET_ERROR - assuming client terminated\n"); fflush(stderr); }
-		return 2;
+	/* Get the header from the socket */
+	if ( (rc = RecvAll(socket, (char *) request, sizeof(*request))) != 0) {
+		if (rc == 2 && DebugLevel >= 1) { fprintf(stderr, "ERROR: recv() returned SOCKET_ERROR - assuming client terminated\n"); fflush(stderr); }
+		return rc;
 	}
 	request->msg      = ntohl(request->msg);
 	request->msgid    = ntohl(request->msgid);
@@ -421,29 +1148,17 @@ int GetSocketMsg(SOCKET socket, CS_MSG *request, void **pdata) {
 
 	/* If we are to get additional data, grab it now */
 	if (request->data_len > 0) {
-#define	MAX_RETRIES	(10)
-		char *data, *aptr;
-		int ineed, itry;
-
-		ineed = request->data_len;										/* How many bytes of additional data should be coming */
-		aptr = data = calloc(1, ineed);								/* Storage plus pointer for next pieces */
-		for (itry=0; itry<MAX_RETRIES && ineed>0; itry++) {
-			if (itry != 0 && DebugLevel >= 2) { fprintf(stderr, "recv() retry [%d]: expect=%d  remaining=%d\n", itry, request->data_len, ineed); fflush(stderr); }
-			icnt = recv(socket, aptr, ineed, 0);
-			if (icnt == 0) {
-				return 1;
-			} else if (icnt == SOCKET_ERROR) {
-				fprintf(stderr, "ERROR[%s]: recv() returned SOCKET_ERROR -- assuming client has been terminated\n", rname);
-				fflush(stderr);
-				return 2;
-			}
-			ineed -= icnt;
-			aptr  += icnt;
-			Sleep(100);
-		}
+		char *data;
 
-		/* At least warn if we were unsuccessful ... but go ahead and return */
-		if (ineed != 0 && DebugLevel >= 1) { fprintf(stderr, "ERROR[%s]: Expected %d bytes but only got %d\n", rname, request->data_len, icnt); fflush(stderr); }
+		if ( (data = malloc(request->data_len)) == NULL) {
+			fprintf(stderr, "ERROR[%s]: Unable to allocate %u bytes for the message data\n", rname, request->data_len); fflush(stderr);
+			return 3;
+		}
+		if ( (rc = RecvAll(socket, data, request->data_len)) != 0) {
+			if (rc == 2) { fprintf(stderr, "ERROR[%s]: recv() returned SOCKET_ERROR -- assuming client has been terminated\n", rname); fflush(stderr); }
+			free(data);
+			return rc;
+		}
 
 		/* If crc32 is set, verify or output an error */
 		if (request->crc32 != 0) {
@@ -551,6 +1266,16 @@ int StandardServerExchange(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_
 		return 1;
 	}
 
+/* Pipelined connection ... the reader thread owns the receive side */
+	if (block->pipelined) {
+		CS_PENDING *op;
+		if ( (rc = SubmitServerRequest(block, request, send_data, NULL, NULL, &op)) == 0) {
+			rc = WaitServerReply(op, INFINITE, reply, reply_data);
+		}
+		if (rc != 0) { fprintf(stderr, "ERROR[%s]: Returned error %d\n", rname, rc); fflush(stderr); }
+		return rc;
+	}
+
 /* Get control of the server semaphore */
 #ifdef _WIN32
 	if (WaitForSingleObject(block->mutex, CLIENT_MUTEX_WAIT) != WAIT_OBJECT_0) {
@@ -572,6 +1297,602 @@ int StandardServerExchange(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_
 	return rc;
 }
 
+/* ===========================================================================
+-- Pipelined client requests ... submit now, collect the reply later
+--
+-- Usage: int SubmitServerRequest(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_data, 
+--                                CS_CALLBACK callback, void *context, CS_PENDING **handle);
+--        int WaitServerReply(CS_PENDING *handle, int msTimeout, CS_MSG *reply, void **reply_data);
+--        int AbandonServerRequest(CS_PENDING *handle);
+--
+-- Inputs: block     - structure returned from ConnectToServerPipelined()
+--         request   - structure with the request (msgid is assigned here)
+--         send_data - data to be sent with the request
+--         callback  - if !NULL, called from the reader thread when the reply arrives
+--         context   - passed unchanged to callback
+--         handle    - pointer to receive handle for WaitServerReply() (if no callback)
+--                     if both callback and handle are NULL, the reply is discarded
+--         msTimeout - maximum time to wait for the reply (INFINITE allowed, 0 to poll)
+--         reply      - pointer to structure to get the reply
+--         reply_data - pointer to variable that gets data returned with reply (if ! NULL)
+--
+-- Output: *handle     - opaque pending request
+--         *reply      - filled with the reply from the server
+--         *reply_data - malloc'd pointer containing message specific data from server
+--
+-- Return: SubmitServerRequest:
+--           0 ==> request sent
+--           1 ==> block invalid or not a pipelined connection
+--           2 ==> timeout waiting for the send semaphore
+--           3 ==> unable to allocate memory / event
+--           4 ==> connection has been lost
+--         WaitServerReply:
+--           0 ==> reply received (handle is released)
+--           1 ==> timeout (handle still valid ... wait again or abandon)
+--           2 ==> connection lost before reply (handle is released)
+--           3 ==> invalid handle
+--         AbandonServerRequest:
+--           0 ==> handle released (reply will be discarded when it arrives)
+--
+-- Notes: (1) Requests are written to the socket in submit order, but the
+--            server is free to answer them in any order.  Replies are matched
+--            on msgid by the reader thread.
+--        (2) Callbacks run on the reader thread.  They must be quick and must
+--            never wait for another reply on the same connection.  The
+--            callback owns data and must free() it.
+=========================================================================== */
+struct _CS_PENDING {
+	struct _CS_PENDING *next;
+	CLIENT_DATA_BLOCK *block;
+	int32_t msgid;							/* Tag sent with the request and echoed by the server */
+	HANDLE done;							/* Manual reset event signaled on completion (NULL for callbacks) */
+	BOOL complete;							/* Reply (or failure) has been recorded */
+	BOOL abandoned;						/* Nobody will wait ... free when complete */
+	int status;								/* 0 ==> reply valid, 1 ==> connection lost */
+	CS_MSG reply;
+	void *data;
+	CS_CALLBACK callback;
+	void *context;
+};
+
+/* Drop one reference to a pipelined block ... the last one frees it */
+static void ReleaseClientBlock(CLIENT_DATA_BLOCK *block) {
+	if (InterlockedDecrement(&block->refcount) > 0) return;
+	CloseHandle(block->reader_done);
+	CloseHandle(block->list_mutex);
+	free(block);
+	return;
+}
+
+/* Free a request handle and its reference to the block (data already dealt with) */
+static void FreePending(CS_PENDING *op) {
+	CLIENT_DATA_BLOCK *block;
+
+	block = op->block;
+	if (op->done != NULL) CloseHandle(op->done);
+	free(op);
+	ReleaseClientBlock(block);
+	return;
+}
+
+int SubmitServerRequest(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_data, CS_CALLBACK callback, void *context, CS_PENDING **handle) {
+	static char *rname = "SubmitServerRequest";
+
+	CS_PENDING *op, **pp;
+	BOOL alive;
+	int rc;
+
+	if (handle != NULL) *handle = NULL;
+
+	if (block == NULL || block->magic != CLIENT_MAGIC || ! block->active || ! block->pipelined) {
+		fprintf(stderr, "ERROR[%s]: Client block invalid or not pipelined\n", rname); fflush(stderr);
+		return 1;
+	}
+
+	if ( (op = calloc(1, sizeof(*op))) == NULL) return 3;
+	op->block    = block;
+	op->callback = callback;
+	op->context  = context;
+	InterlockedIncrement(&block->refcount);			/* Block outlives the handle */
+	if (callback == NULL) {
+		if (handle == NULL) {
+			op->abandoned = TRUE;						/* Fire and forget */
+		} else if ( (op->done = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+			FreePending(op);
+			return 3;
+		}
+	}
+
+	/* The send semaphore keeps msgid order identical to the order on the wire */
+	if (WaitForSingleObject(block->mutex, CLIENT_MUTEX_WAIT) != WAIT_OBJECT_0) {
+		fprintf(stderr, "ERROR[%s]: Timeout waiting for the semaphore\n", rname); fflush(stderr);
+		FreePending(op);
+		return 2;
+	}
+	if (++block->next_msgid <= 0) block->next_msgid = 1;
+	op->msgid = request.msgid = block->next_msgid;
+
+	/* Must be on the list before the request goes out ... reply may beat us back */
+	WaitForSingleObject(block->list_mutex, INFINITE);
+	if (alive = block->reader_alive) {
+		op->next = block->pending;
+		block->pending = op;
+	}
+	ReleaseMutex(block->list_mutex);
+
+	rc = alive ? SendStandardServerRequest(block, request, send_data) : 4;
+	ReleaseMutex(block->mutex);
+
+	/* On failure, pull back off the list ... unless the reader already took it (then it completes with an error) */
+	if (rc != 0) {
+		BOOL found = FALSE;
+		WaitForSingleObject(block->list_mutex, INFINITE);
+		for (pp=&block->pending; *pp!=NULL; pp=&(*pp)->next) {
+			if (*pp == op) { *pp = op->next; found = TRUE; break; }
+		}
+		ReleaseMutex(block->list_mutex);
+		if (found || ! alive) {
+			FreePending(op);
+			return 4;
+		}
+	}
+
+	if (handle != NULL && callback == NULL) *handle = op;
+	return 0;
+}
+
+int WaitServerReply(CS_PENDING *op, int msTimeout, CS_MSG *reply, void **reply_data) {
+	int rc;
+
+	if (reply != NULL) memset(reply, 0, sizeof(*reply));
+	if (reply_data != NULL) *reply_data = NULL;
+	if (op == NULL || op->done == NULL) return 3;
+
+	if (WaitForSingleObject(op->done, msTimeout) != WAIT_OBJECT_0) return 1;
+
+	rc = (op->status == 0) ? 0 : 2;
+	if (reply != NULL) *reply = op->reply;
+	if (reply_data != NULL) {
+		*reply_data = op->data;
+	} else if (op->data != NULL) {
+		free(op->data);
+	}
+	FreePending(op);
+	return rc;
+}
+
+int AbandonServerRequest(CS_PENDING *op) {
+	CLIENT_DATA_BLOCK *block;
+	BOOL release;
+
+	if (op == NULL || op->done == NULL) return 3;
+
+	block = op->block;
+	WaitForSingleObject(block->list_mutex, INFINITE);
+	if (! (release = op->complete)) op->abandoned = TRUE;	/* Reader will clean up */
+	ReleaseMutex(block->list_mutex);
+
+	if (release) {
+		if (op->data != NULL) free(op->data);
+		FreePending(op);
+	}
+	return 0;
+}
+
+/* Record the result and wake the waiter, call the callback, or clean up */
+static void CompletePending(CLIENT_DATA_BLOCK *block, CS_PENDING *op, int status, CS_MSG *reply, void *data) {
+	BOOL release;
+
+	op->status = status;
+	if (reply != NULL) op->reply = *reply;
+	op->data   = data;
+
+	if (op->callback != NULL) {
+		op->callback(status, &op->reply, data, op->context);
+		FreePending(op);
+		return;
+	}
+
+	WaitForSingleObject(block->list_mutex, INFINITE);
+	op->complete = TRUE;
+	if (! (release = op->abandoned)) SetEvent(op->done);
+	ReleaseMutex(block->list_mutex);
+
+	if (release) {
+		if (op->data != NULL) free(op->data);
+		FreePending(op);
+	}
+	return;
+}
+
+/* Thread receiving every reply on a pipelined connection */
+static void PipelineReader(void *arg) {
+	static char *rname = "PipelineReader";
+
+	CLIENT_DATA_BLOCK *block;
+	CS_PENDING *op, **pp;
+	CS_MSG reply;
+	void *data;
+
+	block = (CLIENT_DATA_BLOCK *) arg;
+	while (GetSocketMsg(block->socket, &reply, &data) == 0) {
+
+		/* Find and unlink the matching request */
+		WaitForSingleObject(block->list_mutex, INFINITE);
+		for (pp=&block->pending; (op = *pp) != NULL; pp=&op->next) {
+			if (op->msgid == reply.msgid) { *pp = op->next; break; }
+		}
+		ReleaseMutex(block->list_mutex);
+
+		if (op == NULL) {
+			if (DebugLevel >= 1) { fprintf(stderr, "ERROR[%s]: Reply with unknown msgid %d (msg=%d) discarded\n", rname, reply.msgid, reply.msg); fflush(stderr); }
+			if (data != NULL) free(data);
+			continue;
+		}
+		CompletePending(block, op, 0, &reply, data);
+	}
+
+	/* Connection is gone ... fail everything still outstanding */
+	if (DebugLevel >= 2) { fprintf(stderr, "%s: connection closed\n", rname); fflush(stderr); }
+	WaitForSingleObject(block->list_mutex, INFINITE);
+	block->reader_alive = FALSE;
+	op = block->pending;
+	block->pending = NULL;
+	ReleaseMutex(block->list_mutex);
+
+	while (op != NULL) {
+		CS_PENDING *next = op->next;
+		CompletePending(block, op, 1, NULL, NULL);
+		op = next;
+	}
+
+	SetEvent(block->reader_done);
+	return;
+}
+
+/* ===========================================================================
+-- Same-host shared memory transport
+--
+-- A server that has bulk data (images) for clients on the same machine can
+-- publish it into a named mapping instead of sending it over the socket.
+-- The control exchange still goes over TCP; the reply carries only the slot
+-- and sequence number, and the client reads the data in place.
+--
+-- Layout: SHM_HEADER, then nslots x (SHM_SLOT + slot_bytes), each slot
+-- aligned to SHM_ALIGN bytes.
+--
+-- Each slot carries a sequence number which is odd while the slot is being
+-- rewritten and advances by 2 on every publish.  A reader holding (slot,
+-- sequence) knows the data is intact if the sequence is unchanged after it
+-- has finished with the data (SharedRingValid).
+=========================================================================== */
+#define	SHM_MAGIC	(0x5A4D5348)				/* "HSMZ" */
+#define	SHM_ALIGN	(64)
+
+typedef struct _SHM_HEADER {
+	uint32_t magic;
+	uint32_t nslots;								/* Number of slots in the ring */
+	uint32_t slot_bytes;							/* Data bytes available in each slot */
+	uint32_t stride;								/* Bytes between successive slot headers */
+	volatile long next;							/* Publish counter (selects the next slot) */
+} SHM_HEADER;
+
+typedef struct _SHM_SLOT {
+	volatile long sequence;						/* Odd while being written */
+	int32_t tag;									/* Caller's identifier (imageID), -1 if none */
+	uint32_t length;								/* Valid bytes in the slot */
+} SHM_SLOT;
+
+struct _SHM_RING {
+	SHM_HEADER *header;							/* Start of the mapped view */
+	size_t size;									/* Total bytes mapped */
+	BOOL owner;										/* Created (server) vs opened (client) */
+#ifdef _WIN32
+	HANDLE mapping;
+#elif __linux__
+	char name[64];
+#endif
+};
+
+#ifdef _WIN32
+	#define	SHM_CAS(p,new,old)	InterlockedCompareExchange((p),(new),(old))
+	#define	SHM_INC(p)				InterlockedIncrement(p)
+	#define	SHM_STORE(p,val)		InterlockedExchange((p),(val))
+	#define	SHM_BARRIER()			MemoryBarrier()
+#elif __linux__
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#define	SHM_CAS(p,new,old)	__sync_val_compare_and_swap((p),(old),(new))
+	#define	SHM_INC(p)				__sync_add_and_fetch((p),1)
+	#define	SHM_STORE(p,val)		(__sync_synchronize(), *(p) = (val), __sync_synchronize())
+	#define	SHM_BARRIER()			__sync_synchronize()
+#endif
+
+#define	SHM_SLOT_PTR(ring,i)	((SHM_SLOT *) ((char *) (ring)->header + SHM_ALIGN + (size_t) (i)*(ring)->header->stride))
+
+/* ===========================================================================
+-- Determine if a connected server is running on this machine
+--
+-- Usage: BOOL IsServerLocal(CLIENT_DATA_BLOCK *block);
+--
+-- Inputs: block - connection returned by ConnectToServer[Pipelined]()
+--
+-- Output: none
+--
+-- Return: TRUE if the server is on the loopback address or the two ends
+--         of the socket share the same address
+=========================================================================== */
+BOOL IsServerLocal(CLIENT_DATA_BLOCK *block) {
+	SOCKADDR_IN mine, peer;
+	int len;
+
+	if (block == NULL || block->magic != CLIENT_MAGIC || ! block->active) return FALSE;
+	if ((ntohl(block->ip_addr) >> 24) == 127) return TRUE;
+
+	len = sizeof(mine);
+	if (getsockname(block->socket, (SOCKADDR *) &mine, &len) != 0) return FALSE;
+	len = sizeof(peer);
+	if (getpeername(block->socket, (SOCKADDR *) &peer, &len) != 0) return FALSE;
+	return mine.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+/* ===========================================================================
+-- Create (server) or open (client) a named shared memory ring
+--
+-- Usage: SHM_RING *CreateSharedRing(char *name, int nslots, size_t slot_bytes);
+--        SHM_RING *OpenSharedRing(char *name);
+--        int CloseSharedRing(SHM_RING *ring);
+--
+-- Inputs: name       - name of the mapping (unique per server process)
+--         nslots     - number of slots in the ring
+--         slot_bytes - maximum bytes that can be published in one slot
+--         ring       - handle returned by Create/Open
+--
+-- Output: Creates / maps / unmaps the shared memory.  The client view is
+--         read-only.
+--
+-- Return: Create/Open: handle or NULL on failure
+--         Close:       0 if successful, 1 if ring invalid
+--
+-- Notes: Windows uses a pagefile-backed file mapping; Linux uses POSIX shm
+--        (name is prefixed with "/").  The mapping lives until the last
+--        handle is closed (Windows) or the creator closes it (Linux).
+=========================================================================== */
+SHM_RING *CreateSharedRing(char *name, int nslots, size_t slot_bytes) {
+	static char *rname = "CreateSharedRing";
+
+	SHM_RING *ring;
+	size_t stride, size;
+	int i;
+
+	if (name == NULL || nslots <= 0 || slot_bytes <= 0) return NULL;
+	stride = (sizeof(SHM_SLOT) + slot_bytes + SHM_ALIGN-1) & ~((size_t) SHM_ALIGN-1);
+	size   = SHM_ALIGN + nslots*stride;
+	if (stride > 0xFFFFFFFF) return NULL;
+
+	if ( (ring = calloc(1, sizeof(*ring))) == NULL) return NULL;
+	ring->owner = TRUE;
+	ring->size  = size;
+
+#ifdef _WIN32
+	ring->mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD) (((uint64_t) size) >> 32), (DWORD) size, name);
+	if (ring->mapping == NULL) {
+		if (DebugLevel >= 1) { fprintf(stderr, "ERROR[%s]: CreateFileMapping(%s) failed (%d)\n", rname, name, GetLastError()); fflush(stderr); }
+		free(ring);
+		return NULL;
+	}
+	if ( (ring->header = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size)) == NULL) {
+		if (DebugLevel >= 1) { fprintf(stderr, "ERROR[%s]: MapViewOfFile(%s) failed (%d)\n", rname, name, GetLastError()); fflush(stderr); }
+		CloseHandle(ring->mapping); free(ring);
+		return NULL;
+	}
+#elif __linux__
+	{
+		int fd;
+		snprintf(ring->name, sizeof(ring->name), "/%s", name);
+		if ( (fd = shm_open(ring->name, O_CREAT | O_RDWR, 0644)) < 0) { free(ring); return NULL; }
+		if (ftruncate(fd, size) != 0 || (ring->header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			if (DebugLevel >= 1) { fprintf(stderr, "ERROR[%s]: Unable to map %s\n", rname, ring->name); fflush(stderr); }
+			close(fd); shm_unlink(ring->name); free(ring);
+			return NULL;
+		}
+		close(fd);
+	}
+#endif
+
+	ring->header->nslots     = nslots;
+	ring->header->slot_bytes = (uint32_t) slot_bytes;
+	ring->header->stride     = (uint32_t) stride;
+	ring->header->next       = 0;
+	for (i=0; i<nslots; i++) {
+		SHM_SLOT_PTR(ring,i)->sequence = 0;
+		SHM_SLOT_PTR(ring,i)->tag      = -1;
+		SHM_SLOT_PTR(ring,i)->length   = 0;
+	}
+	SHM_BARRIER();
+	ring->header->magic = SHM_MAGIC;				/* Last ... marks ring as ready */
+
+	if (DebugLevel >= 3) { fprintf(stderr, "INFO[%s]: Created %s with %d slots of %u bytes\n", rname, name, nslots, (unsigned) slot_bytes); fflush(stderr); }
+	return ring;
+}
+
+SHM_RING *OpenSharedRing(char *name) {
+	static char *rname = "OpenSharedRing";
+
+	SHM_RING *ring;
+	SHM_HEADER *header;
+
+	if (name == NULL || (ring = calloc(1, sizeof(*ring))) == NULL) return NULL;
+
+#ifdef _WIN32
+	if ( (ring->mapping = OpenFileMapping(FILE_MAP_READ, FALSE, name)) == NULL) {
+		if (DebugLevel >= 2) { fprintf(stderr, "WARNING[%s]: OpenFileMapping(%s) failed (%d)\n", rname, name, GetLastError()); fflush(stderr); }
+		free(ring);
+		return NULL;
+	}
+	/* Map the header first to learn the full size */
+	if ( (header = MapViewOfFile(ring->mapping, FILE_MAP_READ, 0, 0, sizeof(*header))) == NULL || header->magic != SHM_MAGIC) {
+		if (header != NULL) UnmapViewOfFile(header);
+		CloseHandle(ring->mapping); free(ring);
+		return NULL;
+	}
+	ring->size = SHM_ALIGN + (size_t) header->nslots * header->stride;
+	UnmapViewOfFile(header);
+	if ( (ring->header = MapViewOfFile(ring->mapping, FILE_MAP_READ, 0, 0, ring->size)) == NULL) {
+		CloseHandle(ring->mapping); free(ring);
+		return NULL;
+	}
+#elif __linux__
+	{
+		int fd;
+		struct stat st;
+		snprintf(ring->name, sizeof(ring->name), "/%s", name);
+		if ( (fd = shm_open(ring->name, O_RDONLY, 0)) < 0) { free(ring); return NULL; }
+		if (fstat(fd, &st) != 0 || (header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			close(fd); free(ring);
+			return NULL;
+		}
+		close(fd);
+		ring->header = header;
+		ring->size   = st.st_size;
+		if (header->magic != SHM_MAGIC) { munmap(header, ring->size); free(ring); return NULL; }
+	}
+#endif
+
+	if (DebugLevel >= 3) { fprintf(stderr, "INFO[%s]: Opened %s (%u slots of %u bytes)\n", rname, name, ring->header->nslots, ring->header->slot_bytes); fflush(stderr); }
+	return ring;
+}
+
+int CloseSharedRing(SHM_RING *ring) {
+
+	if (ring == NULL || ring->header == NULL) return 1;
+#ifdef _WIN32
+	UnmapViewOfFile(ring->header);
+	CloseHandle(ring->mapping);
+#elif __linux__
+	munmap(ring->header, ring->size);
+	if (ring->owner) shm_unlink(ring->name);
+#endif
+	free(ring);
+	return 0;
+}
+
+/* ===========================================================================
+-- Publish data into the next free slot of a shared ring (server side)
+--
+-- Usage: int SharedRingPublish(SHM_RING *ring, int32_t tag, void *data, size_t length, int *slot, int32_t *sequence);
+--
+-- Inputs: ring     - ring from CreateSharedRing()
+--         tag      - identifier of immutable data (imageID), or -1 if the
+--                    data may change under the same identifier
+--         data     - bytes to copy into the ring
+--         length   - number of bytes
+--         slot     - pointer to receive the slot used
+--         sequence - pointer to receive the sequence number of the slot
+--
+-- Output: Copies data into the ring unless a slot already holds the same
+--         tag and length, in which case that slot is returned (no copy).
+--         Only pass a tag >= 0 when the same tag always means the same
+--         bytes; otherwise a stale slot would be served.
+--
+-- Return: 0 if successful
+--         1 ==> invalid ring or parameters
+--         2 ==> data larger than a slot
+--         3 ==> unable to find a slot not being written
+--
+-- Notes: Safe to call from several threads at once.  Slots are reused in
+--        round-robin order, so a reader has nslots-1 further publishes
+--        to finish with data before it may be overwritten.
+=========================================================================== */
+int SharedRingPublish(SHM_RING *ring, int32_t tag, void *data, size_t length, int *slot, int32_t *sequence) {
+
+	SHM_HEADER *hdr;
+	SHM_SLOT *s;
+	long seq;
+	int i, k;
+
+	if (slot != NULL) *slot = -1;
+	if (sequence != NULL) *sequence = 0;
+	if (ring == NULL || ! ring->owner || (hdr = ring->header) == NULL || data == NULL) return 1;
+	if (length > hdr->slot_bytes) return 2;
+
+	/* Already published and still intact? */
+	if (tag >= 0) {
+		for (i=0; i<(int) hdr->nslots; i++) {
+			s = SHM_SLOT_PTR(ring,i);
+			seq = s->sequence;
+			if (seq != 0 && ! (seq & 1) && s->tag == tag && s->length == length) {
+				if (slot != NULL) *slot = i;
+				if (sequence != NULL) *sequence = seq;
+				return 0;
+			}
+		}
+	}
+
+	/* Claim a slot by moving its sequence from even to odd */
+	for (k=0; k<(int) hdr->nslots; k++) {
+		i = (int) ((unsigned long) (SHM_INC(&hdr->next)-1) % hdr->nslots);
+		s = SHM_SLOT_PTR(ring,i);
+		seq = s->sequence;
+		if ( (seq & 1) || SHM_CAS(&s->sequence, seq+1, seq) != seq) continue;		/* Another writer has it */
+
+		s->tag = tag;
+		s->length = (uint32_t) length;
+		memcpy(s+1, data, length);
+		seq += 2;
+		SHM_STORE(&s->sequence, seq);				/* Publish (full barrier) */
+
+		if (slot != NULL) *slot = i;
+		if (sequence != NULL) *sequence = seq;
+		return 0;
+	}
+	return 3;
+}
+
+/* ===========================================================================
+-- Access data published in a shared ring (client side)
+--
+-- Usage: void *SharedRingAccess(SHM_RING *ring, int slot, int32_t sequence, size_t *length);
+--        BOOL SharedRingValid(SHM_RING *ring, int slot, int32_t sequence);
+--
+-- Inputs: ring     - ring from OpenSharedRing() (or CreateSharedRing())
+--         slot     - slot reported by the server
+--         sequence - sequence number reported by the server
+--         length   - pointer to receive valid bytes in the slot
+--
+-- Output: *length - bytes of data (0 if not valid)
+--
+-- Return: Access: pointer to the data in place, or NULL if the slot no
+--                 longer holds that sequence
+--         Valid:  TRUE if the slot still holds that sequence
+--
+-- Notes: The data may be overwritten by the server at any time after it
+--        has cycled through the ring.  Call SharedRingValid() after using
+--        (or copying) the data; if it returns FALSE the data must be
+--        discarded.
+=========================================================================== */
+void *SharedRingAccess(SHM_RING *ring, int slot, int32_t sequence, size_t *length) {
+	SHM_SLOT *s;
+
+	if (length != NULL) *length = 0;
+	if (ring == NULL || ring->header == NULL || slot < 0 || slot >= (int) ring->header->nslots) return NULL;
+	if ( (sequence & 1) || sequence == 0) return NULL;
+
+	s = SHM_SLOT_PTR(ring,slot);
+	if (s->sequence != sequence) return NULL;
+	SHM_BARRIER();
+	if (length != NULL) *length = s->length;
+	return (void *) (s+1);
+}
+
+BOOL SharedRingValid(SHM_RING *ring, int slot, int32_t sequence) {
+
+	if (ring == NULL || ring->header == NULL || slot < 0 || slot >= (int) ring->header->nslots) return FALSE;
+	SHM_BARRIER();
+	return SHM_SLOT_PTR(ring,slot)->sequence == sequence;
+}
+
 /* ===========================================================================
 -- Routines to initialize socket support (OS dependent)
 --
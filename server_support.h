@@ -75,8 +75,52 @@ typedef struct _CLIENT_DATA_BLOCK {
 	int port;									/* Port connection */
 	SOCKET socket;								/* Socket for this connection */
 	HANDLE mutex;								/* Semaphore to limit multiple access to this connection */
+	/* Pipelined connections only (requests tagged with msgid, replies matched by a reader thread) */
+	BOOL pipelined;							/* Connection opened by ConnectToServerPipelined() */
+	BOOL reader_alive;						/* Reader thread still receiving replies */
+	int32_t next_msgid;						/* Last msgid assigned (never 0) */
+	HANDLE list_mutex;						/* Protects the pending list */
+	HANDLE reader_done;						/* Signaled when the reader thread exits */
+	struct _CS_PENDING *pending;			/* Requests sent but not yet answered */
+	volatile long refcount;					/* Owner plus every CS_PENDING not yet released */
 } CLIENT_DATA_BLOCK;
 
+/* Event driven server (completion port + worker pool) */
+typedef struct _SERVER_CONN SERVER_CONN;		/* Opaque per-connection state */
+
+#define	SERVER_ORDERED		(0)					/* Runs alone, after everything received before it */
+#define	SERVER_CONCURRENT	(1)					/* May run alongside other requests on the connection */
+#define	SERVER_BLOCKING	(2)					/* Or'd with either ... handler may wait (run off the worker pool) */
+#define	SERVER_CLASS_USER	(0x100)				/* This bit and up belong to the application (passed to the handler) */
+#define	SERVER_DFLT_WORKERS	(8)				/* Worker threads if not specified */
+#define	SERVER_MAX_WAITERS	(64)				/* Threads for SERVER_BLOCKING handlers (more queue) */
+
+/* Called on a worker for each request.  reply is preset (msgid echoed, rc=0, no data) */
+/* request_class is the classify result, so a decision made there is not made again */
+/* Set *reply_data/reply->data_len; *free_reply=TRUE passes a malloc'd buffer, otherwise it is copied */
+typedef void (*SERVER_REQUEST_HANDLER)(SERVER_CONN *conn, CS_MSG *request, int request_class, void *data, CS_MSG *reply, void **reply_data, BOOL *free_reply);
+typedef int  (*SERVER_REQUEST_CLASS)(CS_MSG *request);
+
+/* Timing of one request, reported to the monitor once the reply is written */
+typedef struct _SERVER_TIMING {
+	double queue_ms;							/* Received until a worker started it (includes barrier waits) */
+	double service_ms;						/* Time in the handler */
+	double send_ms;							/* Handler return until the reply was written */
+	BOOL sent;									/* FALSE if the connection closed first */
+} SERVER_TIMING;
+typedef void (*SERVER_MONITOR)(CS_MSG *request, CS_MSG *reply, SERVER_TIMING *timing);
+
+/* Handle for one outstanding request on a pipelined connection */
+typedef struct _CS_PENDING CS_PENDING;
+
+/* Completion callback (runs on the reader thread ... must not wait on the same connection) */
+/* status is 0 if reply is valid, !0 if the connection was lost.  Callback owns data (free) */
+typedef void (*CS_CALLBACK)(int status, CS_MSG *reply, void *data, void *context);
+
+/* Shared memory ring for passing bulk data to clients on the same machine */
+/* Each slot has a sequence number ... odd while being written, advanced by 2 per publish */
+typedef struct _SHM_RING SHM_RING;			/* Opaque handle (either end) */
+
 int InitSockets(void);
 int ShutdownSockets(void);
 int DebugSockets(int level);				/* Enable a level of debug messages for sockets (all to stderr) */
@@ -85,9 +129,13 @@ int DebugSockets(int level);				/* Enable a level of debug messages for sockets
 int RunServer      (char *name, unsigned short port, void (*ServerHandler)(void *), void (*reset)(void));
 int RunServerThread(char *name, unsigned short port, void (*ServerHandler)(void *), void (*reset)(void));
 void EndServerHandler(SERVER_DATA_BLOCK *socket_info);
+int RunEventServer      (char *name, unsigned short port, int nworkers, SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, SERVER_MONITOR monitor, void (*reset)(void));
+int RunEventServerThread(char *name, unsigned short port, int nworkers, SERVER_REQUEST_HANDLER handler, SERVER_REQUEST_CLASS classify, SERVER_MONITOR monitor, void (*reset)(void));
+void EndServerConn(SERVER_CONN *conn);		/* Close connection once queued replies are sent */
 
 /* Routines to connect to a server */
 CLIENT_DATA_BLOCK *ConnectToServer(char *name, char *IP_address, int port, int *err);
+CLIENT_DATA_BLOCK *ConnectToServerPipelined(char *name, char *IP_address, int port, int *err);
 int CloseServerConnection(CLIENT_DATA_BLOCK *block);
 
 /* Standard messages across network */
@@ -101,6 +149,19 @@ int CloseServerConnection(CLIENT_DATA_BLOCK *block);
 	int SendStandardServerRequest(CLIENT_DATA_BLOCK *block, CS_MSG request, void *data);
    int GetStandardServerResponse(CLIENT_DATA_BLOCK *block, CS_MSG *reply,  void **pdata);
 	int StandardServerExchange(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_data, CS_MSG *reply, void **reply_data);
+/* Pipelined client calls (many requests in flight, replies matched by msgid) */
+	int SubmitServerRequest(CLIENT_DATA_BLOCK *block, CS_MSG request, void *send_data, CS_CALLBACK callback, void *context, CS_PENDING **handle);
+	int WaitServerReply(CS_PENDING *handle, int msTimeout, CS_MSG *reply, void **reply_data);
+	int AbandonServerRequest(CS_PENDING *handle);
+
+/* Same-host shared memory transport (TCP connection is still used for control) */
+	BOOL IsServerLocal(CLIENT_DATA_BLOCK *block);
+	SHM_RING *CreateSharedRing(char *name, int nslots, size_t slot_bytes);
+	SHM_RING *OpenSharedRing(char *name);
+	int CloseSharedRing(SHM_RING *ring);
+	int SharedRingPublish(SHM_RING *ring, int32_t tag, void *data, size_t length, int *slot, int32_t *sequence);
+	void *SharedRingAccess(SHM_RING *ring, int slot, int32_t sequence, size_t *length);
+	BOOL SharedRingValid(SHM_RING *ring, int slot, int32_t sequence);
 
 void htond_me(double *val);							/* Handle doubles across network (my code) */
 void ntohd_me(double *val);							/* network to host for double */
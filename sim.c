@@ -0,0 +1,1711 @@
+/* Synthetic camera driver ... frames generated in software for load testing */
+/*
+ * Like the rest of ZooCam (camera.c, the dialogs, the ring and event
+ * plumbing) this driver is Win32 only: it uses windows.h threads, events
+ * and critical sections.  It removes the need for camera hardware, not
+ * for Windows, so benchmarks run on any Windows machine without a camera
+ * rather than on a Linux build box.
+ */
+
+/* ------------------------------ */
+/* Feature test macros            */
+/* ------------------------------ */
+#define _POSIX_SOURCE					/* Always require POSIX standard */
+
+#define NEED_WINDOWS_LIBRARY			/* Define to include windows.h call functions */
+
+/* ------------------------------ */
+/* Standard include files         */
+/* ------------------------------ */
+#include <stddef.h>						/* for defining several useful types and macros */
+#include <stdlib.h>						/* for performing a variety of operations */
+#include <stdio.h>
+#include <string.h>						/* for manipulating several kinds of strings */
+#include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>		            /* C99 extension to get known width integers */
+
+/* Extend from POSIX to get I/O and thread functions */
+#undef _POSIX_
+	#include <stdio.h>					/* for performing input and output */
+	#include <process.h>					/* for process control fuctions (e.g. threads, programs) */
+#define _POSIX_
+
+/* Standard Windows libraries */
+#ifdef NEED_WINDOWS_LIBRARY
+	#define STRICT							/* define before including windows.h for stricter type checking */
+	#include <windows.h>					/* master include file for Windows applications */
+#endif
+
+/* ------------------------------ */
+/* Local include files            */
+/* ------------------------------ */
+#include "timer.h"
+#include "win32ex.h"
+#include "camera.h"
+#include "image_proc.h"
+#include "perf.h"
+#include "tl.h"									/* TL_RAW_FILE_HEADER and imageID continuity */
+#define INCLUDE_SIM_DETAIL_INFO
+#include "sim.h"
+
+/* ------------------------------- */
+/* My local typedef's and defines  */
+/* ------------------------------- */
+#ifndef PATH_MAX
+	#define	PATH_MAX	(260)
+#endif
+
+#define	SIM_MODEL				"ZooCam SIM"
+#define	SIM_SERIAL				"SIM00001"
+#define	SIM_TWOPI				(6.283185307179586)
+#define	SIM_PIXEL_UM			(5.0)				/* Nominal pixel size reported for the images */
+#define	SIM_EXPOSE_MIN			(0.010)			/* Exposure range (ms) */
+#define	SIM_EXPOSE_MAX			(1000.0)
+#define	SIM_DB_MAX				(24.0)			/* Master gain range is [0,SIM_DB_MAX] dB */
+#define	SIM_SPIN_S				(0.002)			/* Spin (not Sleep) this close to a frame deadline */
+#define	SIM_FPS_WINDOW			(0.5)				/* Seconds averaged for SIM_GetFPSActual */
+
+/* Values used in the raw file header (enums from the TL SDK) */
+#define	SIM_SENSOR_MONOCHROME	(0)			/* TL_CAMERA_SENSOR_TYPE_MONOCHROME */
+#define	SIM_SENSOR_BAYER			(1)			/* TL_CAMERA_SENSOR_TYPE_BAYER */
+#define	SIM_FILTER_GREEN_RED		(2)			/* TL_COLOR_FILTER_ARRAY_PHASE_BAYER_GREEN_LEFT_OF_RED */
+
+/* ------------------------------- */
+/* My internal function prototypes */
+/* ------------------------------- */
+static void sim_frame_thread(void *arglist);
+static void sim_generate_frame(SIM_CAMERA *sim, double t_frame);
+static void sim_render(SIM_CAMERA *sim, double t_frame, unsigned short *raw);
+static void sim_init_scene(SIM_CAMERA *sim);
+static unsigned int sim_rand(SIM_CAMERA *sim);
+static double sim_uniform(SIM_CAMERA *sim);
+static double sim_frame_period(SIM_CAMERA *sim);
+static BOOL sim_lock_images(SIM_CAMERA *sim, DWORD msWait, int imageID);
+static void sim_unlock_images(SIM_CAMERA *sim, int imageID);
+static BITMAPINFOHEADER *sim_create_dib(SIM_CAMERA *sim, int frame, int *rc);
+
+/* ------------------------------- */
+/* Locally defined global vars     */
+/* ------------------------------- */
+static SIM_CAMERA *sim_camera = NULL;				/* The one synthetic camera (see SIM_FindCamera) */
+
+static SIM_CONFIG sim_default_config = {			/* Initial scene (see SIM_CONFIG) */
+	1280, 1024,											/* width, height */
+	TRUE, 12,											/* bColor, bit_depth */
+	100.0,												/* fps */
+	4, 6.0, 2000.0, 50.0,							/* nspots, sigma, peak, speed */
+	100.0, 8.0,											/* background, noise */
+	0.0, 0.0, 20.0,									/* focus, best_focus, blur_per_mm */
+	1														/* seed */
+};
+
+
+/* ===========================================================================
+-- Return the synthetic camera, creating it (closed) on the first call
+--
+-- Usage: SIM_CAMERA *SIM_FindCamera(void);
+--
+-- Inputs: none
+--
+-- Output: Allocates the structure with the default configuration
+--
+-- Return: pointer to the camera or NULL if memory is unavailable
+=========================================================================== */
+SIM_CAMERA *SIM_FindCamera(void) {
+	static char *rname = "SIM_FindCamera";
+
+	SIM_CAMERA *sim;
+
+	if (sim_camera != NULL) return sim_camera;
+
+	if ( (sim = calloc(1, sizeof(*sim))) == NULL) {
+		fprintf(stderr, "[%s] Unable to allocate the synthetic camera\n", rname); fflush(stderr);
+		return NULL;
+	}
+	sim->magic = SIM_CAMERA_MAGIC;
+	strcpy_s(sim->model,  sizeof(sim->model),  SIM_MODEL);
+	strcpy_s(sim->serial, sizeof(sim->serial), SIM_SERIAL);
+	sim->config = sim_default_config;
+	InitializeCriticalSection(&sim->lock);
+
+	sim->ms_expose = 10.0;
+	sim->dB_gain   = 0.0;
+	sim->red_gain  = sim->green_gain = sim->blue_gain = 1.0;
+	sim->fps_limit = SIM_FPS_MAX;								/* Deal with the full generator rate */
+	sim->trigger.mode = TRIG_SOFTWARE;
+	sim->trigger.frames_per_trigger = 1;
+
+	sim_camera = sim;
+	return sim;
+}
+
+/* ===========================================================================
+-- Query / modify the synthetic scene and frame rate
+--
+-- Usage: int SIM_GetConfig(SIM_CAMERA *sim, SIM_CONFIG *config);
+--        int SIM_SetConfig(SIM_CAMERA *sim, SIM_CONFIG *config);
+--
+-- Inputs: sim    - camera from SIM_FindCamera()
+--         config - new values (set) or structure to receive them (get)
+--
+-- Output: Values are bounded to the supported ranges and take effect with
+--         the next generated frame.  width, height, bColor and bit_depth
+--         only take effect at the next SIM_OpenCamera().
+--
+-- Return: 0 if successful, 1 if sim invalid, 2 if config NULL
+=========================================================================== */
+int SIM_GetConfig(SIM_CAMERA *sim, SIM_CONFIG *config) {
+	static char *rname = "SIM_GetConfig";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+	if (config == NULL) return 2;
+
+	EnterCriticalSection(&sim->lock);
+	*config = sim->config;
+	LeaveCriticalSection(&sim->lock);
+	return 0;
+}
+
+int SIM_SetConfig(SIM_CAMERA *sim, SIM_CONFIG *config) {
+	static char *rname = "SIM_SetConfig";
+
+	SIM_CONFIG new_config;
+	BOOL reseed;
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+	if (config == NULL) return 2;
+
+	/* Bound everything (even sizes keep the Bayer phase intact) */
+	new_config = *config;
+	new_config.width     = max(16, min(8192, new_config.width))  & ~1;
+	new_config.height    = max(16, min(8192, new_config.height)) & ~1;
+	new_config.bColor    = new_config.bColor ? TRUE : FALSE ;
+	new_config.bit_depth = max(8, min(16, new_config.bit_depth));
+	new_config.fps       = max(1.0, min(SIM_FPS_MAX, new_config.fps));
+	new_config.nspots    = max(0, min(SIM_MAX_SPOTS, new_config.nspots));
+	new_config.sigma     = max(0.3, new_config.sigma);
+	new_config.peak      = max(0.0, new_config.peak);
+	new_config.speed     = max(0.0, new_config.speed);
+	new_config.background  = max(0.0, new_config.background);
+	new_config.noise       = max(0.0, new_config.noise);
+	new_config.blur_per_mm = max(0.0, new_config.blur_per_mm);
+
+	/* Frames are generated from sim->width etc., so a new geometry waits for the open */
+	EnterCriticalSection(&sim->lock);
+	reseed = new_config.seed != sim->config.seed;
+	sim->config = new_config;
+	if (sim->bOpen && reseed) sim_init_scene(sim);
+	LeaveCriticalSection(&sim->lock);
+
+	/* New rate applies immediately */
+	if (sim->wake != NULL) SetEvent(sim->wake);
+	return 0;
+}
+
+/* ===========================================================================
+-- Open the synthetic camera, allocate the ring and start the frame generator
+--
+-- Usage: int SIM_OpenCamera(SIM_CAMERA *sim, int nBuf);
+--
+-- Inputs: sim  - camera from SIM_FindCamera()
+--         nBuf - number of buffers in the ring (SIM_MAX_RING_SIZE)
+--
+-- Output: Starts the generator thread (disarmed until a trigger mode is set)
+--
+-- Return: 0 if successful, otherwise
+--           0x8001 ==> sim invalid
+--           0x8002 ==> unable to allocate the frame buffers
+--           0x8003 ==> unable to start the generator thread
+=========================================================================== */
+int SIM_OpenCamera(SIM_CAMERA *sim, int nBuf) {
+	static char *rname = "SIM_OpenCamera";
+
+	int npixels;
+
+	/* Verify that the structure is valid and not already open */
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0x8001;
+	if (sim->bOpen) return 0;
+
+	/* Geometry is fixed from here until the close */
+	EnterCriticalSection(&sim->lock);
+	sim->width         = sim->config.width;
+	sim->height        = sim->config.height;
+	sim->IsSensorColor = sim->config.bColor;
+	sim->bit_depth     = sim->config.bit_depth;
+	sim->pixel_um      = SIM_PIXEL_UM;
+	npixels = sim->width * sim->height;
+	sim->nbytes_raw  = npixels * sizeof(unsigned short);
+	sim->image_bytes = sim->nbytes_raw;
+
+	sim->frame = malloc(sim->nbytes_raw);
+	sim->noise = malloc(SIM_NOISE_TABLE * sizeof(*sim->noise));
+	sim->gx    = malloc(sim->width  * sizeof(*sim->gx));
+	sim->gy    = malloc(sim->height * sizeof(*sim->gy));
+	sim->rgb24 = malloc((sim->IsSensorColor ? 3 : 1) * npixels);
+	if (sim->frame == NULL || sim->noise == NULL || sim->gx == NULL || sim->gy == NULL || sim->rgb24 == NULL) {
+		fprintf(stderr, "[%s] Unable to allocate buffers for %dx%d frames\n", rname, sim->width, sim->height); fflush(stderr);
+		free(sim->frame); free(sim->noise); free(sim->gx); free(sim->gy); free(sim->rgb24);
+		sim->frame = NULL; sim->noise = NULL; sim->gx = sim->gy = NULL; sim->rgb24 = NULL;
+		LeaveCriticalSection(&sim->lock);
+		return 0x8002;
+	}
+	sim_init_scene(sim);
+	sim->rgb24_imageID = -1;
+	LeaveCriticalSection(&sim->lock);
+
+	/* Create and grab semaphore for access to buffers, then build the ring */
+	sim->image_mutex = CreateMutex(NULL, TRUE, NULL);
+	sim->bOpen = TRUE;
+	SIM_SetRingBufferSize(sim, nBuf);
+
+	/* imageIDs come from the sequence shared with the TL cameras (TL_NextImageID) ... nothing generated yet */
+	sim->image_count = TL_NextImageID(FALSE);
+	sim->frames_generated = sim->frames_stored = sim->frames_skipped = sim->frames_missed = sim->frames_late = 0;
+	sim->fps_actual = 0.0;
+
+	/* Generator starts idle until armed */
+	sim->trigger.bArmed = FALSE;
+	sim->pending = 0;
+	sim->timer = HiResTimerCreate();
+	HiResTimerReset(sim->timer, 0.0);
+	sim->t_image = -1.0;
+	sim->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	sim->thread_abort = FALSE;
+	sim->thread_active = TRUE;
+	if (_beginthread(sim_frame_thread, 0, (void *) sim) == -1L) {
+		fprintf(stderr, "[%s] Unable to start the frame generator thread\n", rname); fflush(stderr);
+		sim->thread_active = FALSE;
+		ReleaseMutex(sim->image_mutex);
+		SIM_CloseCamera(sim);
+		return 0x8003;
+	}
+
+	/* And now release the memory */
+	ReleaseMutex(sim->image_mutex);
+	return 0;
+}
+
+/* ===========================================================================
+-- Stop the generator and release the buffers
+--
+-- Usage: int SIM_CloseCamera(SIM_CAMERA *sim);
+--
+-- Inputs: sim - camera from SIM_FindCamera() (may already be closed)
+--
+-- Output: Structure remains valid for a later SIM_OpenCamera()
+--
+-- Return: 0 if successful, otherwise error code
+--           0x01 -> camera is invalid
+--           0x02 -> generator thread did not stop (buffers are kept)
+=========================================================================== */
+int SIM_CloseCamera(SIM_CAMERA *sim) {
+	static char *rname = "SIM_CloseCamera";
+
+	int i;
+
+	/* Verify that the structure is valid and hasn't already been closed */
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+	if (! sim->bOpen) return 0;
+
+	/* Stop the generator (it never sleeps more than 100 ms at a time) */
+	sim->thread_abort = TRUE;
+	for (i=0; i<100 && sim->thread_active; i++) {
+		SetEvent(sim->wake);
+		Sleep(10);
+	}
+	if (sim->thread_active) {
+		fprintf(stderr, "[%s] Frame generator thread failed to exit\n", rname); fflush(stderr);
+		return 0x02;
+	}
+	sim->bOpen = FALSE;
+	sim->trigger.bArmed = FALSE;
+	sim->pending = 0;
+
+	/* Release allocated memory for the images */
+	if (sim->images != NULL) {
+		for (i=0; i<sim->nBuffers; i++) free(sim->images[i].raw);
+		free(sim->images); sim->images = NULL;
+	}
+	sim->nBuffers = sim->nValid = sim->iLast = sim->iShow = 0;
+	if (sim->frame != NULL) { free(sim->frame); sim->frame = NULL; }
+	if (sim->noise != NULL) { free(sim->noise); sim->noise = NULL; }
+	if (sim->gx    != NULL) { free(sim->gx);    sim->gx    = NULL; }
+	if (sim->gy    != NULL) { free(sim->gy);    sim->gy    = NULL; }
+	if (sim->rgb24 != NULL) { free(sim->rgb24); sim->rgb24 = NULL; }
+
+	/* Release semaphores and the clock */
+	CloseHandle(sim->image_mutex); sim->image_mutex = NULL;
+	CloseHandle(sim->wake);        sim->wake = NULL;
+	HiResTimerDestroy(sim->timer); sim->timer = NULL;
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Test if the camera pointer is the synthetic camera and it is open
+--
+-- Usage: BOOL SIM_IsValidCamera(SIM_CAMERA *sim);
+--
+-- Return: TRUE if pointer is valid and the generator is running
+=========================================================================== */
+BOOL SIM_IsValidCamera(SIM_CAMERA *sim) {
+	return sim != NULL && sim->magic == SIM_CAMERA_MAGIC && sim->bOpen;
+}
+
+/* ===========================================================================
+-- One past the newest imageID generated
+--
+-- Usage: int SIM_GetImageCount(SIM_CAMERA *sim);
+--
+-- Return: -1 if sim is not valid, otherwise one more than the imageID of
+--         the last frame generated (including any skipped or missed by the
+--         ring), or the common next imageID at open if none
+=========================================================================== */
+int SIM_GetImageCount(SIM_CAMERA *sim) {
+	if (! SIM_IsValidCamera(sim)) return -1;
+	return sim->image_count;
+}
+
+/* ===========================================================================
+-- Get information about the camera
+--
+-- Usage: int SIM_GetCameraInfo(SIM_CAMERA *sim, CAMERA_INFO *info);
+--
+-- Inputs: sim  - pointer to camera structure
+--         info - pointer to structure to receive camera information
+--
+-- Output: *info (if not NULL)
+--
+-- Return: 0 if successful, 1 if no camera open
+=========================================================================== */
+int SIM_GetCameraInfo(SIM_CAMERA *sim, CAMERA_INFO *info) {
+	static char *rname = "SIM_GetCameraInfo";
+
+	if (info != NULL) { memset(info, 0, sizeof(*info)); info->type = CAMERA_SIM; }
+	if (! SIM_IsValidCamera(sim)) return 1;
+	if (info == NULL) return 0;
+
+	strcpy_m(info->name,				sizeof(info->name),			 "Synthetic");
+	strcpy_m(info->model,			sizeof(info->model),			 sim->model);
+	strcpy_m(info->serial,			sizeof(info->serial),		 sim->serial);
+	strcpy_m(info->manufacturer,	sizeof(info->manufacturer), "ZooCam");
+	strcpy_m(info->version,			sizeof(info->version),		 "1.0");
+	strcpy_m(info->date,				sizeof(info->date),			 __DATE__);
+
+	info->x_pixel_um = sim->pixel_um;
+	info->y_pixel_um = sim->pixel_um;
+	info->bColor     = sim->IsSensorColor;
+	info->height     = sim->height;
+	info->width      = sim->width;
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Report the binning (synthetic frames are never binned)
+--
+-- Usage: int SIM_GetBinning(SIM_CAMERA *sim, BINNING_INFO *info);
+--
+-- Return: 0 if successful, 1 if no camera open
+=========================================================================== */
+int SIM_GetBinning(SIM_CAMERA *sim, BINNING_INFO *info) {
+	static char *rname = "SIM_GetBinning";
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (! SIM_IsValidCamera(sim)) return 1;
+	if (info == NULL) return 0;
+
+	info->bin = info->hardware = info->software = info->max_hardware = 1;
+	info->width      = sim->width;
+	info->height     = sim->height;
+	info->x_pixel_um = sim->pixel_um;
+	info->y_pixel_um = sim->pixel_um;
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Allocate (or deallocate) ring buffer for images
+--
+-- Usage: int SIM_SetRingBufferSize(SIM_CAMERA *sim, int nBuf);
+--
+-- Inputs: sim  - an opened synthetic camera
+--         nBuf - number of buffers to allocate in the ring (SIM_MAX_RING_SIZE)
+--
+-- Output: Stops generation for a moment, changes buffers, and restarts
+--
+-- Return: Number of buffers or 0 on fatal errors
+=========================================================================== */
+int SIM_SetRingBufferSize(SIM_CAMERA *sim, int nBuf) {
+	static char *rname = "SIM_SetRingBufferSize";
+
+	int i;
+
+	if (! SIM_IsValidCamera(sim)) return 0;
+
+	if (WAIT_OBJECT_0 != WaitForSingleObject(sim->image_mutex, 5*SIM_IMAGE_ACCESS_TIMEOUT)) {
+		Perf_Count(PERF_MUTEX_TIMEOUTS, 1);
+		fprintf(stderr, "[%s] Unable to get image memory semaphore to modify ring buffer structures\n", rname); fflush(stderr);
+		return 0;
+	}
+
+	nBuf = max(1, min(SIM_MAX_RING_SIZE, nBuf));
+	if (nBuf < sim->nBuffers) {
+		for (i=nBuf; i<sim->nBuffers; i++) free(sim->images[i].raw);
+
+	} else if (nBuf > sim->nBuffers) {
+		sim->images = realloc(sim->images, nBuf*sizeof(*sim->images));
+		memset(sim->images+sim->nBuffers, 0, (nBuf-sim->nBuffers)*sizeof(*sim->images));
+		for (i=sim->nBuffers; i<nBuf; i++) {
+			sim->images[i].index = i;
+			if ( (sim->images[i].raw = malloc(sim->nbytes_raw)) == NULL) {
+				fprintf(stderr, "[%s] Only able to increase buffer size to %d\n", rname, i); fflush(stderr);
+				nBuf = i;
+				break;
+			}
+		}
+	}
+	sim->nBuffers = nBuf;
+	sim->nValid = sim->iLast = sim->iShow = 0;
+
+	ReleaseMutex(sim->image_mutex);
+	return sim->nBuffers;
+}
+
+/* ===========================================================================
+-- Reset the ring buffer counters so the next image will be in location 0
+--
+-- Usage: int SIM_ResetRingCounters(SIM_CAMERA *sim);
+--
+-- Return: 0 on success, 1 if sim invalid
+=========================================================================== */
+int SIM_ResetRingCounters(SIM_CAMERA *sim) {
+	static char *rname = "SIM_ResetRingCounters";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	sim->nValid = sim->iLast = sim->iShow = 0;
+	return 0;
+}
+
+/* ===========================================================================
+-- Query the current ring buffer values
+--
+-- Usage: int SIM_GetRingInfo(SIM_CAMERA *sim, int *nBuffers, int *nValid, int *iLast, int *iShow);
+--
+-- Output: For all parameter !NULL, copies appropriate value from internals
+--
+-- Return: 0 if successful, 1 if sim invalid
+=========================================================================== */
+int SIM_GetRingInfo(SIM_CAMERA *sim, int *nBuffers, int *nValid, int *iLast, int *iShow) {
+	static char *rname = "SIM_GetRingInfo";
+	BOOL valid;
+
+	valid = SIM_IsValidCamera(sim);
+
+	if (nBuffers != NULL) *nBuffers = valid ? sim->nBuffers : 1 ;
+	if (nValid   != NULL) *nValid   = valid ? sim->nValid   : 0 ;
+	if (iLast    != NULL) *iLast    = valid ? sim->iLast    : 0 ;
+	if (iShow    != NULL) *iShow    = valid ? sim->iShow    : 0 ;
+
+	return valid ? 0 : 1 ;
+}
+
+/* ===========================================================================
+-- Request / remove a signal when a new image is stored in the ring
+--
+-- Usage: int SIM_AddImageSignal(SIM_CAMERA *sim, HANDLE signal);
+--        int SIM_RemoveImageSignal(SIM_CAMERA *sim, HANDLE signal);
+--
+-- Inputs: sim    - the synthetic camera
+--         signal - event semaphore pulsed via SetEvent() for every stored frame
+--
+-- Return: 0 if successful, 1 if sim invalid, 2 if no space (add) or
+--         signal not in the list (remove)
+=========================================================================== */
+int SIM_AddImageSignal(SIM_CAMERA *sim, HANDLE signal) {
+	static char *rname = "SIM_AddImageSignal";
+
+	int i;
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	for (i=0; i<SIM_MAX_SIGNALS; i++) {
+		if (sim->new_image_signals[i] == NULL) {
+			sim->new_image_signals[i] = signal;
+			return 0;
+		}
+	}
+	return 2;
+}
+
+int SIM_RemoveImageSignal(SIM_CAMERA *sim, HANDLE signal) {
+	static char *rname = "SIM_RemoveImageSignal";
+
+	int i;
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	for (i=0; i<SIM_MAX_SIGNALS; i++) {
+		if (sim->new_image_signals[i] == signal) {
+			sim->new_image_signals[i] = NULL;
+			return 0;
+		}
+	}
+	return 2;
+}
+
+/* ===========================================================================
+-- Frame generator thread
+--
+-- Usage: _beginthread(sim_frame_thread, 0, (void *) sim);
+--
+-- Inputs: arglist - the SIM_CAMERA being opened
+--
+-- Output: Generates frames on a fixed schedule while armed and owed frames
+--
+-- Notes: Frames are due every max(1/fps, exposure).  Windows Sleep() is only
+--        good to a scheduler tick, so the thread sleeps until SIM_SPIN_S
+--        before the deadline and yields (Sleep(0)) the rest of the way.  At
+--        rates over ~500 fps this keeps one core busy, which is the point of
+--        a load test.  When the pipeline holds the generator up by more than
+--        a full period the schedule restarts from now (frames_late) rather
+--        than bursting to catch up.
+=========================================================================== */
+static void sim_frame_thread(void *arglist) {
+	static char *rname = "sim_frame_thread";
+
+	SIM_CAMERA *sim;
+	double t_now, t_next, period, t_window;
+	long n_window;
+
+	sim = (SIM_CAMERA *) arglist;
+	Perf_TraceThreadName(rname);
+
+	t_next = t_window = HiResTimerDelta(sim->timer);
+	n_window = sim->frames_generated;
+
+	while (! sim->thread_abort) {
+
+		/* Idle until armed and owed frames */
+		if (! sim->trigger.bArmed || sim->pending == 0) {
+			WaitForSingleObject(sim->wake, 100);
+			t_next = HiResTimerDelta(sim->timer);
+			if (t_next-t_window > SIM_FPS_WINDOW) { sim->fps_actual = 0.0; t_window = t_next; n_window = sim->frames_generated; }
+			continue;
+		}
+
+		/* Wait for the deadline */
+		period = sim_frame_period(sim);
+		t_now = HiResTimerDelta(sim->timer);
+		if (t_now < t_next) {
+			if (t_next-t_now > SIM_SPIN_S) {
+				WaitForSingleObject(sim->wake, (DWORD) (1000.0*(t_next-t_now-SIM_SPIN_S)));
+			} else {
+				Sleep(0);
+			}
+			continue;
+		}
+		if (t_now-t_next > period) {
+			sim->frames_late++;
+			t_next = t_now;
+		}
+
+		/* Generate and account for the frame */
+		sim_generate_frame(sim, t_next);
+		t_next += period;
+
+		EnterCriticalSection(&sim->lock);
+		if (sim->pending > 0) sim->pending--;
+		LeaveCriticalSection(&sim->lock);
+
+		/* Windowed rate for SIM_GetFPSActual */
+		if (t_now-t_window >= SIM_FPS_WINDOW) {
+			sim->fps_actual = (sim->frames_generated-n_window) / (t_now-t_window);
+			t_window = t_now;
+			n_window = sim->frames_generated;
+		}
+	}
+
+	sim->thread_active = FALSE;
+	return;
+}
+
+/* Frame period (seconds) ... exposure longer than 1/fps slows the rate */
+static double sim_frame_period(SIM_CAMERA *sim) {
+	return max(1.0/sim->config.fps, 0.001*sim->ms_expose);
+}
+
+/* ===========================================================================
+-- Generate one frame and commit it to the ring
+--
+-- Usage: static void sim_generate_frame(SIM_CAMERA *sim, double t_frame);
+--
+-- Inputs: sim     - open camera
+--         t_frame - scheduled time of the frame (s since open)
+--
+-- Output: Same path and accounting as the TL frame callback (perf counters,
+--         trace spans, fps_limit, ring slot choice and signals).  The frame
+--         is rendered before image_mutex is taken so the copy is all that
+--         competes with readers.
+=========================================================================== */
+static void sim_generate_frame(SIM_CAMERA *sim, double t_frame) {
+	static char *rname = "sim_generate_frame";
+
+	int i, ibuf, imageID;
+	LONGLONG t_entry, t_commit;
+	double focus, ms_expose, dB_gain;
+
+	t_entry = Perf_Start();
+
+	imageID = TL_NextImageID(TRUE);
+	sim->image_count = imageID+1;
+	sim->frames_generated++;
+	Perf_Count(PERF_FRAMES_RECEIVED, 1);
+	Perf_TraceBegin("SIM frame", imageID);
+
+	/* Are we "suspended" from processing images */
+	if (sim->suspend_image_processing) { sim->frames_skipped++; Perf_TraceEnd("SIM frame", imageID); return; }
+
+	/* And are images coming faster than we want to handle? */
+	if (t_frame-sim->t_image < 1.0/sim->fps_limit) {
+		sim->frames_skipped++;
+		Perf_Count(PERF_FRAMES_LIMITED, 1);
+		Perf_TraceEnd("SIM frame", imageID);
+		return;
+	}
+	sim->t_image = t_frame;
+
+	/* Render outside the image mutex, tagged with the values it was rendered with */
+	EnterCriticalSection(&sim->lock);
+	sim_render(sim, t_frame, sim->frame);
+	focus     = sim->config.focus;
+	ms_expose = sim->ms_expose;
+	dB_gain   = sim->dB_gain;
+	LeaveCriticalSection(&sim->lock);
+
+	if (sim_lock_images(sim, SIM_IMAGE_ACCESS_TIMEOUT, imageID)) {
+		t_commit = Perf_Start();
+
+		/* Put into the next available position */
+		ibuf = (sim->nValid == 0) ? 0 : (sim->iLast+1) % sim->nBuffers;
+		while (sim->images[ibuf].locks != 0) {
+			if (ibuf == sim->iLast) break;
+			sim->nValid = max(sim->nValid, ibuf+1);
+			ibuf = (ibuf+1) % sim->nBuffers;
+		}
+
+		/* Same slot protocol as the TL ring (tl.c set_image_size_and_buffers) */
+		sim->images[ibuf].imageID = -1;
+		MemoryBarrier();
+
+		GetLocalTime(&sim->images[ibuf].system_time);
+		sim->images[ibuf].timestamp   = _time64(NULL);
+		sim->images[ibuf].camera_time = t_frame;
+		memcpy(sim->images[ibuf].raw, sim->frame, sim->nbytes_raw);
+		sim->images[ibuf].dB_gain   = dB_gain;
+		sim->images[ibuf].ms_expose = ms_expose;
+		sim->images[ibuf].focus     = focus;
+		sim->images[ibuf].valid = TRUE;
+
+		MemoryBarrier();
+		sim->images[ibuf].imageID = imageID;
+		sim->iLast = ibuf;
+		sim->nValid = max(sim->nValid, ibuf+1);
+		sim->frames_stored++;
+
+		sim_unlock_images(sim, imageID);
+		Perf_Stop(PERF_RING_COMMIT, t_commit);
+
+		for (i=0; i<SIM_MAX_SIGNALS; i++) {
+			if (sim->new_image_signals[i] != NULL) SetEvent(sim->new_image_signals[i]);
+		}
+	} else {
+		sim->frames_missed++;
+	}
+
+	Perf_TraceEnd("SIM frame", imageID);
+	Perf_Stop(PERF_CALLBACK, t_entry);
+	return;
+}
+
+/* ===========================================================================
+-- Render the scene at a given time into a raw frame
+--
+-- Usage: static void sim_render(SIM_CAMERA *sim, double t_frame, unsigned short *raw);
+--
+-- Inputs: sim     - open camera (caller holds sim->lock)
+--         t_frame - time of the frame (positions the spots)
+--         raw     - width x height buffer to fill
+--
+-- Output: background + read noise, plus Gaussian spots moving on Lissajous
+--         paths.  Defocus widens each spot in quadrature, sigma_eff^2 =
+--         sigma^2 + (blur_per_mm*|focus-best_focus|)^2, conserving its
+--         integrated signal.  Signal scales with exposure (peak is for
+--         10 ms) and master gain; noise with master gain only.  The same
+--         white light reaches every Bayer site; RGB gains are applied in
+--         SIM_ProcessRGB as the TL color processor does.
+=========================================================================== */
+static void sim_render(SIM_CAMERA *sim, double t_frame, unsigned short *raw) {
+
+	SIM_CONFIG *cfg;
+	SIM_SPOT *spot;
+	int i, row, col, x0, x1, y0, y1, width, height, vmax, irand, v;
+	double gain, sigma_eff, defocus, amp, x, y, r, sn;
+	float *noise, *gx, *gy;
+	unsigned short *aptr;
+
+	cfg = &sim->config;
+	width = sim->width; height = sim->height;
+	vmax = (1 << sim->bit_depth) - 1;
+	gain = pow(10.0, sim->dB_gain/20.0);
+	noise = sim->noise; gx = sim->gx; gy = sim->gy;
+
+	/* Background and read noise (new table offset each row breaks up the repeat) */
+	sn = cfg->noise * gain;
+	for (row=0; row<height; row++) {
+		aptr = raw + row*width;
+		irand = sim_rand(sim);
+		for (col=0; col<width; col++) {
+			v = (int) (cfg->background + sn*noise[(irand+col) & (SIM_NOISE_TABLE-1)] + 0.5);
+			aptr[col] = (unsigned short) max(0, min(vmax, v));
+		}
+	}
+
+	/* Spots ... separable profiles, drawn only to 4 sigma */
+	defocus   = cfg->blur_per_mm * fabs(cfg->focus - cfg->best_focus);
+	sigma_eff = sqrt(cfg->sigma*cfg->sigma + defocus*defocus);
+	amp = cfg->peak * (sim->ms_expose/10.0) * gain * (cfg->sigma*cfg->sigma)/(sigma_eff*sigma_eff);
+	r = 4.0*sigma_eff;
+	for (i=0; i<cfg->nspots; i++) {
+		spot = sim->spots+i;
+		x = spot->x0 + spot->ax*sin(spot->wx*cfg->speed*t_frame + spot->phase);
+		y = spot->y0 + spot->ay*sin(spot->wy*cfg->speed*t_frame + 1.7*spot->phase);
+		x0 = max(0, (int) floor(x-r)); x1 = min(width-1,  (int) ceil(x+r));
+		y0 = max(0, (int) floor(y-r)); y1 = min(height-1, (int) ceil(y+r));
+		if (x0 > x1 || y0 > y1) continue;
+
+		for (col=x0; col<=x1; col++) gx[col] = (float) exp(-(col-x)*(col-x)/(2*sigma_eff*sigma_eff));
+		for (row=y0; row<=y1; row++) gy[row] = (float) (amp*spot->weight*exp(-(row-y)*(row-y)/(2*sigma_eff*sigma_eff)));
+		for (row=y0; row<=y1; row++) {
+			aptr = raw + row*width;
+			for (col=x0; col<=x1; col++) {
+				v = aptr[col] + (int) (gy[row]*gx[col] + 0.5);
+				aptr[col] = (unsigned short) min(vmax, v);
+			}
+		}
+	}
+	return;
+}
+
+/* ===========================================================================
+-- Build the noise table and spot paths from the seed
+--
+-- Usage: static void sim_init_scene(SIM_CAMERA *sim);
+--
+-- Notes: Caller holds sim->lock and the buffers exist.  Motion angular rates
+--        are in radians per pixel travelled so that speed is the rough
+--        spot velocity in pixels per second.
+=========================================================================== */
+static void sim_init_scene(SIM_CAMERA *sim) {
+
+	int i;
+	double u1, u2, w, h;
+	SIM_SPOT *spot;
+
+	sim->rand_state = (unsigned int) sim->config.seed;
+
+	/* Box-Muller pairs */
+	for (i=0; i<SIM_NOISE_TABLE; i+=2) {
+		u1 = max(1E-12, sim_uniform(sim));
+		u2 = sim_uniform(sim);
+		sim->noise[i]   = (float) (sqrt(-2.0*log(u1))*cos(SIM_TWOPI*u2));
+		sim->noise[i+1] = (float) (sqrt(-2.0*log(u1))*sin(SIM_TWOPI*u2));
+	}
+
+	w = sim->width; h = sim->height;
+	for (i=0; i<SIM_MAX_SPOTS; i++) {
+		spot = sim->spots+i;
+		spot->x0 = w*(0.3+0.4*sim_uniform(sim));
+		spot->y0 = h*(0.3+0.4*sim_uniform(sim));
+		spot->ax = w*(0.05+0.20*sim_uniform(sim));
+		spot->ay = h*(0.05+0.20*sim_uniform(sim));
+		spot->wx = (0.5+sim_uniform(sim)) / spot->ax;
+		spot->wy = (0.5+sim_uniform(sim)) / spot->ay;
+		spot->phase  = SIM_TWOPI*sim_uniform(sim);
+		spot->weight = 0.5+0.5*sim_uniform(sim);
+	}
+	return;
+}
+
+/* Linear congruential generator (Numerical Recipes constants) */
+static unsigned int sim_rand(SIM_CAMERA *sim) {
+	sim->rand_state = 1664525u*sim->rand_state + 1013904223u;
+	return sim->rand_state >> 8;
+}
+
+/* Uniform on [0,1) */
+static double sim_uniform(SIM_CAMERA *sim) {
+	return (sim_rand(sim) & 0xFFFFFF) / 16777216.0;
+}
+
+/* ===========================================================================
+-- Take and release sim->image_mutex for the frame paths
+--
+-- Usage: static BOOL sim_lock_images(SIM_CAMERA *sim, DWORD msWait, int imageID);
+--        static void sim_unlock_images(SIM_CAMERA *sim, int imageID);
+--
+-- Notes: Same trace spans and timeout accounting as the TL driver
+=========================================================================== */
+static BOOL sim_lock_images(SIM_CAMERA *sim, DWORD msWait, int imageID) {
+	BOOL rc;
+
+	Perf_TraceBegin("image_mutex wait", imageID);
+	rc = (WAIT_OBJECT_0 == WaitForSingleObject(sim->image_mutex, msWait));
+	Perf_TraceEnd("image_mutex wait", imageID);
+
+	if (rc) {
+		Perf_TraceBegin("image_mutex held", imageID);
+	} else {
+		Perf_Count(PERF_MUTEX_TIMEOUTS, 1);
+		Perf_TraceInstant("image_mutex timeout", imageID);
+	}
+	return rc;
+}
+
+static void sim_unlock_images(SIM_CAMERA *sim, int imageID) {
+	ReleaseMutex(sim->image_mutex);
+	Perf_TraceEnd("image_mutex held", imageID);
+	return;
+}
+
+/* ===========================================================================
+-- Convert a raw frame to 8-bit display data in sim->rgb24
+--
+-- Usage: int SIM_ProcessRGB(SIM_CAMERA *sim, int frame);
+--
+-- Inputs: sim   - an opened synthetic camera
+--         frame - frame to process from buffers (-1 ==> for most recent)
+--
+-- Output: Color: BGR24 from 2x2 (G R / B G) blocks with the RGB gains applied
+--         Mono:  MONO8 (one byte per pixel)
+--
+-- Return: 0 if successful.
+--            1 => not valid camera
+--	           2 => no image yet valid in the camera structure
+--            5 => unable to get the semaphore for image data access
+=========================================================================== */
+int SIM_ProcessRGB(SIM_CAMERA *sim, int frame) {
+	static char *rname = "SIM_ProcessRGB";
+
+	int row, col, shift, width, r, g, b;
+	unsigned short *raw;
+	unsigned char *bgr;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+
+	if (frame < 0) frame = sim->iLast;
+	if (frame >= sim->nValid || ! sim->images[frame].valid) return 2;
+
+	/* Once done for a raw image, don't ever need to repeat */
+	if (sim->rgb24_imageID == sim->images[frame].imageID) return 0;
+
+	if (! sim_lock_images(sim, SIM_IMAGE_ACCESS_TIMEOUT, sim->images[frame].imageID)) return 5;
+
+	raw = sim->images[frame].raw;
+	width = sim->width;
+	shift = sim->bit_depth - 8;
+	if (! sim->IsSensorColor) {
+		for (row=0; row<width*sim->height; row++) sim->rgb24[row] = (unsigned char) (raw[row] >> shift);
+	} else {
+		for (row=0; row<sim->height; row+=2) {
+			for (col=0; col<width; col+=2) {
+				g = (int) (sim->green_gain * ((raw[row*width+col] + raw[(row+1)*width+col+1]) >> (shift+1)));
+				r = (int) (sim->red_gain   *  (raw[row*width+col+1] >> shift));
+				b = (int) (sim->blue_gain  *  (raw[(row+1)*width+col] >> shift));
+				r = min(255, r); g = min(255, g); b = min(255, b);
+
+				bgr = sim->rgb24 + 3*(row*width+col);
+				bgr[0] = bgr[3] = (unsigned char) b;
+				bgr[1] = bgr[4] = (unsigned char) g;
+				bgr[2] = bgr[5] = (unsigned char) r;
+				bgr += 3*width;
+				bgr[0] = bgr[3] = (unsigned char) b;
+				bgr[1] = bgr[4] = (unsigned char) g;
+				bgr[2] = bgr[5] = (unsigned char) r;
+			}
+		}
+	}
+	sim->rgb24_imageID = sim->images[frame].imageID;
+	sim_unlock_images(sim, sim->rgb24_imageID);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Convert a frame to a bottom-up 24-bit device independent bitmap
+--
+-- Usage: static BITMAPINFOHEADER *sim_create_dib(SIM_CAMERA *sim, int frame, int *rc);
+--
+-- Output: *rc (if !NULL) - 0 or error from SIM_ProcessRGB, 4 if no memory
+--
+-- Return: pointer to bitmap (caller frees) or NULL on any error
+=========================================================================== */
+static BITMAPINFOHEADER *sim_create_dib(SIM_CAMERA *sim, int frame, int *rc) {
+
+	BITMAPINFOHEADER *bmih;
+	unsigned char *data, *src;
+	int irow, icol, my_rc;
+
+	if (rc == NULL) rc = &my_rc;
+	if ( (*rc = SIM_ProcessRGB(sim, frame)) != 0) return NULL;
+
+	if ( (bmih = calloc(1, sizeof(*bmih)+3*sim->width*sim->height)) == NULL) { *rc = 4; return NULL; }
+	bmih->biSize          = sizeof(*bmih);
+	bmih->biWidth         = sim->width;
+	bmih->biHeight        = sim->height;
+	bmih->biPlanes        = 1;
+	bmih->biBitCount      = 24;
+	bmih->biCompression   = BI_RGB;
+	bmih->biSizeImage     = 3*sim->width*sim->height;
+	bmih->biXPelsPerMeter = 3780;
+	bmih->biYPelsPerMeter = 3780;
+
+	if (! sim_lock_images(sim, SIM_IMAGE_ACCESS_TIMEOUT, sim->rgb24_imageID)) {
+		free(bmih);
+		*rc = 5;
+		return NULL;
+	}
+	data = ((unsigned char *) bmih) + sizeof(*bmih);
+	for (irow=0; irow<sim->height; irow++) {
+		if (sim->IsSensorColor) {
+			memcpy(data + 3*irow*sim->width, sim->rgb24 + 3*(sim->height-1-irow)*sim->width, 3*sim->width);
+		} else {
+			src = sim->rgb24 + (sim->height-1-irow)*sim->width;
+			for (icol=0; icol<sim->width; icol++) data[3*(irow*sim->width+icol)+0] = data[3*(irow*sim->width+icol)+1] = data[3*(irow*sim->width+icol)+2] = src[icol];
+		}
+	}
+	sim_unlock_images(sim, sim->rgb24_imageID);
+
+	*rc = 0;
+	return bmih;
+}
+
+/* ===========================================================================
+-- Get information about a specific image
+--
+-- Usage: int SIM_GetImageInfo(SIM_CAMERA *sim, int frame, IMAGE_INFO *info);
+--
+-- Inputs: sim   - an opened synthetic camera
+--         frame - index of frame to image (-1 = current)
+--         info  - pointer to structure to receive image information
+--
+-- Return: 0 if successful, 1 => no camera open, 2 => frame invalid
+=========================================================================== */
+int SIM_GetImageInfo(SIM_CAMERA *sim, int frame, IMAGE_INFO *info) {
+	static char *rname = "SIM_GetImageInfo";
+
+	SIM_IMAGE *image;
+	int imageID;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+
+	if (frame == -1) frame = sim->iLast;
+	if (frame < 0 || frame >= sim->nValid) return 2;
+	if (info == NULL) return 0;
+	memset(info, 0, sizeof(*info));
+
+	image = &sim->images[frame];
+	image->locks++;
+	imageID = image->imageID;
+	MemoryBarrier();
+
+	info->type         = CAMERA_SIM;
+	info->frame        = frame;
+	info->timestamp    = image->timestamp;
+	info->camera_time  = image->camera_time;
+	info->width        = sim->width;
+	info->height       = sim->height;
+	info->memory_pitch = 2*sim->width;
+	info->bin          = 1;
+	info->x_pixel_um   = sim->pixel_um;
+	info->y_pixel_um   = sim->pixel_um;
+	info->exposure     = image->ms_expose;
+	info->gamma        = 1.0;
+	info->master_gain  = image->dB_gain;
+	info->red_gain     = sim->red_gain;
+	info->green_gain   = sim->green_gain;
+	info->blue_gain    = sim->blue_gain;
+	info->color_correct_mode     = 0;
+	info->color_correct_strength = 1.0;
+
+	MemoryBarrier();
+	info->imageID = (image->imageID == imageID) ? imageID : -1;
+
+	image->locks--;
+	return 0;
+}
+
+/* ===========================================================================
+-- Get pointer to raw data for a specific image, and length of that data
+--
+-- Usage: int SIM_GetImageData(SIM_CAMERA *sim, int frame, void **image_data, size_t *length);
+--
+-- Output: *image_data - a pointer (UNSIGNED SHORT *) to actual data (shared)
+--         *length     - number of bytes in the memory buffer
+--
+-- Return: 0 if successful, 1 => no camera open, 2 => frame invalid
+=========================================================================== */
+int SIM_GetImageData(SIM_CAMERA *sim, int frame, void **image_data, size_t *length) {
+	static char *rname = "SIM_GetImageData";
+
+	if (image_data != NULL) *image_data = NULL;
+	if (length     != NULL) *length = 0;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+
+	if (frame == -1) frame = sim->iLast;
+	if (frame < 0 || frame >= sim->nValid) return 2;
+
+	if (image_data != NULL) *image_data = (void *) sim->images[frame].raw;
+	if (length     != NULL) *length = sim->image_bytes;
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Describe the pixel layout of a specific image for the generic kernels
+--
+-- Usage: int SIM_GetImageBuffer(SIM_CAMERA *sim, int frame, IMAGE_BUFFER *buffer);
+--
+-- Output: *buffer - PIXEL_BAYER16 or PIXEL_MONO16 pointing at the ring (shared)
+--
+-- Return: 0 if successful, 1 => no camera open, 2 => frame invalid
+=========================================================================== */
+int SIM_GetImageBuffer(SIM_CAMERA *sim, int frame, IMAGE_BUFFER *buffer) {
+	static char *rname = "SIM_GetImageBuffer";
+
+	if (buffer != NULL) memset(buffer, 0, sizeof(*buffer));
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+
+	if (frame == -1) frame = sim->iLast;
+	if (frame < 0 || frame >= sim->nValid) return 2;
+	if (buffer == NULL) return 0;
+
+	buffer->format    = sim->IsSensorColor ? PIXEL_BAYER16 : PIXEL_MONO16 ;
+	buffer->width     = sim->width;
+	buffer->height    = sim->height;
+	buffer->pitch     = sim->width * sizeof(unsigned short);
+	buffer->bit_depth = sim->bit_depth;
+	buffer->data      = (void *) sim->images[frame].raw;
+	buffer->cfa_phase = CFA_GREEN_LEFT_OF_RED;					/* Rendered G R / B G */
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Determine formats that camera supports for writing
+--
+-- Usage: int SIM_GetSaveFormatFlag(SIM_CAMERA *sim);
+--
+-- Return: FL_BMP | FL_RAW
+=========================================================================== */
+int SIM_GetSaveFormatFlag(SIM_CAMERA *sim) {
+	static char *rname = "SIM_GetSaveFormatFlag";
+
+	return FL_BMP | FL_RAW ;
+}
+
+/* ===========================================================================
+-- Save a frame as a bitmap (.bmp) or TL compatible raw (.raw) file
+--
+-- Usage: int SIM_SaveImage(SIM_CAMERA *sim, char *path, int frame, FILE_FORMAT format);
+--        int SIM_SaveBMPImage(SIM_CAMERA *sim, char *path, int frame);
+--        int SIM_SaveRawImage(SIM_CAMERA *sim, char *path, int frame);
+--
+-- Inputs: sim    - an opened synthetic camera
+--         path   - name of the file (required ... no dialog)
+--         frame  - frame to save (-1 ==> for most recent)
+--         format - FILE_RAW or FILE_BMP (default)
+--
+-- Output: Raw files use TL_RAW_FILE_HEADER so existing readers work
+--
+-- Return: 0 if successful, otherwise an error code
+--           1 ==> camera pointer not valid
+--           2 ==> path invalid or frame invalid
+--           5 ==> file failed to open
+=========================================================================== */
+int SIM_SaveImage(SIM_CAMERA *sim, char *path, int frame, FILE_FORMAT format) {
+	static char *rname = "SIM_SaveImage";
+
+	if (path == NULL || *path == '\0') return 2;
+
+	return (format == FILE_RAW) ? SIM_SaveRawImage(sim, path, frame) : SIM_SaveBMPImage(sim, path, frame) ;
+}
+
+int SIM_SaveBMPImage(SIM_CAMERA *sim, char *path, int frame) {
+	static char *rname = "SIM_SaveBMPImage";
+
+	BITMAPINFOHEADER *bmih;
+	BITMAPFILEHEADER  bmfh;
+	int rc, isize;
+	FILE *funit;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+	if ( (bmih = sim_create_dib(sim, frame, &rc)) == NULL) return rc;
+	isize = sizeof(*bmih)+3*sim->width*sim->height;
+
+	memset(&bmfh, 0, sizeof(bmfh));
+	bmfh.bfType = 19778;
+	bmfh.bfSize = sizeof(bmfh)+isize;
+	bmfh.bfOffBits = sizeof(bmfh)+sizeof(*bmih);
+
+	if ( (fopen_s(&funit, path, "wb")) != 0) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		rc = 5;
+	} else {
+		fwrite(&bmfh, 1, sizeof(bmfh), funit);
+		fwrite(bmih, 1, isize, funit);
+		fclose(funit);
+		rc = 0;
+	}
+
+	free(bmih);
+	return rc;
+}
+
+int SIM_SaveRawImage(SIM_CAMERA *sim, char *path, int frame) {
+	static char *rname = "SIM_SaveRawImage";
+
+	FILE *funit;
+	TL_RAW_FILE_HEADER header;
+	SIM_IMAGE *image;
+	int dummy_zeros = 0;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+	if (frame < 0) frame = sim->iLast;
+	if (frame >= sim->nValid) return 2;
+	image = sim->images+frame;
+
+	memset(&header, 0, sizeof(header));
+	header.magic  = TL_RAW_FILE_MAGIC;
+	header.header_size = sizeof(TL_RAW_FILE_HEADER);
+	header.major_version = 1;		header.minor_version = 0;
+
+	header.ms_expose = image->ms_expose;
+	header.dB_gain   = image->dB_gain;
+
+	header.timestamp = image->timestamp;
+	header.camera_time = image->camera_time;
+	header.year = image->system_time.wYear; header.month = image->system_time.wMonth;	header.day = image->system_time.wDay;
+	header.hour = image->system_time.wHour; header.min   = image->system_time.wMinute;	header.sec = image->system_time.wSecond;
+	header.ms   = image->system_time.wMilliseconds;
+
+	strcpy_s(header.camera_model,  sizeof(header.camera_model),  sim->model);
+	strcpy_s(header.camera_serial, sizeof(header.camera_serial), sim->serial);
+	header.sensor_type  = sim->IsSensorColor ? SIM_SENSOR_BAYER : SIM_SENSOR_MONOCHROME ;
+	header.color_filter = SIM_FILTER_GREEN_RED;
+
+	header.width		  = sim->width;				header.height		  = sim->height;
+	header.bit_depth    = sim->bit_depth;
+	header.pixel_bytes  = sizeof(unsigned short);	header.image_bytes  = (int) sim->image_bytes;
+	header.pixel_width  = sim->pixel_um;			header.pixel_height = sim->pixel_um;
+
+	if ( (fopen_s(&funit, path, "wb")) != 0) {
+		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
+		return 5;
+	}
+
+	fwrite(&header, 1, sizeof(header), funit);
+	fwrite(image->raw, 1, sim->nbytes_raw, funit);
+	if (sim->nbytes_raw%4 != 0) fwrite(&dummy_zeros, 1, 4-sim->nbytes_raw%4, funit);
+	fclose(funit);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Save all valid images in the ring (oldest first)
+--
+-- Usage: SIM_SaveBurstImages(SIM_CAMERA *sim, char *pattern, FILE_FORMAT format);
+--
+-- Inputs: sim     - pointer to active camera
+--         pattern - root of name for files
+--							  <pattern>.csv - logfile
+--                     <pattern>_ddd.bmp - individual images
+--         format  - format to save images (FILE_BMP or FILE_RAW - default FILE_BMP)
+--
+-- Return: 0 ==> successful
+--         1 ==> camera not valid
+--         3 ==> save abandoned by choice in the retry dialog
+=========================================================================== */
+int SIM_SaveBurstImages(SIM_CAMERA *sim, char *pattern, FILE_FORMAT format) {
+	static char *rname = "SIM_SaveBurstImages";
+
+	char pathname[PATH_MAX], *extension;
+	int i, istart, icount, inow;
+	double tstart;
+	FILE *funit;
+
+	if (! SIM_IsValidCamera(sim)) return 1;
+
+	if (sim->nValid < sim->nBuffers) {
+		istart = 0;
+		icount = sim->nValid;
+	} else {
+		istart = (sim->iLast+1) % sim->nBuffers;
+		icount = sim->nBuffers;
+	}
+
+	sprintf_s(pathname, sizeof(pathname), "%s.csv", pattern);
+RetryFileOpen:
+	fopen_s(&funit, pathname, "w");
+	if (funit == NULL) {
+		char szTmp[1024];
+		int rc;
+		sprintf_s(szTmp, sizeof(szTmp),
+					 "Failed to open the logfile for information about the burst bitmaps.\n"
+					 "   %s\n"
+					 "Check that the file is not currently open and try again.\n", pathname);
+		rc = MessageBox(NULL, szTmp, "File open failed", MB_ICONERROR | MB_RETRYCANCEL | MB_DEFBUTTON2);
+		if (rc == IDRETRY) goto RetryFileOpen;
+		return 3;
+	}
+
+	extension = (format == FILE_RAW) ? "raw" : "bmp";
+	fprintf(funit, "/* Index,filename,t_relative,t_time,t_clock\n");
+
+	inow = istart;
+	tstart = -999;
+	for (i=0; i<icount; i++, inow=(inow+1)%sim->nBuffers) {
+		if (! sim->images[inow].valid) continue;
+		if (tstart == -999) tstart = sim->images[inow].camera_time;
+
+		sprintf_s(pathname, sizeof(pathname), "%s_%3.3d.%s", pattern, i, extension);
+		fprintf(funit, "%d,%s,%.4f,%lld,%4.4d.%2.2d.%2.2d %2.2d:%2.2d:%2.2d.%3.3d\n",
+				  i, pathname, sim->images[inow].camera_time-tstart, sim->images[inow].timestamp,
+				  sim->images[inow].system_time.wYear, sim->images[inow].system_time.wMonth, sim->images[inow].system_time.wDay,
+				  sim->images[inow].system_time.wHour, sim->images[inow].system_time.wMinute, sim->images[inow].system_time.wSecond,
+				  sim->images[inow].system_time.wMilliseconds);
+		SIM_SaveImage(sim, pathname, inow, format);
+	}
+	fclose(funit);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Render an image in a specified window
+--
+-- Usage: int SIM_RenderFrame(SIM_CAMERA *sim, int frame, HWND hwnd);
+--
+-- Inputs: sim   - an opened synthetic camera
+--         frame - frame to process from buffers (-1 ==> for most recent)
+--         hwnd  - window to render the bitmap to
+--
+-- Return: 0 if successful, 1 if busy or invalid, 2 if no bitmap
+=========================================================================== */
+int SIM_RenderFrame(SIM_CAMERA *sim, int frame, HWND hwnd) {
+	static char *rname = "SIM_RenderFrame";
+
+	HDC hdc, hDCBits;
+	BITMAPINFOHEADER *bmih;
+	HBITMAP hBitmap;
+	RECT Client;
+	static sig_atomic_t active = 0;
+
+	if (active != 0 || ! SIM_IsValidCamera(sim) || ! IsWindow(hwnd)) return 1;
+	active++;
+
+	if (frame < 0) frame = sim->iLast;
+	if ( NULL == (bmih = sim_create_dib(sim, frame, NULL))) { active--; return 2; }
+	sim->iShow = frame;
+
+	hdc = GetDC(hwnd);
+	SetStretchBltMode(hdc, COLORONCOLOR);
+	hBitmap = CreateDIBitmap(hdc, bmih, CBM_INIT, (LPSTR) bmih + bmih->biSize, (BITMAPINFO *) bmih, DIB_RGB_COLORS);
+	hDCBits = CreateCompatibleDC(hdc);
+	SelectObject(hDCBits, hBitmap);
+
+	GetClientRect(hwnd, &Client);
+	StretchBlt(hdc, 0,0, Client.right, Client.bottom, hDCBits, 0, 0, bmih->biWidth, bmih->biHeight, SRCCOPY);
+
+	DeleteDC(hDCBits);
+	DeleteObject(hBitmap);
+	ReleaseDC(hwnd, hdc);
+	free(bmih);
+
+	active--;
+	return 0;
+}
+
+/* ===========================================================================
+-- Exposure (scales the spot signal and limits the frame rate)
+--
+-- Usage: int    SIM_GetExposureParms(SIM_CAMERA *sim, double *ms_min, double *ms_max);
+--        double SIM_SetExposure(SIM_CAMERA *sim, double ms_expose);
+--        double SIM_GetExposure(SIM_CAMERA *sim);
+--
+-- Inputs: ms_expose - requested exposure in ms (<=0 just returns the value)
+--
+-- Return: Parms: 0 if successful, 1 if sim invalid (defaults returned)
+--         Set/Get: current exposure in ms or 0 on error
+=========================================================================== */
+int SIM_GetExposureParms(SIM_CAMERA *sim, double *ms_min, double *ms_max) {
+	static char *rname = "SIM_GetExposureParms";
+
+	if (ms_min != NULL) *ms_min = SIM_EXPOSE_MIN;
+	if (ms_max != NULL) *ms_max = SIM_EXPOSE_MAX;
+
+	return (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) ? 1 : 0 ;
+}
+
+double SIM_SetExposure(SIM_CAMERA *sim, double ms_expose) {
+	static char *rname = "SIM_SetExposure";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0.0;
+
+	if (ms_expose > 0.0) {
+		EnterCriticalSection(&sim->lock);					/* Never between a render and its tag */
+		sim->ms_expose = max(SIM_EXPOSE_MIN, min(SIM_EXPOSE_MAX, 0.001*((int) (1000*ms_expose + 0.5))));
+		LeaveCriticalSection(&sim->lock);
+		if (sim->wake != NULL) SetEvent(sim->wake);
+	}
+	return sim->ms_expose;
+}
+
+double SIM_GetExposure(SIM_CAMERA *sim) {
+	static char *rname = "SIM_GetExposure";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0.0;
+	return sim->ms_expose;
+}
+
+/* ===========================================================================
+-- Frame rate of the generator, the measured rate and the processing limit
+--
+-- Usage: double SIM_SetFPSControl(SIM_CAMERA *sim, double fps);
+--        double SIM_GetFPSControl(SIM_CAMERA *sim);
+--        double SIM_GetFPSActual(SIM_CAMERA *sim);
+--        double SIM_GetFPSLimit(SIM_CAMERA *sim);
+--        double SIM_SetFPSLimit(SIM_CAMERA *sim, double fps);
+--
+-- Inputs: fps - generator rate [1,SIM_FPS_MAX] or processing limit
+--
+-- Return: Value in effect; 0 (control/actual) or -1 (limit) on error
+--
+-- Note: The exposure also bounds the rate (one frame per exposure).  The
+--       limit drops frames after they are generated, as for the TL driver.
+=========================================================================== */
+double SIM_SetFPSControl(SIM_CAMERA *sim, double fps) {
+	static char *rname = "SIM_SetFPSControl";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0.0;
+
+	EnterCriticalSection(&sim->lock);
+	sim->config.fps = max(1.0, min(SIM_FPS_MAX, fps));
+	LeaveCriticalSection(&sim->lock);
+	if (sim->wake != NULL) SetEvent(sim->wake);
+
+	return sim->config.fps;
+}
+
+double SIM_GetFPSControl(SIM_CAMERA *sim) {
+	static char *rname = "SIM_GetFPSControl";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0.0;
+	return sim->config.fps;
+}
+
+double SIM_GetFPSActual(SIM_CAMERA *sim) {
+	static char *rname = "SIM_GetFPSActual";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 0.0;
+	return sim->fps_actual;
+}
+
+double SIM_GetFPSLimit(SIM_CAMERA *sim) {
+	static char *rname = "SIM_GetFPSLimit";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1.0;
+	return sim->fps_limit;
+}
+
+double SIM_SetFPSLimit(SIM_CAMERA *sim, double fps) {
+	static char *rname = "SIM_SetFPSLimit";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1.0;
+
+	/* Use value if it is anything reasonable */
+	if (fps < 0 || fps < 1000000) sim->fps_limit = fps;
+	return sim->fps_limit;
+}
+
+/* ===========================================================================
+-- Master gain (dB) ... scales both signal and noise
+--
+-- Usage: int SIM_GetMasterGainInfo(SIM_CAMERA *sim, BOOL *bGain, double *db_dflt, double *db_min, double *db_max);
+--        int SIM_SetMasterGain(SIM_CAMERA *sim, double dB_gain);
+--        int SIM_GetMasterGain(SIM_CAMERA *sim, double *dB_gain);
+--
+-- Return: 0 if successful, 1 if sim invalid
+=========================================================================== */
+int SIM_GetMasterGainInfo(SIM_CAMERA *sim, BOOL *bGain, double *db_dflt, double *db_min, double *db_max) {
+	static char *rname = "SIM_GetMasterGainInfo";
+
+	if (bGain   != NULL) *bGain   = FALSE;
+	if (db_dflt != NULL) *db_dflt = 0;
+	if (db_min  != NULL) *db_min  = 0;
+	if (db_max  != NULL) *db_max  = 6;
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	if (bGain  != NULL) *bGain  = TRUE;
+	if (db_max != NULL) *db_max = SIM_DB_MAX;
+	return 0;
+}
+
+int SIM_SetMasterGain(SIM_CAMERA *sim, double dB_gain) {
+	static char *rname = "SIM_SetMasterGain";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	EnterCriticalSection(&sim->lock);
+	sim->dB_gain = max(0.0, min(SIM_DB_MAX, dB_gain));
+	LeaveCriticalSection(&sim->lock);
+	return 0;
+}
+
+int SIM_GetMasterGain(SIM_CAMERA *sim, double *dB_gain) {
+	static char *rname = "SIM_GetMasterGain";
+
+	if (dB_gain != NULL) *dB_gain = 0;
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	if (dB_gain != NULL) *dB_gain = sim->dB_gain;
+	return 0;
+}
+
+/* ===========================================================================
+-- RGB channel gains (applied when converting to RGB, default 1.0)
+--
+-- Usage: int SIM_GetRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue);
+--        int SIM_SetRGBGains(SIM_CAMERA *sim, double  red, double  green, double  blue);
+--        int SIM_GetDfltRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue);
+--
+-- Inputs: red, green, blue - gains (set) ... SIM_IGNORE_GAIN leaves a channel unchanged
+--
+-- Return: 0 if successful, 1 (get) or -1 (set) if sim invalid
+=========================================================================== */
+int SIM_GetRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue) {
+	static char *rname = "SIM_GetRGBGains";
+
+	if (red   != NULL) *red   = 0;
+	if (green != NULL) *green = 0;
+	if (blue  != NULL) *blue  = 0;
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	if (red   != NULL) *red   = sim->red_gain;
+	if (green != NULL) *green = sim->green_gain;
+	if (blue  != NULL) *blue  = sim->blue_gain;
+	return 0;
+}
+
+int SIM_SetRGBGains(SIM_CAMERA *sim, double red, double green, double blue) {
+	static char *rname = "SIM_SetRGBGains";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1;
+
+	if (red   != SIM_IGNORE_GAIN) sim->red_gain   = max(0.0, red);
+	if (green != SIM_IGNORE_GAIN) sim->green_gain = max(0.0, green);
+	if (blue  != SIM_IGNORE_GAIN) sim->blue_gain  = max(0.0, blue);
+	sim->rgb24_imageID = -1;												/* Redo conversion with new gains */
+	return 0;
+}
+
+int SIM_GetDfltRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue) {
+	static char *rname = "SIM_GetDfltRGBGains";
+
+	if (red   != NULL) *red   = 0;
+	if (green != NULL) *green = 0;
+	if (blue  != NULL) *blue  = 0;
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	if (red   != NULL) *red   = 1.0;
+	if (green != NULL) *green = 1.0;
+	if (blue  != NULL) *blue  = 1.0;
+	return 0;
+}
+
+/* ===========================================================================
+-- Software arm/disarm (pending triggers)
+--
+-- Usage: TRIG_ARM_ACTION SIM_Arm(SIM_CAMERA *sim, TRIG_ARM_ACTION action);
+--
+-- Inputs: action - one of TRIG_ARM_QUERY, TRIG_ARM, TRIG_DISARM (dflt=query)
+--
+-- Return: TRIG_ARM_UNKNOWN on error, otherwise TRIG_ARM or TRIG_DISARM
+--
+-- Notes: As for TL, arming in TRIG_FREERUN restarts continuous generation
+--        and resets the ring counters
+=========================================================================== */
+TRIG_ARM_ACTION SIM_Arm(SIM_CAMERA *sim, TRIG_ARM_ACTION action) {
+	static char *rname = "SIM_Arm";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return TRIG_ARM_UNKNOWN;
+
+	EnterCriticalSection(&sim->lock);
+	switch (action) {
+		case TRIG_ARM:
+			sim->trigger.bArmed = TRUE;
+			if (sim->trigger.mode == TRIG_FREERUN) {
+				sim->pending = -1;
+				sim->nValid = sim->iLast = sim->iShow = 0;
+			}
+			break;
+		case TRIG_DISARM:
+			sim->trigger.bArmed = FALSE;
+			sim->pending = 0;
+			break;
+		default:
+			break;
+	}
+	LeaveCriticalSection(&sim->lock);
+	if (sim->wake != NULL) SetEvent(sim->wake);
+
+	return sim->trigger.bArmed ? TRIG_ARM : TRIG_DISARM ;
+}
+
+/* ===========================================================================
+-- Software trigger
+--
+-- Usage: int SIM_Trigger(SIM_CAMERA *sim);
+--
+-- Output: If armed, owes frames_per_trigger more frames (0 ==> continuous).
+--         TRIG_FREERUN and TRIG_BURST are always continuous.
+--
+-- Return: 0 if successful, 1 if sim invalid, 3 if not armed
+=========================================================================== */
+int SIM_Trigger(SIM_CAMERA *sim) {
+	static char *rname = "SIM_Trigger";
+
+	int frames;
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return 1;
+
+	if (! sim->trigger.bArmed) {
+		Beep(300,200);
+		return 3;
+	}
+
+	EnterCriticalSection(&sim->lock);
+	frames = (sim->trigger.mode == TRIG_FREERUN || sim->trigger.mode == TRIG_BURST) ? 0 : sim->trigger.frames_per_trigger ;
+	if (frames <= 0) {
+		sim->pending = -1;
+	} else if (sim->pending >= 0) {
+		sim->pending += frames;
+	}
+	LeaveCriticalSection(&sim->lock);
+	if (sim->wake != NULL) SetEvent(sim->wake);
+
+	return 0;
+}
+
+/* ===========================================================================
+-- Set/Query the triggering mode
+--
+-- Usage: TRIGGER_MODE SIM_SetTriggerMode(SIM_CAMERA *sim, TRIGGER_MODE mode, TRIGGER_INFO *info);
+--        TRIGGER_MODE SIM_GetTriggerMode(SIM_CAMERA *sim, TRIGGER_INFO *info);
+--
+-- Inputs: mode - TRIG_SOFTWARE, TRIG_FREERUN, TRIG_EXTERNAL, TRIG_SS or TRIG_BURST
+--         info - if !NULL, frames_per_trigger and ext_slope to use
+--
+-- Output: Same arm state after each change as the TL driver.  There is no
+--         hardware input, so TRIG_EXTERNAL and TRIG_SS wait for SIM_Trigger().
+--
+-- Return: Mode in camera or -1 on error
+=========================================================================== */
+TRIGGER_MODE SIM_GetTriggerMode(SIM_CAMERA *sim, TRIGGER_INFO *info) {
+	static char *rname = "SIM_GetTriggerMode";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1;
+
+	if (info != NULL) *info = sim->trigger;
+	return sim->trigger.mode;
+}
+
+TRIGGER_MODE SIM_SetTriggerMode(SIM_CAMERA *sim, TRIGGER_MODE mode, TRIGGER_INFO *info) {
+	static char *rname = "SIM_SetTriggerMode";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1;
+
+	EnterCriticalSection(&sim->lock);
+
+	/* Handle potential changes to parameters in the new info first */
+	if (info != NULL) {
+		if (info->frames_per_trigger > 0) sim->trigger.frames_per_trigger = info->frames_per_trigger;
+		if (info->ext_slope == TRIG_EXT_POS || info->ext_slope == TRIG_EXT_NEG) sim->trigger.ext_slope = info->ext_slope;
+	}
+
+	if (mode != sim->trigger.mode) {
+		sim->trigger.bArmed = FALSE;
+		sim->pending = 0;
+
+		switch (mode) {
+			case TRIG_FREERUN:
+			case TRIG_BURST:
+				if (mode == TRIG_FREERUN) {
+					sim->trigger.bArmed = TRUE;
+					sim->pending = -1;
+				}
+				break;
+
+			case TRIG_EXTERNAL:
+			case TRIG_SS:
+				if (sim->trigger.ext_slope != TRIG_EXT_POS && sim->trigger.ext_slope != TRIG_EXT_NEG) sim->trigger.ext_slope = TRIG_EXT_POS;
+				if (sim->trigger.frames_per_trigger <= 0) sim->trigger.frames_per_trigger = 1;
+				sim->trigger.bArmed = TRUE;
+				break;
+
+			case TRIG_SOFTWARE:
+			default:
+				mode = TRIG_SOFTWARE;
+				if (sim->trigger.frames_per_trigger <= 0) sim->trigger.frames_per_trigger = 1;
+				sim->trigger.bArmed = TRUE;
+				break;
+		}
+		sim->trigger.mode = mode;
+	}
+	LeaveCriticalSection(&sim->lock);
+	if (sim->wake != NULL) SetEvent(sim->wake);
+
+	return sim->trigger.mode;
+}
+
+/* ===========================================================================
+-- Set/Query number of frames per trigger (0 for continuous)
+--
+-- Usage: int SIM_SetFramesPerTrigger(SIM_CAMERA *sim, int frames);
+--        int SIM_GetFramesPerTrigger(SIM_CAMERA *sim);
+--
+-- Return: Set: 0 if successful, -1 if sim invalid
+--         Get: frames per trigger or -1 if sim invalid
+=========================================================================== */
+int SIM_GetFramesPerTrigger(SIM_CAMERA *sim) {
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1;
+	return sim->trigger.frames_per_trigger;
+}
+
+int SIM_SetFramesPerTrigger(SIM_CAMERA *sim, int frames) {
+	static char *rname = "SIM_SetFramesPerTrigger";
+
+	if (sim == NULL || sim->magic != SIM_CAMERA_MAGIC) return -1;
+
+	if (frames < 0) frames = 0;
+	sim->trigger.frames_per_trigger = frames;
+	return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef sim_loaded
+
+#define sim_loaded
+
+/* Synthetic camera ... generates frames in software for load testing without hardware */
+/* Same ring, trigger and save semantics as the TL driver (see tl.h) */
+
+/* Maximum number of threads that can request a signal when new frame available */
+#define	SIM_MAX_SIGNALS				(10)
+#define	SIM_MAX_RING_SIZE				(1000)
+#define	SIM_IMAGE_ACCESS_TIMEOUT	(200)			/* Never delay for more than 200 ms for access to image buffers */
+
+#define	SIM_FPS_MAX						(10000.0)	/* Highest programmable frame rate */
+#define	SIM_NOISE_TABLE				(65536)		/* Precomputed unit normal deviates (power of 2) */
+
+#define	SIM_CAMERA_MAGIC	0x8A53
+
+#pragma pack(4)
+typedef struct _SIM_IMAGE {
+	int index;											/* Index of this buffer (frame)	*/
+	BOOL valid;											/* Is data in buffer valid			*/
+	int locks;											/* # buffer locks; 0 => availble	*/
+
+	volatile int imageID;							/* Unique ID of image (# since start); -1 while rewritten */
+	unsigned short *raw;								/* Buffer with the raw data		*/
+	double camera_time;								/* Synthetic frame time (s since open) */
+	__time64_t timestamp;							/* time() value						*/
+	SYSTEMTIME system_time;							/* Include millisecond time		*/
+	double dB_gain;									/* Master gain in dB					*/
+	double ms_expose;									/* ms exposure							*/
+	double focus;										/* Virtual focus position (mm)	*/
+} SIM_IMAGE;
+#pragma pack()
+
+#ifndef INCLUDE_SIM_DETAIL_INFO
+	typedef struct _SIM_CAMERA SIM_CAMERA;
+#else
+	typedef struct _SIM_SPOT {
+		double x0, y0;										/* Center of the motion (pixels)	*/
+		double ax, ay;										/* Amplitude of the motion			*/
+		double wx, wy;										/* Angular rates (rad/pixel moved) */
+		double phase;										/* Starting phase						*/
+		double weight;										/* Relative brightness				*/
+	} SIM_SPOT;
+
+	typedef struct _SIM_CAMERA {
+		int magic;											/* Magic value to indicate valid */
+		char model[16];									/* Model									*/
+		char serial[16];									/* Serial number						*/
+		SIM_CONFIG config;								/* Scene and frame rate (SIM_SetConfig) */
+		CRITICAL_SECTION lock;							/* Serializes config against frame generation */
+		BOOL bOpen;											/* Generator running					*/
+
+		/* Image information (fixed while open) */
+		int width, height;								/* Image size							*/
+		int bit_depth;										/* Bit depth							*/
+		BOOL IsSensorColor;								/* TRUE Bayer, FALSE monochrome	*/
+		size_t image_bytes;								/* Number of bytes in an image	*/
+		int nbytes_raw;									/* Number of bytes in each frame */
+		double pixel_um;									/* Nominal pixel size				*/
+
+		/* Current capture conditions */
+		double ms_expose;									/* ms exposure							*/
+		double dB_gain;									/* Master gain in dB					*/
+		double red_gain, green_gain, blue_gain;	/* Applied in SIM_ProcessRGB		*/
+		double fps_limit;									/* Limit processing rate of images */
+		double t_image;									/* Time of last processed image	*/
+
+		TRIGGER_INFO trigger;							/* Trigger details					*/
+		volatile long pending;							/* Frames still owed (-1 ==> continuous) */
+		HANDLE wake;										/* Kicks the generator out of idle */
+
+		HANDLE image_mutex;								/* Access to modify/use data		*/
+		int suspend_image_processing;					/* If !0, don't process images	*/
+		HANDLE new_image_signals[SIM_MAX_SIGNALS];	/* Handles to event semaphores	*/
+
+		/* Per-camera image IDs and capture counts (only the generator changes them) */
+		volatile long image_count;						/* One past the newest imageID	*/
+		volatile long frames_generated;				/* Frames rendered since opened	*/
+		volatile long frames_stored;					/* Copied into the ring				*/
+		volatile long frames_skipped;					/* Suspended or over fps_limit	*/
+		volatile long frames_missed;					/* Ring mutex not available		*/
+		volatile long frames_late;						/* Deadlines missed by a full period */
+		double fps_actual;								/* Measured generation rate		*/
+
+		/* Ring information */
+		int nBuffers,										/* Number of frames in the ring	*/
+			 nValid,											/* # frames valid in ring			*/
+			 iLast,											/* index of last camera frame		*/
+			 iShow;											/* index of frame in rgb24			*/
+		SIM_IMAGE *images;								/* Image raw data and metadata	*/
+
+		int rgb24_imageID;								/* ImageID of current rgb24 data	*/
+		unsigned char *rgb24;							/* BGR24 (color) or MONO8 (mono)	*/
+
+		/* Generator state */
+		unsigned short *frame;							/* Rendered outside the mutex		*/
+		float *noise;										/* SIM_NOISE_TABLE unit normals	*/
+		float *gx, *gy;									/* Separable spot profiles			*/
+		SIM_SPOT spots[SIM_MAX_SPOTS];
+		unsigned int rand_state;						/* Noise table offsets				*/
+		HIRES_TIMER *timer;								/* Frame clock							*/
+		volatile BOOL thread_active;					/* Generator thread running		*/
+		volatile BOOL thread_abort;
+	} SIM_CAMERA;
+#endif		/* #ifdef INCLUDE_SIM_DETAIL_INFO */
+
+/* Functions */
+SIM_CAMERA *SIM_FindCamera(void);
+int SIM_GetConfig(SIM_CAMERA *sim, SIM_CONFIG *config);
+int SIM_SetConfig(SIM_CAMERA *sim, SIM_CONFIG *config);
+
+int SIM_OpenCamera(SIM_CAMERA *sim, int nBuf);
+int SIM_CloseCamera(SIM_CAMERA *sim);
+BOOL SIM_IsValidCamera(SIM_CAMERA *sim);
+int SIM_GetImageCount(SIM_CAMERA *sim);
+int SIM_GetCameraInfo(SIM_CAMERA *sim, CAMERA_INFO *info);
+int SIM_GetBinning(SIM_CAMERA *sim, BINNING_INFO *info);
+
+int SIM_GetRingInfo(SIM_CAMERA *sim, int *nBuffers, int *nValid, int *iLast, int *iShow);
+int SIM_SetRingBufferSize(SIM_CAMERA *sim, int nBuf);
+int SIM_ResetRingCounters(SIM_CAMERA *sim);
+
+int SIM_AddImageSignal(SIM_CAMERA *sim, HANDLE signal);
+int SIM_RemoveImageSignal(SIM_CAMERA *sim, HANDLE signal);
+
+int SIM_ProcessRGB(SIM_CAMERA *sim, int frame);
+
+int SIM_GetImageInfo(SIM_CAMERA *sim, int frame, IMAGE_INFO *info);
+int SIM_GetImageData(SIM_CAMERA *sim, int frame, void **image_data, size_t *length);
+int SIM_GetImageBuffer(SIM_CAMERA *sim, int frame, IMAGE_BUFFER *buffer);
+
+int SIM_GetSaveFormatFlag(SIM_CAMERA *sim);
+int SIM_SaveImage(SIM_CAMERA *sim, char *path, int frame, FILE_FORMAT format);
+int SIM_SaveBMPImage(SIM_CAMERA *sim, char *path, int frame);
+int SIM_SaveRawImage(SIM_CAMERA *sim, char *path, int frame);
+int SIM_SaveBurstImages(SIM_CAMERA *sim, char *pattern, FILE_FORMAT format);
+
+int SIM_RenderFrame(SIM_CAMERA *sim, int frame, HWND hwnd);
+
+int    SIM_GetExposureParms(SIM_CAMERA *sim, double *ms_min, double *ms_max);
+double SIM_SetExposure(SIM_CAMERA *sim, double ms_expose);
+double SIM_GetExposure(SIM_CAMERA *sim);
+
+double SIM_SetFPSControl(SIM_CAMERA *sim, double fps);
+double SIM_GetFPSControl(SIM_CAMERA *sim);
+double SIM_GetFPSActual(SIM_CAMERA *sim);
+double SIM_GetFPSLimit(SIM_CAMERA *sim);
+double SIM_SetFPSLimit(SIM_CAMERA *sim, double fps);
+
+int SIM_GetMasterGainInfo(SIM_CAMERA *sim, BOOL *bGain, double *db_dflt, double *db_min, double *db_max);
+int SIM_SetMasterGain(SIM_CAMERA *sim, double dB_gain);
+int SIM_GetMasterGain(SIM_CAMERA *sim, double *dB_gain);
+
+#define	SIM_IGNORE_GAIN		(-999)
+int SIM_GetRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue);
+int SIM_SetRGBGains(SIM_CAMERA *sim, double  red, double  green, double  blue);
+int SIM_GetDfltRGBGains(SIM_CAMERA *sim, double *red, double *green, double *blue);
+
+/* Triggering controls (external is emulated by the software trigger) */
+TRIG_ARM_ACTION SIM_Arm(SIM_CAMERA *sim, TRIG_ARM_ACTION action);
+int SIM_Trigger(SIM_CAMERA *sim);
+int SIM_SetFramesPerTrigger(SIM_CAMERA *sim, int frames);
+int SIM_GetFramesPerTrigger(SIM_CAMERA *sim);
+TRIGGER_MODE SIM_SetTriggerMode(SIM_CAMERA *sim, TRIGGER_MODE mode, TRIGGER_INFO *info);
+TRIGGER_MODE SIM_GetTriggerMode(SIM_CAMERA *sim, TRIGGER_INFO *info);
+
+#endif			/* sim_loaded */
@@ -42,6 +42,8 @@
 #include "timer.h"
 #include "win32ex.h"
 #include "camera.h"
+#include "image_proc.h"
+#include "perf.h"
 #define INCLUDE_TL_DETAIL_INFO
 #include "tl.h"
 
@@ -54,6 +56,32 @@
 	#define	PATH_MAX	(260)
 #endif
 
+/* Metadata cache for fast discovery (see TL_FindAllCameras, TL_SetCacheFile) */
+#define	TL_CACHE_FILE				"TL_cameras.cache"
+#define	TL_CACHE_MAGIC				(0x4A7B9301)
+#define	TL_MAX_CACHE_RECORDS		(64)
+#define	TL_QUERY_TIMEOUT			(15000)			/* ms to wait for a camera open/query */
+
+#pragma pack(4)
+typedef struct _TL_CACHE_RECORD {
+	int magic;											/* TL_CACHE_MAGIC							*/
+	int record_size;									/* sizeof(TL_CACHE_RECORD)				*/
+	char ID[32], name[32], model[16], serial[16];
+	char firmware[1024];								/* With serial, identifies the entry	*/
+	int sensor_type, color_filter;				/* enum values from the SDK				*/
+	float color_correction[9], white_balance[9];
+	int sensor_width, sensor_height;
+	double pixel_width_um, pixel_height_um;
+	int width, height, bit_depth, pixel_bytes;
+	long long us_expose_min, us_expose_max, us_expose;
+	int clock_Hz;
+	BOOL bGainControl;
+	double db_min, db_max;
+	BOOL bFrameRateControl;
+	double fps_min, fps_max;
+} TL_CACHE_RECORD;
+#pragma pack()
+
 /* ------------------------------- */
 /* My external function prototypes */
 /* ------------------------------- */
@@ -65,6 +93,15 @@ static void camera_connect_callback(char* camera_ID, enum TL_CAMERA_USB_PORT_TYP
 static void camera_disconnect_callback(char* camera_ID, void* context);
 static void frame_available_callback(void* sender, unsigned short* image_buffer, int frame_count, unsigned char* metadata, int metadata_size_in_bytes, void* context);
 static int set_image_size_and_buffers(TL_CAMERA *tl);
+static BOOL tl_lock_images(TL_CAMERA *tl, DWORD msWait, int imageID);
+static void tl_unlock_images(TL_CAMERA *tl, int imageID);
+
+static TL_CAMERA *tl_new_camera(char *ID);
+static void tl_query_thread(void *arg);
+static BOOL tl_cache_lookup(char *ID, TL_CACHE_RECORD *rec);
+static int tl_cache_store(TL_CACHE_RECORD *rec);
+static void tl_cache_from_camera(TL_CACHE_RECORD *rec, TL_CAMERA *tl);
+static void tl_cache_to_camera(TL_CAMERA *tl, TL_CACHE_RECORD *rec);
 
 static int TL_CameraErrMsg(int rc, char *msg, char *routine);
 
@@ -84,6 +121,11 @@ TL_CAMERA *tl_camera_list[TL_MAX_CAMERAS] = {NULL, NULL, NULL, NULL, NULL, NULL,
 /* Locally defined global vars     */
 /* ------------------------------- */
 static FILE *tl_debug = NULL;								/* If !NULL, pointer to some open logfile for debugging */
+static HIRES_TIMER *host_timer = NULL;					/* Common clock for frame arrival (all cameras) */
+static volatile long next_imageID = 0;					/* Common imageID sequence (all TL and SIM cameras) */
+static char tl_cache_path[PATH_MAX] = TL_CACHE_FILE;	/* Camera metadata cache ("" ==> disabled) */
+static CRITICAL_SECTION cache_lock;							/* Serializes cache file access (query threads) */
+static BOOL cache_lock_init = FALSE;
 
 static BOOL is_camera_sdk_open        = FALSE,		/* Have we opened the SDK */
 				is_camera_dll_open        = FALSE,		/* Have we linked to the DLLs */
@@ -116,6 +158,8 @@ int TL_Initialize(void) {
 	/* Clear the camera list and count */
 	memset(tl_camera_list, 0, TL_MAX_CAMERAS*sizeof(*tl_camera_list));
 	tl_camera_count = 0;
+	if (host_timer == NULL) host_timer = HiResTimerCreate();
+	if (! cache_lock_init) { InitializeCriticalSection(&cache_lock); cache_lock_init = TRUE; }
 
 	/* Assume success */
 	rcode = 0;
@@ -257,16 +301,25 @@ int TL_Shutdown(void) {
 --          -1 => TL interface not (and cannot be) initialized
 --          -2 => Unable to allocate memory for the list
 --
--- Notes: Opens and queries properties of all cameras but does not instantiate
---        any of the memory arrays.  TL_OpenCamera must be called before the
---        camera can actually be used.
+-- Notes: Each new camera is opened and queried on its own thread, so the
+--        cost is that of the slowest camera rather than the sum.  Cameras
+--        found in the metadata cache (see TL_SetCacheFile) are returned
+--        immediately with the cached properties; their query continues in
+--        the background and refreshes the structure and the cache (serial
+--        and firmware) when done.  Only cameras with no cache entry are
+--        waited on.  TL_OpenCamera waits for any query still in progress.
+--
+--        Does not instantiate any of the memory arrays.  TL_OpenCamera must
+--        be called before the camera can actually be used.
 =========================================================================== */
 int TL_FindAllCameras(TL_CAMERA **plist[]) {
 	static char *rname = "TL_FindAllCameras";
 
 	char *aptr, *bptr, szBuf[256];
-	int rc;
-	TL_CAMERA *tl;
+	int i, rc, nwait;
+	TL_CAMERA *tl, *fresh[TL_MAX_CAMERAS];
+	HANDLE waits[TL_MAX_CAMERAS];
+	TL_CACHE_RECORD rec;
 
 	/* Initialize the return values */
 	if (plist != NULL) *plist = NULL;
@@ -279,35 +332,64 @@ int TL_FindAllCameras(TL_CAMERA **plist[]) {
 
 	/* Query the list of known camera ID's */
 	*szBuf = 0;
-	if ( (rc = tl_camera_discover_available_cameras(szBuf, sizeof(szBuf))) != 0) { 
+	if ( (rc = tl_camera_discover_available_cameras(szBuf, sizeof(szBuf))) != 0) {
 		TL_CameraErrMsg(rc, "Call to discover cameras failed", rname);
 		return 0;
 	} else if (*szBuf == '\0') {
 		fprintf(stderr, "[%s] No cameras identified\n", rname); fflush(stderr);
 		return 0;
-	} 
+	}
 	fprintf(stderr, "[%s] TL Cameras (full list): %s\n", rname, szBuf);  fflush(stderr);
 	szBuf[strlen(szBuf)] = '\0';				/* Double NULL terminate */
 
+	/* Register every new camera (cached properties if known) and start its query */
 	/* Code maintains list of open cameras and will not double open */
+	nwait = 0;
 	for (aptr=szBuf; *aptr!='\0'; aptr+=strlen(aptr)) {
 		if ( (bptr = strchr(aptr, ' ')) != NULL) *bptr = '\0';
-		if ( (tl = TL_FindCamera(aptr, &rc)) == NULL) {
-			fprintf(stderr, "[%s] Failed to open camera with ID %s (rc = %d)\n", rname, aptr, rc);
-			fflush(stderr);
+		if (TL_FindCameraByID(aptr) != NULL) continue;
+		if (tl_camera_count >= TL_MAX_CAMERAS) {
+			fprintf(stderr, "[%s] Error opening camera %s: Too many cameras already open\n", rname, aptr); fflush(stderr);
+			continue;
+		}
+
+		tl = tl_new_camera(aptr);
+		if (tl_cache_lookup(aptr, &rec)) {
+			tl_cache_to_camera(tl, &rec);
+			tl->bCached = TRUE;
+			fprintf(stderr, "[%s] Camera %s: using cached properties (firmware verified in background)\n", rname, aptr); fflush(stderr);
 		} else {
-			fprintf(stderr, "Camera %s:   handle: 0x%p\n", tl->ID, tl->handle);
-			fprintf(stderr, "   Model: %s\n", tl->model);
-			fprintf(stderr, "   Serial Number: %s\n", tl->serial);
-			fprintf(stderr, "   Bit depth: %d\n", tl->bit_depth);
-			fprintf(stderr, "   Size %d x %d\n", tl->width, tl->height); 
-			fprintf(stderr, "   Exposure (us):  %lld (%lld < exp < %lld)\n", tl->us_expose, tl->us_expose_min, tl->us_expose_max);
-			fprintf(stderr, "   Framerate: %.2f < fps < %.2f\n", tl->fps_min, tl->fps_max);
-			fprintf(stderr, "   Pixel size (um): %.3f x %.3f\n", tl->pixel_width_um, tl->pixel_height_um);
-			fprintf(stderr, "   Bytes per pixel: %d\n", tl->pixel_bytes);
-			fprintf(stderr, "   Clock rate (Hz): %d\n", tl->clock_Hz);
-			fflush(stderr);
+			fresh[nwait] = tl;
+			waits[nwait++] = tl->query_done;
 		}
+		tl_camera_list[tl_camera_count++] = tl;
+
+		if (_beginthread(tl_query_thread, 0, tl) == -1L) tl_query_thread(tl);		/* Do it ourselves if no thread */
+	}
+
+	/* Wait only for the cameras that have nothing cached */
+	if (nwait > 0 && WaitForMultipleObjects(nwait, waits, TRUE, TL_QUERY_TIMEOUT) == WAIT_TIMEOUT) {
+		fprintf(stderr, "[%s] Timeout waiting for camera queries ... continuing with partial information\n", rname); fflush(stderr);
+	}
+	for (i=0; i<nwait; i++) {
+		if (WaitForSingleObject(fresh[i]->query_done, 0) != WAIT_OBJECT_0 || fresh[i]->query_rc == 0) continue;
+		fprintf(stderr, "[%s] Failed to open camera with ID %s (rc = %d)\n", rname, fresh[i]->ID, fresh[i]->query_rc); fflush(stderr);
+		TL_ForgetCamera(fresh[i]);
+	}
+
+	for (i=0; i<tl_camera_count; i++) {
+		tl = tl_camera_list[i];
+		fprintf(stderr, "Camera %s:   handle: 0x%p  %s\n", tl->ID, tl->handle, tl->bDetailed ? "" : "(cached)");
+		fprintf(stderr, "   Model: %s\n", tl->model);
+		fprintf(stderr, "   Serial Number: %s\n", tl->serial);
+		fprintf(stderr, "   Bit depth: %d\n", tl->bit_depth);
+		fprintf(stderr, "   Size %d x %d\n", tl->width, tl->height);
+		fprintf(stderr, "   Exposure (us):  %lld (%lld < exp < %lld)\n", tl->us_expose, tl->us_expose_min, tl->us_expose_max);
+		fprintf(stderr, "   Framerate: %.2f < fps < %.2f\n", tl->fps_min, tl->fps_max);
+		fprintf(stderr, "   Pixel size (um): %.3f x %.3f\n", tl->pixel_width_um, tl->pixel_height_um);
+		fprintf(stderr, "   Bytes per pixel: %d\n", tl->pixel_bytes);
+		fprintf(stderr, "   Clock rate (Hz): %d\n", tl->clock_Hz);
+		fflush(stderr);
 	}
 
 	/* Return pointer to full list and count */
@@ -339,6 +421,9 @@ int TL_FindAllCameras(TL_CAMERA **plist[]) {
 --       Use TL_OpenCamera to ensure that buffers for the camera are
 --       initialized.
 --
+--       Unlike TL_FindAllCameras, always queries the camera directly (and
+--       refreshes the metadata cache) before returning.
+--
 --       Before use, must call TL_OpenCamera to initialize properly
 --				tl->handle
 --				tl->color_processor
@@ -349,14 +434,13 @@ TL_CAMERA *TL_FindCamera(char *ID, int *rcode) {
 	static char *rname = "TL_FindCamera";
 
 	TL_CAMERA *tl;
-	FILE *handle;
- 	int rc, myrcode, ilow, ihigh;
+ 	int myrcode;
 
 	/* Just have something where *rc works */
 	if (rcode == NULL) rcode = &myrcode;
 
 	/* Assume we will be successful */
-	*rcode = 0;										
+	*rcode = 0;
 
 	/* First make sure we don't already have it opened */
 	if ( (tl = TL_FindCameraByID(ID)) != NULL) return tl;
@@ -368,78 +452,322 @@ TL_CAMERA *TL_FindCamera(char *ID, int *rcode) {
 		return NULL;
 	}
 
-	/* Open the camera, get handle, and make sure all seems okay */
-	if ( (rc = tl_camera_open_camera(ID, &handle)) != 0) {
-		char szBuf[64];
-		sprintf_s(szBuf, sizeof(szBuf), "Error opening camera %s", ID);
-		TL_CameraErrMsg(rc, szBuf, rname);
-		*rcode = 2;
+	/* Create the structure and query on this thread */
+	tl = tl_new_camera(ID);
+	tl_query_thread(tl);
+	if ( (*rcode = tl->query_rc) != 0) {
+		CloseHandle(tl->query_done);
+		DeleteCriticalSection(&tl->info_lock);
+		HiResTimerDestroy(tl->timer);
+		free(tl);
 		return NULL;
 	}
 
-	/* Create a structure for the camera now */
+	/* Register in my list of known cameras and return with no error */
+	tl_camera_list[tl_camera_count++] = tl;
+
+	/* And return camera (*rcode already set at start) */
+	return tl;
+}
+
+/* ===========================================================================
+-- Set the file used to cache camera properties between runs
+--
+-- Usage: int TL_SetCacheFile(char *path);
+--
+-- Inputs: path - file for the cache (NULL or "" disables the cache)
+--
+-- Output: sets internal information
+--
+-- Return: 0 if successful (always)
+=========================================================================== */
+int TL_SetCacheFile(char *path) {
+	static char *rname = "TL_SetCacheFile";
+
+	if (path == NULL) path = "";
+	strcpy_s(tl_cache_path, sizeof(tl_cache_path), path);
+	return 0;
+}
+
+/* ===========================================================================
+-- Allocate a TL_CAMERA for a discovered ID (no device access)
+--
+-- Usage: static TL_CAMERA *tl_new_camera(char *ID);
+--
+-- Return: calloc'd structure with query_done unsignaled (query pending)
+=========================================================================== */
+static TL_CAMERA *tl_new_camera(char *ID) {
+
+	TL_CAMERA *tl;
+
 	tl = calloc(1, sizeof(*tl));
 	tl->magic = TL_CAMERA_MAGIC;
 	strcpy_s(tl->ID, sizeof(tl->ID), ID);
-	tl->handle = handle;
+	tl->fps_min = 1; tl->fps_max = 40;				/* Defaults until queried */
+	tl->fps_limit = 1000.0;								/* Deal with up to kHz rate */
+
+	tl->timer = HiResTimerCreate();					/* Timer to manage image times  */
+	tl->t_image = -10.0;									/* No image in last 100 seconds */
+
+	tl->query_done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	InitializeCriticalSection(&tl->info_lock);
+	return tl;
+}
+
+/* ===========================================================================
+-- Open a camera, query all of its properties and close it again
+--
+-- Usage: static void tl_query_thread(void *arg);
+--
+-- Inputs: arg - TL_CAMERA * from tl_new_camera (not opened)
+--
+-- Output: Properties are queried into a scratch structure and copied into
+--         the camera through the cache record under tl->info_lock, and only
+--         if the camera was not opened meanwhile, so an open camera never
+--         has its properties changed underneath it.  (The camera list may
+--         still read a closed camera while the copy runs.)  On success,
+--         updates the cache file and, if copied, sets bDetailed.
+--         tl->query_rc - 0 on success, 2 if the camera could not be opened
+--         tl->query_done is signaled on exit
+--
+-- Return: none
+--
+-- Note: May run concurrently for several cameras.  Touches only its own
+--       camera; TL_ForgetCamera waits for query_done, TL_OpenCamera only
+--       if nothing was cached or the query holds the device.
+=========================================================================== */
+static void tl_query_thread(void *arg) {
+	static char *rname = "tl_query_thread";
+
+	TL_CAMERA *tl, *scan;
+	TL_CACHE_RECORD rec;
+	FILE *handle;
+	int rc, ilow, ihigh;
+
+	tl = (TL_CAMERA *) arg;
+	scan = calloc(1, sizeof(*scan));
+
+	/* Open the camera, get handle, and make sure all seems okay */
+	if ( (rc = tl_camera_open_camera(tl->ID, &handle)) != 0) {
+		char szBuf[64];
+		sprintf_s(szBuf, sizeof(szBuf), "Error opening camera %s", tl->ID);
+		TL_CameraErrMsg(rc, szBuf, rname);
+		free(scan);
+		tl->query_rc = 2;
+		SetEvent(tl->query_done);
+		return;
+	}
 
 	/* And get lots of information about the camera */
-	if ( (rc = tl_camera_get_model                       (handle,  tl->model, sizeof(tl->model)))       != 0) TL_CameraErrMsg(rc, "Error determining model for camera", rname);
-	if ( (rc = tl_camera_get_serial_number               (handle,  tl->serial, sizeof(tl->serial)))     != 0) TL_CameraErrMsg(rc, "Error determining serial number for camera", rname);
-	if ( (rc = tl_camera_get_name								  (handle,  tl->name, sizeof(tl->name)))         != 0) TL_CameraErrMsg(rc, "Error determining name for camera", rname);
-	if ( (rc = tl_camera_get_firmware_version				  (handle,  tl->firmware, sizeof(tl->firmware))) != 0) TL_CameraErrMsg(rc, "Error determining firmware for camera", rname);
-
-	if ( (rc = tl_camera_get_camera_sensor_type          (handle, &tl->sensor_type))      != 0) TL_CameraErrMsg(rc, "Error determining sensor type for camera", rname);
-	if ( (rc = tl_camera_get_color_filter_array_phase    (handle, &tl->color_filter))     != 0) TL_CameraErrMsg(rc, "Error determining color filter array for camera", rname);
-	if ( (rc = tl_camera_get_color_correction_matrix     (handle,  tl->color_correction)) != 0) TL_CameraErrMsg(rc, "Error determining color correction for camera", rname);
-	if ( (rc = tl_camera_get_default_white_balance_matrix(handle,  tl->white_balance))    != 0) TL_CameraErrMsg(rc, "Error determining white balance for camera", rname);
-
-	if ( (rc = tl_camera_get_sensor_width                 (handle, &tl->sensor_width))    != 0) TL_CameraErrMsg(rc, "Unable to get sensor width", rname);
-	if ( (rc = tl_camera_get_sensor_height                (handle, &tl->sensor_height))   != 0) TL_CameraErrMsg(rc, "Unable to get sensor height", rname);
-	fprintf(stderr, "Camera enumeration: sensor size %d x %d\n", tl->sensor_width, tl->sensor_height); fflush(stderr);
-
-	if ( (rc = tl_camera_get_image_width                 (handle, &tl->width))            != 0) TL_CameraErrMsg(rc, "Unable to get image width", rname);
-	if ( (rc = tl_camera_get_image_height                (handle, &tl->height))           != 0) TL_CameraErrMsg(rc, "Unable to get image height", rname);
-	if ( (rc = tl_camera_get_bit_depth                   (handle, &tl->bit_depth))        != 0) TL_CameraErrMsg(rc, "Error determining bit depth for camera", rname);
-
-	if ( (rc = tl_camera_get_sensor_pixel_height         (handle, &tl->pixel_height_um))  != 0) TL_CameraErrMsg(rc, "Error determining pixel height for camera", rname);
-	if ( (rc = tl_camera_get_sensor_pixel_width          (handle, &tl->pixel_width_um))   != 0) TL_CameraErrMsg(rc, "Error determining pixel width for camera", rname);
-	if ( (rc = tl_camera_get_sensor_pixel_size_bytes     (handle, &tl->pixel_bytes))      != 0) TL_CameraErrMsg(rc, "Error determining pixel bytes for camera", rname);
-	tl->image_bytes = tl->pixel_bytes * tl->width * tl->height;
-	fprintf(stderr, "Camera enumeration: image size %d x %d\n", tl->width, tl->height); fflush(stderr);
+	if ( (rc = tl_camera_get_model                       (handle,  scan->model, sizeof(scan->model)))       != 0) TL_CameraErrMsg(rc, "Error determining model for camera", rname);
+	if ( (rc = tl_camera_get_serial_number               (handle,  scan->serial, sizeof(scan->serial)))     != 0) TL_CameraErrMsg(rc, "Error determining serial number for camera", rname);
+	if ( (rc = tl_camera_get_name								  (handle,  scan->name, sizeof(scan->name)))         != 0) TL_CameraErrMsg(rc, "Error determining name for camera", rname);
+	if ( (rc = tl_camera_get_firmware_version				  (handle,  scan->firmware, sizeof(scan->firmware))) != 0) TL_CameraErrMsg(rc, "Error determining firmware for camera", rname);
+
+	if ( (rc = tl_camera_get_camera_sensor_type          (handle, &scan->sensor_type))      != 0) TL_CameraErrMsg(rc, "Error determining sensor type for camera", rname);
+	if ( (rc = tl_camera_get_color_filter_array_phase    (handle, &scan->color_filter))     != 0) TL_CameraErrMsg(rc, "Error determining color filter array for camera", rname);
+	if ( (rc = tl_camera_get_color_correction_matrix     (handle,  scan->color_correction)) != 0) TL_CameraErrMsg(rc, "Error determining color correction for camera", rname);
+	if ( (rc = tl_camera_get_default_white_balance_matrix(handle,  scan->white_balance))    != 0) TL_CameraErrMsg(rc, "Error determining white balance for camera", rname);
+
+	if ( (rc = tl_camera_get_sensor_width                 (handle, &scan->sensor_width))    != 0) TL_CameraErrMsg(rc, "Unable to get sensor width", rname);
+	if ( (rc = tl_camera_get_sensor_height                (handle, &scan->sensor_height))   != 0) TL_CameraErrMsg(rc, "Unable to get sensor height", rname);
+	fprintf(stderr, "Camera enumeration: sensor size %d x %d\n", scan->sensor_width, scan->sensor_height); fflush(stderr);
 
-	if ( (rc = tl_camera_get_exposure_time_range         (handle, &tl->us_expose_min, &tl->us_expose_max)) != 0) TL_CameraErrMsg(rc, "Error determining min/max exposure time for camera", rname);
-	if ( (rc = tl_camera_get_exposure_time               (handle, &tl->us_expose))        != 0) TL_CameraErrMsg(rc, "Unable to set exposure time for camera", rname);
+	if ( (rc = tl_camera_get_image_width                 (handle, &scan->width))            != 0) TL_CameraErrMsg(rc, "Unable to get image width", rname);
+	if ( (rc = tl_camera_get_image_height                (handle, &scan->height))           != 0) TL_CameraErrMsg(rc, "Unable to get image height", rname);
+	if ( (rc = tl_camera_get_bit_depth                   (handle, &scan->bit_depth))        != 0) TL_CameraErrMsg(rc, "Error determining bit depth for camera", rname);
 
-	if ( (rc = tl_camera_get_timestamp_clock_frequency	  (handle, &tl->clock_Hz))         != 0) TL_CameraErrMsg(rc, "Unable to get camera clock frequency", rname);
+	if ( (rc = tl_camera_get_sensor_pixel_height         (handle, &scan->pixel_height_um))  != 0) TL_CameraErrMsg(rc, "Error determining pixel height for camera", rname);
+	if ( (rc = tl_camera_get_sensor_pixel_width          (handle, &scan->pixel_width_um))   != 0) TL_CameraErrMsg(rc, "Error determining pixel width for camera", rname);
+	if ( (rc = tl_camera_get_sensor_pixel_size_bytes     (handle, &scan->pixel_bytes))      != 0) TL_CameraErrMsg(rc, "Error determining pixel bytes for camera", rname);
+	fprintf(stderr, "Camera enumeration: image size %d x %d\n", scan->width, scan->height); fflush(stderr);
+
+	if ( (rc = tl_camera_get_exposure_time_range         (handle, &scan->us_expose_min, &scan->us_expose_max)) != 0) TL_CameraErrMsg(rc, "Error determining min/max exposure time for camera", rname);
+	if ( (rc = tl_camera_get_exposure_time               (handle, &scan->us_expose))        != 0) TL_CameraErrMsg(rc, "Unable to set exposure time for camera", rname);
+
+	if ( (rc = tl_camera_get_timestamp_clock_frequency	  (handle, &scan->clock_Hz))         != 0) TL_CameraErrMsg(rc, "Unable to get camera clock frequency", rname);
 
 	if ( (rc = tl_camera_get_gain_range                  (handle, &ilow, &ihigh))         != 0) TL_CameraErrMsg(rc, "Unable to get gain range for camera", rname);
-	tl->bGainControl = ihigh > 0;		
-	tl->db_min = 0.1*ilow; tl->db_max = 0.1*ihigh;
+	scan->bGainControl = ihigh > 0;
+	scan->db_min = 0.1*ilow; scan->db_max = 0.1*ihigh;
 
 	/* Try to enable framerate control */
-	tl->bFrameRateControl = FALSE;					/* Default unless everything succeeds */
-	tl->fps_min = 1; tl->fps_max = 40;
+	scan->bFrameRateControl = FALSE;					/* Default unless everything succeeds */
+	scan->fps_min = 1; scan->fps_max = 40;
 	if ( (rc = tl_camera_set_is_frame_rate_control_enabled(handle, TRUE)) != 0) {
 		TL_CameraErrMsg(rc, "Unable to enable frame rate control", rname);
-	} else if ( (rc = tl_camera_get_is_frame_rate_control_enabled(handle, &tl->bFrameRateControl)) != 0)  {
+	} else if ( (rc = tl_camera_get_is_frame_rate_control_enabled(handle, &scan->bFrameRateControl)) != 0)  {
 		TL_CameraErrMsg(rc, "Enabled frame rate, but then failed to verify", rname);
-	} else if ( (rc = tl_camera_get_frame_rate_control_value_range(handle, &tl->fps_min, &tl->fps_max)) != 0) {
+	} else if ( (rc = tl_camera_get_frame_rate_control_value_range(handle, &scan->fps_min, &scan->fps_max)) != 0) {
 		TL_CameraErrMsg(rc, "Error determining min/max frame rate for camera", rname);
-	} 
-	tl->fps_limit = 1000.0;								/* Deal with up to kHz rate */
+	}
 
-	tl->timer = HiResTimerCreate();					/* Timer to manage image times  */
-	tl->t_image = -10.0;									/* No image in last 100 seconds */
+	if ( (rc = tl_camera_close_camera(handle)) != 0) TL_CameraErrMsg(rc, "Failed to close camera", rname);
 
-	if ( (rc = tl_camera_close_camera(tl->handle)) != 0) TL_CameraErrMsg(rc, "Failed to close camera", rname);
-	tl->handle = NULL;
+	/* Publish to the camera and to the cache through the same record (an open camera keeps its own) */
+	strcpy_s(scan->ID, sizeof(scan->ID), tl->ID);
+	tl_cache_from_camera(&rec, scan);
+	EnterCriticalSection(&tl->info_lock);
+	if (tl->handle != NULL) {
+		fprintf(stderr, "[%s] Camera %s was opened during the query ... only the cache is updated\n", rname, tl->ID); fflush(stderr);
+	} else {
+		if (! tl->bDetailed && *tl->firmware != '\0' && strcmp(tl->firmware, scan->firmware) != 0) {
+			fprintf(stderr, "[%s] Camera %s: firmware changed since cached ... using new properties\n", rname, tl->ID); fflush(stderr);
+		}
+		tl_cache_to_camera(tl, &rec);
+		tl->bDetailed = TRUE;
+	}
+	LeaveCriticalSection(&tl->info_lock);
+	tl_cache_store(&rec);
+	free(scan);
 
-	/* Register in my list of known cameras and return with no error */
-	tl_camera_list[tl_camera_count++] = tl;
+	tl->query_rc = 0;
+	SetEvent(tl->query_done);
+	return;
+}
 
-	/* And return camera (*rcode already set at start) */
-	return tl;
+/* ===========================================================================
+-- Metadata cache (one fixed size record per camera, keyed by serial/firmware)
+--
+-- Usage: static BOOL tl_cache_lookup(char *ID, TL_CACHE_RECORD *rec);
+--        static int  tl_cache_store(TL_CACHE_RECORD *rec);
+--        static void tl_cache_from_camera(TL_CACHE_RECORD *rec, TL_CAMERA *tl);
+--        static void tl_cache_to_camera(TL_CAMERA *tl, TL_CACHE_RECORD *rec);
+--
+-- Inputs: ID  - camera ID from discovery (the serial number)
+--         rec - record to fill or store
+--         tl  - camera to copy from / to
+--
+-- Output: lookup fills *rec; store replaces any record with the same serial
+--         (a firmware change supersedes the old entry) and rewrites the file
+--
+-- Return: lookup - TRUE if found
+--         store  - 0 on success, 1 if cache disabled or file unwritable
+--
+-- Note: Lookup is by ID since firmware is not known until the camera is
+--       opened; the background query compares firmware and replaces the
+--       cached properties.  File access is serialized for the query threads.
+=========================================================================== */
+static BOOL tl_cache_lookup(char *ID, TL_CACHE_RECORD *rec) {
+
+	FILE *funit;
+	BOOL found;
+
+	if (*tl_cache_path == '\0') return FALSE;
+
+	found = FALSE;
+	EnterCriticalSection(&cache_lock);
+	if (fopen_s(&funit, tl_cache_path, "rb") == 0) {
+		while (fread(rec, sizeof(*rec), 1, funit) == 1) {
+			if (rec->magic != TL_CACHE_MAGIC || rec->record_size != sizeof(*rec)) break;		/* Old format ... ignore the rest */
+			if (_stricmp(rec->ID, ID) == 0) { found = TRUE; break; }
+		}
+		fclose(funit);
+	}
+	LeaveCriticalSection(&cache_lock);
+	return found;
+}
+
+static int tl_cache_store(TL_CACHE_RECORD *rec) {
+	static char *rname = "tl_cache_store";
+
+	FILE *funit;
+	TL_CACHE_RECORD *list;
+	int i, n;
+
+	if (*tl_cache_path == '\0') return 1;
+
+	EnterCriticalSection(&cache_lock);
+
+	/* Read existing records (keeping room for this one) */
+	list = calloc(TL_MAX_CACHE_RECORDS+1, sizeof(*list));
+	n = 0;
+	if (fopen_s(&funit, tl_cache_path, "rb") == 0) {
+		while (n < TL_MAX_CACHE_RECORDS && fread(list+n, sizeof(*list), 1, funit) == 1) {
+			if (list[n].magic != TL_CACHE_MAGIC || list[n].record_size != sizeof(*list)) break;
+			if (_stricmp(list[n].serial, rec->serial) != 0) n++;								/* Drop the old entry for this camera */
+		}
+		fclose(funit);
+	}
+	list[n++] = *rec;
+
+	/* Rewrite the whole file */
+	if (fopen_s(&funit, tl_cache_path, "wb") != 0) {
+		fprintf(stderr, "[%s] Unable to write camera cache %s\n", rname, tl_cache_path); fflush(stderr);
+		free(list);
+		LeaveCriticalSection(&cache_lock);
+		return 1;
+	}
+	for (i=0; i<n; i++) fwrite(list+i, sizeof(*list), 1, funit);
+	fclose(funit);
+
+	free(list);
+	LeaveCriticalSection(&cache_lock);
+	return 0;
+}
+
+static void tl_cache_from_camera(TL_CACHE_RECORD *rec, TL_CAMERA *tl) {
+
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = TL_CACHE_MAGIC;
+	rec->record_size = sizeof(*rec);
+
+	strcpy_s(rec->ID,       sizeof(rec->ID),       tl->ID);
+	strcpy_s(rec->name,     sizeof(rec->name),     tl->name);
+	strcpy_s(rec->model,    sizeof(rec->model),    tl->model);
+	strcpy_s(rec->serial,   sizeof(rec->serial),   tl->serial);
+	strcpy_s(rec->firmware, sizeof(rec->firmware), tl->firmware);
+
+	rec->sensor_type  = tl->sensor_type;
+	rec->color_filter = tl->color_filter;
+	memcpy(rec->color_correction, tl->color_correction, sizeof(rec->color_correction));
+	memcpy(rec->white_balance,    tl->white_balance,    sizeof(rec->white_balance));
+
+	rec->sensor_width = tl->sensor_width; rec->sensor_height = tl->sensor_height;
+	rec->pixel_width_um = tl->pixel_width_um; rec->pixel_height_um = tl->pixel_height_um;
+	rec->width = tl->width; rec->height = tl->height;
+	rec->bit_depth = tl->bit_depth;
+	rec->pixel_bytes = tl->pixel_bytes;
+
+	rec->us_expose_min = tl->us_expose_min; rec->us_expose_max = tl->us_expose_max;
+	rec->us_expose = tl->us_expose;
+	rec->clock_Hz = tl->clock_Hz;
+
+	rec->bGainControl = tl->bGainControl;
+	rec->db_min = tl->db_min; rec->db_max = tl->db_max;
+	rec->bFrameRateControl = tl->bFrameRateControl;
+	rec->fps_min = tl->fps_min; rec->fps_max = tl->fps_max;
+	return;
+}
+
+static void tl_cache_to_camera(TL_CAMERA *tl, TL_CACHE_RECORD *rec) {
+
+	strcpy_s(tl->name,     sizeof(tl->name),     rec->name);
+	strcpy_s(tl->model,    sizeof(tl->model),    rec->model);
+	strcpy_s(tl->serial,   sizeof(tl->serial),   rec->serial);
+	strcpy_s(tl->firmware, sizeof(tl->firmware), rec->firmware);
+
+	tl->sensor_type  = rec->sensor_type;
+	tl->color_filter = rec->color_filter;
+	memcpy(tl->color_correction, rec->color_correction, sizeof(tl->color_correction));
+	memcpy(tl->white_balance,    rec->white_balance,    sizeof(tl->white_balance));
+
+	tl->sensor_width = rec->sensor_width; tl->sensor_height = rec->sensor_height;
+	tl->pixel_width_um = rec->pixel_width_um; tl->pixel_height_um = rec->pixel_height_um;
+	tl->width = rec->width; tl->height = rec->height;
+	tl->bit_depth = rec->bit_depth;
+	tl->pixel_bytes = rec->pixel_bytes;
+	tl->image_bytes = tl->pixel_bytes * tl->width * tl->height;
+
+	tl->us_expose_min = rec->us_expose_min; tl->us_expose_max = rec->us_expose_max;
+	tl->us_expose = rec->us_expose;
+	tl->clock_Hz = rec->clock_Hz;
+
+	tl->bGainControl = rec->bGainControl;
+	tl->db_min = rec->db_min; tl->db_max = rec->db_max;
+	tl->bFrameRateControl = rec->bFrameRateControl;
+	tl->fps_min = rec->fps_min; tl->fps_max = rec->fps_max;
+	return;
 }
 
 
@@ -515,6 +843,8 @@ int TL_SetROI(TL_CAMERA *tl, int x0, int y0, int x1, int y1) {
 
 	if ( (rc = tl_camera_set_roi(handle, x0,y0, x1,y1)) != 0) {		/* reset ROI */
 		TL_CameraErrMsg(rc, "Failed to set ROI", rname);
+		ReleaseMutex(tl->image_mutex);
+		tl->suspend_image_processing--;
 		return 1;
 	} 
 
@@ -526,7 +856,7 @@ int TL_SetROI(TL_CAMERA *tl, int x0, int y0, int x1, int y1) {
 
 	tl_camera_get_image_width(handle, &width);
 	tl_camera_get_image_height(handle, &height);
-	if (width != tl->width || height != tl->height) set_image_size_and_buffers(tl);
+	if (width != tl->raw_width || height != tl->raw_height) set_image_size_and_buffers(tl);
 //	fprintf(stderr, "Requested ROI: (%d,%d) (%d,%d)  Actual ROI: (%d,%d) x (%d,%d)\n", x0,y0, x1,y1, tl->roi.ulx,tl->roi.uly, tl->roi.lrx,tl->roi.lry); fflush(stderr);
 
 	/* Release mutex, re-enable image processing, and re-arm if had been armed */
@@ -540,6 +870,120 @@ int TL_SetROI(TL_CAMERA *tl, int x0, int y0, int x1, int y1) {
 	return 0;
 }
 
+/* ===========================================================================
+-- Set the binning of the images (same factor in x and y)
+--
+-- Usage: int TL_SetBinning(TL_CAMERA *tl, int bin, BOOL bSoftware);
+--
+-- Inputs: tl        - an opened TL camera
+--         bin       - binning factor (1 ==> none, up to MAX_BINNING)
+--         bSoftware - if TRUE, bin in the frame callback even if the
+--                     sensor could do it
+--
+-- Output: Sensor binning is used when the SDK supports the factor on a
+--         monochrome sensor.  Otherwise frames are averaged in the callback
+--         (SSE2, CFA-aware so color frames remain a valid Bayer mosaic).
+--         Ring slots are resized to the binned full sensor.  The number
+--         of slots is not changed.
+--
+-- Return: 0 if successful
+--           1 => no camera initialized
+--           2 => bin out of range
+--           3 => SDK failed to set the hardware binning
+=========================================================================== */
+int TL_SetBinning(TL_CAMERA *tl, int bin, BOOL bSoftware) {
+	static char *rname = "TL_SetBinning";
+
+	FILE *handle;
+	int rc, trig_mode;
+	int hmin, hmax, vmin, vmax;
+	int hw_bin, sw_bin;
+
+	/* Validate structure and camera active */
+	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC || tl->handle == NULL) return 1;
+	if (bin < 1 || bin > MAX_BINNING) return 2;
+
+	/* Make my life a bit easier */
+	handle = tl->handle;
+
+	/* Decide hardware vs software split (color sensors bin on-chip across colors, so never) */
+	hw_bin = 1; sw_bin = bin;
+	if (! bSoftware && ! tl->IsSensorColor &&
+		 tl_camera_get_binx_range(handle, &hmin, &hmax) == 0 && tl_camera_get_biny_range(handle, &vmin, &vmax) == 0 &&
+		 bin >= max(hmin,vmin) && bin <= min(hmax,vmax)) {
+		hw_bin = bin; sw_bin = 1;
+	}
+	if (hw_bin == tl->hw_bin && sw_bin == tl->sw_bin) return 0;
+
+	/* Stop camera if armed, suspend image processing, and take control of image buffers */
+	if (tl->trigger.bArmed) tl_camera_disarm(handle);
+	tl->suspend_image_processing++;
+	WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT);
+
+	rc = 0;
+	if (hw_bin != tl->hw_bin) {
+		if ( (rc = tl_camera_set_binx(handle, hw_bin)) != 0 || (rc = tl_camera_set_biny(handle, hw_bin)) != 0) {
+			TL_CameraErrMsg(rc, "Failed to set hardware binning", rname);
+			tl_camera_set_binx(handle, tl->hw_bin);
+			tl_camera_set_biny(handle, tl->hw_bin);
+			rc = 3;
+		}
+	}
+	if (rc == 0) tl->sw_bin = sw_bin;
+
+	/* Slots follow the binned full sensor (shrink as well as grow) */
+	tl->nbytes_slot = 0;
+	set_image_size_and_buffers(tl);
+	tl_camera_get_roi(handle, &tl->roi.ulx, &tl->roi.uly, &tl->roi.lrx, &tl->roi.lry);
+
+	/* Release mutex, re-enable image processing, and re-arm if had been armed */
+	ReleaseMutex(tl->image_mutex);
+	tl->suspend_image_processing--;
+
+	/* And reset the triggering */
+	trig_mode = tl->trigger.mode; tl->trigger.mode = -1;					/* Save trigger mode and set so different */
+	TL_SetTriggerMode(tl, trig_mode, NULL);									/* Should restart */
+
+	return rc;
+}
+
+/* ===========================================================================
+-- Report the current binning
+--
+-- Usage: int TL_GetBinning(TL_CAMERA *tl, BINNING_INFO *info);
+--
+-- Inputs: tl   - an opened TL camera
+--         info - pointer to structure to receive the state
+--
+-- Output: *info - factors, binned image size and pixel size
+--
+-- Return: 0 if successful, 1 if no camera initialized
+=========================================================================== */
+int TL_GetBinning(TL_CAMERA *tl, BINNING_INFO *info) {
+	static char *rname = "TL_GetBinning";
+
+	int hmin, hmax, vmin, vmax;
+
+	if (info != NULL) memset(info, 0, sizeof(*info));
+	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC || tl->handle == NULL) return 1;
+	if (info == NULL) return 0;
+
+	info->bin      = tl->bin;
+	info->hardware = tl->hw_bin;
+	info->software = tl->sw_bin;
+	info->max_hardware = 1;
+	if (! tl->IsSensorColor &&
+		 tl_camera_get_binx_range(tl->handle, &hmin, &hmax) == 0 && tl_camera_get_biny_range(tl->handle, &vmin, &vmax) == 0) {
+		info->max_hardware = max(1, min(hmax, vmax));
+	}
+	info->width      = tl->width;
+	info->height     = tl->height;
+	info->x_pixel_um = tl->pixel_width_um  * tl->bin;
+	info->y_pixel_um = tl->pixel_height_um * tl->bin;
+
+	return 0;
+}
+
 /* ===========================================================================
 -- Internal routine to deal with all parameters in tl associated with image size
 -- and image buffers
@@ -554,52 +998,107 @@ int TL_SetROI(TL_CAMERA *tl, int x0, int y0, int x1, int y1) {
 -- Return: 0 if successful, !0 otherwise (no checks currently)
 --
 -- Notes: Assumes that thread owns the memory and nothing is running
+--
+--        Ring buffers and the derived rgb24 / separation buffers are sized
+--        for the full sensor the first time through, so later ROI changes
+--        only update the geometry and byte counts.  Nothing is freed or
+--        reallocated unless the image is somehow larger than the sensor.
+--
+--        tl->width/height are the binned size stored in the ring.  With
+--        software binning (tl->sw_bin > 1) the SDK delivers raw_width x
+--        raw_height frames that are reduced in frame_available_callback.
+--        TL_SetBinning zeros nbytes_slot so the slots are resized to the
+--        binned full sensor.
+--
+--        Ring protocol: most readers copy from tl->images[] without holding
+--        image_mutex.  frame_available_callback sets a slot's imageID to -1
+--        before it writes any pixel or metadata, and stores the new imageID
+--        (then iLast) only after both are complete, with a memory barrier
+--        at each step.  A reader takes the imageID, copies, then reads the
+--        imageID again; the copy is whole only if both reads agree and are
+--        not -1.  TL_GetImageInfo applies the same check to the metadata.
 =========================================================================== */
 static int set_image_size_and_buffers(TL_CAMERA *tl) {
 	static char *rname = "set_image_size_and_buffers";
 
 	FILE *handle;
-	int i;
+	int i, k, full_pixels;
+	void *ptr;
 	
 	handle = tl->handle;
 
-	/* Query image size information */
-	tl_camera_get_image_width(handle, &tl->width);
-	tl_camera_get_image_height(handle, &tl->height);
+	/* Query image size information (SDK size is after any hardware binning) */
+	tl_camera_get_image_width(handle, &tl->raw_width);
+	tl_camera_get_image_height(handle, &tl->raw_height);
 	tl_camera_get_sensor_pixel_size_bytes(handle, &tl->pixel_bytes);
+	if (tl_camera_get_binx(handle, &tl->hw_bin) != 0 || tl->hw_bin < 1) tl->hw_bin = 1;
+
+	/* Software binning reduces the frames before they reach the ring */
+	if (tl->sw_bin < 1) tl->sw_bin = 1;
+	if (IP_BinSize(tl->raw_width, tl->raw_height, tl->sw_bin, tl->IsSensorColor, &tl->width, &tl->height) != 0) {
+		fprintf(stderr, "[%s] Image %d x %d too small for %dx%d software binning ... disabled\n", rname, tl->raw_width, tl->raw_height, tl->sw_bin, tl->sw_bin); fflush(stderr);
+		tl->sw_bin = 1;
+		tl->width = tl->raw_width; tl->height = tl->raw_height;
+	}
+	tl->bin = tl->hw_bin * tl->sw_bin;
 	tl->image_bytes = tl->pixel_bytes * tl->width * tl->height;
 
 	/* set number of pixels and image buffer byte size (assume 16-bit values) */
 	tl->npixels = tl->width * tl->height;
 	tl->nbytes_raw = sizeof(unsigned short) * tl->npixels;
+	full_pixels = max(tl->npixels, (tl->sensor_width/tl->bin) * (tl->sensor_height/tl->bin));
+
+	/* Binned frame is staged here before it is copied (or filtered) into a ring slot */
+	if (tl->sw_bin > 1 && tl->nbytes_raw > tl->bin_alloc) {
+		tl->bin_alloc = (int) sizeof(unsigned short) * full_pixels;
+		if ( (tl->bin_buffer = realloc(tl->bin_buffer, tl->bin_alloc)) == NULL) tl->bin_alloc = 0;
+	}
+
+	/* Column totals for IP_Bin16 so the callback never allocates */
+	if (tl->sw_bin > 1 && tl->raw_width > tl->bin_nsums) {
+		tl->bin_nsums = max(tl->raw_width, tl->sensor_width);
+		if ( (tl->bin_sums = realloc(tl->bin_sums, tl->bin_nsums*sizeof(*tl->bin_sums))) == NULL) tl->bin_nsums = 0;
+	}
 
 	/* If color sensor, create RGB channels for a separation of a raw frame */
 	if (tl->IsSensorColor) {
 		tl->nbytes_red   = tl->nbytes_raw / 4;
 		tl->nbytes_green = tl->nbytes_raw / 2;
 		tl->nbytes_blue  = tl->nbytes_raw / 4;
-		tl->red   = realloc(tl->red,   tl->nbytes_red);
-		tl->green = realloc(tl->green, tl->nbytes_green);
-		tl->blue  = realloc(tl->blue,  tl->nbytes_blue);
+		if (tl->nbytes_green > tl->nalloc_separations) {
+			tl->nalloc_separations = (int) sizeof(unsigned short) * full_pixels / 2;
+			tl->red   = realloc(tl->red,   tl->nalloc_separations);
+			tl->green = realloc(tl->green, tl->nalloc_separations);
+			tl->blue  = realloc(tl->blue,  tl->nalloc_separations);
+		}
 	}
 
 	/* If color sensor, create RGB combined buffer */
 	if (tl->IsSensorColor) {
 		tl->rgb24_nbytes = 3 * tl->width * tl->height;
-		tl->rgb24 = realloc(tl->rgb24, tl->rgb24_nbytes);
+		if (tl->rgb24_nbytes > tl->rgb24_alloc) {
+			tl->rgb24_alloc = 3 * full_pixels;
+			tl->rgb24 = realloc(tl->rgb24, tl->rgb24_alloc);
+		}
 	}
 
 	/* Clear the timestamps on separations just in case */
 	tl->rgb24_imageID = tl->separations_imageID = -1;
 
-	/* If we have buffers allocated, free them and recreate */
+	/* Frames in the ring have the old geometry, so restart it (no memory is touched) */
 	tl->nValid = tl->iLast = tl->iShow = 0;
-	for (i=0; i<tl->nBuffers; i++) { free(tl->images[i].raw); tl->images[i].raw = NULL; }
-	for (i=0; i<tl->nBuffers; i++) { 
-		if ( (tl->images[i].raw = malloc(tl->nbytes_raw)) == NULL) {
-			fprintf(stderr, "[%s] Only able to allocate %d buffers for this ROI size\n", rname, i); fflush(stderr);
-			tl->nBuffers = i;
-			break;
+
+	/* Ring buffers only need to change if this image doesn't fit the slots (or binning changed) */
+	if (tl->nbytes_raw > tl->nbytes_slot) {
+		tl->nbytes_slot = (int) sizeof(unsigned short) * full_pixels;
+		for (i=0; i<tl->nBuffers; i++) { 
+			if ( (ptr = realloc(tl->images[i].raw, tl->nbytes_slot)) == NULL) {
+				fprintf(stderr, "[%s] Only able to allocate %d buffers for this ROI size\n", rname, i); fflush(stderr);
+				for (k=i; k<tl->nBuffers; k++) { free(tl->images[k].raw); tl->images[k].raw = NULL; }
+				tl->nBuffers = i;
+				break;
+			}
+			tl->images[i].raw = ptr;
 		}
 	}
 
@@ -634,6 +1133,7 @@ int TL_OpenCamera(TL_CAMERA *tl, int nBuf) {
 
 	FILE *handle;
 	int rc, rcode;
+	BOOL bQuery;
 
 	/* Verify that the structure is valid and hasn't already been closed */
 	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC) return 0x8001;
@@ -641,10 +1141,29 @@ int TL_OpenCamera(TL_CAMERA *tl, int nBuf) {
 	/* Are we already open and initialized? */
 	if (tl->handle != NULL) return 0;	
 
-	/* Open the camera first and make sure it exists */
-	if ( (rc = tl_camera_open_camera(tl->ID, &tl->handle)) != 0) {
+	/* A discovery query may still hold the device.  With cached properties, try at once
+	 * (the query leaves an open camera alone) and wait only if the device is busy */
+	bQuery = tl->query_done != NULL && WaitForSingleObject(tl->query_done, 0) != WAIT_OBJECT_0;
+	if (bQuery && ! tl->bCached) {
+		if (WaitForSingleObject(tl->query_done, TL_QUERY_TIMEOUT) != WAIT_OBJECT_0) {
+			fprintf(stderr, "[%s] Camera %s is still being queried ... trying to open anyway\n", rname, tl->ID); fflush(stderr);
+		}
+		bQuery = FALSE;
+	}
+
+	/* Open the camera first and make sure it exists (handle set under info_lock for the query) */
+	EnterCriticalSection(&tl->info_lock);
+	if ( (rc = tl_camera_open_camera(tl->ID, &tl->handle)) != 0) tl->handle = NULL;
+	LeaveCriticalSection(&tl->info_lock);
+	if (rc != 0 && bQuery) {
+		fprintf(stderr, "[%s] Camera %s is busy with its discovery query ... waiting\n", rname, tl->ID); fflush(stderr);
+		WaitForSingleObject(tl->query_done, TL_QUERY_TIMEOUT);
+		EnterCriticalSection(&tl->info_lock);
+		if ( (rc = tl_camera_open_camera(tl->ID, &tl->handle)) != 0) tl->handle = NULL;
+		LeaveCriticalSection(&tl->info_lock);
+	}
+	if (rc != 0) {
 		TL_CameraErrMsg(rc, "Error opening camera", rname);
-		tl->handle = NULL;
 		return 0x8002;
 	}
 	handle = tl->handle;
@@ -691,8 +1210,13 @@ int TL_OpenCamera(TL_CAMERA *tl, int nBuf) {
 	/* Allocate buffers using common code (needs image_mutex and all image size info) */
 	TL_SetRingBufferSize(tl, nBuf);			/* mutex has to be defined first */
 	
-	/* Register routine that will process images */
-	if ( (rc = tl_camera_set_frame_available_callback(handle, frame_available_callback, 0)) != 0) { 
+	/* imageIDs come from the common sequence (TL_NextImageID) ... nothing delivered yet */
+	tl->image_count = TL_NextImageID(FALSE);
+	tl->frames_received = tl->frames_stored = tl->frames_skipped = tl->frames_missed = 0;
+	tl->host_time = 0.0;
+
+	/* Register routine that will process images (context identifies the camera) */
+	if ( (rc = tl_camera_set_frame_available_callback(handle, frame_available_callback, tl)) != 0) { 
 		TL_CameraErrMsg(rc, "Unable to set frame_available_callback", rname);
 		rcode |= 0x10;
 	}
@@ -736,8 +1260,8 @@ int TL_GetCameraInfo(TL_CAMERA *tl, CAMERA_INFO *info) {
 	strcpy_m(info->version,			sizeof(info->version),		 "<unknown>");
 	strcpy_m(info->date,				sizeof(info->date),			 "<unknown>");
 
-	info->x_pixel_um = tl->pixel_height_um;
-	info->y_pixel_um = tl->pixel_width_um;
+	info->x_pixel_um = tl->pixel_height_um * tl->bin;
+	info->y_pixel_um = tl->pixel_width_um  * tl->bin;
 	info->bColor     = tl->IsSensorColor;
 	info->height     = tl->height;
 	info->width      = tl->width;
@@ -770,6 +1294,7 @@ int TL_SetRingBufferSize(TL_CAMERA *tl, int nBuf) {
 
 	/* Get access to the memory structures */
 	if (WAIT_OBJECT_0 != WaitForSingleObject(tl->image_mutex, 5*TL_IMAGE_ACCESS_TIMEOUT)) {
+		Perf_Count(PERF_MUTEX_TIMEOUTS, 1);
 		fprintf(stderr, "[%s] Unable to get image memory semaphore to modify ring buffer structures\n", rname); fflush(stderr);
 		return 0;
 	}
@@ -791,7 +1316,7 @@ int TL_SetRingBufferSize(TL_CAMERA *tl, int nBuf) {
 		for (i=tl->nBuffers; i<nBuf; i++) {															/* Start adding image buffers	*/
 			tl->images[i].tl    = tl;																	/* Access to other info			*/
 			tl->images[i].index = i;																	/* Immediately index				*/
-			if ( (tl->images[i].raw = malloc(tl->nbytes_raw)) == NULL) {
+			if ( (tl->images[i].raw = malloc(tl->nbytes_slot)) == NULL) {
 				fprintf(stderr, "[%s] Only able to increase buffer size to %d\n", rname, i); fflush(stderr);
 				nBuf = i;
 				break;
@@ -891,6 +1416,8 @@ int TL_CloseCamera(TL_CAMERA *tl) {
 	if (tl->green     != NULL) { free(tl->green);     tl->green     = NULL; }
 	if (tl->blue      != NULL) { free(tl->blue);      tl->blue      = NULL; }
 	if (tl->rgb24     != NULL) { free(tl->rgb24);     tl->rgb24     = NULL; }
+	if (tl->bin_buffer != NULL) { free(tl->bin_buffer); tl->bin_buffer = NULL; tl->bin_alloc = 0; }
+	if (tl->bin_sums   != NULL) { free(tl->bin_sums);   tl->bin_sums   = NULL; tl->bin_nsums = 0; }
 
 	/* Release semaphores */
 	CloseHandle(tl->image_mutex);
@@ -926,6 +1453,13 @@ int TL_ForgetCamera(TL_CAMERA *tl) {
 	/* Close if not already done */
 	TL_CloseCamera(tl);
 
+	/* A discovery query thread still references the structure */
+	if (tl->query_done != NULL) {
+		WaitForSingleObject(tl->query_done, INFINITE);
+		CloseHandle(tl->query_done);
+		tl->query_done = NULL;
+	}
+
 	/* Remove from the list of known cameras */
 	for (i=0; i<tl_camera_count; i++) {
 		if (tl_camera_list[i] == tl) {
@@ -942,6 +1476,7 @@ int TL_ForgetCamera(TL_CAMERA *tl) {
 
 	/* Finally mark the structure invalid and release the structure itself */
 	tl->magic = 0;
+	DeleteCriticalSection(&tl->info_lock);
 	free(tl);
 	return 0;
 }
@@ -1024,6 +1559,50 @@ TL_CAMERA *TL_FindCameraByHandle(void *handle) {
 	return NULL;
 }
 
+/* ===========================================================================
+-- Common clock for frame arrival times (TL_IMAGE host_time)
+--
+-- Usage: double TL_HostTime(void);
+--
+-- Return: seconds since TL_Initialize() on the high resolution timer,
+--         the same clock for every camera so arrivals can be compared
+=========================================================================== */
+double TL_HostTime(void) {
+	if (host_timer == NULL) host_timer = HiResTimerCreate();
+	return HiResTimerDelta(host_timer);
+}
+
+/* ===========================================================================
+-- Common imageID sequence for frames from every camera
+--
+-- Usage: int TL_NextImageID(BOOL bTake);
+--
+-- Inputs: bTake - TRUE to take an ID for a new frame, FALSE to only look
+--
+-- Return: imageID for the new frame (or the one the next frame will get)
+--
+-- Notes: Every TL and SIM camera numbers its frames from this one counter,
+--        so an imageID never names frames from two cameras.  One camera's
+--        imageIDs increase but are not consecutive while others capture.
+=========================================================================== */
+int TL_NextImageID(BOOL bTake) {
+	return bTake ? InterlockedIncrement(&next_imageID)-1 : next_imageID ;
+}
+
+/* ===========================================================================
+-- One past the newest imageID a camera has delivered
+--
+-- Usage: int TL_GetImageCount(TL_CAMERA *tl);
+--
+-- Return: -1 if tl is not valid, otherwise one more than the imageID of
+--         the last frame delivered by the SDK (including any skipped or
+--         missed by the ring), or the common next imageID at open if none
+=========================================================================== */
+int TL_GetImageCount(TL_CAMERA *tl) {
+	if (! TL_IsValidCamera(tl)) return -1;
+	return tl->image_count;
+}
+
 
 /* ===========================================================================
 -- Enumerate list of available cameras into an array structure for use with the
@@ -1159,6 +1738,36 @@ int TL_RemoveImageSignal(TL_CAMERA *tl, HANDLE signal) {
 	return 2;
 }
 
+/* ===========================================================================
+-- Routine to install a filter applied as each frame is copied into the ring
+--
+-- Usage: int TL_SetFrameFilter(TL_CAMERA *tl, TL_FRAME_FILTER filter, void *context);
+--
+-- Inputs: tl      - valid pointer to an existing opened camera
+--         filter  - function producing the ring data from the sensor data
+--                   (NULL ==> plain copy)
+--         context - passed through to the filter
+--
+-- Output: Every later frame is written to the ring by the filter, so all
+--         users of the ring (display, statistics, save, server) see the
+--         filtered data.  The filter runs in the SDK callback with the
+--         image mutex held and must be fast.
+--
+-- Return: 0 if successful, 1 if camera invalid, 2 if unable to get the mutex
+=========================================================================== */
+int TL_SetFrameFilter(TL_CAMERA *tl, TL_FRAME_FILTER filter, void *context) {
+	static char *rname = "TL_SetFrameFilter";
+
+	/* Verify that the structure is valid and hasn't already been closed */
+	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC) return 1;
+
+	if (WAIT_OBJECT_0 != WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) { Perf_Count(PERF_MUTEX_TIMEOUTS, 1); return 2; }
+	tl->frame_filter = filter;
+	tl->frame_filter_context = context;
+	ReleaseMutex(tl->image_mutex);
+	return 0;
+}
+
 
 /* ===========================================================================
 -- Routines to be called when a camera connects / disconnects 
@@ -1201,7 +1810,7 @@ static void camera_disconnect_callback(char *camera_ID, void* context) {
 --         frame_count - frame number from the camera
 --         metadata    - metadata in form of 4-char string 4-byte values
 --         metadata_size_in_bytes - number of metadata blocks
---         context     - unused
+--         context     - TL_CAMERA * registered in TL_OpenCamera
 --
 -- Output: processes the new image and stores information in the camera
 --         structure.  Note that all use of "raw_data" must be completed
@@ -1218,10 +1827,10 @@ static void frame_available_callback(void* sender, unsigned short* image_buffer,
 	
 	TL_CAMERA *tl;
 	int i;
-
-	/* As there may be other cameras, have global common image counter */
+	unsigned short *src, *dst;					/* Frame after software binning */
+	double host_time;								/* Arrival on the common clock */
 	int imageID;									/* ID for this invokation */
-	static sig_atomic_t image_count = 0;	/* Every call increments */
+	LONGLONG t_entry, t_commit;				/* Stage timing (Perf_Start) */
 
 	/* Variables to process the metadata */
 	UINT32 dval;									/* 4-byte integer */
@@ -1231,9 +1840,10 @@ static void frame_available_callback(void* sender, unsigned short* image_buffer,
 	} timestamp;
 	char tag[5];
 
-/* Immediately increment to have this call's image ID */
-	imageID = image_count++;
-	
+/* Arrival time first, before any processing */
+	host_time = TL_HostTime();
+	t_entry = Perf_Start();
+
 /* Now start rest of the process */
 	timestamp.value = 0;
 	for (i=0; i<metadata_size_in_bytes; i+=8) {
@@ -1254,22 +1864,52 @@ static void frame_available_callback(void* sender, unsigned short* image_buffer,
 		}
 	}
 
-	/* Find the camera generating the call */
-	if ( (tl = TL_FindCameraByHandle(sender)) == NULL) {
+	/* Find the camera generating the call (registered as the context, list search as backup) */
+	tl = (TL_CAMERA *) context;
+	if (! TL_IsValidCamera(tl) || tl->handle != sender) tl = TL_FindCameraByHandle(sender);
+	if (tl == NULL) {
 		fprintf(stderr, "ERROR: Unable to identify the camera for this callback\n"); fflush(stderr);
 		return;
 	}
-	
+
+	/* imageIDs are unique across cameras (callbacks for one camera are serialized) */
+	imageID = TL_NextImageID(TRUE);
+	tl->image_count = imageID+1;
+	tl->frames_received++;
+	Perf_Count(PERF_FRAMES_RECEIVED, 1);
+	Perf_TraceBegin("TL callback", imageID);
+
 	/* Are we "suspended" from processing images */
-	if (tl->suspend_image_processing) return;
+	if (tl->suspend_image_processing) { tl->frames_skipped++; Perf_TraceEnd("TL callback", imageID); return; }
 
 	/* And are images coming faster than we want to handle? */
-	if (HiResTimerDelta(tl->timer)-tl->t_image < 1.0/tl->fps_limit) return;
+	if (HiResTimerDelta(tl->timer)-tl->t_image < 1.0/tl->fps_limit) {
+		tl->frames_skipped++;
+		Perf_Count(PERF_FRAMES_LIMITED, 1);
+		Perf_TraceEnd("TL callback", imageID);
+		return;
+	}
 	tl->t_image = HiResTimerDelta(tl->timer);		/* This is now the last image time */
 
 	/* Take control of the memory buffers */
-	if (WAIT_OBJECT_0 == WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) {
+	if (tl_lock_images(tl, TL_IMAGE_ACCESS_TIMEOUT, imageID)) {
 		int ibuf;							/* Which buffer gets the data */
+		t_commit = Perf_Start();
+
+		/* Software binning first, staged in bin_buffer so a frame that can't be binned never touches the ring */
+		src = image_buffer;
+		if (tl->sw_bin > 1) {
+			dst = tl->bin_buffer;
+			if (dst == NULL || IP_Bin16(image_buffer, tl->raw_width, tl->raw_height, tl->sw_bin, tl->IsSensorColor, dst, (tl->bin_nsums >= tl->raw_width) ? tl->bin_sums : NULL) != 0) {
+				tl_unlock_images(tl, imageID);
+				Perf_Stop(PERF_RING_COMMIT, t_commit);
+				tl->frames_missed++;
+				Perf_TraceEnd("TL callback", imageID);
+				Perf_Stop(PERF_CALLBACK, t_entry);
+				return;
+			}
+			src = dst;
+		}
 
 		/* Put into the next available position */
 		ibuf = (tl->nValid == 0) ? 0 : (tl->iLast+1) % tl->nBuffers;
@@ -1279,33 +1919,45 @@ static void frame_available_callback(void* sender, unsigned short* image_buffer,
 			ibuf = (ibuf+1) % tl->nBuffers;
 		}
 
-		/* Save where we are and increment the number of valid (up to nBuffers) */
-		tl->iLast = ibuf;
-		tl->nValid = max(tl->nValid, ibuf+1);				/* Number now valid */
-//		fprintf(stderr, "Reseting iLast and nValid: %d %d\n", tl->iLast, tl->nValid); fflush(stderr);
+		/* Retire the slot's old frame before any byte of it changes (see TL_IMAGE ring protocol) */
+		tl->images[ibuf].imageID = -1;
+		MemoryBarrier();
 
 		/* Copy raw data from sensor (<0.45 ms) and generate metadata */
 		/* Image timestamp documentation (page 42) incorrect ... clock seems to be exactly 99 MHz, not reported value */
-		tl->images[ibuf].imageID = imageID;
 		GetLocalTime(&tl->images[ibuf].system_time);
 		tl->images[ibuf].timestamp = _time64(NULL);
 		tl->images[ibuf].camera_time = timestamp.value/99000000.0;
-		memcpy(tl->images[ibuf].raw, image_buffer, tl->nbytes_raw);
+		tl->images[ibuf].host_time   = host_time;
+
+		if (tl->frame_filter == NULL ||
+			 tl->frame_filter(tl->frame_filter_context, src, tl->images[ibuf].raw, tl->width, tl->height, imageID) != 0) {
+			if (src != tl->images[ibuf].raw) memcpy(tl->images[ibuf].raw, src, tl->nbytes_raw);
+		}
 
 		/* Copy imaging conditions now */
 		tl->images[ibuf].dB_gain   = tl->dB_gain;
 		tl->images[ibuf].ms_expose = tl->ms_expose;
 		tl->images[ibuf].valid = TRUE;
 
+		/* Publish only now that pixels and metadata are complete */
+		MemoryBarrier();
+		tl->images[ibuf].imageID = imageID;
+		tl->iLast = ibuf;
+		tl->nValid = max(tl->nValid, ibuf+1);				/* Number now valid */
+
 		/* Copy framecount and mark raw data valid, other datas "not done" */
 		tl->frame_count = frame_count;
+		tl->host_time = host_time;
+		tl->frames_stored++;
 
 		/* These are optional ... no reason to do unless they are used later */
 //		TL_ProcessRawSeparation(camera);
 //		TL_ProcessRGB(camera);
 
 		/* We are done needing exclusive access to the memory buffers */
-		ReleaseMutex(tl->image_mutex);
+		tl_unlock_images(tl, imageID);
+		Perf_Stop(PERF_RING_COMMIT, t_commit);
 
 //		fprintf(stderr, "[%4.4d] %10.6f:  %10.6f  sender: 0x%p  buffer: 0x%p  meta_buffer: 0x%p  size: %d\n", frame_count, HiResTimerDelta(timer), tl->timestamp, sender, image_buffer, metadata, metadata_size_in_bytes);
 
@@ -1313,8 +1965,50 @@ static void frame_available_callback(void* sender, unsigned short* image_buffer,
 		for (i=0; i<TL_MAX_SIGNALS; i++) {
 			if (tl->new_image_signals[i] != NULL) SetEvent(tl->new_image_signals[i]);
 		}
+	} else {
+		tl->frames_missed++;
+	}
+
+	Perf_TraceEnd("TL callback", imageID);
+	Perf_Stop(PERF_CALLBACK, t_entry);
+	return;
+}
+
+/* ===========================================================================
+-- Take and release tl->image_mutex for the frame paths
+--
+-- Usage: static BOOL tl_lock_images(TL_CAMERA *tl, DWORD msWait, int imageID);
+--        static void tl_unlock_images(TL_CAMERA *tl, int imageID);
+--
+-- Inputs: tl      - camera
+--         msWait  - timeout for the wait (ms)
+--         imageID - frame being worked on (-1 if unknown), for the trace only
+--
+-- Return: tl_lock_images() TRUE if the mutex is now held
+--
+-- Notes: Wraps the wait and the hold in trace spans so contention between
+--        the callback, image thread, autosave and server shows on the
+--        timeline.  Timeouts are counted (PERF_MUTEX_TIMEOUTS).
+=========================================================================== */
+static BOOL tl_lock_images(TL_CAMERA *tl, DWORD msWait, int imageID) {
+	BOOL rc;
+
+	Perf_TraceBegin("image_mutex wait", imageID);
+	rc = (WAIT_OBJECT_0 == WaitForSingleObject(tl->image_mutex, msWait));
+	Perf_TraceEnd("image_mutex wait", imageID);
+
+	if (rc) {
+		Perf_TraceBegin("image_mutex held", imageID);
+	} else {
+		Perf_Count(PERF_MUTEX_TIMEOUTS, 1);
+		Perf_TraceInstant("image_mutex timeout", imageID);
 	}
+	return rc;
+}
 
+static void tl_unlock_images(TL_CAMERA *tl, int imageID) {
+	ReleaseMutex(tl->image_mutex);
+	Perf_TraceEnd("image_mutex held", imageID);
 	return;
 }
 
@@ -1358,7 +2052,7 @@ int TL_ProcessRawSeparation(TL_CAMERA *tl, int frame) {
 	if (tl->images == NULL || tl->red == NULL || tl->green == NULL || tl->blue == NULL) return 3;
 
 	/* Get control of the memory buffers */
-	if (WAIT_OBJECT_0 == WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) {
+	if (tl_lock_images(tl, TL_IMAGE_ACCESS_TIMEOUT, tl->images[frame].imageID)) {
 
 		/* Separate the raw signal into raw red/green/blue buffers */
 		raw = tl->images[frame].raw;			/* Point to the requested buffer */
@@ -1373,7 +2067,7 @@ int TL_ProcessRawSeparation(TL_CAMERA *tl, int frame) {
 			}
 		}
 		tl->separations_imageID = tl->images[frame].imageID;
-		ReleaseMutex(tl->image_mutex);												/* Done with the mutex */
+		tl_unlock_images(tl, tl->separations_imageID);							/* Done with the mutex */
 		rc = 0;
 
 	} else {
@@ -1425,7 +2119,7 @@ int TL_ProcessRGB(TL_CAMERA *tl, int frame) {
 	if (tl->color_processor == NULL) return 4;
 
 	/* Get control of the memory buffers */
-	if (WAIT_OBJECT_0 != WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) {
+	if (! tl_lock_images(tl, TL_IMAGE_ACCESS_TIMEOUT, tl->images[frame].imageID)) {
 		rc = 5;										/* Failed to get the semaphore error */
 	} else {
 		/* Convert to true RGB format */
@@ -1442,7 +2136,7 @@ int TL_ProcessRGB(TL_CAMERA *tl, int frame) {
 			tl->rgb24_imageID = tl->images[frame].imageID;
 			rc = 0;
 		}
-		ReleaseMutex(tl->image_mutex);												/* Done with the mutex */
+		tl_unlock_images(tl, tl->images[frame].imageID);						/* Done with the mutex */
 	}
 
 	return rc;
@@ -1507,7 +2201,7 @@ BITMAPINFOHEADER *TL_CreateDIB(TL_CAMERA *tl, int frame, int *rc) {
 	/* Get access to the mutex semaphore for the data processing */
 	/* and save data reversing row sequence and byte sequence (colors / rotation) */
 	/* Note, the reversal of bits in the rgb24 can be here or in ProcessRGB24 */
-	if (WAIT_OBJECT_0 != WaitForSingleObject(tl->image_mutex, TL_IMAGE_ACCESS_TIMEOUT)) {
+	if (! tl_lock_images(tl, TL_IMAGE_ACCESS_TIMEOUT, tl->rgb24_imageID)) {
 		*rc = 5;
 		return NULL;
 	} else {
@@ -1528,7 +2222,7 @@ BITMAPINFOHEADER *TL_CreateDIB(TL_CAMERA *tl, int frame, int *rc) {
 		}
 	}
 
-	ReleaseMutex(tl->image_mutex);									/* Done with the mutex */
+	tl_unlock_images(tl, tl->rgb24_imageID);					/* Done with the mutex */
 	*rc = 0;
 	return bmih;
 }
@@ -1554,6 +2248,7 @@ int TL_GetImageInfo(TL_CAMERA *tl, int frame, IMAGE_INFO *info) {
 
 	TL_IMAGE *image;
 	float R,G,B;
+	int imageID;
 
 /* Must be valid structure */
 	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC) return 1;
@@ -1566,6 +2261,8 @@ int TL_GetImageInfo(TL_CAMERA *tl, int frame, IMAGE_INFO *info) {
 	/* Point to the appropriate image */
 	image = &tl->images[frame];
 	image->locks++;														/* Lock (or more lock) iamge */
+	imageID = image->imageID;
+	MemoryBarrier();
 
 	info->type         = CAMERA_TL;
 	info->frame        = frame;
@@ -1573,7 +2270,10 @@ int TL_GetImageInfo(TL_CAMERA *tl, int frame, IMAGE_INFO *info) {
 	info->camera_time  = image->camera_time;						/* Higher resolution time */
 	info->width        = tl->width;
 	info->height       = tl->height;
-	info->memory_pitch = 2*tl->height;								/* 2 bytes, and no padding */
+	info->memory_pitch = 2*tl->width;								/* 2 bytes, and no padding */
+	info->bin          = tl->bin;
+	info->x_pixel_um   = tl->pixel_width_um  * tl->bin;
+	info->y_pixel_um   = tl->pixel_height_um * tl->bin;
 	info->exposure     = image->ms_expose;
 	info->gamma        = 1.0;
 	info->master_gain  = image->dB_gain;
@@ -1586,6 +2286,10 @@ int TL_GetImageInfo(TL_CAMERA *tl, int frame, IMAGE_INFO *info) {
 	info->color_correct_mode     = 0;
 	info->color_correct_strength = 1.0;
 
+	/* Unique ID for caching; -1 if the slot was rewritten while we read it */
+	MemoryBarrier();
+	info->imageID = (image->imageID == imageID) ? imageID : -1;
+
 	image->locks--;
 	return 0;
 }
@@ -1632,6 +2336,46 @@ int TL_GetImageData(TL_CAMERA *tl, int frame, void **image_data, size_t *length)
 }
 
 
+/* ===========================================================================
+-- Describe the pixel layout of a specific image for the generic kernels
+--
+-- Usage: int TL_GetImageBuffer(TL_CAMERA *tl, int frame, IMAGE_BUFFER *buffer);
+--
+-- Inputs: tl     - an opened TL camera
+--         frame  - index of frame to image (-1 = current)
+--                    invalid frame return error (rc = 2)
+--         buffer - pointer to structure to receive the description
+--
+-- Output: *buffer - format (PIXEL_BAYER16 or PIXEL_MONO16), size, pitch,
+--                   bit depth and pointer to the raw ring buffer (shared)
+--
+-- Return: 0 if successful, 
+--           1 => no camera initialized
+--           2 => frame invalid
+=========================================================================== */
+int TL_GetImageBuffer(TL_CAMERA *tl, int frame, IMAGE_BUFFER *buffer) {
+	static char *rname = "TL_GetImageBuffer";
+
+	if (buffer != NULL) memset(buffer, 0, sizeof(*buffer));
+
+	/* Must be valid structure */
+	if (tl == NULL || tl->magic != TL_CAMERA_MAGIC) return 1;
+	
+	if (frame == -1) frame = tl->iLast;								/* Last image */
+	if (frame < 0 || frame > tl->nValid) return 2;
+	if (buffer == NULL) return 0;
+
+	buffer->format    = tl->IsSensorColor ? PIXEL_BAYER16 : PIXEL_MONO16 ;
+	buffer->width     = tl->width;
+	buffer->height    = tl->height;
+	buffer->pitch     = tl->width * sizeof(unsigned short);				/* raw is always 16-bit, no padding */
+	buffer->bit_depth = tl->bit_depth;
+	buffer->data      = (void *) tl->images[frame].raw;
+	buffer->cfa_phase = (CFA_PHASE) tl->color_filter;
+
+	return 0;
+}
+
 /* ===========================================================================
 -- Determine formats that camera supports for writing
 --
@@ -1859,7 +2603,7 @@ int TL_SaveRawImage(TL_CAMERA *tl, char *path, int frame) {
 	header.width		  = tl->width;				header.height		  = tl->height;
 	header.bit_depth    = tl->bit_depth;
 	header.pixel_bytes  = tl->pixel_bytes;		header.image_bytes  = tl->image_bytes;
-	header.pixel_width  = tl->pixel_width_um;	header.pixel_height = tl->pixel_height_um;
+	header.pixel_width  = tl->pixel_width_um * tl->bin;	header.pixel_height = tl->pixel_height_um * tl->bin;
 
 	if ( (fopen_s(&funit, path, "wb")) != 0) {
 		fprintf(stderr, "[%s] Failed to open \"%s\"\n", rname, path); fflush(stderr);
@@ -16,13 +16,14 @@ typedef struct _TL_IMAGE {
 	int locks;											/* # buffer locks; 0 => availble	*/
 	struct _TL_CAMERA *tl;							/* If we need other info			*/
 
-	int imageID;										/* Unique ID of image (# since start) */
+	volatile int imageID;							/* Unique ID of image (# since start); -1 while rewritten */
 	unsigned short *raw;								/* Buffer with the raw data		*/
 	double camera_time;								/* Camera pixel clock timestamp	*/
+	double host_time;									/* TL_HostTime() at arrival (same clock for all cameras) */
 	__time64_t timestamp;							/* time() value						*/
 	SYSTEMTIME system_time;							/* Include millisecond time		*/
-	double dB_gain;									/* Master gain in dB					*/
-	double ms_expose;									/* ms exposure (also us_expose)	*/
+	double dB_gain;									/* Master gain in dB (setting at arrival)		*/
+	double ms_expose;									/* ms exposure (setting at arrival, not necessarily the frame's) */
 } TL_IMAGE;
 #pragma pack()
 
@@ -49,6 +50,10 @@ typedef struct _TL_RAW_FILE_HEADER {
 } TL_RAW_FILE_HEADER;
 #pragma pack()
 
+/* Optional in-line processing as each frame is copied into the ring (see TL_SetFrameFilter) */
+/* imageID lines the frame up with setting changes (Camera_ApplySettings bound) */
+/* Returns 0 if it filled dst, !0 to fall back to a plain copy */
+typedef int (*TL_FRAME_FILTER)(void *context, const unsigned short *src, unsigned short *dst, int width, int height, int imageID);
 
 /* Structure use for communicating ring size information in client/server */
 #ifndef INCLUDE_TL_DETAIL_INFO
@@ -86,8 +91,17 @@ typedef struct _TL_RAW_FILE_HEADER {
 				int x,y;
 			} ul_min, ul_max, lr_min, lr_max;
 		} roi;
-		int width, height;									/* Image size							*/
+		int width, height;									/* Image size (binned)				*/
 		int bit_depth;											/* Bit depth							*/
+
+		/* Binning (see TL_SetBinning) */
+		int bin;													/* Total factor (1 ==> none)		*/
+		int hw_bin, sw_bin;									/* Parts done by the sensor / callback */
+		int raw_width, raw_height;							/* Size of frames from the SDK	*/
+		unsigned short *bin_buffer;						/* Binned frame staged ahead of the ring */
+		int bin_alloc;											/* Bytes allocated for bin_buffer */
+		uint32_t *bin_sums;									/* IP_Bin16 column totals (raw_width) */
+		int bin_nsums;											/* Entries allocated in bin_sums */
 		
 		BOOL bGainControl;									/* Has master gain control?		*/
 		double db_min, db_max;								/* Min/max gain in dB */
@@ -120,6 +134,21 @@ typedef struct _TL_RAW_FILE_HEADER {
 		double dB_gain;										/* Master gain in dB					*/
 		double ms_expose;										/* ms exposure (also us_expose)	*/
 		
+		/* Per-camera image IDs and capture counts (only this camera's callback changes them) */
+		volatile long image_count;							/* One past the newest imageID	*/
+		volatile long frames_received;					/* Callbacks since opened			*/
+		volatile long frames_stored;						/* Copied into the ring				*/
+		volatile long frames_skipped;						/* Suspended or over fps_limit	*/
+		volatile long frames_missed;						/* Ring mutex not available (or binning failed) */
+		double host_time;										/* TL_HostTime() of newest stored frame */
+
+		/* Discovery (see TL_FindAllCameras) */
+		BOOL bDetailed;										/* Properties queried from camera (else from cache) */
+		BOOL bCached;											/* Properties were found in the cache */
+		int query_rc;											/* 0 or error from the last open/query */
+		HANDLE query_done;									/* Signaled when no query is running */
+		CRITICAL_SECTION info_lock;						/* Orders a query publishing properties with the open */
+
 		/* Ring information */
 		int frame_count;										/* Total number of frames read	*/
 		int nBuffers,											/* Number of frames in the ring	*/
@@ -131,16 +160,22 @@ typedef struct _TL_RAW_FILE_HEADER {
 		TL_IMAGE *images;										/* Image raw data and metadata	*/
 		int npixels;											/* Number of pixels in a frame	*/
 		int nbytes_raw;										/* Number of bytes in each frame */
+		int nbytes_slot;										/* Bytes allocated for each ring buffer (full sensor) */
 
 		int rgb24_imageID;									/* ImageID of current rgb24 data	*/
 		int rgb24_nbytes;										/* Number of bytes in rgb24 data	*/
+		int rgb24_alloc;										/* Bytes allocated for rgb24		*/
 		unsigned char *rgb24;								/* rgb32 image RGBQUAD (4xh*2)	*/
 		
 		int separations_imageID;							/* ImageID of current separation data	*/
 		int nbytes_red, nbytes_green, nbytes_blue;	/* Number of bytes in sub-chans	*/
+		int nalloc_separations;								/* Bytes allocated for each sub-chan */
 		unsigned short *red, *green, *blue;				/* Inidividual channels */
 		
 		HANDLE new_image_signals[TL_MAX_SIGNALS];		/* Handles to event semaphores	*/
+
+		TL_FRAME_FILTER frame_filter;						/* Replaces the raw copy if !NULL */
+		void *frame_filter_context;						/* Passed to the filter				*/
 		
 } TL_CAMERA;
 #endif		/* #ifdef INCLUDE_MINIMAL_TL */
@@ -160,6 +195,7 @@ int tl_camera_count;
 int TL_Initialize(void);
 int TL_SetDebug(BOOL debug);
 int TL_SetDebugLog(FILE *fdebug);
+int TL_SetCacheFile(char *path);
 int TL_Shutdown(void);
 
 /* Find  initializes structures with minimal resources  */
@@ -172,6 +208,8 @@ int TL_OpenCamera(TL_CAMERA *tl, int nBuf);
 int TL_CloseCamera(TL_CAMERA *tl);
 int TL_SetROIMode(TL_CAMERA *tl, int mode);
 int TL_SetROI(TL_CAMERA *tl, int ulx, int uly, int lrx, int lry);
+int TL_SetBinning(TL_CAMERA *tl, int bin, BOOL bSoftware);
+int TL_GetBinning(TL_CAMERA *tl, BINNING_INFO *info);
 
 int TL_GetCameraName(TL_CAMERA *tl, char *name, size_t length);
 int TL_SetCameraName(TL_CAMERA *tl, char *name);
@@ -187,6 +225,9 @@ int TL_ForgetAllCameras(void);
 TL_CAMERA *TL_FindCameraByIndex(int index);
 TL_CAMERA *TL_FindCameraByID(char *ID);
 TL_CAMERA *TL_FindCameraByHandle(void *handle);
+double TL_HostTime(void);
+int TL_NextImageID(BOOL bTake);
+int TL_GetImageCount(TL_CAMERA *tl);
 
 int TL_EnumCameraList(int *pcount, TL_CAMERA **pinfo[]);
 
@@ -196,6 +237,7 @@ int TL_GetCameraInfo(TL_CAMERA *tl, CAMERA_INFO *info);
 
 int TL_AddImageSignal(TL_CAMERA *tl, HANDLE signal);
 int TL_RemoveImageSignal(TL_CAMERA *tl, HANDLE signal);
+int TL_SetFrameFilter(TL_CAMERA *tl, TL_FRAME_FILTER filter, void *context);
 
 int TL_ProcessRGB(TL_CAMERA *tl, int frame);				/* No ties to TL_ProcessRawSeparation */
 int TL_ProcessRawSeparation(TL_CAMERA *tl, int frame);	/* No ties to TL_ProcessRGB */
@@ -204,6 +246,7 @@ BITMAPINFOHEADER *TL_CreateDIB(TL_CAMERA *tl, int frame, int *rc);
 
 int TL_GetImageInfo(TL_CAMERA *tl, int frame, IMAGE_INFO *info);
 int TL_GetImageData(TL_CAMERA *tl, int frame, void **image_data, size_t *length);
+int TL_GetImageBuffer(TL_CAMERA *tl, int frame, IMAGE_BUFFER *buffer);
 
 int TL_GetSaveFormatFlag(TL_CAMERA *tl);
 int TL_GetSaveName(char *path, size_t length, FILE_FORMAT *format);